@@ -0,0 +1,183 @@
+#include <nvs_flash.h>
+#include <esp_log.h>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include "Periph/Bluetooth.h"
+#include "BLE/GAP.h"
+#include "BLE/Server.h"
+#include "BLE/ConMan.h"
+#include "Util/Threaded.h"
+#include "Util/stdafx.h"
+
+/**
+ * BLE link benchmark, for comparing MTU, data length, PHY and connection interval settings.
+ *
+ * One service with a notifiable TX char and a write / write-without-response RX char. Every TX notification starts
+ * with a type byte, every write to RX too:
+ *  - TX 'F' + filler: flood, sent back to back while enabled
+ *  - TX 'P' + u32 seq + u32 time [us]: ping, once per second. The central writes it back unchanged.
+ *  - RX 'P' ...: the echoed ping, gives the round-trip time
+ *  - RX 'F' + u8: flood off (0) or on (1)
+ *  - RX anything else: counted as sink throughput
+ *
+ * Once per second prints TX and RX throughput, notifications per connection event, ping round trip and the link
+ * parameters over serial.
+ */
+
+static constexpr esp_bt_uuid_t ServiceUID = {
+		.len = ESP_UUID_LEN_128,
+		.uuid = { .uuid128 = { 0x3C, 0x1B, 0x6A, 0x52, 0x8D, 0x40, 0x2F, 0x93, 0x54, 0x4B, 0x43, 0x43, 0x01, 0x00, 0x5E, 0xB3 }}
+};
+
+static constexpr esp_bt_uuid_t RxCharUID = {
+		.len = ESP_UUID_LEN_128,
+		.uuid = { .uuid128 = { 0x3C, 0x1B, 0x6A, 0x52, 0x8D, 0x40, 0x2F, 0x93, 0x54, 0x4B, 0x43, 0x43, 0x02, 0x00, 0x5E, 0xB3 }}
+};
+
+static constexpr esp_bt_uuid_t TxCharUID = {
+		.len = ESP_UUID_LEN_128,
+		.uuid = { .uuid128 = { 0x3C, 0x1B, 0x6A, 0x52, 0x8D, 0x40, 0x2F, 0x93, 0x54, 0x4B, 0x43, 0x43, 0x03, 0x00, 0x5E, 0xB3 }}
+};
+
+static constexpr size_t FloodSize = 244; // [B] fills one 251 B LL PDU with the 247 B MTU phones negotiate
+static constexpr uint32_t ReportInterval = 1000; // [ms]
+
+static std::shared_ptr<BLE::Server::Char> txChar;
+static std::shared_ptr<BLE::Server::Char> rxChar;
+
+static std::atomic_bool flood = true;
+static std::atomic_uint32_t txBytes = 0, txPackets = 0;
+static std::atomic_uint32_t rxBytes = 0, rxPackets = 0;
+
+struct Rtt {
+	uint32_t count = 0;
+	uint32_t min = UINT32_MAX;
+	uint32_t max = 0;
+	uint64_t sum = 0;
+};
+static Rtt rtt; // [us]
+static portMUX_TYPE rttMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t pingSeq = 0;
+
+static void sendPing(){
+	uint8_t ping[9] = { 'P' };
+	const uint32_t time = (uint32_t) micros();
+	const uint32_t seq = pingSeq++;
+	memcpy(ping + 1, &seq, sizeof(seq));
+	memcpy(ping + 5, &time, sizeof(time));
+	txChar->sendNotif(ping, sizeof(ping));
+}
+
+static void onWrite(const std::vector<uint8_t>& data){
+	if(data.empty()) return;
+
+	if(data[0] == 'P' && data.size() >= 9){
+		uint32_t sent;
+		memcpy(&sent, data.data() + 5, sizeof(sent));
+		const uint32_t time = (uint32_t) micros() - sent;
+
+		portENTER_CRITICAL(&rttMux);
+		rtt.count++;
+		rtt.min = std::min(rtt.min, time);
+		rtt.max = std::max(rtt.max, time);
+		rtt.sum += time;
+		portEXIT_CRITICAL(&rttMux);
+	}else if(data[0] == 'F' && data.size() >= 2){
+		flood = data[1] != 0;
+		printf("Flood %s\n", flood ? "on" : "off");
+	}else{
+		rxBytes += data.size();
+		rxPackets++;
+	}
+}
+
+static void report(uint32_t elapsed){
+	const uint32_t tx = txBytes.exchange(0), txN = txPackets.exchange(0);
+	const uint32_t rx = rxBytes.exchange(0), rxN = rxPackets.exchange(0);
+
+	portENTER_CRITICAL(&rttMux);
+	const Rtt r = rtt;
+	rtt = {};
+	portEXIT_CRITICAL(&rttMux);
+
+	const auto link = ConMan.getLink();
+	const float interval = link.interval * 1.25f; // [ms]
+	const float seconds = (float) elapsed / 1000.0f;
+	const float perEvent = interval > 0 ? ((float) txN / seconds) * interval / 1000.0f : 0;
+
+	printf("TX %7.0f B/s %5.0f notif/s %5.2f per event | RX %7.0f B/s %5.0f writes/s", tx / seconds, txN / seconds, perEvent, rx / seconds, rxN / seconds);
+	if(r.count > 0){
+		printf(" | RTT min %6lu avg %6lu max %6lu [us]", r.min, (uint32_t) (r.sum / r.count), r.max);
+	}else{
+		printf(" | RTT -");
+	}
+
+	auto phy = [](uint8_t phy){ return phy == ESP_BLE_GAP_PHY_2M ? "2M" : (phy == ESP_BLE_GAP_PHY_CODED ? "Coded" : "1M"); };
+	printf(" | int %.2f ms lat %u, DLE %u/%u B, PHY %s/%s\n", interval, link.latency, link.txOctets, link.rxOctets, phy(link.txPhy), phy(link.rxPhy));
+}
+
+void init(){
+	auto ret = nvs_flash_init();
+	if(ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND){
+		ESP_ERROR_CHECK(nvs_flash_erase());
+		ret = nvs_flash_init();
+	}
+	ESP_ERROR_CHECK(ret);
+
+	esp_log_level_set("BLE::Server", ESP_LOG_WARN);
+	esp_log_level_set("BLE::Server::Char", ESP_LOG_WARN);
+
+	auto bt = new Bluetooth();
+	auto gap = new BLE::GAP();
+	auto server = new BLE::Server(gap);
+
+	// TX with the NOTIFY bit first, it gets the service's CCCD
+	auto service = server->addService(ServiceUID);
+	txChar = service->addChar(TxCharUID, ESP_GATT_CHAR_PROP_BIT_NOTIFY);
+	rxChar = service->addChar(RxCharUID, ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR);
+
+	server->start();
+
+	auto rx = new ThreadedClosure([](){
+		auto msg = rxChar->getNextWrite();
+		if(!msg) return;
+		onWrite(msg->data);
+	}, "BenchRX", 3 * 1024, 6);
+	rx->start();
+
+	uint8_t payload[FloodSize];
+	memset(payload, 0x55, sizeof(payload));
+	payload[0] = 'F';
+
+	uint64_t lastPing = millis();
+	uint64_t lastReport = millis();
+
+	for(;;){
+		const uint64_t now = millis();
+
+		if(now - lastPing >= 1000){
+			lastPing = now;
+			sendPing();
+		}
+
+		if(now - lastReport >= ReportInterval){
+			report(now - lastReport);
+			lastReport = now;
+		}
+
+		// sendNotif blocks on the server's TX credits, which paces the flood to what the link takes
+		if(flood && txChar->sendNotif(payload, sizeof(payload))){
+			txBytes += sizeof(payload);
+			txPackets++;
+		}else{
+			delayMillis(10);
+		}
+	}
+}
+
+extern "C" void app_main(void){
+	init();
+	vTaskDelete(nullptr);
+}
@@ -0,0 +1,288 @@
+#include <esp_cpu.h>
+#include <esp_app_desc.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <atomic>
+#include <cstdio>
+#include <dirent.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "Pins.hpp"
+#include "Periph/I2C.h"
+#include "Devices/Display.h"
+#include "LV_Interface/LVGL.h"
+#include "LV_Interface/FSLVGL.h"
+#include "Theme/theme.h"
+#include "Util/Events.h"
+#include "Fusion/Madgwick.h"
+#include "Services/ChirpSystem.h"
+#include "Notifs/GBJson.h"
+#include "Util/Notes.h"
+#include "Util/stdafx.h"
+
+/**
+ * Microbenchmarks of the hot paths, for comparing firmware builds. Every case runs a few untimed warm-up iterations,
+ * then times each iteration on its own in CPU cycles. Results are printed one per line:
+ *
+ * BENCH:begin:<app version>:<ELF SHA-256 prefix>:<CPU MHz>
+ * BENCH:<case>:<iterations>:<min>:<median>:<p99>:<max>    [cycles]
+ * BENCH:end
+ *
+ * The LVGL, event, Madgwick and chirp cases then run a second time with the suffix _flash, while a task on the other
+ * core keeps reading assets from SPIFFS. That evicts the flash cache the way asset loading does in the firmware, so
+ * comparing the two, and builds with and without CONFIG_CM_IRAM_HOT_PATHS, shows how much of the frame time jitter
+ * comes from cache misses. Flash operations themselves hold both cores whatever the placement and mostly show in max.
+ *
+ * The ANCS Data Source parser isn't covered, it only runs inside ANCS::Client against requests in flight over a live
+ * BLE link. The Bangle JSON case runs GBJson the way Bangle::handleLine does.
+ */
+
+static constexpr size_t Warmup = 5;
+static constexpr uint8_t ImuAddr = 0x6A;
+static constexpr uint8_t ImuWhoAmI = 0x0F;
+
+static std::vector<uint32_t> times;
+volatile uint32_t sink; // Keeps results of pure computations from being optimized out
+static const char* suffix = ""; // Appended to case names
+
+template<typename Before, typename F>
+static void run(const char* name, size_t iterations, Before&& before, F&& fn){
+	for(size_t i = 0; i < Warmup; i++){
+		before();
+		fn();
+	}
+
+	times.resize(iterations);
+	for(auto& t : times){
+		before();
+		const uint32_t start = esp_cpu_get_cycle_count();
+		fn();
+		t = esp_cpu_get_cycle_count() - start;
+	}
+
+	std::sort(times.begin(), times.end());
+	printf("BENCH:%s%s:%zu:%lu:%lu:%lu:%lu\n", name, suffix, iterations, times.front(), times[iterations / 2], times[(iterations - 1) * 99 / 100], times.back());
+}
+
+template<typename F>
+static void run(const char* name, size_t iterations, F&& fn){
+	run(name, iterations, [](){}, fn);
+}
+
+// A settings-like list over the theme background, so the frame has text and fills to render
+static void buildScreen(){
+	auto scr = lv_scr_act();
+	lv_obj_set_flex_flow(scr, LV_FLEX_FLOW_COLUMN);
+	lv_obj_set_style_pad_gap(scr, 4, 0);
+	for(int i = 0; i < 6; i++){
+		auto row = lv_obj_create(scr);
+		lv_obj_set_size(row, lv_pct(100), 16);
+		lv_obj_set_style_bg_opa(row, LV_OPA_50, 0);
+		lv_obj_set_style_bg_color(row, lv_color_make(0x81, 0x3d, 0xf5), 0);
+
+		auto label = lv_label_create(row);
+		lv_label_set_text_fmt(label, "Row %d of the list", i);
+		lv_obj_center(label);
+	}
+}
+
+static void benchLVGL(LVGL& lvgl){
+	const auto disp = lvgl.disp();
+	run("lvgl_frame", 100, [disp](){
+		lv_obj_invalidate(lv_scr_act());
+		lv_refr_now(disp);
+	});
+}
+
+static void benchFS(){
+	static constexpr const char* Path = "S:/bg.bin";
+	static uint8_t buf[1024];
+
+	const auto read = [](){
+		lv_fs_file_t file;
+		if(lv_fs_open(&file, Path, LV_FS_MODE_RD) != LV_FS_RES_OK) return;
+
+		uint32_t size;
+		while(lv_fs_read(&file, buf, sizeof(buf), &size) == LV_FS_RES_OK && size > 0){}
+		lv_fs_close(&file);
+	};
+
+	run("fs_read_miss", 20, [](){ FSLVGL::removeFromCache(Path); }, read);
+	read();
+	run("fs_read_hit", 100, read);
+}
+
+static void benchEvents(){
+	struct Payload {
+		uint32_t seq;
+		uint8_t data[12];
+	};
+
+	for(const size_t fanOut : { 1, 4, 8 }){
+		std::vector<std::unique_ptr<EventQueue>> queues;
+		for(size_t i = 0; i < fanOut; i++){
+			queues.push_back(std::make_unique<EventQueue>(4, "Bench"));
+			Events::listen(Facility::Settings, queues.back().get());
+		}
+
+		char name[24];
+		snprintf(name, sizeof(name), "events_post_x%zu", fanOut);
+		Payload payload{};
+		run(name, 500, [&queues](){
+			Event evt;
+			for(const auto& queue : queues){
+				while(queue->get(evt, 0)){}
+			}
+		}, [&payload](){
+			payload.seq++;
+			Events::post(Facility::Settings, payload);
+		});
+
+		for(const auto& queue : queues){
+			Events::unlisten(queue.get());
+		}
+	}
+}
+
+static void benchMadgwick(){
+	static constexpr size_t Samples = 104;
+	static IMU::Sample samples[Samples];
+	for(size_t i = 0; i < Samples; i++){
+		const float t = (float) i / 104.0f;
+		samples[i] = { 0.5f * std::cos(t), 0.3f * std::cos(t * 1.7f), 0.01f, 0.5f * std::sin(t), -0.2f * std::sin(t * 1.7f), -0.8f };
+	}
+
+	Fusion::MadgwickT<float> filter;
+	size_t i = 0;
+	run("madgwick_update", 1000, [&filter, &i](){
+		sink = (uint32_t) filter.update(samples[i++ % Samples]).pitch;
+	});
+}
+
+static void benchChirp(){
+	static constexpr Chirp Melody[] = {
+			{ NOTE_C5, NOTE_E5, 120 }, { 0, 0, 40 }, { NOTE_E5, NOTE_G5, 120 }, { 0, 0, 40 },
+			{ NOTE_G5, NOTE_C6, 200 }, { NOTE_C6, NOTE_C6, 80 }, { NOTE_C6, NOTE_G5, 200 }, { 0, 0, 40 }
+	};
+	static constexpr size_t Segments = ChirpSystem::segmentCount(Melody);
+
+	// Not constexpr, so the compile runs at runtime the way play() compiles a sound only known then
+	static Chirp input[std::size(Melody)];
+	std::copy(std::begin(Melody), std::end(Melody), input);
+
+	run("chirp_compile", 500, [](){
+		const auto sound = ChirpSystem::compile<Segments>(input);
+		sink = sound.segments.back().steps;
+	});
+}
+
+static void benchGBJson(){
+	std::string body;
+	while(body.size() < 256){
+		body += "Lorem ipsum dolor sit amet, ";
+	}
+	const std::string line = "{t:\"notify\",id:1234567,src:\"WhatsApp\",title:atob(\"SmFuZSBEb2U=\"),subject:\"\",body:\"" + body + "\",sender:\"+385991234567\",tel:\"\"}";
+
+	GBJson json;
+	std::string title, text;
+	run("gbjson_notify", 500, [&](){
+		json.parse(line);
+		json.string(GBJson::Title, title);
+		json.string(GBJson::Body, text);
+		sink = title.size() + text.size();
+	});
+}
+
+static void benchI2C(I2C& i2c){
+	uint8_t byte;
+	run("i2c_read_reg", 500, [&i2c, &byte](){
+		i2c.readReg(ImuAddr, ImuWhoAmI, byte);
+	});
+}
+
+static std::atomic_bool flashLoad = false;
+static SemaphoreHandle_t flashLoadDone;
+
+static void flashLoadTask(void*){
+	static uint8_t buf[4096];
+	std::string path;
+
+	while(flashLoad){
+		auto dir = opendir("/spiffs");
+		if(dir == nullptr) break;
+
+		while(flashLoad){
+			auto entry = readdir(dir);
+			if(entry == nullptr) break;
+
+			// Straight through the VFS, FSLVGL would serve cached files from RAM
+			path = std::string("/spiffs/") + entry->d_name;
+			auto file = fopen(path.c_str(), "rb");
+			if(file == nullptr) continue;
+			while(flashLoad && fread(buf, 1, sizeof(buf), file) > 0){}
+			fclose(file);
+		}
+
+		closedir(dir);
+	}
+
+	xSemaphoreGive(flashLoadDone);
+	vTaskDelete(nullptr);
+}
+
+static void startFlashLoad(){
+	flashLoad = true;
+	xTaskCreatePinnedToCore(flashLoadTask, "FlashLoad", 4096, nullptr, 1, nullptr, !xPortGetCoreID());
+}
+
+static void stopFlashLoad(){
+	flashLoad = false;
+	xSemaphoreTake(flashLoadDone, portMAX_DELAY);
+}
+
+void init(){
+	auto i2c = new I2C(I2C_NUM_0, (gpio_num_t) Pins::get(Pin::I2cSda), (gpio_num_t) Pins::get(Pin::I2cScl));
+
+	auto display = new Display();
+	auto lvgl = new LVGL(*display);
+	lv_disp_set_theme(lvgl->disp(), theme_init(lvgl->disp()));
+	new FSLVGL('S');
+	buildScreen();
+	flashLoadDone = xSemaphoreCreateBinary();
+
+	char sha[17];
+	esp_app_get_elf_sha256(sha, sizeof(sha));
+
+	for(;;){
+		printf("BENCH:begin:%s:%s:%d\n", esp_app_get_description()->version, sha, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+
+		benchLVGL(*lvgl);
+		benchFS();
+		benchEvents();
+		benchMadgwick();
+		benchChirp();
+		benchGBJson();
+		benchI2C(*i2c);
+
+		suffix = "_flash";
+		startFlashLoad();
+		benchLVGL(*lvgl);
+		benchEvents();
+		benchMadgwick();
+		benchChirp();
+		stopFlashLoad();
+		suffix = "";
+
+		printf("BENCH:end\n\n");
+		delayMillis(2000);
+	}
+}
+
+extern "C" void app_main(void){
+	init();
+	vTaskDelete(nullptr);
+}
@@ -0,0 +1,79 @@
+#include <driver/gpio.h>
+#include <esp_heap_caps.h>
+#include "Pins.hpp"
+#include "Periph/PinOut.h"
+#include "Devices/Display.h"
+#include "Util/stdafx.h"
+
+/**
+ * Measures display push throughput in pixels per second, pushing a frame in LVGL-sized stripes.
+ * Compares the converted path (uint16_t, what LVGL::flush used to pass) with the native panel format path (swap565_t),
+ * both blocking and over DMA.
+ */
+
+static constexpr int Width = 128;
+static constexpr int Height = 128;
+static constexpr int StripeRows = 16;
+static constexpr int Frames = 200;
+
+enum class Mode { Converted, Native };
+
+void bench(LGFX_Device& lgfx, uint16_t* buf, Mode mode, bool dma){
+	lgfx.startWrite();
+
+	const auto start = micros();
+	for(int frame = 0; frame < Frames; frame++){
+		for(int y = 0; y < Height; y += StripeRows){
+			if(mode == Mode::Native){
+				auto data = (const lgfx::swap565_t*) buf;
+				if(dma){
+					lgfx.pushImageDMA(0, y, Width, StripeRows, data);
+				}else{
+					lgfx.pushImage(0, y, Width, StripeRows, data);
+				}
+			}else{
+				if(dma){
+					lgfx.pushImageDMA(0, y, Width, StripeRows, buf);
+				}else{
+					lgfx.pushImage(0, y, Width, StripeRows, buf);
+				}
+			}
+		}
+	}
+	lgfx.waitDMA();
+	const auto duration = micros() - start;
+
+	lgfx.endWrite();
+
+	const uint64_t pixels = (uint64_t) Frames * Width * Height;
+	printf("%-9s %-8s: %7llu px/s, %5.2f ms/frame\n", mode == Mode::Native ? "native" : "converted", dma ? "DMA" : "blocking",
+		   pixels * 1000000 / duration, (double) duration / Frames / 1000.0);
+}
+
+void init(){
+	auto bl = new PinOut(Pins::get(Pin::LedBl), true);
+	bl->on();
+
+	auto display = new Display();
+	auto& lgfx = display->getLGFX();
+
+	auto buf = (uint16_t*) heap_caps_malloc(Width * StripeRows * sizeof(uint16_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+	for(int i = 0; i < Width * StripeRows; i++){
+		buf[i] = (i % Width) < Width / 2 ? 0x1F00 : 0xE007; // byte-swapped blue / green
+	}
+
+	for(;;){
+		bench(lgfx, buf, Mode::Converted, false);
+		bench(lgfx, buf, Mode::Native, false);
+		bench(lgfx, buf, Mode::Converted, true);
+		bench(lgfx, buf, Mode::Native, true);
+		printf("\n");
+
+		delayMillis(2000);
+	}
+}
+
+extern "C" void app_main(void){
+	init();
+	vTaskDelete(nullptr);
+}
@@ -0,0 +1,130 @@
+#include <esp_cpu.h>
+#include <esp_random.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include "Fusion/Madgwick.h"
+#include "Fusion/Mahony.h"
+#include "Util/stdafx.h"
+
+/**
+ * Runs Madgwick and Mahony over the same synthetic IMU stream in double (the reference), float and Q20 fixed point.
+ * Prints CPU cycles per update and how far the pitch and roll of each variant drift from the double reference,
+ * and the cycles per sample of the batched update over FIFO-sized batches.
+ */
+
+static constexpr size_t Samples = 1040; // 10 s at 104 Hz
+static constexpr float Rate = 104.0f; // [Hz]
+static constexpr size_t Batch = 16; // [samples]
+
+struct Error {
+	float max = 0;
+	float sumSq = 0;
+};
+
+static float angleDiff(float a, float b){
+	float d = std::fmod(a - b + 540.0f, 360.0f) - 180.0f;
+	return std::fabs(d);
+}
+
+// Slow wrist-like tilting around X and Y with some sensor noise, gravity reads -1 g on Z when flat
+static void generate(IMU::Sample* samples){
+	for(size_t i = 0; i < Samples; i++){
+		const float t = (float) i / Rate;
+		const float pitch = 0.6f * std::sin(t * 0.9f);
+		const float roll = 0.4f * std::sin(t * 1.7f + 0.5f);
+		const float dPitch = 0.6f * 0.9f * std::cos(t * 0.9f);
+		const float dRoll = 0.4f * 1.7f * std::cos(t * 1.7f + 0.5f);
+
+		auto noise = [](){ return ((float) (esp_random() % 2001) - 1000.0f) / 100000.0f; };
+
+		samples[i] = {
+				dRoll + noise(),
+				dPitch + noise(),
+				noise(),
+				std::sin(pitch) + noise(),
+				-std::sin(roll) * std::cos(pitch) + noise(),
+				-std::cos(roll) * std::cos(pitch) + noise()
+		};
+	}
+}
+
+template<typename F>
+uint32_t run(const IMU::Sample* samples, Fusion::Orient* out){
+	F filter;
+
+	const uint32_t start = esp_cpu_get_cycle_count();
+	for(size_t i = 0; i < Samples; i++){
+		out[i] = filter.update(samples[i]);
+	}
+	const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+	return cycles / Samples;
+}
+
+template<typename F>
+uint32_t runBatched(const IMU::Sample* samples){
+	F filter;
+
+	const uint32_t start = esp_cpu_get_cycle_count();
+	for(size_t i = 0; i < Samples; i += Batch){
+		filter.update(samples + i, std::min(Batch, Samples - i));
+	}
+	const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+	return cycles / Samples;
+}
+
+template<typename F>
+void bench(const char* name, const IMU::Sample* samples, const Fusion::Orient* ref, Fusion::Orient* out){
+	const uint32_t cycles = run<F>(samples, out);
+
+	Error pitch, roll;
+	for(size_t i = 0; i < Samples; i++){
+		const float p = angleDiff(out[i].pitch, ref[i].pitch);
+		const float r = angleDiff(out[i].roll, ref[i].roll);
+		pitch.max = std::max(pitch.max, p);
+		roll.max = std::max(roll.max, r);
+		pitch.sumSq += p * p;
+		roll.sumSq += r * r;
+	}
+
+	printf("%-16s: %6lu cycles/update, %6lu batched, pitch err max %7.4f rms %7.4f, roll err max %7.4f rms %7.4f [deg]\n", name,
+		   cycles, runBatched<F>(samples), pitch.max, std::sqrt(pitch.sumSq / Samples), roll.max, std::sqrt(roll.sumSq / Samples));
+}
+
+template<template<typename> typename F>
+void benchFilter(const char* name, const IMU::Sample* samples, Fusion::Orient* ref, Fusion::Orient* out){
+	char label[32];
+
+	const uint32_t cycles = run<F<double>>(samples, ref);
+	snprintf(label, sizeof(label), "%s double", name);
+	printf("%-16s: %6lu cycles/update, %6lu batched (reference)\n", label, cycles, runBatched<F<double>>(samples));
+
+	snprintf(label, sizeof(label), "%s float", name);
+	bench<F<float>>(label, samples, ref, out);
+
+	snprintf(label, sizeof(label), "%s Q20", name);
+	bench<F<Fusion::Q20>>(label, samples, ref, out);
+}
+
+void init(){
+	auto samples = std::make_unique<IMU::Sample[]>(Samples);
+	auto ref = std::make_unique<Fusion::Orient[]>(Samples);
+	auto out = std::make_unique<Fusion::Orient[]>(Samples);
+
+	for(;;){
+		generate(samples.get());
+
+		benchFilter<Fusion::MadgwickT>("Madgwick", samples.get(), ref.get(), out.get());
+		benchFilter<Fusion::MahonyT>("Mahony", samples.get(), ref.get(), out.get());
+		printf("\n");
+
+		delayMillis(2000);
+	}
+}
+
+extern "C" void app_main(void){
+	init();
+	vTaskDelete(nullptr);
+}
@@ -0,0 +1,87 @@
+#include <esp_timer.h>
+#include <algorithm>
+#include "Pins.hpp"
+#include "Periph/I2C.h"
+#include "Util/stdafx.h"
+
+/**
+ * Per-register read latency on the shared bus: single register reads of the IMU and the RTC, a six register burst
+ * the way the IMU output registers are read, and the same single reads submitted back to back so queueing overlaps
+ * the callers. Prints min/avg/p99/max per case and the bus report.
+ */
+
+static constexpr size_t Rounds = 500;
+static constexpr uint8_t ImuAddr = 0x6A;
+static constexpr uint8_t ImuWhoAmI = 0x0F;
+static constexpr uint8_t ImuOutputs = 0x22; // OUTX_L_G, six registers of gyro output
+static constexpr uint8_t RtcAddr = 0x51;
+static constexpr uint8_t RtcSeconds = 0x02;
+
+static uint32_t times[Rounds];
+
+static void report(const char* name, size_t failed){
+	std::sort(times, times + Rounds);
+	uint64_t sum = 0;
+	for(auto t : times){
+		sum += t;
+	}
+	printf("%-20s min %4lu us, avg %4llu us, p99 %4lu us, max %5lu us%s\n", name, times[0], sum / Rounds,
+		   times[(Rounds - 1) * 99 / 100], times[Rounds - 1], failed ? " (failed reads)" : "");
+}
+
+template<typename F>
+static void measure(const char* name, F&& fn){
+	size_t failed = 0;
+	for(auto& t : times){
+		const uint64_t start = esp_timer_get_time();
+		if(fn() != ESP_OK){
+			failed++;
+		}
+		t = (uint32_t) (esp_timer_get_time() - start);
+	}
+	report(name, failed);
+}
+
+void init(){
+	auto i2c = new I2C(I2C_NUM_0, (gpio_num_t) Pins::get(Pin::I2cSda), (gpio_num_t) Pins::get(Pin::I2cScl));
+
+	for(;;){
+		uint8_t byte;
+		uint8_t burst[6];
+
+		measure("IMU register", [i2c, &byte](){ return i2c->readReg(ImuAddr, ImuWhoAmI, byte); });
+		measure("IMU 6 registers", [i2c, &burst](){ return i2c->readReg(ImuAddr, ImuOutputs, burst, sizeof(burst)); });
+		measure("RTC register", [i2c, &byte](){ return i2c->readReg(RtcAddr, RtcSeconds, byte); });
+
+		// Queued without waiting, timed from submitting to their completion callbacks
+		static constexpr size_t Batch = 8;
+		static uint8_t results[Batch];
+		for(size_t round = 0; round < Rounds; round += Batch){
+			SemaphoreHandle_t done = xSemaphoreCreateCounting(Batch, 0);
+			const uint64_t start = esp_timer_get_time();
+			for(size_t i = 0; i < Batch; i++){
+				const uint8_t reg = ImuWhoAmI;
+				i2c->submit({ .addr = ImuAddr, .wbuf = &reg, .wsize = 1, .rbuf = &results[i], .rsize = 1, .callback = [done, start, round, i](esp_err_t){
+					times[round + i] = (uint32_t) (esp_timer_get_time() - start);
+					xSemaphoreGive(done);
+				}});
+			}
+			for(size_t i = 0; i < Batch; i++){
+				xSemaphoreTake(done, portMAX_DELAY);
+			}
+			vSemaphoreDelete(done);
+		}
+		report("IMU submitted x8", 0);
+
+		i2c->printReport([](const char* line){ printf("%s", line); });
+		i2c->resetStats();
+		printf("\n");
+
+		delayMillis(2000);
+	}
+}
+
+extern "C" void app_main(void){
+	init();
+	vTaskDelete(nullptr);
+}
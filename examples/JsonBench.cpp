@@ -0,0 +1,111 @@
+#include <esp_cpu.h>
+#include <mjson.h>
+#include <mbedtls/base64.h>
+#include <string>
+#include "Notifs/GBJson.h"
+#include "Util/stdafx.h"
+
+/**
+ * Extracts the fields of Gadgetbridge notify commands of growing body length, once with one mjson_find per field
+ * (the way Bangle used to) and once with a single GBJson pass. Prints CPU cycles per command for both and checks that
+ * they extracted the same strings.
+ *
+ * The mjson side only copies and base64 decodes, it leaves out the unescaping GBJson also does, so it's the lower
+ * bound of what the old path cost.
+ */
+
+static constexpr size_t Rounds = 200;
+static constexpr size_t BodySizes[] = { 16, 128, 512, 2048 }; // [B]
+
+struct Fields {
+	double id = 0;
+	std::string src, title, body, sender;
+};
+
+static std::string makeCommand(size_t bodySize){
+	std::string body;
+	while(body.size() < bodySize){
+		body += "Lorem ipsum dolor sit amet, ";
+	}
+	body.resize(bodySize);
+
+	// "Jane Doe" in base64, the way Gadgetbridge sends titles with non-ASCII characters
+	return "{t:\"notify\",id:1234567,src:\"WhatsApp\",title:atob(\"SmFuZSBEb2U=\"),subject:\"\",body:\"" + body + "\",sender:\"+385991234567\",tel:\"\"}";
+}
+
+static std::string mjsonString(const std::string& line, const char* path){
+	int len;
+	const char* val;
+
+	const int tok = mjson_find(line.c_str(), line.size(), path, &val, &len);
+	if(tok == MJSON_TOK_B64){
+		size_t outLen = 0;
+		mbedtls_base64_decode(nullptr, 0, &outLen, (const unsigned char*) val + 1, len - 2);
+
+		std::string decoded(outLen, '\0');
+		if(mbedtls_base64_decode((unsigned char*) decoded.data(), decoded.size(), &outLen, (const unsigned char*) val + 1, len - 2) != 0) return {};
+		decoded.resize(outLen);
+		return decoded;
+	}else if(tok == MJSON_TOK_STRING){
+		return std::string(val + 1, val + len - 1);
+	}
+
+	return {};
+}
+
+static Fields viaMjson(const std::string& line){
+	Fields fields;
+	mjson_get_number(line.c_str(), line.size(), "$.id", &fields.id);
+	fields.src = mjsonString(line, "$.src");
+	fields.title = mjsonString(line, "$.title");
+	fields.body = mjsonString(line, "$.body");
+	fields.sender = mjsonString(line, "$.sender");
+	return fields;
+}
+
+static Fields viaGBJson(GBJson& json, const std::string& line){
+	Fields fields;
+	json.parse(line);
+	json.number(GBJson::Id, fields.id);
+	json.string(GBJson::Src, fields.src);
+	json.string(GBJson::Title, fields.title);
+	json.string(GBJson::Body, fields.body);
+	json.string(GBJson::Sender, fields.sender);
+	return fields;
+}
+
+template<typename F>
+static uint32_t measure(F&& fn){
+	const uint32_t start = esp_cpu_get_cycle_count();
+	for(size_t i = 0; i < Rounds; i++){
+		fn();
+	}
+	return (esp_cpu_get_cycle_count() - start) / Rounds;
+}
+
+void init(){
+	GBJson json;
+
+	for(;;){
+		for(auto size : BodySizes){
+			const auto line = makeCommand(size);
+
+			const auto ref = viaMjson(line);
+			const auto res = viaGBJson(json, line);
+			const bool same = ref.id == res.id && ref.src == res.src && ref.title == res.title && ref.body == res.body && ref.sender == res.sender;
+
+			const uint32_t mjson = measure([&line](){ viaMjson(line); });
+			const uint32_t single = measure([&json, &line](){ viaGBJson(json, line); });
+
+			printf("body %4zu B, line %4zu B: mjson %7lu cycles, GBJson %7lu cycles, %.2fx%s\n", size, line.size(), mjson, single, (float) mjson / (float) single, same ? "" : " MISMATCH");
+		}
+		printf("\n");
+
+		delayMillis(2000);
+	}
+}
+
+extern "C" void app_main(void){
+	init();
+	vTaskDelete(nullptr);
+}
@@ -0,0 +1,463 @@
+#include <driver/gpio.h>
+#include <nvs_flash.h>
+#include <esp_app_desc.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Settings/Settings.h"
+#include "Pins.hpp"
+#include "PWMChannels.hpp"
+#include "Periph/I2C.h"
+#include "Periph/Bluetooth.h"
+#include "Devices/Display.h"
+#include "Devices/Input.h"
+#include "Devices/IMU.h"
+#include "Devices/BatteryV2.h"
+#include "BLE/GAP.h"
+#include "BLE/Client.h"
+#include "BLE/Server.h"
+#include "Notifs/Phone.h"
+#include "LV_Interface/LVGL.h"
+#include "LV_Interface/FSLVGL.h"
+#include "LV_Interface/InputLVGL.h"
+#include "Theme/theme.h"
+#include "Util/Services.h"
+#include "Services/BacklightBrightness.h"
+#include "Services/ChirpSystem.h"
+#include "Services/PCMAudio.h"
+#include "Services/Time.h"
+#include "Services/RTCTelemetry.h"
+#include "Services/PowerTelemetry.h"
+#include "Services/IMUStream.h"
+#include "Services/Orientation.h"
+#include "Services/IMUCalibrator.h"
+#include "Services/StatusCenter.h"
+#include "Services/SleepMan.h"
+#include "Screens/MainMenu/MainMenu.h"
+#include "Screens/Lock/LockScreen.h"
+#include "Screens/Level.h"
+#include "Screens/PongGame.h"
+#include "Util/stdafx.h"
+
+/**
+ * Performance regression harness. Brings the firmware up like main.cpp, with the buttons, the IMU and the phone
+ * replaced by scripts, then drives the real screens through each scenario and times every frame pushed meanwhile.
+ *
+ * Inputs are marked when they're injected and their latency runs to the end of the first frame that started after
+ * them, the way LVProfiler measures it. Button scripts are posted on Facility::Input like Input posts them, IMU traces
+ * go through IMU::inject into Orientation and IMUStream, Android notifs through the Gadgetbridge parser and iOS ones
+ * through Phone's ANCS stand-in. Results are printed one line per scenario, times in [us]:
+ *
+ * REPLAY:begin:<app version>:<ELF SHA-256 prefix>
+ * REPLAY:<scenario>:<frames>:<frame p50>:<p95>:<p99>:<max>:<inputs>:<latency p50>:<p95>:<max>:<PASS|FAIL>
+ * REPLAY:end:<PASS|FAIL>
+ *
+ * A scenario fails when it goes over its budget below. tools/replay_check.py compares a run against a stored
+ * baseline instead, for catching regressions well within the budgets.
+ */
+
+static constexpr uint32_t Settle = 1000; // [ms] after starting a screen, before its scenario begins
+static constexpr uint32_t PressLength = 80; // [ms] from a scripted press to its release
+static constexpr uint32_t SamplePeriod = 10; // [ms] between injected IMU samples, close to the 104 Hz FIFO rate
+static constexpr float G = 1.0f; // [g], the unit IMU::Sample carries acceleration in
+
+/** Per-scenario ceilings [us], well above a healthy build so only real regressions fail */
+struct Budget {
+	uint32_t frameP95;
+	uint32_t frameP99;
+	uint32_t latencyP95;
+};
+
+// Frames and latencies of the running scenario, written by the frame observer on the LVGL thread
+static constexpr size_t MaxFrames = 4096;
+static constexpr size_t MaxLatencies = 1024;
+static uint32_t frameTimes[MaxFrames]; // [us]
+static uint32_t latencies[MaxLatencies]; // [us]
+static std::atomic_size_t frameCount = 0;
+static std::atomic_size_t latencyCount = 0;
+static std::atomic<uint64_t> pendingInput = 0; // [us], oldest injected input no frame has answered yet, 0 if none
+static uint32_t inputCount = 0;
+static Input* buttons; // Paused, scripted presses are injected into it
+
+static void onFrame(uint64_t start, uint64_t end){
+	const size_t frame = frameCount.fetch_add(1, std::memory_order_relaxed);
+	if(frame < MaxFrames){
+		frameTimes[frame] = end - start;
+	}
+
+	auto input = pendingInput.load();
+	if(input == 0 || start < input) return;
+	if(!pendingInput.compare_exchange_strong(input, 0)) return;
+
+	const size_t latency = latencyCount.fetch_add(1, std::memory_order_relaxed);
+	if(latency < MaxLatencies){
+		latencies[latency] = end - input;
+	}
+}
+
+static void markInput(){
+	inputCount++;
+	uint64_t none = 0;
+	pendingInput.compare_exchange_strong(none, esp_timer_get_time());
+}
+
+/** Timed actions of a scenario, played in order of their time [ms] from its start */
+class Script {
+public:
+	void at(uint32_t time, std::function<void()> fn){
+		cues.push_back({ time, std::move(fn) });
+	}
+
+	void press(uint32_t time, Input::Button btn){
+		at(time, [btn](){ button(btn, Input::Data::Press); });
+		at(time + PressLength, [btn](){ button(btn, Input::Data::Release, false); });
+	}
+
+	/** Press held long enough for Hold and repeats Repeats, timed like Input sends them */
+	void hold(uint32_t time, Input::Button btn, uint8_t repeats){
+		at(time, [btn](){ button(btn, Input::Data::Press); });
+		at(time + Input::HoldTime, [btn](){ button(btn, Input::Data::Hold); });
+		const uint32_t release = time + Input::HoldTime + repeats * Input::RepeatTime;
+		for(uint8_t i = 1; i <= repeats; i++){
+			at(time + Input::HoldTime + i * Input::RepeatTime, [btn](){ button(btn, Input::Data::Repeat); });
+		}
+		at(release + 20, [btn](){ button(btn, Input::Data::Release, false); });
+	}
+
+	/** IMU trace from start for duration [ms], trace is given the time [s] from its start */
+	void motion(uint32_t start, uint32_t duration, std::function<IMU::Sample(float t)> trace){
+		auto imu = Services.get<Service::IMU>();
+		for(uint32_t t = 0; t < duration; t += SamplePeriod){
+			at(start + t, [imu, trace, t](){
+				const auto sample = trace((float) t / 1000.0f);
+				imu->inject(&sample, 1);
+				markInput();
+			});
+		}
+	}
+
+	void play(){
+		std::stable_sort(cues.begin(), cues.end(), [](const Cue& a, const Cue& b){ return a.time < b.time; });
+
+		const auto start = xTaskGetTickCount();
+		for(auto& cue : cues){
+			const auto due = start + pdMS_TO_TICKS(cue.time);
+			const auto now = xTaskGetTickCount();
+			if((int32_t) (due - now) > 0){
+				vTaskDelay(due - now);
+			}
+			cue.fn();
+		}
+	}
+
+private:
+	struct Cue {
+		uint32_t time; // [ms]
+		std::function<void()> fn;
+	};
+	std::vector<Cue> cues;
+
+	/** Marked unless it's a release, screens act on presses and repeats */
+	static void button(Input::Button btn, Input::Data::Action action, bool mark = true){
+		buttons->inject(Input::Data{ .btn = btn, .action = action, .time = micros() });
+		if(mark){
+			markInput();
+		}
+	}
+};
+
+/** Fixed attitude with the given rates of change, the watch otherwise still. Pitch tips the fingers down, roll the lower edge. */
+static IMU::Sample tilt(float pitch, float roll, float pitchRate = 0, float rollRate = 0){
+	return {
+			rollRate, pitchRate, 0,
+			-G * std::sin(pitch), G * std::sin(roll) * std::cos(pitch), G * std::cos(roll) * std::cos(pitch)
+	};
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& values, uint32_t pct){
+	if(values.empty()) return 0;
+	return values[(values.size() - 1) * pct / 100];
+}
+
+static bool report(const char* name, const Budget& budget){
+	std::vector<uint32_t> frames(frameTimes, frameTimes + std::min(frameCount.load(), MaxFrames));
+	std::vector<uint32_t> lat(latencies, latencies + std::min(latencyCount.load(), MaxLatencies));
+	std::sort(frames.begin(), frames.end());
+	std::sort(lat.begin(), lat.end());
+
+	const uint32_t frameP95 = percentile(frames, 95);
+	const uint32_t frameP99 = percentile(frames, 99);
+	const uint32_t latP95 = percentile(lat, 95);
+
+	// A scenario that didn't render or answer anything is as broken as a slow one
+	const bool pass = !frames.empty() && !lat.empty() &&
+					  frameP95 <= budget.frameP95 && frameP99 <= budget.frameP99 && latP95 <= budget.latencyP95;
+
+	printf("REPLAY:%s:%zu:%lu:%lu:%lu:%lu:%lu:%lu:%lu:%lu:%s\n", name,
+		   frames.size(), percentile(frames, 50), frameP95, frameP99, frames.empty() ? 0 : frames.back(),
+		   inputCount, percentile(lat, 50), latP95, lat.empty() ? 0 : lat.back(), pass ? "PASS" : "FAIL");
+
+	return pass;
+}
+
+static LVGL* lvgl;
+static SleepMan* sleepMan;
+
+template<typename T>
+static bool run(const char* name, const Budget& budget, Script& script){
+	lvgl->stop();
+	lvgl->startScreen([](){ return std::make_unique<T>(); });
+	lvgl->start();
+
+	// Screens that need the IMU turn auto sleep back on when they stop
+	sleepMan->enAutoSleep(false);
+	delayMillis(Settle);
+
+	frameCount = 0;
+	latencyCount = 0;
+	pendingInput = 0;
+	inputCount = 0;
+
+	script.play();
+	delayMillis(Settle);
+
+	return report(name, budget);
+}
+
+static bool menu(){
+	// Scrolling through the items with taps and with a held button, no Select or Alt so the menu stays up
+	Script script;
+	uint32_t t = 0;
+	for(int i = 0; i < 12; i++, t += 250){
+		script.press(t, i % 6 < 3 ? Input::Down : Input::Up);
+	}
+	script.hold(t, Input::Down, 8);
+	t += Input::HoldTime + 8 * Input::RepeatTime + 300;
+	script.hold(t, Input::Up, 8);
+
+	return run<MainMenu>("menu", { 20000, 33000, 50000 }, script);
+}
+
+static std::string gbNotify(uint32_t id){
+	return "GB({t:\"notify\",id:" + std::to_string(id) + ",src:\"WhatsApp\",title:\"Jane Doe\",body:\"Message number " +
+		   std::to_string(id) + " of the replay flood, long enough to wrap over a few lines on the lock screen\"})";
+}
+
+static bool lockBangle(Phone& phone){
+	// Bursts of notifs like a reconnect replay, then each burst dismissed on the phone
+	static constexpr uint32_t Bursts = 4;
+	static constexpr uint32_t PerBurst = 20;
+	static constexpr uint32_t BurstGap = 1500; // [ms]
+	auto& bangle = phone.getBangle();
+
+	Script script;
+	for(uint32_t burst = 0; burst < Bursts; burst++){
+		const uint32_t start = burst * BurstGap;
+		for(uint32_t i = 0; i < PerBurst; i++){
+			const uint32_t id = 1000 + burst * PerBurst + i;
+			script.at(start + i * 5, [&bangle, id, first = i == 0](){
+				if(first) markInput();
+				bangle.replayLine(gbNotify(id));
+			});
+		}
+	}
+	for(uint32_t burst = 0; burst < Bursts - 1; burst++){
+		const uint32_t start = Bursts * BurstGap + burst * BurstGap;
+		for(uint32_t i = 0; i < PerBurst; i++){
+			const uint32_t id = 1000 + burst * PerBurst + i;
+			script.at(start + i * 5, [&bangle, id, first = i == 0](){
+				if(first) markInput();
+				bangle.replayLine("GB({t:\"notify-\",id:" + std::to_string(id) + "})");
+			});
+		}
+	}
+
+	// Latency includes Phone's batch window, it's from the phone's first line to the notifs on screen
+	const bool pass = run<LockScreen>("lock_bangle", { 25000, 40000, 400000 }, script);
+	bangle.replayDisconnect();
+	return pass;
+}
+
+static bool lockANCS(Phone& phone){
+	static constexpr uint32_t Count = 40;
+	auto& ancs = phone.getReplaySource();
+
+	Script script;
+	script.at(0, [&ancs](){ ancs.connect(); });
+	for(uint32_t i = 0; i < Count; i++){
+		script.at(200 + i * 25, [&ancs, i](){
+			if(i % 10 == 0) markInput();
+			ancs.notifNew(Notif{
+					.uid = 2000 + i,
+					.title = "John Appleseed",
+					.message = "Notification " + std::to_string(i) + " of the ANCS flood",
+					.appID = "com.apple.MobileSMS",
+					.category = Notif::Category::Social
+			});
+		});
+	}
+
+	// Then scrolled through while they're still coming in as modifications
+	uint32_t t = 200 + Count * 25 + 500;
+	for(uint32_t i = 0; i < 16; i++, t += 200){
+		script.press(t, i < 10 ? Input::Down : Input::Up);
+		script.at(t + 100, [&ancs, i](){
+			ancs.notifModify(Notif{
+					.uid = 2000 + i,
+					.title = "John Appleseed",
+					.message = "Edited notification " + std::to_string(i),
+					.appID = "com.apple.MobileSMS",
+					.category = Notif::Category::Social
+			});
+		});
+	}
+
+	const bool pass = run<LockScreen>("lock_ancs", { 25000, 40000, 400000 }, script);
+	ancs.disconnect();
+	return pass;
+}
+
+static bool level(){
+	Script script;
+
+	// Slow sweep over the whole bubble range
+	script.motion(0, 4000, [](float t){
+		const float w = 2.0f * (float) M_PI * 0.25f;
+		return tilt(0.5f * std::sin(w * t), 0.5f * std::cos(w * t), 0.5f * w * std::cos(w * t), -0.5f * w * std::sin(w * t));
+	});
+
+	// Quick jitter, then resting flat so the screen drops to its still rate
+	script.motion(4000, 2000, [](float t){
+		const float w = 2.0f * (float) M_PI * 4.0f;
+		return tilt(0.1f * std::sin(w * t), 0.08f * std::sin(w * t * 1.3f), 0.1f * w * std::cos(w * t), 0.104f * w * std::cos(w * t * 1.3f));
+	});
+	script.motion(6000, 2000, [](float t){ return tilt(0, 0); });
+
+	return run<Level>("level", { 20000, 33000, 80000 }, script);
+}
+
+static bool pong(){
+	Script script;
+	script.press(0, Input::Select);
+
+	// Paddle swept up and down, restarted whenever the ball got past it
+	script.motion(100, 10000, [](float t){
+		const float w = 2.0f * (float) M_PI * 0.5f;
+		return tilt(0, 0.25f * std::sin(w * t), 0, 0.25f * w * std::cos(w * t));
+	});
+	for(uint32_t t = 2000; t < 10000; t += 2000){
+		script.press(t, Input::Select);
+	}
+
+	return run<PongGame>("pong", { 17000, 25000, 50000 }, script);
+}
+
+void init(){
+	gpio_install_isr_service(ESP_INTR_FLAG_LOWMED | ESP_INTR_FLAG_SHARED | ESP_INTR_FLAG_IRAM);
+	Services.set<Service::RTCTelemetry>(new RTCTelemetry());
+
+	auto ret = nvs_flash_init();
+	if(ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND){
+		ESP_ERROR_CHECK(nvs_flash_erase());
+		ret = nvs_flash_init();
+	}
+	ESP_ERROR_CHECK(ret);
+
+	FSLVGL::mount();
+	FSLVGL::loadCache();
+
+	auto disp = new Display();
+	Services.set<Service::Display>(disp);
+
+	auto settings = new Settings();
+	Services.set<Service::Settings>(settings);
+
+	auto blPwm = new PWM(Pins::get(Pin::LedBl), PWMChannels::get(PWMUser::Backlight), true);
+	blPwm->detach();
+	auto bl = new BacklightBrightness(blPwm);
+	Services.set<Service::Backlight>(bl);
+
+#ifdef CONFIG_CM_AUDIO_PCM
+	auto pcm = new PCMAudio((gpio_num_t) Pins::get(Pin::Buzz));
+	auto audio = new ChirpSystem(*pcm);
+#else
+	auto buzzPwm = new PWM(Pins::get(Pin::Buzz), PWMChannels::get(PWMUser::Buzzer));
+	auto audio = new ChirpSystem(*buzzPwm);
+#endif
+	// Muted, the flood and the game would chirp through the whole run
+	audio->setMute(true);
+	Services.set<Service::Audio>(audio);
+
+	auto i2c = new I2C(I2C_NUM_0, (gpio_num_t) Pins::get(Pin::I2cSda), (gpio_num_t) Pins::get(Pin::I2cScl));
+	Services.set<Service::I2C>(i2c);
+	auto rtc = new RTC(*i2c);
+	Services.set<Service::Time>(new Time(*rtc));
+
+	new Bluetooth();
+	auto gap = new BLE::GAP();
+	auto client = new BLE::Client(gap);
+	auto server = new BLE::Server(gap);
+	auto phone = new Phone(server, client);
+	Services.set<Service::Phone>(phone);
+
+	// Screens get the scripted samples through the same services as the sensor's
+	auto imu = new IMU(*i2c);
+	imu->setReplay(true);
+	Services.set<Service::IMU>(imu);
+	auto imuCalibration = new IMUCalibration();
+	Services.set<Service::IMUCalibrator>(new IMUCalibrator(*imu, *imuCalibration));
+	Services.set<Service::IMUStream>(new IMUStream(*imu));
+	Services.set<Service::Orientation>(new Orientation(*imu));
+
+	// The buttons stay paused, the scripts are the only input
+	buttons = new Input();
+	buttons->pause();
+	Services.set<Service::Input>(buttons);
+
+	lvgl = new LVGL(*disp);
+	lv_disp_set_theme(lvgl->disp(), theme_init(lvgl->disp()));
+	new InputLVGL(*buttons);
+	new FSLVGL('S');
+
+	Services.set<Service::PowerTelemetry>(new PowerTelemetry());
+	sleepMan = new SleepMan(*lvgl);
+	Services.set<Service::Sleep>(sleepMan);
+	Services.set<Service::Status>(new StatusCenter());
+
+	auto adc = new ADCBurst(ADC_UNIT_1);
+	auto battery = new BatteryV2(*adc);
+	Services.set<Service::Battery>(battery);
+	battery->begin();
+
+	lvgl->startScreen([](){ return std::make_unique<LockScreen>(); });
+	lvgl->start();
+	bl->fadeIn();
+
+	LVGL::setFrameObserver(onFrame);
+
+	char sha[17];
+	esp_app_get_elf_sha256(sha, sizeof(sha));
+
+	for(;;){
+		printf("REPLAY:begin:%s:%s\n", esp_app_get_description()->version, sha);
+
+		bool pass = true;
+		pass &= menu();
+		pass &= lockBangle(*phone);
+		pass &= lockANCS(*phone);
+		pass &= level();
+		pass &= pong();
+
+		printf("REPLAY:end:%s\n\n", pass ? "PASS" : "FAIL");
+		delayMillis(5000);
+	}
+}
+
+extern "C" void app_main(void){
+	init();
+	vTaskDelete(nullptr);
+}
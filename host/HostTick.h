@@ -0,0 +1,14 @@
+#ifndef CLOCKSTAR_HOST_HOSTTICK_H
+#define CLOCKSTAR_HOST_HOSTTICK_H
+
+#include <stdint.h>
+#include <time.h>
+
+/** LVGL's tick on the host, milliseconds of the monotonic clock */
+static inline uint32_t hostTick(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t) ((uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+#endif //CLOCKSTAR_HOST_HOSTTICK_H
@@ -0,0 +1,24 @@
+#ifndef LV_CONF_H
+#define LV_CONF_H
+
+/*
+ * LVGL configuration of the host UI build. The firmware takes its settings from sdkconfig, the ones that change what
+ * ends up on screen are mirrored here, everything else stays at LVGL's defaults.
+ */
+
+#define LV_COLOR_DEPTH 16
+#define LV_COLOR_16_SWAP 1 // Like on the panel, the asset bundle's true color images are stored swapped
+
+#define LV_MEM_CUSTOM 1
+
+#define LV_TICK_CUSTOM 1
+#define LV_TICK_CUSTOM_INCLUDE "HostTick.h"
+#define LV_TICK_CUSTOM_SYS_TIME_EXPR (hostTick())
+
+// "S:" reads spiffs_image straight from the tree, like FSLVGL does from the SPIFFS partition built from it
+#define LV_USE_FS_STDIO 1
+#define LV_FS_STDIO_LETTER 'S'
+#define LV_FS_STDIO_PATH CM_HOST_ASSETS
+#define LV_FS_STDIO_CACHE_SIZE 0
+
+#endif //LV_CONF_H
@@ -0,0 +1,100 @@
+#include "Display.h"
+#include "HostTick.h"
+#include <cstdio>
+
+Display::Display(int scale) : frame(Width * Height, 0){
+	if(SDL_Init(SDL_INIT_VIDEO) != 0){
+		fprintf(stderr, "SDL init failed: %s\n", SDL_GetError());
+		return;
+	}
+
+	window = SDL_CreateWindow("Clockstar", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, Width * scale, Height * scale, 0);
+	if(window == nullptr){
+		fprintf(stderr, "SDL window failed: %s\n", SDL_GetError());
+		return;
+	}
+
+	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB565, SDL_TEXTUREACCESS_STREAMING, Width, Height);
+}
+
+Display::~Display(){
+	if(texture) SDL_DestroyTexture(texture);
+	if(renderer) SDL_DestroyRenderer(renderer);
+	if(window) SDL_DestroyWindow(window);
+	SDL_Quit();
+}
+
+void Display::pushImage(int x, int y, int w, int h, const uint16_t* pixels){
+	for(int row = 0; row < h; row++){
+		if(y + row < 0 || y + row >= Height) continue;
+
+		for(int col = 0; col < w; col++){
+			if(x + col < 0 || x + col >= Width) continue;
+
+			// Swapped for the panel's SPI byte order
+			const uint16_t px = pixels[row * w + col];
+			frame[(y + row) * Width + x + col] = (uint16_t) ((px << 8) | (px >> 8));
+		}
+	}
+
+	dirty = true;
+}
+
+bool Display::poll(Input& input){
+	SDL_Event evt;
+	while(SDL_PollEvent(&evt)){
+		if(evt.type == SDL_QUIT) return false;
+		if(evt.type != SDL_KEYDOWN && evt.type != SDL_KEYUP) continue;
+		if(evt.key.repeat) continue;
+
+		Input::Button btn;
+		switch(evt.key.keysym.sym){
+			case SDLK_UP:
+				btn = Input::Up;
+				break;
+			case SDLK_DOWN:
+				btn = Input::Down;
+				break;
+			case SDLK_RETURN:
+				btn = Input::Select;
+				break;
+			case SDLK_ESCAPE:
+			case SDLK_BACKSPACE:
+				btn = Input::Alt;
+				break;
+			default:
+				continue;
+		}
+
+		input.set(btn, evt.type == SDL_KEYDOWN, (uint64_t) hostTick() * 1000);
+	}
+
+	if(dirty && texture){
+		SDL_UpdateTexture(texture, nullptr, frame.data(), Width * sizeof(uint16_t));
+		SDL_RenderClear(renderer);
+		SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+		SDL_RenderPresent(renderer);
+	}
+	dirty = false;
+
+	return true;
+}
+
+bool Display::save(const char* path) const{
+	auto file = fopen(path, "wb");
+	if(file == nullptr) return false;
+
+	fprintf(file, "P6\n%d %d\n255\n", Width, Height);
+	for(const uint16_t px : frame){
+		const uint8_t rgb[3] = {
+				(uint8_t) (((px >> 11) & 0x1f) * 255 / 31),
+				(uint8_t) (((px >> 5) & 0x3f) * 255 / 63),
+				(uint8_t) ((px & 0x1f) * 255 / 31)
+		};
+		fwrite(rgb, 1, sizeof(rgb), file);
+	}
+
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,44 @@
+#ifndef CLOCKSTAR_HOST_DISPLAY_H
+#define CLOCKSTAR_HOST_DISPLAY_H
+
+#include <SDL.h>
+#include <cstdint>
+#include <vector>
+#include "Devices/Input.h"
+
+/**
+ * Stands in for the device display on the host: the 128x128 panel as a framebuffer, shown scaled up in an SDL window.
+ * Takes pixels as LVGL flushes them to the panel, byte-swapped RGB565. With SDL_VIDEODRIVER=dummy there's no window,
+ * for running under perf and valgrind.
+ * The keyboard stands in for the buttons: the arrows for Up and Down, Enter for Select, Escape or Backspace for Alt.
+ */
+class Display {
+public:
+	static constexpr int Width = 128;
+	static constexpr int Height = 128;
+
+	explicit Display(int scale = 4);
+	virtual ~Display();
+
+	void pushImage(int x, int y, int w, int h, const uint16_t* pixels);
+
+	/**
+	 * Shows what was pushed since the last call and hands keyboard changes to input.
+	 * @return False once the window was closed
+	 */
+	bool poll(Input& input);
+
+	/** Writes the framebuffer as a binary PPM */
+	bool save(const char* path) const;
+
+private:
+	SDL_Window* window = nullptr;
+	SDL_Renderer* renderer = nullptr;
+	SDL_Texture* texture = nullptr;
+
+	std::vector<uint16_t> frame; // RGB565 in host byte order
+	bool dirty = true;
+
+};
+
+#endif //CLOCKSTAR_HOST_DISPLAY_H
@@ -0,0 +1,21 @@
+#ifndef CLOCKSTAR_HOST_IMU_H
+#define CLOCKSTAR_HOST_IMU_H
+
+/**
+ * Stands in for the device IMU on the host, only the sample format the filters take. Samples come from the sim's
+ * script instead of the sensor FIFO.
+ */
+class IMU {
+public:
+	// Linear acceleration is in m/s^2, angular velocity is in rad/s
+	struct Sample {
+		float gyroX;
+		float gyroY;
+		float gyroZ;
+		float accelX;
+		float accelY;
+		float accelZ;
+	};
+};
+
+#endif //CLOCKSTAR_HOST_IMU_H
@@ -0,0 +1,53 @@
+#ifndef CLOCKSTAR_HOST_INPUT_H
+#define CLOCKSTAR_HOST_INPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+/**
+ * Stands in for the device buttons on the host. Changes come from the SDL keyboard or the UI script instead of the
+ * pins, and go out in order through getEdge(), the way LVGL's indev read takes them on the device.
+ */
+class Input {
+public:
+	enum Button { Up, Down, Select, Alt };
+	static constexpr size_t ButtonCount = 4;
+
+	struct Data {
+		Button btn;
+		enum Action { Release, Press, Hold, Repeat, Chord } action;
+		uint64_t time; // [us]
+		uint8_t chord = 0;
+	};
+
+	bool getState(Button btn) const{
+		return state & (1 << btn);
+	}
+
+	/** Only changes make an edge, repeating the current state is ignored */
+	void set(Button btn, bool pressed, uint64_t time){
+		if(getState(btn) == pressed) return;
+
+		state ^= 1 << btn;
+		edges.push_back({ btn, pressed ? Data::Press : Data::Release, time });
+	}
+
+	bool getEdge(Data& edge){
+		if(edges.empty()) return false;
+
+		edge = edges.front();
+		edges.pop_front();
+		return true;
+	}
+
+	bool hasEdge() const{
+		return !edges.empty();
+	}
+
+private:
+	uint8_t state = 0; // A bit per Button
+	std::deque<Data> edges;
+};
+
+#endif //CLOCKSTAR_HOST_INPUT_H
@@ -0,0 +1,16 @@
+#ifndef CLOCKSTAR_HOST_ESP_HEAP_CAPS_H
+#define CLOCKSTAR_HOST_ESP_HEAP_CAPS_H
+
+#include <cstdlib>
+#include <cstdint>
+
+// The host has one heap, capabilities are ignored
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+static inline void* heap_caps_malloc(size_t size, uint32_t caps){ return malloc(size); }
+static inline void heap_caps_free(void* ptr){ free(ptr); }
+
+#endif //CLOCKSTAR_HOST_ESP_HEAP_CAPS_H
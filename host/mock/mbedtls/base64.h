@@ -0,0 +1,52 @@
+#ifndef CLOCKSTAR_HOST_MBEDTLS_BASE64_H
+#define CLOCKSTAR_HOST_MBEDTLS_BASE64_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+#define MBEDTLS_ERR_BASE64_INVALID_CHARACTER -0x002C
+
+/** Same contract as mbedTLS: with dst too small (or nullptr), only the needed size is written to olen. */
+inline int mbedtls_base64_decode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen){
+	const auto value = [](unsigned char c) -> int {
+		if(c >= 'A' && c <= 'Z') return c - 'A';
+		if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+		if(c >= '0' && c <= '9') return c - '0' + 52;
+		if(c == '+') return 62;
+		if(c == '/') return 63;
+		return -1;
+	};
+
+	size_t chars = 0, pad = 0;
+	for(size_t i = 0; i < slen; i++){
+		if(src[i] == '='){
+			pad++;
+		}else if(pad > 0 || value(src[i]) < 0){
+			return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+		}else{
+			chars++;
+		}
+	}
+	if((chars + pad) % 4 != 0 || pad > 2) return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+
+	const size_t needed = chars * 6 / 8;
+	*olen = needed;
+	if(dst == nullptr || dlen < needed) return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+
+	uint32_t acc = 0;
+	int bits = 0;
+	size_t out = 0;
+	for(size_t i = 0; i < chars; i++){
+		acc = (acc << 6) | value(src[i]);
+		bits += 6;
+		if(bits >= 8){
+			bits -= 8;
+			dst[out++] = (acc >> bits) & 0xff;
+		}
+	}
+
+	return 0;
+}
+
+#endif //CLOCKSTAR_HOST_MBEDTLS_BASE64_H
@@ -0,0 +1,136 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "Fusion/Madgwick.h"
+#include "Fusion/Mahony.h"
+#include "Notifs/GBJson.h"
+#include "Services/SleepPredictor.h"
+
+/**
+ * Runs the firmware's orientation filters, Gadgetbridge parser and sleep predictor on the host, fed from a script
+ * instead of the IMU and BLE. One command per line, from the file given as the first argument or from stdin:
+ *
+ * imu <gx> <gy> <gz> <ax> <ay> <az>    One IMU sample into both filters [rad/s], [g]
+ * tilt <seconds> <rate>                Synthetic wrist tilting at rate [Hz], for profiling the filters
+ * orient                               Prints pitch, roll and yaw of both filters [deg]
+ * gb <line>                            Parses a Gadgetbridge line the way Bangle does and prints its fields
+ * wake|press <ms>                      Sleep predictor activity at a time [ms]
+ * sleep <ms> auto|manual               Sleep predictor, screen turned off
+ * timeout                              Prints the predicted auto sleep timeout [s]
+ *
+ * Lines starting with # are comments.
+ */
+
+static Fusion::MadgwickT<float> madgwick;
+static Fusion::MahonyT<float> mahony;
+static SleepPredictor predictor;
+
+static void feed(const IMU::Sample& sample){
+	madgwick.update(sample);
+	mahony.update(sample);
+}
+
+static void tilt(float seconds, float rate){
+	const auto count = (size_t) (seconds * rate);
+	for(size_t i = 0; i < count; i++){
+		const float t = (float) i / rate;
+		const float pitch = 0.6f * std::sin(t * 0.9f);
+		const float roll = 0.4f * std::sin(t * 1.7f + 0.5f);
+
+		feed({
+				0.4f * 1.7f * std::cos(t * 1.7f + 0.5f),
+				0.6f * 0.9f * std::cos(t * 0.9f),
+				0,
+				std::sin(pitch),
+				-std::sin(roll) * std::cos(pitch),
+				-std::cos(roll) * std::cos(pitch)
+		});
+	}
+}
+
+static void printOrient(const char* name, const Fusion::Orient& orient){
+	printf("orient:%s:%.3f:%.3f:%.3f\n", name, orient.pitch, orient.roll, orient.yaw);
+}
+
+static void parseGB(const std::string& line){
+	GBJson json;
+	if(!json.parse(line)){
+		printf("gb:invalid\n");
+		return;
+	}
+
+	static constexpr std::pair<GBJson::Field, const char*> Fields[] = {
+			{ GBJson::T, "t" }, { GBJson::Src, "src" }, { GBJson::Title, "title" }, { GBJson::Body, "body" },
+			{ GBJson::Sender, "sender" }, { GBJson::Name, "name" }, { GBJson::Number, "number" }, { GBJson::Cmd, "cmd" }
+	};
+
+	std::string value;
+	for(const auto& [field, name] : Fields){
+		if(json.string(field, value)){
+			printf("gb:%s:%s\n", name, value.c_str());
+		}
+	}
+
+	double id;
+	if(json.number(GBJson::Id, id)){
+		printf("gb:id:%.0f\n", id);
+	}
+}
+
+static void run(std::istream& in){
+	std::string line;
+	while(std::getline(in, line)){
+		if(line.empty() || line[0] == '#') continue;
+
+		std::istringstream args(line);
+		std::string cmd;
+		args >> cmd;
+
+		if(cmd == "imu"){
+			IMU::Sample sample{};
+			args >> sample.gyroX >> sample.gyroY >> sample.gyroZ >> sample.accelX >> sample.accelY >> sample.accelZ;
+			feed(sample);
+		}else if(cmd == "tilt"){
+			float seconds = 10, rate = 104;
+			args >> seconds >> rate;
+			tilt(seconds, rate);
+		}else if(cmd == "orient"){
+			printOrient("madgwick", madgwick.get());
+			printOrient("mahony", mahony.get());
+		}else if(cmd == "gb"){
+			parseGB(line.substr(std::min(line.size(), (size_t) 3)));
+		}else if(cmd == "wake" || cmd == "press"){
+			uint64_t time = 0;
+			args >> time;
+			cmd == "wake" ? predictor.woke(time) : predictor.pressed(time);
+		}else if(cmd == "sleep"){
+			uint64_t time = 0;
+			std::string kind;
+			args >> time >> kind;
+			predictor.slept(time, kind == "auto");
+		}else if(cmd == "timeout"){
+			printf("timeout:%u\n", predictor.getTimeout());
+		}else{
+			fprintf(stderr, "Unknown command: %s\n", line.c_str());
+		}
+	}
+}
+
+int main(int argc, char** argv){
+	if(argc > 1){
+		std::ifstream file(argv[1]);
+		if(!file){
+			fprintf(stderr, "Couldn't open %s\n", argv[1]);
+			return 1;
+		}
+		run(file);
+	}else{
+		run(std::cin);
+	}
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <lvgl.h>
+#include "HostTick.h"
+#include "Devices/Display.h"
+#include "Devices/Input.h"
+#include "Theme/theme.h"
+#include "Screens/Settings/BoolElement.h"
+#include "Screens/Settings/LabelElement.h"
+
+/**
+ * Renders the settings list through LVGL into the SDL Display, built from the firmware's own elements, theme, fonts
+ * and assets, so the rendering path can be profiled and checked off the device. Without a script it runs until the
+ * window is closed or Alt is pressed. With a script, from the file given as the first argument, one command per line:
+ *
+ * press up|down|select|alt             Presses and releases a button, 50 ms each
+ * wait <ms>                            Runs the UI for that long
+ * shot <file>                          Saves the current frame as a PPM
+ * report                               Prints frames, render time and rendered pixels since the last report
+ *
+ * Lines starting with # are comments.
+ */
+
+static Display* display;
+static Input input;
+static bool altPressed = false;
+
+// Up, Down, Select, Alt, mapped like InputLVGL does on the device. Alt isn't an encoder key.
+static constexpr lv_key_t KeyMap[Input::ButtonCount] = { LV_KEY_LEFT, LV_KEY_RIGHT, LV_KEY_ENTER, 0 };
+
+struct RenderStats {
+	uint32_t frames;
+	uint32_t time; // [ms] LVGL's render and flush time
+	uint64_t px;
+};
+static RenderStats stats = {};
+
+static void flush(lv_disp_drv_t* drv, const lv_area_t* area, lv_color_t* pixels){
+	display->pushImage(area->x1, area->y1, lv_area_get_width(area), lv_area_get_height(area), (const uint16_t*) pixels);
+	lv_disp_flush_ready(drv);
+}
+
+static void monitor(lv_disp_drv_t* drv, uint32_t time, uint32_t px){
+	stats.frames++;
+	stats.time += time;
+	stats.px += px;
+}
+
+static void read(lv_indev_drv_t* drv, lv_indev_data_t* data){
+	static lv_key_t key = LV_KEY_ENTER;
+	static bool pressed = false;
+
+	Input::Data edge;
+	while(input.getEdge(edge)){
+		const auto mapped = KeyMap[edge.btn];
+		if(mapped == 0){
+			altPressed |= edge.action == Input::Data::Press;
+			continue;
+		}
+
+		key = mapped;
+		pressed = edge.action == Input::Data::Press;
+		break;
+	}
+
+	data->key = key;
+	data->state = pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+	data->continue_reading = input.hasEdge();
+}
+
+/** The settings list as SettingsScreen lays it out, without the rows that need the device's services */
+static lv_group_t* buildSettings(){
+	auto scr = lv_scr_act();
+	lv_obj_set_style_bg_color(scr, lv_color_black(), 0);
+	lv_obj_set_style_bg_opa(scr, LV_OPA_COVER, 0);
+	lv_obj_set_style_bg_img_src(scr, "S:/bg.bin", 0);
+
+	auto container = lv_obj_create(scr);
+	lv_obj_set_size(container, 128, 128 - 18);
+	lv_obj_set_pos(container, 0, 18);
+	lv_obj_add_flag(container, LV_OBJ_FLAG_SCROLLABLE);
+	lv_obj_set_flex_flow(container, LV_FLEX_FLOW_COLUMN);
+	lv_obj_set_flex_align(container, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
+	lv_obj_set_style_pad_gap(container, 5, 0);
+
+	auto group = lv_group_create();
+	const auto add = [group](lv_obj_t* obj){
+		lv_group_add_obj(group, obj);
+		lv_obj_add_flag(obj, LV_OBJ_FLAG_SCROLL_ON_FOCUS);
+	};
+
+	add(*new BoolElement(container, "Sound", [](bool value){ printf("sound:%d\n", value); }, true));
+	add(*new BoolElement(container, "LED enable", [](bool value){ printf("led:%d\n", value); }, false));
+	add(*new BoolElement(container, "Tilt to wake", [](bool value){ printf("tilt:%d\n", value); }, true));
+	add(*new LabelElement(container, "Calibrate motion", [](){ printf("calibrate\n"); }));
+	add(*new LabelElement(container, "Save and Exit", [](){ printf("exit\n"); }));
+
+	return group;
+}
+
+/** One iteration of the UI loop, false once the window was closed */
+static bool step(){
+	const uint32_t ttn = lv_timer_handler();
+	if(!display->poll(input)) return false;
+
+	SDL_Delay(std::min<uint32_t>(ttn, 5));
+	return true;
+}
+
+static bool wait(uint32_t ms){
+	const uint32_t end = hostTick() + ms;
+	while(hostTick() < end){
+		if(!step()) return false;
+	}
+	return true;
+}
+
+static void report(){
+	printf("report:%u frames:%.2f ms avg:%llu px\n", stats.frames, stats.frames ? (float) stats.time / stats.frames : 0.0f,
+		   (unsigned long long) stats.px);
+	stats = {};
+}
+
+static bool press(const std::string& name){
+	static constexpr const char* Names[Input::ButtonCount] = { "up", "down", "select", "alt" };
+
+	for(size_t i = 0; i < Input::ButtonCount; i++){
+		if(name != Names[i]) continue;
+
+		input.set((Input::Button) i, true, (uint64_t) hostTick() * 1000);
+		if(!wait(50)) return false;
+		input.set((Input::Button) i, false, (uint64_t) hostTick() * 1000);
+		return wait(50);
+	}
+
+	fprintf(stderr, "Unknown button: %s\n", name.c_str());
+	return true;
+}
+
+static void run(std::istream& in){
+	std::string line;
+	while(std::getline(in, line)){
+		if(line.empty() || line[0] == '#') continue;
+
+		std::istringstream args(line);
+		std::string cmd;
+		args >> cmd;
+
+		bool open = true;
+		if(cmd == "press"){
+			std::string name;
+			args >> name;
+			open = press(name);
+		}else if(cmd == "wait"){
+			uint32_t ms = 0;
+			args >> ms;
+			open = wait(ms);
+		}else if(cmd == "shot"){
+			std::string path;
+			args >> path;
+			if(!display->save(path.c_str())){
+				fprintf(stderr, "Couldn't write %s\n", path.c_str());
+			}
+		}else if(cmd == "report"){
+			report();
+		}else{
+			fprintf(stderr, "Unknown command: %s\n", line.c_str());
+		}
+
+		if(!open) return;
+	}
+}
+
+int main(int argc, char** argv){
+	display = new Display();
+
+	lv_init();
+
+	static lv_color_t buffer[128 * 32];
+	static lv_disp_draw_buf_t drawBuf;
+	lv_disp_draw_buf_init(&drawBuf, buffer, nullptr, 128 * 32);
+
+	static lv_disp_drv_t dispDrv;
+	lv_disp_drv_init(&dispDrv);
+	dispDrv.hor_res = Display::Width;
+	dispDrv.ver_res = Display::Height;
+	dispDrv.flush_cb = flush;
+	dispDrv.monitor_cb = monitor;
+	dispDrv.draw_buf = &drawBuf;
+	auto disp = lv_disp_drv_register(&dispDrv);
+	lv_disp_set_theme(disp, theme_init(disp));
+
+	static lv_indev_drv_t indevDrv;
+	lv_indev_drv_init(&indevDrv);
+	indevDrv.type = LV_INDEV_TYPE_ENCODER;
+	indevDrv.read_cb = read;
+	lv_indev_set_group(lv_indev_drv_register(&indevDrv), buildSettings());
+
+	if(argc > 1){
+		std::ifstream file(argv[1]);
+		if(!file){
+			fprintf(stderr, "Couldn't open %s\n", argv[1]);
+			return 1;
+		}
+		run(file);
+	}else{
+		while(!altPressed && step());
+	}
+
+	report();
+	delete display;
+	return 0;
+}
@@ -2,6 +2,7 @@
 #include <nvs_flash.h>
 #include "Settings/Settings.h"
 #include "Pins.hpp"
+#include "PWMChannels.hpp"
 #include "Periph/I2C.h"
 #include "Periph/PinOut.h"
 #include "Periph/Bluetooth.h"
@@ -12,24 +13,46 @@
 #include "BLE/GAP.h"
 #include "BLE/Client.h"
 #include "BLE/Server.h"
+#include "BLE/DFU.h"
+#include "BLE/AssetSync.h"
+#include "BLE/Export.h"
 #include "Notifs/Phone.h"
 #include "LV_Interface/LVGL.h"
 #include "LV_Interface/FSLVGL.h"
+#include "LV_Interface/AssetPrefetch.h"
 #include "LV_Interface/InputLVGL.h"
 #include <lvgl/lvgl.h>
 #include "Theme/theme.h"
 #include "Util/Services.h"
 #include "Services/BacklightBrightness.h"
 #include "Services/ChirpSystem.h"
+#include "Services/PCMAudio.h"
 #include "Services/Time.h"
+#include "Services/TaskMonitor.h"
+#include "Services/HeapMonitor.h"
+#include "Services/RTCTelemetry.h"
+#include "Services/PowerTelemetry.h"
+#include "Services/IMUStream.h"
+#include "Services/Orientation.h"
+#include "Services/IMUCalibrator.h"
+#include "Services/Activity.h"
+#include "Services/Gestures.h"
 #include "Services/StatusCenter.h"
 #include "Services/SleepMan.h"
+#include "Services/DataLog.h"
+#include "Services/Actigraphy.h"
+#include "Services/Console.h"
 #include "Screens/ShutdownScreen.h"
 #include "Screens/Lock/LockScreen.h"
 #include "JigHWTest/JigHWTest.h"
 #include "Util/Notes.h"
 #include "Devices/BatteryV2.h"
 #include <Util/EfuseMeta.h>
+#include "Util/BootGraph.h"
+#include "Devices/Splash.h"
+#include "Util/Trace.h"
+#include <esp_timer.h>
+#include <esp_system.h>
 
 LVGL* lvgl;
 BacklightBrightness* bl;
@@ -47,6 +70,24 @@ void shutdown(){
 	sleepMan->shutdown();
 }
 
+/**
+ * The test jig announces itself on the serial port right after power-on. Boots that come from a software reset, a
+ * crash or a deep sleep wake can't be on the jig, so they skip its listening window.
+ */
+bool warmBoot(){
+	switch(esp_reset_reason()){
+		case ESP_RST_SW:
+		case ESP_RST_PANIC:
+		case ESP_RST_INT_WDT:
+		case ESP_RST_TASK_WDT:
+		case ESP_RST_WDT:
+		case ESP_RST_DEEPSLEEP:
+			return true;
+		default:
+			return false;
+	}
+}
+
 /**
  * Since Clockstar v2 has specific I2C periphery compared to Bit v3,
  * we can determine which hardware this is running on.
@@ -71,23 +112,14 @@ bool checkClockstarV2(){
  */
 void resolvePIDConflicts(){
 
-	static constexpr esp_efuse_desc_t PIDBlock = { EFUSE_BLK4, 0, 8 };
-	static constexpr const esp_efuse_desc_t* PID_Blob[] = { &PIDBlock, nullptr };
 	static constexpr uint8_t Block4_Expected = 0x01;
-	uint8_t pidAddition = 0;
-
-	auto err = esp_efuse_read_field_blob((const esp_efuse_desc_t**) PID_Blob, &pidAddition, 8);
-	if(err != ESP_OK){
-		ESP_ERROR_CHECK_WITHOUT_ABORT(err);
-		while(1){
-			ESP_LOGE("main", "couldn't read EFUSE_BLK4");
-			delayMillis(1000);
-		}
-	}
+
+	// Read with the rest of the snapshot, which halted if it couldn't
+	const uint8_t pidAddition = EfuseMeta::getPIDAddition();
 	ESP_LOGI("main", "read from block 4: %d", pidAddition);
 
 	switch(pidAddition){
-		case 0:
+		case 0:{
 			if(!checkClockstarV2()){
 				while(1){
 					ESP_LOGE("main", "Not running on Clockstar v2");
@@ -95,7 +127,7 @@ void resolvePIDConflicts(){
 				}
 			}
 
-			err = esp_efuse_write_field_blob((const esp_efuse_desc_t**) PID_Blob, &Block4_Expected, 8);
+			const auto err = EfuseMeta::writePIDAddition(Block4_Expected);
 			if(err != ESP_OK){
 				ESP_ERROR_CHECK_WITHOUT_ABORT(err);
 				while(1){
@@ -105,6 +137,7 @@ void resolvePIDConflicts(){
 			}
 			ESP_LOGI("main", "fused %d to BLK4", Block4_Expected);
 			return;
+		}
 		case Block4_Expected:
 			return;
 		default:
@@ -115,10 +148,19 @@ void resolvePIDConflicts(){
 	}
 }
 
+static constexpr Chirp BootChirps[] = {
+	Chirp{ .startFreq = NOTE_E4, .endFreq = NOTE_GS4, .duration = 100 },
+	Chirp{ .startFreq = 0, .endFreq = 0, .duration = 200 },
+	Chirp{ .startFreq = NOTE_GS4, .endFreq = NOTE_B4, .duration = 100 },
+	Chirp{ .startFreq = 0, .endFreq = 0, .duration = 200 },
+	Chirp{ .startFreq = NOTE_B4, .endFreq = NOTE_E5, .duration = 100 }
+};
+static constexpr auto BootJingle = ChirpSystem::compile<ChirpSystem::segmentCount(BootChirps)>(BootChirps);
+
 void init(){
 	esp_log_level_set("main", ESP_LOG_DEBUG);
 
-	if(JigHWTest::checkJig()){
+	if(!warmBoot() && JigHWTest::checkJig()){
 		printf("Jig\n");
 		Pins::setLatest();
 		auto test = new JigHWTest();
@@ -128,6 +170,24 @@ void init(){
 		printf("Hello\n");
 	}
 
+	// Written by async stages, declared before the graph so they outlive it
+	Display* disp = nullptr;
+	Phone* phone = nullptr;
+	BLE::Server* server = nullptr;
+
+	// Services are registered from this task only, async stages hand theirs back through the locals above
+	BootGraph boot;
+
+	// Everything from here on reads PID and revision from this snapshot
+	boot.run("efuse", {}, [](){
+		if(!EfuseMeta::load()){
+			while(true){
+				vTaskDelay(1000);
+				printf("Failed to read hardware revision.");
+			}
+		}
+	});
+
 	if(!EfuseMeta::check()){
 		while(true){
 			vTaskDelay(1000);
@@ -137,112 +197,217 @@ void init(){
 
 	resolvePIDConflicts();
 
+	const uint8_t rev = EfuseMeta::getRevision();
 
-	uint8_t rev = 0;
-	if(!EfuseMeta::readRev(rev)){
-		while(true){
-			vTaskDelay(1000);
-			printf("Failed to read hardware revision.");
-		}
-	}
+	// Before the first interrupt goes in, ISRs read the resolved table
+	Pins::init();
 
 	gpio_install_isr_service(ESP_INTR_FLAG_LOWMED | ESP_INTR_FLAG_SHARED | ESP_INTR_FLAG_IRAM);
 
-	auto ret = nvs_flash_init();
-	if(ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND){
-		ESP_ERROR_CHECK(nvs_flash_erase());
-		ret = nvs_flash_init();
-	}
-	ESP_ERROR_CHECK(ret);
-
-	auto settings = new Settings();
-	Services.set(Service::Settings, settings);
-
-	auto blPwm = new PWM(Pins::get(Pin::LedBl), LEDC_CHANNEL_1, true);
-	blPwm->detach();
-	bl = new BacklightBrightness(blPwm);
-	Services.set(Service::Backlight, bl);
-
-	auto buzzPwm = new PWM(Pins::get(Pin::Buzz), LEDC_CHANNEL_0);
-	auto audio = new ChirpSystem(*buzzPwm);
-	Services.set(Service::Audio, audio);
-
-	auto i2c = new I2C(I2C_NUM_0, (gpio_num_t) Pins::get(Pin::I2cSda), (gpio_num_t) Pins::get(Pin::I2cScl));
-	auto imu = new IMU(*i2c);
-	Services.set(Service::IMU, imu);
-
-	auto disp = new Display();
-	Services.set(Service::Display, disp);
-
-	auto input = new Input();
-	Services.set(Service::Input, input);
-
-	lvgl = new LVGL(*disp);
-	auto theme = theme_init(lvgl->disp());
-	lv_disp_set_theme(lvgl->disp(), theme);
-
-	auto lvglInput = new InputLVGL();
-	auto fs = new FSLVGL('S');
-
-	sleepMan = new SleepMan(*lvgl);
-	Services.set(Service::Sleep, sleepMan);
-
-	auto status = new StatusCenter();
-	Services.set(Service::Status, status);
-
-	auto adc = new ADC(ADC_UNIT_1);
-
-	Battery* battery; // Battery is doing shutdown
-	if(rev == 0){
-		while(true){
-			vTaskDelay(1000);
-			EfuseMeta::log();
+#ifdef CONFIG_CM_TRACE
+	Trace::init();
+#endif
+
+#ifdef CONFIG_CM_CONSOLE
+	// Before every subsystem that registers its report with it
+	auto console = new Console();
+	Services.set<Service::Console>(console);
+	console->start();
+#endif
+
+	// Reads back the last boot's counters before anything counts into this one's
+	Services.set<Service::RTCTelemetry>(new RTCTelemetry());
+
+	const auto nvs = boot.run("nvs", {}, [](){
+		auto ret = nvs_flash_init();
+		if(ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND){
+			ESP_ERROR_CHECK(nvs_flash_erase());
+			ret = nvs_flash_init();
 		}
-	}else{
-		battery = new BatteryV2(*adc);
-	}
+		ESP_ERROR_CHECK(ret);
+	});
+
+	// SPIFFS and the lock screen's assets don't need anything else, they load while the rest comes up
+	const auto spiffs = boot.async("spiffs", {}, [](){ FSLVGL::mount(); });
+	const auto assets = boot.async("boot assets", { spiffs }, [](){ FSLVGL::loadCache(); });
+
+	// Panel reset and init delays, on the core LVGL renders on. The splash comes straight from the mapped bundle.
+	const auto display = boot.async("display", {}, [&disp](){
+		disp = new Display();
+#ifdef CONFIG_CM_BOOT_SPLASH
+		Splash::draw(*disp, CONFIG_CM_BOOT_SPLASH_IMAGE);
+#endif
+	}, 1);
+
+	Settings* settings;
+	const auto settingsStage = boot.run("settings", { nvs }, [&settings](){
+		settings = new Settings();
+		Services.set<Service::Settings>(settings);
+	});
+
+	ChirpSystem* audio;
+	const auto audioStage = boot.run("audio", { settingsStage }, [&audio](){
+		auto blPwm = new PWM(Pins::get(Pin::LedBl), PWMChannels::get(PWMUser::Backlight), true);
+		blPwm->detach();
+		bl = new BacklightBrightness(blPwm);
+		Services.set<Service::Backlight>(bl);
+
+#ifdef CONFIG_CM_AUDIO_PCM
+		auto pcm = new PCMAudio((gpio_num_t) Pins::get(Pin::Buzz));
+		audio = new ChirpSystem(*pcm);
+#else
+		auto buzzPwm = new PWM(Pins::get(Pin::Buzz), PWMChannels::get(PWMUser::Buzzer));
+		audio = new ChirpSystem(*buzzPwm);
+#endif
+		Services.set<Service::Audio>(audio);
+	});
+
+	I2C* i2c;
+	const auto i2cStage = boot.run("i2c", {}, [&i2c](){
+		i2c = new I2C(I2C_NUM_0, (gpio_num_t) Pins::get(Pin::I2cSda), (gpio_num_t) Pins::get(Pin::I2cScl));
+		Services.set<Service::I2C>(i2c);
+	});
+
+	// Time service is required as soon as Phone is up
+	const auto time = boot.run("time", { i2cStage }, [i2c](){
+		auto rtc = new RTC(*i2c);
+		Services.set<Service::Time>(new Time(*rtc));
+	});
+
+	// Controller and Bluedroid bring-up is the longest stage, it runs next to everything up to the lock screen
+	const auto bluetooth = boot.async("bluetooth", { nvs, time }, [&phone, &server](){
+		new Bluetooth();
+		auto gap = new BLE::GAP();
+		auto client = new BLE::Client(gap);
+		server = new BLE::Server(gap);
+		phone = new Phone(server, client);
+#ifdef CONFIG_CM_OTA
+		new BLE::DFU(server);
+#endif
+#ifdef CONFIG_CM_ASSET_SYNC
+		new BLE::AssetSync(server);
+#endif
+#ifdef CONFIG_CM_DATALOG
+		new BLE::Export(server);
+#endif
+	}, 0);
+
+	const auto imuStage = boot.run("imu", { i2cStage }, [i2c](){
+		auto imu = new IMU(*i2c);
+		Services.set<Service::IMU>(imu);
+		auto imuCalibration = new IMUCalibration();
+		imu->setCalibration(imuCalibration->get());
+		Services.set<Service::Activity>(new Activity(*imu));
+#ifdef CONFIG_CM_ACTIGRAPHY
+		Services.set<Service::Actigraphy>(new Actigraphy(*imu));
+#endif
+
+		// Only some screens use these, they're constructed by the first lookup. Orientation's filter and Gestures'
+		// state go away again with the last screen holding them.
+		Services.provide<Service::IMUCalibrator>([imu, imuCalibration](){ return new IMUCalibrator(*imu, *imuCalibration); });
+#ifdef CONFIG_CM_CONSOLE
+		IMUCalibrator::addCommands(*Services.get<Service::Console>());
+#endif
+		Services.provide<Service::IMUStream>([imu](){ return new IMUStream(*imu); });
+		Services.provide<Service::Orientation>([imu](){ return new Orientation(*imu); }, [](Orientation* orientation){ delete orientation; });
+		Services.provide<Service::Gestures>([](){ return new Gestures(*Services.hold<Service::Orientation>()); }, [](Gestures* gestures){
+			delete gestures;
+			Services.drop<Service::Orientation>();
+		});
+	});
+
+#ifdef CONFIG_CM_BOOT_SPLASH
+	// The watch responds with the splash while LVGL, Bluetooth and the lock screen come up behind it
+	boot.run("backlight", { display, audioStage }, [](){ bl->fadeIn(); });
+#endif
+
+	const auto ui = boot.run("lvgl", { display, spiffs }, [&disp](){
+		Services.set<Service::Display>(disp);
+
+		auto input = new Input();
+		Services.set<Service::Input>(input);
+
+		lvgl = new LVGL(*disp);
+		auto theme = theme_init(lvgl->disp());
+		lv_disp_set_theme(lvgl->disp(), theme);
+
+		new InputLVGL(*input);
+		new FSLVGL('S');
+		new AssetPrefetch();
+	});
+
+	Battery* battery = nullptr; // Battery is doing shutdown
+	const auto services = boot.run("services", { ui, imuStage }, [&battery, rev](){
+		Services.set<Service::PowerTelemetry>(new PowerTelemetry());
+
+		sleepMan = new SleepMan(*lvgl);
+		Services.set<Service::Sleep>(sleepMan);
+
+		auto status = new StatusCenter();
+		Services.set<Service::Status>(status);
+
+#ifdef CONFIG_CM_TASK_MONITOR
+		Services.set<Service::TaskMonitor>(new TaskMonitor());
+#endif
+#ifdef CONFIG_CM_HEAP_MONITOR
+		Services.set<Service::HeapMonitor>(new HeapMonitor());
+#endif
+
+		auto adc = new ADCBurst(ADC_UNIT_1);
+
+		if(rev == 0){
+			while(true){
+				vTaskDelay(1000);
+				EfuseMeta::log();
+			}
+		}else{
+			battery = new BatteryV2(*adc);
+		}
+	});
 
 	if(battery->isShutdown()) return; // Stop initialization if battery is critical
-	Services.set(Service::Battery, battery);
-
-	auto rtc = new RTC(*i2c);
-	auto time = new Time(*rtc);
-	Services.set(Service::Time, time); // Time service is required as soon as Phone is up
+	Services.set<Service::Battery>(battery);
 
-	auto bt = new Bluetooth();
-	auto gap = new BLE::GAP();
-	auto client = new BLE::Client(gap);
-	auto server = new BLE::Server(gap);
-	auto phone = new Phone(server, client);
-	server->start();
-	Services.set(Service::Phone, phone);
+#ifdef CONFIG_CM_DATALOG
+	Services.set<Service::DataLog>(new DataLog());
+#endif
 
-	FSLVGL::loadCache();
+	// The server only starts once Phone is published, a phone reconnecting right away posts events its listeners look up Phone for
+	const auto phoneStage = boot.run("phone", { bluetooth }, [&phone, &server](){
+		Services.set<Service::Phone>(phone);
+		server->start();
+	});
 
-	// Load start screen here
-	lvgl->startScreen([](){ return std::make_unique<LockScreen>(); });
+	// First frame as soon as the lock screen's own dependencies are in
+	boot.run("lock screen", { ui, services, assets, phoneStage }, [](){
+		lvgl->startScreen([](){ return std::make_unique<LockScreen>(); });
+	});
 
 	if(settings->get().notificationSounds){
-		audio->play({
-							Chirp{ .startFreq = NOTE_E4, .endFreq = NOTE_GS4, .duration = 100 },
-							Chirp{ .startFreq = 0, .endFreq = 0, .duration = 200 },
-							Chirp{ .startFreq = NOTE_GS4, .endFreq = NOTE_B4, .duration = 100 },
-							Chirp{ .startFreq = 0, .endFreq = 0, .duration = 200 },
-							Chirp{ .startFreq = NOTE_B4, .endFreq = NOTE_E5, .duration = 100 }
-					});
+		audio->play(BootJingle, ChirpSystem::Voice::Notification);
 	}
 
 	// Start UI thread after initialization
-	lvgl->start();
+	boot.run("ui thread", {}, [](){ lvgl->start(); });
+
+#ifdef CONFIG_CM_OTA
+	// Made it to a running UI, keep this firmware even if it came in over BLE
+	BLE::DFU::confirmBoot();
+#endif
 
-	bl->fadeIn();
+	bl->fadeIn(); // Already on if the splash turned it on
 
 	// Start Battery scanning after everything else, otherwise Critical
 	// Battery event might come while initialization is still in progress
 	battery->begin();
+
+	boot.printTimeline();
 }
 
 extern "C" void app_main(void){
+	// Startup before app_main includes every C++ static initializer, keep them constexpr where possible
+	ESP_LOGI("main", "app_main reached %lld us after boot", esp_timer_get_time());
+
 	init();
 
 	vTaskDelete(nullptr);
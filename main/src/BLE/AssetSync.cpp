@@ -0,0 +1,358 @@
+#include "AssetSync.h"
+#include "LV_Interface/FSLVGL.h"
+#include "Util/stdafx.h"
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <esp_spiffs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+static const char* TAG = "BLE::AssetSync";
+
+static constexpr uint32_t SessionTimeout = 120000; // [ms] without packets before a file in progress is dropped
+
+static uint16_t readU16(const uint8_t* data){
+	return data[0] | (data[1] << 8);
+}
+
+static uint32_t readU32(const uint8_t* data){
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static uint8_t* writeU16(uint8_t* data, uint16_t val){
+	data[0] = val;
+	data[1] = val >> 8;
+	return data + 2;
+}
+
+static uint8_t* writeU32(uint8_t* data, uint32_t val){
+	data[0] = val;
+	data[1] = val >> 8;
+	data[2] = val >> 16;
+	data[3] = val >> 24;
+	return data + 4;
+}
+
+BLE::AssetSync::AssetSync(BLE::Server* server) : Threaded("AssetSync", 4 * 1024, PlannedTask::AssetSync), server(server),
+		jobs(xQueueCreate(JobCount, sizeof(Job))),
+		rx(BufferSize, [this](uint8_t buffer, uint32_t size, uint32_t session){ post({ .type = Job::Flush, .buffer = buffer, .size = size, .session = session }); },
+		   [this](){ post({ .type = Job::Ack }); }){
+	service = server->addService(ServiceUID);
+
+	// Notifying char first, it gets the service's only client config descriptor, see UART
+	statusChar = service->addChar(StatusCharUID, ESP_GATT_CHAR_PROP_BIT_NOTIFY);
+	ctrlChar = service->addChar(CtrlCharUID, ESP_GATT_CHAR_PROP_BIT_WRITE);
+	dataChar = service->addChar(DataCharUID, ESP_GATT_CHAR_PROP_BIT_WRITE_NR);
+
+	ctrlChar->setOnWriteCb([this](const uint8_t* data, size_t size){ onCtrl(data, size); });
+	dataChar->setOnWriteCb([this](const uint8_t* data, size_t size){ rx.onData(data, size); });
+
+	start();
+}
+
+BLE::AssetSync::~AssetSync(){
+	ctrlChar->setOnWriteCb({});
+	dataChar->setOnWriteCb({});
+	stop();
+	cancel();
+	vQueueDelete(jobs);
+}
+
+void BLE::AssetSync::post(const Job& job){
+	// Only one buffer is handed off at a time and a lost Flush would never be returned, stalling the transfer for good
+	std::lock_guard lock(postMut);
+	const UBaseType_t reserved = job.type == Job::Flush ? 0 : 1;
+	if(uxQueueSpacesAvailable(jobs) <= reserved || xQueueSend(jobs, &job, 0) != pdTRUE){
+		ESP_LOGW(TAG, "Job queue full, dropping job %d", job.type);
+	}
+}
+
+void BLE::AssetSync::afterStopSignal(){
+	const Job job = { .type = Job::Exit };
+	xQueueSend(jobs, &job, portMAX_DELAY);
+}
+
+void BLE::AssetSync::onCtrl(const uint8_t* data, size_t len){
+	Job job = { .type = Job::Ctrl };
+	if(len == 0 || len > sizeof(job.ctrl)){
+		ESP_LOGW(TAG, "Dropping %zu B control write", len);
+		return;
+	}
+
+	job.len = len;
+	memcpy(job.ctrl, data, len);
+	post(job);
+}
+
+void BLE::AssetSync::loop(){
+	Job job;
+	if(xQueueReceive(jobs, &job, pdMS_TO_TICKS(SessionTimeout)) != pdTRUE){
+		if(out != nullptr){
+			ESP_LOGW(TAG, "No packets for %lu s, dropping %s at %lu B", SessionTimeout / 1000, current.path.c_str(), written);
+			cancel();
+		}
+		return;
+	}
+
+	switch(job.type){
+		case Job::Ctrl:
+			handleCtrl(job.ctrl, job.len);
+			break;
+		case Job::Flush:
+			flush(job);
+			break;
+		case Job::Ack:
+			sendAck();
+			break;
+		case Job::Exit:
+			break;
+	}
+}
+
+void BLE::AssetSync::handleCtrl(const uint8_t* data, size_t len){
+	if(!FSLVGL::isMounted()){
+		const uint8_t error = (uint8_t) Error::NotReady;
+		send(Op::Status, &error, 1);
+		return;
+	}
+
+	switch((Op) data[0]){
+		case Op::Entry:
+			if(len < 12) return;
+			entry(readU16(data + 1), readU32(data + 3), readU32(data + 7), std::string((const char*) data + 11, strnlen((const char*) data + 11, len - 11)));
+			break;
+		case Op::Compare: {
+			uint8_t count[2];
+			writeU16(count, wanted.size());
+			send(Op::Compared, count, sizeof(count));
+			ESP_LOGI(TAG, "%zu files differ", wanted.size());
+			break;
+		}
+		case Op::File:
+			if(len < 3) return;
+			beginFile(readU16(data + 1));
+			break;
+		case Op::End:
+			end();
+			break;
+		case Op::Abort:
+			ESP_LOGI(TAG, "Aborted by the client");
+			cancel();
+			wanted.clear();
+			break;
+		default:
+			ESP_LOGW(TAG, "Unknown op 0x%02x", data[0]);
+			break;
+	}
+}
+
+void BLE::AssetSync::entry(uint16_t id, uint32_t size, uint32_t crc, std::string path){
+	if(path.empty() || path[0] != '/' || path.size() > MaxPath || path.find('\n') != std::string::npos){
+		const uint8_t error = (uint8_t) Error::BadPath;
+		send(Op::Status, &error, 1);
+		return;
+	}
+
+	const std::string spath = "/spiffs" + path;
+	struct stat st;
+	bool same = stat(spath.c_str(), &st) == 0 && (uint32_t) st.st_size == size;
+	if(same){
+		std::unique_ptr<uint8_t[]> buf(new(std::nothrow) uint8_t[ReadSize]);
+		same = buf && sameCrc(spath.c_str(), size, crc, buf.get());
+	}
+	if(same) return;
+
+	// A repeated id replaces the entry, the phone may send its manifest again after a reconnect
+	auto it = std::find_if(wanted.begin(), wanted.end(), [id](const File& file){ return file.id == id; });
+	if(it != wanted.end()){
+		*it = { id, size, crc, std::move(path) };
+	}else{
+		wanted.push_back({ id, size, crc, std::move(path) });
+	}
+
+	uint8_t packet[2];
+	writeU16(packet, id);
+	send(Op::Want, packet, sizeof(packet));
+}
+
+bool BLE::AssetSync::sameCrc(const char* spath, uint32_t size, uint32_t crc, uint8_t* buf){
+	auto f = fopen(spath, "r");
+	if(f == nullptr) return false;
+	setvbuf(f, nullptr, _IONBF, 0);
+
+	uint32_t sum = 0;
+	uint32_t left = size;
+	while(left > 0){
+		const size_t read = fread(buf, 1, std::min<uint32_t>(left, ReadSize), f);
+		if(read == 0) break;
+		sum = esp_rom_crc32_le(sum, buf, read);
+		left -= read;
+	}
+	fclose(f);
+
+	return left == 0 && sum == crc;
+}
+
+void BLE::AssetSync::beginFile(uint16_t id){
+	auto it = std::find_if(wanted.begin(), wanted.end(), [id](const File& file){ return file.id == id; });
+	if(it == wanted.end()){
+		const uint8_t error = (uint8_t) Error::Unknown;
+		send(Op::Status, &error, 1);
+		return;
+	}
+
+	if(out != nullptr && current.id == id && !failed && rx.resume(it->size)){
+		ESP_LOGI(TAG, "Resuming %s at %lu of %lu B", current.path.c_str(), rx.window().received, current.size);
+		sendAck();
+		return;
+	}
+
+	cancel();
+
+	// The old file stays until the new one is complete, both have to fit
+	size_t total = 0, used = 0;
+	if(esp_spiffs_info("storage", &total, &used) != ESP_OK || total - used < it->size + BufferSize){
+		ESP_LOGW(TAG, "No room for %s (%lu B), %zu B free", it->path.c_str(), it->size, total - used);
+		const uint8_t error = (uint8_t) Error::NoSpace;
+		send(Op::Status, &error, 1);
+		return;
+	}
+
+	out = fopen(TempPath, "w");
+	if(out == nullptr){
+		const uint8_t error = (uint8_t) Error::Write;
+		send(Op::Status, &error, 1);
+		return;
+	}
+	// Each buffer is written with one call, stdio's own buffer would only copy it again
+	setvbuf(out, nullptr, _IONBF, 0);
+
+	current = *it;
+	written = 0;
+	runningCrc = 0;
+	failed = false;
+
+	if(current.size == 0){
+		finishFile();
+		return;
+	}
+
+	if(!rx.begin(current.size)){
+		cancel();
+		const uint8_t error = (uint8_t) Error::NoMemory;
+		send(Op::Status, &error, 1);
+		return;
+	}
+
+	if(startTime == 0){
+		startTime = millis();
+	}
+
+	ESP_LOGI(TAG, "Receiving %s, %lu B", current.path.c_str(), current.size);
+	sendAck();
+}
+
+void BLE::AssetSync::flush(const Job& job){
+	const uint8_t* data = rx.data(job.buffer, job.session);
+	if(data == nullptr || out == nullptr) return;
+
+	// Received to the end even after a failed write, so FileDone reports it
+	if(!failed && fwrite(data, 1, job.size, out) != job.size){
+		ESP_LOGE(TAG, "Write of %s failed at %lu B", current.path.c_str(), written);
+		failed = true;
+	}
+	runningCrc = esp_rom_crc32_le(runningCrc, data, job.size);
+	written += job.size;
+
+	// Done with this file, nothing else comes in until the next File
+	if(written == current.size){
+		finishFile();
+		return;
+	}
+
+	rx.flushed();
+}
+
+void BLE::AssetSync::finishFile(){
+	rx.cancel();
+	fclose(out);
+	out = nullptr;
+
+	Error error = Error::None;
+	if(failed){
+		error = Error::Write;
+	}else if(runningCrc != current.crc){
+		ESP_LOGE(TAG, "CRC mismatch for %s, got 0x%08lx, expected 0x%08lx", current.path.c_str(), runningCrc, current.crc);
+		error = Error::Checksum;
+	}else{
+		// SPIFFS doesn't rename over an existing file
+		const std::string spath = "/spiffs" + current.path;
+		unlink(spath.c_str());
+		if(rename(TempPath, spath.c_str()) != 0){
+			ESP_LOGE(TAG, "Couldn't move %s into place", current.path.c_str());
+			error = Error::Write;
+		}
+	}
+
+	if(error == Error::None){
+		FSLVGL::overrideAsset(current.path.c_str());
+		files++;
+		bytes += current.size;
+
+		const auto id = current.id;
+		wanted.erase(std::remove_if(wanted.begin(), wanted.end(), [id](const File& file){ return file.id == id; }), wanted.end());
+	}else{
+		unlink(TempPath);
+	}
+
+	uint8_t packet[3];
+	writeU16(packet, current.id)[0] = (uint8_t) error;
+	send(Op::FileDone, packet, sizeof(packet));
+}
+
+void BLE::AssetSync::end(){
+	cancel();
+	FSLVGL::saveOverrides();
+
+	const uint32_t time = std::max<uint32_t>(startTime ? millis() - startTime : 0, 1);
+	const uint32_t rate = (uint64_t) bytes * 1000 / time;
+	ESP_LOGI(TAG, "Replaced %u files, %lu B in %lu ms, %lu kB/s, %zu still differ", files, bytes, time, rate / 1000, wanted.size());
+
+	uint8_t packet[14];
+	writeU32(writeU32(writeU32(writeU16(packet, files), bytes), time), rate);
+	send(Op::Done, packet, sizeof(packet));
+
+	files = 0;
+	bytes = 0;
+	startTime = 0;
+	wanted.clear();
+}
+
+void BLE::AssetSync::cancel(){
+	rx.cancel();
+
+	if(out != nullptr){
+		fclose(out);
+		out = nullptr;
+		unlink(TempPath);
+	}
+}
+
+void BLE::AssetSync::sendAck(){
+	const auto window = rx.window();
+	uint8_t packet[8];
+	writeU32(writeU32(packet, window.received), window.limit);
+	send(Op::Ack, packet, sizeof(packet));
+}
+
+void BLE::AssetSync::send(Op op, const uint8_t* data, size_t len){
+	uint8_t packet[16] = { (uint8_t) op };
+	len = std::min(len, sizeof(packet) - 1);
+	if(len > 0){
+		memcpy(packet + 1, data, len);
+	}
+	statusChar->sendNotif(packet, len + 1);
+}
@@ -0,0 +1,135 @@
+#ifndef CLOCKSTAR_FIRMWARE_ASSETSYNC_H
+#define CLOCKSTAR_FIRMWARE_ASSETSYNC_H
+
+#include "Server.h"
+#include "BulkRx.h"
+#include "Util/Threaded.h"
+#include <freertos/queue.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace BLE {
+
+/**
+ * Replaces asset files in SPIFFS over GATT, without reflashing the storage partition.
+ *
+ * The phone sends a manifest of path, size and CRC32 per file, in the style of SPIFFSChecksums. Files whose size
+ * differs are wanted right away. Files of the same size are read back in ReadSize chunks to compare CRCs. The phone then
+ * sends the wanted ones through BulkRx, each streamed into a temporary file by the writer task. A file whose CRC
+ * matches replaces the old one and is overridden in FSLVGL, so it's served from SPIFFS instead of the bundle and its
+ * cache entry is dropped. Screens opened afterwards show the new file.
+ *
+ * Control writes and status notifications, little endian:
+ * 	Entry [u16 id][u32 size][u32 crc][path]	answered with Want [u16 id] if the file differs
+ * 	Compare	answered with Compared [u16 wanted]
+ * 	File [u16 id]	one wanted file follows on the data char, answered with Ack [u32 received][u32 limit], then FileDone [u16 id][u8 Error]
+ * 	End	answered with Done [u16 files][u32 bytes][u32 time ms][u32 rate B/s]
+ * 	Abort
+ * Anything refused is answered with Status [u8 Error]. A File with the id already in progress resumes it.
+ */
+class AssetSync : private Threaded {
+public:
+	AssetSync(Server* server);
+	~AssetSync() override;
+
+	enum class Op : uint8_t {
+		Entry = 0x01, Compare = 0x02, File = 0x03, End = 0x04, Abort = 0x05,
+		Want = 0x10, Compared = 0x11, Ack = 0x12, FileDone = 0x13, Done = 0x14, Status = 0x15
+	};
+
+	enum class Error : uint8_t {
+		None, NotReady, BadPath, Unknown, NoSpace, NoMemory, Write, Checksum
+	};
+
+private:
+	Server* server;
+
+	std::shared_ptr<Server::Service> service;
+	std::shared_ptr<Server::Char> statusChar;
+	std::shared_ptr<Server::Char> ctrlChar;
+	std::shared_ptr<Server::Char> dataChar;
+
+	static constexpr size_t BufferSize = 4096; // [B] one SPIFFS write each
+	static constexpr size_t ReadSize = 4096; // [B] comparing unchanged sizes
+	static constexpr size_t MaxPath = CONFIG_SPIFFS_OBJ_NAME_LEN - 1; // [B]
+	static constexpr const char* TempPath = "/spiffs/.sync.tmp";
+
+	/** Control writes are copied into the job, a manifest entry with its path */
+	struct Job {
+		enum : uint8_t { Ctrl, Flush, Ack, Exit } type;
+		uint8_t buffer;
+		uint32_t size;
+		uint32_t session;
+		uint8_t len;
+		uint8_t ctrl[15 + MaxPath];
+	};
+	QueueHandle_t jobs; // The last slot is kept for Flush, see post
+	std::mutex postMut;
+	static constexpr size_t JobCount = 12;
+	void post(const Job& job);
+
+	BulkRx rx;
+	void onCtrl(const uint8_t* data, size_t len);
+
+	struct File {
+		uint16_t id;
+		uint32_t size; // [B]
+		uint32_t crc;
+		std::string path; // Relative to /spiffs
+	};
+	std::vector<File> wanted;
+
+	// Writer task state
+	File current; // Being received while out is open
+	FILE* out = nullptr;
+	uint32_t written = 0; // [B] of the current file
+	uint32_t runningCrc = 0;
+	bool failed = false;
+
+	uint16_t files = 0;
+	uint32_t bytes = 0; // [B] of all files replaced
+	uint32_t startTime = 0; // [ms] of the first File since the last End
+
+	void loop() override;
+	void afterStopSignal() override;
+
+	void handleCtrl(const uint8_t* data, size_t len);
+	void entry(uint16_t id, uint32_t size, uint32_t crc, std::string path);
+	void beginFile(uint16_t id);
+	void flush(const Job& job);
+	void finishFile();
+	void end();
+	void cancel();
+
+	static bool sameCrc(const char* spath, uint32_t size, uint32_t crc, uint8_t* buf);
+
+	void sendAck();
+	void send(Op op, const uint8_t* data = nullptr, size_t len = 0);
+
+	static constexpr esp_bt_uuid_t ServiceUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x11, 0x00, 0x5D, 0xC5 }}
+	};
+
+	// Status notifies, written to control, data written without response
+	static constexpr esp_bt_uuid_t StatusCharUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x12, 0x00, 0x5D, 0xC5 }}
+	};
+	static constexpr esp_bt_uuid_t CtrlCharUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x13, 0x00, 0x5D, 0xC5 }}
+	};
+	static constexpr esp_bt_uuid_t DataCharUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x14, 0x00, 0x5D, 0xC5 }}
+	};
+
+};
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_ASSETSYNC_H
@@ -0,0 +1,136 @@
+#include "BulkRx.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+BLE::BulkRx::BulkRx(size_t bufferSize, FlushCB onFlush, AckCB onAck) : BufferSize(bufferSize), AckStride(bufferSize / 4),
+		onFlush(std::move(onFlush)), onAck(std::move(onAck)){}
+
+bool BLE::BulkRx::begin(uint32_t size){
+	cancel();
+
+	std::unique_ptr<uint8_t[]> bufs[2];
+	for(auto& buf : bufs){
+		buf.reset(new(std::nothrow) uint8_t[BufferSize]);
+		if(!buf) return false;
+	}
+
+	std::lock_guard lock(mut);
+	this->size = size;
+	received = acked = 0;
+	nacked = false;
+	buffers[0] = std::move(bufs[0]);
+	buffers[1] = std::move(bufs[1]);
+	fill = 0;
+	fillLen = 0;
+	flushing = -1;
+	session++;
+	active = true;
+	return true;
+}
+
+void BLE::BulkRx::cancel(){
+	std::lock_guard lock(mut);
+	active = false;
+	session++;
+	fillLen = 0;
+	flushing = -1;
+	buffers[0].reset();
+	buffers[1].reset();
+}
+
+bool BLE::BulkRx::resume(uint32_t size){
+	std::lock_guard lock(mut);
+	if(!active || this->size != size) return false;
+
+	// Everything received is written or in a buffer, the client picks up from there
+	nacked = false;
+	return true;
+}
+
+uint32_t BLE::BulkRx::limit() const{
+	if(!active) return 0;
+
+	// The spare buffer takes the rest of a packet once the fill buffer is full, unless it's still being written
+	const uint32_t fillBase = received - fillLen;
+	return std::min(size, fillBase + (uint32_t) BufferSize * (flushing < 0 ? 2 : 1));
+}
+
+bool BLE::BulkRx::fillDone() const{
+	return fillLen == BufferSize || (fillLen > 0 && received == size);
+}
+
+void BLE::BulkRx::handOff(){
+	flushing = fill;
+	onFlush(fill, fillLen, session);
+	fill ^= 1;
+	fillLen = 0;
+}
+
+void BLE::BulkRx::onData(const uint8_t* data, size_t len){
+	if(len <= HeaderSize) return;
+
+	const uint32_t offset = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+	data += HeaderSize;
+	len -= HeaderSize;
+
+	std::lock_guard lock(mut);
+	if(!active) return;
+
+	if(offset != received || received + len > limit()){
+		// Answered once, everything up to the rewind is dropped quietly
+		if(!nacked){
+			nacked = true;
+			onAck();
+		}
+		return;
+	}
+	nacked = false;
+
+	while(len > 0){
+		const size_t chunk = std::min(len, BufferSize - fillLen);
+		memcpy(buffers[fill].get() + fillLen, data, chunk);
+		fillLen += chunk;
+		received += chunk;
+		data += chunk;
+		len -= chunk;
+
+		// The limit keeps a packet from reaching past a full fill buffer while the spare one is written
+		if(fillDone() && flushing < 0){
+			handOff();
+		}
+	}
+
+	if(received - acked >= AckStride || received == size){
+		acked = received;
+		onAck();
+	}
+}
+
+const uint8_t* BLE::BulkRx::data(uint8_t buffer, uint32_t session){
+	std::lock_guard lock(mut);
+	if(!active || session != this->session) return nullptr;
+
+	// The buffer is the writer's until flushed(), the callback only fills the other one
+	return buffers[buffer].get();
+}
+
+void BLE::BulkRx::flushed(){
+	{
+		std::lock_guard lock(mut);
+		if(!active) return;
+		flushing = -1;
+
+		// Filled up while this one was written, the client waits for the limit to move on
+		if(fillDone()){
+			handOff();
+		}
+	}
+
+	onAck();
+}
+
+BLE::BulkRx::Window BLE::BulkRx::window(){
+	std::lock_guard lock(mut);
+	return { received, limit() };
+}
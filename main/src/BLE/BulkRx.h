@@ -0,0 +1,85 @@
+#ifndef CLOCKSTAR_FIRMWARE_BULKRX_H
+#define CLOCKSTAR_FIRMWARE_BULKRX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace BLE {
+
+/**
+ * Receive side of a bulk transfer written without response as packets of [u32 offset][payload].
+ *
+ * Packets are copied from the Bluedroid callback into one of two buffers. A full one is handed to the owner's writer
+ * task through onFlush while the other keeps filling, and returned with flushed(). The client may send up to the limit
+ * in the stream position reported by window(), which never reaches past a buffer that's still being written, so
+ * nothing is dropped for lack of room. onAck asks the owner to send the window every AckStride and whenever a buffer
+ * comes back. A packet off the received offset is dropped and asks for one window the client rewinds to.
+ *
+ * Both callbacks run under the lock from the Bluedroid task or from flushed() and must only post to the writer.
+ * onFlush must never be dropped, the buffer would stay with the writer, so owners keep a queue slot for it.
+ */
+class BulkRx {
+public:
+	/** @param session Flushes of an earlier transfer must be dropped, data() returns nullptr for them */
+	using FlushCB = std::function<void(uint8_t buffer, uint32_t size, uint32_t session)>;
+	using AckCB = std::function<void()>;
+
+	BulkRx(size_t bufferSize, FlushCB onFlush, AckCB onAck);
+
+	/** Allocates the buffers and starts receiving size bytes from offset 0. @return False if out of memory */
+	bool begin(uint32_t size);
+
+	/** Stops receiving and frees the buffers */
+	void cancel();
+
+	/** Whether a transfer of size bytes is in progress, clearing the rewind request if so, for the client to resume */
+	bool resume(uint32_t size);
+
+	void onData(const uint8_t* data, size_t len);
+
+	/** Writer side. @return Contents of a handed off buffer, nullptr if its transfer was cancelled since */
+	const uint8_t* data(uint8_t buffer, uint32_t session);
+
+	/** Returns the buffer handed off last, and hands the other one off right away if it filled up meanwhile */
+	void flushed();
+
+	struct Window {
+		uint32_t received; // [B]
+		uint32_t limit; // [B]
+	};
+	Window window();
+
+	static constexpr size_t HeaderSize = 4; // [B] packet offset
+
+private:
+	const size_t BufferSize; // [B]
+	const size_t AckStride; // [B]
+
+	const FlushCB onFlush;
+	const AckCB onAck;
+
+	std::mutex mut;
+	bool active = false;
+	uint32_t size = 0; // [B]
+	uint32_t received = 0; // [B]
+	uint32_t acked = 0; // [B] received offset of the last ack asked for
+	bool nacked = false; // Off-offset packet answered, until the client rewinds
+	std::unique_ptr<uint8_t[]> buffers[2];
+	uint8_t fill = 0;
+	uint32_t fillLen = 0; // [B]
+	int8_t flushing = -1; // Buffer owned by the writer
+	uint32_t session = 0;
+
+	uint32_t limit() const;
+	bool fillDone() const;
+	void handOff();
+
+};
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_BULKRX_H
@@ -1,6 +1,10 @@
 #include "Client.h"
 #include "GAP.h"
+#include "ConMan.h"
+#include "Dispatch.h"
+#include "Util/stdafx.h"
 #include <cstring>
+#include <algorithm>
 #include <esp_log.h>
 #include <esp_gap_ble_api.h>
 #include <esp_gattc_api.h>
@@ -16,11 +20,16 @@ BLE::Client::Client(GAP* gap) : gap(gap){
 	}
 	self = this;
 
-	esp_ble_gattc_register_callback([](esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t* param){
+	Dispatch::get().setGATTCHandler([](esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t* param){
 		if(self == nullptr) return;
 		self->ble_GATTC_cb(event, gattc_if, param);
 	});
 
+	esp_ble_gattc_register_callback([](esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t* param){
+		if(self == nullptr) return;
+		Dispatch::get().post(event, gattc_if, param);
+	});
+
 	if(iface.appID == 0xff){
 		iface.appID = AppID;
 		esp_ble_gattc_app_register(AppID);
@@ -78,6 +87,12 @@ void BLE::Client::ble_GATTC_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_i
 	}else if(event == ESP_GATTC_SEARCH_CMPL_EVT){
 		ESP_LOGI(TAG, "ESP_GATTC_SEARCH_CMPL_EVT");
 		onSearchComplete(&param->search_cmpl);
+	}else if(event == ESP_GATTC_SRVC_CHG_EVT){
+		ESP_LOGI(TAG, "ESP_GATTC_SRVC_CHG_EVT");
+		onServiceChanged(&param->srvc_chg);
+	}else if(event == ESP_GATTC_DIS_SRVC_CMPL_EVT){
+		ESP_LOGI(TAG, "ESP_GATTC_DIS_SRVC_CMPL_EVT");
+		onDiscoveryDone(&param->dis_srvc_cmpl);
 	}else if(event == ESP_GATTC_CLOSE_EVT){
 		ESP_LOGI(TAG, "ESP_GATTC_CLOSE_EVT");
 		onClose(&param->close);
@@ -101,18 +116,62 @@ void BLE::Client::ble_GATTC_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_i
 
 void BLE::Client::onConnect(const esp_ble_gattc_cb_param_t::gattc_connect_evt_param* param){
 	memcpy(con.addr, param->remote_bda, 6);
+	con.time = millis();
+	opened = encrypted = searched = false;
 
 	// Server notifies ConMan, which in turn sets connection parameters
 
 	esp_ble_set_encryption(con.addr, ESP_BLE_SEC_ENCRYPT_MITM);
-	// ble_set_encryption initiates pairing. After the devices complete pairing,
+	// ble_set_encryption initiates pairing, or re-encryption with a bonded peer. Once it's done,
 	// the ESP_GAP_BLE_AUTH_CMPL_EVT comes up (handled by BLE), and BLE calls onPairDone().
+
+	// The stack reports a bonded phone by its identity address, even when it connected with a resolvable private one
+	if(isBonded(con.addr)){
+		ESP_LOGI(TAG, "Bonded peer, opening before encryption completes");
+		open();
+	}
 }
 
-void BLE::Client::onPairDone(){
+bool BLE::Client::isBonded(const esp_bd_addr_t addr){
+	int count = esp_ble_get_bond_device_num();
+	if(count <= 0) return false;
+
+	std::vector<esp_ble_bond_dev_t> bonds(count);
+	if(esp_ble_get_bond_device_list(&count, bonds.data()) != ESP_OK) return false;
+
+	return std::any_of(bonds.begin(), bonds.begin() + count, [addr](const esp_ble_bond_dev_t& bond){
+		return memcmp(bond.bd_addr, addr, sizeof(esp_bd_addr_t)) == 0;
+	});
+}
+
+void BLE::Client::open(){
+	opened = true;
 	esp_ble_gattc_open(iface.hndl, con.addr, BLE_ADDR_TYPE_PUBLIC, true);
 }
 
+void BLE::Client::onPairDone(){
+	encrypted = true;
+	ESP_LOGI(TAG, "Encrypted %lu ms after connecting", (uint32_t) (millis() - con.time));
+
+	if(!opened){
+		open();
+		return;
+	}
+
+	if(!searched) return;
+
+	// Searched before encryption: a service the phone only shows on an encrypted link gets a second look,
+	// answered from the attribute table the first search loaded
+	const bool missing = std::any_of(services.begin(), services.end(), [](const auto& svc){ return !svc->established(); });
+	if(missing){
+		searched = false;
+		searchServices();
+		return;
+	}
+
+	pullServices();
+}
+
 void BLE::Client::onOpen(const esp_ble_gattc_cb_param_t::gattc_open_evt_param* param){
 	if(param->status != ESP_GATT_OK){
 		ESP_LOGE(TAG, "open failed, error status = 0x%x", param->status);
@@ -120,8 +179,13 @@ void BLE::Client::onOpen(const esp_ble_gattc_cb_param_t::gattc_open_evt_param* p
 	}
 
 	con.hndl = param->conn_id;
+	rediscovering = false;
 
 	esp_ble_gattc_send_mtu_req(iface.hndl, con.hndl);
+
+	// A bonded peer's attribute table comes from the stack's NVS cache, so the search completes without any
+	// over-the-air discovery and doesn't need to wait for the MTU exchange
+	searchServices();
 }
 
 void BLE::Client::onMtuResp(const esp_ble_gattc_cb_param_t::gattc_cfg_mtu_evt_param* param){
@@ -131,8 +195,6 @@ void BLE::Client::onMtuResp(const esp_ble_gattc_cb_param_t::gattc_cfg_mtu_evt_pa
 	}
 
 	con.MTU_size = param->mtu; // TODO: check if this really sets the MTU on the remote device side
-
-	searchServices();
 }
 
 void BLE::Client::searchServices(){
@@ -155,6 +217,20 @@ void BLE::Client::onSearchComplete(const esp_ble_gattc_cb_param_t::gattc_search_
 		return;
 	}
 
+	ESP_LOGI(TAG, "Services %s", param->searched_service_source == ESP_GATT_SERVICE_FROM_NVS_FLASH ? "loaded from cache" : "discovered");
+	searched = true;
+
+	// Bonded fast path, the CCCD writes in pull would fail with insufficient authentication until the link is encrypted
+	if(!encrypted) return;
+
+	pullServices();
+
+	// TODO: disconnect if no registered service is found on remote server
+}
+
+void BLE::Client::pullServices(){
+	ESP_LOGI(TAG, "Services ready %lu ms after connecting", (uint32_t) (millis() - con.time));
+
 	// TODO: invoke pull on the service which search results belong to
 	// current implementation only works with one service registered, I think
 	for(auto& svc : services){
@@ -162,8 +238,30 @@ void BLE::Client::onSearchComplete(const esp_ble_gattc_cb_param_t::gattc_search_
 		if(svc->populated()) continue;
 		svc->pull();
 	}
+}
 
-	// TODO: disconnect if no registered service is found on remote server
+void BLE::Client::onServiceChanged(const esp_ble_gattc_cb_param_t::gattc_srvc_chg_evt_param* param){
+	if(!con || memcmp(param->remote_bda, con.addr, sizeof(esp_bd_addr_t)) != 0) return;
+
+	// The stack drops its cached table and rediscovers on its own, the handles we hold are stale until it's done
+	ESP_LOGI(TAG, "Remote services changed, rediscovering");
+	for(auto& svc : services){
+		svc->close();
+	}
+	chars.clear();
+	rediscovering = true;
+}
+
+void BLE::Client::onDiscoveryDone(const esp_ble_gattc_cb_param_t::gattc_dis_srvc_cmpl_evt_param* param){
+	if(!rediscovering || param->conn_id != con.hndl) return;
+	rediscovering = false;
+
+	if(param->status != ESP_GATT_OK){
+		ESP_LOGE(TAG, "Rediscovery failed, error status = %x", param->status);
+		return;
+	}
+
+	searchServices();
 }
 
 void BLE::Client::onClose(const esp_ble_gattc_cb_param_t::gattc_close_evt_param* param){
@@ -183,6 +281,10 @@ void BLE::Client::onDisconnect(const esp_ble_gattc_cb_param_t::gattc_disconnect_
 void BLE::Client::passToChar(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t* param){
 #define check(x) do { if(x == chars.end()){ ESP_LOGW(TAG, "Received event %d directed to non-registered characteristic", event); return; } } while(0)
 
+	if(event != ESP_GATTC_REG_FOR_NOTIFY_EVT){
+		ConMan.dataActivity();
+	}
+
 	if(event == ESP_GATTC_REG_FOR_NOTIFY_EVT){
 		ESP_LOGI(TAG, "ESP_GATTC_REG_FOR_NOTIFY_EVT");
 
@@ -228,6 +330,8 @@ void BLE::Client::close(){
 		svc->close();
 	}
 	chars.clear();
+	rediscovering = false;
+	opened = encrypted = searched = false;
 
 	con.hndl = 0;
 	memset(con.addr, 0, 6);
@@ -53,6 +53,7 @@ private:
 		uint16_t hndl = 0xffff;
 
 		uint16_t MTU_size = 500;
+		uint64_t time = 0; // [ms] connected at
 
 		operator bool(){ return hndl != 0xffff; }
 	} con;
@@ -62,6 +63,18 @@ private:
 	GAP* gap;
 	void onPairDone();
 
+	/**
+	 * Bonded peers skip the wait for encryption: the GATT open goes out right on connect, so the cached attribute table
+	 * loads (or discovery runs) while the link re-encrypts with the stored keys. Only the CCCD writes need encryption,
+	 * so pulling the found services waits for whichever of the two finishes last.
+	 */
+	bool opened = false; // esp_ble_gattc_open issued for this connection
+	bool encrypted = false;
+	bool searched = false;
+	static bool isBonded(const esp_bd_addr_t addr);
+	void open();
+	void pullServices();
+
 	void onConnect(const esp_ble_gattc_cb_param_t::gattc_connect_evt_param* param);
 	void onOpen(const esp_ble_gattc_cb_param_t::gattc_open_evt_param* param);
 	void onMtuResp(const esp_ble_gattc_cb_param_t::gattc_cfg_mtu_evt_param* param);
@@ -70,6 +83,14 @@ private:
 	void onSearchResult(const esp_ble_gattc_cb_param_t::gattc_search_res_evt_param* param);
 	void onSearchComplete(const esp_ble_gattc_cb_param_t::gattc_search_cmpl_evt_param* param);
 
+	/**
+	 * Discovered attribute tables are kept per peer in NVS by the stack (BT_GATTC_CACHE_NVS_FLASH), so a bonded phone
+	 * reconnecting goes straight from open to the CCCD writes. A Service Changed indication invalidates the table.
+	 */
+	bool rediscovering = false;
+	void onServiceChanged(const esp_ble_gattc_cb_param_t::gattc_srvc_chg_evt_param* param);
+	void onDiscoveryDone(const esp_ble_gattc_cb_param_t::gattc_dis_srvc_cmpl_evt_param* param);
+
 	void onClose(const esp_ble_gattc_cb_param_t::gattc_close_evt_param* param);
 	void onDisconnect(const esp_ble_gattc_cb_param_t::gattc_disconnect_evt_param* param);
 
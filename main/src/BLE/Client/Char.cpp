@@ -16,10 +16,18 @@ std::unique_ptr<BLE::Client::Char::Notif> BLE::Client::Char::getNextNotif(TickTy
 	return notifQueue.get(wait);
 }
 
+void BLE::Client::Char::interrupt(){
+	notifQueue.post(nullptr, 0);
+}
+
 void BLE::Client::Char::setOnConnectedCb(ConnectedCB cb){
 	onConnectedCB = cb;
 }
 
+void BLE::Client::Char::setOnNotifCb(NotifCB cb){
+	onNotifCB = std::move(cb);
+}
+
 bool BLE::Client::Char::established(){
 	return chr != nullptr;
 }
@@ -80,6 +88,11 @@ void BLE::Client::Char::onRegNotify(const esp_ble_gattc_cb_param_t::gattc_reg_fo
 }
 
 void BLE::Client::Char::onNotify(const esp_ble_gattc_cb_param_t::gattc_notify_evt_param* param){
+	if(onNotifCB){
+		onNotifCB(param->value, param->value_len);
+		return;
+	}
+
 	if(notifQueue.size != 1){
 		notifQueue.post(std::make_unique<Notif>(std::vector(param->value, param->value + param->value_len), !param->is_notify), 0);
 	}
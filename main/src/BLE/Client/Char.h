@@ -20,8 +20,18 @@ public:
 	/** Gets next notification in the queue. This is a blocking function. */
 	std::unique_ptr<Notif> getNextNotif(TickType_t wait = portMAX_DELAY);
 
+	/** Makes a getNextNotif() in progress, or the next one, return nullptr, for stopping the task waiting in it. */
+	void interrupt();
+
 	void setOnConnectedCb(ConnectedCB cb);
 
+	/**
+	 * Hands notifications and read results to cb on the BLE worker instead of queueing them for getNextNotif(). The data
+	 * is only valid for the duration of the call, and cb must not block, it holds up every GATT event after it.
+	 */
+	using NotifCB = std::function<void(const uint8_t* data, size_t size)>;
+	void setOnNotifCb(NotifCB cb);
+
 	void writeDescr(uint16_t uuid, const std::vector<uint8_t>& data);
 
 	void write(const std::vector<uint8_t>& data);
@@ -51,6 +61,7 @@ private:
 
 	PtrQueue<Notif> notifQueue;
 	ConnectedCB onConnectedCB;
+	NotifCB onNotifCB;
 
 	void onNotify(const esp_ble_gattc_cb_param_t::gattc_notify_evt_param* param);
 	void onRegNotify(const esp_ble_gattc_cb_param_t::gattc_reg_for_notify_evt_param* param);
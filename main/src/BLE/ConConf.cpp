@@ -1,68 +1,149 @@
 #include <freertos/FreeRTOS.h>
 #include "ConConf.h"
+#include "Util/stdafx.h"
+#include <cstring>
+#include <algorithm>
+#include <esp_log.h>
 
-// TODO: add timout for configuration
+static const char* TAG = "ConConf";
 
 void ConConf::conf(const esp_ble_conn_update_params_t& params){
 	std::lock_guard lock(confMut);
 
 	if(hasCurrent()){
-		pending = params;
+		// Asking for what's already in flight again drops whatever was queued behind it
+		pending = same(params, current) ? esp_ble_conn_update_params_t {} : params;
 		return;
 	}
 
-	send(params);
+	// Already on this set, an update request would only cost the peer a renegotiation
+	if(same(params, applied)) return;
+
+	start(params);
 }
 
 void ConConf::confDone(bool success){
 	std::lock_guard lockConf(confMut);
 
-	if(hasPending()){
-		send(pending);
-		pending = {};
+	if(!hasCurrent() || state != State::Waiting){
+		// Update initiated by the peer, the parameters it picked aren't ours
+		if(!hasCurrent()) applied = {};
 		return;
 	}
 
-	if(!success && hasCurrent()){
-		send(current);
+	if(!success && tries < MaxTries){
+		retry();
 		return;
 	}
 
-	current = {};
+	finish(success);
+}
 
-	std::lock_guard lockWait(waitMut);
-	for(const auto& sem : waitSems){
-		xSemaphoreGive(sem);
-		vSemaphoreDelete(sem);
+void ConConf::start(const esp_ble_conn_update_params_t& params){
+	if(timer == nullptr){
+		timer = xTimerCreate("ConConf", ResponseTimeout, pdFALSE, this, [](TimerHandle_t timer){
+			static_cast<ConConf*>(pvTimerGetTimerID(timer))->onTimer();
+		});
 	}
-	waitSems.clear();
-}
 
-void ConConf::send(esp_ble_conn_update_params_t params){
 	current = params;
-	auto status = esp_ble_gap_update_conn_params(&current);
-	int tries = 1;
-	while(status != ESP_BT_STATUS_SUCCESS && tries < 3){
-		vTaskDelay(10);
-		status = esp_ble_gap_update_conn_params(&current);
-		tries++;
+	tries = 0;
+	startTime = millis();
+	send();
+}
+
+void ConConf::send(){
+	tries++;
+
+	const auto err = esp_ble_gap_update_conn_params(&current);
+	if(err != ESP_OK){
+		ESP_LOGW(TAG, "Update request not accepted by the stack: %s", esp_err_to_name(err));
+		if(tries < MaxTries){
+			retry();
+		}else{
+			finish(false);
+		}
+		return;
 	}
 
-	if(status != ESP_BT_STATUS_SUCCESS){
-		current = {};
+	state = State::Waiting;
+	arm(ResponseTimeout);
+}
+
+void ConConf::retry(){
+	stats.retries++;
+	state = State::Backoff;
+	arm(RetryDelay << std::min<uint8_t>(tries - 1, 8));
+}
+
+void ConConf::finish(bool success){
+	xTimerStop(timer, 0);
+
+	const uint32_t time = (uint32_t) millis() - startTime;
+	stats.negotiations++;
+	stats.lastTime = time;
+	stats.maxTime = std::max(stats.maxTime, time);
+	stats.totalTime += time;
+
+	if(success){
+		applied = current;
+		ESP_LOGI(TAG, "Parameters %u-%u, latency %u applied after %lu ms, %u tries", current.min_int, current.max_int, current.latency, time, tries);
+	}else{
+		stats.failures++;
+		applied = {};
+		ESP_LOGW(TAG, "Giving up on parameters %u-%u, latency %u after %lu ms, %u tries", current.min_int, current.max_int, current.latency, time, tries);
+	}
+
+	current = {};
+	state = State::Idle;
+
+	if(hasPending()){
+		const auto next = pending;
+		pending = {};
+		if(!same(next, applied)){
+			start(next);
+			return;
+		}
+	}
+
+	releaseWaiters();
+}
+
+void ConConf::onTimer(){
+	std::lock_guard lock(confMut);
+
+	if(state == State::Backoff){
+		send();
+	}else if(state == State::Waiting){
+		stats.timeouts++;
+		ESP_LOGW(TAG, "No answer to parameter update in %lu ms", ResponseTimeout);
+		if(tries < MaxTries){
+			retry();
+		}else{
+			finish(false);
+		}
 	}
 }
 
+void ConConf::arm(uint32_t ms){
+	// Called from the timer task too, so never wait on its queue
+	xTimerChangePeriod(timer, pdMS_TO_TICKS(std::max(ms, (uint32_t) 1)), 0);
+}
+
 void ConConf::reset(){
 	std::lock_guard lockConf(confMut);
-	current = pending = {};
-
-	std::lock_guard lockWait(waitMut);
-	for(const auto& sem : waitSems){
-		xSemaphoreGive(sem);
-		vSemaphoreDelete(sem);
+	current = pending = applied = {};
+	state = State::Idle;
+	if(timer){
+		xTimerStop(timer, 0);
 	}
-	waitSems.clear();
+
+	releaseWaiters();
+}
+
+ConConf::Stats ConConf::getStats(){
+	std::lock_guard lock(confMut);
+	return stats;
 }
 
 void ConConf::waitDone(TickType_t wait){
@@ -73,6 +154,20 @@ void ConConf::waitDone(TickType_t wait){
 	waitMut.unlock();
 
 	xSemaphoreTake(sem, wait);
+
+	// Whoever gave it already dropped it from the set, on timeout it's still there
+	waitMut.lock();
+	waitSems.erase(sem);
+	waitMut.unlock();
+	vSemaphoreDelete(sem);
+}
+
+void ConConf::releaseWaiters(){
+	std::lock_guard lockWait(waitMut);
+	for(const auto& sem : waitSems){
+		xSemaphoreGive(sem);
+	}
+	waitSems.clear();
 }
 
 bool ConConf::hasCurrent() const{
@@ -82,3 +177,8 @@ bool ConConf::hasCurrent() const{
 bool ConConf::hasPending() const{
 	return pending.timeout != 0;
 }
+
+bool ConConf::same(const esp_ble_conn_update_params_t& a, const esp_ble_conn_update_params_t& b){
+	return a.min_int == b.min_int && a.max_int == b.max_int && a.latency == b.latency && a.timeout == b.timeout
+		   && memcmp(a.bda, b.bda, sizeof(esp_bd_addr_t)) == 0;
+}
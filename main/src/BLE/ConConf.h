@@ -6,7 +6,13 @@
 #include <mutex>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/timers.h>
 
+/**
+ * Connection parameter negotiation, one request in flight at a time with the latest newer request queued behind it.
+ * Never blocks the caller: failed submissions and unanswered or rejected requests are retried from a software timer
+ * with exponential backoff, and given up on after MaxTries.
+ */
 class ConConf {
 public:
 
@@ -15,18 +21,46 @@ public:
 	void confDone(bool success);
 	void reset();
 
+	struct Stats {
+		uint32_t negotiations = 0; // Finished, successful or not
+		uint32_t failures = 0;
+		uint32_t timeouts = 0;
+		uint32_t retries = 0;
+		uint32_t lastTime = 0; // [ms] first request to the final answer
+		uint32_t maxTime = 0; // [ms]
+		uint32_t totalTime = 0; // [ms]
+	};
+	Stats getStats();
+
 private:
 	esp_ble_conn_update_params_t current = {};
 	esp_ble_conn_update_params_t pending = {};
+	esp_ble_conn_update_params_t applied = {}; // Last set the peer accepted, zeroed when unknown
 	std::mutex confMut;
 
 	bool hasCurrent() const;
 	bool hasPending() const;
+	static bool same(const esp_ble_conn_update_params_t& a, const esp_ble_conn_update_params_t& b);
+
+	enum class State { Idle, Waiting, Backoff } state = State::Idle;
+	uint8_t tries = 0;
+	uint32_t startTime = 0; // [ms]
+	TimerHandle_t timer = nullptr;
+	static constexpr uint8_t MaxTries = 4;
+	static constexpr uint32_t ResponseTimeout = 5000; // [ms]
+	static constexpr uint32_t RetryDelay = 20; // [ms], doubled on each retry
+	Stats stats;
 
-	void send(esp_ble_conn_update_params_t params);
+	void start(const esp_ble_conn_update_params_t& params);
+	void send();
+	void retry();
+	void finish(bool success);
+	void onTimer();
+	void arm(uint32_t ms);
 
 	std::unordered_set<SemaphoreHandle_t> waitSems;
 	std::mutex waitMut;
+	void releaseWaiters();
 
 };
 
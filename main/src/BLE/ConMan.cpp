@@ -1,40 +1,208 @@
 #include "ConMan.h"
 #include <cstring>
+#include <algorithm>
+#include <vector>
+#include <esp_log.h>
+#include "Util/stdafx.h"
+
+static const char* TAG = "ConMan";
 
 ConManager ConMan;
 
-void ConManager::confDone(bool success){
+void ConManager::confDone(const esp_ble_gap_cb_param_t::ble_update_conn_params_evt_param& param){
+	const bool success = param.status == ESP_BT_STATUS_SUCCESS;
+	if(success){
+		std::lock_guard lock(mut);
+		link.interval = param.conn_int;
+		link.latency = param.latency;
+	}
+
 	conConf.confDone(success);
 }
 
-void ConManager::connect(const esp_bd_addr_t addr){
+void ConManager::connect(const esp_bd_addr_t addr, uint16_t interval, uint16_t latency){
+	std::lock_guard lock(mut);
+
+	if(idleTimer == nullptr){
+		idleTimer = xTimerCreate("ConIdle", IdleTimeout, pdFALSE, nullptr, [](TimerHandle_t){ ConMan.checkIdle(); });
+	}
+
+	if(advertising){
+		const uint32_t time = (uint32_t) millis() - advStart;
+		reconnectStats.count++;
+		reconnectStats.last = time;
+		reconnectStats.max = std::max(reconnectStats.max, time);
+		if(directing){
+			reconnectStats.directed++;
+		}
+		ESP_LOGI(TAG, "Connected %lu ms after advertising started%s", time, directing ? ", directed" : "");
+		advertising = false;
+	}
+
+	if(directing){
+		directing = false;
+		xTimerStop(advTimer, 0);
+	}
+
 	connected = true;
+	conStart = millis();
+	notifSeen = false;
 	memcpy(current, addr, 6);
+	link = {};
+	link.interval = interval;
+	link.latency = latency;
+
+	// Service discovery and the initial ANCS/Bangle sync follow right after connecting
+	busy = true;
+	lastActivity = millis();
 	setCon();
+	xTimerChangePeriod(idleTimer, IdleTimeout, 0);
+
+	negotiateLink();
 }
 
 void ConManager::disconnect(){
+	std::lock_guard lock(mut);
+
 	connected = false;
+	busy = false;
+	if(idleTimer){
+		xTimerStop(idleTimer, 0);
+	}
+
+	link = {};
 	conConf.reset();
-	setAdv();
+	startAdv();
 }
 
 void ConManager::goLowPow(){
+	std::lock_guard lock(mut);
+
 	lowPow = true;
 	if(connected){
 		setCon();
-	}else{
+	}else if(!directing){
 		setAdv();
 	}
 }
 
 void ConManager::goHiPow(){
+	std::lock_guard lock(mut);
+
 	lowPow = false;
 	if(connected){
 		setCon();
-	}else{
+	}else if(!directing){
+		setAdv();
+	}
+}
+
+void ConManager::dataActivity(){
+	lastActivity = millis();
+	if(busy || !connected) return;
+
+	std::lock_guard lock(mut);
+	if(busy || !connected || idleTimer == nullptr) return;
+
+	busy = true;
+	setCon();
+	xTimerChangePeriod(idleTimer, IdleTimeout, 0);
+}
+
+void ConManager::checkIdle(){
+	std::lock_guard lock(mut);
+	if(!busy || !connected) return;
+
+	// Traffic since the timer was armed, wait out the rest of the timeout from the last packet
+	const uint32_t idle = (uint32_t) millis() - lastActivity;
+	if(idle < IdleTimeout){
+		xTimerChangePeriod(idleTimer, std::max(IdleTimeout - idle, (uint32_t) 1), 0);
+		return;
+	}
+
+	busy = false;
+	setCon();
+}
+
+void ConManager::setPeer(const esp_bd_addr_t addr, esp_ble_addr_type_t type){
+	std::lock_guard lock(mut);
+	memcpy(peer, addr, sizeof(esp_bd_addr_t));
+	peerType = type;
+	hasPeer = true;
+}
+
+bool ConManager::loadPeer(){
+	if(hasPeer) return true;
+
+	// Bonds live in NVS, so the phone from before a reboot is known too. The list has no order, any bond will do.
+	int count = esp_ble_get_bond_device_num();
+	if(count <= 0) return false;
+
+	std::vector<esp_ble_bond_dev_t> bonds(count);
+	if(esp_ble_get_bond_device_list(&count, bonds.data()) != ESP_OK) return false;
+
+	// The list is read again, a bond removed in between leaves it shorter or empty
+	if(count <= 0 || (size_t) count > bonds.size()) return false;
+	const auto& bond = bonds[count - 1];
+
+	memcpy(peer, bond.bd_addr, sizeof(esp_bd_addr_t));
+	peerType = (bond.bond_key.key_mask & ESP_BLE_ID_KEY_MASK) ? bond.bond_key.pid_key.addr_type : BLE_ADDR_TYPE_PUBLIC;
+	hasPeer = true;
+	return true;
+}
+
+void ConManager::startAdv(){
+	if(advTimer == nullptr){
+		advTimer = xTimerCreate("ConAdv", DirectedBurst, pdFALSE, nullptr, [](TimerHandle_t){ ConMan.endDirected(); });
+	}
+
+	advertising = true;
+	advStart = millis();
+
+	if(!loadPeer()){
+		setAdv();
+		return;
+	}
+
+	esp_ble_adv_params_t params = AdvDirected;
+	memcpy(params.peer_addr, peer, sizeof(esp_bd_addr_t));
+	params.peer_addr_type = peerType;
+
+	if(esp_ble_gap_start_advertising(&params) != ESP_OK){
 		setAdv();
+		return;
 	}
+
+	directing = true;
+	xTimerChangePeriod(advTimer, DirectedBurst, 0);
+}
+
+void ConManager::endDirected(){
+	std::lock_guard lock(mut);
+	if(!directing) return;
+	directing = false;
+
+	if(connected) return;
+
+	// The controller ends high duty directed advertising itself, stopping covers stacks that don't
+	esp_ble_gap_stop_advertising();
+	setAdv();
+}
+
+void ConManager::notifReceived(){
+	std::lock_guard lock(mut);
+	if(!connected || notifSeen) return;
+	notifSeen = true;
+
+	const uint32_t time = (uint32_t) millis() - conStart;
+	reconnectStats.firstNotif = time;
+	reconnectStats.maxFirstNotif = std::max(reconnectStats.maxFirstNotif, time);
+	ESP_LOGI(TAG, "First notification %lu ms after connecting", time);
+}
+
+ConManager::ReconnectStats ConManager::getReconnectStats(){
+	std::lock_guard lock(mut);
+	return reconnectStats;
 }
 
 void ConManager::setAdv(){
@@ -44,7 +212,80 @@ void ConManager::setAdv(){
 void ConManager::setCon(){
 	/* For the IOS system, please reference the apple official documents about the ble connection parameters restrictions. */
 	esp_ble_conn_update_params_t params = {};
-	memcpy(&params, lowPow ? &ConLowPow : &ConHiPow, sizeof(esp_ble_conn_update_params_t));
+	const esp_ble_conn_update_params_t* set = busy ? &ConBusy : (lowPow ? &ConLowPow : &ConHiPow);
+	memcpy(&params, set, sizeof(esp_ble_conn_update_params_t));
 	memcpy(params.bda, current, 6);
 	conConf.conf(params);
 }
+
+ConManager::LinkInfo ConManager::getLink() const{
+	std::lock_guard lock(mut);
+	return link;
+}
+
+void ConManager::setMTU(uint16_t mtu){
+	std::lock_guard lock(mut);
+	link.mtu = mtu;
+}
+
+void ConManager::readRSSI(){
+	std::lock_guard lock(mut);
+	if(!connected) return;
+	esp_ble_gap_read_rssi(current);
+}
+
+void ConManager::rssiDone(const esp_ble_gap_cb_param_t::ble_read_rssi_cmpl_evt_param& param){
+	if(param.status != ESP_BT_STATUS_SUCCESS) return;
+
+	std::lock_guard lock(mut);
+	link.rssi = param.rssi;
+	link.rssiReads++;
+}
+
+ConConf::Stats ConManager::getConfStats(){
+	return conConf.getStats();
+}
+
+void ConManager::negotiateLink(){
+	auto err = esp_ble_gap_set_pkt_data_len(current, MaxDataLen);
+	if(err != ESP_OK){
+		ESP_LOGW(TAG, "Data length request failed: %s", esp_err_to_name(err));
+	}
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+	constexpr esp_ble_gap_phy_mask_t phys = ESP_BLE_GAP_PHY_1M_PREF_MASK | ESP_BLE_GAP_PHY_2M_PREF_MASK;
+	err = esp_ble_gap_set_preferred_phy(current, 0, phys, phys, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+	if(err != ESP_OK){
+		ESP_LOGW(TAG, "PHY request failed: %s", esp_err_to_name(err));
+	}
+#endif
+}
+
+void ConManager::dataLenDone(const esp_ble_gap_cb_param_t::ble_pkt_data_length_cmpl_evt_param& param){
+	if(param.status != ESP_BT_STATUS_SUCCESS){
+		ESP_LOGW(TAG, "Data length extension refused (0x%x), staying at %u B PDUs", param.status, link.txOctets);
+		return;
+	}
+
+	std::lock_guard lock(mut);
+	link.txOctets = param.params.tx_len;
+	link.rxOctets = param.params.rx_len;
+	ESP_LOGI(TAG, "Data length: TX %u B, RX %u B", link.txOctets, link.rxOctets);
+}
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+void ConManager::phyDone(const esp_ble_gap_cb_param_t::ble_phy_update_cmpl_evt_param& param){
+	if(param.status != ESP_BT_STATUS_SUCCESS){
+		ESP_LOGW(TAG, "PHY update refused (0x%x), staying on %s", param.status, link.txPhy == ESP_BLE_GAP_PHY_2M ? "2M" : "1M");
+		return;
+	}
+
+	std::lock_guard lock(mut);
+	link.txPhy = param.tx_phy;
+	link.rxPhy = param.rx_phy;
+
+	auto name = [](uint8_t phy){ return phy == ESP_BLE_GAP_PHY_2M ? "2M" : (phy == ESP_BLE_GAP_PHY_CODED ? "Coded" : "1M"); };
+	ESP_LOGI(TAG, "PHY: TX %s, RX %s", name(link.txPhy), name(link.rxPhy));
+	esp_log_buffer_hex(TAG, param.bda, ESP_BD_ADDR_LEN);
+}
+#endif
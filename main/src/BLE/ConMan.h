@@ -4,29 +4,132 @@
 #include "GAP.h"
 #include "ConConf.h"
 #include <esp_gap_ble_api.h>
+#include <atomic>
+#include <mutex>
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
 
 class ConManager {
 public:
 
-	void connect(const esp_bd_addr_t addr);
+	/** @param interval [1.25 ms] and latency the central connected with */
+	void connect(const esp_bd_addr_t addr, uint16_t interval = 0, uint16_t latency = 0);
 	void disconnect();
 
 	void goLowPow();
 	void goHiPow();
 
+	/**
+	 * Marks traffic on the link: notifications going out, writes coming in, client reads and notifications.
+	 * Switches to the short ConBusy interval right away if the link isn't on it already, and falls back to the
+	 * idle set once nothing moved for IdleTimeout. Cheap enough to call per packet.
+	 */
+	void dataActivity();
+
+	/** Negotiated link layer of the current connection, as reported by the controller. */
+	struct LinkInfo {
+		uint16_t txOctets = 27; // [B] max LL PDU payload
+		uint16_t rxOctets = 27; // [B]
+		uint8_t txPhy = ESP_BLE_GAP_PHY_1M;
+		uint8_t rxPhy = ESP_BLE_GAP_PHY_1M;
+		uint16_t interval = 0; // [1.25 ms], 0 until the first parameter update
+		uint16_t latency = 0; // [connection events]
+		uint16_t mtu = 23; // [B] ATT MTU
+		int8_t rssi = 0; // [dBm] from the last readRSSI()
+		uint32_t rssiReads = 0; // Completed reads, tells a new rssi from the previous one
+	};
+	LinkInfo getLink() const;
+
+	/**
+	 * Asks the controller for the connection's RSSI, which lands in LinkInfo once it answers. It's measured on the
+	 * packets the link exchanges anyway, so reading it costs an HCI command and no radio time.
+	 */
+	void readRSSI();
+
+	/** The server reports the ATT MTU once the client exchanged it. */
+	void setMTU(uint16_t mtu);
+
+	/** How connection parameter negotiations went since boot. */
+	ConConf::Stats getConfStats();
+
+	/** Remembers the peer to aim directed advertising at after a disconnect. GAP calls this once bonding completes. */
+	void setPeer(const esp_bd_addr_t addr, esp_ble_addr_type_t type);
+
+	struct ReconnectStats {
+		uint32_t count = 0;
+		uint32_t directed = 0; // Connected during the directed burst
+		uint32_t last = 0; // [ms] from advertising start to connection
+		uint32_t max = 0; // [ms]
+		uint32_t firstNotif = 0; // [ms] from connection to the first ANCS notification
+		uint32_t maxFirstNotif = 0; // [ms]
+	};
+	ReconnectStats getReconnectStats();
+
+	/** ANCS reports each notification it receives, only the first one after connecting goes into ReconnectStats. */
+	void notifReceived();
+
 private:
 	friend BLE::GAP;
-	void confDone(bool success);
+	void confDone(const esp_ble_gap_cb_param_t::ble_update_conn_params_evt_param& param);
+	void dataLenDone(const esp_ble_gap_cb_param_t::ble_pkt_data_length_cmpl_evt_param& param);
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+	void phyDone(const esp_ble_gap_cb_param_t::ble_phy_update_cmpl_evt_param& param);
+#endif
+	void rssiDone(const esp_ble_gap_cb_param_t::ble_read_rssi_cmpl_evt_param& param);
 	ConConf conConf;
 
-	bool connected = false;
+	std::atomic_bool connected = false;
 	esp_bd_addr_t current;
 
 	bool lowPow = false;
 
+	/**
+	 * Fast up, slow down: the first packet after an idle period requests ConBusy, but going back only happens
+	 * IdleTimeout after the last packet, so a burst with gaps doesn't bounce between the two sets.
+	 * ConConf drops requests for the set that's already applied or in flight.
+	 */
+	std::atomic_bool busy = false;
+	std::atomic_uint32_t lastActivity = 0; // [ms]
+	static constexpr uint32_t IdleTimeout = 3000; // [ms]
+	TimerHandle_t idleTimer = nullptr;
+	mutable std::mutex mut; // Also guards link, which the GAP callbacks fill in
+
+	void checkIdle();
+
+	/**
+	 * After a disconnect the last bonded phone gets a DirectedBurst of high duty cycle directed advertising, which it
+	 * picks up almost immediately if it's in range and scanning at all. Undirected advertising follows, first
+	 * AdvHiPow or AdvLowPow as the power mode says.
+	 */
+	bool hasPeer = false;
+	esp_bd_addr_t peer;
+	esp_ble_addr_type_t peerType = BLE_ADDR_TYPE_PUBLIC;
+	bool loadPeer();
+
+	bool directing = false;
+	TimerHandle_t advTimer = nullptr;
+	static constexpr uint32_t DirectedBurst = 1280; // [ms], the controller's limit for high duty cycle directed
+
+	uint32_t advStart = 0; // [ms]
+	uint32_t conStart = 0; // [ms]
+	bool notifSeen = false;
+	bool advertising = false;
+	ReconnectStats reconnectStats;
+
+	void startAdv();
+	void endDirected();
+
 	void setAdv();
 	void setCon();
 
+	/**
+	 * Asks for Data Length Extension and the 2M PHY right after connecting. Both are requests: a phone that doesn't
+	 * support them keeps the link at 27 B PDUs and 1M, which is the fallback, so 1M stays in the allowed PHYs.
+	 */
+	void negotiateLink();
+	static constexpr uint16_t MaxDataLen = 251; // [B]
+	LinkInfo link;
+
 	static constexpr esp_ble_adv_params_t AdvLowPow = {
 			.adv_int_min        = 2056, // 1285ms = 2056 * 0.625ms
 			.adv_int_max        = 2056, // Apple: Interval should be 20ms. After 30 seconds of no connection, feel free to switch to 1285ms
@@ -45,6 +148,16 @@ private:
 			.adv_filter_policy  = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
 	};
 
+	// Interval is ignored for high duty cycle directed, peer_addr is filled in from the stored bond
+	static constexpr esp_ble_adv_params_t AdvDirected = {
+			.adv_int_min        = 32,
+			.adv_int_max        = 32,
+			.adv_type           = ADV_TYPE_DIRECT_IND_HIGH,
+			.own_addr_type      = BLE_ADDR_TYPE_RPA_PUBLIC,
+			.channel_map        = ADV_CHNL_ALL,
+			.adv_filter_policy  = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+	};
+
 	static constexpr esp_ble_conn_update_params_t ConLowPow = {
 			.min_int = 720, // min_int = 720*1.25ms = 900ms
 			.max_int = 960, // max_int = 960*1.25ms = 1125ms
@@ -52,11 +165,20 @@ private:
 			.timeout = 600 // timeout = 500*10ms = 5000ms
 	};
 
+	// Idle while awake: UI-responsive interval, but the watch may skip up to 4 events when it has nothing to send
 	static constexpr esp_ble_conn_update_params_t ConHiPow = {
 			.min_int = 24, // min_int = 24*1.25ms = 30ms
 			.max_int = 40, // max_int = 40*1.25ms = 50ms
+			.latency = 4, // Apple: max_int * (latency + 1) <= 2s
+			.timeout = 400 // timeout = 400*10ms = 4000ms
+	};
+
+	// Data flowing (ANCS attribute bursts, Bangle JSON): every event, at the shortest interval iOS accepts
+	static constexpr esp_ble_conn_update_params_t ConBusy = {
+			.min_int = 12, // min_int = 12*1.25ms = 15ms
+			.max_int = 24, // max_int = 24*1.25ms = 30ms
 			.latency = 0,
-			.timeout = 400 // timeout = 500*10ms = 5000ms
+			.timeout = 400 // timeout = 400*10ms = 4000ms
 	};
 
 };
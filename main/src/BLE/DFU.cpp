@@ -0,0 +1,264 @@
+#include "DFU.h"
+#include "Util/stdafx.h"
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <algorithm>
+
+static const char* TAG = "BLE::DFU";
+
+static constexpr uint32_t SessionTimeout = 120000; // [ms] without packets before an interrupted transfer is dropped
+static constexpr uint32_t RebootDelay = 1000; // [ms] for Done to reach the client
+
+static uint32_t readU32(const uint8_t* data){
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static uint8_t* writeU32(uint8_t* data, uint32_t val){
+	data[0] = val;
+	data[1] = val >> 8;
+	data[2] = val >> 16;
+	data[3] = val >> 24;
+	return data + 4;
+}
+
+BLE::DFU::DFU(BLE::Server* server) : Threaded("DFU", 4 * 1024, PlannedTask::DFU), server(server), jobs(xQueueCreate(JobCount, sizeof(Job))),
+		rx(BufferSize, [this](uint8_t buffer, uint32_t size, uint32_t session){ post({ .type = Job::Flush, .buffer = buffer, .size = size, .session = session }); },
+		   [this](){ post({ .type = Job::Ack }); }){
+	service = server->addService(ServiceUID);
+
+	// Notifying char first, it gets the service's only client config descriptor, see UART
+	statusChar = service->addChar(StatusCharUID, ESP_GATT_CHAR_PROP_BIT_NOTIFY);
+	ctrlChar = service->addChar(CtrlCharUID, ESP_GATT_CHAR_PROP_BIT_WRITE);
+	dataChar = service->addChar(DataCharUID, ESP_GATT_CHAR_PROP_BIT_WRITE_NR);
+
+	ctrlChar->setOnWriteCb([this](const uint8_t* data, size_t size){ onCtrl(data, size); });
+	dataChar->setOnWriteCb([this](const uint8_t* data, size_t size){ rx.onData(data, size); });
+
+	start();
+}
+
+BLE::DFU::~DFU(){
+	ctrlChar->setOnWriteCb({});
+	dataChar->setOnWriteCb({});
+	stop();
+	cancel();
+	vQueueDelete(jobs);
+}
+
+void BLE::DFU::confirmBoot(){
+	const auto running = esp_ota_get_running_partition();
+	esp_ota_img_states_t state;
+	if(esp_ota_get_state_partition(running, &state) != ESP_OK || state != ESP_OTA_IMG_PENDING_VERIFY) return;
+
+	esp_ota_mark_app_valid_cancel_rollback();
+	ESP_LOGI(TAG, "Updated firmware in %s booted, rollback cancelled", running->label);
+}
+
+void BLE::DFU::post(const Job& job){
+	// Only one buffer is handed off at a time and a lost Flush would never be returned, stalling the transfer for good
+	std::lock_guard lock(postMut);
+	const UBaseType_t reserved = job.type == Job::Flush ? 0 : 1;
+	if(uxQueueSpacesAvailable(jobs) <= reserved || xQueueSend(jobs, &job, 0) != pdTRUE){
+		ESP_LOGW(TAG, "Job queue full, dropping job %d", job.type);
+	}
+}
+
+void BLE::DFU::afterStopSignal(){
+	const Job job = { .type = Job::Exit };
+	xQueueSend(jobs, &job, portMAX_DELAY);
+}
+
+void BLE::DFU::onCtrl(const uint8_t* data, size_t len){
+	if(len == 0) return;
+
+	switch((Op) data[0]){
+		case Op::Begin:
+			if(len < 9) return;
+			post({ .type = Job::Begin, .size = readU32(data + 1), .crc = readU32(data + 5) });
+			break;
+		case Op::End:
+			post({ .type = Job::End });
+			break;
+		case Op::Abort:
+			post({ .type = Job::Abort });
+			break;
+		default:
+			ESP_LOGW(TAG, "Unknown op 0x%02x", data[0]);
+			break;
+	}
+}
+
+void BLE::DFU::loop(){
+	Job job;
+	if(xQueueReceive(jobs, &job, pdMS_TO_TICKS(SessionTimeout)) != pdTRUE){
+		if(ota != 0){
+			ESP_LOGW(TAG, "No packets for %lu s, dropping the transfer at %lu B", SessionTimeout / 1000, written);
+			cancel();
+		}
+		return;
+	}
+
+	switch(job.type){
+		case Job::Begin:
+			begin(job.size, job.crc);
+			break;
+		case Job::End:
+			end();
+			break;
+		case Job::Abort:
+			ESP_LOGI(TAG, "Aborted by the client at %lu B", written);
+			cancel();
+			break;
+		case Job::Flush:
+			flush(job);
+			break;
+		case Job::Ack:
+			sendAck();
+			break;
+		case Job::Exit:
+			break;
+	}
+}
+
+void BLE::DFU::begin(uint32_t size, uint32_t crc){
+	if(ota != 0 && !failed && this->crc == crc && rx.resume(size)){
+		ESP_LOGI(TAG, "Resuming at %lu of %lu B", rx.window().received, size);
+		sendAck();
+		return;
+	}
+
+	cancel();
+
+	slot = esp_ota_get_next_update_partition(nullptr);
+	if(slot == nullptr){
+		ESP_LOGE(TAG, "No OTA slot to update into, is partitions_ota.csv flashed?");
+		sendStatus(Error::NoSlot);
+		return;
+	}
+
+	if(size == 0 || size > slot->size){
+		ESP_LOGE(TAG, "Image of %lu B doesn't fit into %s (%lu B)", size, slot->label, slot->size);
+		sendStatus(Error::TooBig);
+		return;
+	}
+
+	// Sequential writes erase each sector right before programming it, instead of the whole image up front
+	const auto err = esp_ota_begin(slot, OTA_WITH_SEQUENTIAL_WRITES, &ota);
+	if(err != ESP_OK){
+		ESP_LOGE(TAG, "OTA begin failed: %s", esp_err_to_name(err));
+		ota = 0;
+		sendStatus(Error::Flash);
+		return;
+	}
+
+	if(!rx.begin(size)){
+		ESP_LOGE(TAG, "No memory for the write buffers");
+		cancel();
+		sendStatus(Error::NoMemory);
+		return;
+	}
+
+	this->size = size;
+	this->crc = crc;
+	written = 0;
+	runningCrc = 0;
+	failed = false;
+	startTime = millis();
+
+	ESP_LOGI(TAG, "Receiving %lu B into %s", size, slot->label);
+	sendAck();
+}
+
+void BLE::DFU::flush(const Job& job){
+	const uint8_t* data = rx.data(job.buffer, job.session);
+	if(data == nullptr) return;
+
+	if(!failed){
+		const auto err = esp_ota_write(ota, data, job.size);
+		if(err != ESP_OK){
+			ESP_LOGE(TAG, "Write at %lu B failed: %s", written, esp_err_to_name(err));
+			failed = true;
+			sendStatus(err == ESP_ERR_OTA_VALIDATE_FAILED ? Error::Image : Error::Flash);
+		}
+		runningCrc = esp_rom_crc32_le(runningCrc, data, job.size);
+		written += job.size;
+	}
+
+	rx.flushed();
+}
+
+void BLE::DFU::end(){
+	if(ota == 0){
+		sendStatus(Error::Incomplete);
+		return;
+	}
+
+	if(failed){
+		sendStatus(Error::Flash);
+		return;
+	}
+
+	if(written != size){
+		ESP_LOGW(TAG, "End at %lu of %lu B", written, size);
+		sendStatus(Error::Incomplete);
+		return;
+	}
+
+	if(runningCrc != crc){
+		ESP_LOGE(TAG, "CRC mismatch, got 0x%08lx, expected 0x%08lx", runningCrc, crc);
+		cancel();
+		sendStatus(Error::Checksum);
+		return;
+	}
+
+	// Checks the image's header, segments and hash before anything points at it
+	auto err = esp_ota_end(ota);
+	ota = 0;
+	if(err == ESP_OK){
+		err = esp_ota_set_boot_partition(slot);
+	}
+	if(err != ESP_OK){
+		ESP_LOGE(TAG, "Image rejected: %s", esp_err_to_name(err));
+		cancel();
+		sendStatus(Error::Image);
+		return;
+	}
+
+	const uint32_t time = std::max<uint32_t>(millis() - startTime, 1);
+	const uint32_t rate = (uint64_t) size * 1000 / time;
+	ESP_LOGI(TAG, "Received %lu B in %lu ms, %lu.%03lu MB/s, rebooting into %s", size, time, rate / 1000000, (rate / 1000) % 1000, slot->label);
+
+	cancel();
+	sendDone(time, rate);
+
+	vTaskDelay(pdMS_TO_TICKS(RebootDelay));
+	esp_restart();
+}
+
+void BLE::DFU::cancel(){
+	rx.cancel();
+
+	if(ota != 0){
+		esp_ota_abort(ota);
+		ota = 0;
+	}
+}
+
+void BLE::DFU::sendAck(){
+	const auto window = rx.window();
+	uint8_t packet[9] = { (uint8_t) Op::Ack };
+	writeU32(writeU32(packet + 1, window.received), window.limit);
+	statusChar->sendNotif(packet, sizeof(packet));
+}
+
+void BLE::DFU::sendStatus(Error error){
+	const uint8_t packet[2] = { (uint8_t) Op::Status, (uint8_t) error };
+	statusChar->sendNotif(packet, sizeof(packet));
+}
+
+void BLE::DFU::sendDone(uint32_t time, uint32_t rate){
+	uint8_t packet[13] = { (uint8_t) Op::Done };
+	writeU32(writeU32(writeU32(packet + 1, size), time), rate);
+	statusChar->sendNotif(packet, sizeof(packet));
+}
@@ -0,0 +1,119 @@
+#ifndef CLOCKSTAR_FIRMWARE_DFU_H
+#define CLOCKSTAR_FIRMWARE_DFU_H
+
+#include "Server.h"
+#include "BulkRx.h"
+#include "Util/Threaded.h"
+#include <esp_ota_ops.h>
+#include <freertos/queue.h>
+#include <memory>
+
+namespace BLE {
+
+/**
+ * Firmware update over GATT into the inactive OTA slot.
+ *
+ * The client writes Begin with the image size and its CRC32 to the control char, then streams the image to the data
+ * char through BulkRx, up to the limit of the last Ack. The writer task streams each received buffer through
+ * esp_ota_write, which erases sector by sector, so flash never waits on the radio or the other way around.
+ *
+ * The session outlives the connection: a Begin with the same size and CRC after a reconnect resumes at the received
+ * offset. End verifies the CRC, checks the image and boots it.
+ */
+class DFU : private Threaded {
+public:
+	DFU(Server* server);
+	~DFU() override;
+
+	/** Marks a freshly updated app valid, so the bootloader doesn't roll back. Call once the firmware booted fine. */
+	static void confirmBoot();
+
+	enum class Op : uint8_t {
+		Begin = 0x01, // [u32 size][u32 crc32], answered with Ack or Status
+		End = 0x02, // Answered with Done or Status
+		Abort = 0x03,
+
+		Ack = 0x10, // [u32 received][u32 limit]
+		Done = 0x11, // [u32 size][u32 time ms][u32 rate B/s], the watch reboots into the image
+		Status = 0x12 // [u8 Error]
+	};
+
+	enum class Error : uint8_t {
+		None, NoSlot, TooBig, NoMemory, Flash, Incomplete, Checksum, Image
+	};
+
+private:
+	Server* server;
+
+	std::shared_ptr<Server::Service> service;
+	std::shared_ptr<Server::Char> statusChar;
+	std::shared_ptr<Server::Char> ctrlChar;
+	std::shared_ptr<Server::Char> dataChar;
+
+#ifdef CONFIG_CM_OTA_BUFFER
+	static constexpr size_t BufferSize = CONFIG_CM_OTA_BUFFER; // [B]
+#else
+	static constexpr size_t BufferSize = 8192; // [B]
+#endif
+
+	struct Job {
+		enum : uint8_t { Begin, End, Abort, Flush, Ack, Exit } type;
+		uint8_t buffer;
+		uint32_t size;
+		uint32_t crc;
+		uint32_t session;
+	};
+	QueueHandle_t jobs; // The last slot is kept for Flush, see post
+	std::mutex postMut;
+	static constexpr size_t JobCount = 8;
+	void post(const Job& job);
+
+	BulkRx rx;
+	void onCtrl(const uint8_t* data, size_t len);
+
+	// Writer task state
+	esp_ota_handle_t ota = 0;
+	const esp_partition_t* slot = nullptr;
+	uint32_t size = 0; // [B] image
+	uint32_t crc = 0; // expected
+	uint32_t written = 0; // [B]
+	uint32_t runningCrc = 0;
+	uint32_t startTime = 0; // [ms] of the first Begin of the session
+	bool failed = false;
+
+	void loop() override;
+	void afterStopSignal() override;
+	void begin(uint32_t size, uint32_t crc);
+	void flush(const Job& job);
+	void end();
+	void cancel();
+
+	void sendAck();
+	void sendStatus(Error error);
+	void sendDone(uint32_t time, uint32_t rate);
+
+	static constexpr esp_bt_uuid_t ServiceUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x01, 0x00, 0x5D, 0xC5 }}
+	};
+
+	// Status notifies, written to control, data written without response
+	static constexpr esp_bt_uuid_t StatusCharUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x02, 0x00, 0x5D, 0xC5 }}
+	};
+	static constexpr esp_bt_uuid_t CtrlCharUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x03, 0x00, 0x5D, 0xC5 }}
+	};
+	static constexpr esp_bt_uuid_t DataCharUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x04, 0x00, 0x5D, 0xC5 }}
+	};
+
+};
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_DFU_H
@@ -0,0 +1,127 @@
+#include "Dispatch.h"
+#include <esp_log.h>
+#include <cstring>
+#include "Util/Trace.h"
+
+static const char* TAG = "BLE::Dispatch";
+
+BLE::Dispatch& BLE::Dispatch::get(){
+	static Dispatch dispatch;
+	return dispatch;
+}
+
+BLE::Dispatch::Dispatch() : Threaded("BLE", 6 * 1024, PlannedTask::BLE), queue(Slots){
+	start();
+}
+
+void BLE::Dispatch::setGATTSHandler(GATTSHandler handler){
+	gattsHandler = std::move(handler);
+}
+
+void BLE::Dispatch::setGATTCHandler(GATTCHandler handler){
+	gattcHandler = std::move(handler);
+}
+
+void BLE::Dispatch::post(esp_gatts_cb_event_t event, esp_gatt_if_t iface, const esp_ble_gatts_cb_param_t* param){
+	auto evt = queue.acquire(PostWait);
+
+	bool fits = (bool) evt;
+	if(evt){
+		evt->source = Event::Source::GATTS;
+		evt->event = event;
+		evt->iface = iface;
+		evt->param.gatts = *param;
+
+		if(event == ESP_GATTS_WRITE_EVT){
+			fits = copyValue(*evt, &evt->param.gatts.write.value, param->write.len);
+		}
+	}
+
+	if(!fits){
+		evt.reset();
+		inlined++;
+		ESP_LOGW(TAG, "Handling GATTS event %d on the stack's task", event);
+		if(gattsHandler){
+			gattsHandler(event, iface, const_cast<esp_ble_gatts_cb_param_t*>(param));
+		}
+		return;
+	}
+
+	enqueue(std::move(evt));
+}
+
+void BLE::Dispatch::post(esp_gattc_cb_event_t event, esp_gatt_if_t iface, const esp_ble_gattc_cb_param_t* param){
+	auto evt = queue.acquire(PostWait);
+
+	bool fits = (bool) evt;
+	if(evt){
+		evt->source = Event::Source::GATTC;
+		evt->event = event;
+		evt->iface = iface;
+		evt->param.gattc = *param;
+
+		if(event == ESP_GATTC_NOTIFY_EVT){
+			fits = copyValue(*evt, &evt->param.gattc.notify.value, param->notify.value_len);
+		}else if(event == ESP_GATTC_READ_CHAR_EVT || event == ESP_GATTC_READ_DESCR_EVT){
+			fits = copyValue(*evt, &evt->param.gattc.read.value, param->read.value_len);
+		}
+	}
+
+	if(!fits){
+		evt.reset();
+		inlined++;
+		ESP_LOGW(TAG, "Handling GATTC event %d on the stack's task", event);
+		if(gattcHandler){
+			gattcHandler(event, iface, const_cast<esp_ble_gattc_cb_param_t*>(param));
+		}
+		return;
+	}
+
+	enqueue(std::move(evt));
+}
+
+bool BLE::Dispatch::copyValue(Event& evt, uint8_t** ptr, uint16_t len){
+	if(len > MaxValue) return false;
+	if(len > 0 && *ptr != nullptr){
+		memcpy(evt.value, *ptr, len);
+	}
+	*ptr = evt.value;
+	return true;
+}
+
+void BLE::Dispatch::enqueue(PooledPtrQueue<Event>::Ptr evt){
+	TRACE_INSTANT("ble_post");
+	posted++;
+
+	const uint32_t p = ++pending;
+	uint32_t max = maxPending;
+	while(p > max && !maxPending.compare_exchange_weak(max, p)){}
+
+	// Can't fail, the queue is as long as the pool
+	queue.post(std::move(evt), 0);
+}
+
+BLE::Dispatch::Stats BLE::Dispatch::getStats() const{
+	return { posted, inlined, maxPending };
+}
+
+void BLE::Dispatch::handle(Event& evt){
+	TRACE_SCOPE(evt.source == Event::Source::GATTS ? "ble_gatts" : "ble_gattc");
+	if(evt.source == Event::Source::GATTS){
+		if(gattsHandler){
+			gattsHandler((esp_gatts_cb_event_t) evt.event, evt.iface, &evt.param.gatts);
+		}
+	}else{
+		if(gattcHandler){
+			gattcHandler((esp_gattc_cb_event_t) evt.event, evt.iface, &evt.param.gattc);
+		}
+	}
+}
+
+void BLE::Dispatch::loop(){
+	auto evt = queue.get(portMAX_DELAY);
+	if(!evt) return;
+
+	pending--;
+	handle(*evt);
+}
@@ -0,0 +1,81 @@
+#ifndef CLOCKSTAR_FIRMWARE_BLE_DISPATCH_H
+#define CLOCKSTAR_FIRMWARE_BLE_DISPATCH_H
+
+#include <functional>
+#include <atomic>
+#include <Util/Queue.h>
+#include <Util/Threaded.h>
+#include <esp_gatts_api.h>
+#include <esp_gattc_api.h>
+
+namespace BLE {
+
+/**
+ * Moves GATT server and client callback handling off the Bluedroid task. The stack's callbacks only copy the event,
+ * and the attribute value it points to, into a preallocated slot, and the BLE worker task runs the handlers in the
+ * order the events came in. Keeps the stack's callback time to a memcpy, so handler work can't stall the controller.
+ *
+ * When all slots are taken for longer than PostWait, the event is handled on the stack's task instead of dropped,
+ * since a lost write or disconnect would leave a request unanswered or the state wrong.
+ */
+class Dispatch : private Threaded {
+public:
+	static Dispatch& get();
+
+	using GATTSHandler = std::function<void(esp_gatts_cb_event_t event, esp_gatt_if_t iface, esp_ble_gatts_cb_param_t* param)>;
+	using GATTCHandler = std::function<void(esp_gattc_cb_event_t event, esp_gatt_if_t iface, esp_ble_gattc_cb_param_t* param)>;
+
+	/** Set once, before the corresponding app is registered with the stack. */
+	void setGATTSHandler(GATTSHandler handler);
+	void setGATTCHandler(GATTCHandler handler);
+
+	/** Called from the stack's callbacks. */
+	void post(esp_gatts_cb_event_t event, esp_gatt_if_t iface, const esp_ble_gatts_cb_param_t* param);
+	void post(esp_gattc_cb_event_t event, esp_gatt_if_t iface, const esp_ble_gattc_cb_param_t* param);
+
+	struct Stats {
+		uint32_t posted = 0;
+		uint32_t inlined = 0; // Handled on the stack's task, all slots were busy
+		uint32_t maxPending = 0; // [events]
+	};
+	Stats getStats() const;
+
+private:
+	Dispatch();
+
+	static constexpr size_t Slots = 16;
+	static constexpr size_t MaxValue = 517; // [B] largest attribute value the stack hands over, at the 517 B MTU
+	static constexpr TickType_t PostWait = 5; // [ms]
+
+	struct Event {
+		enum class Source : uint8_t { GATTS, GATTC } source;
+		int event;
+		esp_gatt_if_t iface;
+		union {
+			esp_ble_gatts_cb_param_t gatts;
+			esp_ble_gattc_cb_param_t gattc;
+		} param;
+		uint8_t value[MaxValue]; // Deep copy of the value param points to, param is fixed up to point here
+	};
+	PooledPtrQueue<Event> queue;
+
+	GATTSHandler gattsHandler;
+	GATTCHandler gattcHandler;
+
+	std::atomic_uint32_t posted = 0;
+	std::atomic_uint32_t inlined = 0;
+	std::atomic_uint32_t pending = 0;
+	std::atomic_uint32_t maxPending = 0;
+
+	/** Copies len bytes from *ptr into the slot and repoints *ptr there. False if the value doesn't fit. */
+	static bool copyValue(Event& evt, uint8_t** ptr, uint16_t len);
+	void enqueue(PooledPtrQueue<Event>::Ptr evt);
+
+	void handle(Event& evt);
+	void loop() override;
+
+};
+
+}
+
+#endif //CLOCKSTAR_FIRMWARE_BLE_DISPATCH_H
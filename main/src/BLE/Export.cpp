@@ -0,0 +1,186 @@
+#include "Export.h"
+#include "ConMan.h"
+#include "Util/Services.h"
+#include "Util/stdafx.h"
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+static const char* TAG = "BLE::Export";
+
+static uint32_t readU32(const uint8_t* data){
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static uint8_t* writeU16(uint8_t* data, uint16_t val){
+	data[0] = val;
+	data[1] = val >> 8;
+	return data + 2;
+}
+
+static uint8_t* writeU32(uint8_t* data, uint32_t val){
+	data[0] = val;
+	data[1] = val >> 8;
+	data[2] = val >> 16;
+	data[3] = val >> 24;
+	return data + 4;
+}
+
+BLE::Export::Export(BLE::Server* server) : Threaded("Export", 4 * 1024, PlannedTask::Export), server(server), jobs(xQueueCreate(JobCount, sizeof(Job))){
+	service = server->addService(ServiceUID);
+
+	// Notifying char first, it gets the service's only client config descriptor, see UART
+	dataChar = service->addChar(DataCharUID, ESP_GATT_CHAR_PROP_BIT_NOTIFY);
+	ctrlChar = service->addChar(CtrlCharUID, ESP_GATT_CHAR_PROP_BIT_WRITE);
+
+	ctrlChar->setOnWriteCb([this](const uint8_t* data, size_t size){ onCtrl(data, size); });
+
+	start();
+}
+
+BLE::Export::~Export(){
+	ctrlChar->setOnWriteCb({});
+	stop();
+	vQueueDelete(jobs);
+}
+
+void BLE::Export::afterStopSignal(){
+	const Job job = { .type = Job::Exit };
+	xQueueSend(jobs, &job, portMAX_DELAY);
+}
+
+void BLE::Export::onCtrl(const uint8_t* data, size_t len){
+	if(len == 0) return;
+
+	Job job;
+	switch((Op) data[0]){
+		case Op::Request:
+			if(len < 6) return;
+			job = { .type = Job::Request, .seq = readU32(data + 1), .window = data[5] };
+			break;
+		case Op::Ack:
+			if(len < 5) return;
+			job = { .type = Job::Ack, .seq = readU32(data + 1) };
+			break;
+		case Op::Stop:
+			job = { .type = Job::Stop };
+			break;
+		default:
+			ESP_LOGW(TAG, "Unknown op 0x%02x", data[0]);
+			return;
+	}
+
+	if(xQueueSend(jobs, &job, 0) != pdTRUE){
+		ESP_LOGW(TAG, "Job queue full, dropping op 0x%02x", data[0]);
+	}
+}
+
+void BLE::Export::loop(){
+	// Sends without waiting while the window allows, the queue is only polled between blocks
+	const bool open = active && next < acked + window;
+	const TickType_t wait = !active ? portMAX_DELAY : open ? 0 : pdMS_TO_TICKS(AckTimeout);
+
+	Job job;
+	if(xQueueReceive(jobs, &job, wait) != pdTRUE){
+		if(open){
+			sendBlock();
+		}else if(active){
+			ESP_LOGW(TAG, "No ack for %lu s, stopping at block %lu", AckTimeout / 1000, next);
+			active = false;
+		}
+		return;
+	}
+
+	switch(job.type){
+		case Job::Request:
+			request(job.seq, job.window);
+			break;
+		case Job::Ack:
+			if(active && job.seq >= acked){
+				acked = std::min(job.seq + 1, next);
+			}
+			break;
+		case Job::Stop:
+			active = false;
+			break;
+		case Job::Exit:
+			break;
+	}
+}
+
+void BLE::Export::request(uint32_t from, uint8_t window){
+	auto log = Services.get<Service::DataLog>();
+	if(log == nullptr){
+		sendInfo({ 0, 0 });
+		return;
+	}
+
+	const auto range = log->range();
+	next = std::clamp(from, range.first, range.last);
+	last = range.last;
+	acked = next;
+	this->window = std::clamp<uint8_t>(window, 1, MaxWindow);
+	sentBytes = 0;
+	startTime = millis();
+	active = true;
+
+	ESP_LOGI(TAG, "Sending blocks %lu to %lu, window %u", next, last, this->window);
+	sendInfo(range);
+}
+
+void BLE::Export::sendBlock(){
+	auto log = Services.get<Service::DataLog>();
+	if(log == nullptr || !log->read(next, block)){
+		// Overwritten by the ring since the request, the phone sees the gap in the seqs
+		const auto range = log ? log->range() : DataLog::Range{ 0, 0 };
+		if(log == nullptr || next >= range.first){
+			active = false;
+			return;
+		}
+		next = acked = range.first;
+		return;
+	}
+
+	const size_t size = DataLog::HeaderSize + std::min<size_t>(block.used, sizeof(block.data));
+	const size_t chunk = std::min<size_t>(ConMan.getLink().mtu - 3 - ChunkHeader, MaxChunk);
+	const auto raw = (const uint8_t*) &block;
+
+	for(size_t offset = 0; offset < size; offset += chunk){
+		const size_t len = std::min(chunk, size - offset);
+		packet[0] = (uint8_t) Op::Chunk;
+		memcpy(writeU16(writeU32(packet + 1, next), offset), raw + offset, len);
+
+		if(!dataChar->sendNotif(packet, ChunkHeader + len)){
+			ESP_LOGI(TAG, "Link gone at block %lu, the phone resumes from there", next);
+			active = false;
+			return;
+		}
+		sentBytes += len;
+	}
+
+	if(next == last){
+		finish();
+	}else{
+		next++;
+	}
+}
+
+void BLE::Export::finish(){
+	const uint32_t time = std::max<uint32_t>(millis() - startTime, 1);
+	ESP_LOGI(TAG, "Sent %lu B in %lu ms, %llu B/s", sentBytes, time, (uint64_t) sentBytes * 1000 / time);
+
+	send(Op::End, last);
+	active = false;
+}
+
+void BLE::Export::send(Op op, uint32_t val){
+	uint8_t data[5] = { (uint8_t) op };
+	writeU32(data + 1, val);
+	dataChar->sendNotif(data, sizeof(data));
+}
+
+void BLE::Export::sendInfo(const DataLog::Range& range){
+	uint8_t data[9] = { (uint8_t) Op::Info };
+	writeU32(writeU32(data + 1, range.first), range.last);
+	dataChar->sendNotif(data, sizeof(data));
+}
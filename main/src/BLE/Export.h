@@ -0,0 +1,101 @@
+#ifndef CLOCKSTAR_FIRMWARE_EXPORT_H
+#define CLOCKSTAR_FIRMWARE_EXPORT_H
+
+#include "Server.h"
+#include "Services/DataLog.h"
+#include "Util/Threaded.h"
+#include <freertos/queue.h>
+#include <memory>
+
+namespace BLE {
+
+/**
+ * Streams DataLog blocks to the phone over GATT.
+ *
+ * The phone writes Request with the first block it's missing and how many blocks it takes unacknowledged. The watch
+ * answers with Info and sends each block from there on as it's stored, header and used data only, in MTU-sized Chunk
+ * notifications, one per Server::notify call so UART traffic goes out in between. Once the window is used up, sending
+ * waits for an Ack, stopping if none comes within AckTimeout. The open block goes last and is followed by End. After a
+ * reconnect, the phone resumes with a Request from the open block it got last, which has grown meanwhile.
+ *
+ * Control writes and data notifications, little endian:
+ * 	Request [u32 from seq][u8 window]	answered with Info [u32 first][u32 last]
+ * 	Ack [u32 seq]	every block up to seq is in
+ * 	Stop
+ * 	Chunk [u32 seq][u16 offset][bytes]	a block is complete once it has its HeaderSize plus used bytes
+ * 	End [u32 last]
+ */
+class Export : private Threaded {
+public:
+	Export(Server* server);
+	~Export() override;
+
+	enum class Op : uint8_t {
+		Request = 0x01, Ack = 0x02, Stop = 0x03,
+		Info = 0x10, Chunk = 0x11, End = 0x12
+	};
+
+private:
+	Server* server;
+
+	std::shared_ptr<Server::Service> service;
+	std::shared_ptr<Server::Char> dataChar;
+	std::shared_ptr<Server::Char> ctrlChar;
+
+	static constexpr uint8_t MaxWindow = 16; // [blocks]
+	static constexpr uint32_t AckTimeout = 10000; // [ms]
+	static constexpr size_t ChunkHeader = 7; // [B] op, seq, offset
+	static constexpr size_t MaxChunk = 517 - 3 - ChunkHeader; // [B] at the largest ATT MTU
+
+	struct Job {
+		enum : uint8_t { Request, Ack, Stop, Exit } type;
+		uint32_t seq;
+		uint8_t window;
+	};
+	QueueHandle_t jobs;
+	static constexpr size_t JobCount = 8;
+	void onCtrl(const uint8_t* data, size_t len);
+
+	// Sender task state
+	bool active = false;
+	uint32_t next = 0; // Seq to send next
+	uint32_t last = 0; // Open block when the request came in
+	uint32_t acked = 0; // Seq up to which the phone has everything, +1
+	uint8_t window = 1;
+	uint32_t sentBytes = 0; // [B]
+	uint64_t startTime = 0; // [ms]
+
+	DataLog::Block block;
+	uint8_t packet[ChunkHeader + MaxChunk];
+
+	void loop() override;
+	void afterStopSignal() override;
+
+	void request(uint32_t from, uint8_t window);
+	void sendBlock();
+	void finish();
+
+	void send(Op op, uint32_t val);
+	void sendInfo(const DataLog::Range& range);
+
+	static constexpr esp_bt_uuid_t ServiceUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x21, 0x00, 0x5D, 0xC5 }}
+	};
+
+	// Data notifies, written to control
+	static constexpr esp_bt_uuid_t DataCharUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x22, 0x00, 0x5D, 0xC5 }}
+	};
+	static constexpr esp_bt_uuid_t CtrlCharUID = {
+			.len = ESP_UUID_LEN_128,
+			.uuid = { .uuid128 = { 0x6B, 0x1C, 0x3F, 0x8A, 0x52, 0xD4, 0x4E, 0x97, 0xA1, 0x0C, 0x7E, 0x25, 0x23, 0x00, 0x5D, 0xC5 }}
+	};
+
+};
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_EXPORT_H
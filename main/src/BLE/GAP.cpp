@@ -3,6 +3,7 @@
 #include "Server.h"
 #include "ConMan.h"
 #include <esp_log.h>
+#include "Util/Trace.h"
 #include <esp_gap_ble_api.h>
 #include <esp_gatt_common_api.h>
 
@@ -48,12 +49,27 @@ void BLE::GAP::startAdvertising(){
 }
 
 void BLE::GAP::ble_GAP_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param){
+	TRACE_SCOPE("ble_gap");
 	ESP_LOGV(TAG, "GAP_EVT, event %d", event);
 	// TODO: handle ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT -> contains connection parameters (min & max interval, etc.)
 
 	switch(event){
 		case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
-			ConMan.confDone(param->update_conn_params.status == ESP_BT_STATUS_SUCCESS);
+			ConMan.confDone(param->update_conn_params);
+			break;
+
+		case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+			ConMan.dataLenDone(param->pkt_data_length_cmpl);
+			break;
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+		case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+			ConMan.phyDone(param->phy_update);
+			break;
+#endif
+
+		case ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT:
+			ConMan.rssiDone(param->read_rssi);
 			break;
 
 		case ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT:
@@ -93,6 +109,7 @@ void BLE::GAP::ble_GAP_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t*
 			}
 			ESP_LOGI(TAG, "paired");
 			esp_log_buffer_hex("addr", param->ble_security.auth_cmpl.bd_addr, ESP_BD_ADDR_LEN);
+			ConMan.setPeer(param->ble_security.auth_cmpl.bd_addr, param->ble_security.auth_cmpl.addr_type);
 
 			if(client){
 				client->onPairDone();
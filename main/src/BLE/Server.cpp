@@ -1,6 +1,7 @@
 #include "Server.h"
 #include "GAP.h"
 #include "ConMan.h"
+#include "Dispatch.h"
 #include <esp_log.h>
 #include <esp_gatts_api.h>
 #include <algorithm>
@@ -17,17 +18,39 @@ BLE::Server::Server(GAP* gap) : gap(gap){
 	}
 	self = this;
 
-	esp_ble_gatts_register_callback([](esp_gatts_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gatts_cb_param_t* param){
+	txCredits = xSemaphoreCreateCounting(MaxInFlight, MaxInFlight);
+	txUncongested = xSemaphoreCreateBinary();
+
+	Dispatch::get().setGATTSHandler([](esp_gatts_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gatts_cb_param_t* param){
 		if(self == nullptr) return;
 		self->ble_GATTS_cb(event, gattc_if, param);
 	});
 
+	esp_ble_gatts_register_callback([](esp_gatts_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gatts_cb_param_t* param){
+		if(self == nullptr) return;
+
+		// TX bookkeeping is only a semaphore give and notify() is waiting on it, so it stays on the stack's task
+		if(event == ESP_GATTS_CONF_EVT){
+			// Also reported for notifications, once the stack has passed them down. Returns the credit taken in notify()
+			xSemaphoreGive(self->txCredits);
+			return;
+		}else if(event == ESP_GATTS_CONGEST_EVT){
+			self->onCongest(&param->congest);
+			return;
+		}
+
+		Dispatch::get().post(event, gattc_if, param);
+	});
+
 	// TODO: This is only needed so GAP can notify the GATT Server when pairing is done
 	gap->setServer(this);
 }
 
 BLE::Server::~Server(){
 	self = nullptr;
+
+	vSemaphoreDelete(txCredits);
+	vSemaphoreDelete(txUncongested);
 }
 
 std::shared_ptr<BLE::Server::Service> BLE::Server::addService(esp_bt_uuid_t uuid){
@@ -192,6 +215,7 @@ void BLE::Server::onMtuResp(const esp_ble_gatts_cb_param_t::gatts_mtu_evt_param*
 	}
 
 	con.MTU_size = param->mtu;
+	ConMan.setMTU(param->mtu);
 	ESP_LOGI(TAG, "Got MTU event. New MTU is %d B", param->mtu);
 }
 
@@ -202,7 +226,7 @@ void BLE::Server::onConnect(const esp_ble_gatts_cb_param_t::gatts_connect_evt_pa
 	// Client will initiate pairing, after which onPairDone() is called
 	// Here, we only set up the connection parameters
 
-	ConMan.connect(param->remote_bda);
+	ConMan.connect(param->remote_bda, param->conn_params.interval, param->conn_params.latency);
 
 	if(onConnectCB){
 		onConnectCB(con.addr);
@@ -213,6 +237,12 @@ void BLE::Server::onDisconnect(const esp_ble_gatts_cb_param_t::gatts_disconnect_
 	ESP_LOGI(TAG, "Disconnected. Reason: 0x%x", param->reason);
 	memset(con.addr, 0, 6);
 	con.hndl = 0xffff;
+	con.MTU_size = 23;
+	resetTx();
+
+	for(const auto& it : chars){
+		it.second->onDisconnect();
+	}
 
 	ConMan.disconnect();
 
@@ -221,6 +251,59 @@ void BLE::Server::onDisconnect(const esp_ble_gatts_cb_param_t::gatts_disconnect_
 	}
 }
 
+void BLE::Server::onCongest(const esp_ble_gatts_cb_param_t::gatts_congest_evt_param* param){
+	congested = param->congested;
+	if(!congested){
+		xSemaphoreGive(txUncongested);
+	}
+}
+
+bool BLE::Server::notify(uint16_t attrHndl, const uint8_t* data, size_t size){
+	std::lock_guard lock(txMut);
+
+	ConMan.dataActivity();
+
+	while(size > 0){
+		if(!con) return false;
+
+		// Notification carries MTU minus the 3 B ATT header
+		const size_t len = std::min(size, (size_t) std::max(con.MTU_size - 3, 1));
+
+		while(congested){
+			if(xSemaphoreTake(txUncongested, TxTimeout) != pdTRUE){
+				ESP_LOGW(TAG, "Link congested, dropping %zu B of notification", size);
+				return false;
+			}
+		}
+
+		if(xSemaphoreTake(txCredits, TxTimeout) != pdTRUE){
+			ESP_LOGW(TAG, "TX queue full, dropping %zu B of notification", size);
+			return false;
+		}
+
+		const auto err = esp_ble_gatts_send_indicate(iface.hndl, con.hndl, attrHndl, len, const_cast<uint8_t*>(data), false);
+		if(err != ESP_OK){
+			xSemaphoreGive(txCredits);
+			ESP_LOGW(TAG, "Notification send failed: %s, dropping %zu B", esp_err_to_name(err), size);
+			return false;
+		}
+
+		data += len;
+		size -= len;
+	}
+
+	return true;
+}
+
+void BLE::Server::resetTx(){
+	// Queued notifications are discarded with the connection, their confirmations never come
+	while(uxSemaphoreGetCount(txCredits) < MaxInFlight){
+		xSemaphoreGive(txCredits);
+	}
+	congested = false;
+	xSemaphoreGive(txUncongested);
+}
+
 void BLE::Server::passToChar(esp_gatts_cb_event_t event, const esp_ble_gatts_cb_param_t* param){
 #define check(x) do { if(x == chars.end()){ ESP_LOGW(TAG, "Received event %d directed to non-registered characteristic", event); return; } } while(0)
 
@@ -233,6 +316,7 @@ void BLE::Server::passToChar(esp_gatts_cb_event_t event, const esp_ble_gatts_cb_
 		chr->second->onRead(&param->read);
 	}else if(event == ESP_GATTS_WRITE_EVT){
 		ESP_LOGI(TAG, "ESP_GATTS_WRITE_EVT");
+		ConMan.dataActivity();
 
 		auto chr = chars.find(param->write.handle);
 		if(chr == chars.end()){
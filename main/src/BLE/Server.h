@@ -8,7 +8,10 @@
 #include <functional>
 #include <unordered_set>
 #include <unordered_map>
+#include <atomic>
+#include <mutex>
 #include <Util/Queue.h>
+#include <freertos/semphr.h>
 #include <esp_bt_defs.h>
 #include <esp_gatt_defs.h>
 #include <esp_gatts_api.h>
@@ -70,6 +73,21 @@ private:
 		operator bool(){ return hndl != 0xffff; }
 	} con;
 
+	/**
+	 * Notification TX. Payloads are split into MTU-sized notifications handed to the stack back to back, so several go
+	 * out per connection event. At most MaxInFlight wait in the stack at once, each returns its credit on
+	 * ESP_GATTS_CONF_EVT, and sending pauses while the stack reports congestion.
+	 */
+	static constexpr size_t MaxInFlight = 8; // [notifications]
+	static constexpr TickType_t TxTimeout = 1000; // [ms] waiting for a credit or for congestion to clear
+	SemaphoreHandle_t txCredits;
+	SemaphoreHandle_t txUncongested;
+	std::atomic_bool congested = false;
+	std::mutex txMut; // Keeps the fragments of a payload together
+	bool notify(uint16_t attrHndl, const uint8_t* data, size_t size);
+	void resetTx();
+	void onCongest(const esp_ble_gatts_cb_param_t::gatts_congest_evt_param* param);
+
 	void ble_GATTS_cb(esp_gatts_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gatts_cb_param_t *param);
 
 	void registerServices();
@@ -1,12 +1,12 @@
 #include <BLE/Server.h>
 #include <esp_log.h>
 #include <cstring>
+#include <algorithm>
 
 static const char* TAG = "BLE::Server::Char";
 
-BLE::Server::Char::Char(esp_bt_uuid_t uuid, esp_gatt_char_prop_t props) : uuid(uuid), props(props), writeQueue((props & (ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR)) ? 12 : 1){
-	writeData.reserve(12 * 1024);
-
+BLE::Server::Char::Char(esp_bt_uuid_t uuid, esp_gatt_char_prop_t props, uint8_t writeDepth) : uuid(uuid), props(props),
+		writeQueue(std::max<uint8_t>(writeDepth, 1), [writeDepth](WriteMsg& msg){ if(writeDepth > 1) msg.data.reserve(WriteMsgCapacity); }){
 	if(props & (ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR)){
 		perm |= ESP_GATT_PERM_WRITE;
 	}
@@ -19,7 +19,7 @@ void BLE::Server::Char::setOnWriteCb(WriteCB cb){
 	onWriteCB = cb;
 }
 
-std::unique_ptr<BLE::Server::Char::WriteMsg> BLE::Server::Char::getNextWrite(TickType_t wait){
+BLE::Server::Char::WriteMsgPtr BLE::Server::Char::getNextWrite(TickType_t wait){
 	if(!(props & (ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR))){
 		ESP_LOGW(TAG, "Requesting write msg, but WRITE property bit isn't");
 		return nullptr;
@@ -28,15 +28,27 @@ std::unique_ptr<BLE::Server::Char::WriteMsg> BLE::Server::Char::getNextWrite(Tic
 	return writeQueue.get(wait);
 }
 
-void BLE::Server::Char::sendNotif(const std::vector<uint8_t>& data){
+void BLE::Server::Char::interrupt(){
+	auto msg = writeQueue.acquire();
+	if(!msg) return; // Queue full, the reader has something to return on anyway
+
+	msg->data.clear();
+	writeQueue.post(std::move(msg), 0);
+}
+
+bool BLE::Server::Char::sendNotif(const std::vector<uint8_t>& data){
+	return sendNotif(data.data(), data.size());
+}
+
+bool BLE::Server::Char::sendNotif(const uint8_t* data, size_t size){
 	if(!(props & (ESP_GATT_CHAR_PROP_BIT_NOTIFY))){
 		ESP_LOGW(TAG, "Sending notif, but NOTIFY property bit isn't set");
-		return;
+		return false;
 	}
 
-	if(!notifyEn) return;
+	if(!notifyEn || !chr) return false;
 
-	chr->sendNotif(data);
+	return chr->sendNotif(data, size);
 }
 
 void BLE::Server::Char::establish(std::unique_ptr<BLE::Server::CharInfo> info){
@@ -79,12 +91,24 @@ void BLE::Server::Char::onWrite(const esp_ble_gatts_cb_param_t::gatts_write_evt_
 	};
 
 	if(param->is_prep){
-		if(param->offset > writeData.size()){
+		if(!prepWrite){
+			prepWrite = writeQueue.acquire();
+			if(!prepWrite){
+				ESP_LOGW(TAG, "Write queue full, refusing prepared write");
+				resp(ESP_GATT_PREPARE_Q_FULL);
+				return;
+			}
+			prepWrite->data.clear();
+		}
+
+		auto& data = prepWrite->data;
+
+		if(param->offset > data.size()){
 			resp(ESP_GATT_INVALID_OFFSET);
 			return;
 		}
 
-		if(param->offset + param->len > writeData.capacity()){
+		if(param->offset + param->len > MaxPreparedLen){
 			resp(ESP_GATT_INVALID_ATTR_LEN);
 			return;
 		}
@@ -101,17 +125,52 @@ void BLE::Server::Char::onWrite(const esp_ble_gatts_cb_param_t::gatts_write_evt_
 
 		if(!resp(ESP_GATT_OK, &rsp)) return;
 
-		writeData.insert(writeData.end(), param->value, param->value + param->len);
+		// A rewritten offset replaces what was queued from there on
+		data.resize(param->offset);
+		data.insert(data.end(), param->value, param->value + param->len);
 	}else{
 		resp(ESP_GATT_OK);
-		writeQueue.post(std::make_unique<WriteMsg>(std::vector(param->value, param->value + param->len)), 0);
+		postWrite(param->value, param->len);
 	}
 }
 
 void BLE::Server::Char::onExecWrite(const esp_ble_gatts_cb_param_t::gatts_exec_write_evt_param* param){
-	if(writeData.empty()) return;
+	if(!prepWrite) return;
 
 	chr->sendResp(param->trans_id, ESP_GATT_OK);
-	writeQueue.post(std::make_unique<WriteMsg>(std::vector(writeData.cbegin(), writeData.cend())), 0);
-	writeData.clear();
+
+	if(param->exec_write_flag == ESP_GATT_PREP_WRITE_CANCEL || prepWrite->data.empty()){
+		prepWrite.reset();
+		return;
+	}
+
+	if(onWriteCB){
+		onWriteCB(prepWrite->data.data(), prepWrite->data.size());
+		prepWrite.reset();
+		return;
+	}
+
+	// Posting can't fail, the queue is as long as the pool the slot came from
+	writeQueue.post(std::move(prepWrite), 0);
+}
+
+void BLE::Server::Char::onDisconnect(){
+	// Prepared writes the client never executed are dropped with the connection
+	prepWrite.reset();
+}
+
+void BLE::Server::Char::postWrite(const uint8_t* data, size_t size){
+	if(onWriteCB){
+		onWriteCB(data, size);
+		return;
+	}
+
+	auto msg = writeQueue.acquire();
+	if(!msg){
+		ESP_LOGW(TAG, "Write queue full, dropping %zu bytes", size);
+		return;
+	}
+
+	msg->data.assign(data, data + size);
+	writeQueue.post(std::move(msg), 0);
 }
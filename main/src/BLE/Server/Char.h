@@ -6,27 +6,41 @@ public:
 
 	struct WriteMsg {
 		std::vector<uint8_t> data;
-		WriteMsg(std::vector<uint8_t> data) : data(std::move(data)){}
 	};
+	using WriteMsgPtr = PooledPtrQueue<WriteMsg>::Ptr;
 
-	std::unique_ptr<WriteMsg> getNextWrite(TickType_t wait = portMAX_DELAY);
+	WriteMsgPtr getNextWrite(TickType_t wait = portMAX_DELAY);
 
-	void sendNotif(const std::vector<uint8_t>& data);
+	/** Posts an empty write, so a getNextWrite() in progress returns, for stopping the task waiting in it. */
+	void interrupt();
 
-	using WriteCB = std::function<void(const std::vector<uint8_t>& data)>;
+	bool sendNotif(const std::vector<uint8_t>& data);
+	bool sendNotif(const uint8_t* data, size_t size);
+
+	/**
+	 * Hands writes to cb on the Bluedroid task instead of queueing them for getNextWrite(). The data is only valid for
+	 * the duration of the call, and cb must not block, notifications from it would wait on events of the same task.
+	 */
+	using WriteCB = std::function<void(const uint8_t* data, size_t size)>;
 	void setOnWriteCb(WriteCB cb);
 
 private:
 	friend BLE::Server;
 	friend BLE::Server::Service;
-	Char(esp_bt_uuid_t uuid, esp_gatt_char_prop_t props);
+	/**
+	 * @param writeDepth Slots for writes waiting in getNextWrite(). Only deeper queues reserve WriteMsgCapacity per
+	 * slot up front, a depth of 1 grows its one slot on demand.
+	 */
+	Char(esp_bt_uuid_t uuid, esp_gatt_char_prop_t props, uint8_t writeDepth);
 
 	esp_bt_uuid_t uuid;
 	esp_gatt_char_prop_t props;
 	esp_gatt_perm_t perm = 0;
 
 	WriteCB onWriteCB;
-	PtrQueue<WriteMsg> writeQueue;
+	static constexpr size_t WriteMsgCapacity = 512; // [B] Max attribute length, so queued writes never reallocate
+	PooledPtrQueue<WriteMsg> writeQueue;
+	void postWrite(const uint8_t* data, size_t size);
 
 	std::unique_ptr<BLE::Server::CharInfo> chr;
 	void establish(std::unique_ptr<BLE::Server::CharInfo> info);
@@ -34,6 +48,7 @@ private:
 	void onRead(const esp_ble_gatts_cb_param_t::gatts_read_evt_param* param);
 	void onWrite(const esp_ble_gatts_cb_param_t::gatts_write_evt_param* param);
 	void onExecWrite(const esp_ble_gatts_cb_param_t::gatts_exec_write_evt_param* param);
+	void onDisconnect();
 
 	// TODO: reset on disconnect
 	bool notifyEn = false;
@@ -41,7 +56,12 @@ private:
 
 	uint16_t ctrlDescrHndl = 0xffff;
 
-	std::vector<uint8_t> writeData; // TODO: clear on disconnect
+	/**
+	 * Prepared (long) writes are reassembled straight into a slot taken from writeQueue's pool and posted as is on
+	 * execute, so the payload is copied once, out of the stack's event.
+	 */
+	WriteMsgPtr prepWrite;
+	static constexpr size_t MaxPreparedLen = 12 * 1024; // [B]
 
 };
 
@@ -21,11 +21,6 @@ esp_err_t BLE::Server::CharInfo::sendResp(uint32_t trans, esp_gatt_status_t stat
 	return esp_ble_gatts_send_response(server->iface.hndl, server->con.hndl, trans, status, resp);
 }
 
-void BLE::Server::CharInfo::sendNotif(std::vector<uint8_t> data){
-	while(data.size()){
-		size_t len = std::min(data.size(), (size_t) server->con.MTU_size - 4);
-		len = std::max(len, 1U);
-		esp_ble_gatts_send_indicate(server->iface.hndl, server->con.hndl, hndl, len, data.data(), false);
-		data.erase(data.begin(), data.begin() + len);
-	}
+bool BLE::Server::CharInfo::sendNotif(const uint8_t* data, size_t size){
+	return server->notify(hndl, data, size);
 }
@@ -14,7 +14,11 @@ public:
 
 	esp_err_t sendResp(uint32_t trans, esp_gatt_status_t status, esp_gatt_rsp_t* resp = nullptr);
 
-	void sendNotif(std::vector<uint8_t> data);
+	/**
+	 * Sends data as notifications of at most MTU - 3 bytes each. Blocks while the link is congested or the TX queue is full.
+	 * @return False if the connection dropped or the link stayed congested for longer than Server::TxTimeout
+	 */
+	bool sendNotif(const uint8_t* data, size_t size);
 
 private:
 	BLE::Server* server;
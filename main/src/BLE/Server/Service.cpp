@@ -8,8 +8,8 @@ BLE::Server::Service::Service(esp_gatt_srvc_id_t id) : id(id){
 
 }
 
-std::shared_ptr<BLE::Server::Char> BLE::Server::Service::addChar(esp_bt_uuid_t uuid, esp_gatt_char_prop_t props){
-	std::shared_ptr<Char> chr(new Char(uuid, props));
+std::shared_ptr<BLE::Server::Char> BLE::Server::Service::addChar(esp_bt_uuid_t uuid, esp_gatt_char_prop_t props, uint8_t writeDepth){
+	std::shared_ptr<Char> chr(new Char(uuid, props, writeDepth));
 	chars.insert(chr);
 	return chr;
 }
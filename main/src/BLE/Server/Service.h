@@ -3,7 +3,8 @@
 
 class Service {
 public:
-	std::shared_ptr<BLE::Server::Char> addChar(esp_bt_uuid_t uuid, esp_gatt_char_prop_t props = 0);
+	/** @param writeDepth Writes queued for getNextWrite(), see Char. Chars with a write callback don't need more than 1. */
+	std::shared_ptr<BLE::Server::Char> addChar(esp_bt_uuid_t uuid, esp_gatt_char_prop_t props = 0, uint8_t writeDepth = 1);
 
 private:
 	friend BLE::Server;
@@ -1,6 +1,11 @@
 #include "UART.h"
+#include <algorithm>
+#include <cstring>
+#include <esp_log.h>
 
-BLE::UART::UART(BLE::Server* server) : Threaded("BLE UART", 2 * 1024), server(server), rxQueue(12){
+static const char* TAG = "BLE::UART";
+
+BLE::UART::UART(BLE::Server* server) : server(server), lineBuf(new uint8_t[MaxLine]){
 	service = server->addService(ServiceUID);
 
 	// Creation order is important due to char shenanigans: When any char creates a descriptor,
@@ -8,16 +13,13 @@ BLE::UART::UART(BLE::Server* server) : Threaded("BLE UART", 2 * 1024), server(se
 	// bit create descriptors that are used by clients to sub for notifs, so the TX char with
 	// NOTIFY bit should be created first.
 	txChar = service->addChar(TxCharUID, ESP_GATT_CHAR_PROP_BIT_NOTIFY);
-	rxChar = service->addChar(RxCharUID, ESP_GATT_CHAR_PROP_BIT_WRITE);
+	rxChar = service->addChar(RxCharUID, ESP_GATT_CHAR_PROP_BIT_WRITE, RxDepth);
 
-	rxBuf.reserve(4 * 1024);
 	txBuf.reserve(4 * 1024);
-
-	start();
 }
 
 BLE::UART::~UART(){
-	stop();
+	msg.reset();
 }
 
 void BLE::UART::printf(const char* fmt, ...){
@@ -27,8 +29,10 @@ void BLE::UART::printf(const char* fmt, ...){
 	va_start(argptr, fmt);
 	int len = vsnprintf((char*) txBuf.data(), txBuf.size(), fmt, argptr);
 	va_end(argptr);
+	if(len <= 0) return;
 
-	txBuf.resize(len);
+	// Output longer than the buffer is cut at its capacity, minus the terminator vsnprintf wrote
+	txBuf.resize(std::min((size_t) len, txBuf.size() - 1));
 	txChar->sendNotif(txBuf);
 }
 
@@ -36,36 +40,197 @@ void BLE::UART::print(const std::vector<uint8_t>& data){
 	txChar->sendNotif(data);
 }
 
+void BLE::UART::print(const char* text, size_t size){
+	txChar->sendNotif((const uint8_t*) text, size);
+}
+
+void BLE::UART::sendFrame(uint8_t type, const uint8_t* payload, size_t size){
+	size = std::min(size, txBuf.capacity() - FrameHeader);
+	txBuf.resize(FrameHeader + size);
+	txBuf[0] = FrameMagic;
+	txBuf[1] = type;
+	txBuf[2] = size;
+	txBuf[3] = size >> 8;
+	if(size > 0){
+		memcpy(txBuf.data() + FrameHeader, payload, size);
+	}
+	txChar->sendNotif(txBuf);
+}
+
 std::vector<uint8_t> BLE::UART::scan(){
-	if(rxBuf.empty()) return {};
-	std::vector<uint8_t> ret = rxBuf;
-	rxBuf.clear();
+	if(lineTaken){
+		lineLen = 0;
+		lineTaken = false;
+	}
+
+	std::vector<uint8_t> ret(lineBuf.get(), lineBuf.get() + lineLen);
+	if(msg){
+		ret.insert(ret.end(), msg->data.cbegin() + pos, msg->data.cend());
+		msg.reset();
+	}
+
+	lineLen = 0;
+	lineOverflow = false;
 	return ret;
 }
 
-void BLE::UART::loop(){
-	auto msg = rxChar->getNextWrite();
-	if(msg == nullptr) return;
+BLE::UART::Line BLE::UART::scan_nl(TickType_t wait){
+	if(lineTaken){
+		lineLen = 0;
+		lineTaken = false;
+	}
+
+	for(;;){
+		if(!nextWrite(wait)) return {};
+
+		// Each byte is scanned once: pos never moves back, and lineBuf only receives what was already scanned
+		const uint8_t* begin = msg->data.data() + pos;
+		const size_t left = msg->data.size() - pos;
+		const auto nl = (const uint8_t*) memchr(begin, '\n', left);
+
+		if(nl == nullptr){
+			append(begin, left);
+			pos += left;
+			continue;
+		}
+
+		const size_t len = nl + 1 - begin;
+		pos += len;
+
+		if(lineLen == 0 && !lineOverflow){
+			// Whole line inside this write, no copy
+			return { begin, len };
+		}
+
+		append(begin, len);
+
+		if(lineOverflow){
+			ESP_LOGW(TAG, "Line longer than %zu B, dropping it", MaxLine);
+			lineLen = 0;
+			lineOverflow = false;
+			continue;
+		}
+
+		lineTaken = true;
+		return { lineBuf.get(), lineLen };
+	}
+}
+
+BLE::UART::Line BLE::UART::scan_frame(TickType_t wait){
+	if(lineTaken){
+		lineLen = 0;
+		lineTaken = false;
+	}
 
-	rxBuf.insert(rxBuf.end(), msg->data.cbegin(), msg->data.cend());
+	for(;;){
+		if(!nextWrite(wait)) return {};
+
+		const uint8_t* begin = msg->data.data() + pos;
+		size_t left = msg->data.size() - pos;
+
+		if(lineLen == 0){
+			const auto magic = (const uint8_t*) memchr(begin, FrameMagic, left);
+			if(magic == nullptr){
+				pos += left;
+				continue;
+			}
+			pos += magic - begin;
+			left -= magic - begin;
+			begin = magic;
+
+			if(left >= FrameHeader){
+				const size_t size = frameSize(begin);
+				if(size > MaxLine){
+					ESP_LOGW(TAG, "Frame of %zu B longer than %zu B, dropping it", size, MaxLine);
+					pos++;
+					continue;
+				}
+
+				if(left >= size){
+					// Whole frame inside this write, no copy
+					pos += size;
+					return { begin, size };
+				}
+			}
+		}
+
+		// Header first, then as much of the frame as it announces, so nothing past the frame is taken
+		const size_t need = lineLen < FrameHeader ? FrameHeader : frameSize(lineBuf.get());
+		const size_t chunk = std::min(left, need - lineLen);
+		append(begin, chunk);
+		pos += chunk;
+
+		if(lineLen < FrameHeader) continue;
+
+		const size_t size = frameSize(lineBuf.get());
+		if(size > MaxLine){
+			ESP_LOGW(TAG, "Frame of %zu B longer than %zu B, dropping it", size, MaxLine);
+			lineLen = 0;
+			continue;
+		}
+
+		if(lineLen == size){
+			lineTaken = true;
+			return { lineBuf.get(), lineLen };
+		}
+	}
+}
 
-	auto nl = std::find(rxBuf.begin(), rxBuf.end(), '\n');
-	if(nl != rxBuf.end()){
-		do {
-			// TODO: Possible fragmentation: lines are created on heap
-			auto line = std::make_unique<Line>(rxBuf.begin(), nl+1);
-			rxBuf.erase(rxBuf.begin(), nl+1);
+bool BLE::UART::wait(TickType_t wait){
+	return nextWrite(wait);
+}
 
-			rxQueue.post(std::move(line));
+void BLE::UART::interrupt(){
+	rxChar->interrupt();
+}
 
-			nl = std::find(rxBuf.begin(), rxBuf.end(), '\n');
-		} while(nl != rxBuf.end());
+void BLE::UART::release(){
+	msg.reset();
+	pos = 0;
+	dropPartial();
+	lineBuf.reset();
+}
+
+void BLE::UART::reserve(){
+	if(!lineBuf){
+		lineBuf.reset(new uint8_t[MaxLine]);
 	}
 }
 
-std::unique_ptr<BLE::UART::Line> BLE::UART::scan_nl(TickType_t wait){
-	auto line = rxQueue.get(wait);
-	if(!line) return nullptr;
+void BLE::UART::dropPartial(){
+	lineLen = 0;
+	lineOverflow = false;
+	lineTaken = false;
+}
+
+bool BLE::UART::nextWrite(TickType_t wait){
+	if(msg && pos >= msg->data.size()){
+		msg.reset();
+	}
+
+	if(!msg){
+		msg = rxChar->getNextWrite(wait);
+		if(!msg) return false;
+		pos = 0;
+
+		// Empty writes come from interrupt()
+		if(msg->data.empty()){
+			msg.reset();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void BLE::UART::append(const uint8_t* data, size_t size){
+	if(lineOverflow) return;
+
+	if(lineLen + size > MaxLine){
+		lineOverflow = true;
+		return;
+	}
 
-	return line;
+	memcpy(lineBuf.get() + lineLen, data, size);
+	lineLen += size;
 }
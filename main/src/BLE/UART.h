@@ -2,27 +2,65 @@
 #define CLOCKSTAR_FIRMWARE_UART_H
 
 #include "Server.h"
-#include "Util/Threaded.h"
 #include <vector>
 
 namespace BLE {
 
-class UART : private Threaded {
+class UART {
 public:
 	UART(Server* server);
 	virtual ~UART();
 
+	/** Formats into the 4 KB TX buffer and sends it in as many notifications as the MTU requires. Blocks until queued. */
 	void printf(const char* fmt, ...);
 	void print(const std::vector<uint8_t>& data);
 
-	// Returns contents of RX buffer and clears it
+	/** Sends text as is, no formatting or copy into the TX buffer. For fixed commands kept in flash. */
+	void print(const char* text, size_t size);
+
+	/** Sends a frame of [FrameMagic][u8 type][u16 length][payload] through the TX buffer, see scan_frame(). */
+	void sendFrame(uint8_t type, const uint8_t* payload = nullptr, size_t size = 0);
+
+	// Returns the received bytes not yet terminated by a new-line and clears them
 	std::vector<uint8_t> scan();
 
+	struct Line {
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+
+		operator bool() const{ return data != nullptr; }
+	};
+
 	/**
-	 * Waits until a new-line character, and returns the contents including the nl char.
-	 * May contain multiple lines. This is a blocking function.
+	 * Waits until a new-line character, and returns one line including the nl char. This is a blocking function.
+	 * The view points into the received write itself, or into lineBuf for lines spread over several writes, and
+	 * stays valid until the next scan() or scan_nl(). Not thread safe, call both from one task.
 	 */
-	std::unique_ptr<std::vector<uint8_t>> scan_nl(TickType_t wait = portMAX_DELAY);
+	Line scan_nl(TickType_t wait = portMAX_DELAY);
+
+	/**
+	 * Binary counterpart of scan_nl(): waits for a whole [FrameMagic][u8 type][u16 length][payload] frame and returns
+	 * it with its FrameHeader, in place or reassembled in lineBuf like lines. Bytes before a FrameMagic are skipped,
+	 * frames longer than lineBuf are dropped.
+	 */
+	Line scan_frame(TickType_t wait = portMAX_DELAY);
+
+	/** Waits for received data without consuming any, so the caller can pick how to scan it */
+	bool wait(TickType_t wait = portMAX_DELAY);
+
+	/** Drops a line or frame received only in part, when switching between the two */
+	void dropPartial();
+
+	/** Makes a scan or wait() in progress return empty, for stopping the task reading */
+	void interrupt();
+
+	/** Frees the line buffer while nobody reads, e.g. with an iPhone connected. reserve() before scanning again. */
+	void release();
+	void reserve();
+
+	static constexpr uint8_t FrameMagic = 0xB1; // Can't start a text line, a stray text write resyncs at the next frame
+	static constexpr size_t FrameHeader = 4; // [B]
+	static size_t frameSize(const uint8_t* header){ return FrameHeader + (header[2] | (header[3] << 8)); }
 
 private:
 	BLE::Server* server;
@@ -33,11 +71,25 @@ private:
 
 
 	std::vector<uint8_t> txBuf;
-	std::vector<uint8_t> rxBuf;
-	using Line = std::vector<uint8_t>;
-	PtrQueue<Line> rxQueue;
 
-	void loop() override;
+	// Write being split, lines are scanned from pos onwards
+	BLE::Server::Char::WriteMsgPtr msg;
+	size_t pos = 0;
+
+	/** Next write into msg, or false after waiting in vain. Drops msg once it's scanned through. */
+	bool nextWrite(TickType_t wait);
+
+	/**
+	 * Unterminated start of a line spread over several writes. Only the line in progress is ever kept, so it always
+	 * starts at 0 and rewinds once the line is consumed, no wrap-around or compaction needed.
+	 */
+	static constexpr size_t MaxLine = 12 * 1024; // [B]
+	static constexpr uint8_t RxDepth = 12; // Writes queued on the RX char, Gadgetbridge sends a message in bursts of them
+	std::unique_ptr<uint8_t[]> lineBuf;
+	size_t lineLen = 0;
+	bool lineOverflow = false;
+	bool lineTaken = false; // Last returned line is in lineBuf
+	void append(const uint8_t* data, size_t size);
 
 	// Nordic UART
 	static constexpr esp_bt_uuid_t ServiceUID = {
@@ -4,14 +4,16 @@
 #include <soc/efuse_reg.h>
 #include <Util/stdafx.h>
 #include <cmath>
+#include <algorithm>
 #include <esp_log.h>
 #include <driver/gpio.h>
 #include "Util/Services.h"
 #include "Services/SleepMan.h"
+#include "Services/Time.h"
 
 static const char* TAG = "Battery";
 
-Battery::Battery() : Threaded("Battery", 3 * 1024, 5, 1), chargeHyst(500, ChargingState::Unplugged), sem(xSemaphoreCreateBinary()), timer(ShortMeasureIntverval, isr, sem){
+Battery::Battery() : Threaded("Battery", 3 * 1024, PlannedTask::Battery), sem(xSemaphoreCreateBinary()), chargeHyst(ChargingState::Unplugged, timerCb, sem), timer(ShortMeasureIntverval, timerCb, sem){
 	gpio_config_t cfg_gpio = {};
 	cfg_gpio.mode = GPIO_MODE_INPUT;
 	cfg_gpio.pull_down_en = GPIO_PULLDOWN_DISABLE;
@@ -37,6 +39,7 @@ Battery::~Battery(){
 void Battery::begin(){
 	start();
 	startTimer();
+	Events::reserve(Facility::Battery, sizeof(Event));
 	gpio_isr_handler_add((gpio_num_t) Pins::get(Pin::Usb), isr, sem);
 }
 
@@ -83,11 +86,17 @@ void Battery::loop(){
 
 	std::lock_guard lock(mut);
 
+	const int8_t pending = pendingSleep.exchange(-1);
+	if(pending != -1){
+		applySleep(pending);
+	}
+
 	checkCharging();
 	if(sleep){
 		ESP_LOGI(TAG, "InSleepReconfigure\n");
 		inSleepReconfigure();
 		sample(true);
+		backOff();
 	}else{
 		sample();
 	}
@@ -102,14 +111,25 @@ void Battery::startTimer(){
 	if((getChargingState() != ChargingState::Unplugged) || !sleep){
 		timer.setPeriod(ShortMeasureIntverval);
 	}else{
-		timer.setPeriod(LongMeasureIntverval);
+		timer.setPeriod(sleepInterval);
 	}
 	timer.start();
 }
 
 void IRAM_ATTR Battery::isr(void* arg){
 	BaseType_t priority = pdFALSE;
+
+	// The edge is all subscribers need to know, they don't wait for the battery task to relay it
+	const Event evt = { .action = Event::Plugged };
+	Events::postFromISR(Facility::Battery, evt, &priority);
+
+	// The charging state still goes through the hysteresis on the task
 	xSemaphoreGiveFromISR(arg, &priority);
+	portYIELD_FROM_ISR(priority);
+}
+
+void Battery::timerCb(void* arg){
+	xSemaphoreGive(arg);
 }
 
 Battery::ChargingState Battery::getChargingState() const{
@@ -121,16 +141,51 @@ bool Battery::isShutdown() const{
 }
 
 void Battery::setSleep(bool sleep){
+	timer.stop();
+	pendingSleep = sleep;
+	xSemaphoreGive(sem);
+}
+
+void Battery::applySleep(bool sleep){
+	if(this->sleep == sleep) return;
+
 	if(!sleep){
 		ESP_LOGI(TAG, "Battery reconfigure on wake\n");
 		inSleepReconfigure();
 	}
 
-	timer.stop();
-	std::lock_guard lock(mut);
-
 	onSleep(sleep);
-
 	this->sleep = sleep;
-	xSemaphoreGive(sem);
-}
\ No newline at end of file
+
+	sleepInterval = LongMeasureIntverval;
+	intervalVoltage = 0;
+}
+
+void Battery::backOff(){
+	const uint16_t now = voltage;
+	const bool holding = intervalVoltage != 0 && std::abs((int) now - (int) intervalVoltage) <= StableVoltage;
+	intervalVoltage = now;
+
+	if(!holding || getLevel() <= Low){
+		sleepInterval = LongMeasureIntverval;
+	}else{
+		sleepInterval = std::min(sleepInterval * 2, MaxSleepInterval);
+	}
+}
+
+BatteryHistory& Battery::getHistory(){
+	return history;
+}
+
+uint16_t Battery::getVoltage() const{
+	return voltage;
+}
+
+void Battery::record(float voltage){
+	this->voltage = (uint16_t) std::max(voltage, 0.0f);
+
+	auto time = Services.get<Service::Time>();
+	if(time == nullptr) return;
+
+	history.add((uint32_t) time->now(), (uint16_t) std::max(voltage, 0.0f), getPerc(), (uint8_t) getChargingState(), !sleep);
+}
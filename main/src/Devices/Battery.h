@@ -4,8 +4,9 @@
 #include <atomic>
 #include "Util/Threaded.h"
 #include "Periph/ADC.h"
-#include "Periph/Timer.h"
-#include "Util/TimeHysteresis.h"
+#include "Util/PoolTimer.h"
+#include "Util/Temporal.h"
+#include "BatteryHistory.h"
 #include <mutex>
 #include <memory>
 
@@ -22,9 +23,10 @@ public:
 	virtual Level getLevel() const = 0;
 	ChargingState getChargingState() const;
 
+	/** Plugged comes straight from the USB pin interrupt on plug-in, Charging follows once the state has settled. */
 	struct Event {
 		enum {
-			Charging, LevelChange
+			Charging, LevelChange, Plugged
 		} action;
 		union {
 			ChargingState chargeStatus;
@@ -35,9 +37,16 @@ public:
 	bool isShutdown() const;
 	void setShutdown(bool value) { shutdown = value; }
 
+	/** Doesn't wait for the battery task, which applies the change before its next sample. */
 	void setSleep(bool sleep);
 	void startTimer();
 
+	/** [mV] of the latest sample, 0 before the first one */
+	uint16_t getVoltage() const;
+
+	/** Downsampled voltage, charge and charging state, e.g. for a drain graph */
+	BatteryHistory& getHistory();
+
 protected:
 	void loop() override;
 
@@ -46,24 +55,44 @@ protected:
 	virtual void sample(bool fresh = false) = 0;
 	virtual void onSleep(bool sleep) {}
 
+	bool isSleeping() const { return sleep; }
+
+	/** Adds a sample to the history, once the time is known */
+	void record(float voltage);
+
 private:
-	static constexpr uint32_t ShortMeasureIntverval = 100;
-	static constexpr uint32_t LongMeasureIntverval = 6000;
+	static constexpr uint32_t ShortMeasureIntverval = 500; // Every sample averages a whole ADC burst, no need to wake more often
+	static constexpr uint32_t LongMeasureIntverval = 30000; // The charge model integrates between samples, the voltage only corrects it
+	static constexpr uint32_t MaxSleepInterval = 240000; // [ms] Sleep samples back off up to this while the voltage holds
+	static constexpr uint16_t StableVoltage = 10; // [mV] Change between sleep samples still counted as holding
+
+	uint32_t sleepInterval = LongMeasureIntverval; // [ms]
+	uint16_t intervalVoltage = 0; // [mV] At the last sleep sample, 0 until there is one
+	/** Doubles the sleep interval while the voltage holds, drops back to LongMeasureIntverval once it moves or runs low */
+	void backOff();
 
 	std::mutex mut;
 
-	TimeHysteresis<ChargingState> chargeHyst;
+	SemaphoreHandle_t sem;
+
+	static constexpr uint32_t ChargeHoldTime = 500; // [ms] Wakes the task when due, a slow measuring interval doesn't delay the change
+	Temporal::Hold<ChargingState, ChargeHoldTime> chargeHyst;
 	ChargingState lastCharging = ChargingState::Unplugged;
 	bool sleep = false;
+	std::atomic_int8_t pendingSleep = -1; // Set by setSleep, -1 if there's no change waiting
+	void applySleep(bool sleep);
 
 	std::atomic_bool abortFlag = false;
 
-	SemaphoreHandle_t sem;
-	Timer timer;
+	PoolTimer timer;
 	static void isr(void* arg);
+	static void timerCb(void* arg);
 
 	bool shutdown = false;
 
+	BatteryHistory history;
+	std::atomic_uint16_t voltage = 0; // [mV]
+
 	/**
 	 * Sometimes ADC will start having an offset during sleep and after wakeup.
 	 * This method will be called every time the Battery class wakes up during sleep,
@@ -0,0 +1,116 @@
+#include "BatteryHistory.h"
+#include <nvs_flash.h>
+#include <esp_log.h>
+#include <algorithm>
+
+static const char* TAG = "BatteryHistory";
+
+BatteryHistory::BatteryHistory(){
+	auto err = nvs_open(NVSNamespace, NVS_READWRITE, &handle);
+	ESP_ERROR_CHECK(err);
+	load();
+}
+
+void BatteryHistory::add(uint32_t time, uint16_t voltage, uint8_t soc, uint8_t state, bool screenOn){
+	std::lock_guard lock(mut);
+
+	const Entry sample = { time, voltage, soc, (uint8_t) ((state & StateMask) | (screenOn ? ScreenOn : 0)) };
+
+	Entry minute, hour, day;
+	if(!feed(data.minutes, Period[(size_t) Resolution::Minute], sample, minute)) return;
+	if(!feed(data.hours, Period[(size_t) Resolution::Hour], minute, hour)) return;
+
+	// An hour is done, that's the batch that goes to flash
+	feed(data.days, Period[(size_t) Resolution::Day], hour, day);
+	write();
+}
+
+template<size_t N>
+bool BatteryHistory::feed(Tier<N>& tier, uint32_t period, const Entry& entry, Entry& closed){
+	Acc& acc = tier.acc;
+
+	bool done = false;
+	if(acc.count > 0 && entry.time / period != acc.start / period){
+		closed = {
+				acc.start / period * period,
+				(uint16_t) ((acc.voltage + acc.count / 2) / acc.count),
+				(uint8_t) ((acc.soc + acc.count / 2) / acc.count),
+				(uint8_t) (acc.state | (acc.screenOn * 2 >= acc.count ? ScreenOn : 0))
+		};
+
+		tier.ring[tier.head] = closed;
+		tier.head = (tier.head + 1) % N;
+		tier.count = std::min((size_t) tier.count + 1, N);
+
+		acc = {};
+		done = true;
+	}
+
+	if(acc.count == 0){
+		acc.start = entry.time;
+	}
+	acc.voltage += entry.voltage;
+	acc.soc += entry.soc;
+	acc.screenOn += (entry.flags & ScreenOn) ? 1 : 0;
+	acc.state = entry.flags & StateMask;
+	acc.count++;
+
+	return done;
+}
+
+size_t BatteryHistory::get(Resolution res, Entry* out, size_t max){
+	std::lock_guard lock(mut);
+
+	switch(res){
+		case Resolution::Minute:
+			return copy(data.minutes, out, max);
+		case Resolution::Hour:
+			return copy(data.hours, out, max);
+		case Resolution::Day:
+			return copy(data.days, out, max);
+		default:
+			return 0;
+	}
+}
+
+template<size_t N>
+size_t BatteryHistory::copy(const Tier<N>& tier, Entry* out, size_t max){
+	const size_t count = std::min((size_t) tier.count, max);
+
+	// The newest count entries, the oldest of them first
+	const size_t first = (tier.head + N - count) % N;
+	for(size_t i = 0; i < count; i++){
+		out[i] = tier.ring[(first + i) % N];
+	}
+
+	return count;
+}
+
+void BatteryHistory::store(){
+	std::lock_guard lock(mut);
+	write();
+}
+
+void BatteryHistory::write(){
+	esp_err_t err = nvs_set_blob(handle, BlobName, &data, sizeof(Data));
+
+	if(err != ESP_OK){
+		ESP_LOGW(TAG, "NVS history store error: %d", err);
+		return;
+	}
+
+	err = nvs_commit(handle);
+	if(err != ESP_OK){
+		ESP_LOGW(TAG, "NVS history commit error: %d", err);
+	}
+}
+
+void BatteryHistory::load(){
+	size_t size = sizeof(Data);
+	auto err = nvs_get_blob(handle, BlobName, &data, &size);
+	if(err != ESP_OK || size != sizeof(Data) || data.version != Version){
+		// Nothing is written until the first hour is done
+		ESP_LOGI(TAG, "No battery history found, starting empty");
+		data = {};
+	}
+}
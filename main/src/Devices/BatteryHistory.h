@@ -0,0 +1,102 @@
+#ifndef CLOCKSTAR_FIRMWARE_BATTERYHISTORY_H
+#define CLOCKSTAR_FIRMWARE_BATTERYHISTORY_H
+
+#include <nvs.h>
+#include <array>
+#include <mutex>
+#include <cstdint>
+
+/**
+ * Battery samples downsampled into averages per minute, hour and day, each resolution kept in a ring of its own.
+ * Raw samples are only summed up, never stored. Everything is persisted in NVS, in the same namespace as Settings,
+ * once per hour when an hour entry is done, so flash is written 24 times a day.
+ */
+class BatteryHistory {
+public:
+	BatteryHistory();
+
+	enum class Resolution : uint8_t {
+		Minute, Hour, Day, COUNT
+	};
+
+	struct __attribute__((packed)) Entry {
+		uint32_t time; //[s] Unix time of the period start
+		uint16_t voltage; //[mV]
+		uint8_t soc; //[%]
+		uint8_t flags; // Charging state in the low two bits, ScreenOn
+	};
+	static constexpr uint8_t StateMask = 0x03;
+	static constexpr uint8_t ScreenOn = 0x04; // Screen was on for at least half of the period
+
+	/**
+	 * Adds a sample, closing the periods it doesn't belong to anymore.
+	 * @param time [s] Unix time
+	 * @param state Battery::ChargingState
+	 */
+	void add(uint32_t time, uint16_t voltage, uint8_t soc, uint8_t state, bool screenOn);
+
+	/**
+	 * Copies up to max entries of a resolution into out, oldest first. The period in progress isn't included.
+	 * @return Number of entries copied
+	 */
+	size_t get(Resolution res, Entry* out, size_t max);
+
+	/** Writes the history to NVS right away, e.g. before a shutdown. */
+	void store();
+
+	static constexpr size_t Minutes = 60;
+	static constexpr size_t Hours = 48;
+	static constexpr size_t Days = 30;
+	static constexpr size_t Capacity[(size_t) Resolution::COUNT] = { Minutes, Hours, Days };
+	static constexpr uint32_t Period[(size_t) Resolution::COUNT] = { 60, 3600, 86400 }; //[s]
+
+private:
+	nvs_handle_t handle{};
+
+	static constexpr const char* NVSNamespace = "Clockstar";
+	static constexpr const char* BlobName = "BattHist";
+	static constexpr uint8_t Version = 1;
+
+	struct __attribute__((packed)) Acc {
+		uint32_t start = 0; //[s]
+		uint32_t voltage = 0;
+		uint32_t soc = 0;
+		uint16_t count = 0;
+		uint16_t screenOn = 0;
+		uint8_t state = 0;
+	};
+
+	template<size_t N>
+	struct __attribute__((packed)) Tier {
+		Acc acc;
+		std::array<Entry, N> ring;
+		uint16_t head = 0; // Next slot to write
+		uint16_t count = 0;
+	};
+
+	/** Blob layout, written and read as a whole */
+	struct __attribute__((packed)) Data {
+		uint8_t version = Version;
+		Tier<Minutes> minutes;
+		Tier<Hours> hours;
+		Tier<Days> days;
+	} data;
+
+	std::mutex mut;
+
+	/**
+	 * Closes the tier's period if the entry is past it, then sums the entry up.
+	 * @return True if a period was closed into closed
+	 */
+	template<size_t N>
+	static bool feed(Tier<N>& tier, uint32_t period, const Entry& entry, Entry& closed);
+
+	template<size_t N>
+	static size_t copy(const Tier<N>& tier, Entry* out, size_t max);
+
+	void load();
+	void write();
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_BATTERYHISTORY_H
@@ -0,0 +1,52 @@
+#include "BatteryModel.h"
+#include "Services/PowerTelemetry.h"
+#include "Util/stdafx.h"
+#include <algorithm>
+
+uint32_t BatteryModel::current(const Load& load){
+	uint32_t current = load.sleep ? PowerTelemetry::SleepCurrent : PowerTelemetry::AwakeCurrent + CPUCurrent[(size_t) load.cpu];
+	current += (uint32_t) load.backlight * BacklightCurrent / 100;
+	if(load.ble){
+		current += BLECurrent;
+	}
+	return current;
+}
+
+float BatteryModel::compensate(float voltage, const Load& load){
+	return voltage + (float) current(load) / 1000.0f * InternalResistance; // [mA] * [Ohm] = [mV]
+}
+
+void BatteryModel::reset(float voltage, const Load& load){
+	soc = ocvToSoC(compensate(voltage, load));
+	lastUpdate = millis();
+}
+
+float BatteryModel::update(float voltage, const Load& load){
+	if(soc < 0){
+		reset(voltage, load);
+		return soc;
+	}
+
+	const uint32_t now = millis();
+	const uint32_t dt = now - lastUpdate;
+	lastUpdate = now;
+
+	// [uA] * [ms] over [mAh] in [uA ms], as a percentage
+	soc -= (float) current(load) * (float) dt / (Capacity * 3.6e7f);
+
+	const float measured = ocvToSoC(compensate(voltage, load));
+	const uint32_t tau = load.sleep ? CorrectionSleep : CorrectionAwake;
+	soc += (measured - soc) * (float) dt / (float) (dt + tau);
+
+	// Past the cut-off the voltage wins right away, the estimate never keeps the device running on an empty cell
+	if(measured <= 0){
+		soc = 0;
+	}
+
+	soc = std::clamp(soc, 0.0f, 100.0f);
+	return soc;
+}
+
+float BatteryModel::get() const{
+	return std::max(soc, 0.0f);
+}
@@ -0,0 +1,101 @@
+#ifndef CLOCKSTAR_FIRMWARE_BATTERYMODEL_H
+#define CLOCKSTAR_FIRMWARE_BATTERYMODEL_H
+
+#include <cstdint>
+#include <cstddef>
+#include "Util/PowerLock.h"
+
+/**
+ * State of charge estimate of the LiPo cell.
+ * Between samples the charge is integrated from the current the device is estimated to draw, which doesn't jump
+ * with the backlight like the voltage does. Every sample pulls the estimate slowly towards the charge the
+ * open-circuit voltage points to, where the open-circuit voltage is the measured one plus the drop the estimated
+ * current causes on the cell's internal resistance.
+ */
+class BatteryModel {
+public:
+	/** What draws current at the moment of a sample */
+	struct Load {
+		uint8_t backlight = 0; //[%] duty
+		bool ble = false; // Connected to the phone
+		PowerProfile cpu = PowerProfile::Idle;
+		bool sleep = false;
+	};
+
+	/** Estimated current draw [uA] */
+	static uint32_t current(const Load& load);
+
+	/** Charge [%] the open-circuit voltage [mV] corresponds to */
+	static constexpr float ocvToSoC(float voltage){
+		if(voltage <= OCV[0].voltage) return 0;
+		for(size_t i = 1; i < sizeof(OCV) / sizeof(OCV[0]); i++){
+			if(voltage >= OCV[i].voltage) continue;
+
+			const auto& lo = OCV[i - 1];
+			const auto& hi = OCV[i];
+			return lo.soc + (hi.soc - lo.soc) * (voltage - lo.voltage) / (hi.voltage - lo.voltage);
+		}
+		return 100;
+	}
+
+	/** Starts the estimate over from the voltage alone */
+	void reset(float voltage, const Load& load);
+
+	/**
+	 * Integrates the charge used since the last sample, then corrects it towards the voltage.
+	 * @param voltage Measured battery voltage [mV]
+	 * @return Charge [%]
+	 */
+	float update(float voltage, const Load& load);
+
+	/** Charge [%] */
+	float get() const;
+
+	static constexpr float VoltEmpty = 3600.0f; //[mV]
+	static constexpr float VoltFull = 4150.0f; //[mV]
+
+private:
+	struct Point {
+		float voltage; //[mV]
+		float soc; //[%]
+	};
+
+	/**
+	 * Resting voltage of a typical LiPo cell, squeezed into the range between the device's cut-off and the voltage
+	 * it reads as full.
+	 */
+	static constexpr Point OCV[] = {
+			{ VoltEmpty, 0 },
+			{ 3680, 5 },
+			{ 3720, 10 },
+			{ 3745, 20 },
+			{ 3770, 30 },
+			{ 3795, 40 },
+			{ 3825, 50 },
+			{ 3865, 60 },
+			{ 3920, 70 },
+			{ 3985, 80 },
+			{ 4060, 90 },
+			{ VoltFull, 100 }
+	};
+
+	static constexpr float Capacity = 250.0f; //[mAh] nominal
+	static constexpr float InternalResistance = 0.3f; //[Ohm] cell and protection, at room temperature
+
+	static constexpr uint32_t BacklightCurrent = 40000; //[uA] at full duty
+	static constexpr uint32_t BLECurrent = 1500; //[uA] connected, averaged over the connection interval
+	static constexpr uint32_t CPUCurrent[(size_t) PowerProfile::COUNT] = { 0, 8000, 18000 }; //[uA] above the Idle profile
+
+	// How long it takes for the voltage to correct the integrated charge. A sleeping cell is close to
+	// its open-circuit voltage, so in sleep the voltage is trusted sooner.
+	static constexpr uint32_t CorrectionAwake = 600000; //[ms]
+	static constexpr uint32_t CorrectionSleep = 120000; //[ms]
+
+	float soc = -1; //[%]
+	uint32_t lastUpdate = 0; //[ms]
+
+	static float compensate(float voltage, const Load& load);
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_BATTERYMODEL_H
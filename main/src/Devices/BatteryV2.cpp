@@ -7,18 +7,20 @@
 #include <driver/gpio.h>
 #include "Services/SleepMan.h"
 #include <Util/Services.h>
+#include "Services/BacklightBrightness.h"
+#include "Notifs/Phone.h"
 
 static const char* TAG = "Battery";
 
-BatteryV2::BatteryV2(ADC& adc) : adc(adc), refSwitch(Pins::get(Pin::BattVref)), hysteresis({ 0, 4, 15, 30, 70, 100 }, 3){
+BatteryV2::BatteryV2(ADCBurst& adc) : adc(adc), refSwitch(Pins::get(Pin::BattVref)), hysteresis({ 0, 4, 15, 30, 70, 100 }, 3){
 	configReader(Pins::get(Pin::BattRead), caliBatt, readerBatt, true);
 	configReader(Pins::get(Pin::BattRead), caliRef, readerRef, false);
 
 	calibrate();
 
 	readerBatt->resetEma();
-	if(readerBatt->getValue() <= 1.f){
-		auto sleepMan = (SleepMan*)Services.get(Service::Sleep);
+	if(readerBatt->getValue() <= BatteryModel::VoltEmpty){
+		auto sleepMan = Services.get<Service::Sleep>();
 		sleepMan->shutdown();
 	}
 
@@ -35,18 +37,9 @@ void BatteryV2::calibrate(){
 	refSwitch.on();
 
 	delayMillis(100);
-	for(int i = 0; i < CalReads; i++){
-		readerRef->sample();
-		delayMillis(10);
-	}
-
-	float total = 0;
-	for(int i = 0; i < CalReads; i++){
-		total += readerRef->sample();
-		delayMillis(10);
-	}
 
-	const float reading = total / (float) CalReads;
+	// A single burst is averaged in place of a series of reads, the reference has settled by now
+	const float reading = readerRef->sample();
 	const float offset = CalExpected - reading;
 	readerBatt->setMoreOffset(offset);
 
@@ -60,19 +53,37 @@ void BatteryV2::calibrate(){
 
 void BatteryV2::sample(bool fresh){
 	if(Battery::isShutdown()) return;
-	if(Battery::getChargingState() != ChargingState::Unplugged) return;
+	if(Battery::getChargingState() != ChargingState::Unplugged){
+		seeded = false;
+		record(readerBatt->sample());
+		return;
+	}
 
 	auto oldLevel = getLevel();
 
+	float voltage;
 	if(fresh){
 		readerBatt->resetEma();
-		const float val = readerBatt->getValue();
-		hysteresis.reset(val);
+		voltage = readerBatt->getValue();
+	}else{
+		voltage = readerBatt->sample();
+	}
+
+	if(!seeded){
+		model.reset(voltage, getLoad());
+		seeded = true;
+	}else{
+		model.update(voltage, getLoad());
+	}
+
+	if(fresh){
+		hysteresis.reset(model.get());
 	}else{
-		const float val = readerBatt->sample();
-		hysteresis.update(val);
+		hysteresis.update(model.get());
 	}
 
+	record(voltage);
+
 	if(oldLevel != getLevel() || fresh){
 		Events::post(Facility::Battery, Battery::Event{ .action = Event::LevelChange, .level = getLevel() });
 	}
@@ -89,13 +100,28 @@ void BatteryV2::onSleep(bool sleep) {
 }
 
 uint8_t BatteryV2::getPerc() const{
-	return readerBatt->getValue();
+	return model.get();
 }
 
 Battery::Level BatteryV2::getLevel() const{
 	return (Level) hysteresis.get();
 }
 
+BatteryModel::Load BatteryV2::getLoad() const{
+	BatteryModel::Load load;
+	load.cpu = PowerLock::getProfile();
+	load.sleep = isSleeping();
+
+	if(auto bl = Services.get<Service::Backlight>()){
+		load.backlight = bl->getDuty();
+	}
+	if(auto phone = Services.get<Service::Phone>()){
+		load.ble = phone->isConnected();
+	}
+
+	return load;
+}
+
 void BatteryV2::inSleepReconfigure(){
 	adc.reinit();
 	adc_cali_delete_scheme_curve_fitting(caliBatt);
@@ -103,16 +129,13 @@ void BatteryV2::inSleepReconfigure(){
 	readerBatt->setMoreOffset(lastCalibrationOffset);
 }
 
-void BatteryV2::configReader(int pin, adc_cali_handle_t& cali, std::unique_ptr<ADCReader>& reader, bool emaAndMap){
+void BatteryV2::configReader(int pin, adc_cali_handle_t& cali, std::unique_ptr<ADCReader>& reader, bool ema){
 	adc_unit_t unit;
 	adc_channel_t chan;
-	ESP_ERROR_CHECK(adc_oneshot_io_to_channel(pin, &unit, &chan));
+	ESP_ERROR_CHECK(adc_continuous_io_to_channel(pin, &unit, &chan));
 	assert(unit == adc.getUnit());
 
-	adc.config(chan, {
-			.atten = ADC_ATTEN_DB_2_5,
-			.bitwidth = ADC_BITWIDTH_12
-	});
+	adc.config(chan, ADC_ATTEN_DB_2_5);
 
 	const adc_cali_curve_fitting_config_t curveCfg = {
 			.unit_id = unit,
@@ -122,8 +145,8 @@ void BatteryV2::configReader(int pin, adc_cali_handle_t& cali, std::unique_ptr<A
 	};
 	ESP_ERROR_CHECK(adc_cali_create_scheme_curve_fitting(&curveCfg, &cali));
 
-	if(emaAndMap){
-		reader = std::make_unique<ADCReader>(adc, chan, caliBatt, BattReadOffset, Factor, EmaA, VoltEmpty, VoltFull);
+	if(ema){
+		reader = std::make_unique<ADCReader>(adc, chan, caliBatt, BattReadOffset, Factor, EmaA);
 	}else{
 		reader = std::make_unique<ADCReader>(adc, chan, caliBatt, Offset, Factor);
 	}
@@ -1,17 +1,18 @@
 #ifndef ARTEMIS_BATTERYV3_H
 #define ARTEMIS_BATTERYV3_H
 
-#include "Periph/ADC.h"
-#include "Util/Hysteresis.h"
+#include "Periph/ADCBurst.h"
+#include "Util/DSP.h"
 #include "Services/ADCReader.h"
 #include "Periph/PinOut.h"
 #include <esp_efuse.h>
 #include <memory>
 #include "Battery.h"
+#include "BatteryModel.h"
 
 class BatteryV2 : public Battery {
 public:
-	BatteryV2(ADC& adc);
+	BatteryV2(ADCBurst& adc);
 	virtual ~BatteryV2() override;
 
 	void setSleep(bool sleep);
@@ -20,9 +21,7 @@ public:
 	virtual Level getLevel() const override;
 
 private:
-	static constexpr float VoltFull = 4150.0f; //[mV]
-	static constexpr float VoltEmpty = 3600.0f; //[mV]
-	static constexpr float EmaA = 0.05f;
+	static constexpr float EmaA = 0.2f; // Every sample is already a burst average
 	static constexpr float EmaA_sleep = 0.5f;
 
 	static constexpr float Factor = 4.0f;
@@ -35,13 +34,14 @@ private:
 	 * Sample size of 2 devices.
 	 */
 	static constexpr float BattReadOffset = 75; //[mV],
-	static constexpr int CalReads = 10;
 	static constexpr float CalExpected = 2500;
 
-	ADC& adc;
+	ADCBurst& adc;
 	PinOut refSwitch;
 
-	Hysteresis hysteresis;
+	DSP::Hysteresis<int, 5> hysteresis;
+	BatteryModel model;
+	bool seeded = false; // Model reset is due after boot and after charging
 
 	std::unique_ptr<ADCReader> readerBatt;
 	adc_cali_handle_t caliBatt;
@@ -52,11 +52,13 @@ private:
 
 	void calibrate();
 
+	BatteryModel::Load getLoad() const;
+
 	virtual void sample(bool fresh) override;
 
 	virtual void onSleep(bool sleep) override;
 
-	void configReader(int pin, adc_cali_handle_t& cali, std::unique_ptr<ADCReader>& reader, bool emaAndMap);
+	void configReader(int pin, adc_cali_handle_t& cali, std::unique_ptr<ADCReader>& reader, bool ema);
 
 	void inSleepReconfigure() override;
 };
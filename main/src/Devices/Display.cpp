@@ -1,30 +1,63 @@
 #include "Display.h"
 #include <Pins.hpp>
 #include "Util/EfuseMeta.h"
+#include "Util/stdafx.h"
+#include <esp_log.h>
+
+static const char* TAG = "Display";
 
 Display::Display(uint8_t revision){
 
 	if(revision == 0xFF){
-		EfuseMeta::readRev(revision);
+		revision = EfuseMeta::getRevision();
 	}
 
-	setupBus();
-	setupPanel(revision);
+	const auto profile = getProfile(revision);
+
+	setupBus(profile.freqWrite);
+	setupPanel(profile);
 
 	// LGFX init -> panel init -> bus init
 	panel.setBus(&bus);
 	lgfx.setPanel(&panel);
 	lgfx.init();
+
+	if(profile.freqWrite == FallbackFreq || verifyBus(profile.freqWrite)) return;
+
+	ESP_LOGW(TAG, "Bus check failed at %lu Hz, falling back to %lu Hz", profile.freqWrite, FallbackFreq);
+	bus.release();
+	setupBus(FallbackFreq);
+	lgfx.init();
 }
 
 Display::~Display(){
 	bus.release();
 }
 
-void Display::setupBus(){
+Display::Profile Display::getProfile(uint8_t revision){
+	if(revision >= sizeof(Profiles) / sizeof(Profiles[0])){
+		return Profiles[sizeof(Profiles) / sizeof(Profiles[0]) - 1];
+	}
+
+	return Profiles[revision];
+}
+
+bool Display::verifyBus(uint32_t freq){
+	const uint32_t expected = (uint64_t) 128 * 128 * 16 * 1000000 / freq; // [us]
+
+	const auto start = micros();
+	lgfx.fillScreen(TFT_BLACK);
+	const uint32_t duration = micros() - start;
+
+	ESP_LOGI(TAG, "Full frame at %lu Hz: %lu us, expected %lu us", freq, duration, expected);
+
+	return duration <= expected * 3 / 2 + VerifyMargin;
+}
+
+void Display::setupBus(uint32_t freq){
 	lgfx::Bus_SPI::config_t cfg = {
-			.freq_write = 40000000,
-			.freq_read = 40000000,
+			.freq_write = freq,
+			.freq_read = FallbackFreq,
 			.pin_sclk = (int16_t) Pins::get(Pin::TftSck),
 			.pin_miso = -1,
 			.pin_mosi = (int16_t) Pins::get(Pin::TftMosi),
@@ -38,7 +71,7 @@ void Display::setupBus(){
 	bus.config(cfg);
 }
 
-void Display::setupPanel(uint8_t revision){
+void Display::setupPanel(const Profile& profile){
 	lgfx::Panel_Device::config_t cfg = {
 			.pin_cs = -1,
 			.pin_rst = (int16_t) Pins::get(Pin::TftRst),
@@ -49,7 +82,7 @@ void Display::setupPanel(uint8_t revision){
 			.panel_height = 128,
 			.offset_x = 2,
 			.offset_y = 1,
-			.offset_rotation = (uint8_t) (revision == 0 ? 0 : 2),
+			.offset_rotation = profile.offsetRotation,
 			.readable = false,
 			.invert = false,
 			.rgb_order = false,
@@ -60,6 +93,26 @@ void Display::setupPanel(uint8_t revision){
 	panel.setBus(&bus);
 }
 
+void Display::setIdle(bool idle){
+	if(this->idle == idle) return;
+	this->idle = idle;
+
+	lgfx.waitDMA();
+	lgfx.startWrite();
+	if(idle){
+		lgfx.writeCommand(CmdFrameRateIdle);
+		for(auto param : IdleFrameRate){
+			lgfx.writeData(param);
+		}
+	}
+	lgfx.writeCommand(idle ? CmdIdleOn : CmdIdleOff);
+	lgfx.endWrite();
+}
+
+bool Display::isIdle() const{
+	return idle;
+}
+
 LGFX_Device& Display::getLGFX(){
 	return lgfx;
 }
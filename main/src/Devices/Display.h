@@ -2,6 +2,7 @@
 #define CLOCKSTAR_FIRMWARE_DISPLAY_H
 
 #include <LovyanGFX.h>
+#include <sdkconfig.h>
 
 class Display {
 public:
@@ -12,13 +13,51 @@ public:
 
 	void drawTest();
 
+	/** Panel idle mode, 8 colors at a reduced frame rate. Current contents stay on screen. */
+	void setIdle(bool idle);
+	[[nodiscard]] bool isIdle() const;
+
 private:
 	lgfx::Bus_SPI bus;
 	lgfx::Panel_ST7735S panel;
 	LGFX_Device lgfx;
 
-	void setupBus();
-	void setupPanel(uint8_t revision);
+	struct Profile {
+		uint32_t freqWrite; // [Hz]
+		uint8_t offsetRotation;
+	};
+
+	/**
+	 * Indexed by hardware revision. Revision 1 routes the TFT through the GPIO matrix, it only runs at 80 MHz with
+	 * CONFIG_CM_DISPLAY_SPI_80MHZ, as the boot check can't see corrupted pixels.
+	 */
+	static constexpr Profile Profiles[] = {
+			{ 40000000, 0 },
+#ifdef CONFIG_CM_DISPLAY_SPI_80MHZ
+			{ 80000000, 2 },
+#else
+			{ 40000000, 2 },
+#endif
+	};
+	static constexpr uint32_t FallbackFreq = 40000000; // [Hz]
+	static constexpr uint32_t VerifyMargin = 1000; // [us]
+
+	static Profile getProfile(uint8_t revision);
+
+	bool idle = false;
+	static constexpr uint8_t CmdIdleOff = 0x38;
+	static constexpr uint8_t CmdIdleOn = 0x39;
+	static constexpr uint8_t CmdFrameRateIdle = 0xB2; // FRMCTR2
+	static constexpr uint8_t IdleFrameRate[] = { 0x0F, 0x3F, 0x3F }; // Slowest line period and longest porches
+
+	void setupBus(uint32_t freq);
+	void setupPanel(const Profile& profile);
+
+	/**
+	 * Pushes a full frame and checks the transfer took as long as the configured clock implies. Only catches a clock
+	 * that isn't reached, the panel isn't readable and the data itself can't be checked.
+	 */
+	bool verifyBus(uint32_t freq);
 
 };
 
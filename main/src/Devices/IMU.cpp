@@ -2,31 +2,35 @@
 #include <Util/Events.h>
 #include <driver/gpio.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
 #include "Pins.hpp"
 #include "Services/Sleep.h"
 #include "Util/Services.h"
 #include "Services/SleepMan.h"
 #include "Util/EfuseMeta.h"
+#include "Util/Trace.h"
 
 static const char* TAG = "IMU";
 
-IMU::IMU(I2C& i2c) : i2c(i2c), fifoSamples(1 /*MaxReads*/), thread1([this](){ thread1Func(); }, "IMU1", 2 * 1024, 8),
-					 thread2([this](){ thread2Func(); }, "IMU2", 2 * 1024){
-	sem1 = xSemaphoreCreateBinary();
-	sem2 = xSemaphoreCreateBinary();
+IMU::RawSample IMU::FifoBurst[MaxReads];
 
-	thread1.start();
-	// thread2.start();
+IMU::IMU(I2C& i2c) : i2c(i2c), thread([this](){ threadFunc(); }, "IMU", 2 * 1024, PlannedTask::IMU){
+	sem = xSemaphoreCreateBinary();
+	fifoSem = xSemaphoreCreateBinary();
+
+	thread.start();
 
 	init();
 }
 
 IMU::~IMU(){
-	vSemaphoreDelete(sem1);
-	vSemaphoreDelete(sem2);
+	thread.stop();
 
-	thread1.stop();
-//	thread2.stop();
+	vSemaphoreDelete(sem);
+	vSemaphoreDelete(fifoSem);
 }
 
 bool IMU::init(){
@@ -52,18 +56,18 @@ bool IMU::init(){
 	//accelero setup
 	lsm6ds3tr_c_xl_filter_analog_set(&ctx, LSM6DS3TR_C_XL_ANA_BW_400Hz);
 	lsm6ds3tr_c_xl_full_scale_set(&ctx, LSM6DS3TR_C_16g);
-	lsm6ds3tr_c_xl_data_rate_set(&ctx, LSM6DS3TR_C_XL_ODR_104Hz);
 
 	//gyro setup
-	lsm6ds3tr_c_gy_data_rate_set(&ctx, LSM6DS3TR_C_GY_ODR_104Hz);
 	lsm6ds3tr_c_gy_full_scale_set(&ctx, LSM6DS3TR_C_2000dps);
+	setDataRate(highRateUsers > 0);
+
 	lsm6ds3tr_c_gy_band_pass_set(&ctx, LSM6DS3TR_C_HP_65mHz_LP1_NORMAL);
 
-	//FIFO setup
-/*	lsm6ds3tr_c_fifo_watermark_set(&ctx, ReadingsWatermark);
+	//FIFO setup, stays in bypass until enableFIFO. Watermark is in 16-bit words, 6 per sample
+	lsm6ds3tr_c_fifo_watermark_set(&ctx, fifoWatermark * sampleWords());
 	lsm6ds3tr_c_fifo_xl_batch_set(&ctx, LSM6DS3TR_C_FIFO_XL_NO_DEC);
 	lsm6ds3tr_c_fifo_gy_batch_set(&ctx, LSM6DS3TR_C_FIFO_GY_NO_DEC);
-	lsm6ds3tr_c_fifo_data_rate_set(&ctx, LSM6DS3TR_C_FIFO_104Hz);*/
+	lsm6ds3tr_c_fifo_data_rate_set(&ctx, LSM6DS3TR_C_FIFO_104Hz);
 	lsm6ds3tr_c_fifo_mode_set(&ctx, LSM6DS3TR_C_BYPASS_MODE); //disable fifo buffering
 
 	//wrist tilt interrupt setup
@@ -75,30 +79,29 @@ bool IMU::init(){
 	lsm6ds3tr_c_a_wrist_tilt_mask_t tiltMask = { 0, 0, 0, 0, 0, 0, 0 };
 	lsm6ds3tr_c_tilt_src_set(&ctx, &tiltMask);
 
+	//pedometer setup, engines stay off until enabled
+	lsm6ds3tr_c_pedo_full_scale_set(&ctx, LSM6DS3TR_C_PEDO_AT_2g);
+	lsm6ds3tr_c_pedo_threshold_set(&ctx, PedoThreshold);
+	lsm6ds3tr_c_pedo_debounce_steps_set(&ctx, PedoDebounceSteps);
+
 	//significant motion setup
-/*	lsm6ds3tr_c_motion_sens_set(&ctx, 0);
 	uint8_t motionSenseThresh = SignificantMotionSens;
-	lsm6ds3tr_c_motion_threshold_set(&ctx, &motionSenseThresh);*/
+	lsm6ds3tr_c_motion_threshold_set(&ctx, &motionSenseThresh);
 
 	//tap setup
-/*	lsm6ds3tr_c_tap_detection_on_x_set(&ctx, 0);
-	lsm6ds3tr_c_tap_detection_on_y_set(&ctx, 0);
-	lsm6ds3tr_c_tap_detection_on_z_set(&ctx, 1);
 	lsm6ds3tr_c_tap_threshold_x_set(&ctx, 1);
 	lsm6ds3tr_c_tap_dur_set(&ctx, 1);
 	lsm6ds3tr_c_tap_quiet_set(&ctx, 1);
 	lsm6ds3tr_c_tap_shock_set(&ctx, 0);
-	lsm6ds3tr_c_tap_mode_set(&ctx, LSM6DS3TR_C_BOTH_SINGLE_DOUBLE);*/
+	lsm6ds3tr_c_tap_mode_set(&ctx, LSM6DS3TR_C_BOTH_SINGLE_DOUBLE);
 	lsm6ds3tr_c_int_notification_set(&ctx, LSM6DS3TR_C_INT_LATCHED);
 	//lsm6ds3tr_c_data_ready_mode_set(&ctx, LSM6DS3TR_C_DRDY_LATCHED);
 
-	lsm6ds3tr_c_pin_int1_route_set(&ctx, { 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 });
+	int1Route.int1_fth = 1;
+	applyInt1Route();
 	lsm6ds3tr_c_pin_int2_route_set(&ctx, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 }); //wrist tilt to INT2
 
-	uint8_t rev = 0;
-	EfuseMeta::readRev(rev);
-
-	if(rev == 1){
+	if(EfuseMeta::getRevision() == 1){
 		setWristPosition(IMU::WatchPosition::FaceUp);
 	}else{
 		setWristPosition(IMU::WatchPosition::FaceDown);
@@ -114,181 +117,375 @@ bool IMU::init(){
 
 	io_conf.pin_bit_mask = (1ULL << Pins::get(Pin::Imu_int1));
 	gpio_config(&io_conf);
-	gpio_isr_handler_add((gpio_num_t) Pins::get(Pin::Imu_int1), isr1, this);
+	gpio_isr_handler_add((gpio_num_t) Pins::get(Pin::Imu_int1), isr, this);
 
 	io_conf.pin_bit_mask = (1ULL << Pins::get(Pin::Imu_int2));
 	gpio_config(&io_conf);
-	gpio_isr_handler_add((gpio_num_t) Pins::get(Pin::Imu_int2), isr2, this);
+	gpio_isr_handler_add((gpio_num_t) Pins::get(Pin::Imu_int2), isr, this);
 
 	return true;
 }
 
-void IRAM_ATTR IMU::isr1(void* arg){
+void IRAM_ATTR IMU::isr(void* arg){
+	// Level interrupts until the handler re-arms them, the handler keeps polling the pins meanwhile
 	gpio_set_intr_type((gpio_num_t) Pins::get(Pin::Imu_int1), GPIO_INTR_POSEDGE);
-	auto imu = static_cast<IMU*>(arg);
-	int wake = 1;
-	xSemaphoreGiveFromISR(imu->sem1, &wake);
-}
-
-void IRAM_ATTR IMU::isr2(void* arg){
 	gpio_set_intr_type((gpio_num_t) Pins::get(Pin::Imu_int2), GPIO_INTR_POSEDGE);
 	auto imu = static_cast<IMU*>(arg);
-	int wake = 1;
-	xSemaphoreGiveFromISR(imu->sem1, &wake);
+	if(imu->intrTime == 0){
+		imu->intrTime = esp_timer_get_time();
+	}
+	BaseType_t wake = pdFALSE;
+	xSemaphoreGiveFromISR(imu->sem, &wake);
+	portYIELD_FROM_ISR(wake);
 }
 
-void IMU::thread1Func(){
-	if(xSemaphoreTake(sem1, portMAX_DELAY) != pdTRUE) return;
+void IMU::threadFunc(){
+	if(xSemaphoreTake(sem, portMAX_DELAY) != pdTRUE) return;
+	TRACE_SCOPE("imu_fetch");
 
-	while(gpio_get_level((gpio_num_t) Pins::get(Pin::Imu_int1)) || gpio_get_level((gpio_num_t) Pins::get(Pin::Imu_int2))){
-		fetchEvents();
-	}
+	// Latched sources hold their pin high until read, so the loop ends once every raised source was serviced
+	do{
+		Sources src;
+		if(!readSources(src)) break;
+		handleSources(src);
+	}while(gpio_get_level((gpio_num_t) Pins::get(Pin::Imu_int1)) || gpio_get_level((gpio_num_t) Pins::get(Pin::Imu_int2)));
+	intrTime = 0;
 
-	lsm6ds3tr_c_int_notification_set(&ctx, LSM6DS3TR_C_INT_LATCHED);
+	gpio_set_intr_type((gpio_num_t) Pins::get(Pin::Imu_int1), GPIO_INTR_HIGH_LEVEL);
 	gpio_set_intr_type((gpio_num_t) Pins::get(Pin::Imu_int2), GPIO_INTR_HIGH_LEVEL);
 }
 
-void IMU::thread2Func(){
-	if(xSemaphoreTake(sem2, portMAX_DELAY) != pdTRUE) return;
+bool IMU::readSources(Sources& src){
+	static_assert(offsetof(Sources, status) - offsetof(Sources, wakeUp) == LSM6DS3TR_C_STATUS_REG - LSM6DS3TR_C_WAKE_UP_SRC);
+	static_assert(offsetof(Sources, fifo4) - offsetof(Sources, fifo1) == LSM6DS3TR_C_FIFO_STATUS4 - LSM6DS3TR_C_FIFO_STATUS1);
+	static_assert(offsetof(Sources, wristTilt) - offsetof(Sources, func1) == LSM6DS3TR_C_WRIST_TILT_IA - LSM6DS3TR_C_FUNC_SRC1);
 
-	lsm6ds3tr_c_all_sources_t src;
-	lsm6ds3tr_c_all_sources_get(&ctx, &src);
+	// Register auto-increment is on by default. The FIFO burst stops before FIFO_DATA_OUT, reading that pops samples
+	if(lsm6ds3tr_c_read_reg(&ctx, LSM6DS3TR_C_WAKE_UP_SRC, (uint8_t*) &src.wakeUp, LSM6DS3TR_C_STATUS_REG - LSM6DS3TR_C_WAKE_UP_SRC + 1) != 0) return false;
+	if(lsm6ds3tr_c_read_reg(&ctx, LSM6DS3TR_C_FIFO_STATUS1, (uint8_t*) &src.fifo1, LSM6DS3TR_C_FIFO_STATUS4 - LSM6DS3TR_C_FIFO_STATUS1 + 1) != 0) return false;
+	if(lsm6ds3tr_c_read_reg(&ctx, LSM6DS3TR_C_FUNC_SRC1, (uint8_t*) &src.func1, LSM6DS3TR_C_WRIST_TILT_IA - LSM6DS3TR_C_FUNC_SRC1 + 1) != 0) return false;
 
-	bool ypos = (tiltDirection == TiltDirection::Lifted) ^ (position == WatchPosition::FaceUp);
-	if((src.wrist_tilt_ia.wrist_tilt_ia_ypos && ypos) || (src.wrist_tilt_ia.wrist_tilt_ia_yneg && !ypos)){
-		Event evt = { .action = Event::WristTilt, .wristTiltDir = tiltDirection };
-		Events::post(Facility::Motion, &evt, sizeof(evt));
-	}
+	return true;
 }
 
-void IMU::fetchEvents(){
-	lsm6ds3tr_c_all_sources_t src;
-	lsm6ds3tr_c_all_sources_get(&ctx, &src);
-
-	uint8_t fifoThresh = 0;
-	lsm6ds3tr_c_fifo_wtm_flag_get(&ctx, &fifoThresh);
-
-	if(fifoThresh){
-		uint16_t numReadings;
-		lsm6ds3tr_c_fifo_data_level_get(&ctx, &numReadings);
-		const auto numDataSets = numReadings / 6;
-
-		struct RawSample {
-			uint16_t gX, gY, gZ, aX, aY, aZ;
-		} buf{};
-		for(int i = 0; i < numDataSets; ++i){
-			lsm6ds3tr_c_fifo_raw_data_get(&ctx, reinterpret_cast<uint8_t*>(&buf), sizeof(RawSample));
-		}
-
-		/*
-		struct RawSample {
-			uint16_t gX, gY, gZ, aX, aY, aZ;
-		} buf[numDataSets];
-		lsm6ds3tr_c_fifo_raw_data_get(&ctx, reinterpret_cast<uint8_t*>(buf), numReadings * 2);
-
-		for(auto& read : buf){
-			Sample sample = {
-					gyConv(read.gX),
-					gyConv(read.gY),
-					gyConv(read.gZ),
-					xlConv(read.aX),
-					xlConv(read.aY),
-					xlConv(read.aZ)
-			};
-
-			fifoSamples.post(sample);
-		}
-
-		Event evt = { .action = Event::FIFO };
-		Events::post(Facility::Motion, &evt, sizeof(evt));
-		 */
+void IMU::handleSources(const Sources& src){
+	if(src.fifo2.waterm){
+		const uint16_t words = ((uint16_t) src.fifo2.diff_fifo << 8) | src.fifo1.diff_fifo;
+		const uint16_t pattern = ((uint16_t) src.fifo4.fifo_pattern << 8) | src.fifo3.fifo_pattern;
+		drainFIFO(words, pattern);
 	}
 
-	if(src.func_src1.sign_motion_ia){
+	if(src.func1.sign_motion_ia){
 		Event evt = { .action = Event::SignMotion };
 		Events::post(Facility::Motion, &evt, sizeof(evt));
 	}
 
-	if(src.tap_src.single_tap){
+	if(src.tap.single_tap){
 		Event evt = { .action = Event::SingleTap };
 		Events::post(Facility::Motion, &evt, sizeof(evt));
 	}
 
-/*	if(src.tap_src.double_tap){
+	if(src.tap.double_tap){
 		Event evt = { .action = Event::DoubleTap };
 		Events::post(Facility::Motion, &evt, sizeof(evt));
-
-		if(tiltDirection == TiltDirection::Lifted){
-			auto sleep = (SleepMan*) Services.get(Service::Sleep);
-			sleep->wake();
-		}
-	}*/
+	}
 
 	bool ypos = (tiltDirection == TiltDirection::Lifted) ^ (position == WatchPosition::FaceUp);
-	if((src.wrist_tilt_ia.wrist_tilt_ia_ypos && ypos) || (src.wrist_tilt_ia.wrist_tilt_ia_yneg && !ypos)){
+	if((src.wristTilt.wrist_tilt_ia_ypos && ypos) || (src.wristTilt.wrist_tilt_ia_yneg && !ypos)){
 		Event evt = { .action = Event::WristTilt, .wristTiltDir = tiltDirection };
 		Events::post(Facility::Motion, &evt, sizeof(evt));
 
-		if(tiltDirection == TiltDirection::Lifted){
-			auto sleep = (SleepMan*) Services.get(Service::Sleep);
-			sleep->wake();
+		if(tiltDirection == TiltDirection::Lifted && checkRaise()){
+			auto sleep = Services.get<Service::Sleep>();
+			sleep->wake(false, intrTime);
 		}
 	}
 }
 
+bool IMU::checkRaise(){
+	float sumX = 0, sumZ = 0;
+	for(size_t i = 0; i < RaiseWindow; i++){
+		if(i > 0){
+			vTaskDelay(pdMS_TO_TICKS(10));
+		}
+
+		const Sample sample = getSample();
+		const float g = std::sqrt(sample.accelX * sample.accelX + sample.accelY * sample.accelY + sample.accelZ * sample.accelZ);
+		if(g < RaiseMinG || g > RaiseMaxG) return false;
+
+		sumX += sample.accelX;
+		sumZ += sample.accelZ;
+	}
+
+	const float x = sumX / RaiseWindow;
+	const float z = sumZ / RaiseWindow;
+	return z >= RaiseMinZ && std::abs(x) <= RaiseMaxX;
+}
+
 void IMU::clearSources(){
-	lsm6ds3tr_c_all_sources_t src;
-	lsm6ds3tr_c_all_sources_get(&ctx, &src);
+	Sources src;
+	readSources(src);
 }
 
 IMU::Sample IMU::getSample(){
-	int16_t g[3];
-	int16_t a[3];
+#ifdef CONFIG_CM_REPLAY
+	if(replaying){
+		std::lock_guard lock(fifoMut);
+		return replayLast;
+	}
+#endif
 
-	lsm6ds3tr_c_acceleration_raw_get(&ctx, a);
-	lsm6ds3tr_c_angular_rate_raw_get(&ctx, g);
+	// Gyro and accelerometer output registers are contiguous (OUTX_L_G to OUTZ_H_XL), read them in one transaction
+	RawSample raw{};
+	lsm6ds3tr_c_read_reg(&ctx, LSM6DS3TR_C_OUTX_L_G, reinterpret_cast<uint8_t*>(&raw), sizeof(raw));
 
-	Sample sample = {
-			gyConv(g[0]),
-			gyConv(g[1]),
-			gyConv(g[2]),
-			xlConv(a[0]),
-			xlConv(a[1]),
-			xlConv(a[2])
-	};
+	return convert(raw, EfuseMeta::getRevision() == 1, getCalibration());
+}
 
-	uint8_t rev = 0;
-	EfuseMeta::readRev(rev);
+void IMU::acquireHighRate(){
+	std::lock_guard lock(rateMut);
+	if(highRateUsers++ > 0) return;
+	setDataRate(true);
+}
 
-	if(rev == 1){
-		sample.accelX *= -1.0f;
-		sample.gyroX *= -1.0f;
-		sample.accelY *= -1.0f;
-		sample.gyroY *= -1.0f;
-	}
+void IMU::releaseHighRate(){
+	std::lock_guard lock(rateMut);
+	if(highRateUsers == 0 || --highRateUsers > 0) return;
+	setDataRate(false);
+}
 
-	return sample;
+void IMU::setDataRate(bool high){
+	lsm6ds3tr_c_xl_data_rate_set(&ctx, high ? LSM6DS3TR_C_XL_ODR_416Hz : LSM6DS3TR_C_XL_ODR_104Hz);
+	if(fifoLowRate) return; // Gyro stays off until the low rate ends
+	lsm6ds3tr_c_gy_data_rate_set(&ctx, high ? LSM6DS3TR_C_GY_ODR_416Hz : LSM6DS3TR_C_GY_ODR_104Hz);
 }
 
 void IMU::enableFIFO(bool enable){
-	ESP_LOGE(TAG, "Function enableFIFO is removed from use.");
-	return;
+	if(fifoEnabled == enable) return;
+	fifoEnabled = enable;
 
-	clearFifo();
-	fifoSamples.reset();
+	{
+		std::lock_guard lock(fifoMut);
+		fifoHead = fifoCount = 0;
+	}
 
 	if(enable){
-		lsm6ds3tr_c_fifo_mode_set(&ctx, LSM6DS3TR_C_STREAM_MODE);
+		// At the low rate only the accelerometer is batched, twice the samples fit before the FIFO fills up
+		lsm6ds3tr_c_fifo_xl_batch_set(&ctx, fifoLowRate ? LSM6DS3TR_C_FIFO_XL_DEC_4 : LSM6DS3TR_C_FIFO_XL_NO_DEC);
+		lsm6ds3tr_c_fifo_gy_batch_set(&ctx, fifoLowRate ? LSM6DS3TR_C_FIFO_GY_DISABLE : LSM6DS3TR_C_FIFO_GY_NO_DEC);
+		lsm6ds3tr_c_fifo_data_rate_set(&ctx, fifoLowRate ? LSM6DS3TR_C_FIFO_12Hz5 : LSM6DS3TR_C_FIFO_104Hz);
+		clearFifo();
 	}else{
 		lsm6ds3tr_c_fifo_mode_set(&ctx, LSM6DS3TR_C_BYPASS_MODE);
 	}
 }
 
+void IMU::setFIFOWatermark(uint16_t samples){
+	samples = std::clamp<uint16_t>(samples, 1, fifoLowRate ? MaxLowRateWatermark : MaxReads);
+	if(samples == fifoWatermark) return;
+
+	fifoWatermark = samples;
+	lsm6ds3tr_c_fifo_watermark_set(&ctx, fifoWatermark * sampleWords());
+}
+
+void IMU::setFIFOLowRate(bool low){
+	if(low == fifoLowRate) return;
+	fifoLowRate = low;
+
+	// The watermark is in words, which a sample takes half as many of without the gyro
+	fifoWatermark = std::min<uint16_t>(fifoWatermark, low ? MaxLowRateWatermark : MaxReads);
+	lsm6ds3tr_c_fifo_watermark_set(&ctx, fifoWatermark * sampleWords());
+
+	// Nothing reads the gyro while the low rate batches, it's powered down meanwhile
+	if(low){
+		lsm6ds3tr_c_gy_data_rate_set(&ctx, LSM6DS3TR_C_GY_ODR_OFF);
+	}else{
+		setDataRate(highRateUsers > 0);
+	}
+}
+
+uint16_t IMU::sampleWords() const{
+	return fifoLowRate ? AccelWords : sizeof(RawSample) / 2;
+}
+
+bool IMU::isFIFOEnabled() const{
+	return fifoEnabled;
+}
+
+void IMU::setFIFOListener(TaskPool::Job* job){
+	fifoListener = job;
+}
+
+void IMU::notifyFIFO(){
+	xSemaphoreGive(fifoSem);
+
+	if(auto job = fifoListener.load()){
+		TaskPool::get().schedule(job, 0);
+	}
+
+	Event evt = { .action = Event::FIFO };
+	Events::post(Facility::Motion, &evt, sizeof(evt));
+}
+
+void IMU::drainFIFO(uint16_t words, uint16_t pattern){
+	if(words == 0) return;
+
+	const uint16_t perSample = sampleWords();
+
+	// Realign to the start of a pattern if a previous read stopped mid-sample
+	if(pattern != 0){
+		const uint16_t skip = std::min<uint16_t>(words, perSample - pattern);
+		lsm6ds3tr_c_fifo_raw_data_get(&ctx, reinterpret_cast<uint8_t*>(FifoBurst), skip * 2);
+		words -= skip;
+	}
+
+	// A low rate batch can be larger than one burst, it's read in several
+	size_t total = 0;
+	size_t count;
+	while((count = std::min<size_t>(words / perSample, MaxReads)) > 0){
+		words -= count * perSample;
+
+		// One burst: the FIFO output register address rolls back automatically, so the whole batch is a single I2C read
+		lsm6ds3tr_c_fifo_raw_data_get(&ctx, reinterpret_cast<uint8_t*>(FifoBurst), count * perSample * 2);
+
+		// Accelerometer-only samples are spread out to full ones back to front, so none is overwritten before it's read
+		if(perSample == AccelWords){
+			const auto accel = reinterpret_cast<const int16_t*>(FifoBurst);
+			for(size_t i = count; i-- > 0;){
+				const RawSample sample = { 0, 0, 0, accel[i * 3], accel[i * 3 + 1], accel[i * 3 + 2] };
+				FifoBurst[i] = sample;
+			}
+		}
+
+#ifdef CONFIG_CM_REPLAY
+		if(replaying) continue;
+#endif
+
+		std::lock_guard lock(fifoMut);
+		for(size_t i = 0; i < count; i++){
+			fifoRing[fifoHead] = FifoBurst[i];
+			fifoHead = (fifoHead + 1) % FifoRingSize;
+		}
+		if(fifoCount + count > FifoRingSize){
+			fifoOverruns += fifoCount + count - FifoRingSize;
+		}
+		fifoCount = std::min(fifoCount + count, FifoRingSize);
+		total += count;
+	}
+
+	if(total == 0) return;
+	notifyFIFO();
+}
+
+size_t IMU::readFIFO(Sample* samples, size_t count, TickType_t wait){
+	if(!fifoEnabled || count == 0) return 0;
+
+	{
+		std::lock_guard lock(fifoMut);
+		if(fifoCount == 0){
+			xSemaphoreTake(fifoSem, 0);
+		}
+	}
+
+	if(fifoCount == 0 && wait != 0){
+		xSemaphoreTake(fifoSem, wait);
+	}
+
+	const uint8_t rev = EfuseMeta::getRevision();
+	const auto cal = getCalibration();
+
+	std::lock_guard lock(fifoMut);
+	count = std::min(count, fifoCount);
+	size_t tail = (fifoHead + FifoRingSize - fifoCount) % FifoRingSize;
+	for(size_t i = 0; i < count; i++){
+#ifdef CONFIG_CM_REPLAY
+		samples[i] = replaying ? replayRing[tail] : convert(fifoRing[tail], rev == 1, cal);
+#else
+		samples[i] = convert(fifoRing[tail], rev == 1, cal);
+#endif
+		tail = (tail + 1) % FifoRingSize;
+	}
+	fifoCount -= count;
+
+	return count;
+}
+
 bool IMU::pollFIFO(Sample& sample, TickType_t wait){
-	ESP_LOGE(TAG, "Function pollFIFO is removed from use.");
-	return false;
+	return readFIFO(&sample, 1, wait) == 1;
+}
+
+#ifdef CONFIG_CM_REPLAY
+void IMU::setReplay(bool replay){
+	std::lock_guard lock(fifoMut);
+	if(replay && !replayRing){
+		replayRing = std::make_unique<Sample[]>(FifoRingSize);
+	}
+	replaying = replay;
+	fifoHead = fifoCount = 0;
+	replayLast = {};
+}
+
+void IMU::inject(const Sample* samples, size_t count){
+	if(!replaying || count == 0) return;
+
+	{
+		std::lock_guard lock(fifoMut);
+		replayLast = samples[count - 1];
+		if(!fifoEnabled) return;
+
+		for(size_t i = 0; i < count; i++){
+			replayRing[fifoHead] = samples[i];
+			fifoHead = (fifoHead + 1) % FifoRingSize;
+		}
+		if(fifoCount + count > FifoRingSize){
+			fifoOverruns += fifoCount + count - FifoRingSize;
+		}
+		fifoCount = std::min(fifoCount + count, FifoRingSize);
+	}
+
+	notifyFIFO();
+}
+#endif
+
+uint32_t IMU::getFIFOOverruns() const{
+	return fifoOverruns;
+}
+
+void IMU::setCalibration(const IMUCalibrationData& calibration){
+	std::lock_guard lock(calibrationMut);
+	this->calibration = calibration;
+}
 
-	return fifoSamples.get(sample, wait);
+IMUCalibrationData IMU::getCalibration(){
+	std::lock_guard lock(calibrationMut);
+	return calibration;
+}
+
+IMU::Sample IMU::convert(const RawSample& raw, bool flip, const IMUCalibrationData& cal) const{
+	Sample sample = {
+			gyConv(raw.gX),
+			gyConv(raw.gY),
+			gyConv(raw.gZ),
+			xlConv(raw.aX),
+			xlConv(raw.aY),
+			xlConv(raw.aZ)
+	};
+
+	if(flip){
+		sample.accelX *= -1.0f;
+		sample.gyroX *= -1.0f;
+		sample.accelY *= -1.0f;
+		sample.gyroY *= -1.0f;
+	}
+
+	sample.gyroX -= cal.gyroBias[0];
+	sample.gyroY -= cal.gyroBias[1];
+	sample.gyroZ -= cal.gyroBias[2];
+	sample.accelX = (sample.accelX - cal.accelOffset[0]) * cal.accelScale[0];
+	sample.accelY = (sample.accelY - cal.accelOffset[1]) * cal.accelScale[1];
+	sample.accelZ = (sample.accelZ - cal.accelOffset[2]) * cal.accelScale[2];
+
+	return sample;
 }
 
 void IMU::clearFifo(){
@@ -309,13 +506,7 @@ void IMU::setTiltDirection(IMU::TiltDirection direction){
 
 
 	uint8_t tiltThresh = 8; // total thresh is tiltThresh * 15.625mg
-	uint8_t tiltLatency = 8; // total latency is tiltLatency * 40ms
-	if(direction == TiltDirection::Lifted){
-		//tiltThresh = 8;
-	}else{
-		//tiltThresh = 16;
-		tiltLatency = 6;
-	}
+	uint8_t tiltLatency = direction == TiltDirection::Lifted ? RaiseLatency : LowerLatency;
 	lsm6ds3tr_c_tilt_threshold_set(&ctx, &tiltThresh);
 	lsm6ds3tr_c_tilt_latency_set(&ctx, &tiltLatency);
 
@@ -346,9 +537,51 @@ void IMU::setWristPosition(WatchPosition wristPosition){
 	lsm6ds3tr_c_tilt_src_set(&ctx, &tiltMask);
 }
 
+void IMU::enablePedometer(bool enable){
+	if(enable){
+		lsm6ds3tr_c_pedo_step_reset_set(&ctx, 1);
+	}
+	lsm6ds3tr_c_pedo_sens_set(&ctx, enable);
+	lsm6ds3tr_c_pedo_step_reset_set(&ctx, 0);
+}
+
+uint16_t IMU::getStepCount(){
+	uint8_t buf[2] = {};
+	lsm6ds3tr_c_read_reg(&ctx, LSM6DS3TR_C_STEP_COUNTER_L, buf, sizeof(buf));
+	return buf[0] | (buf[1] << 8);
+}
+
+void IMU::resetStepCount(){
+	lsm6ds3tr_c_pedo_step_reset_set(&ctx, 1);
+	lsm6ds3tr_c_pedo_step_reset_set(&ctx, 0);
+}
+
 void IMU::enableMotionDetection(bool enable){
-	ESP_LOGE(TAG, "Function enableMotionDetection is removed from use.");
-	lsm6ds3tr_c_motion_sens_set(&ctx, enable);
+	if(enable){
+		lsm6ds3tr_c_motion_sens_set(&ctx, 1);
+	}else{
+		// lsm6ds3tr_c_motion_sens_set only writes CTRL10_C when enabling
+		lsm6ds3tr_c_ctrl10_c_t ctrl10;
+		if(lsm6ds3tr_c_read_reg(&ctx, LSM6DS3TR_C_CTRL10_C, (uint8_t*) &ctrl10, 1) == 0){
+			ctrl10.sign_motion_en = 0;
+			lsm6ds3tr_c_write_reg(&ctx, LSM6DS3TR_C_CTRL10_C, (uint8_t*) &ctrl10, 1);
+		}
+	}
+
+	int1Route.int1_sign_mot = enable;
+	applyInt1Route();
+}
+
+void IMU::enableTapDetection(bool enable){
+	lsm6ds3tr_c_tap_detection_on_z_set(&ctx, enable);
+
+	int1Route.int1_single_tap = enable;
+	int1Route.int1_double_tap = enable;
+	applyInt1Route();
+}
+
+void IMU::applyInt1Route(){
+	lsm6ds3tr_c_pin_int1_route_set(&ctx, int1Route);
 }
 
 int32_t IMU::platform_write(void* hndl, uint8_t reg, const uint8_t* data, uint16_t len){
@@ -358,15 +591,21 @@ int32_t IMU::platform_write(void* hndl, uint8_t reg, const uint8_t* data, uint16
 
 int32_t IMU::platform_read(void* hndl, uint8_t reg, uint8_t* data, uint16_t len){
 	auto imu = (IMU*) hndl;
-	return imu->i2c.readReg(Addr, reg, data, len);
+
+	// FIFO bursts go first so the hardware FIFO never overflows behind other bus users. The FIFO output register
+	// rolls back instead of incrementing, so only the other registers can be joined with adjacent reads
+	if(reg == LSM6DS3TR_C_FIFO_DATA_OUT_L){
+		return imu->i2c.readReg(Addr, reg, data, len, I2C::Priority::High, false);
+	}
+	return imu->i2c.readReg(Addr, reg, data, len, I2C::Priority::Normal, true);
 }
 
-double IMU::xlConv(int16_t raw){
-	return (double) lsm6ds3tr_c_from_fs16g_to_mg(raw) / 1000.0;
+float IMU::xlConv(int16_t raw){
+	return lsm6ds3tr_c_from_fs16g_to_mg(raw) / 1000.0f;
 }
 
-double IMU::gyConv(int16_t raw){
-	return ((double) lsm6ds3tr_c_from_fs2000dps_to_mdps(raw) * M_PI / 180.0) / 1000.0;
+float IMU::gyConv(int16_t raw){
+	return lsm6ds3tr_c_from_fs2000dps_to_mdps(raw) * (float) (M_PI / 180.0 / 1000.0);
 }
 
 void IMU::printInterruptInfo(){
@@ -5,9 +5,12 @@
 #include "Periph/I2C.h"
 #include "Util/Threaded.h"
 #include "Util/Queue.h"
+#include "Settings/IMUCalibration.h"
 #include <cstdint>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <atomic>
 
 /**
  * Axis orientation when the watch is on your left wrist:
@@ -30,22 +33,27 @@ public:
 	enum class WatchPosition {
 		FaceUp, FaceDown
 	};
+	enum class FlickDirection {
+		Up, Down
+	};
 
 	struct Event {
-		enum { SignMotion, SingleTap, WristTilt, FIFO, DoubleTap } action;
+		enum { SignMotion, SingleTap, WristTilt, FIFO, DoubleTap, Flick, Shake, TurnOver } action;
 		union {
 			TiltDirection wristTiltDir;
+			FlickDirection flickDir;
 		};
 	};
 
-	// Linear acceleration is in m/s^2, angular velocity is in rad/s
+	// Linear acceleration is in g, angular velocity is in rad/s
+	// Single precision, the S3 FPU doesn't do double
 	struct Sample {
-		double gyroX;
-		double gyroY;
-		double gyroZ;
-		double accelX;
-		double accelY;
-		double accelZ;
+		float gyroX;
+		float gyroY;
+		float gyroZ;
+		float accelX;
+		float accelY;
+		float accelZ;
 	};
 
 	/**
@@ -56,34 +64,95 @@ public:
 
 	void enableTiltDetection(bool enable);
 
+	/**
+	 * On-chip pedometer. Steps are counted by the embedded function engine without interrupting the CPU, so counting
+	 * carries on through light sleep. OFF by default
+	 */
+	void enablePedometer(bool enable);
+
+	/** Steps since the pedometer was enabled or last reset. The hardware counter wraps at 2^16. */
+	uint16_t getStepCount();
+	void resetStepCount();
+
+	/** Enable/Disable significant motion detection events. OFF by default */
+	void enableMotionDetection(bool enable);
+
+	/** Enable/Disable single and double tap events on the Z axis. OFF by default */
+	void enableTapDetection(bool enable);
+
+	/**
+	 * Runs the accelerometer and gyro at 416 Hz instead of 104 Hz, for screens that track motion closely.
+	 * Reference counted. The FIFO keeps batching at 104 Hz and the embedded functions work at either rate.
+	 */
+	void acquireHighRate();
+	void releaseHighRate();
+
+	/** Synchronous read of the output registers. Apps should subscribe to IMUStream instead of polling this. */
 	Sample getSample();
 
 	void clearSources();
 
 	void shutdown();
 
-private:
-	static constexpr uint8_t Addr = 0x6A;
-	I2C& i2c;
+	/**
+	 * Switches the hardware FIFO between stream mode and bypass. While enabled, the IMU batches gyro and accelerometer
+	 * samples at 104 Hz and interrupts once the watermark is reached, then burst-reads them into a ring.
+	 */
+	void enableFIFO(bool enable);
 
-	bool init();
+	/**
+	 * Samples batched before the FIFO interrupts. The default batches for power, consumers that need a live stream
+	 * lower it at the cost of more frequent wakeups.
+	 */
+	void setFIFOWatermark(uint16_t samples = ReadingsWatermark);
 
 	/**
-	 * !DELETED FUNCTION!
-	 * Enable/Disable significant motion detection events. OFF by default
-	 * @param enable
+	 * Batches accelerometer samples only at LowFIFORate instead of both at 104 Hz, so a full watermark spans minutes,
+	 * for trackers that run through sleep. The gyro is off and reads as 0 meanwhile. Batching takes effect with the next
+	 * enableFIFO(true).
 	 */
-	void enableMotionDetection(bool enable);
+	void setFIFOLowRate(bool low);
+	static constexpr float LowFIFORate = 3.125f; // [Hz], 12.5 Hz FIFO with every 4th sample kept
+	static constexpr uint16_t MaxLowRateWatermark = 500; // [samples], 1500 of the FIFO's 2048 words
+
+	bool isFIFOEnabled() const;
+
+	/**
+	 * Scheduled on the TaskPool after every batch that reached the ring, for consumers that read the FIFO without
+	 * keeping a task waiting in readFIFO(). One listener, nullptr removes it.
+	 */
+	void setFIFOListener(TaskPool::Job* job);
 
 	/**
-	 * !DELETED FUNCTION!
+	 * Pops up to count samples from the FIFO ring, oldest first.
+	 * @param wait Time to wait for the next batch if the ring is empty
+	 * @return Number of samples written
 	 */
+	size_t readFIFO(Sample* samples, size_t count, TickType_t wait = 0);
 	bool pollFIFO(Sample& sample, TickType_t wait = portMAX_DELAY);
 
+	/** Samples overwritten in the ring before they were read. */
+	uint32_t getFIFOOverruns() const;
+
+	/** Applied to all samples from getSample() and the FIFO from now on. */
+	void setCalibration(const IMUCalibrationData& calibration);
+	IMUCalibrationData getCalibration();
+
+#ifdef CONFIG_CM_REPLAY
 	/**
-	 * !DELETED FUNCTION!
+	 * Serves scripted samples to FIFO readers and getSample() in place of the sensor, for the replay harness.
+	 * Injected samples are taken as already calibrated and reach the FIFO like a hardware batch, with its Motion event.
+	 * The sensor keeps running underneath, its batches are read out and dropped while replaying.
 	 */
-	void enableFIFO(bool enable);
+	void setReplay(bool replay);
+	void inject(const Sample* samples, size_t count);
+#endif
+
+private:
+	static constexpr uint8_t Addr = 0x6A;
+	I2C& i2c;
+
+	bool init();
 
 	/**
 	 * Sets the watch wear position for tilt detection. Default is face-up.
@@ -100,32 +169,109 @@ private:
 			.handle = this
 	};
 
-	static constexpr uint16_t ReadingsWatermark = 200;
-	static constexpr size_t MaxReads = 250;
-	Queue<Sample> fifoSamples;
+	static constexpr uint16_t ReadingsWatermark = 200; // [samples]
+	static constexpr size_t MaxReads = 250; // Samples per burst read
+	static constexpr size_t FifoRingSize = 512; // [samples], holds a full low rate batch
+	static constexpr uint16_t AccelWords = 3; // Per sample while only the accelerometer is batched
+
+	// One FIFO pattern with gyro and accelerometer at the same rate: 6 words, gyro first
+	struct RawSample {
+		int16_t gX, gY, gZ, aX, aY, aZ;
+	};
+	static_assert(sizeof(RawSample) == 12);
+	static RawSample FifoBurst[MaxReads];
+
+	RawSample fifoRing[FifoRingSize];
+	size_t fifoHead = 0; // Next write position
+	size_t fifoCount = 0;
+	uint32_t fifoOverruns = 0;
+	std::mutex fifoMut;
+	SemaphoreHandle_t fifoSem;
+	std::atomic_bool fifoEnabled = false;
+	uint16_t fifoWatermark = ReadingsWatermark; // [samples]
+	bool fifoLowRate = false;
+	uint16_t sampleWords() const; // FIFO words per sample in the current pattern
+	std::atomic<TaskPool::Job*> fifoListener = nullptr;
+	void notifyFIFO();
+
+#ifdef CONFIG_CM_REPLAY
+	std::atomic_bool replaying = false;
+	std::unique_ptr<Sample[]> replayRing; // FifoRingSize samples, used in place of fifoRing while replaying
+	Sample replayLast = {}; // Returned by getSample()
+#endif
+
+	IMUCalibrationData calibration;
+	std::mutex calibrationMut;
+
+	uint32_t highRateUsers = 0;
+	std::mutex rateMut;
+	void setDataRate(bool high);
+
 	void clearFifo();
+	void drainFIFO(uint16_t words, uint16_t pattern);
+	Sample convert(const RawSample& raw, bool flip, const IMUCalibrationData& cal) const;
 
 	bool tiltEnable = true;
 	TiltDirection tiltDirection = TiltDirection::Lifted;
 	HandSide handSide = HandSide::Left;
 	WatchPosition position = WatchPosition::FaceUp;
 	static constexpr uint8_t SignificantMotionSens = 4;
+	static constexpr uint8_t PedoThreshold = 16; // total thresh is PedoThreshold * 16mg at the 2g pedometer scale
+	static constexpr uint8_t PedoDebounceSteps = 7; // steps before the counter starts, filters out arm gestures
+
+	// Tilt latencies are in steps of 40ms. Raising is confirmed on the host, so it can fire early
+	static constexpr uint8_t RaiseLatency = 3;
+	static constexpr uint8_t LowerLatency = 6;
+
+	// A raise wakes only if the watch then holds still with the screen turned up, in [g] averaged over the window
+	static constexpr size_t RaiseWindow = 3; // [samples], 104 Hz
+	static constexpr float RaiseMinG = 0.7f; // Each sample, anything outside swings harder than looking at the watch
+	static constexpr float RaiseMaxG = 1.3f;
+	static constexpr float RaiseMinZ = 0.4f; // Screen tilted at least ~25 degrees up from vertical
+	static constexpr float RaiseMaxX = 0.7f; // Forearm closer to level than ~45 degrees, not hanging down or pointing up
+
+	/** Reads a short window of samples after a raise and checks it looks like the user turned to read the screen */
+	bool checkRaise();
+
+	volatile int64_t intrTime = 0; // [us] of the first interrupt the thread hasn't serviced yet
+
+	// INT1 sources are enabled by several features, so the routing is kept here and written as a whole
+	lsm6ds3tr_c_int1_route_t int1Route = {};
+	void applyInt1Route();
 
 	void printInterruptInfo();
 
-	SemaphoreHandle_t sem1 = nullptr;
-	SemaphoreHandle_t sem2 = nullptr;
-	static void IRAM_ATTR isr1(void* arg);
-	static void IRAM_ATTR isr2(void* arg);
-	ThreadedClosure thread1;
-	ThreadedClosure thread2;
-	void thread1Func();
-	void thread2Func();
+	/**
+	 * Snapshot of every interrupt source, taken in three register bursts instead of one transaction per register.
+	 * Reading the latched sources also clears them.
+	 */
+	struct Sources {
+		// WAKE_UP_SRC to STATUS_REG
+		lsm6ds3tr_c_wake_up_src_t wakeUp;
+		lsm6ds3tr_c_tap_src_t tap;
+		lsm6ds3tr_c_d6d_src_t d6d;
+		lsm6ds3tr_c_status_reg_t status;
+		// FIFO_STATUS1 to FIFO_STATUS4
+		lsm6ds3tr_c_fifo_status1_t fifo1;
+		lsm6ds3tr_c_fifo_status2_t fifo2;
+		lsm6ds3tr_c_fifo_status3_t fifo3;
+		lsm6ds3tr_c_fifo_status4_t fifo4;
+		// FUNC_SRC1 to WRIST_TILT_IA
+		lsm6ds3tr_c_func_src1_t func1;
+		lsm6ds3tr_c_func_src2_t func2;
+		lsm6ds3tr_c_wrist_tilt_ia_t wristTilt;
+	};
+	bool readSources(Sources& src);
+	void handleSources(const Sources& src);
 
-	void fetchEvents();
+	// Both interrupt pins wake the same handler, so sources raised together are serviced from one snapshot
+	SemaphoreHandle_t sem = nullptr;
+	static void IRAM_ATTR isr(void* arg);
+	ThreadedClosure thread;
+	void threadFunc();
 
-	static double xlConv(int16_t raw);
-	static double gyConv(int16_t raw);
+	static float xlConv(int16_t raw);
+	static float gyConv(int16_t raw);
 };
 
 
@@ -1,36 +1,23 @@
 #include "Input.h"
 #include "Util/Events.h"
-#include <Util/stdafx.h>
 #include <Pins.hpp>
 #include <driver/gpio.h>
+#include <esp_log.h>
+#include <esp_sleep.h>
+#include <algorithm>
 
-// button index -> GPIO port
-std::unordered_map<Input::Button, gpio_num_t> Input::PinMap;
-
-const std::unordered_map<Input::Button, const char*> Input::PinLabels{
-		{ Up,     "Up" },
-		{ Down,   "Down" },
-		{ Select, "Select" },
-		{ Alt,    "Alt" },
-};
-
-Input::Input() : SleepyThreaded(SleepTime, "Input", 2048, 6, 0){
-	PinMap = {
-		{ Up,     (gpio_num_t) Pins::get(Pin::BtnUp) },
-		{ Down,   (gpio_num_t) Pins::get(Pin::BtnDown) },
-		{ Select, (gpio_num_t) Pins::get(Pin::BtnSelect) },
-		{ Alt,    (gpio_num_t) Pins::get(Pin::BtnAlt) },
-	};
+static const char* TAG = "Input";
 
+Input::Input() : pins({
+		(gpio_num_t) Pins::get(Pin::BtnUp),
+		(gpio_num_t) Pins::get(Pin::BtnDown),
+		(gpio_num_t) Pins::get(Pin::BtnSelect),
+		(gpio_num_t) Pins::get(Pin::BtnAlt)
+}){
 	auto mask = 0ULL;
-	for(const auto& pair : PinMap){
-		const auto port = pair.first;
-		const auto pin = pair.second;
-
-		btnState[port] = false;
-		dbTime[port] = 0;
-
-		mask |= (1ULL << pin);
+	for(size_t i = 0; i < ButtonCount; i++){
+		mask |= (1ULL << pins[i]);
+		isrArgs[i] = { this, pins[i] };
 	}
 
 	gpio_config_t io_conf = {
@@ -42,82 +29,258 @@ Input::Input() : SleepyThreaded(SleepTime, "Input", 2048, 6, 0){
 	};
 	gpio_config(&io_conf);
 
-	start();
+	// Already installed when running the firmware, not when the jig test or an example gets here first
+	const auto err = gpio_install_isr_service(ESP_INTR_FLAG_LOWMED | ESP_INTR_FLAG_SHARED | ESP_INTR_FLAG_IRAM);
+	if(err != ESP_OK && err != ESP_ERR_INVALID_STATE){
+		ESP_LOGE(TAG, "GPIO ISR service install failed: %s", esp_err_to_name(err));
+	}
+
+	const esp_timer_create_args_t args = {
+			.callback = debounced,
+			.arg = this,
+			.dispatch_method = ESP_TIMER_TASK,
+			.name = "Input",
+			.skip_unhandled_events = true
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&args, &timer));
+
+	const esp_timer_create_args_t holdArgs = {
+			.callback = holdTick,
+			.arg = this,
+			.dispatch_method = ESP_TIMER_TASK,
+			.name = "InputHold",
+			.skip_unhandled_events = true
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&holdArgs, &holdTimer));
+
+	resume();
 }
 
 Input::~Input(){
-	stop();
+	pause();
+	esp_timer_delete(timer);
+	esp_timer_delete(holdTimer);
 }
 
-void Input::sleepyLoop(){
-	scan();
+bool Input::getState(Input::Button btn) const{
+	return state & (1 << btn);
 }
 
-bool Input::getState(Input::Button btn) const{
-	return btnState.at(btn);
+void Input::pause(){
+	if(paused) return;
+	paused = true;
+
+	for(const auto pin : pins){
+		gpio_set_intr_type(pin, GPIO_INTR_DISABLE);
+		gpio_isr_handler_remove(pin);
+	}
+	esp_timer_stop(timer);
+	esp_timer_stop(holdTimer);
 }
 
-void Input::scan(){
-	for(const auto& pair: PinMap){
-		const auto port = pair.first;
-		const auto pin = pair.second;
+void Input::resume(){
+	if(!paused) return;
+	paused = false;
+
+	for(size_t i = 0; i < ButtonCount; i++){
+		gpio_isr_handler_add(pins[i], isr, &isrArgs[i]);
+		gpio_set_intr_type(pins[i], intrType(getState((Button) i)));
+	}
+
+	// Buttons may have changed while paused, e.g. the one that woke the watch
+	esp_timer_stop(timer);
+	esp_timer_start_once(timer, DebounceTime * 1000);
+}
 
-		bool state = gpio_get_level(pin);
+void Input::setWakeup(bool wakeup){
+	if(this->wakeup == wakeup) return;
+	this->wakeup = wakeup;
 
-		if(state){
-			pressed(port);
+	for(size_t i = 0; i < ButtonCount; i++){
+		if(wakeup){
+			gpio_wakeup_enable(pins[i], GPIO_INTR_HIGH_LEVEL);
 		}else{
-			released(port);
+			gpio_wakeup_disable(pins[i]);
+		}
+		if(!paused){
+			gpio_set_intr_type(pins[i], intrType(getState((Button) i)));
 		}
 	}
-}
 
-void Input::pressed(Input::Button btn){
-	if(btnState[btn]){
-		dbTime[btn] = 0;
-		return;
+	if(wakeup){
+		esp_sleep_enable_gpio_wakeup();
+	}else{
+		esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
 	}
+}
+
+gpio_int_type_t Input::intrType(bool pressed) const{
+	return (wakeup && !pressed) ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_ANYEDGE;
+}
 
-	auto t = millis();
+void IRAM_ATTR Input::isr(void* arg){
+	auto pin = static_cast<IsrArg*>(arg);
+	auto input = pin->input;
 
-	if(dbTime[btn] == 0){
-		dbTime[btn] = t;
-		return;
-	}else if(t - dbTime[btn] < DebounceTime){
-		return;
+	portENTER_CRITICAL_ISR(&input->edgeLock);
+	auto& edge = input->edgeTime[pin - input->isrArgs.data()];
+	if(edge == 0){
+		edge = esp_timer_get_time();
 	}
+	portEXIT_CRITICAL_ISR(&input->edgeLock);
 
-	btnState[btn] = true;
-	dbTime[btn] = 0;
+	// A level interrupt keeps firing while the button is held, the release is caught by edge
+	if(input->wakeup){
+		gpio_set_intr_type(pin->pin, GPIO_INTR_ANYEDGE);
+	}
 
-	Data data = {
-			.btn = btn,
-			.action = Data::Press
-	};
-	Events::post(Facility::Input, data);
+	// Bouncing keeps pushing the read back until the pins are quiet
+	esp_timer_stop(input->timer);
+	esp_timer_start_once(input->timer, DebounceTime * 1000);
+}
+
+void Input::debounced(void* arg){
+	static_cast<Input*>(arg)->scan();
 }
 
-void Input::released(Input::Button btn){
-	if(!btnState[btn]){
-		dbTime[btn] = 0;
-		return;
+void Input::scan(){
+	if(paused) return;
+
+	uint8_t levels = 0;
+	for(size_t i = 0; i < ButtonCount; i++){
+		if(gpio_get_level(pins[i])){
+			levels |= 1 << i;
+		}
+	}
+
+	std::array<uint64_t, ButtonCount> edges;
+	portENTER_CRITICAL(&edgeLock);
+	edges = edgeTime;
+	edgeTime = {};
+	portEXIT_CRITICAL(&edgeLock);
+
+	const uint8_t changed = levels ^ state.exchange(levels);
+	for(size_t i = 0; i < ButtonCount; i++){
+		if(wakeup && !(levels & (1 << i))){
+			gpio_set_intr_type(pins[i], GPIO_INTR_HIGH_LEVEL);
+		}
+
+		if(!(changed & (1 << i))) continue;
+
+		const bool pressed = levels & (1 << i);
+		const uint64_t time = edges[i] ? edges[i] : (uint64_t) esp_timer_get_time();
+
+		Data data = {
+				.btn = (Button) i,
+				.action = pressed ? Data::Press : Data::Release,
+				.time = time
+		};
+		pushEdge(data);
+		Events::post(Facility::Input, data);
+
+		if(pressed){
+			pressTime[i] = time;
+			repeatTime[i] = time + HoldTime * 1000;
+			checkChord((Button) i, time);
+		}else{
+			held &= ~(1 << i);
+			chorded &= ~(1 << i);
+		}
+	}
+
+	if(changed){
+		checkHolds();
 	}
+}
+
+void Input::pushEdge(const Data& edge){
+	const size_t head = edgeHead.load(std::memory_order_relaxed);
+	if(head - edgeTail.load(std::memory_order_acquire) >= EdgeCapacity) return;
+
+	edgeRing[head % EdgeCapacity] = edge;
+	edgeHead.store(head + 1, std::memory_order_release);
+}
+
+bool Input::getEdge(Data& edge){
+	const size_t tail = edgeTail.load(std::memory_order_relaxed);
+	if(tail == edgeHead.load(std::memory_order_acquire)) return false;
+
+	edge = edgeRing[tail % EdgeCapacity];
+	edgeTail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool Input::hasEdge() const{
+	return edgeTail.load(std::memory_order_relaxed) != edgeHead.load(std::memory_order_acquire);
+}
 
-	auto t = millis();
+void Input::inject(const Data& data){
+	// The debounce timer is the edge ring's only writer while the buttons run
+	if(!paused) return;
 
-	if(dbTime[btn] == 0){
-		dbTime[btn] = t;
-		return;
-	}else if(t - dbTime[btn] < DebounceTime){
-		return;
+	if(data.action == Data::Press || data.action == Data::Release){
+		pushEdge(data);
 	}
+	Events::post(Facility::Input, data);
+}
 
-	btnState[btn] = false;
-	dbTime[btn] = 0;
+void Input::checkChord(Button btn, uint64_t now){
+	uint8_t chord = 0;
+	for(size_t i = 0; i < ButtonCount; i++){
+		if(!(state & (1 << i)) || (chorded & (1 << i))) continue;
+		if(now - pressTime[i] > ChordWindow * 1000) continue;
+		chord |= 1 << i;
+	}
 
+	// At least one other button besides the one just pressed
+	if((chord & ~(1 << btn)) == 0) return;
+
+	chorded |= chord;
 	Data data = {
 			.btn = btn,
-			.action = Data::Release
+			.action = Data::Chord,
+			.time = now,
+			.chord = chord
 	};
 	Events::post(Facility::Input, data);
 }
+
+void Input::holdTick(void* arg){
+	static_cast<Input*>(arg)->checkHolds();
+}
+
+void Input::checkHolds(){
+	if(paused) return;
+
+	const auto now = (uint64_t) esp_timer_get_time();
+	const uint8_t pressed = state;
+
+	uint64_t next = UINT64_MAX;
+	for(size_t i = 0; i < ButtonCount; i++){
+		const uint8_t bit = 1 << i;
+		if(!(pressed & bit) || (chorded & bit)) continue;
+
+		// Hold sent and nothing to repeat
+		if((held & bit) && !(RepeatButtons & bit)) continue;
+
+		if(now >= repeatTime[i]){
+			Data data = {
+					.btn = (Button) i,
+					.action = (held & bit) ? Data::Repeat : Data::Hold,
+					.time = now
+			};
+			Events::post(Facility::Input, data);
+
+			held |= bit;
+			repeatTime[i] = std::max(repeatTime[i] + RepeatTime * 1000, now + 1000);
+			if(!(RepeatButtons & bit)) continue;
+		}
+
+		next = std::min(next, repeatTime[i]);
+	}
+
+	esp_timer_stop(holdTimer);
+	if(next != UINT64_MAX){
+		esp_timer_start_once(holdTimer, next - now);
+	}
+}
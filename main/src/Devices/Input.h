@@ -1,46 +1,113 @@
 #ifndef CLOCKSTAR_FIRMWARE_INPUT_H
 #define CLOCKSTAR_FIRMWARE_INPUT_H
 
-#include "Util/Threaded.h"
-#include <unordered_map>
-#include <freertos/task.h>
-#include <freertos/queue.h>
+#include <array>
+#include <atomic>
+#include <esp_timer.h>
 #include <hal/gpio_types.h>
+#include <freertos/FreeRTOS.h>
 
-class Input : public SleepyThreaded {
+/**
+ * Buttons, driven by their GPIO edge interrupts. Every edge restarts a debounce timer, once the pins are quiet for
+ * DebounceTime the timer task reads the levels and posts an event for every button that changed.
+ * A second timer, armed only while a button is down, turns held buttons into Hold and then Repeat events, and two or
+ * more buttons pressed within ChordWindow into a single Chord event. Nothing runs while no button moves.
+ */
+class Input {
 public:
 	Input();
 	virtual ~Input();
 
 	enum Button { Up, Down, Select, Alt };
-	static const std::unordered_map<Button, const char*> PinLabels;
+	static constexpr size_t ButtonCount = 4;
+	static constexpr std::array<const char*, ButtonCount> PinLabels = { "Up", "Down", "Select", "Alt" };
 
 	struct Data {
 		Button btn;
-		enum Action { Release, Press } action;
+		/**
+		 * Hold comes once per press after HoldTime, Repeat follows every RepeatTime for RepeatButtons. A Chord comes
+		 * once with btn set to the button that completed it, chorded buttons send no Hold or Repeat.
+		 * Press and Release are always sent, so consumers only interested in those can ignore the rest.
+		 */
+		enum Action { Release, Press, Hold, Repeat, Chord } action;
+		uint64_t time; // [us] of the first edge of the change, for latency measurements
+		uint8_t chord = 0; // Buttons of a Chord, a bit per Button
 	};
 
+	static constexpr uint32_t HoldTime = 300; //[ms]
+	static constexpr uint32_t RepeatTime = 100; //[ms]
+	static constexpr uint32_t ChordWindow = 80; //[ms] between the presses of a chord
+	static constexpr uint8_t RepeatButtons = (1 << Up) | (1 << Down);
+
 	bool getState(Button btn) const;
 
+	/** Stops reacting to buttons, the pins are free to be used as wakeup sources. */
+	void pause();
+
+	/** Reinstalls the interrupts and reports any button that changed while paused. */
+	void resume();
+
+	/**
+	 * Lets a press wake the chip from automatic light sleep. Only level interrupts wake it, so while this is set
+	 * released buttons wait for a high level and pressed ones for any edge.
+	 */
+	void setWakeup(bool wakeup);
+
+	/**
+	 * Press and Release edges in order, for one reader polling at its own pace, LVGL's indev read, instead of
+	 * listening for events. Lock-free, the debounce timer task is the only writer. Edges coming in while the ring is
+	 * full are dropped, the reader sees the state it missed with the next edge of that button.
+	 * @return False if no edge is waiting
+	 */
+	bool getEdge(Data& edge);
+	bool hasEdge() const;
+
+	/** Feeds in a scripted change as if the buttons made it, for the replay harness. Ignored unless paused. */
+	void inject(const Data& data);
+
 private:
-	void scan();
-	void pressed(Button btn);
-	void released(Button btn);
+	std::array<gpio_num_t, ButtonCount> pins;
 
-	static std::unordered_map<Button, gpio_num_t> PinMap;
+	std::atomic_uint8_t state = 0; // Debounced, a bit per Button
+	bool paused = true;
+	std::atomic_bool wakeup = false;
 
-	std::unordered_map<Button, bool> btnState;
+	struct IsrArg {
+		Input* input;
+		gpio_num_t pin;
+	};
+	std::array<IsrArg, ButtonCount> isrArgs;
+
+	/** Interrupt type the button waits on in its current state */
+	gpio_int_type_t intrType(bool pressed) const;
+
+	// First edge of every button since the last read, 0 if none
+	std::array<uint64_t, ButtonCount> edgeTime{};
+	portMUX_TYPE edgeLock = portMUX_INITIALIZER_UNLOCKED;
+
+	esp_timer_handle_t timer = nullptr;
+	static constexpr uint64_t DebounceTime = 5; // [ms] of quiet pins before they are read
+
+	static void isr(void* arg);
+	static void debounced(void* arg);
+	void scan();
 
-	enum DbDir { Release, Press, None };
-	std::unordered_map<Button, uint64_t> dbTime;
-	static constexpr uint64_t SleepTime = 20; // [ms]
-	static constexpr uint64_t DebounceTime = 5; // [ms]
+	static constexpr size_t EdgeCapacity = 16; // Power of two
+	std::array<Data, EdgeCapacity> edgeRing{};
+	std::atomic_size_t edgeHead = 0; // Written by scan
+	std::atomic_size_t edgeTail = 0; // Written by the reader
+	void pushEdge(const Data& edge);
 
-	void sleepyLoop() override;
+	// Only touched from the esp_timer task
+	esp_timer_handle_t holdTimer = nullptr;
+	std::array<uint64_t, ButtonCount> pressTime{}; //[us]
+	std::array<uint64_t, ButtonCount> repeatTime{}; //[us] of the next Hold or Repeat
+	uint8_t held = 0; // Hold sent, a bit per Button
+	uint8_t chorded = 0; // Part of a sent Chord, a bit per Button
 
-	// Hide public functions
-	using Threaded::start;
-	using Threaded::stop;
+	static void holdTick(void* arg);
+	void checkHolds();
+	void checkChord(Button btn, uint64_t now);
 
 };
 
@@ -1,4 +1,5 @@
 #include "LEDController.h"
+#include <algorithm>
 
 static void IRAM_ATTR isr(void* arg){
 	BaseType_t priority = pdFALSE;
@@ -6,15 +7,28 @@ static void IRAM_ATTR isr(void* arg){
 }
 
 template <typename T>
-LEDController<T>::LEDController() : Threaded("LEDController", 2048, 6), sleepLock(ESP_PM_APB_FREQ_MAX),
+LEDController<T>::LEDController() : Threaded("LEDController", 2048, PlannedTask::LEDController), sleepLock(ESP_PM_APB_FREQ_MAX, "LEDController"),
 									timerSem(xSemaphoreCreateBinary()), timer(1 /*placeholder*/, isr, timerSem){
 
-
+	const esp_timer_create_args_t args = {
+			.callback = curveIsr,
+			.arg = this,
+			.dispatch_method = ESP_TIMER_ISR,
+			.name = "LEDCurve",
+			.skip_unhandled_events = true
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&args, &curveTimer));
 }
 
 template <typename T>
 LEDController<T>::~LEDController(){
 	end();
+	esp_timer_delete(curveTimer);
+}
+
+template <typename T>
+void LEDController<T>::setOutputs(PWM* a, PWM* b, PWM* c){
+	outputs = { a, b, c };
 }
 
 template <typename T>
@@ -28,6 +42,7 @@ void LEDController<T>::begin(){
 template <typename T>
 void LEDController<T>::end(){
 	timer.stop();
+	stopCurve();
 	clear();
 	stop(0);
 	abortFlag = true;
@@ -43,6 +58,7 @@ void LEDController<T>::end(){
 template <typename T>
 void LEDController<T>::clear(){
 	timer.stop();
+	stopCurve();
 	std::unique_lock lock(mut);
 
 	shortAction = {};
@@ -56,6 +72,7 @@ void LEDController<T>::clear(){
 template <typename T>
 void LEDController<T>::setSolid(T color){
 	std::unique_lock lock(mut);
+	stopCurve();
 	continuousAction = { .type = ContinuousAction::Solid, .state = ContinuousAction::Pending, .data = { .solidColor = color } };
 	if(shortAction.type == ShortAction::None){
 		xSemaphoreGive(timerSem);
@@ -89,6 +106,7 @@ void LEDController<T>::blinkContinuous(T color, int32_t loops, uint32_t onTime,
 	   continuousAction.data.continuousBlink.color == color)
 		return;
 
+	stopCurve();
 	continuousAction = { ContinuousAction::ContinuousBlink, ContinuousAction::Pending, { .continuousBlink = { color, onTime, offTime, loops, 0 } } };
 	if(shortAction.type == ShortAction::None){
 		xSemaphoreGive(timerSem);
@@ -105,7 +123,13 @@ void LEDController<T>::breathe(T start, T end, size_t period, int32_t loops){
 	   continuousAction.data.breathe.loops == loops)
 		return;
 
-	continuousAction = { ContinuousAction::Breathe, ContinuousAction::Pending, { .breathe = { start, end, period, loops, 0, 0 } } };
+	stopCurve();
+	buildCurve(start, end, period);
+	curveLoops = loops;
+	curveLoop = 0;
+	curveIndex = 0;
+
+	continuousAction = { ContinuousAction::Breathe, ContinuousAction::Pending, { .breathe = { start, end, period, loops } } };
 	if(shortAction.type == ShortAction::None){
 		xSemaphoreGive(timerSem);
 	}
@@ -121,6 +145,12 @@ void LEDController<T>::loop(){
 
 	std::unique_lock lock(mut);
 
+	// Short actions pause the curve, it resumes where it was once they're done
+	if(shortAction.type != ShortAction::None && continuousAction.type == ContinuousAction::Breathe && continuousAction.state == ContinuousAction::On && !curveDone){
+		stopCurve();
+		continuousAction.state = ContinuousAction::Pending;
+	}
+
 	auto timerPeriod = handleShortAction();
 	if(timerPeriod == 0){
 		timerPeriod = handleContinuousAction();
@@ -161,15 +191,11 @@ uint32_t LEDController<T>::handleContinuousAction(){
 				}
 				break;
 			case ContinuousAction::On:
+				// Nothing to keep running while the LED is dark, the timer wakes the chip up
 				write(T());
 				timerVal = continuousAction.data.continuousBlink.offTime;
 				continuousAction.state = ContinuousAction::Off;
-
-				if(timerVal < 500){
-					sleepLock.acquire();
-				}else{
-					sleepLock.release();
-				}
+				sleepLock.release();
 				break;
 			case ContinuousAction::Off:
 				continuousAction.data.continuousBlink.currLoops++;
@@ -192,39 +218,24 @@ uint32_t LEDController<T>::handleContinuousAction(){
 				break;
 		}
 	}else if(continuousAction.type == ContinuousAction::Breathe){
-			switch(continuousAction.state){
+		switch(continuousAction.state){
 			case ContinuousAction::Pending:
-				write(continuousAction.data.breathe.start);
-				timerVal = BreatheDeltaT;
-				continuousAction.data.breathe.t += BreatheDeltaT;
+				startCurve();
 				continuousAction.state = ContinuousAction::On;
 				sleepLock.acquire();
 				break;
 			case ContinuousAction::On:
-				continuousAction.data.breathe.currLoops++;
-				if(continuousAction.data.breathe.loops == -1 ||
-				   continuousAction.data.breathe.currLoops < continuousAction.data.breathe.loops){
-					float t = 0.5 * cos(2 * M_PI * continuousAction.data.breathe.t / continuousAction.data.breathe.period) + 0.5;
-					T startPart = continuousAction.data.breathe.start;
-					startPart *= t;
-					T endPart = continuousAction.data.breathe.end;
-					endPart *= (1.0f - t);
-					write(startPart + endPart);
-					timerVal = BreatheDeltaT;
-					continuousAction.data.breathe.t += BreatheDeltaT;
-					sleepLock.acquire();
-				}else{
-					timerVal = 0;
+				if(curveDone){
 					continuousAction.type = ContinuousAction::None;
 					sleepLock.release();
+				}else{
+					sleepLock.acquire();
 				}
 				break;
 			case ContinuousAction::Off:
 				continuousAction.type = ContinuousAction::None;
 				sleepLock.release();
-				timerVal = 0;
 		}
-
 	}
 
 	return timerVal;
@@ -251,7 +262,7 @@ uint32_t LEDController<T>::handleShortAction(){
 				write(T());
 				timerVal = shortAction.offTime;
 				shortAction.state = ShortAction::Off;
-				sleepLock.acquire();
+				sleepLock.release();
 				break;
 			case ShortAction::Off:
 				timerVal = 0;
@@ -271,7 +282,7 @@ uint32_t LEDController<T>::handleShortAction(){
 				write(T());
 				timerVal = shortAction.offTime;
 				shortAction.state = ShortAction::Off;
-				sleepLock.acquire();
+				sleepLock.release();
 				break;
 			case ShortAction::Off:
 				write(shortAction.color);
@@ -286,10 +297,72 @@ uint32_t LEDController<T>::handleShortAction(){
 	return timerVal;
 }
 
+template <typename T>
+void LEDController<T>::buildCurve(T start, T end, uint32_t period){
+	// Long periods get longer steps instead of a longer table
+	curveStep = std::max(BreatheDeltaT, (uint32_t) ((period + MaxCurve - 1) / MaxCurve));
+	curveLen = std::clamp((size_t) (period / curveStep), (size_t) 1, MaxCurve);
+
+	for(size_t i = 0; i < curveLen; i++){
+		float t = 0.5 * cos(2 * M_PI * (i * curveStep) / period) + 0.5;
+		T startPart = start;
+		startPart *= t;
+		T endPart = end;
+		endPart *= (1.0f - t);
+		curve[i] = toDuty(startPart + endPart);
+	}
+}
+
+template <typename T>
+void LEDController<T>::startCurve(){
+	if(curveLen == 0) return;
+	curveDone = false;
+
+	curveFrame();
+	if(curveDone) return;
+
+	esp_timer_start_periodic(curveTimer, curveStep * 1000);
+}
+
+template <typename T>
+void LEDController<T>::stopCurve(){
+	esp_timer_stop(curveTimer);
+}
+
+template <typename T>
+void IRAM_ATTR LEDController<T>::curveFrame(){
+	const Duty& duty = curve[curveIndex];
+	for(size_t i = 0; i < MaxChannels; i++){
+		if(outputs[i] == nullptr) continue;
+		outputs[i]->setDutyFromISR(duty[i]);
+	}
+
+	if(++curveIndex < curveLen) return;
+	curveIndex = 0;
+
+	if(curveLoops == -1 || ++curveLoop < (uint32_t) curveLoops) return;
+
+	esp_timer_stop(curveTimer);
+	curveDone = true;
+
+	BaseType_t woken = pdFALSE;
+	xSemaphoreGiveFromISR(timerSem, &woken);
+	if(woken){
+		esp_timer_isr_dispatch_need_yield();
+	}
+}
+
+template <typename T>
+void IRAM_ATTR LEDController<T>::curveIsr(void* arg){
+	static_cast<LEDController<T>*>(arg)->curveFrame();
+}
+
 template
 class LEDController<uint8_t>;
 
-SingleLEDController::SingleLEDController(PWM& pwm) : pwm(pwm){}
+SingleLEDController::SingleLEDController(PWM& pwm) : pwm(pwm){
+	setOutputs(&pwm);
+}
 
 void SingleLEDController::init(){
 }
@@ -305,11 +378,18 @@ void SingleLEDController::write(uint8_t val){
 	pwm.setDuty(fVal);
 }
 
+SingleLEDController::Duty SingleLEDController::toDuty(uint8_t val){
+	const float fVal = (float) val / 255.0f;
+	return { (uint16_t) std::round(fVal * fVal * PWM::FullDuty), 0, 0 };
+}
+
 
 template
 class LEDController<glm::vec3>;
 
-RGBLEDController::RGBLEDController(PWM& pwmR, PWM& pwmG, PWM& pwmB) : pwmR(pwmR), pwmG(pwmG), pwmB(pwmB){}
+RGBLEDController::RGBLEDController(PWM& pwmR, PWM& pwmG, PWM& pwmB) : pwmR(pwmR), pwmG(pwmG), pwmB(pwmB){
+	setOutputs(&pwmR, &pwmG, &pwmB);
+}
 
 void RGBLEDController::init(){
 
@@ -329,3 +409,9 @@ void RGBLEDController::write(glm::vec3 val){
 	pwmG.setDuty(val.y);
 	pwmB.setDuty(val.z);
 }
+
+RGBLEDController::Duty RGBLEDController::toDuty(glm::vec3 val){
+	val /= 255.0;
+	val = glm::round(val * val * (float) PWM::FullDuty);
+	return { (uint16_t) val.x, (uint16_t) val.y, (uint16_t) val.z };
+}
@@ -5,6 +5,8 @@
 #include <vector>
 #include <mutex>
 #include <atomic>
+#include <array>
+#include <esp_timer.h>
 #include "Util/Threaded.h"
 #include "Periph/PWM.h"
 #include "Periph/Timer.h"
@@ -34,6 +36,7 @@ public:
 	/**
 	 * Breathes an LED from specified start value to end value.
 	 * Typename T needs to have defined subtraction (T start - T end) and multiplication by a scalar value (T start * float n)
+	 * The curve is precomputed once in duty units and played from a timer ISR, the LED task sleeps until it's over.
 	 * @param start Starting value
 	 * @param end Ending value
 	 * @param period Duration of 1 period, going from start to end and back, in milliseconds.
@@ -42,10 +45,19 @@ public:
 	void breathe(T start, T end, size_t period, int32_t loops = -1);
 
 protected:
+	static constexpr size_t MaxChannels = 3;
+	using Duty = std::array<uint16_t, MaxChannels>; // [0, PWM::FullDuty] per output
+
 	virtual void init() = 0;
 	virtual void deinit() = 0;
 	virtual void write(T val) = 0;
 
+	/** Duty of every output at val, gamma included. Only used when precomputing curves. */
+	virtual Duty toDuty(T val) = 0;
+
+	/** Outputs the curve ISR writes to, in the order of Duty */
+	void setOutputs(PWM* a, PWM* b = nullptr, PWM* c = nullptr);
+
 private:
 	void loop() override;
 
@@ -85,8 +97,6 @@ private:
 				T start, end;
 				uint32_t period;
 				int32_t loops;
-				uint32_t currLoops;
-				uint32_t t;
 			} breathe;
 		} data;
 	} continuousAction;
@@ -103,7 +113,26 @@ private:
 	std::atomic_bool abortFlag = false;
 
 	static constexpr uint32_t DefaultBlinkDuration = 100; //[ms]
-	static constexpr uint32_t BreatheDeltaT = 20;
+	static constexpr uint32_t BreatheDeltaT = 20; //[ms] shortest curve step
+	static constexpr size_t MaxCurve = 128;
+
+	// Breathe curve. Built by breathe() while the curve timer is stopped, played by the timer's ISR.
+	std::array<Duty, MaxCurve> curve;
+	size_t curveLen = 0;
+	uint32_t curveStep = BreatheDeltaT; //[ms]
+	size_t curveIndex = 0;
+	int32_t curveLoops = -1;
+	uint32_t curveLoop = 0;
+	std::atomic_bool curveDone = false;
+
+	std::array<PWM*, MaxChannels> outputs{};
+	esp_timer_handle_t curveTimer;
+
+	void buildCurve(T start, T end, uint32_t period);
+	void startCurve();
+	void stopCurve();
+	void curveFrame();
+	static void curveIsr(void* arg);
 };
 
 
@@ -113,6 +142,7 @@ public:
 
 protected:
 	void write(uint8_t val) override;
+	Duty toDuty(uint8_t val) override;
 
 	void init() override;
 	void deinit() override;
@@ -128,6 +158,7 @@ public:
 
 protected:
 	void write(glm::vec3 val) override;
+	Duty toDuty(glm::vec3 val) override;
 
 	void init() override;
 	void deinit() override;
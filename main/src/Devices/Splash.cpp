@@ -0,0 +1,118 @@
+#include "Splash.h"
+#include "Util/AssetBundle.h"
+#include "Util/LZ4.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <memory>
+#include <new>
+
+static const char* TAG = "Splash";
+
+bool Splash::draw(Display& display, const char* path){
+	const auto start = esp_timer_get_time();
+
+	// Mapped only for the splash, FSLVGL maps its own once SPIFFS is up
+	AssetBundle bundle;
+	const auto asset = bundle.find(path);
+	if(asset.data == nullptr){
+		ESP_LOGW(TAG, "%s isn't in the asset bundle", path);
+		return false;
+	}
+
+	const uint8_t* data = asset.data;
+	std::unique_ptr<uint8_t[]> raw;
+	if(asset.compressed()){
+		raw.reset(new(std::nothrow) uint8_t[asset.rawSize]);
+		if(!raw || LZ4::decompress(asset.data, asset.size, raw.get(), asset.rawSize) != asset.rawSize){
+			ESP_LOGW(TAG, "Couldn't decompress %s", path);
+			return false;
+		}
+		data = raw.get();
+	}
+
+	Image image;
+	if(!parse(data, asset.rawSize, image)){
+		ESP_LOGW(TAG, "%s isn't an indexed or true color image", path);
+		return false;
+	}
+
+	push(display, image);
+
+	ESP_LOGI(TAG, "Drew %s in %lld us", path, esp_timer_get_time() - start);
+	return true;
+}
+
+bool Splash::parse(const uint8_t* data, size_t size, Image& image){
+	if(size < 4) return false;
+
+	// lv_img_header_t: cf:5, always_zero:3, reserved:2, w:11, h:11
+	const uint32_t header = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+	image.cf = header & 0x1F;
+	image.width = (header >> 10) & 0x7FF;
+	image.height = (header >> 21) & 0x7FF;
+	image.pixels = data + 4;
+
+	size_t expected;
+	if(image.cf == CfTrueColor){
+		expected = (size_t) image.width * image.height * 2;
+	}else if(image.cf >= CfIndexed1 && image.cf <= CfIndexed8){
+		const uint8_t bpp = 1 << (image.cf - CfIndexed1);
+		expected = (4 << bpp) + (size_t) ((image.width * bpp + 7) / 8) * image.height;
+	}else{
+		return false;
+	}
+
+	return image.width > 0 && image.height > 0 && size - 4 >= expected;
+}
+
+void Splash::push(Display& display, const Image& image){
+	auto& lgfx = display.getLGFX();
+	const int16_t width = std::min<int16_t>(image.width, lgfx.width());
+	const int16_t height = std::min<int16_t>(image.height, lgfx.height());
+	const int16_t x = (lgfx.width() - width) / 2;
+	const int16_t y = (lgfx.height() - height) / 2;
+
+	if(width < lgfx.width() || height < lgfx.height()){
+		lgfx.fillScreen(TFT_BLACK);
+	}
+
+	if(image.cf == CfTrueColor){
+		// Already in the panel's byte order, rows past the panel's width are skipped by the stride
+		for(int16_t row = 0; row < height; row++){
+			lgfx.pushImage(x, y + row, width, 1, (const lgfx::swap565_t*) (image.pixels + row * image.width * 2));
+		}
+		return;
+	}
+
+	const uint8_t bpp = 1 << (image.cf - CfIndexed1);
+	const uint16_t colors = 1 << bpp;
+	const size_t stride = (image.width * bpp + 7) / 8;
+
+	// lv_color32_t entries, blue first. Alpha is blended onto black, the splash has nothing else under it.
+	lgfx::swap565_t palette[256];
+	for(uint16_t i = 0; i < colors; i++){
+		const uint8_t* c = image.pixels + i * 4;
+		palette[i] = lgfx::swap565_t(c[2] * c[3] / 255, c[1] * c[3] / 255, c[0] * c[3] / 255);
+	}
+	const uint8_t* indices = image.pixels + colors * 4;
+
+	std::unique_ptr<lgfx::swap565_t[]> stripe(new(std::nothrow) lgfx::swap565_t[width * StripeRows]);
+	if(!stripe) return;
+
+	const uint8_t mask = colors - 1;
+	for(int16_t top = 0; top < height; top += StripeRows){
+		const int16_t rows = std::min<int16_t>(StripeRows, height - top);
+		for(int16_t row = 0; row < rows; row++){
+			const uint8_t* src = indices + (top + row) * stride;
+			auto dst = stripe.get() + row * width;
+			for(int16_t col = 0; col < width; col++){
+				// Pixels are packed most significant bits first
+				const uint32_t bit = col * bpp;
+				const uint8_t shift = 8 - bpp - (bit & 7);
+				dst[col] = palette[(src[bit >> 3] >> shift) & mask];
+			}
+		}
+		lgfx.pushImage(x, y + top, width, rows, stripe.get());
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef CLOCKSTAR_FIRMWARE_SPLASH_H
+#define CLOCKSTAR_FIRMWARE_SPLASH_H
+
+#include "Display.h"
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Boot splash pushed straight into the panel from the mapped asset bundle, before LVGL, SPIFFS or the FSLVGL cache
+ * exist. The image is an LVGL .bin from spiffs_image, decoded here without LVGL: indexed (1, 2, 4 or 8 bit)
+ * or 16-bit true color stored byte-swapped like LVGL renders. An image smaller than the panel is centered on
+ * black. The lock screen's background makes the handover to LVGL's first frame seamless.
+ */
+class Splash {
+public:
+	/**
+	 * @param path Relative to the image root, e.g. /bg.bin
+	 * @return False if the bundle or the image is missing or in another format, the panel is left as it was
+	 */
+	static bool draw(Display& display, const char* path);
+
+private:
+	static constexpr uint8_t CfTrueColor = 4; // LV_IMG_CF_TRUE_COLOR
+	static constexpr uint8_t CfIndexed1 = 7; // LV_IMG_CF_INDEXED_1BIT, 2, 4 and 8 bit follow
+	static constexpr uint8_t CfIndexed8 = 10;
+	static constexpr uint8_t StripeRows = 16;
+
+	struct Image {
+		const uint8_t* pixels;
+		uint8_t cf;
+		uint16_t width;
+		uint16_t height;
+	};
+
+	static bool parse(const uint8_t* data, size_t size, Image& image);
+	static void push(Display& display, const Image& image);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_SPLASH_H
@@ -1,82 +1,63 @@
 #include "Filter.h"
 
-Fusion::Filter::Quat Fusion::Filter::QuatMul(const Fusion::Filter::Quat L, const Fusion::Filter::Quat R){
-	return {
-			(L.q1 * R.q1) - (L.q2 * R.q2) - (L.q3 * R.q3) - (L.q4 * R.q4),
-			(L.q1 * R.q2) + (L.q2 * R.q1) + (L.q3 * R.q4) - (L.q4 * R.q3),
-			(L.q1 * R.q3) - (L.q2 * R.q4) + (L.q3 * R.q1) + (L.q4 * R.q2),
-			(L.q1 * R.q4) + (L.q2 * R.q3) - (L.q3 * R.q2) + (L.q4 * R.q1)
-	};
-}
-
-void Fusion::Filter::QuatMulScalar(Fusion::Filter::Quat& q, double scalar){
-	q.q1 *= scalar;
-	q.q2 *= scalar;
-	q.q3 *= scalar;
-	q.q4 *= scalar;
-};
-
-Fusion::Filter::Quat Fusion::Filter::QuatAdd(const Fusion::Filter::Quat l, const Fusion::Filter::Quat r){
-	return {
-			l.q1 + r.q1,
-			l.q2 + r.q2,
-			l.q3 + r.q3,
-			l.q4 + r.q4
-	};
+template<typename T>
+Fusion::Orient Fusion::FilterT<T>::QuatToEuler(Quat<T> quat){
+	using R = Real<T>;
+	const R q1 = (R) quat.q1, q2 = (R) quat.q2, q3 = (R) quat.q3, q4 = (R) quat.q4;
+
+	R yaw = atan2f((R(2) * q2 * q3 - R(2) * q1 * q4), (R(2) * q1 * q1 + R(2) * q2 * q2 - R(1)));  // equation (7)
+	R pitch = -asinf(R(2) * q2 * q4 + R(2) * q1 * q3);                                  // equatino (8)
+	R roll = atan2f((R(2) * q3 * q4 - R(2) * q1 * q2), (R(2) * q1 * q1 + R(2) * q4 * q4 - R(1)));
+
+	yaw *= R(180.0 / M_PI);
+	pitch *= R(180.0 / M_PI);
+	roll *= R(180.0 / M_PI);
+
+	return { (float) -roll, (float) yaw, (float) -pitch };
+}
+
+template<typename T>
+Fusion::Quat<T> Fusion::FilterT<T>::EulerToQuat(Real<T> pitch, Real<T> yaw, Real<T> roll){
+	using R = Real<T>;
+	R c1 = std::cos(yaw/R(2));
+	R s1 = std::sin(yaw/R(2));
+	R c2 = std::cos(pitch/R(2));
+	R s2 = std::sin(pitch/R(2));
+	R c3 = std::cos(roll/R(2));
+	R s3 = std::sin(roll/R(2));
+	R c1c2 = c1*c2;
+	R s1s2 = s1*s2;
+	R w =c1c2*c3 - s1s2*s3;
+	R x =c1c2*s3 + s1s2*c3;
+	R y =s1*c2*c3 + c1*s2*s3;
+	R z =c1*s2*c3 - s1*c2*s3;
+	return { T(w), T(x), T(y), T(z) };
+}
+
+template<typename T>
+Fusion::Quat<T> Fusion::FilterT<T>::GravityToQuat(glm::vec3 g){
+	const float len = std::sqrt(g.x * g.x + g.y * g.y + g.z * g.z);
+	if(len == 0) return { T(1), T(0), T(0), T(0) };
+	g /= len;
+
+	// Shortest arc from +Z, degenerate when g points straight down
+	if(g.z < -0.9999f) return { T(0), T(1), T(0), T(0) };
+
+	Quat<T> q = { T(1.0f + g.z), T(g.y), T(-g.x), T(0) };
+	QuatNormalize(q);
+	return q;
 }
 
-Fusion::Filter::Quat Fusion::Filter::QuatSub(const Fusion::Filter::Quat l, const Fusion::Filter::Quat r){
+template<typename T>
+glm::vec3 Fusion::FilterT<T>::QuatToGravity(Quat<T> quat){
+	const float q1 = (float) quat.q1, q2 = (float) quat.q2, q3 = (float) quat.q3, q4 = (float) quat.q4;
 	return {
-			l.q1 - r.q1,
-			l.q2 - r.q2,
-			l.q3 - r.q3,
-			l.q4 - r.q4
+			2.0f * (q2 * q4 - q1 * q3),
+			2.0f * (q1 * q2 + q3 * q4),
+			1.0f - 2.0f * (q2 * q2 + q3 * q3)
 	};
 }
 
-Fusion::Filter::Quat Fusion::Filter::QuatConjug(Fusion::Filter::Quat q){
-	q.q2 = -q.q2;
-	q.q3 = -q.q3;
-	q.q4 = -q.q4;
-	return q;
-}
-
-double Fusion::Filter::QuatNorm(const Fusion::Filter::Quat q){
-	return std::sqrt(q.q1 * q.q1 + q.q2 * q.q2 + q.q3 * q.q3 + q.q4 * q.q4);
-}
-
-void Fusion::Filter::QuatNormalize(Fusion::Filter::Quat& q){
-	float norm = QuatNorm(q);
-	q.q1 /= norm;
-	q.q2 /= norm;
-	q.q3 /= norm;
-	q.q4 /= norm;
-}
-
-Fusion::Orient Fusion::Filter::QuatToEuler(Fusion::Filter::Quat q){
-	double yaw = atan2f((2.0 * q.q2 * q.q3 - 2.0 * q.q1 * q.q4), (2.0 * q.q1 * q.q1 + 2.0 * q.q2 * q.q2 - 1.0));  // equation (7)
-	double pitch = -asinf(2.0 * q.q2 * q.q4 + 2.0 * q.q1 * q.q3);                                  // equatino (8)
-	double roll = atan2f((2.0 * q.q3 * q.q4 - 2.0 * q.q1 * q.q2), (2.0 * q.q1 * q.q1 + 2.0 * q.q4 * q.q4 - 1.0));
-
-	yaw *= (180.0 / M_PI);
-	pitch *= (180.0 / M_PI);
-	roll *= (180.0 / M_PI);
-
-	return { -roll, yaw, -pitch };
-}
-
-Fusion::Filter::Quat Fusion::Filter::EulerToQuat(double pitch, double yaw, double roll){
-	double c1 = cos(yaw/2.0);
-	double s1 = sin(yaw/2.0);
-	double c2 = cos(pitch/2.0);
-	double s2 = sin(pitch/2.0);
-	double c3 = cos(roll/2.0);
-	double s3 = sin(roll/2.0);
-	double c1c2 = c1*c2;
-	double s1s2 = s1*s2;
-	double w =c1c2*c3 - s1s2*s3;
-	double x =c1c2*s3 + s1s2*c3;
-	double y =s1*c2*c3 + c1*s2*s3;
-	double z =c1*s2*c3 - s1*c2*s3;
-	return { w, x, y, z };
-}
+template class Fusion::FilterT<double>;
+template class Fusion::FilterT<float>;
+template class Fusion::FilterT<Fusion::Q20>;
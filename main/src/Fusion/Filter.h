@@ -2,38 +2,172 @@
 #define CLOCKSTAR_FIRMWARE_FILTER_H
 
 #include "Devices/IMU.h"
+#include "Fixed.h"
+#include <type_traits>
+#include <cstring>
+#include <vec3.hpp>
 
 namespace Fusion {
 
-struct Orient { double pitch, yaw, roll; };
+struct Orient { float pitch, yaw, roll; }; // [deg]
 
-class Filter {
+/**
+ * Type used for the parts of a filter that need trigonometry or roots. double for the double reference, float for
+ * float and fixed point, since the S3 FPU only does single precision.
+ */
+template<typename T>
+using Real = std::conditional_t<std::is_same_v<T, double>, double, float>;
+
+template<typename T>
+struct Quat {
+	T q1, q2, q3, q4;
+};
+
+/**
+ * Orientation filter over scalar type T: double (reference), float or a Fixed Q-format.
+ * FilterT<double>, aliased as Filter, matches the original double-precision implementation.
+ */
+template<typename T>
+class FilterT {
 public:
+	virtual ~FilterT() = default;
+
+	virtual Orient update(const IMU::Sample& sample) = 0;
+
+	/**
+	 * Integrates count consecutive samples in one loop and converts to Euler angles once, for FIFO batches.
+	 * Same result as calling update() on each sample.
+	 */
+	virtual Orient update(const IMU::Sample* samples, size_t count) = 0;
 
-	virtual Orient update(IMU::Sample sample) = 0;
 	virtual Orient get() = 0;
 
+	/** Jumps straight to the attitude the accelerometer in sample reads, with zero yaw. */
+	virtual void reset(const IMU::Sample& sample) = 0;
+
+	virtual Quat<T> getQuat() const = 0;
+
+	/** Estimated gravity direction as a unit vector in the IMU::Sample axes, what a still accelerometer would read. */
+	virtual glm::vec3 getGravity() const = 0;
+
 protected:
 
-	static constexpr double DeltaT = 1.0/104.0; // 104Hz sample rate
+	static constexpr T DeltaT = T(1.0/104.0); // 104Hz sample rate
 
-	struct Quat {
-		double q1, q2, q3, q4;
-	};
+	static Quat<T> QuatMul(Quat<T> l, Quat<T> r);
+	static void QuatMulScalar(Quat<T>& q, T scalar);
+	static Quat<T> QuatAdd(Quat<T> l, Quat<T> r);
+	static Quat<T> QuatSub(Quat<T> l, Quat<T> r);
+	static Quat<T> QuatConjug(Quat<T> q);
+	static T QuatNorm(Quat<T> q);
+	static void QuatNormalize(Quat<T>& q);
+	static Quat<T> EulerToQuat(Real<T> pitch, Real<T> yaw, Real<T> roll);
 
-	static Quat QuatMul(Quat l, Quat r);
-	static void QuatMulScalar(Quat& q, double scalar);
-	static Quat QuatAdd(Quat l, Quat r);
-	static Quat QuatSub(Quat l, Quat r);
-	static Quat QuatConjug(Quat q);
-	static double QuatNorm(Quat q);
-	static void QuatNormalize(Quat& q);
-	static Quat EulerToQuat(double pitch, double yaw, double roll);
+	static Orient QuatToEuler(Quat<T> q);
 
-	static Orient QuatToEuler(Quat q);
+	/** Unit quaternion whose conjugate rotates +Z onto the gravity vector g. */
+	static Quat<T> GravityToQuat(glm::vec3 g);
+	/** Inverse of GravityToQuat: +Z rotated by the conjugate of q. */
+	static glm::vec3 QuatToGravity(Quat<T> q);
+
+	static T invSqrt(T x);
 
 };
 
+/**
+ * Bit-trick inverse square root with two Newton steps, ~5e-6 relative error. Seven FPU multiply-adds instead of
+ * a square root followed by a divide, both of which are iterative on the S3.
+ */
+inline float fastInvSqrt(float x){
+	uint32_t i;
+	std::memcpy(&i, &x, sizeof(i));
+	i = 0x5f3759df - (i >> 1);
+	float y;
+	std::memcpy(&y, &i, sizeof(y));
+
+	const float halfx = 0.5f * x;
+	y = y * (1.5f - halfx * y * y);
+	y = y * (1.5f - halfx * y * y);
+	return y;
+}
+
+// Hot per-sample kernels are defined here so they inline into the filters' update loops
+
+template<typename T>
+inline Quat<T> FilterT<T>::QuatMul(const Quat<T> L, const Quat<T> R){
+	return {
+			(L.q1 * R.q1) - (L.q2 * R.q2) - (L.q3 * R.q3) - (L.q4 * R.q4),
+			(L.q1 * R.q2) + (L.q2 * R.q1) + (L.q3 * R.q4) - (L.q4 * R.q3),
+			(L.q1 * R.q3) - (L.q2 * R.q4) + (L.q3 * R.q1) + (L.q4 * R.q2),
+			(L.q1 * R.q4) + (L.q2 * R.q3) - (L.q3 * R.q2) + (L.q4 * R.q1)
+	};
+}
+
+template<typename T>
+inline void FilterT<T>::QuatMulScalar(Quat<T>& q, T scalar){
+	q.q1 *= scalar;
+	q.q2 *= scalar;
+	q.q3 *= scalar;
+	q.q4 *= scalar;
+}
+
+template<typename T>
+inline Quat<T> FilterT<T>::QuatAdd(const Quat<T> l, const Quat<T> r){
+	return {
+			l.q1 + r.q1,
+			l.q2 + r.q2,
+			l.q3 + r.q3,
+			l.q4 + r.q4
+	};
+}
+
+template<typename T>
+inline Quat<T> FilterT<T>::QuatSub(const Quat<T> l, const Quat<T> r){
+	return {
+			l.q1 - r.q1,
+			l.q2 - r.q2,
+			l.q3 - r.q3,
+			l.q4 - r.q4
+	};
+}
+
+template<typename T>
+inline Quat<T> FilterT<T>::QuatConjug(Quat<T> q){
+	q.q2 = -q.q2;
+	q.q3 = -q.q3;
+	q.q4 = -q.q4;
+	return q;
+}
+
+template<typename T>
+inline T FilterT<T>::QuatNorm(const Quat<T> q){
+	using std::sqrt;
+	return sqrt(q.q1 * q.q1 + q.q2 * q.q2 + q.q3 * q.q3 + q.q4 * q.q4);
+}
+
+template<typename T>
+inline void FilterT<T>::QuatNormalize(Quat<T>& q){
+	// One root and four multiplications instead of four divisions, which are expensive in fixed point
+	const T sq = q.q1 * q.q1 + q.q2 * q.q2 + q.q3 * q.q3 + q.q4 * q.q4;
+	if(sq == T(0)) return;
+	QuatMulScalar(q, invSqrt(sq));
+}
+
+template<typename T>
+inline T FilterT<T>::invSqrt(T x){
+	if constexpr(std::is_same_v<T, double>){
+		return 1.0 / std::sqrt(x);
+	}else{
+		return T(fastInvSqrt((float) x));
+	}
+}
+
+using Filter = FilterT<double>;
+
+extern template class FilterT<double>;
+extern template class FilterT<float>;
+extern template class FilterT<Q20>;
+
 }
 
 
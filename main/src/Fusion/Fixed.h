@@ -0,0 +1,65 @@
+#ifndef CLOCKSTAR_FIRMWARE_FIXED_H
+#define CLOCKSTAR_FIRMWARE_FIXED_H
+
+#include <cstdint>
+#include <cmath>
+
+namespace Fusion {
+
+/**
+ * Signed Q-format fixed point number, Frac fractional bits in an int32_t. Products and quotients are computed in
+ * int64_t so only the result has to fit. Square roots and trigonometry go through float, which the FPU handles.
+ */
+template<int Frac>
+struct Fixed {
+	static_assert(Frac > 0 && Frac < 31);
+	static constexpr int32_t One = 1 << Frac;
+
+	int32_t raw = 0;
+
+	constexpr Fixed() = default;
+	constexpr Fixed(int val) : raw(val * One){}
+	constexpr Fixed(float val) : raw((int32_t) (val * One + (val >= 0 ? 0.5f : -0.5f))){}
+	constexpr Fixed(double val) : raw((int32_t) (val * One + (val >= 0 ? 0.5 : -0.5))){}
+
+	static constexpr Fixed fromRaw(int32_t raw){
+		Fixed f;
+		f.raw = raw;
+		return f;
+	}
+
+	constexpr explicit operator float() const{ return (float) raw / One; }
+	constexpr explicit operator double() const{ return (double) raw / One; }
+
+	friend constexpr Fixed operator+(Fixed l, Fixed r){ return fromRaw(l.raw + r.raw); }
+	friend constexpr Fixed operator-(Fixed l, Fixed r){ return fromRaw(l.raw - r.raw); }
+	friend constexpr Fixed operator*(Fixed l, Fixed r){ return fromRaw((int32_t) (((int64_t) l.raw * r.raw) >> Frac)); }
+	friend constexpr Fixed operator/(Fixed l, Fixed r){ return fromRaw((int32_t) (((int64_t) l.raw * One) / r.raw)); }
+	constexpr Fixed operator-() const{ return fromRaw(-raw); }
+
+	constexpr Fixed& operator+=(Fixed r){ return *this = *this + r; }
+	constexpr Fixed& operator-=(Fixed r){ return *this = *this - r; }
+	constexpr Fixed& operator*=(Fixed r){ return *this = *this * r; }
+	constexpr Fixed& operator/=(Fixed r){ return *this = *this / r; }
+
+	friend constexpr bool operator==(Fixed l, Fixed r){ return l.raw == r.raw; }
+	friend constexpr bool operator!=(Fixed l, Fixed r){ return l.raw != r.raw; }
+	friend constexpr bool operator<(Fixed l, Fixed r){ return l.raw < r.raw; }
+	friend constexpr bool operator>(Fixed l, Fixed r){ return l.raw > r.raw; }
+	friend constexpr bool operator<=(Fixed l, Fixed r){ return l.raw <= r.raw; }
+	friend constexpr bool operator>=(Fixed l, Fixed r){ return l.raw >= r.raw; }
+
+};
+
+/** 11 integer bits cover squared accelerometer magnitudes at 16 g, 20 fractional bits resolve gyro steps at 104 Hz. */
+using Q20 = Fixed<20>;
+
+template<int Frac>
+inline Fixed<Frac> sqrt(Fixed<Frac> x){
+	return std::sqrt((float) x);
+}
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_FIXED_H
@@ -1,34 +1,45 @@
 #include "Madgwick.h"
 
-Fusion::Orient Fusion::Madgwick::update(IMU::Sample sample){
-	sample.accelZ *= -1;
-	sample.gyroX *= -1;
-	sample.gyroY *= -1;
+template<typename T>
+Fusion::Orient Fusion::MadgwickT<T>::update(const IMU::Sample& sample){
+	integrate(sample);
+	return get();
+}
 
-	Quat q_est_prev = q_est;
-	Quat q_est_dot = { 0, 0, 0, 0 };            // used as a place holder in equations 42 and 43
+template<typename T>
+Fusion::Orient Fusion::MadgwickT<T>::update(const IMU::Sample* samples, size_t count){
+	for(size_t i = 0; i < count; i++){
+		integrate(samples[i]);
+	}
+	return get();
+}
+
+template<typename T>
+inline void Fusion::MadgwickT<T>::integrate(const IMU::Sample& sample){
+	Quat<T> q_est_prev = q_est;
+	Quat<T> q_est_dot = { T(0), T(0), T(0), T(0) };            // used as a place holder in equations 42 and 43
 	//const Quat q_g_ref = {0, 0, 0, 1};// equation (23), reference to field of gravity for gradient descent optimization (not needed because I used eq 25 instead of eq 21
-	Quat q_a = { 0, sample.accelX, sample.accelY, sample.accelZ };    // equation (24) raw acceleration values, needs to be normalized
+	Quat<T> q_a = { T(0), T(sample.accelX), T(sample.accelY), T(-sample.accelZ) };    // equation (24) raw acceleration values, needs to be normalized
 
-	double F_g[3] = { 0, 0, 0 };                        // equation(15/21/25) objective function for gravity
-	double J_g[3][4];                     // jacobian matrix for gravity
+	T F_g[3] = { T(0), T(0), T(0) };                        // equation(15/21/25) objective function for gravity
+	T J_g[3][4];                     // jacobian matrix for gravity
 	for(int i = 0; i < 3; i++){
 		for(int j = 0; j < 4; j++){
-			J_g[i][j] = 0;
+			J_g[i][j] = T(0);
 		}
 	}
 
-	Quat gradient = { 0, 0, 0, 0 };
+	Quat<T> gradient = { T(0), T(0), T(0), T(0) };
 
 	/* Integrate angluar velocity to obtain position in angles. */
-	Quat q_w;                   // equation (10), places gyroscope readings in a quaternion
-	q_w.q1 = 0;                              // the real component is zero, which the Madgwick uses to simplfy quat. mult.
-	q_w.q2 = sample.gyroX;
-	q_w.q3 = sample.gyroY;
-	q_w.q4 = sample.gyroZ;
+	Quat<T> q_w;                   // equation (10), places gyroscope readings in a quaternion
+	q_w.q1 = T(0);                            // the real component is zero, which the Madgwick uses to simplfy quat. mult.
+	q_w.q2 = T(-sample.gyroX);
+	q_w.q3 = T(-sample.gyroY);
+	q_w.q4 = T(sample.gyroZ);
 
-	QuatMulScalar(q_w, 0.5);                  // equation (12) dq/dt = (1/2)q*w
-	q_w = QuatMul(q_est_prev, q_w);        // equation (12)
+	F::QuatMulScalar(q_w, T(0.5));                  // equation (12) dq/dt = (1/2)q*w
+	q_w = F::QuatMul(q_est_prev, q_w);        // equation (12)
 
 	/* NOTE
 	* Page 10 states equation (40) substitutes equation (13) into it. This seems false, as he actually
@@ -48,27 +59,27 @@ Fusion::Orient Fusion::Madgwick::update(IMU::Sample sample){
 	 Note: it is possible to compute the objective function with quaternion multiplcation functions, but it does not take into account the many zeros that cancel terms out and is not optimized like the paper shows
 	 */
 
-	QuatNormalize(q_a);              // normalize the acceleration quaternion to be a unit quaternion
+	F::QuatNormalize(q_a);              // normalize the acceleration quaternion to be a unit quaternion
 	//Compute the objective function for gravity, equation(15), simplified to equation (25) due to the 0's in the acceleration reference quaternion
-	F_g[0] = 2.0 * (q_est_prev.q2 * q_est_prev.q4 - q_est_prev.q1 * q_est_prev.q3) - q_a.q2;
-	F_g[1] = 2.0 * (q_est_prev.q1 * q_est_prev.q2 + q_est_prev.q3 * q_est_prev.q4) - q_a.q3;
-	F_g[2] = 2.0 * (0.5 - q_est_prev.q2 * q_est_prev.q2 - q_est_prev.q3 * q_est_prev.q3) - q_a.q4;
+	F_g[0] = T(2) * (q_est_prev.q2 * q_est_prev.q4 - q_est_prev.q1 * q_est_prev.q3) - q_a.q2;
+	F_g[1] = T(2) * (q_est_prev.q1 * q_est_prev.q2 + q_est_prev.q3 * q_est_prev.q4) - q_a.q3;
+	F_g[2] = T(2) * (T(0.5) - q_est_prev.q2 * q_est_prev.q2 - q_est_prev.q3 * q_est_prev.q3) - q_a.q4;
 
 	//Compute the Jacobian matrix, equation (26), for gravity
-	J_g[0][0] = -2.0 * q_est_prev.q3;
-	J_g[0][1] = 2.0 * q_est_prev.q4;
-	J_g[0][2] = -2.0 * q_est_prev.q1;
-	J_g[0][3] = 2.0 * q_est_prev.q2;
+	J_g[0][0] = -T(2) * q_est_prev.q3;
+	J_g[0][1] = T(2) * q_est_prev.q4;
+	J_g[0][2] = -T(2) * q_est_prev.q1;
+	J_g[0][3] = T(2) * q_est_prev.q2;
 
-	J_g[1][0] = 2.0 * q_est_prev.q2;
-	J_g[1][1] = 2.0 * q_est_prev.q1;
-	J_g[1][2] = 2.0 * q_est_prev.q4;
-	J_g[1][3] = 2.0 * q_est_prev.q3;
+	J_g[1][0] = T(2) * q_est_prev.q2;
+	J_g[1][1] = T(2) * q_est_prev.q1;
+	J_g[1][2] = T(2) * q_est_prev.q4;
+	J_g[1][3] = T(2) * q_est_prev.q3;
 
-	J_g[2][0] = 0;
-	J_g[2][1] = -4.0 * q_est_prev.q2;
-	J_g[2][2] = -4.0 * q_est_prev.q3;
-	J_g[2][3] = 0;
+	J_g[2][0] = T(0);
+	J_g[2][1] = -T(4) * q_est_prev.q2;
+	J_g[2][2] = -T(4) * q_est_prev.q3;
+	J_g[2][3] = T(0);
 
 	// now computer the gradient, equation (20), gradient = J_g'*F_g
 	gradient.q1 = J_g[0][0] * F_g[0] + J_g[1][0] * F_g[1] + J_g[2][0] * F_g[2];
@@ -77,7 +88,7 @@ Fusion::Orient Fusion::Madgwick::update(IMU::Sample sample){
 	gradient.q4 = J_g[0][3] * F_g[0] + J_g[1][3] * F_g[1] + J_g[2][3] * F_g[2];
 
 	// Normalize the gradient, equation (44)
-	QuatNormalize(gradient);
+	F::QuatNormalize(gradient);
 
 	/* This is the sensor fusion part of the algorithm.
 	 Combining Gyroscope position angles calculated in the beginning, with the quaternion orienting the accelerometer to gravity created above.
@@ -91,16 +102,37 @@ Fusion::Orient Fusion::Madgwick::update(IMU::Sample sample){
 	 Combining the simplification of the gradient descent equation with the simplification of the fusion equation gets you eq.
 	 41 which can be subdivided into eqs 42-44.
 	*/
-	QuatMulScalar(gradient, Beta);             // multiply normalized gradient by beta
-	q_est_dot = QuatSub(q_w, gradient);        // subtract above from q_w, the integrated gyro quaternion
-	QuatMulScalar(q_est_dot, DeltaT);
-	q_est = QuatAdd(q_est_prev, q_est_dot);     // Integrate orientation rate to find position
-	QuatNormalize(q_est);                 // normalize the orientation of the estimate
+	F::QuatMulScalar(gradient, Beta);             // multiply normalized gradient by beta
+	q_est_dot = F::QuatSub(q_w, gradient);        // subtract above from q_w, the integrated gyro quaternion
+	F::QuatMulScalar(q_est_dot, F::DeltaT);
+	q_est = F::QuatAdd(q_est_prev, q_est_dot);     // Integrate orientation rate to find position
+	F::QuatNormalize(q_est);                 // normalize the orientation of the estimate
 	//(shown in diagram, plus always use unit quaternions for orientation)
+}
 
-	return get();
+template<typename T>
+Fusion::Orient Fusion::MadgwickT<T>::get(){
+	return F::QuatToEuler(q_est);
+}
+
+template<typename T>
+void Fusion::MadgwickT<T>::reset(const IMU::Sample& sample){
+	// The filter works with Z flipped, see q_a in update()
+	q_est = F::GravityToQuat({ sample.accelX, sample.accelY, -sample.accelZ });
 }
 
-Fusion::Orient Fusion::Madgwick::get(){
-	return QuatToEuler(q_est);
+template<typename T>
+Fusion::Quat<T> Fusion::MadgwickT<T>::getQuat() const{
+	return q_est;
 }
+
+template<typename T>
+glm::vec3 Fusion::MadgwickT<T>::getGravity() const{
+	auto g = F::QuatToGravity(q_est);
+	g.z = -g.z;
+	return g;
+}
+
+template class Fusion::MadgwickT<double>;
+template class Fusion::MadgwickT<float>;
+template class Fusion::MadgwickT<Fusion::Q20>;
@@ -5,20 +5,35 @@
 
 namespace Fusion {
 
-class Madgwick : public Filter {
+template<typename T>
+class MadgwickT : public FilterT<T> {
 public:
 
-	Orient update(IMU::Sample sample) override;
+	Orient update(const IMU::Sample& sample) override;
+	Orient update(const IMU::Sample* samples, size_t count) override;
 	Orient get() override;
+	void reset(const IMU::Sample& sample) override;
+	Quat<T> getQuat() const override;
+	glm::vec3 getGravity() const override;
 
 private:
-	Quat q_est = { 1, 0, 0, 0 };
+	using F = FilterT<T>;
+
+	void integrate(const IMU::Sample& sample);
+
+	Quat<T> q_est = { T(1), T(0), T(0), T(0) };
 
 	static constexpr double GyroMeanError = M_PI * (5.0/180.0);
-	static constexpr double Beta =  GyroMeanError * 0.8660254; // sqrt(3/4)
+	static constexpr T Beta = T(GyroMeanError * 0.8660254); // sqrt(3/4)
 
 };
 
+using Madgwick = MadgwickT<double>;
+
+extern template class MadgwickT<double>;
+extern template class MadgwickT<float>;
+extern template class MadgwickT<Q20>;
+
 }
 
 
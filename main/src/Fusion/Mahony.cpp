@@ -1,24 +1,44 @@
 #include "Mahony.h"
 #include <gtc/quaternion.hpp>
 
-Fusion::Orient Fusion::Mahony::update(IMU::Sample sample){
-	double ax = sample.accelX;
-	double ay = sample.accelY;
-	double az = sample.accelZ;
-	double gx = sample.gyroX;
-	double gy = sample.gyroY;
-	double gz = sample.gyroZ;
-
-	double recipNorm;
-	double halfvx, halfvy, halfvz;
-	double halfex, halfey, halfez;
-	double qa, qb, qc;
+template<typename T>
+Fusion::Orient Fusion::MahonyT<T>::update(const IMU::Sample& sample){
+	integrate(sample);
+	derotate();
+	return get();
+}
+
+template<typename T>
+Fusion::Orient Fusion::MahonyT<T>::update(const IMU::Sample* samples, size_t count){
+	for(size_t i = 0; i < count; i++){
+		integrate(samples[i]);
+	}
+
+	// Yaw doesn't feed back into the gravity error and a rotation about Z commutes with the integration,
+	// so dropping it once per batch ends up where dropping it every sample would
+	derotate();
+	return get();
+}
+
+template<typename T>
+inline void Fusion::MahonyT<T>::integrate(const IMU::Sample& sample){
+	T ax = T(sample.accelX);
+	T ay = T(sample.accelY);
+	T az = T(sample.accelZ);
+	T gx = T(sample.gyroX);
+	T gy = T(sample.gyroY);
+	T gz = T(sample.gyroZ);
+
+	T recipNorm;
+	T halfvx, halfvy, halfvz;
+	T halfex, halfey, halfez;
+	T qa, qb, qc;
 
 	// Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
-	if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+	if(!((ax == T(0)) && (ay == T(0)) && (az == T(0)))) {
 
 		// Normalise accelerometer measurement
-		recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+		recipNorm = F::invSqrt(ax * ax + ay * ay + az * az);
 		ax *= recipNorm;
 		ay *= recipNorm;
 		az *= recipNorm;
@@ -26,7 +46,7 @@ Fusion::Orient Fusion::Mahony::update(IMU::Sample sample){
 		// Estimated direction of gravity and vector perpendicular to magnetic flux
 		halfvx = q.q2 * q.q4 - q.q1 * q.q3;
 		halfvy = q.q1 * q.q2 + q.q3 * q.q4;
-		halfvz = q.q1 * q.q1 - 0.5f + q.q4 * q.q4;
+		halfvz = q.q1 * q.q1 - T(0.5f) + q.q4 * q.q4;
 
 		// Error is sum of cross product between estimated and measured direction of gravity
 		halfex = (ay * halfvz - az * halfvy);
@@ -34,18 +54,18 @@ Fusion::Orient Fusion::Mahony::update(IMU::Sample sample){
 		halfez = (ax * halfvy - ay * halfvx);
 
 		// Compute and apply integral feedback if enabled
-		if(twoKi > 0.0f) {
-			integralFBx += twoKi * halfex * DeltaT;	// integral error scaled by Ki
-			integralFBy += twoKi * halfey * DeltaT;
-			integralFBz += twoKi * halfez * DeltaT;
+		if(twoKi > T(0)) {
+			integralFBx += twoKi * halfex * F::DeltaT;	// integral error scaled by Ki
+			integralFBy += twoKi * halfey * F::DeltaT;
+			integralFBz += twoKi * halfez * F::DeltaT;
 			gx += integralFBx;	// apply integral feedback
 			gy += integralFBy;
 			gz += integralFBz;
 		}
 		else {
-			integralFBx = 0.0f;	// prevent integral windup
-			integralFBy = 0.0f;
-			integralFBz = 0.0f;
+			integralFBx = T(0);	// prevent integral windup
+			integralFBy = T(0);
+			integralFBz = T(0);
 		}
 
 		// Apply proportional feedback
@@ -55,9 +75,9 @@ Fusion::Orient Fusion::Mahony::update(IMU::Sample sample){
 	}
 
 	// Integrate rate of change of quaternion
-	gx *= (0.5f * DeltaT);		// pre-multiply common factors
-	gy *= (0.5f * DeltaT);
-	gz *= (0.5f * DeltaT);
+	gx *= (T(0.5f) * F::DeltaT);		// pre-multiply common factors
+	gy *= (T(0.5f) * F::DeltaT);
+	gz *= (T(0.5f) * F::DeltaT);
 	qa = q.q1;
 	qb = q.q2;
 	qc = q.q3;
@@ -67,46 +87,56 @@ Fusion::Orient Fusion::Mahony::update(IMU::Sample sample){
 	q.q4 += (qa * gz + qb * gy - qc * gx);
 
 	// Normalise quaternion
-	recipNorm = invSqrt(q.q1 * q.q1 + q.q2 * q.q2 + q.q3 * q.q3 + q.q4 * q.q4);
-	q.q1 *= recipNorm;
-	q.q2 *= recipNorm;
-	q.q3 *= recipNorm;
-	q.q4 *= recipNorm;
+	F::QuatNormalize(q);
+}
+
+template<typename T>
+void Fusion::MahonyT<T>::derotate(){
+	using R = Real<T>;
 
-	glm::dquat qConverted = { q.q1, q.q2, q.q3, q.q4 };
+	glm::qua<R> qConverted = { (R) q.q1, (R) q.q2, (R) q.q3, (R) q.q4 };
 	auto euler = glm::eulerAngles(qConverted);
-	glm::vec3 derotAngles = { 0, 0, -euler.z };
-	auto derot = glm::dquat{ derotAngles };
+	glm::vec<3, R> derotAngles = { 0, 0, -euler.z };
+	auto derot = glm::qua<R>{ derotAngles };
 	qConverted = derot * qConverted;
 	qConverted = glm::normalize(qConverted);
-	q.q1 = qConverted.w;
-	q.q2 = qConverted.x;
-	q.q3 = qConverted.y;
-	q.q4 = qConverted.z;
-
-	return get();
+	q.q1 = T(qConverted.w);
+	q.q2 = T(qConverted.x);
+	q.q3 = T(qConverted.y);
+	q.q4 = T(qConverted.z);
 }
 
-Fusion::Orient Fusion::Mahony::get(){
+template<typename T>
+Fusion::Orient Fusion::MahonyT<T>::get(){
+	using R = Real<T>;
 
-	glm::dquat glmQuat = { q.q1, q.q2, q.q3, q.q4 };
+	glm::qua<R> glmQuat = { (R) q.q1, (R) q.q2, (R) q.q3, (R) q.q4 };
 	auto final = glm::eulerAngles(glmQuat);
 
-	auto pitch = glm::degrees(M_PI - final.x);
-	if(pitch > 180){
-		pitch -= 360;
+	auto pitch = glm::degrees(R(M_PI) - final.x);
+	if(pitch > R(180)){
+		pitch -= R(360);
 	}
 
-	return { pitch, glm::degrees(final.z), glm::degrees(final.y) };
+	return { (float) pitch, (float) glm::degrees(final.z), (float) glm::degrees(final.y) };
 }
 
-// TODO: IRAM_ATTR also adds __attribute__, check if both are applied
-double IRAM_ATTR __attribute__((optimize("O0"))) Fusion::Mahony::invSqrt(double x){
-	double halfx = 0.5 * x;
-	volatile float y = x;
-	long i = *(long*)&y;
-	i = 0x5f3759df - (i>>1);
-	y = *(float*)&i;
-	y = y * (1.5f - (halfx * y * y));
-	return y;
+template<typename T>
+void Fusion::MahonyT<T>::reset(const IMU::Sample& sample){
+	q = F::GravityToQuat({ sample.accelX, sample.accelY, sample.accelZ });
+	integralFBx = integralFBy = integralFBz = T(0);
 }
+
+template<typename T>
+Fusion::Quat<T> Fusion::MahonyT<T>::getQuat() const{
+	return q;
+}
+
+template<typename T>
+glm::vec3 Fusion::MahonyT<T>::getGravity() const{
+	return F::QuatToGravity(q);
+}
+
+template class Fusion::MahonyT<double>;
+template class Fusion::MahonyT<float>;
+template class Fusion::MahonyT<Fusion::Q20>;
@@ -5,26 +5,42 @@
 
 namespace Fusion {
 
-class Mahony : public Filter {
+template<typename T>
+class MahonyT : public FilterT<T> {
 public:
 
-	Orient update(IMU::Sample sample) override;
+	Orient update(const IMU::Sample& sample) override;
+	Orient update(const IMU::Sample* samples, size_t count) override;
 	Orient get() override;
+	void reset(const IMU::Sample& sample) override;
+	Quat<T> getQuat() const override;
+	glm::vec3 getGravity() const override;
 
 private:
-	static constexpr double twoKpDef = (2.0f * 0.5f); // 2 * proportional gain
-	static constexpr double twoKiDef = (2.0f * 0.0f); // 2 * integral gain
+	using F = FilterT<T>;
 
-	Quat q = { 1, 0, 0, 0 };
+	void integrate(const IMU::Sample& sample);
 
-	double twoKp = twoKpDef;
-	double twoKi = twoKiDef;
-	double integralFBx = 0.0f,  integralFBy = 0.0f, integralFBz = 0.0f;
+	/** Removes the yaw component, this filter only tracks gravity. */
+	void derotate();
 
-	static double invSqrt(double x);
+	static constexpr T twoKpDef = T(2.0f * 0.5f); // 2 * proportional gain
+	static constexpr T twoKiDef = T(2.0f * 0.0f); // 2 * integral gain
+
+	Quat<T> q = { T(1), T(0), T(0), T(0) };
+
+	T twoKp = twoKpDef;
+	T twoKi = twoKiDef;
+	T integralFBx = T(0),  integralFBy = T(0), integralFBz = T(0);
 
 };
 
+using Mahony = MahonyT<double>;
+
+extern template class MahonyT<double>;
+extern template class MahonyT<float>;
+extern template class MahonyT<Q20>;
+
 }
 
 
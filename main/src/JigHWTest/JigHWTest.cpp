@@ -1,6 +1,7 @@
 #include "JigHWTest.h"
 #include "SPIFFSChecksum.hpp"
 #include <Pins.hpp>
+#include <PWMChannels.hpp>
 #include <soc/efuse_reg.h>
 #include <esp_efuse.h>
 #include <ctime>
@@ -14,6 +15,13 @@
 #include "Drivers/lsm6ds3tr-c_reg.h"
 #include "Util/EfuseMeta.h"
 #include <Services/ChirpSystem.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <array>
+#include <algorithm>
 
 
 JigHWTest* JigHWTest::test = nullptr;
@@ -23,6 +31,11 @@ LGFX_Sprite* JigHWTest::canvas = nullptr;
 I2C* JigHWTest::i2c = nullptr;
 RTC* JigHWTest::rtc = nullptr;
 Input* JigHWTest::input = nullptr;
+thread_local const char* JigHWTest::currentTest = nullptr;
+
+// Shared with the lane tasks. Never freed, a lane abandoned after a timeout may still report when its test returns.
+static QueueHandle_t laneReports = nullptr;
+static std::atomic_bool laneAbort = false;
 
 
 JigHWTest::JigHWTest(){
@@ -38,16 +51,17 @@ JigHWTest::JigHWTest(){
 
 	test = this;
 
-	tests.push_back({ JigHWTest::RTCTest, "RTC", [](){}});
-	tests.push_back({ JigHWTest::Time1, "RTC crystal", [](){}});
-	tests.push_back({ JigHWTest::Time2, "RTC crystal", [](){}});
-	tests.push_back({ JigHWTest::IMUTest, "Gyroscope", [](){}});
-	tests.push_back({ JigHWTest::IMUInterruptTest, "Gyro interrupt", [](){}});
-	tests.push_back({ JigHWTest::SPIFFSTest, "SPIFFS", [](){}});
-	tests.push_back({ JigHWTest::BatteryCheck, "Battery check", [](){}});
-	tests.push_back({ JigHWTest::VoltReferenceCheck, "Voltage ref", [](){ gpio_set_level((gpio_num_t) Pins::get(Pin::BattVref), 0); }});
-//	tests.push_back({ JigHWTest::buttons, "Buttons", [](){}});
-	tests.push_back({ JigHWTest::HWVersion, "HW rev", [](){}});
+	// The RTC drift wait overlaps the IMU, SPIFFS and ADC tests. Fusing the HW version comes last, only on a unit that passed.
+	tests.push_back({ JigHWTest::RTCTest, "RTC", [](){}, RTCLane, 1000 });
+	tests.push_back({ JigHWTest::Time1, "RTC crystal", [](){}, RTCLane, 4000 });
+	tests.push_back({ JigHWTest::Time2, "RTC crystal", [](){}, RTCLane, 8000 });
+	tests.push_back({ JigHWTest::IMUTest, "Gyroscope", [](){}, IMULane, 1000 });
+	tests.push_back({ JigHWTest::IMUInterruptTest, "Gyro interrupt", [](){}, IMULane, 1000 });
+	tests.push_back({ JigHWTest::SPIFFSTest, "SPIFFS", [](){}, FSLane, 20000 });
+	tests.push_back({ JigHWTest::BatteryCheck, "Battery check", [](){}, ADCLane, 3000 });
+	tests.push_back({ JigHWTest::VoltReferenceCheck, "Voltage ref", [](){ gpio_set_level((gpio_num_t) Pins::get(Pin::BattVref), 0); }, ADCLane, 3000 });
+//	tests.push_back({ JigHWTest::buttons, "Buttons", [](){}, FinalLane, 30000 });
+	tests.push_back({ JigHWTest::HWVersion, "HW rev", [](){}, FinalLane, 2000 });
 }
 
 bool JigHWTest::checkJig(){
@@ -108,42 +122,34 @@ void JigHWTest::start(){
 
 	canvas->pushSprite(0, 0);
 
+	// One row per test, results are filled in as tests finish in any order
 	canvas->setCursor(0, 16);
-
-	bool pass = true;
+	canvas->setTextColor(TFT_WHITE);
+	rows.clear();
 	for(const Test& test : tests){
-		currentTest = test.name;
-
-		canvas->setTextColor(TFT_WHITE);
 		canvas->printf("%s: ", test.name);
-		canvas->pushSprite(0, 0);
-
-
-		printf("TEST:startTest:%s\n", currentTest);
-
-		bool result = test.test();
-
-		canvas->setTextColor(result ? TFT_SILVER : TFT_ORANGE);
-		canvas->printf("%s\n", result ? "PASS" : "FAIL");
-		canvas->pushSprite(0, 0);
-
-		printf("TEST:endTest:%s\n", result ? "pass" : "fail");
+		rows.push_back({ canvas->getCursorX(), canvas->getCursorY() });
+		canvas->println();
+	}
+	const int32_t resultY = canvas->getCursorY();
+	canvas->pushSprite(0, 0);
 
-		if(!(pass &= result)){
-			if(test.onFail){
-				test.onFail();
-			}
+	const uint64_t startTime = esp_timer_get_time();
 
-			break;
-		}
+	const Test* failed = runLanes();
+	if(failed == nullptr){
+		failed = runFinal();
 	}
+	const bool pass = failed == nullptr;
 
+	printf("TEST:time:%llu\n", (esp_timer_get_time() - startTime) / 1000);
 	if(pass){
 		printf("TEST:passall\n");
 	}else{
-		printf("TEST:fail:%s\n", currentTest);
+		printf("TEST:fail:%s\n", failed->name);
 	}
 
+	canvas->setCursor(0, resultY);
 
 	//------------------------------------------------------
 	canvas->print("\n");
@@ -157,7 +163,7 @@ void JigHWTest::start(){
 	const uint16_t note = 1047 + ((rand() * 20) % 400) - 200; //NOTE_C6 = 1047
 
 
-	auto buzzPwm = new PWM(Pins::get(Pin::Buzz), LEDC_CHANNEL_0);
+	auto buzzPwm = new PWM(Pins::get(Pin::Buzz), PWMChannels::get(PWMUser::Buzzer));
 	auto audio = new ChirpSystem(*buzzPwm);
 
 
@@ -213,6 +219,153 @@ void JigHWTest::start(){
 	}
 }
 
+const Test* JigHWTest::runLanes(){
+	// Filled completely before any lane starts, the tasks keep pointers into it
+	lanes.clear();
+	std::vector<uint8_t> laneOf(tests.size(), UINT8_MAX);
+	for(uint8_t i = 0; i < tests.size(); i++){
+		if(tests[i].lane == FinalLane) continue;
+
+		auto lane = std::find_if(lanes.begin(), lanes.end(), [this, i](const LaneRun& run){ return tests[run.tests.front()].lane == tests[i].lane; });
+		if(lane == lanes.end()){
+			lanes.push_back(LaneRun{ {}, (uint8_t) lanes.size() });
+			lane = lanes.end() - 1;
+		}
+		lane->tests.push_back(i);
+		laneOf[i] = lane->index;
+	}
+
+	laneReports = xQueueCreate(tests.size() * 2 + lanes.size(), sizeof(Report));
+	laneAbort = false;
+	for(auto& lane : lanes){
+		xTaskCreate(runLane, "JigLane", 6144, &lane, 5, nullptr);
+	}
+
+	std::vector<uint64_t> started(tests.size(), 0); // [us], 0 while not running
+	std::vector<bool> abandoned(lanes.size(), false);
+	size_t running = lanes.size();
+	const Test* failed = nullptr;
+
+	while(running > 0){
+		// Wake up for the earliest deadline of the running tests
+		int timing = -1;
+		uint64_t deadline = UINT64_MAX;
+		for(uint8_t i = 0; i < tests.size(); i++){
+			if(started[i] == 0) continue;
+			const uint64_t end = started[i] + tests[i].timeout * 1000ULL;
+			if(end < deadline){
+				deadline = end;
+				timing = i;
+			}
+		}
+
+		TickType_t wait = portMAX_DELAY;
+		if(timing >= 0){
+			const uint64_t now = esp_timer_get_time();
+			wait = deadline > now ? pdMS_TO_TICKS((deadline - now + 999) / 1000) : 0;
+		}
+
+		Report report{};
+		if(xQueueReceive(laneReports, &report, wait) != pdTRUE){
+			if(timing < 0) continue;
+
+			// The test can't be interrupted, its lane is left to finish on its own and ignored
+			currentTest = tests[timing].name;
+			log("timeout", tests[timing].timeout);
+			started[timing] = 0;
+			abandoned[laneOf[timing]] = true;
+			running--;
+
+			finish(timing, false, tests[timing].timeout);
+			if(failed == nullptr) failed = &tests[timing];
+			laneAbort = true;
+			continue;
+		}
+
+		const uint8_t lane = report.type == Report::LaneEnd ? report.index : laneOf[report.index];
+		if(abandoned[lane]) continue;
+
+		if(report.type == Report::LaneEnd){
+			running--;
+		}else if(report.type == Report::Start){
+			started[report.index] = report.time;
+			printf("TEST:startTest:%s\n", tests[report.index].name);
+		}else{
+			started[report.index] = 0;
+			finish(report.index, report.pass, report.time / 1000);
+
+			if(!report.pass){
+				if(failed == nullptr) failed = &tests[report.index];
+				laneAbort = true;
+			}
+		}
+	}
+
+	return failed;
+}
+
+const Test* JigHWTest::runFinal(){
+	for(uint8_t i = 0; i < tests.size(); i++){
+		const Test& test = tests[i];
+		if(test.lane != FinalLane) continue;
+
+		currentTest = test.name;
+		printf("TEST:startTest:%s\n", test.name);
+
+		// Whatever the test prints goes on its own row, behind where the result comes
+		canvas->setCursor(rows[i].x + canvas->textWidth("PASS "), rows[i].y);
+
+		const uint64_t start = esp_timer_get_time();
+		const bool pass = test.test();
+		finish(i, pass, (esp_timer_get_time() - start) / 1000);
+
+		if(!pass) return &test;
+	}
+
+	return nullptr;
+}
+
+void JigHWTest::runLane(void* arg){
+	auto lane = (LaneRun*) arg;
+
+	for(const auto index : lane->tests){
+		if(laneAbort) break;
+
+		const Test& t = test->tests[index];
+		currentTest = t.name;
+
+		const uint64_t start = esp_timer_get_time();
+		Report report = { Report::Start, index, false, start };
+		xQueueSend(laneReports, &report, portMAX_DELAY);
+
+		const bool pass = t.test();
+
+		report = { Report::End, index, pass, esp_timer_get_time() - start };
+		xQueueSend(laneReports, &report, portMAX_DELAY);
+
+		// Later tests in a lane rely on the earlier ones
+		if(!pass) break;
+	}
+
+	const Report report = { Report::LaneEnd, lane->index, false, 0 };
+	xQueueSend(laneReports, &report, portMAX_DELAY);
+	vTaskDelete(nullptr);
+}
+
+void JigHWTest::finish(uint8_t index, bool pass, uint32_t time){
+	const Test& test = tests[index];
+	printf("TEST:endTest:%s:%s:%lu\n", pass ? "pass" : "fail", test.name, time);
+
+	canvas->setCursor(rows[index].x, rows[index].y);
+	canvas->setTextColor(pass ? TFT_SILVER : TFT_ORANGE);
+	canvas->printf("%s", pass ? "PASS" : "FAIL");
+	canvas->pushSprite(0, 0);
+
+	if(!pass && test.onFail){
+		test.onFail();
+	}
+}
+
 void JigHWTest::log(const char* property, const char* value){
 	printf("%s:%s:%s\n", currentTest, property, value);
 }
@@ -362,40 +515,121 @@ bool JigHWTest::SPIFFSTest(){
 		return false;
 	}
 
-	for(const auto& f : SPIFFSChecksums){
-		auto file = fopen(f.name, "rb");
-		if(file == nullptr){
+	// Files are handed out to one worker per core, so one checksums while the other waits on flash
+	static constexpr size_t FileCount = sizeof(SPIFFSChecksums) / sizeof(SPIFFSChecksums[0]);
+	struct Work {
+		std::atomic_size_t next = 0;
+		std::array<Checksum, FileCount> results;
+		SemaphoreHandle_t done;
+	} work;
+	work.done = xSemaphoreCreateCounting(ChecksumWorkers, 0);
+
+	const auto worker = [](void* arg){
+		auto work = (Work*) arg;
+		auto buf = (uint8_t*) heap_caps_malloc(ChecksumReadSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_32BIT);
+
+		size_t i;
+		while(buf && (i = work->next++) < FileCount){
+			work->results[i] = calcChecksum(SPIFFSChecksums[i].name, buf);
+		}
+
+		heap_caps_free(buf);
+		xSemaphoreGive(work->done);
+		vTaskDelete(nullptr);
+	};
+
+	const uint64_t start = esp_timer_get_time();
+	uint8_t started = 0;
+	for(uint8_t core = 0; core < ChecksumWorkers; core++){
+		started += xTaskCreatePinnedToCore(worker, "Checksum", 3072, &work, 5, nullptr, core) == pdPASS;
+	}
+	for(uint8_t i = 0; i < started; i++){
+		xSemaphoreTake(work.done, portMAX_DELAY);
+	}
+	const uint64_t elapsed = esp_timer_get_time() - start;
+	vSemaphoreDelete(work.done);
+
+	if(started == 0 || work.next < FileCount){
+		test->log("workers", (uint32_t) started);
+		return false;
+	}
+
+	size_t total = 0;
+	for(size_t i = 0; i < FileCount; i++){
+		const auto& f = SPIFFSChecksums[i];
+		const auto& result = work.results[i];
+
+		if(!result.found){
 			test->log("missing", f.name);
 			return false;
 		}
 
-		uint32_t sum = calcChecksum(file);
-		fclose(file);
+		char speed[48];
+		snprintf(speed, sizeof(speed), "%zu B, %llu us, %llu kB/s", result.size, result.time, result.time ? result.size * 1000ULL / result.time : 0);
+		test->log(f.name, speed);
+		total += result.size;
 
-		if(sum != f.sum){
+		if(result.sum != f.sum){
 			test->log("file", f.name);
 			test->log("expected", (uint32_t) f.sum);
-			test->log("got", (uint32_t) sum);
+			test->log("got", (uint32_t) result.sum);
 
 			return false;
 		}
 	}
 
+	char speed[48];
+	snprintf(speed, sizeof(speed), "%zu B, %llu us, %llu kB/s", total, elapsed, elapsed ? total * 1000ULL / elapsed : 0);
+	test->log("total", speed);
+
 	return true;
 }
 
-uint32_t JigHWTest::calcChecksum(FILE* file){
-	if(file == nullptr) return 0;
+JigHWTest::Checksum JigHWTest::calcChecksum(const char* path, uint8_t* buf){
+	Checksum result;
+	const uint64_t start = esp_timer_get_time();
+
+	// Straight to the VFS, stdio would copy everything through its own small buffer first
+	const int fd = open(path, O_RDONLY);
+	if(fd < 0) return result;
+	result.found = true;
 
-#define READ_SIZE 512
+	ssize_t read;
+	while((read = ::read(fd, buf, ChecksumReadSize)) > 0){
+		result.sum += byteSum(buf, read);
+		result.size += read;
+	}
+	close(fd);
+
+	result.time = esp_timer_get_time() - start;
+	return result;
+}
 
+uint32_t JigHWTest::byteSum(const uint8_t* data, size_t size){
 	uint32_t sum = 0;
-	uint8_t b[READ_SIZE];
-	size_t read = 0;
-	while((read = fread(b, 1, READ_SIZE, file))){
-		for(int i = 0; i < read; i++){
-			sum += b[i];
+	for(; size > 0 && ((uintptr_t) data & 3); size--){
+		sum += *data++;
+	}
+
+	// Word at a time, the four bytes are added pairwise into two 16-bit lanes.
+	// A lane grows by at most 2 * 255 per word, so it's emptied every 128 words before it can overflow.
+	auto words = (const uint32_t*) data;
+	for(size_t count = size / 4; count > 0;){
+		const size_t batch = std::min<size_t>(count, 128);
+		uint32_t lanes = 0;
+		for(size_t i = 0; i < batch; i++){
+			const uint32_t w = words[i];
+			lanes += (w & 0x00ff00ff) + ((w >> 8) & 0x00ff00ff);
 		}
+		sum += (lanes & 0xffff) + (lanes >> 16);
+
+		words += batch;
+		count -= batch;
+	}
+
+	data = (const uint8_t*) words;
+	for(size = size & 3; size > 0; size--){
+		sum += *data++;
 	}
 
 	return sum;
@@ -451,7 +685,6 @@ bool JigHWTest::Time2(){
 		if(diff > 1){
 			test->log("reading", i);
 			test->log("diff", diff);
-			JigHWTest::canvas->printf("diff: %.2f", diff);
 			return false;
 		}
 
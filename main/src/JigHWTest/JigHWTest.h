@@ -16,6 +16,8 @@ struct Test {
 	bool (* test)();
 	const char* name;
 	void (* onFail)();
+	uint8_t lane; // Tests in a lane run in order, separate lanes run at the same time
+	uint32_t timeout; // [ms]
 };
 
 class JigHWTest {
@@ -34,7 +36,36 @@ private:
 	static JigHWTest* test;
 	static Input* input;
 	std::vector<Test> tests;
-	const char* currentTest;
+	static thread_local const char* currentTest;
+
+	enum Lane : uint8_t {
+		RTCLane, IMULane, FSLane, ADCLane,
+		FinalLane = UINT8_MAX // Runs alone once all other lanes passed
+	};
+
+	struct Report {
+		enum : uint8_t { Start, End, LaneEnd } type;
+		uint8_t index; // Test, or lane for LaneEnd
+		bool pass;
+		uint64_t time; // [us] Start: started at, End: duration
+	};
+
+	struct LaneRun {
+		std::vector<uint8_t> tests;
+		uint8_t index;
+	};
+	std::vector<LaneRun> lanes; // A lane left running after a timeout still reads its entry, they're never freed
+
+	struct Row {
+		int32_t x, y; // [px] where the test's result is printed
+	};
+	std::vector<Row> rows;
+
+	/** Runs all lanes but the final one concurrently, returns the first test that failed or timed out */
+	const Test* runLanes();
+	const Test* runFinal();
+	static void runLane(void* arg);
+	void finish(uint8_t index, bool pass, uint32_t time);
 
 	void log(const char* property, const char* value);
 	void log(const char* property, float value);
@@ -47,7 +78,15 @@ private:
 	static bool BatteryCheck();
 	static bool VoltReferenceCheck();
 	static bool SPIFFSTest();
-	static uint32_t calcChecksum(FILE* file);
+	struct Checksum {
+		uint32_t sum = 0;
+		size_t size = 0; // [B]
+		uint64_t time = 0; // [us]
+		bool found = false;
+	};
+	/** Sum of all bytes in the file, matching SPIFFSChecksums, read through buf of ChecksumReadSize */
+	static Checksum calcChecksum(const char* path, uint8_t* buf);
+	static uint32_t byteSum(const uint8_t* data, size_t size);
 	static bool RTCTest();
 	static bool Time1();
 	static bool Time2();
@@ -64,6 +103,9 @@ private:
 
 	static constexpr uint32_t CheckTimeout = 500;
 
+	static constexpr size_t ChecksumReadSize = 4096; // [B] one SPIFFS block
+	static constexpr uint8_t ChecksumWorkers = 2; // One per core
+
 	static constexpr esp_vfs_spiffs_conf_t spiffsConfig = {
 			.base_path = "/spiffs",
 			.partition_label = "storage",
@@ -0,0 +1,28 @@
+#include "AssetPrefetch.h"
+#include "FSLVGL.h"
+
+AssetPrefetch* AssetPrefetch::instance = nullptr;
+
+AssetPrefetch::AssetPrefetch() : Threaded("AssetPrefetch", 3072, PlannedTask::AssetPrefetch), queue(1){
+	instance = this;
+	start();
+}
+
+AssetPrefetch* AssetPrefetch::getInstance(){
+	return instance;
+}
+
+void AssetPrefetch::request(const LVScreen::AssetList& assets){
+	const LVScreen::AssetList* list = &assets;
+	queue.reset();
+	queue.post(list, 0);
+}
+
+void AssetPrefetch::loop(){
+	const LVScreen::AssetList* list;
+	if(!queue.get(list, portMAX_DELAY)) return;
+
+	for(size_t i = 0; i < list->count; i++){
+		FSLVGL::prefetch(list->paths[i]);
+	}
+}
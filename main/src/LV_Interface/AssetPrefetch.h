@@ -0,0 +1,32 @@
+#ifndef CLOCKSTAR_FIRMWARE_ASSETPREFETCH_H
+#define CLOCKSTAR_FIRMWARE_ASSETPREFETCH_H
+
+#include "LVScreen.h"
+#include "Util/Threaded.h"
+#include "Util/Queue.h"
+
+/**
+ * Warms the FSLVGL cache with a screen's assets on a low-priority task on core 0,
+ * so the screen doesn't stall on file reads during its first frames. Pays off for files that have to be read from
+ * SPIFFS or decoded, see FSLVGL::prefetch: asset overrides pushed from the phone, and every asset with CM_ASSETS_COMPRESS.
+ */
+class AssetPrefetch : private Threaded {
+public:
+	AssetPrefetch();
+
+	/** Queues the list for loading, replacing any list that's still waiting. */
+	void request(const LVScreen::AssetList& assets);
+
+	static AssetPrefetch* getInstance();
+
+protected:
+	void loop() override;
+
+private:
+	Queue<const LVScreen::AssetList*> queue;
+	static AssetPrefetch* instance;
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_ASSETPREFETCH_H
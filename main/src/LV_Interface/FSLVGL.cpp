@@ -1,12 +1,20 @@
 #include "FSLVGL.h"
 #include <cstdio>
+#include <cstring>
 #include <dirent.h>
+#include <sys/stat.h>
 #include <esp_spiffs.h>
 #include <esp_log.h>
 #include <string>
-#include <algorithm>
 #include <unordered_map>
-
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "Util/stdafx.h"
+#include "Util/ReadAheadFile.h"
+#include "Util/PSRAM.h"
+#include "Util/LoopGuard.h"
+
+/** The first BootCachedCount files are what LockScreen needs for its first frame, loadCache() waits only for those. */
 static const char* Cached[] = {
 	"/bg.bin",
 	"/bg_bot.bin",
@@ -17,6 +25,22 @@ static const char* Cached[] = {
 	"/icons/phone.bin",
 	"/icons/phoneDisconnected.bin",
 
+	"/clockIcons/0.bin",
+	"/clockIcons/1.bin",
+	"/clockIcons/2.bin",
+	"/clockIcons/3.bin",
+	"/clockIcons/4.bin",
+	"/clockIcons/5.bin",
+	"/clockIcons/6.bin",
+	"/clockIcons/7.bin",
+	"/clockIcons/8.bin",
+	"/clockIcons/9.bin",
+	"/clockIcons/colon.bin",
+	"/clockIcons/space.bin",
+
+	"/icon/lock_closed.bin",
+	"/icon/lock_open.bin",
+
 	"/icon/app_inst.bin",
 	"/icon/app_mess.bin",
 	"/icon/app_sms.bin",
@@ -36,33 +60,75 @@ static const char* Cached[] = {
 	"/icon/cat_sched.bin",
 	"/icon/cat_soc.bin",
 	"/icon/etc.bin",
-	"/icon/lock_closed.bin",
-	"/icon/lock_open.bin",
 	"/icon/trash.bin",
 	"/icon/trash_sel.bin",
 	"/icon/back.bin",
-	"/icon/back_sel.bin",
-
-	"/clockIcons/0.bin",
-	"/clockIcons/1.bin",
-	"/clockIcons/2.bin",
-	"/clockIcons/3.bin",
-	"/clockIcons/4.bin",
-	"/clockIcons/5.bin",
-	"/clockIcons/6.bin",
-	"/clockIcons/7.bin",
-	"/clockIcons/8.bin",
-	"/clockIcons/9.bin",
-	"/clockIcons/colon.bin",
-	"/clockIcons/space.bin"
+	"/icon/back_sel.bin"
 
 };
+static constexpr size_t CachedCount = sizeof(Cached) / sizeof(Cached[0]);
+static constexpr size_t BootCachedCount = 21;
 
 const char* TAG = "FSLVGL";
-std::unordered_set<FSLVGL::FileResource, std::hash<RamFile*>> FSLVGL::cache;
+std::unordered_map<uint32_t, FSLVGL::FileResource> FSLVGL::cache;
+std::unordered_map<const void*, uint32_t> FSLVGL::handles;
+std::mutex FSLVGL::mut;
+AssetBundle* FSLVGL::bundle = nullptr;
+std::unordered_set<uint32_t> FSLVGL::overrides;
+std::vector<std::string> FSLVGL::overridePaths;
+std::mutex FSLVGL::overrideMut;
+FSLVGL::Stats FSLVGL::stats = { 0, 0, 0, 0, FSLVGL::Budget, 0, 0, 0, 0 };
+uint32_t FSLVGL::useCounter = 0;
+std::atomic<size_t> FSLVGL::loadNext = 0;
+std::atomic<size_t> FSLVGL::loadDone = 0;
+std::atomic<size_t> FSLVGL::bootDone = 0;
+SemaphoreHandle_t FSLVGL::bootReady = nullptr;
+
+bool FSLVGL::mounted = false;
+char FSLVGL::driveLetter = 0;
 
 FSLVGL::FSLVGL(char letter){
-	cache.reserve(sizeof(Cached) / sizeof(Cached[0]) + 16);
+	if(!mounted && !mount()) return;
+
+	lv_fs_drv_init(&drv);                     /*Basic initialization*/
+
+	drv.letter = letter;                         /*An uppercase letter to identify the drive */
+	drv.ready_cb = ready_cb;               /*Callback to tell if the drive is ready to use */
+	drv.open_cb = open_cb;                 /*Callback to open a file */
+	drv.close_cb = close_cb;               /*Callback to close a file */
+	drv.read_cb = read_cb;                 /*Callback to read a file */
+	drv.write_cb = write_cb;               /*Callback to write a file */
+	drv.seek_cb = seek_cb;                 /*Callback to seek in a file (Move cursor) */
+	drv.tell_cb = tell_cb;                 /*Callback to tell the cursor position  */
+
+	drv.dir_open_cb = dir_open_cb;         /*Callback to open directory to read its content */
+	drv.dir_read_cb = dir_read_cb;         /*Callback to read a directory's content */
+	drv.dir_close_cb = dir_close_cb;       /*Callback to close a directory */
+
+	drv.user_data = this;             /*Any custom data if required*/
+
+	lv_fs_drv_register(&drv);                 /*Finally register the drive*/
+	driveLetter = letter;
+}
+
+bool FSLVGL::mount(){
+	cache.reserve(CachedCount + 16);
+	handles.reserve(CachedCount + 16);
+
+	if(bundle == nullptr){
+		bundle = new AssetBundle();
+	}
+
+	if(ExternalBudget > 0 && PSRAM::available()){
+		stats.externalBudget = ExternalBudget;
+		ESP_LOGI(TAG, "Caching files from %zu B in PSRAM, %zu B free", ExternalMin, PSRAM::getFree());
+	}
+
+#ifdef CONFIG_CM_OTA
+	// The OTA layout has no room for SPIFFS next to two app slots, every file comes from the bundle
+	mounted = true;
+	return true;
+#endif
 
 	esp_vfs_spiffs_conf_t conf = {
 			.base_path = "/spiffs",
@@ -81,94 +147,397 @@ FSLVGL::FSLVGL(char letter){
 			ESP_LOGE(TAG, "Failed to initialize SPIFFS (%s)", esp_err_to_name(ret));
 		}
 
-		return;
+		return false;
 	}
 
+	loadOverrides();
+	mounted = true;
+	return true;
+}
 
-	lv_fs_drv_init(&drv);                     /*Basic initialization*/
+FSLVGL::~FSLVGL(){
+#ifndef CONFIG_CM_OTA
+	esp_vfs_spiffs_unregister("storage");
+#endif
+	mounted = false;
+	delete bundle;
+	bundle = nullptr;
+}
 
-	drv.letter = letter;                         /*An uppercase letter to identify the drive */
-	drv.ready_cb = ready_cb;               /*Callback to tell if the drive is ready to use */
-	drv.open_cb = open_cb;                 /*Callback to open a file */
-	drv.close_cb = close_cb;               /*Callback to close a file */
-	drv.read_cb = read_cb;                 /*Callback to read a file */
-	drv.write_cb = write_cb;               /*Callback to write a file */
-	drv.seek_cb = seek_cb;                 /*Callback to seek in a file (Move cursor) */
-	drv.tell_cb = tell_cb;                 /*Callback to tell the cursor position  */
+const char* FSLVGL::stripDrive(const char* path){
+	if(path[0] != 0 && path[1] == DriveSeparator){
+		return path + 2;
+	}
+	return path;
+}
 
-	drv.dir_open_cb = dir_open_cb;         /*Callback to open directory to read its content */
-	drv.dir_read_cb = dir_read_cb;         /*Callback to read a directory's content */
-	drv.dir_close_cb = dir_close_cb;       /*Callback to close a directory */
+FSLVGL::FileResource* FSLVGL::findCache(const char* path){
+	auto it = cache.find(AssetBundle::hashPath(path));
+	if(it == cache.end()) return nullptr;
 
-	drv.user_data = this;             /*Any custom data if required*/
+	// Guard against hash collisions; RamFile paths are prefixed with "/spiffs"
+	const auto& ramPath = it->second.ramFile->path();
+	if(ramPath.size() <= 7 || strcmp(ramPath.c_str() + 7, path) != 0) return nullptr;
 
-	lv_fs_drv_register(&drv);                 /*Finally register the drive*/
+	return &it->second;
 }
 
-FSLVGL::~FSLVGL(){
-	esp_vfs_spiffs_unregister("storage");
+FSLVGL::FileResource* FSLVGL::findCache(const void* ptr){
+	auto it = handles.find(ptr);
+	if(it == handles.end()) return nullptr;
+
+	return &cache.at(it->second);
 }
 
-auto FSLVGL::findCache(const std::string& lvPath){
-	std::string path("/spiffs");
-	path.append(lvPath);
+size_t FSLVGL::ramSizeOf(const char* spath, const AssetBundle::Asset& asset){
+	if(asset.compressed()) return asset.rawSize;
+	if(asset.data) return 0;
 
-	return std::find_if(cache.begin(), cache.end(), [&path](auto fileResource){
-		return fileResource.ramFile->path() == path;
-	});
+	struct stat st;
+	if(stat(spath, &st) != 0) return 0;
+	return st.st_size;
 }
 
-auto FSLVGL::findCache(void* ptr){
-	return std::find_if(cache.begin(), cache.end(), [ptr](auto fileResource){
-		return fileResource.ramFile == ptr;
-	});
+bool FSLVGL::isExternal(size_t ramSize, bool use32bAligned){
+	return stats.externalBudget > 0 && !use32bAligned && ramSize >= ExternalMin;
 }
 
-void FSLVGL::addToCache(const char* path, bool use32bAligned){
-	std::string p;
-	if(strchr(path, DriveSeparator) != nullptr){
-		p = std::string(path + 2);
-	}else{
-		p = path;
+size_t& FSLVGL::tierUsed(bool external){
+	return external ? stats.externalUsed : stats.used;
+}
+
+size_t FSLVGL::tierBudget(bool external){
+	return external ? stats.externalBudget : Budget;
+}
+
+RamFile* FSLVGL::loadFile(const char* spath, const AssetBundle::Asset& asset, bool use32bAligned, bool external){
+	if(asset.data && !asset.compressed()){
+		return new RamFile(spath, asset.data, asset.size);
+	}else if(asset.data){
+		// Compressed bundle entries are decoded into RAM, same as files copied from SPIFFS
+		return new RamFile(spath, asset.data, asset.size, asset.rawSize, use32bAligned, external);
 	}
+	return new RamFile(spath, use32bAligned, external);
+}
 
-	auto found = findCache(p);
-	if(found != cache.end()){
-		found->deleteFlag = false;
-		return;
+FSLVGL::FileResource* FSLVGL::insertLoaded(const char* path, RamFile* ram, size_t ramSize, bool pinned, bool external){
+	const auto hash = AssetBundle::hashPath(path);
+	if(cache.count(hash)){
+		ESP_LOGE(TAG, "Path hash collision, not caching %s", path);
+		delete ram;
+		return nullptr;
+	}
+
+	auto& used = tierUsed(external);
+	if(pinned && ramSize > 0 && used + ramSize > tierBudget(external)){
+		ESP_LOGW(TAG, "Pinned %s over %s budget (%zu + %zu B > %zu B)", path, external ? "PSRAM" : "RAM", used, ramSize, tierBudget(external));
 	}
+	used += ramSize;
 
+	auto it = cache.insert({ hash, { ram, false, pinned, 0, ++useCounter, ramSize, external } }).first;
+	handles.insert({ ram, hash });
+	return &it->second;
+}
+
+FSLVGL::FileResource* FSLVGL::insertCache(const char* path, bool use32bAligned, bool pinned){
 	std::string spath("/spiffs");
-	spath.append(p);
+	spath.append(path);
+
+	const auto asset = getAsset(path);
+	const size_t ramSize = ramSizeOf(spath.c_str(), asset);
+	if(asset.data == nullptr && ramSize == 0) return nullptr;
+
+	const bool external = isExternal(ramSize, use32bAligned);
+	if(ramSize > 0){
+		if(!pinned && ramSize > tierBudget(external)) return nullptr;
+		if(!evict(ramSize, external) && !pinned) return nullptr;
+	}
+
+	auto ram = loadFile(spath.c_str(), asset, use32bAligned, external);
+	const auto evictions = stats.evictions;
+	if(ram->size() == 0 && (evict(tierBudget(external), external), stats.evictions != evictions)){
+		// Allocation failed, retry with every evictable entry of the tier dropped
+		delete ram;
+		ram = loadFile(spath.c_str(), asset, use32bAligned, external);
+	}
 
-	auto ram = new RamFile(spath.c_str(), use32bAligned);
 	if(ram->size() == 0){
 		delete ram;
+		return nullptr;
+	}
+
+	return insertLoaded(path, ram, ramSize, pinned, external);
+}
+
+void FSLVGL::eraseCache(std::unordered_map<uint32_t, FileResource>::iterator it){
+	tierUsed(it->second.external) -= it->second.ramSize;
+	handles.erase(it->second.ramFile);
+	delete it->second.ramFile;
+	cache.erase(it);
+}
+
+bool FSLVGL::evict(size_t bytes, bool external){
+	while(tierUsed(external) + bytes > tierBudget(external)){
+		auto victim = cache.end();
+		for(auto it = cache.begin(); it != cache.end(); it++){
+			const auto& res = it->second;
+			if(res.pinned || res.opens > 0 || res.ramSize == 0 || res.external != external) continue;
+			if(victim == cache.end() || res.lastUse < victim->second.lastUse){
+				victim = it;
+			}
+		}
+
+		if(victim == cache.end()) return false;
+
+		eraseCache(victim);
+		stats.evictions++;
+	}
+
+	return true;
+}
+
+void FSLVGL::addToCache(const char* path, bool use32bAligned){
+	path = stripDrive(path);
+
+	{
+		std::lock_guard lock(mut);
+
+		auto found = findCache(path);
+		if(found){
+			found->deleteFlag = false;
+			found->pinned = true;
+			return;
+		}
+	}
+
+	// Files are read and decoded outside the lock, so several tasks can fill the cache at once
+	std::string spath("/spiffs");
+	spath.append(path);
+	const auto asset = getAsset(path);
+	const bool external = isExternal(ramSizeOf(spath.c_str(), asset), use32bAligned);
+	auto ram = loadFile(spath.c_str(), asset, use32bAligned, external);
+
+	std::lock_guard lock(mut);
+
+	const auto evictions = stats.evictions;
+	if(ram->size() == 0 && (evict(tierBudget(external), external), stats.evictions != evictions)){
+		delete ram;
+		ram = loadFile(spath.c_str(), asset, use32bAligned, external);
+	}
+
+	if(ram->size() == 0){
+		delete ram;
+		return;
+	}
+
+	auto found = findCache(path);
+	if(found){
+		delete ram;
+		found->deleteFlag = false;
+		found->pinned = true;
 		return;
 	}
 
-	FileResource r = { ram, false };
-	cache.insert(r);
+	const size_t ramSize = (asset.data && !asset.compressed()) ? 0 : ram->size();
+	evict(ramSize, external);
+	insertLoaded(path, ram, ramSize, true, external);
 }
 
 void FSLVGL::removeFromCache(const char* path){
-	std::string p;
-	if(strchr(path, DriveSeparator) != nullptr){
-		p = std::string(path + 2);
-	}else{
-		p = path;
+	std::lock_guard lock(mut);
+
+	const auto hash = AssetBundle::hashPath(stripDrive(path));
+	auto res = findCache(stripDrive(path));
+	if(!res) return;
+
+	if(res->opens == 0){
+		eraseCache(cache.find(hash));
+		return;
 	}
 
-	auto it = findCache(p);
-	if(it == cache.end()) return;
+	res->deleteFlag = true;
+}
+
+FSLVGL::Stats FSLVGL::getStats(){
+	std::lock_guard lock(mut);
+
+	return stats;
+}
+
+void FSLVGL::resetStats(){
+	std::lock_guard lock(mut);
+
+	stats.hits = stats.misses = stats.evictions = 0;
+	stats.streamReads = stats.streamSyscalls = 0;
+}
+
+void FSLVGL::prefetch(const char* path){
+	std::lock_guard lock(mut);
+
+	path = stripDrive(path);
+	if(findCache(path)) return;
+
+	// Uncompressed bundled files are already a direct flash read away
+	const auto asset = getAsset(path);
+	if(asset.data && !asset.compressed()) return;
+
+	insertCache(path, false, false);
+}
+
+RamFile* FSLVGL::openCached(const char* path){
+	if(driveLetter == 0 || path[0] != driveLetter || path[1] != DriveSeparator) return nullptr;
+
+	std::lock_guard lock(mut);
+
+	auto cached = findCache(path + 2);
+	if(!cached) return nullptr;
 
-	it->deleteFlag = true;
+	stats.hits++;
+	cached->opens++;
+	cached->lastUse = ++useCounter;
+	return cached->ramFile;
+}
+
+bool FSLVGL::peekCached(const char* path, void* dest, size_t len){
+	if(driveLetter == 0 || path[0] != driveLetter || path[1] != DriveSeparator) return false;
+
+	std::lock_guard lock(mut);
+
+	auto cached = findCache(path + 2);
+	if(!cached) return false;
+
+	auto file = cached->ramFile;
+	if(file->buffer() == nullptr || file->size() < len) return false;
+
+	memcpy(dest, file->buffer(), len);
+	return true;
+}
+
+void FSLVGL::closeCached(RamFile* file){
+	std::lock_guard lock(mut);
+	release(file);
+}
+
+bool FSLVGL::release(const void* file_p){
+	auto handle = handles.find(file_p);
+	if(handle == handles.end()) return false;
+
+	auto it = cache.find(handle->second);
+	auto& res = it->second;
+	if(res.opens > 0) res.opens--;
+	if(res.deleteFlag && res.opens == 0){
+		eraseCache(it);
+	}
+	return true;
+}
+
+RamFile* FSLVGL::getCached(const char* path){
+	std::lock_guard lock(mut);
+
+	auto res = findCache(stripDrive(path));
+	if(!res) return nullptr;
+
+	return res->ramFile;
+}
+
+AssetBundle::Asset FSLVGL::getAsset(const char* path){
+	if(bundle == nullptr) return { nullptr, 0, 0 };
+
+	path = stripDrive(path);
+	{
+		std::lock_guard lock(overrideMut);
+		if(!overrides.empty() && overrides.count(AssetBundle::hashPath(path))) return { nullptr, 0, 0 };
+	}
+
+	return bundle->find(path);
+}
+
+void FSLVGL::overrideAsset(const char* path){
+	path = stripDrive(path);
+	{
+		std::lock_guard lock(overrideMut);
+		if(overrides.insert(AssetBundle::hashPath(path)).second){
+			overridePaths.emplace_back(path);
+		}
+	}
+
+	// Reopened from SPIFFS next time, open handles keep the old contents until closed
+	removeFromCache(path);
+}
+
+bool FSLVGL::saveOverrides(){
+	std::lock_guard lock(overrideMut);
+
+	auto f = fopen(OverridesPath, "w");
+	if(f == nullptr){
+		ESP_LOGW(TAG, "Couldn't write %s", OverridesPath);
+		return false;
+	}
+
+	bool ok = true;
+	for(const auto& path : overridePaths){
+		ok &= fprintf(f, "%s\n", path.c_str()) > 0;
+	}
+	ok &= fclose(f) == 0;
+	return ok;
+}
+
+void FSLVGL::loadOverrides(){
+	auto f = fopen(OverridesPath, "r");
+	if(f == nullptr) return;
+
+	std::lock_guard lock(overrideMut);
+	char line[64];
+	while(fgets(line, sizeof(line), f)){
+		line[strcspn(line, "\n")] = 0;
+		if(line[0] == 0) continue;
+		if(overrides.insert(AssetBundle::hashPath(line)).second){
+			overridePaths.emplace_back(line);
+		}
+	}
+	fclose(f);
+
+	ESP_LOGI(TAG, "%zu files replaced since flashing are read from SPIFFS", overridePaths.size());
+}
+
+bool FSLVGL::isMounted(){
+	return mounted;
 }
 
 void FSLVGL::loadCache(){
-	for(const auto& path : Cached){
-		addToCache(path);
+	const auto start = millis();
+	loadNext = 0;
+	loadDone = 0;
+	bootDone = 0;
+	bootReady = xSemaphoreCreateBinary();
+
+	for(int i = 0; i < LoadWorkers; i++){
+		xTaskCreatePinnedToCore(loadWorker, "FSLoad", 3072, (void*) (uint32_t) start, 5, nullptr, i % portNUM_PROCESSORS);
 	}
+
+	xSemaphoreTake(bootReady, portMAX_DELAY);
+	vSemaphoreDelete(bootReady);
+	bootReady = nullptr;
+	ESP_LOGI(TAG, "Boot assets ready after %llu ms", millis() - start);
+}
+
+void FSLVGL::loadWorker(void* arg){
+	const uint64_t start = (uint32_t) arg;
+
+	size_t i;
+	while((i = loadNext++) < CachedCount){
+		addToCache(Cached[i]);
+
+		if(i < BootCachedCount && ++bootDone == BootCachedCount){
+			xSemaphoreGive(bootReady);
+		}
+
+		if(++loadDone == CachedCount){
+			ESP_LOGI(TAG, "Cache loaded after %llu ms, %zu B in RAM", millis() - start, getStats().used);
+		}
+	}
+
+	vTaskDelete(nullptr);
 }
 
 bool FSLVGL::ready_cb(struct _lv_fs_drv_t* drv){
@@ -176,10 +545,31 @@ bool FSLVGL::ready_cb(struct _lv_fs_drv_t* drv){
 }
 
 void* FSLVGL::open_cb(struct _lv_fs_drv_t* drv, const char* path, lv_fs_mode_t mode){
+	// Misses load on the caller's task, and the lock may wait for a prefetch in progress
+	LoopGuard::Span span("FSLVGL open");
+	std::lock_guard lock(mut);
+
 	auto cached = findCache(path);
-	if(cached != cache.end()){
-		(*cached).ramFile->seek(0);
-		return (*cached).ramFile;
+	if(cached){
+		stats.hits++;
+		cached->opens++;
+		cached->lastUse = ++useCounter;
+		cached->ramFile->seek(0);
+		return cached->ramFile;
+	}
+
+	stats.misses++;
+
+	if(mode == LV_FS_MODE_RD){
+		// Bundled files get a transient view straight into mapped flash, other files are loaded into RAM if they fit the budget
+		const auto asset = getAsset(path);
+		const bool bundled = asset.data != nullptr && !asset.compressed();
+		auto res = insertCache(path, false, false);
+		if(res){
+			res->deleteFlag = bundled;
+			res->opens++;
+			return res->ramFile;
+		}
 	}
 
 	const char* fsMode;
@@ -193,79 +583,79 @@ void* FSLVGL::open_cb(struct _lv_fs_drv_t* drv, const char* path, lv_fs_mode_t m
 	auto fslvgl = (FSLVGL*) drv->user_data;
 	std::string p = fslvgl->Root + std::string(path);
 
-	return (void*) fopen(p.c_str(), fsMode);
+	auto file = fopen(p.c_str(), fsMode);
+	if(file == nullptr) return nullptr;
+
+	return new ReadAheadFile(file, mode == LV_FS_MODE_RD ? ReadAhead : 0);
 }
 
 lv_fs_res_t FSLVGL::close_cb(struct _lv_fs_drv_t* drv, void* file_p){
-	auto it = findCache(file_p);
-	if(it != cache.end()){
-		if(it->deleteFlag){
-			delete it->ramFile;
-			cache.erase(it);
-		}
-		return 0;
-	}
+	std::lock_guard lock(mut);
+
+	if(release(file_p)) return 0;
 
-	fclose((FILE*) file_p);
+	auto file = (ReadAheadFile*) file_p;
+	stats.streamReads += file->getReads();
+	stats.streamSyscalls += file->getSyscalls();
+	ESP_LOGV(TAG, "Closed streamed file, %lu reads in %lu syscalls", file->getReads(), file->getSyscalls());
+	delete file;
 	return 0;
 }
 
 lv_fs_res_t FSLVGL::read_cb(struct _lv_fs_drv_t* drv, void* file_p, void* buf, uint32_t btr, uint32_t* br){
+	std::lock_guard lock(mut);
+
 	auto cached = findCache(file_p);
-	if(cached != cache.end()){
-		*br = (*cached).ramFile->read(buf, btr);
+	if(cached){
+		*br = cached->ramFile->read(buf, btr);
 		return 0;
 	}
 
-	if(ferror((FILE*) file_p)) return LV_FS_RES_NOT_EX;
-	*br = fread(buf, 1, btr, (FILE*) file_p);
+	auto file = (ReadAheadFile*) file_p;
+	if(file->error()) return LV_FS_RES_NOT_EX;
+	*br = file->read(buf, btr);
 	return 0;
 }
 
 lv_fs_res_t FSLVGL::write_cb(struct _lv_fs_drv_t* drv, void* file_p, const void* buf, uint32_t btw, uint32_t* bw){
+	std::lock_guard lock(mut);
+
 	auto cached = findCache(file_p);
-	if(cached != cache.end()){
+	if(cached){
 		*bw = 0;
 		return 0;
 	}
 
-	if(ferror((FILE*) file_p)) return LV_FS_RES_NOT_EX;
+	auto file = (ReadAheadFile*) file_p;
+	if(file->error()) return LV_FS_RES_NOT_EX;
 
-	*bw = fwrite((uint8_t*) buf, 1, btw, (FILE*) file_p);
+	*bw = file->write(buf, btw);
 	return 0;
 }
 
+static int seekMode(lv_fs_whence_t whence){
+	switch(whence){
+		case LV_FS_SEEK_CUR: return SEEK_CUR;
+		case LV_FS_SEEK_END: return SEEK_END;
+		default: return SEEK_SET;
+	}
+}
+
 lv_fs_res_t FSLVGL::seek_cb(struct _lv_fs_drv_t* drv, void* file_p, uint32_t pos, lv_fs_whence_t whence){
+	std::lock_guard lock(mut);
+
 	auto cached = findCache(file_p);
-	if(cached != cache.end()){
-		static const std::unordered_map<lv_fs_whence_t, int> SeekMap = {
-				{ LV_FS_SEEK_SET, SEEK_SET },
-				{ LV_FS_SEEK_CUR, SEEK_CUR },
-				{ LV_FS_SEEK_END, SEEK_END },
-		};
-		(*cached).ramFile->seek(pos, SeekMap.at(whence));
+	if(cached){
+		cached->ramFile->seek(pos, seekMode(whence));
 		return 0;
 	}
 
-	if(ferror((FILE*) file_p)){
+	auto file = (ReadAheadFile*) file_p;
+	if(file->error()){
 		return LV_FS_RES_NOT_EX;
 	}
 
-	int mode;
-	switch(whence){
-		case LV_FS_SEEK_SET:
-			mode = SEEK_SET;
-			break;
-		case LV_FS_SEEK_CUR:
-			mode = SEEK_CUR;
-			break;
-		case LV_FS_SEEK_END:
-			mode = SEEK_END;
-			break;
-		default:
-			mode = SEEK_SET;
-	}
-	if(fseek((FILE*) file_p, pos, mode) != 0){
+	if(!file->seek(pos, seekMode(whence))){
 		return LV_FS_RES_INV_PARAM;
 	}
 	return 0;
@@ -273,16 +663,17 @@ lv_fs_res_t FSLVGL::seek_cb(struct _lv_fs_drv_t* drv, void* file_p, uint32_t pos
 }
 
 lv_fs_res_t FSLVGL::tell_cb(struct _lv_fs_drv_t* drv, void* file_p, uint32_t* pos_p){
+	std::lock_guard lock(mut);
+
 	auto cached = findCache(file_p);
-	if(cached != cache.end()){
-		*pos_p = (*cached).ramFile->pos();
+	if(cached){
+		*pos_p = cached->ramFile->pos();
 		return 0;
 	}
 
-	if(ferror((FILE*) file_p)) return LV_FS_RES_NOT_EX;
-	auto val = ftell((FILE*) file_p);
-	if(val == -1) return LV_FS_RES_UNKNOWN;
-	*pos_p = val;
+	auto file = (ReadAheadFile*) file_p;
+	if(file->error()) return LV_FS_RES_NOT_EX;
+	*pos_p = file->tell();
 	return 0;
 }
 
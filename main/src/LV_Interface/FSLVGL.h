@@ -3,9 +3,16 @@
 
 #include <lvgl.h>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "Util/RamFile.h"
+#include "Util/AssetBundle.h"
 
 class FSLVGL {
 public:
@@ -13,38 +20,152 @@ public:
 	virtual ~FSLVGL();
 
 	/**
-	 * Allocates memory and stores a file in memory.
+	 * Mounts SPIFFS and opens the asset bundle. Doesn't need LVGL, so the boot assets can load while the display and LVGL
+	 * are still coming up. The constructor mounts if this hasn't been called.
+	 * @return False if SPIFFS couldn't be mounted. With CONFIG_CM_OTA there is no SPIFFS and only the bundle is opened.
+	 */
+	static bool mount();
+
+	/**
+	 * Stores a file in memory and pins it, so it's never evicted. Files present in the asset bundle are served straight from mapped flash
+	 * and don't use any heap, others are copied from SPIFFS into RAM and count towards the cache budget.
 	 * @param path Relative to /spiffs (e.g. /bg.bin)
-	 * @param use32bAligned Choose to use ESP32's IRAM or not. Defaults to False.
+	 * @param use32bAligned Choose to use ESP32's IRAM or not. Defaults to False. Ignored for bundled files.
 	 * 						Useful if caching 4-byte palette sprites for example, but will throw LoadStoreError if data isn't accesed in 32-bit chunks.
 	 */
 	static void addToCache(const char* path, bool use32bAligned = false);
 	static void removeFromCache(const char* path);
 
+	/**
+	 * Loads a file into the cache without pinning it, subject to the budget. Safe to call from any task.
+	 * Only files served from SPIFFS, synced overrides included, and compressed bundle entries are loaded,
+	 * uncompressed bundle entries are already a direct flash read.
+	 */
+	static void prefetch(const char* path);
+
+	struct Stats {
+		uint32_t hits;
+		uint32_t misses;
+		uint32_t evictions;
+		size_t used; // [B] RAM held by cached files
+		size_t budget; // [B]
+		uint32_t streamReads; // reads of closed uncached files
+		uint32_t streamSyscalls; // stdio calls those reads needed
+		size_t externalUsed; // [B] PSRAM held by cached files
+		size_t externalBudget; // [B] 0 without PSRAM
+	};
+
+	/**
+	 * Unpinned files opened through LVGL are loaded into RAM on demand and evicted least-recently-used once the budget is exceeded.
+	 * With PSRAM, files of at least ExternalMin (backgrounds, GIF frames) are cached there under their own budget and
+	 * small ones (icons) stay in internal RAM, where they're quickest to draw.
+	 */
+	static Stats getStats();
+	static void resetStats();
+
+	/**
+	 * Pins the boot asset set into the cache, reading files on a worker per core.
+	 * Returns as soon as the files the lock screen shows are loaded, the rest keep loading in the background.
+	 */
 	static void loadCache();
 
+	/** @return Cached file or nullptr if the file isn't in cache. */
+	static RamFile* getCached(const char* path);
+
+	/**
+	 * Opens a file through its drive path (e.g. S:/bg.bin) only if it's already cached, for readers that use the
+	 * buffer in place. The file stays loaded until closeCached(), like one opened through LVGL.
+	 * @return Cached file or nullptr, misses aren't loaded
+	 */
+	static RamFile* openCached(const char* path);
+	static void closeCached(RamFile* file);
+
+	/** Copies the first len bytes of a cached file, by its drive path. @return False if it isn't cached or is shorter */
+	static bool peekCached(const char* path, void* dest, size_t len);
+
+	/** @return File contents in mapped flash, data is nullptr if the file isn't in the asset bundle or is overridden. */
+	static AssetBundle::Asset getAsset(const char* path);
+
+	/**
+	 * Serves path from SPIFFS instead of the bundle from now on, for files replaced after flashing, and drops its
+	 * cache entry. saveOverrides() keeps the list in OverridesPath, which mount() reads back.
+	 * @param path Relative to /spiffs (e.g. /bg.bin)
+	 */
+	static void overrideAsset(const char* path);
+	static bool saveOverrides();
+
+	static bool isMounted();
+
 private:
 	lv_fs_drv_t drv;                   /*Needs to be static or global*/
 	const std::string Root = "/spiffs";
 	static constexpr const char DriveSeparator = ':';
 
+	static constexpr size_t Budget = CONFIG_CM_FSLVGL_CACHE_BUDGET * 1024; // [B]
+	static constexpr size_t ReadAhead = CONFIG_CM_FSLVGL_READ_AHEAD; // [B]
+#ifdef CONFIG_CM_PSRAM
+	static constexpr size_t ExternalBudget = CONFIG_CM_FSLVGL_PSRAM_BUDGET * 1024; // [B]
+	static constexpr size_t ExternalMin = CONFIG_CM_FSLVGL_PSRAM_MIN; // [B]
+#else
+	static constexpr size_t ExternalBudget = 0; // [B]
+	static constexpr size_t ExternalMin = 0; // [B]
+#endif
+
 	struct FileResource {
 		RamFile* ramFile;
-		mutable bool deleteFlag;
+		bool deleteFlag;
+		bool pinned;
+		uint16_t opens;
+		uint32_t lastUse;
+		size_t ramSize; // [B] 0 for files mapped from the bundle
+		bool external; // Counts towards the PSRAM budget
+	};
 
-		bool operator==(const FileResource& other) const{
-			return other.ramFile == ramFile;
-		}
+	/** Cached files keyed by the FNV-1a hash of their path relative to Root; handles maps open RamFile pointers back to their key. */
+	static std::unordered_map<uint32_t, FileResource> cache;
+	static std::unordered_map<const void*, uint32_t> handles;
 
-		operator RamFile*() const{
-			return ramFile;
-		}
-	};
+	static AssetBundle* bundle;
+
+	static constexpr const char* OverridesPath = "/spiffs/.overrides"; // One path per line
+	static std::unordered_set<uint32_t> overrides; // Path hashes
+	static std::vector<std::string> overridePaths;
+	static std::mutex overrideMut; // getAsset() is called with mut held
+	static void loadOverrides();
+	static std::mutex mut;
+	static bool mounted;
+
+	static constexpr int LoadWorkers = 2;
+	static std::atomic<size_t> loadNext;
+	static std::atomic<size_t> loadDone;
+	static std::atomic<size_t> bootDone;
+	static SemaphoreHandle_t bootReady;
+	static void loadWorker(void* arg);
+	static Stats stats;
+	static uint32_t useCounter;
+
+	static char driveLetter; // 0 until the drive is registered
+
+	static const char* stripDrive(const char* path);
+
+	static FileResource* findCache(const char* path);
+	static FileResource* findCache(const void* ptr);
 
-	static std::unordered_set<FileResource, std::hash<RamFile*>> cache;
+	/** [B] of RAM the file will take when loaded, 0 for files mapped from the bundle or missing ones */
+	static size_t ramSizeOf(const char* spath, const AssetBundle::Asset& asset);
+	/** Whether a file of ramSize is cached in PSRAM */
+	static bool isExternal(size_t ramSize, bool use32bAligned);
+	static size_t& tierUsed(bool external);
+	static size_t tierBudget(bool external);
 
-	static auto findCache(const std::string& path);
-	static auto findCache(void* ptr);
+	static RamFile* loadFile(const char* spath, const AssetBundle::Asset& asset, bool use32bAligned, bool external);
+	static FileResource* insertLoaded(const char* path, RamFile* ram, size_t ramSize, bool pinned, bool external);
+	static FileResource* insertCache(const char* path, bool use32bAligned, bool pinned);
+	static void eraseCache(std::unordered_map<uint32_t, FileResource>::iterator it);
+	/** Drops least recently used unpinned, closed files of a tier until bytes more fit its budget. Returns false if they can't. */
+	static bool evict(size_t bytes, bool external);
+	/** Closes a cached file handle, erasing transient ones with their last close. @return False if it isn't one */
+	static bool release(const void* file_p);
 
 	static bool ready_cb(struct _lv_fs_drv_t* drv);
 	static void* open_cb(struct _lv_fs_drv_t* drv, const char* path, lv_fs_mode_t mode);
@@ -1,15 +1,13 @@
 #include "InputLVGL.h"
-#include "Pins.hpp"
+#include "LVGL.h"
+#include <esp_timer.h>
 
 InputLVGL* InputLVGL::instance = nullptr;
-const std::map<Input::Button, lv_key_t> InputLVGL::keyMap = {{ Input::Button::Up,     LV_KEY_LEFT },
-															 { Input::Button::Down,   LV_KEY_RIGHT },
-															 { Input::Button::Select, LV_KEY_ENTER }};
 
-InputLVGL::InputLVGL() : Threaded("InputLVGL", 1024), queue(QueueSize){
+InputLVGL::InputLVGL(Input& input) : input(input), queue(QueueSize, "InputLVGL"){
 	instance = this;
 
-	Events::listen(Facility::Input, &queue);
+	Events::listen(Facility::Motion, &queue);
 
 	static lv_indev_drv_t inputDriver;
 	lv_indev_drv_init(&inputDriver);
@@ -18,31 +16,82 @@ InputLVGL::InputLVGL() : Threaded("InputLVGL", 1024), queue(QueueSize){
 	inputDriver.long_press_time = 350;
 	inputDriver.read_cb = [](lv_indev_drv_t* drv, lv_indev_data_t* data){ InputLVGL::getInstance()->read(drv, data); };
 	inputDevice = lv_indev_drv_register(&inputDriver);
+}
 
-	start();
+InputLVGL::~InputLVGL(){
+	Events::unlisten(&queue);
+	instance = nullptr;
 }
 
 void InputLVGL::read(lv_indev_drv_t* drv, lv_indev_data_t* data){
-	if(keyMap.count(lastKey) == 0) return;
-	data->key = keyMap.at(lastKey);
-	data->state = (action == Input::Data::Action::Press) ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+	if(gestureClick){
+		gestureClick = false;
+		pressed = false;
+	}else{
+		Input::Data edge;
+		bool took = false;
+		while(!took && input.getEdge(edge)){
+			const auto mapped = KeyMap[edge.btn];
+			if(mapped == 0) continue;
+
+			// Releases always go through, LVGL would otherwise keep a key held
+			const bool press = edge.action == Input::Data::Press;
+			if(press && (uint64_t) esp_timer_get_time() - edge.time > MaxPressAge) continue;
+
+			key = mapped;
+			pressed = press;
+			took = true;
+
+			// The change reaches LVGL now, the profiler closes it out once the next frame is pushed
+			LVGL::markInput(edge.time);
+		}
+
+		if(!took){
+			readGesture();
+		}
+	}
+
+	data->key = key;
+	data->state = pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+	data->continue_reading = gestureClick || input.hasEdge();
+}
+
+bool InputLVGL::readGesture(){
+	Event evt{};
+	if(!queue.get(evt, 0)) return false;
+
+	auto data = (IMU::Event*) evt.data;
+	if(data->action == IMU::Event::Flick){
+		key = data->flickDir == IMU::FlickDirection::Up ? LV_KEY_LEFT : LV_KEY_RIGHT;
+	}else if(data->action == IMU::Event::Shake){
+		key = LV_KEY_ENTER;
+	}else return false;
+
+	pressed = true;
+	gestureClick = true;
+	return true;
 }
 
 InputLVGL* InputLVGL::getInstance(){
 	return instance;
 }
 
-void InputLVGL::loop(){
-	Event event{};
+lv_indev_t* InputLVGL::getIndev() const{
+	return inputDevice;
+}
 
-	if(queue.get(event, portMAX_DELAY)){
-		auto inputData = ((Input::Data*) event.data);
-		lastKey = inputData->btn;
-		action = inputData->action;
-		free(event.data);
-	}
+void InputLVGL::suspend(){
+	if(suspended || pressed || gestureClick || input.hasEdge()) return;
+
+	lv_timer_pause(inputDevice->driver->read_timer);
+	suspended = true;
 }
 
-lv_indev_t* InputLVGL::getIndev() const{
-	return inputDevice;
+void InputLVGL::resume(){
+	if(!suspended) return;
+
+	auto timer = inputDevice->driver->read_timer;
+	lv_timer_resume(timer);
+	lv_timer_ready(timer);
+	suspended = false;
 }
@@ -2,32 +2,55 @@
 #define CLOCKSTAR_FIRMWARE_INPUTLVGL_H
 
 #include <lvgl.h>
-#include <map>
 #include "Util/Events.h"
-#include "Util/Threaded.h"
 #include "../Devices/Input.h"
-
-class InputLVGL : private Threaded {
+#include "../Devices/IMU.h"
+
+/**
+ * LVGL encoder driven by the buttons and gestures. Everything happens in the indev read on the LVGL task: button edges
+ * come straight from Input's edge ring, one per read, and LVGL is asked to read again while more are waiting, so a
+ * press and release landing between two reads both get through. Gestures are polled from a small event queue.
+ */
+class InputLVGL {
 public:
-	InputLVGL();
+	InputLVGL(Input& input);
+	virtual ~InputLVGL();
 
 	void read(lv_indev_drv_t* drv, lv_indev_data_t* data);
 	static InputLVGL* getInstance();
 
 	[[nodiscard]] lv_indev_t* getIndev() const;
 
-protected:
-	void loop() override;
+	/**
+	 * Pauses LVGL's periodic read while no key is held and no edge is waiting, so an idle UI isn't woken for it.
+	 * resume() reads again right away, LVGL calls it when an event ends its wait, Input and Motion are wake events.
+	 * LVGL task only.
+	 */
+	void suspend();
+	void resume();
 
 private:
-	static const std::map<Input::Button, lv_key_t> keyMap;
+	Input& input;
+
+	// Up, Down, Select, Alt. Alt isn't an encoder key, screens handle it from their own event queues.
+	static constexpr lv_key_t KeyMap[Input::ButtonCount] = { LV_KEY_LEFT, LV_KEY_RIGHT, LV_KEY_ENTER, 0 };
+
 	lv_indev_t* inputDevice;
 
-	Input::Button lastKey = Input::Alt;
-	Input::Data::Action action = Input::Data::Release;
+	// Only touched by the LVGL task
+	lv_key_t key = LV_KEY_ENTER;
+	bool pressed = false;
+	bool suspended = false;
+
+	/** Presses older than this are from while LVGL wasn't reading, e.g. the one that woke the watch, and are dropped */
+	static constexpr uint64_t MaxPressAge = 1000000; // [us]
+
+	// Gestures have no release, their key is reported pressed on one read and released on the next
+	bool gestureClick = false;
+	bool readGesture();
 
 	EventQueue queue;
-	static constexpr size_t QueueSize = 5;
+	static constexpr size_t QueueSize = 4;
 
 	static InputLVGL* instance;
 };
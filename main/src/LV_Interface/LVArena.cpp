@@ -0,0 +1,106 @@
+#include "LVArena.h"
+#include <esp_log.h>
+#include <new>
+
+static const char* TAG = "LVArena";
+
+LVArena* LVArena::active = nullptr;
+
+LVArena::LVArena() = default;
+
+LVArena::~LVArena(){
+	if(active == this){
+		active = nullptr;
+	}
+
+	// Something built by the screen outlived it, its memory can't go without leaving it dangling
+	if(used != 0){
+		ESP_LOGE(TAG, "Destroyed with %zu B still allocated, keeping its %zu chunks", used, chunkCount);
+		return;
+	}
+
+	while(chunks){
+		auto prev = *(void**) chunks;
+		::operator delete(chunks);
+		chunks = prev;
+	}
+}
+
+void* LVArena::alloc(size_t size){
+	const size_t total = size + sizeof(Header);
+
+	if(active == nullptr || total > MaxBlock){
+		auto header = (Header*) ::operator new(total);
+		*header = { nullptr, 0 };
+		return header + 1;
+	}
+
+	return active->take((total + ClassSize - 1) / ClassSize);
+}
+
+void LVArena::free(void* ptr){
+	if(ptr == nullptr) return;
+
+	auto header = (Header*) ptr - 1;
+	if(header->arena == nullptr){
+		::operator delete(header);
+		return;
+	}
+
+	header->arena->give(header);
+}
+
+void LVArena::setActive(LVArena* arena){
+	active = arena;
+}
+
+LVArena* LVArena::getActive(){
+	return active;
+}
+
+LVArena::Stats LVArena::getStats() const{
+	return { chunkCount, used, peak };
+}
+
+void* LVArena::take(uint32_t sizeClass){
+	const size_t size = sizeClass * ClassSize;
+
+	Header* header;
+	if(auto block = freeLists[sizeClass]){
+		freeLists[sizeClass] = block->next;
+		header = (Header*) block;
+	}else{
+		if(left < size){
+			// The rest of the chunk is given up, it's under MaxBlock
+			auto chunk = (uint8_t*) ::operator new(ChunkSize);
+			*(void**) chunk = chunks;
+			chunks = chunk;
+			chunkCount++;
+
+			cursor = chunk + sizeof(Header); // Keeps the blocks 8-aligned after the link
+			left = ChunkSize - sizeof(Header);
+		}
+
+		header = (Header*) cursor;
+		cursor += size;
+		left -= size;
+	}
+
+	*header = { this, sizeClass };
+	used += size;
+	if(used > peak){
+		peak = used;
+	}
+
+	return header + 1;
+}
+
+void LVArena::give(Header* header){
+	const auto sizeClass = header->sizeClass;
+	used -= sizeClass * ClassSize;
+
+	// The link overwrites the header, the block gets a new one when it's taken again
+	auto block = (FreeBlock*) header;
+	block->next = freeLists[sizeClass];
+	freeLists[sizeClass] = block;
+}
@@ -0,0 +1,73 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVARENA_H
+#define CLOCKSTAR_FIRMWARE_LVARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Allocator owned by each LVScreen for the helper objects it builds: every LVObject, and buffers taken with alloc().
+ * Blocks are carved from ChunkSize heap chunks, freed ones are kept on a free list per size class and reused, so a
+ * screen that keeps adding and removing items stays at its peak. The chunks go back to the heap in one go when the
+ * screen is destroyed, instead of as scattered small holes.
+ *
+ * Allocations go to the active arena: a screen's own while it's being built and while it's the current one, set by
+ * LVScreen and LVGL. Blocks over MaxBlock, and everything while no arena is active, come from the heap. Every block
+ * remembers where it came from, so free() works for all of them. LVGL thread only, like LVGL itself.
+ */
+class LVArena {
+public:
+	LVArena();
+	~LVArena();
+
+	LVArena(const LVArena&) = delete;
+	LVArena& operator=(const LVArena&) = delete;
+
+	static void* alloc(size_t size);
+	static void free(void* ptr);
+
+	static void setActive(LVArena* arena);
+	static LVArena* getActive();
+
+	struct Stats {
+		size_t chunks;
+		size_t used; // [B] in live blocks, with their headers
+		size_t peak; // [B]
+	};
+	Stats getStats() const;
+
+	static constexpr size_t ChunkSize = 4096; // [B]
+
+private:
+	static constexpr size_t ClassSize = 16; // [B], block sizes are rounded up to it
+	static constexpr size_t MaxBlock = 512; // [B] including the header
+	static constexpr size_t ClassCount = MaxBlock / ClassSize + 1;
+
+	/** Precedes every block. 8 bytes, so blocks keep the alignment of the chunk. */
+	struct Header {
+		LVArena* arena; // nullptr for blocks from the heap
+		uint32_t sizeClass;
+	};
+	static_assert(sizeof(Header) == 8);
+
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	static LVArena* active;
+
+	void* chunks = nullptr; // Each chunk starts with a pointer to the previous one
+	size_t chunkCount = 0;
+	uint8_t* cursor = nullptr;
+	size_t left = 0; // [B] after cursor in the newest chunk
+
+	FreeBlock* freeLists[ClassCount] = {};
+	size_t used = 0;
+	size_t peak = 0;
+
+	void* take(uint32_t sizeClass);
+	void give(Header* header);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVARENA_H
@@ -0,0 +1,85 @@
+#include "LVBlend.h"
+#include <cstring>
+#include <esp_attr.h>
+
+static_assert(LV_COLOR_DEPTH == 16, "LVBlend kernels are written for RGB565");
+
+void LVBlend::initCtx(lv_disp_drv_t* drv, lv_draw_ctx_t* ctx){
+	lv_draw_sw_init_ctx(drv, ctx);
+	((lv_draw_sw_ctx_t*) ctx)->blend = blend;
+}
+
+void IRAM_ATTR LVBlend::blend(lv_draw_ctx_t* ctx, const lv_draw_sw_blend_dsc_t* dsc){
+	const lv_opa_t* mask = dsc->mask_buf;
+	if(mask && dsc->mask_res == LV_DRAW_MASK_RES_TRANSP) return;
+	if(mask && dsc->mask_res == LV_DRAW_MASK_RES_FULL_COVER) mask = nullptr;
+
+	auto disp = _lv_refr_get_disp_refreshing();
+	if(mask || dsc->opa < LV_OPA_MAX || dsc->blend_mode != LV_BLEND_MODE_NORMAL || disp->driver->set_px_cb || disp->driver->screen_transp){
+		lv_draw_sw_blend_basic(ctx, dsc);
+		return;
+	}
+
+	lv_area_t area;
+	if(!_lv_area_intersect(&area, dsc->blend_area, ctx->clip_area)) return;
+
+	const lv_coord_t destStride = lv_area_get_width(ctx->buf_area);
+	auto dest = (lv_color_t*) ctx->buf + destStride * (area.y1 - ctx->buf_area->y1) + (area.x1 - ctx->buf_area->x1);
+	const lv_coord_t w = lv_area_get_width(&area);
+	const lv_coord_t h = lv_area_get_height(&area);
+
+	if(dsc->src_buf == nullptr){
+		fill(dest, destStride, w, h, dsc->color);
+		return;
+	}
+
+	const lv_coord_t srcStride = lv_area_get_width(dsc->blend_area);
+	auto src = dsc->src_buf + srcStride * (area.y1 - dsc->blend_area->y1) + (area.x1 - dsc->blend_area->x1);
+	copy(dest, destStride, src, srcStride, w, h);
+}
+
+void IRAM_ATTR LVBlend::fill(lv_color_t* dest, lv_coord_t destStride, lv_coord_t w, lv_coord_t h, lv_color_t color){
+	const uint32_t pair = color.full | ((uint32_t) color.full << 16);
+
+	for(lv_coord_t y = 0; y < h; y++){
+		auto px = (uint16_t*) (dest + y * destStride);
+		lv_coord_t n = w;
+
+		if(((uintptr_t) px & 0x3) && n > 0){
+			*px++ = color.full;
+			n--;
+		}
+
+		// Buffer rows are 4-aligned from here, write two pixels per store, 8 per iteration
+		auto words = (uint32_t*) px;
+		while(n >= 8){
+			words[0] = pair;
+			words[1] = pair;
+			words[2] = pair;
+			words[3] = pair;
+			words += 4;
+			n -= 8;
+		}
+		while(n >= 2){
+			*words++ = pair;
+			n -= 2;
+		}
+
+		if(n){
+			*(uint16_t*) words = color.full;
+		}
+	}
+}
+
+void IRAM_ATTR LVBlend::copy(lv_color_t* dest, lv_coord_t destStride, const lv_color_t* src, lv_coord_t srcStride, lv_coord_t w, lv_coord_t h){
+	if(w == destStride && w == srcStride){
+		memcpy(dest, src, w * h * sizeof(lv_color_t));
+		return;
+	}
+
+	for(lv_coord_t y = 0; y < h; y++){
+		memcpy(dest, src, w * sizeof(lv_color_t));
+		dest += destStride;
+		src += srcStride;
+	}
+}
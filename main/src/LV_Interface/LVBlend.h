@@ -0,0 +1,23 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVBLEND_H
+#define CLOCKSTAR_FIRMWARE_LVBLEND_H
+
+#include <lvgl.h>
+
+/**
+ * Replaces the software renderer's blend stage with word-wide kernels for the opaque, unmasked cases:
+ * solid fills and image/buffer copies. Everything else is passed on to lv_draw_sw_blend_basic.
+ */
+class LVBlend {
+public:
+	/** To be set as lv_disp_drv_t::draw_ctx_init */
+	static void initCtx(lv_disp_drv_t* drv, lv_draw_ctx_t* ctx);
+
+private:
+	static void blend(lv_draw_ctx_t* ctx, const lv_draw_sw_blend_dsc_t* dsc);
+
+	static void fill(lv_color_t* dest, lv_coord_t destStride, lv_coord_t w, lv_coord_t h, lv_color_t color);
+	static void copy(lv_color_t* dest, lv_coord_t destStride, const lv_color_t* src, lv_coord_t srcStride, lv_coord_t w, lv_coord_t h);
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVBLEND_H
@@ -0,0 +1,140 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVBUILD_H
+#define CLOCKSTAR_FIRMWARE_LVBUILD_H
+
+#include <lvgl.h>
+#include "Theme/styles.h"
+
+/**
+ * Declarative object building. Each call creates one object and applies all of its modifiers before returning, so
+ * children are created under a parent that is already styled and adding a style never refreshes a subtree.
+ * Styles go first regardless of where they're listed, then the rest in order. Layout stays lazy, LVGL only runs it
+ * with the next refresh once the whole tree is built.
+ *
+ * 	bg = LVBuild::obj(*this, LVBuild::Style{ Styles::Backdrop }, LVBuild::Size{ 128, 128 });
+ *
+ * Modifiers are plain aggregates and every call is inlined, this compiles to the same lv_obj_* calls written by hand.
+ * Prefer shared const styles from Theme/styles.h over local style properties, which allocate a local style per object.
+ */
+namespace LVBuild {
+
+	struct Style {
+		const lv_style_t& style;
+		lv_style_selector_t selector = 0;
+	};
+
+	struct Pos {
+		lv_coord_t x;
+		lv_coord_t y;
+	};
+
+	struct Size {
+		lv_coord_t w;
+		lv_coord_t h;
+	};
+
+	/** Set and cleared in one call each, combine flags with | */
+	struct Flags {
+		lv_obj_flag_t add = 0;
+		lv_obj_flag_t clear = 0;
+	};
+
+	/** Flex properties are registered at runtime by LVGL, so they can't go in a const style */
+	struct Flex {
+		lv_flex_flow_t flow;
+		lv_flex_align_t main = LV_FLEX_ALIGN_START;
+		lv_flex_align_t cross = LV_FLEX_ALIGN_START;
+		lv_flex_align_t track = LV_FLEX_ALIGN_START;
+	};
+
+	/** Static text of a label, not copied */
+	struct Text {
+		const char* text;
+	};
+
+	/** Source of an image */
+	struct Src {
+		const void* src;
+	};
+
+	/** Value range of a slider or bar */
+	struct Range {
+		int32_t min;
+		int32_t max;
+	};
+
+	namespace Impl {
+
+		template<typename T>
+		inline void style(lv_obj_t*, const T&){}
+
+		inline void style(lv_obj_t* obj, const Style& mod){
+			lv_obj_add_style(obj, Styles::get(mod.style), mod.selector);
+		}
+
+		inline void apply(lv_obj_t*, const Style&){}
+
+		inline void apply(lv_obj_t* obj, const Pos& mod){
+			lv_obj_set_pos(obj, mod.x, mod.y);
+		}
+
+		inline void apply(lv_obj_t* obj, const Size& mod){
+			lv_obj_set_size(obj, mod.w, mod.h);
+		}
+
+		inline void apply(lv_obj_t* obj, const Flags& mod){
+			if(mod.add) lv_obj_add_flag(obj, mod.add);
+			if(mod.clear) lv_obj_clear_flag(obj, mod.clear);
+		}
+
+		inline void apply(lv_obj_t* obj, const Flex& mod){
+			lv_obj_set_layout(obj, LV_LAYOUT_FLEX);
+			lv_obj_set_flex_flow(obj, mod.flow);
+			lv_obj_set_flex_align(obj, mod.main, mod.cross, mod.track);
+		}
+
+		inline void apply(lv_obj_t* obj, const Text& mod){
+			lv_label_set_text_static(obj, mod.text);
+		}
+
+		inline void apply(lv_obj_t* obj, const Src& mod){
+			lv_img_set_src(obj, mod.src);
+		}
+
+		inline void apply(lv_obj_t* obj, const Range& mod){
+			lv_bar_set_range(obj, mod.min, mod.max);
+		}
+
+	}
+
+	/** Applies modifiers to an existing object, such as a screen or an LVObject */
+	template<typename... Mods>
+	inline lv_obj_t* build(lv_obj_t* obj, const Mods&... mods){
+		(Impl::style(obj, mods), ...);
+		(Impl::apply(obj, mods), ...);
+		return obj;
+	}
+
+	template<typename... Mods>
+	inline lv_obj_t* obj(lv_obj_t* parent, const Mods&... mods){
+		return build(lv_obj_create(parent), mods...);
+	}
+
+	template<typename... Mods>
+	inline lv_obj_t* label(lv_obj_t* parent, const Mods&... mods){
+		return build(lv_label_create(parent), mods...);
+	}
+
+	template<typename... Mods>
+	inline lv_obj_t* img(lv_obj_t* parent, const Mods&... mods){
+		return build(lv_img_create(parent), mods...);
+	}
+
+	template<typename... Mods>
+	inline lv_obj_t* slider(lv_obj_t* parent, const Mods&... mods){
+		return build(lv_slider_create(parent), mods...);
+	}
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVBUILD_H
@@ -0,0 +1,6 @@
+#include "LVDirectScreen.h"
+
+LVDirectScreen::LVDirectScreen(uint8_t fps){
+	direct = true;
+	setFrameRate(fps);
+}
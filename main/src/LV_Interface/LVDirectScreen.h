@@ -0,0 +1,31 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVDIRECTSCREEN_H
+#define CLOCKSTAR_FIRMWARE_LVDIRECTSCREEN_H
+
+#include "LVScreen.h"
+#include <LovyanGFX.h>
+
+/**
+ * Screen that draws the whole display itself, for apps that redraw everything every frame and don't need LVGL objects
+ * moving, restyling and invalidating for them. While it's the current screen LVGL's refresh is paused and the screen
+ * draws into a full-frame canvas owned by LVGL, which is pushed to the panel with DMA. LVGL timers, input and events
+ * keep running. When another screen starts, the canvas is freed and the display is handed back to LVGL, which redraws
+ * the new screen in full. If the canvas can't be allocated, the screen's LVGL objects are shown instead.
+ */
+class LVDirectScreen : public LVScreen {
+protected:
+	explicit LVDirectScreen(uint8_t fps = 60);
+
+	/**
+	 * Draws the next frame, on the LVGL thread once per frame period. The canvas still holds the previous frame,
+	 * its last DMA transfer is already done.
+	 * @return False if nothing changed, the frame isn't pushed then
+	 */
+	virtual bool draw(LGFX_Sprite& canvas) = 0;
+
+private:
+	friend LVGL;
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVDIRECTSCREEN_H
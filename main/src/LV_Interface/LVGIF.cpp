@@ -1,52 +1,90 @@
 #include <string>
 #include <cstdio>
 #include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
 #include "LVGIF.h"
+#include "FSLVGL.h"
+#include "LVArena.h"
+#include "Util/LZ4.h"
 
 static const char* tag = "LVGIF";
 
-LVGIF::LVGIF(lv_obj_t* parent, const char* path) : LVObject(parent), path(path){
+/** Reads a small file from the asset bundle or SPIFFS. */
+static bool readFile(const std::string& relPath, std::vector<uint8_t>& out){
+	const auto asset = FSLVGL::getAsset(relPath.c_str());
+	if(asset.compressed()){
+		out.resize(asset.rawSize);
+		return LZ4::decompress(asset.data, asset.size, out.data(), out.size()) == asset.rawSize;
+	}else if(asset.data){
+		out.assign(asset.data, asset.data + asset.size);
+		return true;
+	}
+
+	auto spath = "/spiffs" + relPath;
+	auto f = fopen(spath.c_str(), "r");
+	if(f == nullptr) return false;
+
+	fseek(f, 0L, SEEK_END);
+	out.resize(ftell(f));
+	rewind(f);
+	out.resize(fread(out.data(), 1, out.size(), f));
+	fclose(f);
+	return true;
+}
+
+LVGIF::LVGIF(lv_obj_t* parent, const char* path, uint8_t ringSize) : LVObject(parent), path(path){
 	auto strpath = std::string(path);
 	if(strpath.find("S:") == 0){
 		strpath = strpath.substr(2);
 	}
-	auto descPath = "/spiffs" + strpath + "/desc.bin";
+	framePath = strpath;
+	strpath += "/desc.bin";
+
+	pathLen = strpath.length() + 10;
+	imgPath = (char*) LVArena::alloc(pathLen);
+	imgPath[0] = 0;
 
-	pathLen = descPath.length() + 10;
-	imgPath = new char[pathLen];
-	auto f = fopen(descPath.c_str(), "r");
+	std::vector<uint8_t> descFile;
+	if(!readFile(strpath, descFile)){
+		ESP_LOGE(tag, "Couldn't open GIF descriptor file at %s", strpath.c_str());
+		return;
+	}
 
-	if(f == nullptr){
-		ESP_LOGE(tag, "Couldn't open GIF descriptor file at %s", descPath.c_str());
+	if(descFile.size() < 8){
+		ESP_LOGE(tag, "Invalid GIF descriptor for %s", path);
 		return;
 	}
 
-	//read w and h as uint16_t variables, most significant byte is read first
-	fread(((uint8_t*) &w) + 1, 1, 1, f);
-	fread(((uint8_t*) &w), 1, 1, f);
-	fread(((uint8_t*) &h) + 1, 1, 1, f);
-	fread(((uint8_t*) &h), 1, 1, f);
-	uint32_t length;
-	fread(((uint8_t*) &length) + 3, 1, 1, f);
-	fread(((uint8_t*) &length) + 2, 1, 1, f);
-	fread(((uint8_t*) &length) + 1, 1, 1, f);
-	fread(((uint8_t*) &length), 1, 1, f);
+	//w, h, frame count and durations are stored with most significant byte first
+	auto d = descFile.data();
+	w = (d[0] << 8) | d[1];
+	h = (d[2] << 8) | d[3];
+	uint32_t length = (d[4] << 24) | (d[5] << 16) | (d[6] << 8) | d[7];
+	length = std::min(length, (uint32_t) (descFile.size() - 8) / 2);
 	durations.reserve(length);
 	for(int i = 0; i < length; i++){
-		uint16_t duration;
-		fread(((uint8_t*) &duration) + 1, 1, 1, f);
-		fread(((uint8_t*) &duration), 1, 1, f);
+		uint16_t duration = (d[8 + i * 2] << 8) | d[9 + i * 2];
 		durations.push_back(duration * 10);
 	}
 
-	fclose(f);
-
 	lv_obj_set_size(obj, w, h);
 	lv_obj_set_style_bg_opa(obj, LV_OPA_TRANSP, 0);
 	img = lv_img_create(obj);
 
-	sprintf(imgPath, "%s/%lu.bin", path, index);
-	lv_img_set_src(img, imgPath);
+	initDelta();
+	initRing(ringSize);
+	if(!patches.empty()){
+		if(ring.empty() || !loadFrame(base, 0)){
+			snprintf(imgPath, pathLen, "%s/0.bin", path);
+			lv_img_set_src(img, imgPath);
+		}else{
+			lv_img_set_src(img, &base.dsc);
+		}
+	}
+	showFrame(index);
+
 	timer = lv_timer_create([](lv_timer_t* t){
 		auto gif = (LVGIF*) t->user_data;
 		gif->index++;
@@ -60,9 +98,7 @@ LVGIF::LVGIF(lv_obj_t* parent, const char* path) : LVObject(parent), path(path){
 		}
 
 		lv_timer_set_period(gif->timer, gif->durations[gif->index]);
-		lv_img_cache_invalidate_src(gif->imgPath);
-		sprintf(gif->imgPath, "%s/%lu.bin", gif->path, gif->index);
-		lv_img_set_src(gif->img, gif->imgPath);
+		gif->showFrame(gif->index);
 
 	}, durations[index], this);
 	lv_timer_pause(timer);
@@ -70,7 +106,11 @@ LVGIF::LVGIF(lv_obj_t* parent, const char* path) : LVObject(parent), path(path){
 
 LVGIF::~LVGIF(){
 	lv_timer_del(timer);
-	delete imgPath;
+	for(auto& slot : ring){
+		if(slot.index >= 0) lv_img_cache_invalidate_src(&slot.dsc);
+	}
+	if(base.index >= 0) lv_img_cache_invalidate_src(&base.dsc);
+	LVArena::free(imgPath);
 }
 
 void LVGIF::start(){
@@ -83,8 +123,7 @@ void LVGIF::stop(){
 
 void LVGIF::reset(){
 	index = 0;
-	sprintf(imgPath, "%s/%lu.bin", path, index);
-	lv_img_set_src(img, imgPath);
+	showFrame(index);
 	lv_timer_set_period(timer, durations[index]);
 	lv_timer_reset(timer);
 	lv_timer_resume(timer);
@@ -100,12 +139,183 @@ void LVGIF::setDoneCallback(std::function<void()> cb){
 
 void LVGIF::setImage(uint index){
 	this->index = index;
-	sprintf(imgPath, "%s/%d.bin", path, index);
-	lv_img_set_src(img, imgPath);
+	showFrame(index);
 	lv_timer_reset(timer);
 	lv_timer_resume(timer);
 }
 
+void LVGIF::release(){
+	lv_timer_pause(timer);
+	index = 0;
+	showFrame(index);
+
+	// Frame 0 is in one of the slots, or in base with delta frames
+	for(auto& slot : ring){
+		if(slot.index <= 0) continue;
+		lv_img_cache_invalidate_src(&slot.dsc);
+		slot.file.reset();
+		slot.index = -1;
+	}
+}
+
 size_t LVGIF::getNumFrames() const{
 	return durations.size();
 }
+
+size_t LVGIF::getRingMemory() const{
+	return ringMemory;
+}
+
+void LVGIF::initRing(uint8_t ringSize){
+	if(ringSize == 0 || durations.empty()) return;
+
+	// Frames mapped straight from the bundle are free to keep, others are copied or decompressed into RAM
+	bool allMapped = true;
+	size_t maxFrame = 0;
+	size_t total = 0;
+	for(size_t i = 0; i < durations.size(); i++){
+		if(!hasFile(i)) continue;
+
+		const auto relPath = framePath + "/" + std::to_string(i) + ".bin";
+		const auto asset = FSLVGL::getAsset(relPath.c_str());
+
+		size_t cost = 0;
+		if(asset.compressed()){
+			cost = asset.rawSize;
+		}else if(asset.data == nullptr){
+			struct stat st;
+			const auto spath = "/spiffs" + relPath;
+			cost = stat(spath.c_str(), &st) == 0 ? st.st_size : 0;
+		}
+
+		allMapped &= (asset.data && !asset.compressed());
+		maxFrame = std::max(maxFrame, cost);
+		total += cost;
+	}
+
+	size_t count = std::min((size_t) ringSize, durations.size());
+	if(allMapped){
+		count = durations.size();
+	}else if(count < durations.size()){
+		count = std::min(count, (size_t) 2);
+	}
+	ringMemory = (count == durations.size()) ? total : maxFrame * count;
+
+	ESP_LOGI(tag, "%s: %zu frame ring, %zu B", path, count, ringMemory);
+
+	ring.resize(count);
+}
+
+bool LVGIF::loadFrame(Frame& slot, uint32_t frame){
+	if(slot.index == (int32_t) frame) return true;
+
+	if(slot.index >= 0){
+		lv_img_cache_invalidate_src(&slot.dsc);
+		slot.index = -1;
+	}
+
+	// Not in imgPath, that holds the path the fallback last set as the source
+	const auto relPath = framePath + "/" + std::to_string(frame) + ".bin";
+	const auto spath = "/spiffs" + relPath;
+	const auto asset = FSLVGL::getAsset(relPath.c_str());
+	if(asset.compressed()){
+		slot.file = std::make_unique<RamFile>(spath.c_str(), asset.data, asset.size, asset.rawSize);
+	}else if(asset.data){
+		slot.file = std::make_unique<RamFile>(spath.c_str(), asset.data, asset.size);
+	}else{
+		slot.file = std::make_unique<RamFile>(spath.c_str());
+	}
+
+	if(slot.file->buffer() == nullptr || slot.file->size() <= sizeof(lv_img_header_t)){
+		slot.file.reset();
+		return false;
+	}
+
+	memcpy(&slot.dsc.header, slot.file->buffer(), sizeof(lv_img_header_t));
+	slot.dsc.data_size = slot.file->size() - sizeof(lv_img_header_t);
+	slot.dsc.data = slot.file->buffer() + sizeof(lv_img_header_t);
+	slot.index = frame;
+
+	return true;
+}
+
+void LVGIF::initDelta(){
+	std::vector<uint8_t> data;
+	if(!readFile(framePath + "/delta.bin", data)) return;
+	if(data.size() != durations.size() * 9){
+		ESP_LOGW(tag, "%s: delta.bin doesn't match the frame count, playing full frames", path);
+		return;
+	}
+
+	patches.resize(durations.size());
+	for(size_t i = 0; i < patches.size(); i++){
+		const auto d = data.data() + i * 9;
+		patches[i] = { (uint16_t) ((d[0] << 8) | d[1]), (uint16_t) ((d[2] << 8) | d[3]),
+					   (uint16_t) ((d[4] << 8) | d[5]), (uint16_t) ((d[6] << 8) | d[7]), d[8] };
+	}
+
+	patch = lv_img_create(obj);
+	lv_obj_add_flag(patch, LV_OBJ_FLAG_HIDDEN);
+}
+
+bool LVGIF::hasFile(uint32_t frame) const{
+	return patches.empty() || patches[frame].w != 0;
+}
+
+void LVGIF::showFrame(uint32_t frame){
+	lv_obj_t* target = img;
+
+	if(!patches.empty()){
+		// Frame 0 stays on img, other frames are drawn as a patch over it so only the changed area gets redrawn
+		const auto& p = patches[frame];
+		if(frame == 0 || p.w == 0){
+			lv_obj_clear_flag(img, LV_OBJ_FLAG_HIDDEN);
+			lv_obj_add_flag(patch, LV_OBJ_FLAG_HIDDEN);
+			return;
+		}
+
+		if(p.flags & PatchFull){
+			lv_obj_add_flag(img, LV_OBJ_FLAG_HIDDEN);
+		}else{
+			lv_obj_clear_flag(img, LV_OBJ_FLAG_HIDDEN);
+		}
+		lv_obj_set_pos(patch, p.x, p.y);
+		lv_obj_clear_flag(patch, LV_OBJ_FLAG_HIDDEN);
+		target = patch;
+	}
+
+	if(ring.size() == durations.size()){
+		auto& slot = ring[frame];
+		if(loadFrame(slot, frame)){
+			lv_img_set_src(target, &slot.dsc);
+			return;
+		}
+	}else if(ring.size() == 1){
+		if(loadFrame(ring[0], frame)){
+			lv_img_set_src(target, &ring[0].dsc);
+			return;
+		}
+	}else if(!ring.empty()){
+		// Frames only ever go into the back slot, which then comes to the front, so the frame on screen is never
+		// overwritten. The next frame is preloaded into the new back slot, the following switch only swaps them.
+		if(ring[front].index != (int32_t) frame){
+			if(loadFrame(ring[1 - front], frame)){
+				front = 1 - front;
+			}
+		}
+
+		if(ring[front].index == (int32_t) frame){
+			lv_img_set_src(target, &ring[front].dsc);
+
+			const auto next = (frame + 1) % durations.size();
+			if(hasFile(next) && (patches.empty() || next != 0)){
+				loadFrame(ring[1 - front], next);
+			}
+			return;
+		}
+	}
+
+	snprintf(imgPath, pathLen, "%s/%lu.bin", path, frame);
+	lv_img_cache_invalidate_src(imgPath);
+	lv_img_set_src(target, imgPath);
+}
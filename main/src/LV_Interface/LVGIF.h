@@ -4,15 +4,26 @@
 #include "LVObject.h"
 #include <vector>
 #include <functional>
+#include <memory>
+#include <string>
+#include "Util/RamFile.h"
 
 /**
  * For GIFs converted using LVGL GIF converter (https://github.com/CircuitMess/LVGL_GIFConverter)
  */
 class LVGIF : public LVObject {
 public:
-	LVGIF(lv_obj_t* parent, const char* path);
+	/**
+	 * @param ringSize Number of frames kept loaded as image descriptors, so frame switches don't go through the filesystem.
+	 * 				   0 opens every frame by path, RingAll keeps all of them. Frames mapped from the asset bundle cost no RAM
+	 * 				   and are always all kept. A ring short of all frames is a front slot on screen and a back one the
+	 * 				   next frame is preloaded into, so more than 2 only cost RAM.
+	 */
+	LVGIF(lv_obj_t* parent, const char* path, uint8_t ringSize = 0);
 	~LVGIF() override;
 
+	static constexpr uint8_t RingAll = UINT8_MAX;
+
 	enum class LoopType {
 		Single, // play only one loop
 		On // loop indefinitely
@@ -24,8 +35,14 @@ public:
 	void setLooping(LoopType loop);
 	void setDoneCallback(std::function<void()> cb);
 	void setImage(size_t index);
+
+	/** Stops on the first frame and frees every other loaded frame, for GIFs that aren't played for a while. */
+	void release();
 	[[nodiscard]] size_t getNumFrames() const;
 
+	/** @return RAM held by the frame ring when it's full. [B] */
+	[[nodiscard]] size_t getRingMemory() const;
+
 private:
 	lv_obj_t* img;
 	lv_timer_t* timer;
@@ -40,6 +57,33 @@ private:
 
 	LoopType loopType = LoopType::On;
 	std::function<void()> cb;
+
+	struct Frame {
+		lv_img_dsc_t dsc;
+		std::unique_ptr<RamFile> file;
+		int32_t index = -1;
+	};
+	std::vector<Frame> ring;
+	size_t front = 0; // Slot on screen in a sliding window, the other one is the back slot
+	size_t ringMemory = 0;
+	std::string framePath; // Relative to the filesystem root, without the frame number
+
+	/** Delta-encoded GIFs (tools/gif_delta.py) store frames after the first one as the rectangle that differs from it. */
+	struct Patch {
+		uint16_t x, y, w, h;
+		uint8_t flags;
+	};
+	static constexpr uint8_t PatchFull = 1; // Frame isn't a patch, frame 0 is hidden while it's shown
+	std::vector<Patch> patches;
+	lv_obj_t* patch = nullptr;
+	Frame base; // Frame 0 in delta mode, kept outside the ring
+
+	void initDelta();
+	bool hasFile(uint32_t frame) const;
+
+	void initRing(uint8_t ringSize);
+	bool loadFrame(Frame& slot, uint32_t frame);
+	void showFrame(uint32_t frame);
 };
 
 
@@ -1,68 +1,584 @@
 #include "LVGL.h"
 #include <lvgl.h>
+#include <core/lv_refr.h>
 #include "LVScreen.h"
 #include "InputLVGL.h"
+#include "LVBlend.h"
+#include "LVImgCache.h"
+#include "LVImgDirect.h"
+#include "LVMem.h"
+#include "LVText.h"
+#include "LVDirectScreen.h"
+#include "FSLVGL.h"
 #include "Util/Services.h"
 #include "Services/SleepMan.h"
+#include "Services/Console.h"
+#include "Services/RTCTelemetry.h"
+#include "Util/stdafx.h"
+#include "Util/Trace.h"
+#include "Util/Hot.h"
+#include "Util/PSRAM.h"
+#include "Util/TaskPlan.h"
+#include <esp_heap_caps.h>
+#include <esp_memory_utils.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
 
-LVGL::LVGL(Display& display) : Threaded("LVGL", 4 * 1024, 6, 1), display(display){
+static const char* TAG = "LVGL";
+
+#ifdef CONFIG_CM_LVGL_NATIVE_COLOR
+static_assert(LV_COLOR_DEPTH == 16 && LV_COLOR_16_SWAP, "Native panel color format needs LVGL to render byte-swapped RGB565");
+#endif
+
+#ifdef CONFIG_CM_LVGL_DRAW_BUF_STATIC
+DMA_ATTR lv_color_t LVGL::staticBuffers[BufferCount][BufferPixels];
+#endif
+
+LVGL::LVGL(Display& display) : Threaded("LVGL", 4 * 1024, PlannedTask::LVGL), display(display), renderLock(PowerProfile::Performance, "Render"),
+							   wakeQueue(12, "LVGL wake"), loopGuard("LVGL loop", CONFIG_CM_UI_STALL_BUDGET, StallWatchdog){
 	lv_init();
-	lv_disp_draw_buf_init(&lvDrawBuf, drawBuffer, nullptr, sizeof(drawBuffer) / 2);
+	allocBuffers();
+	lv_disp_draw_buf_init(&lvDrawBuf, drawBuffer[0], drawBuffer[1], BufferPixels);
 
 	lv_disp_drv_init(&lvDispDrv);
 	lvDispDrv.hor_res = 128;
 	lvDispDrv.ver_res = 128;
 	lvDispDrv.flush_cb = flush;
+	lvDispDrv.render_start_cb = renderStart;
+#ifdef CONFIG_CM_LVGL_FAST_BLEND
+	lvDispDrv.draw_ctx_init = LVBlend::initCtx;
+#endif
+#ifdef CONFIG_CM_LVGL_PROFILER
+	lvDispDrv.monitor_cb = monitor;
+#endif
 	lvDispDrv.draw_buf = &lvDrawBuf;
 	lvDispDrv.user_data = this;
 	lvDisplay = lv_disp_drv_register(&lvDispDrv);
+#ifdef CONFIG_CM_LVGL_DIRECT_IMG
+	LVImgDirect::init();
+#endif
+	LVImgCache::init(lvDisplay);
+
+	callDone = xSemaphoreCreateBinary();
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ call([this, &print](){ printReport(print); }); },
+						   [this](){ call([this](){ resetStats(); }); });
+	}
+
+	Events::listen(Facility::Input, &wakeQueue);
+	Events::listen(Facility::Motion, &wakeQueue);
+	Events::listen(Facility::Phone, &wakeQueue);
+	Events::listen(Facility::Time, &wakeQueue);
+	Events::listen(Facility::Battery, &wakeQueue);
 }
 
 LVGL::~LVGL(){
 	stop();
+	Events::unlisten(&wakeQueue);
+	vSemaphoreDelete(callDone);
+
+#ifndef CONFIG_CM_LVGL_DRAW_BUF_STATIC
+	for(auto buf : drawBuffer){
+		free(buf);
+	}
+#endif
+#ifdef CONFIG_CM_LVGL_DRAW_BUF_PSRAM
+	for(auto buf : bounceBuffer){
+		free(buf);
+	}
+#endif
+}
+
+void LVGL::allocBuffers(){
+	for(uint8_t i = 0; i < BufferCount; i++){
+#ifdef CONFIG_CM_LVGL_DRAW_BUF_STATIC
+		drawBuffer[i] = staticBuffers[i];
+#else
+#ifdef CONFIG_CM_LVGL_DRAW_BUF_PSRAM
+		if(PSRAM::available()){
+			drawBuffer[i] = (lv_color_t*) heap_caps_malloc(BufferPixels * sizeof(lv_color_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+		}
+		if(drawBuffer[i] != nullptr) continue;
+#endif
+		drawBuffer[i] = (lv_color_t*) heap_caps_malloc(BufferPixels * sizeof(lv_color_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+		if(drawBuffer[i] == nullptr){
+			ESP_LOGE(TAG, "Couldn't allocate draw buffer %d. Need %zu B, largest block: %zu B", i, BufferPixels * sizeof(lv_color_t),
+					 heap_caps_get_largest_free_block(MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+			abort();
+		}
+#endif
+	}
+
+#if defined(CONFIG_CM_LVGL_DRAW_BUF_PSRAM) && defined(CONFIG_CM_LVGL_DMA_FLUSH)
+	if(esp_ptr_external_ram(drawBuffer[0])){
+		for(auto& buf : bounceBuffer){
+			buf = (lv_color_t*) heap_caps_malloc(128 * BounceRows * sizeof(lv_color_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+			if(buf == nullptr){
+				ESP_LOGE(TAG, "Couldn't allocate bounce buffer");
+				abort();
+			}
+		}
+	}
+#endif
+
+	ESP_LOGI(TAG, "Draw buffer: %d x %d rows%s", BufferCount, Rows, esp_ptr_external_ram(drawBuffer[0]) ? " in PSRAM" : "");
 }
 
-void LVGL::flush(lv_disp_drv_t* dispDrv, const lv_area_t* area, lv_color_t* pixels){
+LVGL::FrameCounters LVGL::frameCounters = {};
+
+LVGL::FrameCounters LVGL::getFrameCounters(){
+	return frameCounters;
+}
+
+std::atomic<LVGL::FrameObserver> LVGL::frameObserver = nullptr;
+
+void LVGL::setFrameObserver(FrameObserver observer){
+	frameObserver = observer;
+}
+
+void CM_HOT LVGL::flush(lv_disp_drv_t* dispDrv, const lv_area_t* area, lv_color_t* pixels){
+	TRACE_SCOPE("lvgl_flush");
+	const auto flushStart = esp_timer_get_time();
 	auto lvgl = static_cast<LVGL*>(dispDrv->user_data);
-	auto lgfx = lvgl->display.getLGFX();
+	auto& lgfx = lvgl->display.getLGFX();
+
+	// Idle mode only shows 8 colors, whatever is drawn while dimmed comes back in full color
+	if(lvgl->display.isIdle()){
+		lvgl->display.setIdle(false);
+	}
 
 	auto x = area->x1;
 	auto y = area->y1;
 	auto w = (area->x2 - area->x1 + 1);
 	auto h = (area->y2 - area->y1 + 1);
-	auto data = &pixels->full;
+#ifdef CONFIG_CM_LVGL_NATIVE_COLOR
+	// LVGL already renders in panel byte order, LovyanGFX sends the buffer as-is
+	using PanelColor = lgfx::swap565_t;
+#else
+	using PanelColor = uint16_t;
+#endif
+	auto data = (const PanelColor*) pixels;
+
+#ifdef CONFIG_CM_LVGL_PROFILER
+	lvgl->profiler.flushStart();
+#endif
+
+#ifdef CONFIG_CM_LVGL_DMA_FLUSH
+	// Transaction is kept open so endWrite doesn't block on the transfer
+	if(lgfx.getStartCount() == 0){
+		lgfx.startWrite();
+	}
+
+#ifdef CONFIG_CM_LVGL_DRAW_BUF_PSRAM
+	if(lvgl->bounceBuffer[0]){
+		// The bounce buffer being filled was sent two pushes ago, the wait before the last push saw it finish
+		for(int row = 0; row < h; row += BounceRows){
+			const int rows = std::min<int>(BounceRows, h - row);
+			auto bounce = lvgl->bounceBuffer[lvgl->bounceNext];
+			lvgl->bounceNext ^= 1;
+
+			memcpy(bounce, pixels + row * w, w * rows * sizeof(lv_color_t));
+			lgfx.waitDMA();
+			lgfx.pushImageDMA(x, y + row, w, rows, (const PanelColor*) bounce);
+		}
+		// The draw buffer is copied out, so LVGL can render into it again right away
+	}else
+#endif
+	{
+		// Previous stripe has to finish before its buffer is handed back to LVGL
+		lgfx.waitDMA();
+		lgfx.pushImageDMA(x, y, w, h, data);
 
+		// With a single buffer there's nothing to render into during the transfer
+		if(BufferCount == 1){
+			lgfx.waitDMA();
+		}
+	}
+#else
 	lgfx.pushImage(x, y, w, h, data);
+#endif
+
+#ifdef CONFIG_CM_LVGL_PROFILER
+	lvgl->profiler.flushEnd(w * h * sizeof(lv_color_t));
+#endif
+
+	const auto flushEnd = esp_timer_get_time();
+	frameCounters.flushTime += flushEnd - flushStart;
+	if(lv_disp_flush_is_last(dispDrv)){
+		frameCounters.frames++;
+		RTCTelemetry::frameTime(millis() - lvgl->renderTime);
+		if(auto observer = frameObserver.load(std::memory_order_relaxed)){
+			observer(lvgl->frameStart, flushEnd);
+		}
+	}
 
 	lv_disp_flush_ready(dispDrv);
 }
 
+void LVGL::renderStart(lv_disp_drv_t* dispDrv){
+	if(MergeThreshold > 0){
+		coalesceAreas(dispDrv);
+	}
+
+	auto lvgl = static_cast<LVGL*>(dispDrv->user_data);
+	lvgl->renderLock.acquire();
+	lvgl->renderTime = millis();
+	lvgl->frameStart = esp_timer_get_time();
+
+#ifdef CONFIG_CM_LVGL_PROFILER
+	static_cast<LVGL*>(dispDrv->user_data)->profiler.frameStart();
+#endif
+}
+
+#ifdef CONFIG_CM_LVGL_PROFILER
+void LVGL::monitor(lv_disp_drv_t* dispDrv, uint32_t time, uint32_t px){
+	static_cast<LVGL*>(dispDrv->user_data)->profiler.frameEnd();
+}
+#endif
+
+void LVGL::call(const std::function<void()>& fn){
+	std::lock_guard lock(callMut);
+
+	pendingCall.store(&fn);
+	wakeQueue.wake();
+	xSemaphoreTake(callDone, portMAX_DELAY);
+}
+
+void LVGL::printReport(const std::function<void(const char* line)>& print){
+#ifdef CONFIG_CM_LVGL_PROFILER
+	profiler.printReport();
+#endif
+
+	char line[128];
+	const auto fs = FSLVGL::getStats();
+	snprintf(line, sizeof(line), "FS cache: %lu hits, %lu misses, %lu evictions, %zu / %zu B, free internal heap %zu B\n",
+			 fs.hits, fs.misses, fs.evictions, fs.used, fs.budget, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+	print(line);
+	snprintf(line, sizeof(line), "FS streams: %lu reads, %lu syscalls, %ld saved by read-ahead\n",
+			 fs.streamReads, fs.streamSyscalls, (long) fs.streamReads - (long) fs.streamSyscalls);
+	print(line);
+	if(fs.externalBudget > 0){
+		snprintf(line, sizeof(line), "FS PSRAM cache: %zu / %zu B, free PSRAM %zu B\n", fs.externalUsed, fs.externalBudget, PSRAM::getFree());
+		print(line);
+	}
+
+	const auto mem = LVMem::getStats();
+	snprintf(line, sizeof(line), "LVGL pool: %zu / %zu B used, peak %zu B, largest free %zu B, %u%% fragmented%s\n",
+			 mem.used, mem.total, mem.peak, mem.biggest, mem.frag, mem.overflow ? ", overflow pool added" : "");
+	print(line);
+	if(const auto arena = LVArena::getActive()){
+		const auto stats = arena->getStats();
+		snprintf(line, sizeof(line), "Screen arena: %zu chunks, %zu B used, peak %zu B\n", stats.chunks, stats.used, stats.peak);
+		print(line);
+	}
+
+	const auto img = LVImgCache::getStats();
+	snprintf(line, sizeof(line), "Image cache: %u entries, %lu draws, %lu misses, %u resizes\n", img.size, img.draws, img.misses, img.resizes);
+	print(line);
+	const auto text = LVText::getStats();
+	snprintf(line, sizeof(line), "Text: %zu images, %zu B, %lu renders, %lu shared\n", text.entries, text.bytes, text.renders, text.shared);
+	print(line);
+
+	loopGuard.printReport(print);
+}
+
+void LVGL::resetStats(){
+#ifdef CONFIG_CM_LVGL_PROFILER
+	profiler.reset();
+#endif
+	loopGuard.resetStats();
+	FSLVGL::resetStats();
+	LVImgCache::resetStats();
+	LVText::resetStats();
+}
+
+void LVGL::coalesceAreas(lv_disp_drv_t* dispDrv){
+	auto disp = _lv_refr_get_disp_refreshing();
+	if(disp == nullptr || disp->driver != dispDrv) return;
+
+	// LVGL only joins areas when the union isn't bigger than both of them combined. Nearby small areas
+	// (clock digits, status bar icons) are worth merging even with some overdraw, since every separate
+	// area costs a window set and a new SPI transaction.
+	bool merged;
+	do {
+		merged = false;
+
+		for(uint16_t i = 0; i < disp->inv_p; i++){
+			if(disp->inv_area_joined[i]) continue;
+			auto& a = disp->inv_areas[i];
+
+			for(uint16_t j = i + 1; j < disp->inv_p; j++){
+				if(disp->inv_area_joined[j]) continue;
+				auto& b = disp->inv_areas[j];
+
+				lv_area_t joined;
+				_lv_area_join(&joined, &a, &b);
+
+				const uint32_t joinedSize = lv_area_get_size(&joined);
+				const uint32_t separateSize = lv_area_get_size(&a) + lv_area_get_size(&b);
+				if(joinedSize > separateSize + MergeThreshold) continue;
+
+				a = joined;
+				disp->inv_area_joined[j] = 1;
+				merged = true;
+			}
+		}
+	} while(merged);
+}
+
 void LVGL::loop(){
-	auto sleep = (SleepMan*) Services.get(Service::Sleep);
+	const uint32_t loopStart = millis();
+	TRACE_BEGIN("lvgl_loop");
+	loopGuard.begin("sleep");
+
+	auto sleep = Services.get<Service::Sleep>();
 	if(sleep){
 		sleep->loop();
 	}
 
+	loopGuard.phase("screen loop");
 	if(currentScreen){
 		currentScreen->loop();
 	}
 
+	syncDirect();
+
+	loopGuard.phase("lv_timer_handler");
 	auto ttn = lv_timer_handler();
-	if(ttn <= 0 || ttn > LV_DISP_DEF_REFR_PERIOD) ttn = 1;
-	vTaskDelay(ttn);
+
+	if(directCanvas){
+		loopGuard.phase("direct draw");
+		drawDirect();
+
+		const uint32_t now = millis();
+		ttn = std::min(ttn, directFrame > now ? directFrame - now : 0);
+	}
+
+	if(currentScreen){
+		currentScreen->imgCacheSize = LVImgCache::tune();
+	}
+
+	if(renderLock.isLocked() && millis() - renderTime >= RenderHoldoff){
+		renderLock.release();
+	}
+
+#ifdef CONFIG_CM_LVGL_PROFILER
+	profiler.handlerDone(ttn);
+#endif
+
+	if(auto fn = pendingCall.exchange(nullptr)){
+		loopGuard.phase("call");
+		(*fn)();
+		xSemaphoreGive(callDone);
+	}
+
+	applyFramePeriod();
+
+	// Sleep until the next LVGL timer or wake event. Invalidating resumes LVGL's refresh timer, so a pending redraw
+	// is in ttn already. Screens also animate in their loop, while anything does the wait is one frame at most.
+	uint32_t maxWait = framePeriod;
+	const bool animating = !currentScreen || directCanvas || lv_anim_count_running() > 0;
+	auto input = InputLVGL::getInstance();
+	if(!animating){
+		maxWait = std::max(framePeriod, std::min(currentScreen->getLoopPeriod(), MaxIdleWait));
+
+		// Its read timer would wake the thread every LV_INDEV_DEF_READ_PERIOD, input and gestures are wake events
+		if(input){
+			input->suspend();
+		}
+	}
+
+	if(ttn == 0) ttn = 1;
+	if(ttn > maxWait) ttn = maxWait;
+
+	loopGuard.end();
+	RTCTelemetry::loopTime(millis() - loopStart);
+	TRACE_END("lvgl_loop");
+
+	Event evt{};
+	if(wakeQueue.get(evt, pdMS_TO_TICKS(ttn))){
+		wakeQueue.reset();
+
+		// Only on wake events, resumed after a timeout its read would be in the next ttn again
+		if(input){
+			input->resume();
+		}
+	}
+}
+
+void LVGL::onStop(){
+	loopGuard.detach();
+}
+
+void LVGL::syncDirect(){
+	const bool direct = currentScreen && currentScreen->isDirect() && currentScreen.get() != directFailed;
+	if(direct == (bool) directCanvas) return;
+
+	auto& lgfx = display.getLGFX();
+	auto refrTimer = _lv_disp_get_refr_timer(lvDisplay);
+
+	// Whichever side drew last may still be sending its buffer
+	lgfx.waitDMA();
+
+	if(!direct){
+		directCanvas.reset();
+		directFailed = nullptr;
+
+		lv_timer_resume(refrTimer);
+		lv_obj_invalidate(lv_scr_act());
+		return;
+	}
+
+	auto canvas = std::make_unique<LGFX_Sprite>(&lgfx);
+	canvas->setColorDepth(lgfx::rgb565_2Byte);
+	canvas->setPsram(false);
+	if(canvas->createSprite(128, 128) == nullptr){
+		ESP_LOGE(TAG, "Couldn't allocate direct canvas, largest DMA block: %zu B", heap_caps_get_largest_free_block(MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+		directFailed = currentScreen.get();
+		return;
+	}
+	canvas->clear(TFT_BLACK);
+
+	directCanvas = std::move(canvas);
+	directFrame = millis();
+	lv_timer_pause(refrTimer);
+}
+
+void LVGL::drawDirect(){
+	const uint32_t now = millis();
+	if(now < directFrame) return;
+
+	// Frames stay on their period, unless drawing falls behind
+	const uint32_t period = currentScreen->getFramePeriod();
+	directFrame = std::max(directFrame + period, now);
+
+	auto& lgfx = display.getLGFX();
+	lgfx.waitDMA();
+
+	auto screen = static_cast<LVDirectScreen*>(currentScreen.get());
+	const auto start = esp_timer_get_time();
+	if(!screen->draw(*directCanvas)) return;
+
+	renderLock.acquire();
+	renderTime = now;
+
+	// Transaction is kept open like with DMA flushing, the transfer runs while the next frame is simulated
+	if(lgfx.getStartCount() == 0){
+		lgfx.startWrite();
+	}
+	lgfx.pushImageDMA(0, 0, 128, 128, (const lgfx::swap565_t*) directCanvas->getBuffer());
+
+	// Ends once the transfer is queued, it runs while the next frame is simulated
+	if(auto observer = frameObserver.load(std::memory_order_relaxed)){
+		observer(start, esp_timer_get_time());
+	}
+}
+
+void LVGL::render(lv_obj_t* obj, const lv_area_t& area, lv_color_t* surface){
+	lv_disp_t* disp = lv_obj_get_disp(obj);
+	lv_area_t clip = area;
+
+	lv_disp_drv_t driver;
+	lv_disp_drv_init(&driver);
+	driver.hor_res = lv_area_get_width(&area);
+	driver.ver_res = lv_area_get_height(&area);
+
+	lv_disp_t fake{};
+	fake.driver = &driver;
+
+	auto ctx = (lv_draw_ctx_t*) lv_mem_alloc(disp->driver->draw_ctx_size);
+	if(ctx == nullptr) return;
+	disp->driver->draw_ctx_init(&driver, ctx);
+	ctx->clip_area = &clip;
+	ctx->buf_area = &clip;
+	ctx->buf = surface;
+	driver.draw_ctx = ctx;
+
+	auto refreshing = _lv_refr_get_disp_refreshing();
+	_lv_refr_set_disp_refreshing(&fake);
+	lv_obj_redraw(ctx, obj);
+	_lv_refr_set_disp_refreshing(refreshing);
+
+	disp->driver->draw_ctx_deinit(&driver, ctx);
+	lv_mem_free(ctx);
+}
+
+void LVGL::markInput(uint64_t time){
+#ifdef CONFIG_CM_LVGL_PROFILER
+	auto disp = lv_disp_get_default();
+	if(disp == nullptr) return;
+	static_cast<LVGL*>(disp->driver->user_data)->profiler.markInput(time);
+#endif
+}
+
+void LVGL::applyFramePeriod(){
+	uint32_t period = currentScreen ? currentScreen->getFramePeriod() : LVScreen::DefaultFramePeriod;
+	if(idleRefresh){
+		period = idleRefresh;
+	}
+	if(period == framePeriod) return;
+
+	framePeriod = period;
+	lv_timer_set_period(_lv_disp_get_refr_timer(lvDisplay), framePeriod);
 }
 
 void LVGL::startScreen(std::function<std::unique_ptr<LVScreen>()> create){
-	stopScreen();
+	startScreen(nullptr, create);
+}
+
+void LVGL::startScreen(const void* key, std::function<std::unique_ptr<LVScreen>()> create){
+	LoopGuard::Span span("startScreen");
+
+	if(key && currentScreen && currentScreen->key == key){
+		if(!currentScreen->isRunning()){
+			currentScreen->start(this);
+			lv_indev_set_group(InputLVGL::getInstance()->getIndev(), currentScreen->inputGroup);
+			currentScreen->onStart();
+		}
+		lv_obj_invalidate(*currentScreen);
+		applyImageCache();
+		return;
+	}
 
-	lv_obj_t* tmp = lv_obj_create(nullptr);
-	lv_scr_load_anim(tmp, LV_SCR_LOAD_ANIM_NONE, 0, 0, false);
+	if(auto resident = takeResident(key)){
+		show(std::move(resident));
+		return;
+	}
 
-	currentScreen.reset();
+	stopScreen();
+	auto previous = std::move(currentScreen);
+
+	// The previous screen normally stays on the display until the new one is loaded over it
+	const auto mem = LVMem::getFree();
+	const bool prebuild = mem.heap >= PrebuildReserve && (LV_MEM_CUSTOM || mem.pool >= PrebuildPoolReserve);
+	if(!prebuild){
+		ESP_LOGW(TAG, "Low on memory, %zu B heap and %zu B pool, destroying the previous screen before building",
+				 mem.heap, mem.pool);
+		lv_obj_t* tmp = lv_obj_create(nullptr);
+		lv_scr_load_anim(tmp, LV_SCR_LOAD_ANIM_NONE, 0, 0, false);
+		previous.reset();
+	}
 
+	// Objects go in LVGL's pool and everything else on the heap, a screen's size is what it took from both
+	const auto before = LVMem::getFree();
+	const auto buildStart = esp_timer_get_time();
 	currentScreen = create();
+	const auto buildTime = (uint32_t) (esp_timer_get_time() - buildStart);
+	currentScreen->key = key;
+	const auto after = LVMem::getFree();
+	const size_t heap = before.heap - std::min(before.heap, after.heap);
+	const size_t pool = before.pool - std::min(before.pool, after.pool);
+	currentScreen->heapSize = heap + pool;
+	ESP_LOGD(TAG, "Screen built in %lu us, %zu B heap, %zu B pool", buildTime, heap, pool);
+	LVMem::check();
+	LVArena::setActive(currentScreen->arena.get());
 	currentScreen->start(this);
-	lv_scr_load_anim(*currentScreen, LV_SCR_LOAD_ANIM_NONE, 0, 0, true);
+	applyImageCache();
+	lv_scr_load_anim(*currentScreen, LV_SCR_LOAD_ANIM_NONE, 0, 0, !prebuild);
+
+	park(std::move(previous));
 }
 
 void LVGL::stopScreen(){
@@ -71,6 +587,81 @@ void LVGL::stopScreen(){
 	lv_indev_set_group(InputLVGL::getInstance()->getIndev(), nullptr);
 }
 
+bool LVGL::resumeSuspended(){
+	if(currentScreen && currentScreen->isPersistent()){
+		if(!currentScreen->isRunning()){
+			currentScreen->start(this);
+			lv_indev_set_group(InputLVGL::getInstance()->getIndev(), currentScreen->inputGroup);
+			currentScreen->onStart();
+		}
+		lv_obj_invalidate(*currentScreen);
+		applyImageCache();
+		return true;
+	}
+
+	if(residents.empty()) return false;
+
+	auto last = std::max_element(residents.begin(), residents.end(), [](const Resident& a, const Resident& b){ return a.lastUse < b.lastUse; });
+	auto screen = std::move(last->screen);
+	residents.erase(last);
+	show(std::move(screen));
+
+	return true;
+}
+
+std::unique_ptr<LVScreen> LVGL::takeResident(const void* key){
+	if(key == nullptr) return nullptr;
+
+	auto it = std::find_if(residents.begin(), residents.end(), [key](const Resident& r){ return r.screen->key == key; });
+	if(it == residents.end()) return nullptr;
+
+	auto screen = std::move(it->screen);
+	residents.erase(it);
+	return screen;
+}
+
+void LVGL::show(std::unique_ptr<LVScreen> screen){
+	stopScreen();
+	auto previous = std::move(currentScreen);
+
+	currentScreen = std::move(screen);
+	LVArena::setActive(currentScreen->arena.get());
+	currentScreen->start(this);
+	applyImageCache();
+	lv_scr_load_anim(*currentScreen, LV_SCR_LOAD_ANIM_NONE, 0, 0, false);
+	lv_obj_invalidate(*currentScreen);
+
+	park(std::move(previous));
+}
+
+void LVGL::park(std::unique_ptr<LVScreen> screen){
+	if(!screen || !screen->isPersistent()) return; // Destroyed on return
+
+	residents.push_back({ std::move(screen), ++useCounter });
+
+	for(;;){
+		size_t heap = 0;
+		for(const auto& r : residents){
+			heap += r.screen->heapSize;
+		}
+		if(residents.size() <= MaxResident && heap <= ResidentBudget) return;
+
+		auto oldest = std::min_element(residents.begin(), residents.end(), [](const Resident& a, const Resident& b){ return a.lastUse < b.lastUse; });
+		ESP_LOGD(TAG, "Evicting a resident screen (%zu B)", oldest->screen->heapSize);
+		residents.erase(oldest);
+	}
+}
+
+void LVGL::applyImageCache(){
+	if(!currentScreen) return;
+	currentScreen->imgCacheSize = LVImgCache::apply(currentScreen->imgCacheMin, currentScreen->imgCacheMax, currentScreen->imgCacheSize);
+}
+
+void LVGL::setIdleRefresh(uint32_t period){
+	idleRefresh = period;
+	applyFramePeriod();
+}
+
 lv_disp_t* LVGL::disp() const{
 	return lvDisplay;
 }
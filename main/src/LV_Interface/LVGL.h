@@ -5,7 +5,17 @@
 #include "Devices/Display.h"
 #include "LVScreen.h"
 #include "Util/Threaded.h"
+#include "LVProfiler.h"
+#include "Util/Events.h"
+#include "Util/PowerLock.h"
+#include "Util/LoopGuard.h"
 #include <hal/lv_hal_disp.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <sdkconfig.h>
 
 class LVGL : public Threaded {
 public:
@@ -14,16 +24,101 @@ public:
 
 	lv_disp_t* disp() const;
 
+	/** Always counted, for live readouts. Rates come from the difference between two reads. */
+	struct FrameCounters {
+		uint32_t frames; // Rendered since boot
+		uint64_t flushTime; // [us] spent in flush since boot
+	};
+	static FrameCounters getFrameCounters();
+
+	/**
+	 * Called on the LVGL thread once every frame is pushed, LVGL-rendered and direct alike, with its start and end [us].
+	 * For harnesses that need every frame, the profiler only keeps the last few. One observer, nullptr removes it.
+	 */
+	using FrameObserver = void (*)(uint64_t start, uint64_t end);
+	static void setFrameObserver(FrameObserver observer);
+
+	/**
+	 * Starts a screen of type T. A resident one is loaded as it is, otherwise it's built while the previous screen is
+	 * still shown and loaded straight over it, without a blank frame in between.
+	 */
+	template<typename T>
+	void startScreen(){
+		startScreen(LVScreen::typeKey<T>(), [](){ return std::make_unique<T>(); });
+	}
+
+	/** Like startScreen<T>(), key identifies the screen type for residency, nullptr if it can't be found again. */
+	void startScreen(const void* key, std::function<std::unique_ptr<LVScreen>()> create);
 	void startScreen(std::function<std::unique_ptr<LVScreen>()> create);
 
 	/** startScreen should be called immediately after this function. */
 	void stopScreen();
 
+	/**
+	 * Restarts the current screen if it is persistent and stopped, or brings back the most recently used resident one.
+	 * The screen is started and invalidated, nothing is rebuilt.
+	 * @return False if there's no persistent screen to resume
+	 */
+	bool resumeSuspended();
+
+	/**
+	 * Overrides the screen's refresh rate while the UI is idle. Invalidated areas are collected and flushed
+	 * once per period. Set to 0 to go back to the screen's own rate.
+	 * @param period [ms]
+	 */
+	void setIdleRefresh(uint32_t period);
+
+	/**
+	 * Marks that input sampled at time [us] was applied to the UI. With the profiler enabled, the latency from the
+	 * sample to the end of the next refreshed frame is recorded. No-op otherwise. Safe to call from any task.
+	 */
+	static void markInput(uint64_t time);
+
+	/**
+	 * Draws obj as it's laid out now into surface, which covers area in screen coordinates, without touching the
+	 * display. Like lv_snapshot, but of any area and blended over what surface already holds.
+	 */
+	static void render(lv_obj_t* obj, const lv_area_t& area, lv_color_t* surface);
+
+	/**
+	 * Runs fn on the LVGL thread and waits for it, for other tasks reading state only that thread touches. Returns once
+	 * the next loop iteration ran it, so it waits for the thread to start and must never be called from it.
+	 */
+	void call(const std::function<void()>& fn);
+
 private:
 	Display& display;
 
+#if defined(CONFIG_CM_LVGL_DRAW_BUF_FULL)
+	static constexpr uint8_t Rows = 128;
+	static constexpr uint8_t BufferCount = 1;
+#elif defined(CONFIG_CM_LVGL_DRAW_BUF_QUARTER_DOUBLE)
+	static constexpr uint8_t Rows = 32;
+	static constexpr uint8_t BufferCount = 2;
+#elif defined(CONFIG_CM_LVGL_DRAW_BUF_FULL_DOUBLE)
+	static constexpr uint8_t Rows = 128;
+	static constexpr uint8_t BufferCount = 2;
+#elif defined(CONFIG_CM_LVGL_DMA_FLUSH)
+	/** 32-row stripe split into two halves, LVGL renders into one while the other is being sent. */
+	static constexpr uint8_t Rows = 16;
+	static constexpr uint8_t BufferCount = 2;
+#else
 	static constexpr uint8_t Rows = 32;
-	uint8_t drawBuffer[2*128*Rows];
+	static constexpr uint8_t BufferCount = 1;
+#endif
+	static constexpr size_t BufferPixels = 128 * Rows;
+
+	lv_color_t* drawBuffer[2] = { nullptr, nullptr };
+#ifdef CONFIG_CM_LVGL_DRAW_BUF_STATIC
+	static lv_color_t staticBuffers[BufferCount][BufferPixels];
+#endif
+#ifdef CONFIG_CM_LVGL_DRAW_BUF_PSRAM
+	/** DMA only reads internal RAM, flushes from PSRAM are copied through two of these. One is filled while the other is sent. */
+	static constexpr uint8_t BounceRows = 16;
+	lv_color_t* bounceBuffer[2] = { nullptr, nullptr };
+	uint8_t bounceNext = 0;
+#endif
+	void allocBuffers();
 
 	lv_disp_draw_buf_t lvDrawBuf;
 	lv_disp_drv_t lvDispDrv;
@@ -31,10 +126,88 @@ private:
 
 	static void flush(lv_disp_drv_t* dispDrv, const lv_area_t* area, lv_color_t* pixels);
 
+	/** Max number of pixels that merging two dirty areas may redraw needlessly. [px] */
+	static constexpr uint32_t MergeThreshold = CONFIG_CM_LVGL_MERGE_THRESHOLD;
+	static void coalesceAreas(lv_disp_drv_t* dispDrv);
+
+	static void renderStart(lv_disp_drv_t* dispDrv);
+
+	/** Performance profile from the start of a frame until no frame was rendered for RenderHoldoff */
+	PowerLock renderLock;
+	uint32_t renderTime = 0; // [ms] start of the last rendered frame
+	uint64_t frameStart = 0; // [us] start of the last rendered frame, for the observer
+	static FrameCounters frameCounters;
+	static std::atomic<FrameObserver> frameObserver;
+	static constexpr uint32_t RenderHoldoff = 100; // [ms]
+
+#ifdef CONFIG_CM_LVGL_PROFILER
+	LVProfiler profiler;
+	static void monitor(lv_disp_drv_t* dispDrv, uint32_t time, uint32_t px);
+#endif
+
+	/** Handed over by call(), one at a time */
+	std::mutex callMut;
+	std::atomic<const std::function<void()>*> pendingCall = nullptr;
+	SemaphoreHandle_t callDone;
+
+	/** The UI side's counters for the console, run through call() */
+	void printReport(const std::function<void(const char* line)>& print);
+	void resetStats();
+
 	void loop() override;
+	void onStop() override;
 
 	std::unique_ptr<LVScreen> currentScreen;
 
+	/**
+	 * Persistent screens that another one replaced, kept with their objects and assets. At most MaxResident stay, and
+	 * only as long as the heap they took when built fits ResidentBudget, least recently used ones are destroyed first.
+	 */
+	struct Resident {
+		std::unique_ptr<LVScreen> screen;
+		uint32_t lastUse;
+	};
+	std::vector<Resident> residents;
+	uint32_t useCounter = 0;
+	static constexpr size_t MaxResident = 2;
+	static constexpr size_t ResidentBudget = 64 * 1024; // [B]
+
+	/** Below this much free heap or LVGL pool, the previous screen is destroyed before the next one is built. */
+	static constexpr size_t PrebuildReserve = 48 * 1024; // [B] of heap
+	static constexpr size_t PrebuildPoolReserve = 16 * 1024; // [B] of LVGL's pool
+
+	std::unique_ptr<LVScreen> takeResident(const void* key);
+	void park(std::unique_ptr<LVScreen> screen);
+	void show(std::unique_ptr<LVScreen> screen);
+
+	/** Wakes the thread before the next LVGL timer is due, so screens handle events without waiting. call() too. */
+	EventQueue wakeQueue;
+
+	/** Longest wait while idle whatever the screen's loop period, SleepMan counts its timeouts in seconds. */
+	static constexpr uint32_t MaxIdleWait = 1000; // [ms]
+
+	/** Logs and counts loop iterations over CM_UI_STALL_BUDGET, with the phase or span they spent the longest in */
+	LoopGuard loopGuard;
+#ifdef CONFIG_CM_UI_STALL_WDT
+	static constexpr bool StallWatchdog = true;
+#else
+	static constexpr bool StallWatchdog = false;
+#endif
+	uint32_t framePeriod = LVScreen::DefaultFramePeriod;
+	uint32_t idleRefresh = 0;
+	void applyFramePeriod();
+
+	void applyImageCache();
+
+	/** Full-frame canvas while the current screen is a direct one, LVGL's refresh is paused meanwhile */
+	std::unique_ptr<LGFX_Sprite> directCanvas;
+	const LVScreen* directFailed = nullptr; // Direct screen the canvas couldn't be allocated for, shown through LVGL
+	uint32_t directFrame = 0; // [ms] the next direct frame is due
+
+	/** Takes the display from LVGL or hands it back, following the current screen */
+	void syncDirect();
+	void drawDirect();
+
 };
 
 
@@ -0,0 +1,124 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVGAME_H
+#define CLOCKSTAR_FIRMWARE_LVGAME_H
+
+#include "LVScreen.h"
+#include "Util/StateBuffer.h"
+#include "Util/Threaded.h"
+#include <esp_timer.h>
+#include <algorithm>
+
+/**
+ * Screen for games, with the simulation apart from rendering. step() runs on the game's own thread at a fixed rate,
+ * however late the thread gets woken, so physics behave the same at any frame rate. After each batch of steps the last
+ * two states are handed to the LVGL thread through a StateBuffer, and render() draws between them. Drawing trails the
+ * simulation by one step, in exchange motion stays smooth when frames and steps don't line up.
+ * The simulated State is only touched by the game thread while the game is running, derived screens set it up
+ * before that in their constructor or onGameStart, and pass input to step() through atomics.
+ */
+template<typename State>
+class LVGame : public LVScreen {
+protected:
+	/**
+	 * @param stepRate Simulation steps per second, also used as the screen's frame rate
+	 * The game thread is placed by TaskPlan, off the core LVGL renders on.
+	 */
+	LVGame(const char* name, uint8_t stepRate, size_t stackSize = 4096) :
+			StepPeriod(1000000 / stepRate), thread([this](){ simLoop(); }, name, stackSize, PlannedTask::Game){
+		setFrameRate(stepRate);
+	}
+
+	~LVGame() override{
+		thread.stop();
+	}
+
+	/** Simulation period [us], the time each step() advances */
+	const uint64_t StepPeriod;
+
+	/** Simulated state, only touched from step() while the game is running */
+	State state{};
+
+	/** Game thread, advances state by one StepPeriod */
+	virtual void step(State& state) = 0;
+
+	/**
+	 * LVGL thread, draws the game between two consecutive states
+	 * @param alpha 0 at prev, 1 at curr
+	 */
+	virtual void render(const State& prev, const State& curr, float alpha) = 0;
+
+	/** LVGL thread, before the game thread starts and after it stopped */
+	virtual void onGameStart(){}
+	virtual void onGameStop(){}
+
+	/** LVGL thread, every loop after the frame is rendered, for input and UI outside of the game. May transition away. */
+	virtual void onLoop(){}
+
+	static float lerp(float a, float b, float alpha){
+		return a + (b - a) * alpha;
+	}
+
+private:
+	static constexpr uint8_t MaxCatchUp = 4; // Steps run at once after a stall, older ones are dropped
+
+	struct Frame {
+		State prev;
+		State curr;
+		uint64_t time; // [us] the simulation reached curr
+	};
+	StateBuffer<Frame> frames;
+
+	ThreadedClosure thread;
+	uint64_t lastTime = 0; // [us]
+	uint64_t lag = 0; // [us] of wall time not simulated yet
+
+	void onStart() override{
+		onGameStart();
+
+		frames.clear();
+		frames.publish({ state, state, (uint64_t) esp_timer_get_time() });
+
+		lastTime = esp_timer_get_time();
+		lag = 0;
+		thread.start();
+	}
+
+	void onStop() override{
+		thread.stop();
+		onGameStop();
+	}
+
+	void loop() override{
+		if(auto frame = frames.read()){
+			const uint64_t now = esp_timer_get_time();
+			const float alpha = now > frame->time ? std::min(1.0f, (float) (now - frame->time) / (float) StepPeriod) : 0.0f;
+			render(frame->prev, frame->curr, alpha);
+		}
+
+		// Last, a transition destroys this screen
+		onLoop();
+	}
+
+	void simLoop(){
+		const uint64_t now = esp_timer_get_time();
+		lag = std::min(lag + (now - lastTime), StepPeriod * MaxCatchUp);
+		lastTime = now;
+
+		if(lag >= StepPeriod){
+			State prev = state;
+			while(lag >= StepPeriod){
+				prev = state;
+				step(state);
+				lag -= StepPeriod;
+			}
+			frames.publish({ prev, state, now - lag });
+		}
+
+		// Sleep until the next step is due, the remainder is carried over in lag
+		const uint64_t wait = (StepPeriod - lag + 999) / 1000; // [ms]
+		vTaskDelay(std::max((TickType_t) 1, (TickType_t) pdMS_TO_TICKS(wait)));
+	}
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVGAME_H
@@ -0,0 +1,95 @@
+#include "LVImgCache.h"
+#include <misc/lv_gc.h>
+#include <algorithm>
+
+uint16_t LVImgCache::min = LV_IMG_CACHE_DEF_SIZE;
+uint16_t LVImgCache::max = LV_IMG_CACHE_DEF_SIZE;
+uint16_t LVImgCache::size = LV_IMG_CACHE_DEF_SIZE;
+uint32_t LVImgCache::windowDraws = 0;
+uint32_t LVImgCache::windowMisses = 0;
+uint8_t LVImgCache::highWindows = 0;
+LVImgCache::Stats LVImgCache::stats{};
+
+void LVImgCache::init(lv_disp_t* disp){
+	// The software renderer doesn't set draw_img, returning LV_RES_INV falls through to the cache and decoders
+	disp->driver->draw_ctx->draw_img = countDraw;
+
+	// Created decoders go in front of the built-in one
+	auto decoder = lv_img_decoder_create();
+	lv_img_decoder_set_info_cb(decoder, countInfo);
+	lv_img_decoder_set_open_cb(decoder, neverOpen);
+
+	stats.size = size;
+}
+
+uint16_t LVImgCache::apply(uint16_t min, uint16_t max, uint16_t size){
+	LVImgCache::min = std::max<uint16_t>(min, 1);
+	LVImgCache::max = std::max(LVImgCache::min, max);
+
+	windowDraws = windowMisses = 0;
+	highWindows = 0;
+
+	resize(std::clamp(size, LVImgCache::min, LVImgCache::max));
+	return LVImgCache::size;
+}
+
+uint16_t LVImgCache::tune(){
+	if(windowDraws < WindowDraws) return size;
+
+	const uint32_t hitRate = 100 - std::min<uint32_t>(100, windowMisses * 100 / windowDraws);
+	windowDraws = windowMisses = 0;
+
+	if(hitRate < LowHitRate){
+		highWindows = 0;
+		if(size < max){
+			resize(size + 1);
+		}
+	}else if(hitRate >= HighHitRate){
+		if(++highWindows >= ShrinkWindows && size > min){
+			highWindows = 0;
+			resize(size - 1);
+		}
+	}else{
+		highWindows = 0;
+	}
+
+	return size;
+}
+
+void LVImgCache::resize(uint16_t newSize){
+	if(newSize == size) return;
+
+	size = newSize;
+	lv_img_cache_set_size(size);
+	stats.size = size;
+	stats.resizes++;
+}
+
+LVImgCache::Stats LVImgCache::getStats(){
+	return stats;
+}
+
+void LVImgCache::resetStats(){
+	stats = { .draws = 0, .misses = 0, .size = size, .resizes = 0 };
+}
+
+lv_res_t LVImgCache::countDraw(lv_draw_ctx_t* ctx, const lv_draw_img_dsc_t* dsc, const lv_area_t* coords, const void* src){
+	windowDraws++;
+	stats.draws++;
+	return LV_RES_INV;
+}
+
+lv_res_t LVImgCache::countInfo(lv_img_decoder_t* decoder, const void* src, lv_img_header_t* header){
+	// Plain lv_img_decoder_get_info() calls pass their own header, opens for the cache pass one inside a cache entry
+	const auto entries = LV_GC_ROOT(_lv_img_cache_array);
+	if(entries && header >= &entries[0].dec_dsc.header && header <= &entries[size - 1].dec_dsc.header){
+		windowMisses++;
+		stats.misses++;
+	}
+
+	return LV_RES_INV;
+}
+
+lv_res_t LVImgCache::neverOpen(lv_img_decoder_t* decoder, lv_img_decoder_dsc_t* dsc){
+	return LV_RES_INV;
+}
@@ -0,0 +1,60 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVIMGCACHE_H
+#define CLOCKSTAR_FIRMWARE_LVIMGCACHE_H
+
+#include <lvgl.h>
+#include <cstdint>
+
+/**
+ * Sizes LVGL's image cache from its measured hit rate, within the range the running screen allows.
+ * Image draws are counted through the draw context, misses through a decoder placed in front of the built-in ones:
+ * it only passes requests on, and the ones made for a cache entry are the opens the cache couldn't serve.
+ * All calls are expected from the LVGL thread.
+ */
+class LVImgCache {
+public:
+	/** Call once, after the display is registered. */
+	static void init(lv_disp_t* disp);
+
+	/** Applies a screen's range, starting from size, which is clamped into it. @return Applied size */
+	static uint16_t apply(uint16_t min, uint16_t max, uint16_t size);
+
+	/**
+	 * Grows the cache by one when the hit rate of the last window is under LowHitRate, shrinks it by one after
+	 * ShrinkWindows windows over HighHitRate. Resizing drops every cached image, so it's done at most once per window.
+	 * @return Current size
+	 */
+	static uint16_t tune();
+
+	struct Stats {
+		uint32_t draws;
+		uint32_t misses;
+		uint16_t size;
+		uint16_t resizes;
+	};
+	static Stats getStats();
+	static void resetStats();
+
+private:
+	static constexpr uint32_t WindowDraws = 200; // Image draws a window needs before it's judged
+	static constexpr uint8_t LowHitRate = 85; // [%]
+	static constexpr uint8_t HighHitRate = 98; // [%]
+	static constexpr uint8_t ShrinkWindows = 4;
+
+	static uint16_t min;
+	static uint16_t max;
+	static uint16_t size;
+
+	static uint32_t windowDraws;
+	static uint32_t windowMisses;
+	static uint8_t highWindows;
+	static Stats stats;
+
+	static void resize(uint16_t newSize);
+
+	static lv_res_t countDraw(lv_draw_ctx_t* ctx, const lv_draw_img_dsc_t* dsc, const lv_area_t* coords, const void* src);
+	static lv_res_t countInfo(lv_img_decoder_t* decoder, const void* src, lv_img_header_t* header);
+	static lv_res_t neverOpen(lv_img_decoder_t* decoder, lv_img_decoder_dsc_t* dsc);
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVIMGCACHE_H
@@ -0,0 +1,47 @@
+#include "LVImgDirect.h"
+#include "FSLVGL.h"
+
+void LVImgDirect::init(){
+	auto decoder = lv_img_decoder_create();
+	lv_img_decoder_set_info_cb(decoder, info);
+	lv_img_decoder_set_open_cb(decoder, open);
+	lv_img_decoder_set_close_cb(decoder, close);
+}
+
+bool LVImgDirect::directFormat(uint8_t cf){
+	return cf == LV_IMG_CF_TRUE_COLOR || cf == LV_IMG_CF_TRUE_COLOR_ALPHA || cf == LV_IMG_CF_TRUE_COLOR_CHROMA_KEYED || cf == LV_IMG_CF_ALPHA_8BIT;
+}
+
+lv_res_t LVImgDirect::info(lv_img_decoder_t* decoder, const void* src, lv_img_header_t* header){
+	if(lv_img_src_get_type(src) != LV_IMG_SRC_FILE) return LV_RES_INV;
+
+	lv_img_header_t head;
+	if(!FSLVGL::peekCached((const char*) src, &head, sizeof(head))) return LV_RES_INV;
+	if(head.always_zero != 0 || !directFormat(head.cf)) return LV_RES_INV;
+
+	*header = head;
+	return LV_RES_OK;
+}
+
+lv_res_t LVImgDirect::open(lv_img_decoder_t* decoder, lv_img_decoder_dsc_t* dsc){
+	// Evicted since info(), the built-in decoder loads it through the drive
+	auto file = FSLVGL::openCached((const char*) dsc->src);
+	if(file == nullptr) return LV_RES_INV;
+
+	const auto& header = dsc->header;
+	const size_t pixels = lv_img_buf_get_img_size(header.w, header.h, header.cf);
+	if(file->buffer() == nullptr || file->size() < sizeof(lv_img_header_t) + pixels){
+		FSLVGL::closeCached(file);
+		return LV_RES_INV;
+	}
+
+	dsc->img_data = file->buffer() + sizeof(lv_img_header_t);
+	dsc->user_data = file;
+	return LV_RES_OK;
+}
+
+void LVImgDirect::close(lv_img_decoder_t* decoder, lv_img_decoder_dsc_t* dsc){
+	FSLVGL::closeCached((RamFile*) dsc->user_data);
+	dsc->img_data = nullptr;
+	dsc->user_data = nullptr;
+}
@@ -0,0 +1,26 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVIMGDIRECT_H
+#define CLOCKSTAR_FIRMWARE_LVIMGDIRECT_H
+
+#include <lvgl.h>
+
+/**
+ * Image decoder for files FSLVGL already holds in RAM or mapped flash. Instead of reading the file through the drive
+ * into LVGL's buffers, it hands the renderer a pointer to the pixels in the cached file, which stays pinned while the
+ * image is open. Only formats the renderer draws straight from memory are taken: true color with or without alpha,
+ * chroma keyed and 8-bit alpha. Indexed images and uncached files go on to the built-in decoder through the drive.
+ */
+class LVImgDirect {
+public:
+	/** Call once after lv_init(), before LVImgCache::init() so its miss counter stays in front */
+	static void init();
+
+private:
+	static bool directFormat(uint8_t cf);
+
+	static lv_res_t info(lv_img_decoder_t* decoder, const void* src, lv_img_header_t* header);
+	static lv_res_t open(lv_img_decoder_t* decoder, lv_img_decoder_dsc_t* dsc);
+	static void close(lv_img_decoder_t* decoder, lv_img_decoder_dsc_t* dsc);
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVIMGDIRECT_H
@@ -0,0 +1,48 @@
+#include "LVMem.h"
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+
+static const char* TAG = "LVMem";
+
+void* LVMem::overflow = nullptr;
+
+LVMem::Stats LVMem::getStats(){
+#if LV_MEM_CUSTOM == 0
+	// Only walks the main pool, the overflow one isn't counted
+	lv_mem_monitor_t mon;
+	lv_mem_monitor(&mon);
+	return { mon.total_size, mon.total_size - mon.free_size, mon.max_used, mon.free_biggest_size, mon.frag_pct, overflow != nullptr };
+#else
+	return {};
+#endif
+}
+
+LVMem::Free LVMem::getFree(){
+	const size_t heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+#if LV_MEM_CUSTOM == 0
+	lv_mem_monitor_t mon;
+	lv_mem_monitor(&mon);
+	return { heap, mon.free_size };
+#else
+	return { heap, 0 };
+#endif
+}
+
+void LVMem::check(){
+#if LV_MEM_CUSTOM == 0
+	if(overflow) return;
+
+	lv_mem_monitor_t mon;
+	lv_mem_monitor(&mon);
+	if(mon.free_size >= LowWater) return;
+
+	overflow = heap_caps_malloc(OverflowSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if(overflow == nullptr){
+		ESP_LOGE(TAG, "Pool down to %zu B and no heap for the overflow pool", mon.free_size);
+		return;
+	}
+
+	lv_mem_add_pool(overflow, OverflowSize);
+	ESP_LOGW(TAG, "Pool down to %zu B of %zu B, added a %zu B overflow pool, peak %zu B", mon.free_size, mon.total_size, OverflowSize, mon.max_used);
+#endif
+}
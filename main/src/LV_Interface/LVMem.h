@@ -0,0 +1,46 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVMEM_H
+#define CLOCKSTAR_FIRMWARE_LVMEM_H
+
+#include <lvgl.h>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * LVGL allocates objects, styles and draw layers from its own TLSF pool of LV_MEM_SIZE_KILOBYTES, in .bss, instead
+ * of the system heap. Screen churn then only fragments the pool, the heap keeps its large blocks for RamFile and BLE.
+ * LVGL can't take a failed allocation, so when a built screen leaves less than LowWater free, one overflow pool
+ * of OverflowSize is added from the heap. With LV_MEM_CUSTOM set, LVGL is on the system heap and the stats are zero.
+ * All calls are expected from the LVGL thread.
+ */
+class LVMem {
+public:
+	struct Stats {
+		size_t total; // [B] of the main pool
+		size_t used; // [B]
+		size_t peak; // [B] used at most since boot
+		size_t biggest; // [B] largest free block
+		uint8_t frag; // [%]
+		bool overflow; // The overflow pool was added
+	};
+	static Stats getStats();
+
+	/** Free memory in the two places building a screen takes from, apart as running out of either is fatal [B] */
+	struct Free {
+		size_t heap; // 8-bit capable system heap
+		size_t pool; // LVGL's main pool, 0 with LV_MEM_CUSTOM
+	};
+	static Free getFree();
+
+	/** Adds the overflow pool if the main one is running low. Called after a screen is built. */
+	static void check();
+
+private:
+	static constexpr size_t LowWater = 8 * 1024; // [B]
+	static constexpr size_t OverflowSize = 32 * 1024; // [B]
+
+	static void* overflow;
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVMEM_H
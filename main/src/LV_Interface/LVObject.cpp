@@ -1,4 +1,5 @@
 #include "LVObject.h"
+#include "LVArena.h"
 
 LVObject::LVObject(lv_obj_t* parent){
 	obj = lv_obj_create(parent);
@@ -25,3 +26,11 @@ LVObject::operator lv_obj_t*(){
 	return obj;
 }
 
+
+void* LVObject::operator new(size_t size){
+	return LVArena::alloc(size);
+}
+
+void LVObject::operator delete(void* ptr){
+	LVArena::free(ptr);
+}
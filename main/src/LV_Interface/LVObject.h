@@ -2,12 +2,17 @@
 #define BATCONTROLLER_FIRMWARE_LVOBJECT_H
 
 #include <lvgl.h>
+#include <cstddef>
 
 class LVObject {
 public:
 	LVObject(lv_obj_t* parent);
 	virtual ~LVObject();
 
+	/** From the active screen's arena, see LVArena */
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr);
+
 	operator lv_obj_t*();
 
 protected:
@@ -0,0 +1,131 @@
+#include "LVPager.h"
+#include "LVGL.h"
+#include "Util/Services.h"
+#include "Util/stdafx.h"
+#include "Devices/Display.h"
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <sdkconfig.h>
+#include <algorithm>
+
+static const char* TAG = "LVPager";
+
+#ifdef CONFIG_CM_LVGL_NATIVE_COLOR
+using PanelColor = lgfx::swap565_t;
+#else
+using PanelColor = uint16_t;
+#endif
+
+LVPager::LVPager(lv_obj_t* screen) : screen(screen){}
+
+LVPager::~LVPager(){
+	disable();
+}
+
+bool LVPager::enable(){
+	if(from && to) return true;
+
+	constexpr size_t bytes = Size * Size * sizeof(lv_color_t);
+	from = (lv_color_t*) heap_caps_malloc(bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+	to = (lv_color_t*) heap_caps_malloc(bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+	if(from && to) return true;
+
+	ESP_LOGW(TAG, "Couldn't allocate surfaces, largest DMA block: %zu B", heap_caps_get_largest_free_block(MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+	disable();
+	return false;
+}
+
+void LVPager::disable(){
+	finish();
+
+	free(from);
+	free(to);
+	from = to = nullptr;
+}
+
+bool LVPager::isSliding() const{
+	return sliding;
+}
+
+bool LVPager::slide(lv_obj_t* target){
+	if(from == nullptr || to == nullptr) return false;
+
+	lv_obj_update_layout(screen);
+	const lv_coord_t scroll = lv_obj_get_scroll_y(screen);
+	const lv_coord_t y = lv_obj_get_y(target);
+	if(y == scroll) return false;
+
+	// A slide that's still running is cut short, the screen is already scrolled to its page
+	auto& lgfx = Services.get<Service::Display>()->getLGFX();
+	lgfx.waitDMA();
+
+	render(from);
+	lv_obj_scroll_to_view(target, LV_ANIM_OFF);
+	lv_obj_update_layout(screen);
+	render(to);
+
+	down = y > scroll;
+	startTime = frameTime = millis();
+	if(!sliding){
+		sliding = true;
+		lv_timer_pause(_lv_disp_get_refr_timer(lv_obj_get_disp(screen)));
+	}
+
+	push(0);
+	return true;
+}
+
+void LVPager::loop(){
+	if(!sliding) return;
+
+	const uint64_t now = millis();
+	if(now - frameTime < FramePeriod) return;
+	frameTime = now;
+
+	const float t = std::min(1.0f, (float) (now - startTime) / Duration);
+	if(t >= 1.0f){
+		push(Size);
+		finish();
+		return;
+	}
+
+	// Ease out, the page starts fast and settles into place
+	const float rest = 1.0f - t;
+	const float progress = 1.0f - rest * rest * rest;
+	push((lv_coord_t) (progress * Size + 0.5f));
+}
+
+void LVPager::render(lv_color_t* surface){
+	// A display-sized area of the screen instead of an object's own
+	LVGL::render(screen, { 0, 0, Size - 1, Size - 1 }, surface);
+}
+
+void LVPager::push(lv_coord_t offset){
+	auto& lgfx = Services.get<Service::Display>()->getLGFX();
+
+	// Surfaces aren't written during a slide, the previous push may still be reading them
+	lgfx.waitDMA();
+	if(lgfx.getStartCount() == 0){
+		lgfx.startWrite();
+	}
+
+	const lv_coord_t rest = Size - offset;
+	if(down){
+		if(rest > 0) lgfx.pushImageDMA(0, 0, Size, rest, (const PanelColor*) (from + offset * Size));
+		if(offset > 0) lgfx.pushImageDMA(0, rest, Size, offset, (const PanelColor*) to);
+	}else{
+		if(offset > 0) lgfx.pushImageDMA(0, 0, Size, offset, (const PanelColor*) (to + rest * Size));
+		if(rest > 0) lgfx.pushImageDMA(0, offset, Size, rest, (const PanelColor*) from);
+	}
+}
+
+void LVPager::finish(){
+	if(!sliding) return;
+	sliding = false;
+
+	Services.get<Service::Display>()->getLGFX().waitDMA();
+
+	// LVGL didn't draw anything meanwhile, its next frame repaints the whole page
+	lv_timer_resume(_lv_disp_get_refr_timer(lv_obj_get_disp(screen)));
+	lv_obj_invalidate(screen);
+}
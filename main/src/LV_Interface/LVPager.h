@@ -0,0 +1,64 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVPAGER_H
+#define CLOCKSTAR_FIRMWARE_LVPAGER_H
+
+#include <lvgl.h>
+#include <cstdint>
+
+/**
+ * Vertical transitions between full-screen pages of a scrolling screen, without LVGL redrawing the whole display every
+ * frame of a scroll animation. The outgoing and incoming pages are rendered once, each into a full-frame surface, and
+ * LVGL's refresh is paused while the pager pushes the two surfaces with DMA, shifted by the slide's offset. When the
+ * slide ends LVGL takes over again and repaints the display, which then matches the incoming surface.
+ *
+ * The surfaces take 2 x 32 kB of DMA-capable RAM while the pager is enabled. When they couldn't be allocated, slide()
+ * returns false and the caller scrolls the usual way.
+ */
+class LVPager {
+public:
+	explicit LVPager(lv_obj_t* screen);
+	~LVPager();
+
+	/** Allocates the surfaces, false if there's no room for them */
+	bool enable();
+
+	/** Ends a slide that's still running and frees the surfaces */
+	void disable();
+
+	/**
+	 * Scrolls the screen to target at once and slides the display from what was shown before to the page it shows now.
+	 * @return False if the pager isn't enabled or target is already in view, the screen isn't scrolled then
+	 */
+	bool slide(lv_obj_t* target);
+
+	/** Pushes the next frame of a slide when it's due, call from the screen's loop */
+	void loop();
+
+	bool isSliding() const;
+
+private:
+	lv_obj_t* screen;
+
+	static constexpr lv_coord_t Size = 128; // [px]
+	static constexpr uint32_t Duration = 160; // [ms]
+	static constexpr uint32_t FramePeriod = 16; // [ms]
+
+	lv_color_t* from = nullptr;
+	lv_color_t* to = nullptr;
+
+	bool sliding = false;
+	bool down = false; // The incoming page comes in from below
+	uint64_t startTime = 0; // [ms]
+	uint64_t frameTime = 0; // [ms] the last frame was pushed
+
+	/** Renders the screen as it's scrolled now into surface, without touching the display */
+	void render(lv_color_t* surface);
+
+	/** Pushes both surfaces with the incoming one offset rows in */
+	void push(lv_coord_t offset);
+
+	void finish();
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVPAGER_H
@@ -0,0 +1,144 @@
+#include "LVProfiler.h"
+#include "Util/stdafx.h"
+#include <cstdio>
+#include <algorithm>
+
+void LVProfiler::frameStart(){
+	current = {};
+	frameStartTime = micros();
+	inFrame = true;
+	frameDone = false;
+}
+
+void LVProfiler::flushStart(){
+	flushStartTime = micros();
+}
+
+void LVProfiler::flushEnd(uint32_t bytes){
+	if(!inFrame) return;
+
+	const uint64_t now = micros();
+	current.flushTime += now - flushStartTime;
+	current.bytes += bytes;
+	current.areas++;
+
+	// Input shows up on screen with the first area pushed after it
+	if(current.inputLatency == 0){
+		const uint64_t input = pendingInput.exchange(0);
+		if(input){
+			current.inputLatency = now > input ? now - input : 1;
+			latencies[latencyHead] = current.inputLatency;
+			latencyHead = (latencyHead + 1) % LatencyCount;
+			latencyCount = std::min(latencyCount + 1, LatencyCount);
+		}
+	}
+}
+
+void LVProfiler::frameEnd(){
+	if(!inFrame) return;
+
+	const uint32_t total = micros() - frameStartTime;
+	current.renderTime = total > current.flushTime ? total - current.flushTime : 0;
+
+	inFrame = false;
+	frameDone = true;
+}
+
+void LVProfiler::markInput(uint64_t time){
+	if(time == 0) return;
+
+	// Keep the oldest mark, it's the sample that waited longest for this frame
+	uint64_t expected = 0;
+	pendingInput.compare_exchange_strong(expected, time);
+}
+
+void LVProfiler::handlerDone(uint32_t ttn){
+	if(!frameDone) return;
+	frameDone = false;
+
+	current.ttn = std::min(ttn, (uint32_t) UINT16_MAX);
+	frames[head] = current;
+	head = (head + 1) % FrameCount;
+	count = std::min(count + 1, FrameCount);
+}
+
+void LVProfiler::reset(){
+	head = count = 0;
+	latencyHead = latencyCount = 0;
+	inFrame = frameDone = false;
+	pendingInput = 0;
+}
+
+void LVProfiler::printReport() const{
+	if(count == 0){
+		printf("LVGL profiler: no frames recorded\n");
+		return;
+	}
+
+	uint64_t render = 0, flush = 0, bytes = 0, areas = 0, ttn = 0;
+	uint32_t maxRender = 0, maxFlush = 0;
+	size_t histogram[HistogramBins] = {};
+	uint64_t latency = 0;
+	uint32_t maxLatency = 0;
+	size_t inputFrames = 0;
+
+	for(size_t i = 0; i < count; i++){
+		const auto& frame = frames[i];
+		render += frame.renderTime;
+		flush += frame.flushTime;
+		bytes += frame.bytes;
+		areas += frame.areas;
+		ttn += frame.ttn;
+		maxRender = std::max(maxRender, frame.renderTime);
+		maxFlush = std::max(maxFlush, frame.flushTime);
+
+		if(frame.inputLatency){
+			latency += frame.inputLatency;
+			maxLatency = std::max(maxLatency, frame.inputLatency);
+			inputFrames++;
+		}
+
+		const uint32_t frameTime = (frame.renderTime + frame.flushTime) / 1000;
+		size_t bin = 0;
+		while(bin < HistogramBins - 1 && frameTime >= HistogramBounds[bin]){
+			bin++;
+		}
+		histogram[bin]++;
+	}
+
+	printf("LVGL profiler, last %zu frames\n", count);
+	printf("  render: avg %llu us, max %lu us\n", render / count, maxRender);
+	printf("  flush:  avg %llu us, max %lu us\n", flush / count, maxFlush);
+	printf("  pushed: avg %llu B in %llu.%llu areas\n", bytes / count, areas / count, (areas * 10 / count) % 10);
+	printf("  timer handler ttn: avg %llu ms\n", ttn / count);
+	if(inputFrames){
+		printf("  input to flush: avg %llu us, max %lu us over %zu frames\n", latency / inputFrames, maxLatency, inputFrames);
+	}
+	if(latencyCount){
+		uint32_t sorted[LatencyCount];
+		std::copy_n(latencies, latencyCount, sorted);
+		std::sort(sorted, sorted + latencyCount);
+		const auto pct = [&sorted, this](size_t p){ return sorted[(latencyCount - 1) * p / 100]; };
+		printf("  input to flush, last %zu inputs: p50 %lu us, p90 %lu us, p99 %lu us, max %lu us\n",
+			   latencyCount, pct(50), pct(90), pct(99), sorted[latencyCount - 1]);
+	}
+	printf("  frame time histogram:\n");
+
+	for(size_t bin = 0; bin < HistogramBins; bin++){
+		char label[16];
+		if(bin == 0){
+			snprintf(label, sizeof(label), "< %lu", HistogramBounds[0]);
+		}else if(bin == HistogramBins - 1){
+			snprintf(label, sizeof(label), ">= %lu", HistogramBounds[bin - 1]);
+		}else{
+			snprintf(label, sizeof(label), "%lu - %lu", HistogramBounds[bin - 1], HistogramBounds[bin]);
+		}
+		printf("    %8s ms: ", label);
+
+		const size_t bar = (histogram[bin] * 40 + count - 1) / count;
+		for(size_t i = 0; i < bar; i++){
+			printf("#");
+		}
+		printf(" %zu\n", histogram[bin]);
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVPROFILER_H
+#define CLOCKSTAR_FIRMWARE_LVPROFILER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+/**
+ * Per-frame timing of the LVGL thread. All calls except markInput are expected from the LVGL thread.
+ */
+class LVProfiler {
+public:
+	struct Frame {
+		uint32_t renderTime; // [us], refresh time without flushing
+		uint32_t flushTime; // [us]
+		uint32_t bytes;
+		uint16_t areas;
+		uint16_t ttn; // [ms], lv_timer_handler return value
+		uint32_t inputLatency; // [us], from the oldest input marked for this frame to its first pushed area, 0 if none
+	};
+
+	void frameStart();
+	void flushStart();
+	void flushEnd(uint32_t bytes);
+	void frameEnd();
+
+	/** Input sampled at time [us] went into the next frame. Safe to call from any task. */
+	void markInput(uint64_t time);
+
+	/** Called after each lv_timer_handler. Commits the frame if one was refreshed during the call. */
+	void handlerDone(uint32_t ttn);
+
+	void printReport() const;
+	void reset();
+
+private:
+	static constexpr size_t FrameCount = 128;
+	Frame frames[FrameCount]{};
+	size_t head = 0;
+	size_t count = 0;
+
+	Frame current{};
+	uint64_t frameStartTime = 0;
+	uint64_t flushStartTime = 0;
+	bool inFrame = false;
+	bool frameDone = false;
+
+	std::atomic<uint64_t> pendingInput = 0; // [us], oldest input marked since the last frame, 0 if none
+
+	// Latencies of the last inputs, kept apart from frames since most frames have none
+	static constexpr size_t LatencyCount = 64;
+	uint32_t latencies[LatencyCount]{}; // [us]
+	size_t latencyHead = 0;
+	size_t latencyCount = 0;
+
+	static constexpr uint32_t HistogramBounds[] = { 2, 5, 10, 16, 25, 40, 60 }; // [ms]
+	static constexpr size_t HistogramBins = sizeof(HistogramBounds) / sizeof(HistogramBounds[0]) + 1;
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVPROFILER_H
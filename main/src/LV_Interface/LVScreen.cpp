@@ -1,12 +1,19 @@
 #include "LVScreen.h"
 #include "LVGL.h"
 #include "InputLVGL.h"
+#include "FSLVGL.h"
+#include "Util/PSRAM.h"
 #include <cstdio>
+#include <cstring>
 #include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
 
 static constexpr const char* TAG = "LVScreen";
 
-LVScreen::LVScreen() : LVObject(nullptr){
+LVScreen::LVScreen() : LVObject(nullptr), arena(std::make_unique<LVArena>()){
+	// Everything the derived constructors build goes in here, LVGL keeps it active while this is the current screen
+	LVArena::setActive(arena.get());
 
 	lv_obj_add_event_cb(obj, [](lv_event_t* event){
 		auto screen = static_cast<LVScreen*>(event->user_data);
@@ -22,15 +29,26 @@ LVScreen::~LVScreen(){
 		ESP_LOGE(TAG, "Destroying while still running! Call stop() first.");
 		abort();
 	}
+
+	// Children are LVObjects in the arena, they have to go before it does
+	lv_obj_clean(obj);
 	lv_group_del(inputGroup);
+
+	for(const auto& layer : staticLayers){
+		lv_img_cache_invalidate_src(&layer->dsc);
+	}
 }
 
 void LVScreen::transition(std::function<std::unique_ptr<LVScreen>()> create){
+	transition(nullptr, create);
+}
+
+void LVScreen::transition(const void* key, std::function<std::unique_ptr<LVScreen>()> create){
 	if(lvgl == nullptr){
 		ESP_LOGE(TAG, "Starting transition, but LVGL ptr isn't set");
 		abort();
 	}
-	lvgl->startScreen(create);
+	lvgl->startScreen(key, create);
 }
 
 void LVScreen::start(LVGL* lvgl){
@@ -57,3 +75,136 @@ void LVScreen::loop(){ }
 bool LVScreen::isRunning() const{
 	return running;
 }
+
+uint32_t LVScreen::getFramePeriod() const{
+	return framePeriod;
+}
+
+uint32_t LVScreen::getLoopPeriod() const{
+	return std::max(loopPeriod, framePeriod);
+}
+
+bool LVScreen::resumeSuspended(){
+	if(lvgl == nullptr) return false;
+	return lvgl->resumeSuspended();
+}
+
+bool LVScreen::isPersistent() const{
+	return persistent;
+}
+
+bool LVScreen::isDirect() const{
+	return direct;
+}
+
+void LVScreen::setPersistent(bool persistent){
+	this->persistent = persistent;
+}
+
+void LVScreen::setFrameRate(uint8_t fps){
+	if(fps == 0) return;
+	framePeriod = std::max(1000 / fps, 1);
+}
+
+void LVScreen::setLoopPeriod(uint32_t period){
+	loopPeriod = period;
+}
+
+void LVScreen::setImageCache(uint16_t min, uint16_t max){
+	imgCacheMin = min;
+	imgCacheMax = std::max(min, max);
+	imgCacheSize = std::clamp(imgCacheSize, imgCacheMin, imgCacheMax);
+}
+
+lv_color_t* LVScreen::toTrueColor(const lv_img_dsc_t& img){
+	const auto cf = (lv_img_cf_t) img.header.cf;
+	if(cf < LV_IMG_CF_INDEXED_1BIT || cf > LV_IMG_CF_INDEXED_8BIT) return nullptr;
+
+	const uint8_t bpp = lv_img_cf_get_px_size(cf);
+	const size_t colors = 1 << bpp;
+	const uint32_t w = img.header.w;
+	const uint32_t h = img.header.h;
+	const size_t rowBytes = (w * bpp + 7) / 8;
+	if(img.data_size < colors * sizeof(lv_color32_t) + rowBytes * h) return nullptr;
+
+	// Transparent entries would need an alpha byte per pixel, the plain copy only covers opaque images
+	auto palette = (const lv_color32_t*) img.data;
+	for(size_t i = 0; i < colors; i++){
+		if(palette[i].ch.alpha != LV_OPA_COVER) return nullptr;
+	}
+
+	const size_t size = w * h * sizeof(lv_color_t);
+	lv_color_t* pixels = nullptr;
+	if(PSRAM::available()){
+		pixels = (lv_color_t*) heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+	}
+	if(pixels == nullptr){
+		pixels = (lv_color_t*) heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	}
+	if(pixels == nullptr){
+		ESP_LOGW(TAG, "No %zu B for a true color background, drawing it indexed", size);
+		return nullptr;
+	}
+
+	lv_color_t lut[256];
+	for(size_t i = 0; i < colors; i++){
+		lut[i] = lv_color_make(palette[i].ch.red, palette[i].ch.green, palette[i].ch.blue);
+	}
+
+	// Rows start on a byte, pixels are packed from the most significant bit
+	auto row = img.data + colors * sizeof(lv_color32_t);
+	const uint8_t mask = (1 << bpp) - 1;
+	auto px = pixels;
+	for(uint32_t y = 0; y < h; y++, row += rowBytes){
+		for(uint32_t x = 0; x < w; x++){
+			const uint32_t bit = x * bpp;
+			const uint8_t shift = 8 - bpp - (bit & 7);
+			*px++ = lut[(row[bit >> 3] >> shift) & mask];
+		}
+	}
+
+	return pixels;
+}
+
+void LVScreen::setStaticBackground(lv_obj_t* target, const char* path){
+	auto layer = std::make_unique<StaticLayer>();
+
+	RamFile* file = FSLVGL::getCached(path);
+	if(file == nullptr){
+		std::string spath("/spiffs");
+		spath.append(strchr(path, ':') ? path + 2 : path);
+
+		const auto asset = FSLVGL::getAsset(path);
+		if(asset.compressed()){
+			layer->file = std::make_unique<RamFile>(spath.c_str(), asset.data, asset.size, asset.rawSize);
+		}else if(asset.data){
+			layer->file = std::make_unique<RamFile>(spath.c_str(), asset.data, asset.size);
+		}else{
+			layer->file = std::make_unique<RamFile>(spath.c_str());
+		}
+		file = layer->file.get();
+	}
+
+	if(file->buffer() == nullptr || file->size() <= sizeof(lv_img_header_t)){
+		ESP_LOGW(TAG, "Couldn't load static background %s, drawing from file", path);
+		lv_obj_set_style_bg_img_src(target, path, 0);
+		return;
+	}
+
+	memcpy(&layer->dsc.header, file->buffer(), sizeof(lv_img_header_t));
+	layer->dsc.data_size = file->size() - sizeof(lv_img_header_t);
+	layer->dsc.data = file->buffer() + sizeof(lv_img_header_t);
+
+	// LVGL decodes indexed images line by line into a scratch buffer on every draw, only true color is blended
+	// straight from the image, see LVBlend
+	if(auto pixels = toTrueColor(layer->dsc)){
+		layer->pixels.reset(pixels);
+		layer->dsc.header.cf = LV_IMG_CF_TRUE_COLOR;
+		layer->dsc.data_size = layer->dsc.header.w * layer->dsc.header.h * sizeof(lv_color_t);
+		layer->dsc.data = (const uint8_t*) pixels;
+		layer->file.reset();
+	}
+
+	lv_obj_set_style_bg_img_src(target, &layer->dsc, 0);
+	staticLayers.push_back(std::move(layer));
+}
@@ -2,37 +2,140 @@
 #define BATCONTROLLER_FIRMWARE_LVSCREEN_H
 
 #include "LVObject.h"
+#include "LVArena.h"
 #include <unordered_set>
 #include <functional>
 #include <memory>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include "Util/RamFile.h"
 
 class LVGL;
+class LVDirectScreen;
 
 class LVScreen : public LVObject {
 public:
 	LVScreen();
 	virtual ~LVScreen();
 
+	/** Screens own the arena their objects come from, so they're on the heap themselves */
+	static void* operator new(size_t size){ return ::operator new(size); }
+	static void operator delete(void* ptr){ ::operator delete(ptr); }
+
 	bool isRunning() const;
 
+	/** Persistent screens stay resident instead of being destroyed when another one starts, see LVGL::startScreen */
+	bool isPersistent() const;
+
+	/** Direct screens draw the display themselves instead of LVGL, see LVDirectScreen */
+	[[nodiscard]] bool isDirect() const;
+
+	static constexpr uint32_t DefaultFramePeriod = LV_DISP_DEF_REFR_PERIOD; // [ms]
+	[[nodiscard]] uint32_t getFramePeriod() const;
+
+	/**
+	 * Longest LVGL waits between two loop() calls while nothing animates, LVGL's own timers and wake events aside.
+	 * Every frame period unless the screen raised it with setLoopPeriod. [ms]
+	 */
+	[[nodiscard]] uint32_t getLoopPeriod() const;
+
+	/** For screens whose loop() only handles events and steps of half a second or longer, e.g. the status bar's. */
+	static constexpr uint32_t IdleLoopPeriod = 500; // [ms]
+
+	/** Identifies a screen type, so LVGL can find a resident instance of it again */
+	template<typename T>
+	static const void* typeKey(){
+		static const char key = 0;
+		return &key;
+	}
+
+	/** Files a screen opens when it's built, see AssetPrefetch. */
+	struct AssetList {
+		const char* const* paths;
+		size_t count;
+	};
+
 protected:
 	lv_group_t* inputGroup;
 
+	/** Starts a screen of type T, loading a resident one if there is one, see LVGL::startScreen */
+	template<typename T>
+	void transition(){
+		transition(typeKey<T>(), [](){ return std::make_unique<T>(); });
+	}
+
 	void transition(std::function<std::unique_ptr<LVScreen>()> create);
 
+	/** Raises the refresh rate while this screen is running. Defaults to LV_DISP_DEF_REFR_PERIOD. */
+	void setFrameRate(uint8_t fps);
+
+	/**
+	 * Lets LVGL wait up to period between loop() calls while nothing animates, see getLoopPeriod. For screens that only
+	 * poll events in loop(), those wake it when they come in. 0 goes back to every frame, for while loop() animates.
+	 */
+	void setLoopPeriod(uint32_t period);
+
+	/**
+	 * Lets LVGL's image cache grow and shrink within [min, max] entries while this screen is running, following its
+	 * hit rate, see LVImgCache. The size reached is kept for the next time the screen starts. Defaults to LV_IMG_CACHE_DEF_SIZE.
+	 */
+	void setImageCache(uint16_t min, uint16_t max);
+
+	/** Switches to the suspended persistent screen, if there is one. Like transition, this screen may be gone after. */
+	bool resumeSuspended();
+
+	void setPersistent(bool persistent);
+
+	/**
+	 * Sets a background image that's drawn straight from RAM as a plain copy, instead of being read through
+	 * the filesystem and decoded line by line on every redraw. Uses the FSLVGL cache if the file is in there,
+	 * otherwise the file is loaded for the lifetime of the screen. Opaque indexed images are converted to true color
+	 * once here, PSRAM first, as LVGL only blends true color without decoding it.
+	 * @param path LVGL path (e.g. S:/bg.bin)
+	 */
+	void setStaticBackground(lv_obj_t* target, const char* path);
+
 private:
 	LVGL* lvgl = nullptr;
 
+	/** LVObjects built while this screen is current, see LVArena. Emptied in the destructor. */
+	std::unique_ptr<LVArena> arena;
+
+	void transition(const void* key, std::function<std::unique_ptr<LVScreen>()> create);
+
 	void start(LVGL* lvgl);
 	void stop();
 
+	const void* key = nullptr; // See typeKey, set by LVGL
+	size_t heapSize = 0; // [B] taken when built, counts towards LVGL's residency budget
+
 	virtual void onStarting();
 	virtual void onStart();
 	virtual void onStop();
 
 	bool running = false;
+	bool persistent = false;
+	bool direct = false; // Only set by LVDirectScreen
+	uint32_t framePeriod = DefaultFramePeriod;
+	uint32_t loopPeriod = 0; // [ms] 0 for every frame
+
+	uint16_t imgCacheMin = LV_IMG_CACHE_DEF_SIZE;
+	uint16_t imgCacheMax = LV_IMG_CACHE_DEF_SIZE;
+	uint16_t imgCacheSize = LV_IMG_CACHE_DEF_SIZE;
+
+	struct StaticLayer {
+		lv_img_dsc_t dsc;
+		std::unique_ptr<RamFile> file; // Only set if the file wasn't cached and is drawn as it is
+		std::unique_ptr<lv_color_t, decltype(&free)> pixels{ nullptr, &free }; // Converted from an indexed file
+	};
+
+	/** Pixels of an opaque indexed image in true color, heap allocated. nullptr for other formats or without memory. */
+	static lv_color_t* toTrueColor(const lv_img_dsc_t& img);
+	std::vector<std::unique_ptr<StaticLayer>> staticLayers;
 
 	friend LVGL;
+	friend LVDirectScreen;
 	virtual void loop();
 
 };
@@ -0,0 +1,94 @@
+#include "LVSprites.h"
+
+LVSprites::LVSprites(lv_obj_t* parent, uint8_t count) : LVObject(parent), sprites(count){
+	lv_obj_set_style_bg_opa(obj, LV_OPA_TRANSP, 0);
+	lv_obj_set_style_border_width(obj, 0, 0);
+	lv_obj_set_style_pad_all(obj, 0, 0);
+	lv_obj_clear_flag(obj, LV_OBJ_FLAG_CLICKABLE);
+
+	lv_obj_add_event_cb(obj, onDraw, LV_EVENT_DRAW_MAIN, this);
+}
+
+void LVSprites::set(uint8_t index, const Sprite& sprite){
+	if(index >= sprites.size()) return;
+
+	auto& current = sprites[index];
+	if(same(current, sprite)) return;
+
+	invalidate(current);
+	current = sprite;
+	invalidate(current);
+}
+
+void LVSprites::move(uint8_t index, lv_coord_t x, lv_coord_t y){
+	if(index >= sprites.size()) return;
+
+	auto sprite = sprites[index];
+	sprite.x = x;
+	sprite.y = y;
+	set(index, sprite);
+}
+
+void LVSprites::setVisible(uint8_t index, bool visible){
+	if(index >= sprites.size()) return;
+
+	auto sprite = sprites[index];
+	sprite.visible = visible;
+	set(index, sprite);
+}
+
+const LVSprites::Sprite& LVSprites::get(uint8_t index) const{
+	return sprites[index];
+}
+
+bool LVSprites::same(const Sprite& a, const Sprite& b){
+	return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h && a.color.full == b.color.full && a.radius == b.radius &&
+		   a.img == b.img && a.visible == b.visible;
+}
+
+lv_area_t LVSprites::area(const Sprite& sprite) const{
+	lv_area_t coords;
+	lv_obj_get_coords(obj, &coords);
+
+	return {
+			.x1 = (lv_coord_t) (coords.x1 + sprite.x),
+			.y1 = (lv_coord_t) (coords.y1 + sprite.y),
+			.x2 = (lv_coord_t) (coords.x1 + sprite.x + sprite.w - 1),
+			.y2 = (lv_coord_t) (coords.y1 + sprite.y + sprite.h - 1)
+	};
+}
+
+void LVSprites::invalidate(const Sprite& sprite){
+	if(!sprite.visible || sprite.w <= 0 || sprite.h <= 0) return;
+
+	auto spriteArea = area(sprite);
+	lv_obj_invalidate_area(obj, &spriteArea);
+}
+
+void LVSprites::onDraw(lv_event_t* evt){
+	auto layer = static_cast<LVSprites*>(evt->user_data);
+	auto ctx = lv_event_get_draw_ctx(evt);
+
+	lv_draw_rect_dsc_t rectDsc;
+	lv_draw_rect_dsc_init(&rectDsc);
+	rectDsc.bg_opa = LV_OPA_COVER;
+
+	lv_draw_img_dsc_t imgDsc;
+	lv_draw_img_dsc_init(&imgDsc);
+
+	for(const auto& sprite : layer->sprites){
+		if(!sprite.visible || sprite.w <= 0 || sprite.h <= 0) continue;
+
+		const auto spriteArea = layer->area(sprite);
+		lv_area_t clipped;
+		if(!_lv_area_intersect(&clipped, &spriteArea, ctx->clip_area)) continue;
+
+		if(sprite.img){
+			lv_draw_img(ctx, &imgDsc, &spriteArea, sprite.img);
+		}else{
+			rectDsc.bg_color = sprite.color;
+			rectDsc.radius = sprite.radius;
+			lv_draw_rect(ctx, &rectDsc, &spriteArea);
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVSPRITES_H
+#define CLOCKSTAR_FIRMWARE_LVSPRITES_H
+
+#include "LVObject.h"
+#include <vector>
+
+/**
+ * A fixed number of sprites drawn directly in one widget's draw event, for things that move every frame.
+ * Moving a sprite only invalidates the area it left and the one it moved to, there are no objects to relayout,
+ * restyle or reorder. Sprites are drawn in index order, a later one over an earlier one.
+ */
+class LVSprites : public LVObject {
+public:
+	LVSprites(lv_obj_t* parent, uint8_t count);
+
+	struct Sprite {
+		lv_coord_t x = 0, y = 0; // [px] from the widget's top left corner
+		lv_coord_t w = 0, h = 0; // [px]
+		lv_color_t color = lv_color_white();
+		lv_coord_t radius = 0; // [px], LV_RADIUS_CIRCLE for a circle
+		const lv_img_dsc_t* img = nullptr; // Drawn instead of a filled rectangle if set, has to outlive the sprite
+		bool visible = true;
+	};
+
+	/** Only redraws if the sprite changed. */
+	void set(uint8_t index, const Sprite& sprite);
+	void move(uint8_t index, lv_coord_t x, lv_coord_t y);
+	void setVisible(uint8_t index, bool visible);
+
+	[[nodiscard]] const Sprite& get(uint8_t index) const;
+
+private:
+	std::vector<Sprite> sprites;
+
+	static bool same(const Sprite& a, const Sprite& b);
+	void invalidate(const Sprite& sprite);
+	lv_area_t area(const Sprite& sprite) const;
+
+	static void onDraw(lv_event_t* evt);
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVSPRITES_H
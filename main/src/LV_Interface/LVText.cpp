@@ -0,0 +1,244 @@
+#include "LVText.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstring>
+
+static const char* TAG = "LVText";
+
+std::vector<LVText::Entry*> LVText::entries;
+uint32_t LVText::renders = 0;
+uint32_t LVText::shared = 0;
+
+static const lv_style_const_prop_t PlainProps[] = {
+		{ .prop = LV_STYLE_BG_OPA, .value = { .num = LV_OPA_TRANSP } },
+		{ .prop = LV_STYLE_BORDER_WIDTH, .value = { .num = 0 } },
+		{ .prop = LV_STYLE_PAD_TOP, .value = { .num = 0 } },
+		{ .prop = LV_STYLE_PAD_BOTTOM, .value = { .num = 0 } },
+		{ .prop = LV_STYLE_PAD_LEFT, .value = { .num = 0 } },
+		{ .prop = LV_STYLE_PAD_RIGHT, .value = { .num = 0 } },
+		{ .prop = LV_STYLE_PROP_INV, .value = { .num = 0 } }
+};
+LV_STYLE_CONST_INIT(Plain, PlainProps);
+
+LVText::LVText(lv_obj_t* parent, const char* text, const lv_font_t* font, lv_color_t color, lv_text_align_t align, lv_coord_t lineSpace) :
+		LVObject(parent), font(font), color(color), align(align), lineSpace(lineSpace){
+	lv_obj_add_style(obj, const_cast<lv_style_t*>(&Plain), 0);
+	lv_obj_clear_flag(obj, LV_OBJ_FLAG_CLICKABLE);
+	lv_obj_set_size(obj, LV_SIZE_CONTENT, LV_SIZE_CONTENT);
+
+	lv_obj_add_event_cb(obj, onDraw, LV_EVENT_DRAW_MAIN, this);
+	lv_obj_add_event_cb(obj, onSelfSize, LV_EVENT_GET_SELF_SIZE, this);
+
+	setText(text);
+}
+
+LVText::~LVText(){
+	release(entry);
+}
+
+void LVText::setText(const char* text){
+	if(text == nullptr){
+		text = "";
+	}
+	if(entry && entry->text == text) return;
+
+	auto next = acquire(text);
+	release(entry);
+	entry = next;
+
+	lv_obj_refresh_self_size(obj);
+	lv_obj_invalidate(obj);
+}
+
+LVText::Entry* LVText::acquire(const char* text){
+	auto it = std::find_if(entries.begin(), entries.end(), [this, text](const Entry* e){
+		return e->font == font && e->color.full == color.full && e->align == align && e->lineSpace == lineSpace && e->text == text;
+	});
+	if(it != entries.end()){
+		(*it)->refs++;
+		shared++;
+		return *it;
+	}
+
+	auto e = new Entry{ text, font, color, align, lineSpace, {}, 1 };
+	render(*e);
+	entries.push_back(e);
+	renders++;
+	return e;
+}
+
+void LVText::release(Entry* entry){
+	if(entry == nullptr || --entry->refs > 0) return;
+
+	entries.erase(std::remove(entries.begin(), entries.end(), entry), entries.end());
+	if(entry->img.data){
+		lv_img_cache_invalidate_src(&entry->img);
+		heap_caps_free((void*) entry->img.data);
+	}
+	delete entry;
+}
+
+void LVText::render(Entry& entry){
+	const auto font = entry.font;
+	const char* text = entry.text.c_str();
+
+	// Line widths first, every line is laid out within the widest one
+	std::vector<lv_coord_t> widths;
+	lv_coord_t width = 0;
+	uint32_t i = 0;
+	lv_coord_t line = 0;
+	for(;;){
+		const uint32_t letter = _lv_txt_encoded_next(text, &i);
+		if(letter == '\n' || letter == 0){
+			widths.push_back(line);
+			width = std::max(width, line);
+			line = 0;
+			if(letter == 0) break;
+			continue;
+		}
+
+		uint32_t next = i;
+		const uint32_t letterNext = _lv_txt_encoded_next(text, &next);
+		line += lv_font_get_glyph_width(font, letter, letterNext);
+	}
+
+	const lv_coord_t lineHeight = lv_font_get_line_height(font);
+	const auto lines = (lv_coord_t) widths.size();
+	const lv_coord_t height = lines * lineHeight + (lines - 1) * entry.lineSpace;
+
+	entry.img.header.cf = LV_IMG_CF_TRUE_COLOR_ALPHA;
+	entry.img.header.w = width;
+	entry.img.header.h = height;
+	entry.img.data_size = width * height * LV_IMG_PX_SIZE_ALPHA_BYTE;
+	entry.img.data = nullptr;
+	if(entry.img.data_size == 0) return;
+
+	auto data = (uint8_t*) heap_caps_malloc(entry.img.data_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if(data == nullptr){
+		ESP_LOGE(TAG, "Couldn't allocate %lu B for \"%s\"", entry.img.data_size, text);
+		entry.img.header.w = entry.img.header.h = 0;
+		entry.img.data_size = 0;
+		return;
+	}
+
+	// Every pixel has the text color, the glyphs only set the alpha
+	for(size_t px = 0; px < (size_t) width * height; px++){
+		memcpy(data + px * LV_IMG_PX_SIZE_ALPHA_BYTE, &entry.color, sizeof(lv_color_t));
+		data[px * LV_IMG_PX_SIZE_ALPHA_BYTE + LV_IMG_PX_SIZE_ALPHA_BYTE - 1] = LV_OPA_TRANSP;
+	}
+
+	i = 0;
+	size_t lineIndex = 0;
+	lv_coord_t x = 0;
+	lv_coord_t y = 0;
+	const auto lineStart = [&](size_t index){
+		const lv_coord_t free = width - widths[index];
+		if(entry.align == LV_TEXT_ALIGN_CENTER) return (lv_coord_t) (free / 2);
+		if(entry.align == LV_TEXT_ALIGN_RIGHT) return free;
+		return (lv_coord_t) 0;
+	};
+	x = lineStart(0);
+
+	for(;;){
+		const uint32_t letter = _lv_txt_encoded_next(text, &i);
+		if(letter == 0) break;
+		if(letter == '\n'){
+			lineIndex++;
+			x = lineStart(lineIndex);
+			y += lineHeight + entry.lineSpace;
+			continue;
+		}
+
+		uint32_t next = i;
+		const uint32_t letterNext = _lv_txt_encoded_next(text, &next);
+
+		lv_font_glyph_dsc_t glyph;
+		if(!lv_font_get_glyph_dsc(font, &glyph, letter, letterNext)) continue;
+
+		const uint8_t* bitmap = lv_font_get_glyph_bitmap(font, letter);
+		const uint8_t bpp = glyph.bpp;
+		if(bitmap && (bpp == 1 || bpp == 2 || bpp == 4 || bpp == 8)){
+			const uint8_t maxValue = (1 << bpp) - 1;
+			const lv_coord_t gx = x + glyph.ofs_x;
+			const lv_coord_t gy = y + (font->line_height - font->base_line) - glyph.box_h - glyph.ofs_y;
+
+			// Glyph bitmaps are packed rows of bpp bits per pixel, most significant bits first
+			for(uint16_t row = 0; row < glyph.box_h; row++){
+				const lv_coord_t py = gy + row;
+				if(py < 0 || py >= height) continue;
+
+				for(uint16_t col = 0; col < glyph.box_w; col++){
+					const lv_coord_t px = gx + col;
+					if(px < 0 || px >= width) continue;
+
+					const uint32_t bit = (row * glyph.box_w + col) * bpp;
+					const uint8_t value = (bitmap[bit >> 3] >> (8 - bpp - (bit & 7))) & maxValue;
+					if(value == 0) continue;
+
+					auto& alpha = data[((size_t) py * width + px) * LV_IMG_PX_SIZE_ALPHA_BYTE + LV_IMG_PX_SIZE_ALPHA_BYTE - 1];
+					alpha = std::max<uint8_t>(alpha, value * 255 / maxValue);
+				}
+			}
+		}
+
+		x += glyph.adv_w;
+	}
+
+	entry.img.data = data;
+}
+
+void LVText::onSelfSize(lv_event_t* evt){
+	auto text = static_cast<LVText*>(evt->user_data);
+	auto size = (lv_point_t*) lv_event_get_param(evt);
+	if(text->entry == nullptr) return;
+
+	size->x = std::max<lv_coord_t>(size->x, text->entry->img.header.w);
+	size->y = std::max<lv_coord_t>(size->y, text->entry->img.header.h);
+}
+
+void LVText::onDraw(lv_event_t* evt){
+	auto text = static_cast<LVText*>(evt->user_data);
+	if(text->entry == nullptr || text->entry->img.data == nullptr) return;
+	const auto& img = text->entry->img;
+
+	lv_area_t content;
+	lv_obj_get_content_coords(text->obj, &content);
+
+	lv_coord_t x = content.x1;
+	const lv_coord_t free = lv_area_get_width(&content) - img.header.w;
+	if(free > 0 && text->align == LV_TEXT_ALIGN_CENTER){
+		x += free / 2;
+	}else if(free > 0 && text->align == LV_TEXT_ALIGN_RIGHT){
+		x += free;
+	}
+
+	const lv_area_t area = {
+			.x1 = x,
+			.y1 = content.y1,
+			.x2 = (lv_coord_t) (x + img.header.w - 1),
+			.y2 = (lv_coord_t) (content.y1 + img.header.h - 1)
+	};
+
+	auto ctx = lv_event_get_draw_ctx(evt);
+	lv_area_t clipped;
+	if(!_lv_area_intersect(&clipped, &area, ctx->clip_area)) return;
+
+	lv_draw_img_dsc_t dsc;
+	lv_draw_img_dsc_init(&dsc);
+	lv_obj_init_draw_img_dsc(text->obj, LV_PART_MAIN, &dsc);
+	lv_draw_img(ctx, &dsc, &area, &img);
+}
+
+LVText::Stats LVText::getStats(){
+	size_t bytes = 0;
+	for(const auto e : entries){
+		bytes += e->img.data_size;
+	}
+	return { entries.size(), bytes, renders, shared };
+}
+
+void LVText::resetStats(){
+	renders = 0;
+	shared = 0;
+}
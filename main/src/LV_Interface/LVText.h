@@ -0,0 +1,63 @@
+#ifndef CLOCKSTAR_FIRMWARE_LVTEXT_H
+#define CLOCKSTAR_FIRMWARE_LVTEXT_H
+
+#include "LVObject.h"
+#include <vector>
+#include <string>
+
+/**
+ * Text for labels that rarely change. setText rasterizes the glyphs once into a true color + alpha image, which the
+ * widget then blits in its draw event, instead of an lv_label laying out and blending every glyph on each redraw.
+ * The same text in the same font, color and format shares one image, like a settings row rebuilt on every visit.
+ * Sizes to its text like an lv_label, in a larger object the text is placed at the top by align.
+ * Breaks lines only at '\n', there's no wrapping or long mode.
+ */
+class LVText : public LVObject {
+public:
+	LVText(lv_obj_t* parent, const char* text, const lv_font_t* font, lv_color_t color, lv_text_align_t align = LV_TEXT_ALIGN_LEFT,
+		   lv_coord_t lineSpace = 0);
+	~LVText() override;
+
+	/** Renders only if the text changed */
+	void setText(const char* text);
+
+	struct Stats {
+		size_t entries;
+		size_t bytes; // [B] of rendered images
+		uint32_t renders;
+		uint32_t shared; // setText calls served by an image another widget already rendered
+	};
+	static Stats getStats();
+	static void resetStats();
+
+private:
+	const lv_font_t* const font;
+	const lv_color_t color;
+	const lv_text_align_t align;
+	const lv_coord_t lineSpace;
+
+	struct Entry {
+		std::string text;
+		const lv_font_t* font;
+		lv_color_t color;
+		lv_text_align_t align;
+		lv_coord_t lineSpace;
+		lv_img_dsc_t img;
+		uint32_t refs;
+	};
+	Entry* entry = nullptr;
+
+	static std::vector<Entry*> entries;
+	static uint32_t renders;
+	static uint32_t shared;
+
+	Entry* acquire(const char* text);
+	static void release(Entry* entry);
+	static void render(Entry& entry);
+
+	static void onDraw(lv_event_t* evt);
+	static void onSelfSize(lv_event_t* evt);
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LVTEXT_H
@@ -1,10 +1,16 @@
 #include "Client.h"
 #include <cstring>
 #include <esp_log.h>
+#include <algorithm>
+#include <iterator>
+#include "Util/stdafx.h"
+#include "BLE/ConMan.h"
 
 static const char* TAG = "ANCS";
 
-ANCS::Client::Client(BLE::Client* client) : notifThread([this](){ loopNotif(); }, "ANCS::Notif", 2 * 1024), dataThread([this](){ loopData(); }, "ANCS::Data", 3 * 1024){
+ANCS::Client::Client(BLE::Client* client) :
+		notifThread([this](){ loopNotif(); }, "ANCS::Notif", 2 * 1024, PlannedTask::ANCSNotif, [this](){ chr.notif->interrupt(); }),
+		dataThread([this](){ loopData(); }, "ANCS::Data", 3 * 1024, PlannedTask::ANCSData, [this](){ chr.data->interrupt(); }){
 	service = client->addService(ServiceUUID);
 	chr.notif = service->addChar(Char_NotifSource_UUID, ESP_GATT_CHAR_PROP_BIT_NOTIFY);
 	chr.ctrl = service->addChar(Char_ControlPoint_UUID, ESP_GATT_CHAR_PROP_BIT_WRITE);
@@ -15,9 +21,6 @@ ANCS::Client::Client(BLE::Client* client) : notifThread([this](){ loopNotif(); }
 
 	chr.notif->setOnConnectedCb([this](){ chr.notif->writeDescr(ESP_GATT_UUID_CHAR_CLIENT_CONFIG, { 0x01, 0x00 }); });
 	chr.data->setOnConnectedCb([this](){ chr.data->writeDescr(ESP_GATT_UUID_CHAR_CLIENT_CONFIG, { 0x01, 0x00 }); });
-
-	notifThread.start();
-	dataThread.start();
 }
 
 ANCS::Client::~Client(){
@@ -26,19 +29,28 @@ ANCS::Client::~Client(){
 }
 
 void ANCS::Client::onConn(){
+	// Discovery found ANCS, so this is an iPhone. The tasks only exist while it's connected.
+	parser = {};
 	connected = true;
+	notifThread.start();
+	dataThread.start();
+
 	connect();
 }
 
 void ANCS::Client::onDiscon(){
-	std::lock_guard lock(needDataMut);
-	while(needData.size()){
-		needData.pop();
+	connected = false;
+	notifThread.stop();
+	dataThread.stop();
+
+	{
+		std::lock_guard lock(needDataMut);
+		needData.clear();
+		inFlight.clear();
+		fetchedFull.clear();
+		setQueueDepth(0);
 	}
-	dataQueue.clear();
-	processingAttrs = false;
 
-	connected = false;
 	disconnect();
 }
 
@@ -62,7 +74,8 @@ void ANCS::Client::actionNeg(uint32_t uid){
 
 void ANCS::Client::loopNotif(){
 	if(chr.notif == nullptr || !connected){
-		vTaskDelay(500);
+		// Disconnected, the stop signal follows right away
+		vTaskDelay(1);
 		return;
 	}
 
@@ -70,6 +83,8 @@ void ANCS::Client::loopNotif(){
 	if(notif == nullptr) return;
 
 	if(!connected) return;
+	countBytes(notif->data.size());
+	ConMan.notifReceived();
 
 	auto data = notif->data;
 	if(notif->isIndicate){
@@ -83,183 +98,322 @@ void ANCS::Client::loopNotif(){
 	uint32_t uid = *((uint32_t*) &data[4]);
 
 	if(evt == NotificationAdded || evt == NotificationModified){
+		// Replayed on connect and maybe still cached from before, its date tells whether the preview is needed again
+		const bool verify = evt == NotificationAdded && (flags & EventFlagPreExisting) && tracksKnown();
+
 		std::lock_guard lock(needDataMut);
-		needData.push(QueuedNotif{ .uid = uid, .category = cat, .modify = (evt == NotificationModified) });
-		requestData(uid);
+		fetchedFull.erase(uid); // The new version comes in as a preview again
+
+		// Already waiting for a request slot, the single fetch will get the latest attributes
+		auto queued = std::find_if(needData.begin(), needData.end(), [uid](const QueuedNotif& nd){ return nd.uid == uid; });
+		if(queued != needData.end()){
+			queued->category = cat;
+			queued->full = false; // A full fetch would only refresh the text, not the app ID
+			queued->verify = queued->verify && verify;
+			return;
+		}
+
+		needData.push_back(QueuedNotif{ .uid = uid, .category = cat, .modify = (evt == NotificationModified || findInFlight(uid) != nullptr),
+										.verify = verify });
+		needData.back().announced = millis();
+		pumpRequests();
 	}else if(evt == NotificationRemoved){
+		std::unique_lock lock(needDataMut);
+		needData.erase(std::remove_if(needData.begin(), needData.end(), [uid](const QueuedNotif& nd){ return nd.uid == uid; }), needData.end());
+		fetchedFull.erase(uid);
+		if(auto nd = findInFlight(uid)){
+			nd->removed = true;
+		}
+		lock.unlock();
+
 		notifRemove(uid);
 	}
 }
 
 void ANCS::Client::loopData(){
 	if(chr.data == nullptr || !connected){
-		vTaskDelay(500);
+		vTaskDelay(1);
 		return;
 	}
 
-	auto notif = chr.data->getNextNotif(processingAttrs ? 3500 : portMAX_DELAY); // if no data for 500ms
-	if(notif == nullptr && !processingAttrs) return;
+	auto notif = chr.data->getNextNotif(nextTimeout());
 
 	if(!connected) return;
 
-	if(processingAttrs && notif == nullptr){
-		processData(true);
+	if(notif){
+		countBytes(notif->data.size());
+
+		const uint64_t start = micros();
+		parse(notif->data.data(), notif->data.size());
+		countParse(micros() - start);
+	}
+
+	expireRequests();
+}
+
+ANCS::Client::QueuedNotif* ANCS::Client::findInFlight(uint32_t uid){
+	auto nd = std::find_if(inFlight.begin(), inFlight.end(), [uid](const QueuedNotif& nd){ return nd.uid == uid; });
+	return nd == inFlight.end() ? nullptr : &*nd;
+}
+
+void ANCS::Client::pumpRequests(){
+	// Called with needDataMut locked. A notif can only be in flight once, otherwise responses couldn't be told apart.
+	for(auto it = needData.begin(); it != needData.end() && inFlight.size() < Window;){
+		if(findInFlight(it->uid)){
+			++it;
+			continue;
+		}
+
+		auto& nd = inFlight.emplace_back(std::move(*it));
+		it = needData.erase(it);
+
+		nd.sent = millis();
+		requestData(nd);
+	}
+
+	setQueueDepth(needData.size() + inFlight.size());
+}
+
+TickType_t ANCS::Client::nextTimeout(){
+	std::lock_guard lock(needDataMut);
+	if(inFlight.empty()) return RequestTimeout; // Requests can get sent while we're waiting, don't sleep past their timeout
+
+	uint64_t oldest = inFlight.front().sent;
+	for(const auto& nd : inFlight){
+		oldest = std::min(oldest, nd.sent);
+	}
+
+	const uint64_t elapsed = millis() - oldest;
+	return elapsed >= RequestTimeout ? 0 : (TickType_t) (RequestTimeout - elapsed);
+}
+
+void ANCS::Client::expireRequests(){
+	std::vector<uint32_t> expired;
+	{
+		std::lock_guard lock(needDataMut);
+		const uint64_t now = millis();
+		for(const auto& nd : inFlight){
+			if(now - nd.sent >= RequestTimeout){
+				expired.push_back(nd.uid);
+			}
+		}
+	}
+
+	for(auto uid : expired){
+		ESP_LOGW(TAG, "Attribute request for notif 0x%lx timed out", uid);
+		countDrop();
+		{
+			std::lock_guard lock(needDataMut);
+			auto nd = findInFlight(uid);
+			if(nd && nd->full){
+				fetchedFull.erase(uid); // Try again the next time it's opened
+			}
+		}
+		if(parser.state != Parser::State::Header && parser.uid == uid){
+			parser = {};
+		}
+		finish(uid);
+	}
+}
+
+void ANCS::Client::finish(uint32_t uid){
+	std::unique_lock lock(needDataMut);
+	auto it = std::find_if(inFlight.begin(), inFlight.end(), [uid](const QueuedNotif& nd){ return nd.uid == uid; });
+	if(it == inFlight.end()) return;
+
+	QueuedNotif nd = std::move(*it);
+	inFlight.erase(it);
+	pumpRequests();
+	lock.unlock();
+
+	if(nd.removed) return;
+
+	if(nd.verify){
+		if(notifKnown(uid, (Notif::Category) nd.category, stampOf(nd.date))) return;
+
+		// Changed or dropped while disconnected, or the check timed out, fetched like a new one unless it already is
+		lock.lock();
+		auto queued = std::find_if(needData.begin(), needData.end(), [uid](const QueuedNotif& other){ return other.uid == uid; });
+		if(queued == needData.end() && findInFlight(uid) == nullptr){
+			needData.push_back(QueuedNotif{ .uid = uid, .category = nd.category, .modify = false, .announced = nd.announced });
+			pumpRequests();
+		}
 		return;
 	}
 
-	dataQueue.insert(dataQueue.cend(), notif->data.cbegin(), notif->data.cend());
-	processData(false);
+	countLatency(millis() - nd.announced);
+	deliver(std::move(nd));
 }
 
-void ANCS::Client::requestData(uint32_t uid){
+void ANCS::Client::deliver(QueuedNotif nd){
+	Notif notif = std::move(nd.notif);
+	notif.uid = nd.uid;
+	notif.category = (Notif::Category) nd.category; // TODO: Currently, Notif categories map 1:1 to ANCS categories. In the future, mapping will be needed
+	if(!nd.full){
+		notif.stamp = stampOf(nd.date); // Full fetches don't ask for the date, the stored notif's stamp stays
+	}
+
+	if(const char* name = labelApp(notif.appID)){
+		notif.appID = name;
+	}
+
+	ESP_LOGI(TAG, "Sending notif 0x%lx. Modify: %d\n", nd.uid, nd.modify);
+	if(nd.modify){
+		notifModify(std::move(notif));
+	}else{
+		notifNew(std::move(notif));
+	}
+}
+
+size_t ANCS::Client::attrCount(const QueuedNotif& nd){
+	if(nd.verify) return std::size(StampAttrs);
+	return nd.full ? std::size(FullAttrs) : std::size(PreviewAttrs);
+}
+
+uint32_t ANCS::Client::stampOf(const std::string& date){
+	if(date.empty()) return 0;
+
+	// FNV-1a, the date is a 15 character timestamp
+	uint32_t hash = 2166136261u;
+	for(char c : date){
+		hash = (hash ^ (uint8_t) c) * 16777619u;
+	}
+	return hash;
+}
+
+void ANCS::Client::requestData(const QueuedNotif& nd){
+	const uint32_t uid = nd.uid;
 	std::vector<uint8_t> buf;
 
-	buf.push_back(0);
+	buf.push_back(GetNotificationAttributes);
 	buf.insert(buf.cend(), (uint8_t*) &uid, (uint8_t*) (((uint32_t*) &uid) + 1));
 
-	for(int i = 0; i < AttributeID::COUNT; i++){
-		buf.push_back(i);
-		if(AttrNeedLen.count((AttributeID) i)){
-			buf.push_back(0xff);
-			buf.push_back(0xff);
+	auto add = [&buf](const AttrRequest& attr){
+		buf.push_back(attr.id);
+		if(needsLen(attr.id)){
+			buf.push_back(attr.maxLen & 0xff);
+			buf.push_back(attr.maxLen >> 8);
 		}
+	};
+
+	if(nd.verify){
+		for(const auto& attr : StampAttrs) add(attr);
+	}else if(nd.full){
+		for(const auto& attr : FullAttrs) add(attr);
+	}else{
+		for(const auto& attr : PreviewAttrs) add(attr);
 	}
 
 	chr.ctrl->write(buf);
 
-	ESP_LOGI(TAG, "Requesting data for notif 0x%lx\n", uid);
+	ESP_LOGI(TAG, "Requesting %s data for notif 0x%lx\n", nd.verify ? "date" : (nd.full ? "full" : "preview"), uid);
 }
 
-void ANCS::Client::processData(bool sendIncomplete){
-	// Send and remove the notification at the front of needData queue
-	// Exits the notification processing state (resets processingAttrs)
-	auto send = [this](){
-		std::unique_lock lock(needDataMut);
-		QueuedNotif nd = needData.front(); // important: create a copy, the reference is going to get invalidated after pop below
-		needData.pop();
-		lock.unlock();
+void ANCS::Client::fetchFull(const Notif& notif){
+	if(!connected) return;
 
-		auto get = [&nd](AttributeID id){
-			auto attr = nd.attrs.find(id);
-			if(attr == nd.attrs.end()) return std::string();
-			return attr->second;
-		};
-
-		Notif notif = {
-				.uid = nd.uid,
-				.title = get(Title),
-				//.subtitle = get(Subtitle),
-				.message = get(Message),
-				.appID = get(AppIdentifier),
-				//.time = {}, // TODO
-				//.label = { .pos = get(PositiveActionLabel), .neg = get(NegativeActionLabel) },
-				.category = (Notif::Category) nd.category // TODO: Currently, Notif categories map 1:1 to ANCS categories. In the future, mapping will be needed
-		};
-
-		if(AppIDMap.count(notif.appID)){
-			notif.appID = AppIDMap.at(notif.appID);
-		}
+	std::lock_guard lock(needDataMut);
+	if(fetchedFull.count(notif.uid)) return;
 
+	auto queued = std::find_if(needData.begin(), needData.end(), [&notif](const QueuedNotif& nd){ return nd.uid == notif.uid; });
+	if(queued != needData.end()) return; // A preview refresh is already queued, it'll get opened again once it lands
 
-		ESP_LOGI(TAG, "Sending notif 0x%lx. Modify: %d\n", nd.uid, nd.modify);
-		if(nd.modify){
-			notifModify(notif);
-		}else{
-			notifNew(notif);
-		}
+	fetchedFull.insert(notif.uid);
 
-		processingAttrs = false;
-	};
+	// Starts from the stored notif so the app ID and category survive, the text gets overwritten as it streams in
+	needData.push_back(QueuedNotif{ .uid = notif.uid, .category = (CategoryID) notif.category, .modify = true, .full = true, .notif = notif });
+	needData.back().announced = millis();
+	pumpRequests();
+}
 
-#define err() if(sendIncomplete){ send(); } return
+std::string* ANCS::Client::attrTarget(QueuedNotif& nd, AttributeID attr){
+	switch(attr){
+		case AppIdentifier: return &nd.notif.appID;
+		case Title: return &nd.notif.title;
+		case Message: return &nd.notif.message;
+		case Date: return &nd.date;
+		default: return nullptr;
+	}
+}
 
-	auto getNext = [this]() -> uint32_t {
-		std::lock_guard lock(needDataMut);
-		if(needData.size() == 0) return -1;
-		return needData.front().uid;
-	};
+void ANCS::Client::parse(const uint8_t* data, size_t size){
+	std::vector<uint32_t> done;
 
-	uint32_t uid = -1;
-	while((uid = getNext()) != (uint32_t) -1){
-		// Search for start of data for this notification
-		if(!processingAttrs){
-			uint8_t target[5] = { 0 };
-			memcpy(target + 1, &uid, 4);
-
-			int matched = 0, i = 0;
-			for(; i < dataQueue.size() && matched < 5; i++){
-				if(dataQueue[i] == target[matched]){
-					matched++;
-				}else{
-					matched = 0;
-
-					if(dataQueue[i] == target[matched]){
-						matched++;
-					}
+	std::unique_lock lock(needDataMut);
+	QueuedNotif* nd = parser.state == Parser::State::Header ? nullptr : findInFlight(parser.uid);
+	if(parser.state != Parser::State::Header && nd == nullptr){
+		// Timed out or the link was reset under us
+		parser = {};
+	}
+
+	while(size > 0){
+		switch(parser.state){
+			case Parser::State::Header: {
+				parser.buf[parser.bufLen++] = *data++;
+				size--;
+				if(parser.bufLen < 5) break;
+
+				uint32_t uid;
+				memcpy(&uid, parser.buf + 1, sizeof(uid));
+
+				nd = parser.buf[0] == GetNotificationAttributes ? findInFlight(uid) : nullptr;
+				if(nd == nullptr){
+					// Leftover of a response that timed out, or garbage. Slide the window by one byte.
+					memmove(parser.buf, parser.buf + 1, 4);
+					parser.bufLen = 4;
+					break;
 				}
-			}
-			dataQueue.erase(dataQueue.begin(), dataQueue.begin() + i - matched);
 
-			if(matched == 5){
-				// Matched whole header
-				processingAttrs = true;
 				ESP_LOGI(TAG, "Found header for notif 0x%lx\n", uid);
-
-				// We've entered the notification processing state, notif at the front of needData is the notif we're processing from now on
-				// Erase the found header from data buffer
-				dataQueue.erase(dataQueue.begin(), dataQueue.begin() + 5);
-			}else{
-				// No header found => data is incomplete
-				err();
+				parser.uid = uid;
+				parser.bufLen = 0;
+				parser.state = Parser::State::AttrHeader;
+				break;
 			}
-		}
 
-		while(dataQueue.size()){
-			std::unique_lock lock(needDataMut);
-			auto attrID = needData.front().currAttr;
-			auto attrLen = needData.front().currAttrLen;
-			lock.unlock();
+			case Parser::State::AttrHeader: {
+				parser.buf[parser.bufLen++] = *data++;
+				size--;
+				if(parser.bufLen < 3) break;
 
-			// Search for next attribute ID and length
-			if(attrID == AttributeID::COUNT){
-				if(dataQueue.size() < 3){
-					err();
-				}
-
-				attrID = (AttributeID) dataQueue[0];
-				attrLen = *((uint16_t*) &dataQueue[1]);
-
-				dataQueue.erase(dataQueue.begin(), dataQueue.begin() + 3);
+				parser.attr = (AttributeID) parser.buf[0];
+				parser.remaining = parser.buf[1] | (parser.buf[2] << 8);
+				parser.bufLen = 0;
+				parser.state = Parser::State::AttrValue;
 
-				lock.lock();
-				needData.front().currAttr = attrID;
-				needData.front().currAttrLen = attrLen;
-				lock.unlock();
+				if(auto target = attrTarget(*nd, parser.attr)){
+					target->clear();
+					target->reserve(parser.remaining);
+				}
+				break;
 			}
 
-			// Waiting for rest of attr
-			if(dataQueue.size() < attrLen){
-				err();
+			case Parser::State::AttrValue: {
+				const size_t len = std::min(size, (size_t) parser.remaining);
+				if(auto target = attrTarget(*nd, parser.attr)){
+					target->append((const char*) data, len);
+				}
+				data += len;
+				size -= len;
+				parser.remaining -= len;
+				break;
 			}
+		}
 
-			// Extract attribute
-			const auto data = &dataQueue[0];
-			const auto val = std::string(data, data + attrLen);
-			dataQueue.erase(dataQueue.begin(), dataQueue.begin() + attrLen);
-
-			// Insert new attribute
-			lock.lock();
-			needData.front().attrs[attrID].append(val);
-			needData.front().currAttr = AttributeID::COUNT;
-			needData.front().currAttrLen = 0;
-			auto attrCount = needData.front().attrs.size();
-			lock.unlock();
-
-			// If all attributes received, send the notification
-			if(sendIncomplete || attrCount >= AttributeID::COUNT){
-				send();
-				break;
+		// Attribute complete, including zero-length ones which never see a byte of value
+		if(parser.state == Parser::State::AttrValue && parser.remaining == 0){
+			parser.state = Parser::State::AttrHeader;
+			if(++nd->attrsDone >= attrCount(*nd)){
+				done.push_back(parser.uid);
+				parser = {};
+				nd = nullptr;
 			}
 		}
 	}
+
+	lock.unlock();
+
+	for(auto uid : done){
+		finish(uid);
+	}
 }
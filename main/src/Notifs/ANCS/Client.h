@@ -5,11 +5,12 @@
 #include "Notifs/NotifSource.h"
 #include "Util/Threaded.h"
 #include "Model.h"
-#include <queue>
+#include <atomic>
 #include <deque>
 #include <mutex>
 #include <cstdint>
 #include <vector>
+#include <unordered_set>
 
 namespace ANCS {
 
@@ -20,6 +21,8 @@ public:
 
 	void actionPos(uint32_t uid) override;
 	void actionNeg(uint32_t uid) override;
+	void fetchFull(const Notif& notif) override;
+	bool replaysOnConnect() const override{ return true; }
 
 private:
 	std::shared_ptr<BLE::Client::Service> service;
@@ -29,11 +32,12 @@ private:
 		std::shared_ptr<BLE::Client::Char> data;
 	} chr;
 
-	bool connected = false;
+	std::atomic_bool connected = false;
 
 	void onConn();
 	void onDiscon();
 
+	/** Started once discovery finds ANCS on the phone and stopped when it disconnects, Android phones never start them */
 	ThreadedClosure notifThread;
 	ThreadedClosure dataThread;
 
@@ -44,17 +48,71 @@ private:
 		uint32_t uid;
 		CategoryID category;
 		bool modify; // whether it's a new notification or a modification
-		std::unordered_map<AttributeID, std::string> attrs;
-		AttributeID currAttr = AttributeID::COUNT;
-		uint32_t currAttrLen = 0;
+		bool full = false; // second tier: the whole title and message of a notif that's already been delivered
+		bool verify = false; // cached from before, only its date is fetched to tell if it changed meanwhile
+		bool removed = false; // removed while its request was in flight, dropped instead of delivered
+		uint64_t announced = 0; // [ms] when the phone told us about it
+		uint64_t sent = 0; // [ms] when its attributes were requested
+		Notif notif = {}; // Attributes are written straight in as they stream in, moved out on delivery
+		std::string date; // Notif::stamp is hashed from it
+		uint8_t attrsDone = 0;
 	};
-	std::queue<QueuedNotif> needData;
+
+	/**
+	 * Attribute requests are pipelined: up to Window of them are in flight at once, the rest wait in needData.
+	 * Responses are matched to their request by the UID in the response header, and each request times out on its own.
+	 */
+	static constexpr size_t Window = 4;
+	static constexpr uint32_t RequestTimeout = 1500; // [ms]
+	/**
+	 * Attributes are fetched in two tiers. New and modified notifs get their app ID and a preview of their title and
+	 * message, enough for the lock screen icon and item. The full title and message are only fetched once the notif
+	 * is opened (fetchFull), so long bodies don't go over the air during notification floods.
+	 * The date comes with the preview and goes into the notif's stamp, the phone moves it when the notification is
+	 * updated. Cached notifs replayed on connect only get their date fetched (StampAttrs), and the preview only if it
+	 * changed. The other attributes Notif doesn't carry aren't requested at all.
+	 */
+	struct AttrRequest {
+		AttributeID id;
+		uint16_t maxLen; // [B], only sent for attributes that needsLen
+	};
+	static constexpr uint16_t MaxAttrLen = 1024; // [B]
+	static constexpr AttrRequest PreviewAttrs[] = { { AppIdentifier, 0 }, { Title, 64 }, { Message, 32 }, { Date, 0 } };
+	static constexpr AttrRequest FullAttrs[] = { { Title, MaxAttrLen }, { Message, MaxAttrLen } };
+	static constexpr AttrRequest StampAttrs[] = { { Date, 0 } };
+	static size_t attrCount(const QueuedNotif& nd);
+	static uint32_t stampOf(const std::string& date);
+	std::unordered_set<uint32_t> fetchedFull; // Guarded by needDataMut
+
+	std::deque<QueuedNotif> needData;
+	std::vector<QueuedNotif> inFlight;
 	std::mutex needDataMut;
 
-	void requestData(uint32_t uid);
-	void processData(bool sendIncomplete);
-	std::deque<uint8_t> dataQueue;
-	bool processingAttrs = false;
+	QueuedNotif* findInFlight(uint32_t uid);
+	void pumpRequests();
+	void expireRequests();
+	TickType_t nextTimeout();
+	void finish(uint32_t uid);
+	void deliver(QueuedNotif nd);
+
+	void requestData(const QueuedNotif& nd);
+
+	/**
+	 * Resumable parser for the Data Source stream. Every byte of every GATT notification is looked at once: the header
+	 * goes through a 5 byte window (which also resyncs after a dropped response), attribute values are appended
+	 * straight into the in-flight notif they belong to, and unwanted ones are skipped without being copied.
+	 */
+	struct Parser {
+		enum class State : uint8_t { Header, AttrHeader, AttrValue } state = State::Header;
+		uint8_t buf[5]; // Command ID + notif UID, or attribute ID + length
+		uint8_t bufLen = 0;
+		uint32_t uid = 0;
+		AttributeID attr = AttributeID::COUNT;
+		uint16_t remaining = 0; // [B] of the current attribute value
+	} parser;
+
+	void parse(const uint8_t* data, size_t size);
+	static std::string* attrTarget(QueuedNotif& nd, AttributeID attr);
 
 	static constexpr esp_bt_uuid_t ServiceUUID =			{ .len = ESP_UUID_LEN_128, .uuid = { .uuid128 = { 0xD0, 0x00, 0x2D, 0x12, 0x1E, 0x4B, 0x0F, 0xA4, 0x99, 0x4E, 0xCE, 0xB5, 0x31, 0xF4, 0x05, 0x79 }}};
 	static constexpr esp_bt_uuid_t Char_NotifSource_UUID =	{ .len = ESP_UUID_LEN_128, .uuid = { .uuid128 = { 0xbd, 0x1d, 0xa2, 0x99, 0xe6, 0x25, 0x58, 0x8c, 0xd9, 0x42, 0x01, 0x63, 0x0d, 0x12, 0xbf, 0x9f }}};
@@ -1,54 +1,75 @@
 #include "Model.h"
-#include <unordered_map>
-#include <cstdint>
+#include <algorithm>
+#include <iterator>
 
 namespace ANCS {
 
-	// const std::unordered_set<NotificationAttributeID> AttrNeedLen = { Title, Subtitle, Message };
-
-	static const std::unordered_map<uint16_t, const char*> ErrString = {
-			{ ANCS::Error::Unknown_command,   "Unknown command" },
-			{ ANCS::Error::Invalid_command,   "Invalid command" },
-			{ ANCS::Error::Invalid_parameter, "Invalid parameter" },
-			{ ANCS::Error::Action_failed,     "Action failed" }
+	struct AppName {
+		std::string_view id;
+		const char* name;
 	};
 
-	static const std::unordered_map<uint8_t, const char*> EventString = {
-			{ ANCS::EventID::NotificationAdded,    "New notification" },
-			{ ANCS::EventID::NotificationModified, "Modified notification" },
-			{ ANCS::EventID::NotificationRemoved,  "Removed notification" }
+	// Sorted by bundle ID for the binary search in labelApp
+	static constexpr AppName AppNames[] = {
+			{ "com.apple.MobileSMS",      "Messages" },
+			{ "com.burbn.instagram",      "Instagram" },
+			{ "com.facebook.Messenger",   "Messenger" },
+			{ "com.toyopagroup.picaboo",  "Snapchat" },
+			{ "com.zhiliaoapp.musically", "TikTok" },
+			{ "net.whatsapp.WhatsApp",    "WhatsApp" }
 	};
 
-	static const std::unordered_map<uint8_t, const char*> CategoryString = {
-			{ ANCS::CategoryID::Other,              "Other" },
-			{ ANCS::CategoryID::IncomingCall,       "IncomingCall" },
-			{ ANCS::CategoryID::MissedCall,         "MissedCall" },
-			{ ANCS::CategoryID::Voicemail,          "Voicemail" },
-			{ ANCS::CategoryID::Social,             "Social" },
-			{ ANCS::CategoryID::Schedule,           "Schedule" },
-			{ ANCS::CategoryID::Email,              "Email" },
-			{ ANCS::CategoryID::News,               "News" },
-			{ ANCS::CategoryID::HealthAndFitness,   "HealthAndFitness" },
-			{ ANCS::CategoryID::BusinessAndFinance, "BusinessAndFinance" },
-			{ ANCS::CategoryID::Location,           "Location" },
-			{ ANCS::CategoryID::Entertainment,      "Entertainment" }
-	};
+	static constexpr bool sorted(){
+		for(size_t i = 1; i < std::size(AppNames); i++){
+			if(!(AppNames[i - 1].id < AppNames[i].id)) return false;
+		}
+		return true;
+	}
+	static_assert(sorted(), "AppNames must be sorted by ID");
+
+}
+
+const char* ANCS::labelApp(std::string_view appID){
+	const auto app = std::lower_bound(std::begin(AppNames), std::end(AppNames), appID, [](const AppName& entry, std::string_view id){
+		return entry.id < id;
+	});
+	if(app == std::end(AppNames) || app->id != appID) return nullptr;
+	return app->name;
 }
 
 const char* ANCS::labelError(ANCS::Error error){
-	auto label = ErrString.find(error);
-	if(label == ErrString.end()) return "Unknown error";
-	return label->second;
+	switch(error){
+		case Unknown_command: return "Unknown command";
+		case Invalid_command: return "Invalid command";
+		case Invalid_parameter: return "Invalid parameter";
+		case Action_failed: return "Action failed";
+		default: return "Unknown error";
+	}
 }
 
 const char* ANCS::labelEvent(ANCS::EventID evt){
-	auto label = EventString.find(evt);
-	if(label == EventString.end()) return "Unknown EventID";
-	return label->second;
+	switch(evt){
+		case NotificationAdded: return "New notification";
+		case NotificationModified: return "Modified notification";
+		case NotificationRemoved: return "Removed notification";
+		default: return "Unknown EventID";
+	}
 }
 
 const char* ANCS::labelCategory(ANCS::CategoryID cat){
-	auto label = CategoryString.find(cat);
-	if(label == CategoryString.end()) return "Unknown CategoryID";
-	return label->second;
+	switch(cat){
+		case Other: return "Other";
+		case IncomingCall: return "IncomingCall";
+		case MissedCall: return "MissedCall";
+		case Voicemail: return "Voicemail";
+		case Social: return "Social";
+		case Schedule: return "Schedule";
+		case Email: return "Email";
+		case News: return "News";
+		case HealthAndFitness: return "HealthAndFitness";
+		case BusinessAndFinance: return "BusinessAndFinance";
+		case Location: return "Location";
+		case Entertainment: return "Entertainment";
+		default: return "Unknown CategoryID";
+	}
 }
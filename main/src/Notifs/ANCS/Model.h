@@ -1,9 +1,7 @@
 #ifndef CLOCKSTAR_FIRMWARE_MODEL_H
 #define CLOCKSTAR_FIRMWARE_MODEL_H
 
-#include <unordered_set>
-#include <map>
-#include <string>
+#include <string_view>
 
 namespace ANCS {
 	enum Error {
@@ -27,6 +25,14 @@ namespace ANCS {
 		//Reserved EventID values = 3–255
 	};
 
+	enum EventFlags {
+		EventFlagSilent = (1 << 0),
+		EventFlagImportant = (1 << 1),
+		EventFlagPreExisting = (1 << 2), // Was already on the phone when we subscribed, replayed on every connect
+		EventFlagPositiveAction = (1 << 3),
+		EventFlagNegativeAction = (1 << 4),
+	};
+
 	enum AttributeID {
 		AppIdentifier = 0,
 		Title = 1, // (Needs to be followed by a 2-bytes max length parameter)
@@ -39,7 +45,18 @@ namespace ANCS {
 		// Reserved NotificationAttributeID values = 8–255
 		COUNT
 	};
-	static const std::unordered_set<AttributeID> AttrNeedLen = { Title, Subtitle, Message }; // Attributes that require max length specified when requesting data
+
+	/** Attributes that require max length specified when requesting data */
+	constexpr bool needsLen(AttributeID attr){
+		switch(attr){
+			case Title:
+			case Subtitle:
+			case Message:
+				return true;
+			default:
+				return false;
+		}
+	}
 
 	enum ActionID {
 		ActionIDPositive = 0,
@@ -63,14 +80,8 @@ namespace ANCS {
 		// Reserved CategoryID values = 12–255
 	};
 
-	static const std::map<std::string, std::string> AppIDMap = {
-			{ "com.apple.MobileSMS",      "Messages" },
-			{ "com.facebook.Messenger",   "Messenger" },
-			{ "net.whatsapp.WhatsApp",    "WhatsApp" },
-			{ "com.burbn.instagram",      "Instagram" },
-			{ "com.toyopagroup.picaboo",  "Snapchat" },
-			{ "com.zhiliaoapp.musically", "TikTok" }
-	};
+	/** Name of a known app by its bundle ID, nullptr for the rest */
+	const char* labelApp(std::string_view appID);
 
 	const char* labelError(Error error);
 	const char* labelEvent(EventID evt);
@@ -1,32 +1,16 @@
 #include "Bangle.h"
 #include "Util/Services.h"
 #include "Services/Time.h"
-#include <mjson.h>
+#include "Services/RTCTelemetry.h"
+#include "Util/stdafx.h"
 #include <esp_log.h>
 #include <cmath>
-#include <regex>
-#include <mbedtls/base64.h>
+#include <charconv>
+#include <cstring>
 
 static const char* TAG = "Bangle";
-const std::map<std::pair<Bangle::CallState, Bangle::CallCmd>, Bangle::CallState> Bangle::CallTransitions = {
-		{ { Bangle::CallState::None,             Bangle::CallCmd::Incoming }, Bangle::CallState::Incoming },
-		{ { Bangle::CallState::None,             Bangle::CallCmd::Outgoing }, Bangle::CallState::Outgoing },
-		{ { Bangle::CallState::Incoming,         Bangle::CallCmd::End },      Bangle::CallState::IncomingMissed },
-		{ { Bangle::CallState::Incoming,         Bangle::CallCmd::Start },    Bangle::CallState::IncomingAccepted },
-		{ { Bangle::CallState::IncomingMissed,   Bangle::CallCmd::Any },      Bangle::CallState::None },
-		{ { Bangle::CallState::IncomingAccepted, Bangle::CallCmd::End },      Bangle::CallState::None },
-		{ { Bangle::CallState::Outgoing,         Bangle::CallCmd::End },      Bangle::CallState::None }
-};
-
-const std::unordered_map<Bangle::CallState, Bangle::CallInfo> Bangle::CallInfoMap = {
-		{ Bangle::CallState::Incoming,         { "Incoming call",       Notif::Category::IncomingCall } },
-		{ Bangle::CallState::IncomingMissed,   { "Missed call",         Notif::Category::MissedCall } },
-		{ Bangle::CallState::Outgoing,         { "Calling...",          Notif::Category::OutgoingCall } },
-		{ Bangle::CallState::IncomingAccepted, { "Call in progress...", Notif::Category::IncomingCall } }
-};
-
-
-Bangle::Bangle(BLE::Server* server) : Threaded("Bangle", 4 * 1024), server(server), uart(server){
+
+Bangle::Bangle(BLE::Server* server) : Threaded("Bangle", 4 * 1024, PlannedTask::Bangle), server(server), uart(server){
 	server->setOnDisconnectCb([this](const esp_bd_addr_t addr){ onDisconnect(); });
 	start();
 }
@@ -37,15 +21,44 @@ Bangle::~Bangle(){
 	server->setOnDisconnectCb({});
 }
 
+void Bangle::park(){
+	stop();
+	uart.release();
+	ESP_LOGI(TAG, "Parked");
+}
+
+void Bangle::unpark(){
+	if(running()) return;
+
+	uart.reserve();
+	start();
+	ESP_LOGI(TAG, "Unparked");
+}
+
+void Bangle::afterStopSignal(){
+	uart.interrupt();
+}
+
 void Bangle::onConnect(){
 	if(connected) return;
 	connected = true;
 	connect();
+
+	// Shows up as a toast in Gadgetbridge, once per crash
+	char report[192];
+	if(RTCTelemetry::takeCrashReport(report, sizeof(report))){
+		if(binary){
+			uart.sendFrame((uint8_t) GBBinary::Frame::Warn, (const uint8_t*) report, strlen(report));
+		}else{
+			uart.printf("{t:\"warn\",msg:\"%s\"} \n", report);
+		}
+	}
 }
 
 void Bangle::onDisconnect(){
 	if(!connected) return;
 	connected = false;
+	binary = false;
 	currentCallState = CallState::None;
 	currentCallId = -1;
 	missedCalls.clear();
@@ -68,39 +81,112 @@ void Bangle::actionNeg(uint32_t uid){
 		return;
 	}
 
+	if(binary){
+		const uint8_t id[4] = { (uint8_t) uid, (uint8_t) (uid >> 8), (uint8_t) (uid >> 16), (uint8_t) (uid >> 24) };
+		uart.sendFrame((uint8_t) GBBinary::Frame::Dismiss, id, sizeof(id));
+		return;
+	}
+
 	uart.printf("{t:\"notify\",id:%d,n:\"DISMISS\"} \n", uid);
 }
 
+// Resent every ring period, so kept ready instead of formatted each time
+static constexpr char FindPhoneOn[] = "{t:\"findPhone\",n:true} \n";
+static constexpr char FindPhoneOff[] = "{t:\"findPhone\",n:false} \n";
+
 void Bangle::findPhoneStart(){
 	if(!connected) return;
-	uart.printf("{t:\"findPhone\",n:true} \n");
+
+	if(binary){
+		const uint8_t on = 1;
+		uart.sendFrame((uint8_t) GBBinary::Frame::FindPhone, &on, 1);
+		return;
+	}
+
+	uart.print(FindPhoneOn, sizeof(FindPhoneOn) - 1);
 }
 
 void Bangle::findPhoneStop(){
 	if(!connected) return;
-	uart.printf("{t:\"findPhone\", n:false} \n");
+
+	if(binary){
+		const uint8_t on = 0;
+		uart.sendFrame((uint8_t) GBBinary::Frame::FindPhone, &on, 1);
+		return;
+	}
+
+	uart.print(FindPhoneOff, sizeof(FindPhoneOff) - 1);
 }
 
 void Bangle::loop(){
-	auto data = uart.scan_nl(portMAX_DELAY);
-	if(!data || data->empty()) return;
+	// The scan is picked once a write is in, a disconnect while waiting has switched back to lines by then
+	if(!uart.wait(portMAX_DELAY)) return;
 
-	std::string line(data->cbegin(), data->cend());
-	data.reset();
+	const bool frames = binary;
+	if(frames != framed){
+		framed = frames;
+		uart.dropPartial();
+	}
 
+	if(frames){
+		const auto frame = uart.scan_frame(0);
+		if(!frame) return;
+
+		countBytes(frame.size);
+
+		const uint64_t start = micros();
+		handleFrame(frame.data, frame.size);
+		countParse(micros() - start);
+		return;
+	}
+
+	auto line = uart.scan_nl(0);
+	if(!line || line.size == 0) return;
+
+	countBytes(line.size + 1);
+
+	// The view stays valid until the next scan_nl
+	const uint64_t start = micros();
+	handleLine(std::string_view((const char*) line.data, line.size));
+	countParse(micros() - start);
+}
+
+#ifdef CONFIG_CM_REPLAY
+void Bangle::replayLine(std::string_view line){
+	if(!connected){
+		connected = true;
+		connect();
+	}
+
+	countBytes(line.size() + 1);
+
+	const uint64_t start = micros();
+	handleLine(line);
+	countParse(micros() - start);
+}
+
+void Bangle::replayDisconnect(){
+	onDisconnect();
+}
+#endif
+
+void Bangle::handleLine(std::string_view line){
 	// trimming
-	line.erase(line.begin(), std::find_if(line.begin(), line.end(), [](unsigned char ch){ return !std::isspace(ch); }));
-	line.erase(std::find_if(line.rbegin(), line.rend(), [](unsigned char ch){ return !std::isspace(ch); }).base(), line.end());
+	static constexpr const char* Space = " \t\r\n\v\f";
+	const auto first = line.find_first_not_of(Space);
+	if(first == std::string_view::npos) return;
+	line = line.substr(first, line.find_last_not_of(Space) - first + 1);
 
-	ESP_LOGV(TAG, "%s", line.c_str());
+	ESP_LOGV(TAG, "%.*s", (int) line.size(), line.data());
 
 	auto gbStart = line.find("GB(");
-	if(gbStart != std::string::npos && line.back() == ')'){
-		line.erase(line.cbegin(), line.cbegin() + gbStart + 3);
-		line.pop_back();
+	if(gbStart != std::string_view::npos && line.back() == ')'){
+		line.remove_prefix(gbStart + 3);
+		line.remove_suffix(1);
 
-		if(line[0] != '{' || line[line.size() - 1] != '}'){
-			ESP_LOGD(TAG, "Malformed JSON: %s", line.c_str());
+		if(line.empty() || line.front() != '{' || line.back() != '}'){
+			ESP_LOGD(TAG, "Malformed JSON: %.*s", (int) line.size(), line.data());
+			countDrop();
 			return;
 		}
 
@@ -108,32 +194,37 @@ void Bangle::loop(){
 		return;
 	}
 
-	auto findArg = [&line](std::string fn){
-		fn.push_back('(');
-
+	// fn includes the opening parenthesis
+	auto findArg = [line](std::string_view fn){
 		auto fnStart = line.find(fn);
-		if(fnStart == std::string::npos) return std::string();
+		if(fnStart == std::string_view::npos) return std::string_view();
 
 		fnStart += fn.size();
 
-		auto fnEnd = line.find(")", fnStart);
-		if(fnEnd == std::string::npos) return std::string();
+		auto fnEnd = line.find(')', fnStart);
+		if(fnEnd == std::string_view::npos) return std::string_view();
 
-		return std::string(line.cbegin() + fnStart, line.cend() + fnEnd);
+		return line.substr(fnStart, fnEnd - fnStart);
 	};
 
-	auto time = findArg("setTime");
+	auto time = findArg("setTime(");
 	if(!time.empty()){
-		timeUnix = std::stoll(time);
-		ESP_LOGI(TAG, "Got UNIX time: %lld", timeUnix);
-		setTime();
+		long long unix = 0;
+		if(std::from_chars(time.data(), time.data() + time.size(), unix).ec == std::errc()){
+			timeUnix = unix;
+			ESP_LOGI(TAG, "Got UNIX time: %lld", timeUnix);
+			setTime();
+		}
 	}
 
-	auto timeZone = findArg("setTimeZone");
+	auto timeZone = findArg("setTimeZone(");
 	if(!timeZone.empty()){
-		timeOffset = std::stod(timeZone);
-		ESP_LOGI(TAG, "Got timezone: %f", timeOffset);
-		setTime();
+		float offset = 0;
+		if(std::from_chars(timeZone.data(), timeZone.data() + timeZone.size(), offset).ec == std::errc()){
+			timeOffset = offset;
+			ESP_LOGI(TAG, "Got timezone: %f", timeOffset);
+			setTime();
+		}
 	}
 }
 
@@ -142,8 +233,8 @@ void Bangle::setTime(){
 
 	auto time = timeUnix + timeOffset * 60 * 60 + 20;
 
-	auto ts = static_cast<Time*>(Services.get(Service::Time));
-	ts->setTime((time_t) time);
+	auto ts = Services.get<Service::Time>();
+	ts->sync((time_t) time);
 
 	// If we receive time from the device, we'll consider this the "connected" event. Might happen
 	// multiple times during session, but since we're already connected, those onConnect calls will
@@ -151,55 +242,161 @@ void Bangle::setTime(){
 	onConnect();
 }
 
-void Bangle::handleCommand(const std::string& line){
+Bangle::Command Bangle::parseCommand(std::string_view t){
+	// Every command has a distinct length, except the two 4 letter ones
+	switch(t.size()){
+		case 4:
+			if(t == "find") return Command::Find;
+			if(t == "call") return Command::Call;
+			return Command::Unknown;
+		case 5:
+			return t == "proto" ? Command::Proto : Command::Unknown;
+		case 6:
+			return t == "notify" ? Command::Notify : Command::Unknown;
+		case 7:
+			return t == "notify-" ? Command::NotifyDel : Command::Unknown;
+		case 13:
+			return t == "is_gps_active" ? Command::IsGpsActive : Command::Unknown;
+		default:
+			return Command::Unknown;
+	}
+}
+
+void Bangle::handleCommand(std::string_view line){
 	if(!connected) return;
 
-	int comlen;
-	const char* com;
-	if(mjson_find(line.c_str(), line.size(), "$.t", &com, &comlen) != MJSON_TOK_STRING){
-		ESP_LOGW(TAG, "Invalid JSON, missing command: %s", line.c_str());
+	// One pass over the whole object, handlers only pick out and decode the fields they need
+	if(!json.parse(line) || json.raw(GBJson::T).empty()){
+		ESP_LOGW(TAG, "Invalid JSON, missing command: %.*s", (int) line.size(), line.data());
+		countDrop();
 		return;
 	}
 
-	std::string t(com + 1, com + comlen - 1);
-
-	static const std::unordered_map<std::string, std::function<void(const std::string& line)>> handlers = {
-			{ "is_gps_active", [this](const std::string& line){ handle_isGpsActive(); } },
-			{ "find",          [this](const std::string& line){
-				int on;
-				int res = mjson_get_bool(line.c_str(), line.size(), "$.n", &on);
-				handle_find(res && on);
-			} },
-			{ "notify",        [this](const std::string& line){ handle_notify(line); } },
-			{ "notify-",       [this](const std::string& line){
-				double id;
-				int res = mjson_get_number(line.c_str(), line.size(), "$.id", &id);
-				if(!res){
-					ESP_LOGE(TAG, "Received notify del withoud id");
-					return;
-				}
-
-				if(std::round(id) != id || id < 0){
-					ESP_LOGE(TAG, "Received notify del command with invalid id: %f", id);
-					return;
-				}
-
-				handle_notifyDel(id);
-			} },
-			{ "call",          [this](const std::string& line){ handle_call(line); } }
-	};
+	const std::string_view t = json.raw(GBJson::T);
+	const auto command = parseCommand(t);
+	if(command == Command::Unknown){
+		ESP_LOGW(TAG, "Unhandled command from phone: %.*s", (int) t.size(), t.data());
+		return;
+	}
+
+	ESP_LOGI(TAG, "Command: %.*s", (int) t.size(), t.data());
+	dispatch(command, json);
+}
+
+void Bangle::handleFrame(const uint8_t* frame, size_t size){
+	const auto type = (GBBinary::Frame) frame[1];
+	const std::string_view payload((const char*) frame + BLE::UART::FrameHeader, size - BLE::UART::FrameHeader);
+
+	if(type == GBBinary::Frame::Time){
+		if(payload.size() < 10){
+			countDrop();
+			return;
+		}
+
+		const auto p = (const uint8_t*) payload.data();
+		uint64_t unix = 0;
+		for(int i = 0; i < 8; i++){
+			unix |= (uint64_t) p[i] << (8 * i);
+		}
+		const auto offset = (int16_t) (p[8] | (p[9] << 8));
 
-	auto handler = handlers.find(t);
-	if(handler == handlers.end()){
-		ESP_LOGW(TAG, "Unhandled command from phone: %s", t.data());
+		timeUnix = unix;
+		timeOffset = offset / 60.0f;
+		ESP_LOGI(TAG, "Got UNIX time: %lld, timezone: %d min", timeUnix, offset);
+		setTime();
 		return;
 	}
 
-	ESP_LOGI(TAG, "Command: %s", t.data());
-	handler->second(line);
+	if(!connected) return;
+
+	Command command;
+	switch(type){
+		case GBBinary::Frame::Notify:
+			command = Command::Notify;
+			break;
+		case GBBinary::Frame::NotifyDel:
+			command = Command::NotifyDel;
+			break;
+		case GBBinary::Frame::Call:
+			command = Command::Call;
+			break;
+		case GBBinary::Frame::Find:
+			command = Command::Find;
+			break;
+		case GBBinary::Frame::IsGpsActive:
+			command = Command::IsGpsActive;
+			break;
+		default:
+			ESP_LOGW(TAG, "Unhandled frame from phone: 0x%02x", frame[1]);
+			return;
+	}
+
+	if(!bin.parse(payload)){
+		ESP_LOGW(TAG, "Truncated fields in frame 0x%02x", frame[1]);
+		countDrop();
+		return;
+	}
+
+	dispatch(command, bin);
+}
+
+template<typename Fields>
+void Bangle::dispatch(Command command, const Fields& fields){
+	switch(command){
+		case Command::IsGpsActive:
+			handle_isGpsActive();
+			break;
+
+		case Command::Find: {
+			bool on = false;
+			fields.boolean(GBJson::N, on);
+			handle_find(on);
+			break;
+		}
+
+		case Command::Notify:
+			handle_notify(fields);
+			break;
+
+		case Command::NotifyDel: {
+			double id;
+			if(!fields.number(GBJson::Id, id)){
+				ESP_LOGE(TAG, "Received notify del withoud id");
+				return;
+			}
+
+			if(std::round(id) != id || id < 0){
+				ESP_LOGE(TAG, "Received notify del command with invalid id: %f", id);
+				return;
+			}
+
+			handle_notifyDel(id);
+			break;
+		}
+
+		case Command::Call:
+			handle_call(fields);
+			break;
+
+		case Command::Proto: {
+			double version = 0;
+			fields.number(GBJson::N, version);
+			handle_proto(version > 0 ? (uint32_t) version : 0);
+			break;
+		}
+
+		case Command::Unknown:
+			break;
+	}
 }
 
 void Bangle::handle_isGpsActive(){
+	if(binary){
+		const uint8_t on = 0;
+		uart.sendFrame((uint8_t) GBBinary::Frame::GpsPower, &on, 1);
+		return;
+	}
+
 	uart.printf("{t:\"gps_power\",status:false} \n");
 }
 
@@ -208,39 +405,65 @@ void Bangle::handle_find(bool on){
 	// TODO: trigger an alarm or something
 }
 
-void Bangle::handle_notify(const std::string& line){
+// JSON strings have to be unescaped into scratch, binary ones are used in place from the frame
+static std::string_view text(const GBJson& json, GBJson::Field field, std::string& scratch){
+	json.string(field, scratch);
+	return scratch;
+}
+
+static std::string_view text(const GBBinary& bin, GBJson::Field field, std::string&){
+	return bin.raw(field);
+}
+
+template<typename Fields>
+void Bangle::handle_notify(const Fields& json){
 	double id;
-	int res = mjson_get_number(line.c_str(), line.size(), "$.id", &id);
-	if(!res){
+	if(!json.number(GBJson::Id, id)){
 		ESP_LOGE(TAG, "Received notify without id");
+		countDrop();
 		return;
 	}
 
 	if(std::round(id) != id || id < 0){
 		ESP_LOGE(TAG, "Received notify with invalid id: %f", id);
+		countDrop();
 		return;
 	}
 
-	Notif notif = {
-			.uid = (uint32_t) id,
-			.title = getProperty(line, "title"),
-			//.subtitle = get(line, "subject"),
-			.message = getProperty(line, "body"),
-			.appID = getProperty(line, "src"),
-			.category = Notif::Category::Other,
-	};
+	std::string title, message, app;
+	NotifView notif((uint32_t) id, text(json, GBJson::Title, title), text(json, GBJson::Body, message),
+					text(json, GBJson::Src, app), Notif::Category::Other);
+
+	// SMS come with the contact in sender and no title
+	if(notif.title.empty()){
+		notif.title = text(json, GBJson::Sender, title);
+	}
 
 	ESP_LOGI(TAG, "New notif ID %ld", notif.uid);
 
 	notifNew(notif);
 }
 
+void Bangle::handle_proto(uint32_t version){
+	// Answered in JSON either way, the phone switches once it sees the version it asked for
+	const bool supported = version == GBBinary::Version;
+	uart.printf("{t:\"proto\",n:%d} \n", supported ? GBBinary::Version : 0);
+	binary = supported;
+
+	if(supported){
+		ESP_LOGI(TAG, "Switched to binary frames v%lu", version);
+	}else{
+		ESP_LOGW(TAG, "Unsupported protocol v%lu, staying on JSON", version);
+	}
+}
+
 void Bangle::handle_notifyDel(uint32_t id){
 	ESP_LOGI(TAG, "Del notif ID %ld", id);
 	notifRemove(id);
 }
 
-void Bangle::handle_call(const std::string& line){
+template<typename Fields>
+void Bangle::handle_call(const Fields& json){
 	const auto hash = [](const std::string& str){
 		uint32_t n = 0;
 		for(int i = 0; i < str.size(); i++){
@@ -249,11 +472,11 @@ void Bangle::handle_call(const std::string& line){
 		return n;
 	};
 
-	auto name = getProperty(line, "name");
-	auto number = getProperty(line, "number");
+	auto name = json.string(GBJson::Name);
+	auto number = json.string(GBJson::Number);
 	auto uid = hash(name) * hash(number);
 
-	auto cmd = getProperty(line, "cmd");
+	auto cmd = json.string(GBJson::Cmd);
 	CallCmd command = CallCmd::Invalid;
 	if(cmd == "outgoing"){
 		command = CallCmd::Outgoing;
@@ -274,9 +497,7 @@ void Bangle::handle_call(const std::string& line){
 	}
 
 	//transition used only for incomingMissed -> None
-	if(CallTransitions.count({ currentCallState, CallCmd::Any })){
-		currentCallState = CallTransitions.at({ currentCallState, CallCmd::Any });
-	}
+	callTransition(currentCallState, CallCmd::Any);
 
 	//take care of edge-cases when multiple simultaneous calls occur
 	if(uid != currentCallId && currentCallState != CallState::None){
@@ -313,23 +534,23 @@ void Bangle::handle_call(const std::string& line){
 
 	currentCallId = uid;
 
-	if(CallTransitions.count({ currentCallState, command })){
-		currentCallState = CallTransitions.at({ currentCallState, command });
-	}else{
+	if(!callTransition(currentCallState, command)){
 		currentCallState = CallState::None;
 	}
 
-	if(!CallInfoMap.count(currentCallState) && !missedCalls.count(uid)){
-		notifRemove(uid);
+	// A missed call's notif stays up once the call is over
+	const auto& info = CallInfos[(size_t) currentCallState];
+	if(info.message == nullptr){
+		if(!missedCalls.count(uid)){
+			notifRemove(uid);
+		}
 		return;
 	}
 
-	const auto& info = CallInfoMap.at(currentCallState);
-
 	Notif notif = {
 			.uid = (uint32_t) uid,
 			.title = name + " (" + number + ")", //ime(broj)
-			//.subtitle = get(line, "subject"),
+			//.subtitle = json.string(GBJson::Subject),
 			.message = info.message, //incoming call, missed call
 			.appID = "",
 			.category = info.category
@@ -337,46 +558,3 @@ void Bangle::handle_call(const std::string& line){
 
 	notifModify(notif);
 }
-
-std::string Bangle::getProperty(const std::string& line, std::string prop){
-	prop.insert(0, "$.");
-	int len;
-	const char* val;
-	std::string s;
-
-	if(mjson_find(line.c_str(), line.size(), prop.c_str(), &val, &len) == MJSON_TOK_B64){
-		s = std::string(val + 1, val + len - 1);
-
-		size_t outLen = 0;
-		auto ret = mbedtls_base64_decode(nullptr, 0, &outLen, (unsigned char*) s.c_str(), s.length());
-		if(ret != MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL || outLen <= 0){
-			ESP_LOGW(TAG, "(1) Failed decoding base64: %s | Return status: %d", s.c_str(), ret);
-			return {};
-		}
-
-		std::string decoded(outLen + 1, '\0');
-		ret = mbedtls_base64_decode((unsigned char*) decoded.data(), decoded.size(), &outLen, (unsigned char*) s.c_str(), s.length());
-		if(ret != 0 || outLen <= 0){
-			ESP_LOGW(TAG, "(2) Failed decoding base64: %s | Return status: %d", s.c_str(), ret);
-			return {};
-		}
-		decoded.resize(outLen);
-
-		s = std::move(decoded);
-	}else if(mjson_find(line.c_str(), line.size(), prop.c_str(), &val, &len) == MJSON_TOK_STRING){
-		s = std::string(val + 1, val + len - 1);
-	}else{
-		ESP_LOGD(TAG, "Missing prop in notif: %s", prop.c_str() + 2);
-		return {};
-	}
-
-	s = std::regex_replace(s, std::regex(R"(\\u[a-zA-Z0-9]{3,4})"), "?");
-	s = std::regex_replace(s, std::regex(R"(\\n)"), "\n");
-	s = std::regex_replace(s, std::regex(R"(\\r)"), "\r");
-	s = std::regex_replace(s, std::regex(R"(\\\\)"), "\\");
-	s = std::regex_replace(s, std::regex(R"(\\t)"), "\t");
-	s.erase(std::remove(s.begin(), s.end(), '\r'), s.end());
-	std::replace(s.begin(), s.end(), '\t', ' ');
-
-	return s;
-}
@@ -4,7 +4,10 @@
 #include "Notifs/NotifSource.h"
 #include "BLE/Server.h"
 #include "BLE/UART.h"
-#include <map>
+#include "GBJson.h"
+#include "GBBinary.h"
+#include <atomic>
+#include <string_view>
 
 class Bangle : public NotifSource, private Threaded {
 public:
@@ -17,37 +20,100 @@ public:
 	void findPhoneStart();
 	void findPhoneStop();
 
+	/** Stops the task and frees the UART line buffer while an iPhone is connected */
+	void park() override;
+	void unpark() override;
+
+#ifdef CONFIG_CM_REPLAY
+	/**
+	 * Handles line as if the phone had sent it, connecting first, for the replay harness. Called from the harness'
+	 * task while the Bangle task waits on an idle UART, so there must be no real phone connected.
+	 */
+	void replayLine(std::string_view line);
+	void replayDisconnect();
+#endif
+
 private:
 	BLE::Server* server;
 	BLE::UART uart;
 
 	void loop() override;
+	void afterStopSignal() override;
+
+	/** Lines are parsed in place, line only has to stay valid for the duration of the call. */
+	void handleLine(std::string_view line);
+	void handleCommand(std::string_view line);
+
+	/** Binary counterpart of handleLine, for a whole frame from UART::scan_frame */
+	void handleFrame(const uint8_t* frame, size_t size);
+
+	enum class Command : uint8_t {
+		IsGpsActive, Find, Notify, NotifyDel, Call, Proto, Unknown
+	};
+	static Command parseCommand(std::string_view t);
 
-	void handleCommand(const std::string& line);
+	/** Fields is GBJson or GBBinary, both decode the same GBJson::Field s */
+	template<typename Fields>
+	void dispatch(Command command, const Fields& fields);
 
 	// command handlers
 	void handle_isGpsActive();
 	void handle_find(bool on);
-	void handle_notify(const std::string& prop);
+	template<typename Fields>
+	void handle_notify(const Fields& fields);
 	void handle_notifyDel(uint32_t id);
-	void handle_call(const std::string& line);
+	template<typename Fields>
+	void handle_call(const Fields& fields);
+	void handle_proto(uint32_t version);
 
-	static std::string getProperty(const std::string& line, std::string prop);
+	GBJson json; // Fields of the command being handled, reused for every line
+	GBBinary bin; // Same for frames
+
+	/**
+	 * Both directions use UART frames instead of JSON lines once the phone asked for GBBinary::Version. Cleared on
+	 * disconnect, framed follows it on the Bangle task as each write comes in.
+	 */
+	std::atomic_bool binary = false;
+	bool framed = false;
 
 	enum class CallState : uint8_t {
-		None, Incoming, Outgoing, IncomingAccepted, IncomingMissed
+		None, Incoming, Outgoing, IncomingAccepted, IncomingMissed, COUNT
 	};
 	enum class CallCmd : uint8_t {
-		Outgoing, End, Incoming, Start, Invalid, Any
+		Outgoing, End, Incoming, Start, Invalid, Any, COUNT
+	};
+
+	/** Next state by [state][command], COUNT where the call has no such transition */
+	static constexpr CallState CallTransitions[(size_t) CallState::COUNT][(size_t) CallCmd::COUNT] = {
+			//                       Outgoing             End                        Incoming             Start                        Invalid           Any
+			/* None */             { CallState::Outgoing, CallState::COUNT,          CallState::Incoming, CallState::COUNT,            CallState::COUNT, CallState::COUNT },
+			/* Incoming */         { CallState::COUNT,    CallState::IncomingMissed, CallState::COUNT,    CallState::IncomingAccepted, CallState::COUNT, CallState::COUNT },
+			/* Outgoing */         { CallState::COUNT,    CallState::None,           CallState::COUNT,    CallState::COUNT,            CallState::COUNT, CallState::COUNT },
+			/* IncomingAccepted */ { CallState::COUNT,    CallState::None,           CallState::COUNT,    CallState::COUNT,            CallState::COUNT, CallState::COUNT },
+			/* IncomingMissed */   { CallState::COUNT,    CallState::COUNT,          CallState::COUNT,    CallState::COUNT,            CallState::COUNT, CallState::None }
 	};
 
 	struct CallInfo {
-		const char* message;
+		const char* message; // nullptr if the call has no notif in this state
 		Notif::Category category;
 	};
 
-	static const std::map<std::pair<CallState, CallCmd>, CallState> CallTransitions;
-	static const std::unordered_map<CallState, CallInfo> CallInfoMap;
+	/** What a call's notif shows, by state */
+	static constexpr CallInfo CallInfos[(size_t) CallState::COUNT] = {
+			{ nullptr,               Notif::Category::Other },        // None
+			{ "Incoming call",       Notif::Category::IncomingCall }, // Incoming
+			{ "Calling...",          Notif::Category::OutgoingCall }, // Outgoing
+			{ "Call in progress...", Notif::Category::IncomingCall }, // IncomingAccepted
+			{ "Missed call",         Notif::Category::MissedCall }    // IncomingMissed
+	};
+
+	/** Moves state along cmd, false if the call has no such transition from there */
+	static constexpr bool callTransition(CallState& state, CallCmd cmd){
+		const auto next = CallTransitions[(size_t) state][(size_t) cmd];
+		if(next == CallState::COUNT) return false;
+		state = next;
+		return true;
+	}
 
 	uint32_t currentCallId = -1;
 	CallState currentCallState = CallState::None;
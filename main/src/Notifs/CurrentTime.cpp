@@ -2,32 +2,16 @@
 #include "Services/Time.h"
 #include "Util/Services.h"
 
-CurrentTime::CurrentTime(BLE::Client* client) : Threaded("CurrentTime", 2048){
+CurrentTime::CurrentTime(BLE::Client* client){
 	service = client->addService(ServiceUUID);
 	chr = service->addChar(CharUUID, ESP_GATT_CHAR_PROP_BIT_NOTIFY | ESP_GATT_CHAR_PROP_BIT_READ);
 
+	chr->setOnNotifCb([this](const uint8_t* data, size_t size){ setTime(data, size); });
 	chr->setOnConnectedCb([this](){ chr->writeDescr(ESP_GATT_UUID_CHAR_CLIENT_CONFIG, { 0x01, 0x00 }); chr->read(); });
-
-	start();
-}
-
-void CurrentTime::loop(){
-	if(chr == nullptr || !chr->connected()){
-		vTaskDelay(500);
-		return;
-	}
-
-	auto notif = chr->getNextNotif();
-	if(!notif){
-		vTaskDelay(500);
-		return;
-	}
-
-	setTime(notif->data);
 }
 
-void CurrentTime::setTime(const std::vector<uint8_t>& data){
-	if(data.size() < 7) return;
+void CurrentTime::setTime(const uint8_t* data, size_t size){
+	if(size < 7) return;
 
 	int year = data[0] | (data[1] << 8);
 	int month = data[2];
@@ -47,6 +31,7 @@ void CurrentTime::setTime(const std::vector<uint8_t>& data){
 			.tm_year = year - 1900
 	};
 
-	auto ts = static_cast<Time*>(Services.get(Service::Time));
-	ts->setTime((tm) time);
+	auto ts = Services.get<Service::Time>();
+	if(ts == nullptr) return;
+	ts->sync(mktime(&time));
 }
@@ -2,9 +2,13 @@
 #define CLOCKSTAR_FIRMWARE_CURRENTTIME_H
 
 #include "BLE/Client.h"
-#include "Util/Threaded.h"
 
-class CurrentTime : public Threaded {
+/**
+ * Current Time Service client. The time is read once the characteristic is set up and then comes in notifications,
+ * both handled on the BLE worker, without a task of its own. Times close to ours are dropped by Time::sync, so a
+ * phone pushing the time on every connection doesn't write the RTC each time.
+ */
+class CurrentTime {
 public:
 	CurrentTime(BLE::Client* client);
 
@@ -12,10 +16,7 @@ private:
 	std::shared_ptr<BLE::Client::Service> service;
 	std::shared_ptr<BLE::Client::Char> chr;
 
-	bool connected;
-	void loop() override;
-
-	void setTime(const std::vector<uint8_t>& data);
+	void setTime(const uint8_t* data, size_t size);
 
 	static constexpr esp_bt_uuid_t ServiceUUID = { .len = ESP_UUID_LEN_16, .uuid = { .uuid16 = 0x1805 }};
 	static constexpr esp_bt_uuid_t CharUUID = { .len = ESP_UUID_LEN_16, .uuid = { .uuid16 = 0x2A2B }};
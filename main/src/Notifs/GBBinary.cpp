@@ -0,0 +1,73 @@
+#include "GBBinary.h"
+
+bool GBBinary::parse(std::string_view payload){
+	for(auto& p : present){
+		p = false;
+	}
+
+	auto p = (const uint8_t*) payload.data();
+	const auto end = p + payload.size();
+
+	while(p < end){
+		if(end - p < 3) return false;
+
+		const uint8_t field = p[0];
+		const size_t len = p[1] | (p[2] << 8);
+		p += 3;
+		if((size_t) (end - p) < len) return false;
+
+		// Unknown fields are skipped, newer apps may send more than this firmware reads
+		if(field < GBJson::COUNT){
+			values[field] = std::string_view((const char*) p, len);
+			present[field] = true;
+		}
+		p += len;
+	}
+
+	return true;
+}
+
+bool GBBinary::has(Field field) const{
+	return present[field];
+}
+
+bool GBBinary::string(Field field, std::string& out) const{
+	if(!present[field]) return false;
+	out.assign(values[field]);
+	return true;
+}
+
+std::string GBBinary::string(Field field) const{
+	std::string out;
+	string(field, out);
+	return out;
+}
+
+std::string_view GBBinary::raw(Field field) const{
+	if(!present[field]) return {};
+	return values[field];
+}
+
+bool GBBinary::number(Field field, double& out) const{
+	if(!present[field]) return false;
+
+	const auto& value = values[field];
+	const size_t len = value.size();
+	if(len != 1 && len != 2 && len != 4 && len != 8) return false;
+
+	uint64_t raw = 0;
+	for(size_t i = 0; i < len; i++){
+		raw |= (uint64_t) (uint8_t) value[i] << (8 * i);
+	}
+
+	// Sign extended from the top bit of the last byte
+	const uint32_t shift = 64 - 8 * len;
+	out = (double) ((int64_t) (raw << shift) >> shift);
+	return true;
+}
+
+bool GBBinary::boolean(Field field, bool& out) const{
+	if(!present[field] || values[field].size() != 1) return false;
+	out = values[field][0] != 0;
+	return true;
+}
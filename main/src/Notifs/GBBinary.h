@@ -0,0 +1,60 @@
+#ifndef CLOCKSTAR_FIRMWARE_GBBINARY_H
+#define CLOCKSTAR_FIRMWARE_GBBINARY_H
+
+#include "GBJson.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * Fields of a binary command frame from our companion app, the compact counterpart of GBJson. Negotiated with
+ * GB({t:"proto",n:1}), after which both directions switch to UART frames for the rest of the connection.
+ *
+ * Commands carry TLV fields, [u8 GBJson::Field][u16 length][value], little endian:
+ * strings are raw UTF-8, numbers are signed integers of 1, 2, 4 or 8 bytes, booleans a single byte.
+ * parse() only records where each field is, like GBJson, and the views point into the frame.
+ */
+class GBBinary {
+public:
+	using Field = GBJson::Field;
+
+	static constexpr uint8_t Version = 1;
+
+	/** Frame types, see BLE::UART::scan_frame */
+	enum class Frame : uint8_t {
+		// Phone to watch
+		Time = 0x01, // [i64 unix s][i16 timezone offset min], fixed layout
+		Notify = 0x02,
+		NotifyDel = 0x03,
+		Call = 0x04,
+		Find = 0x05,
+		IsGpsActive = 0x06,
+
+		// Watch to phone
+		Dismiss = 0x81, // [u32 id]
+		FindPhone = 0x82, // [u8 on]
+		GpsPower = 0x83, // [u8 on]
+		Warn = 0x84 // [text]
+	};
+
+	/** @return False if a field runs past the payload, fields before it are still set */
+	bool parse(std::string_view payload);
+
+	bool has(Field field) const;
+
+	/** Copied straight into out, nothing to decode. False if missing. */
+	bool string(Field field, std::string& out) const;
+	std::string string(Field field) const;
+	std::string_view raw(Field field) const;
+
+	bool number(Field field, double& out) const;
+	bool boolean(Field field, bool& out) const;
+
+private:
+	std::string_view values[GBJson::COUNT];
+	bool present[GBJson::COUNT] = {};
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_GBBINARY_H
@@ -0,0 +1,272 @@
+#include "GBJson.h"
+#include <mbedtls/base64.h>
+#include <esp_log.h>
+#include <charconv>
+#include <cctype>
+
+static const char* TAG = "GBJson";
+
+static void skipSpace(const char*& p, const char* end){
+	while(p < end && std::isspace((unsigned char) *p)) p++;
+}
+
+// p at the opening quote, leaves p after the closing one. out gets the contents without the quotes.
+static bool scanString(const char*& p, const char* end, std::string_view& out){
+	const char quote = *p++;
+	const char* start = p;
+
+	while(p < end){
+		if(*p == '\\'){
+			p += 2;
+			continue;
+		}
+
+		if(*p == quote){
+			out = std::string_view(start, p - start);
+			p++;
+			return true;
+		}
+
+		p++;
+	}
+
+	return false;
+}
+
+// p at the opening bracket, leaves p after the matching closing one
+static bool skipNested(const char*& p, const char* end){
+	int depth = 0;
+
+	while(p < end){
+		const char c = *p;
+		if(c == '"' || c == '\''){
+			std::string_view str;
+			if(!scanString(p, end, str)) return false;
+			continue;
+		}
+
+		p++;
+		if(c == '{' || c == '['){
+			depth++;
+		}else if((c == '}' || c == ']') && --depth == 0){
+			return true;
+		}
+	}
+
+	return false;
+}
+
+GBJson::Field GBJson::lookup(std::string_view key){
+	switch(key.size()){
+		case 1:
+			if(key == "t") return T;
+			if(key == "n") return N;
+			return COUNT;
+		case 2:
+			return key == "id" ? Id : COUNT;
+		case 3:
+			if(key == "src") return Src;
+			if(key == "cmd") return Cmd;
+			return COUNT;
+		case 4:
+			if(key == "body") return Body;
+			if(key == "name") return Name;
+			return COUNT;
+		case 5:
+			return key == "title" ? Title : COUNT;
+		case 6:
+			if(key == "sender") return Sender;
+			if(key == "number") return Number;
+			return COUNT;
+		default:
+			return COUNT;
+	}
+}
+
+bool GBJson::parse(std::string_view json){
+	for(auto& value : values){
+		value = {};
+	}
+
+	const char* p = json.data();
+	const char* const end = p + json.size();
+
+	skipSpace(p, end);
+	if(p == end || *p != '{') return false;
+	p++;
+
+	for(;;){
+		skipSpace(p, end);
+		if(p == end) return false;
+		if(*p == '}') return true;
+
+		// Key, quoted or bare
+		std::string_view key;
+		if(*p == '"' || *p == '\''){
+			if(!scanString(p, end, key)) return false;
+		}else{
+			const char* start = p;
+			while(p < end && (std::isalnum((unsigned char) *p) || *p == '_' || *p == '$' || *p == '-')) p++;
+			key = std::string_view(start, p - start);
+			if(key.empty()) return false;
+		}
+
+		skipSpace(p, end);
+		if(p == end || *p != ':') return false;
+		p++;
+		skipSpace(p, end);
+		if(p == end) return false;
+
+		Value value;
+		if(*p == '"' || *p == '\''){
+			if(!scanString(p, end, value.raw)) return false;
+			value.type = Type::String;
+		}else if(end - p > 5 && std::string_view(p, 5) == "atob("){
+			p += 5;
+			skipSpace(p, end);
+			if(p == end || (*p != '"' && *p != '\'') || !scanString(p, end, value.raw)) return false;
+			skipSpace(p, end);
+			if(p == end || *p != ')') return false;
+			p++;
+			value.type = Type::Base64;
+		}else if(*p == '{' || *p == '['){
+			const char* start = p;
+			if(!skipNested(p, end)) return false;
+			value.raw = std::string_view(start, p - start);
+			value.type = Type::Other;
+		}else{
+			const char* start = p;
+			while(p < end && *p != ',' && *p != '}' && !std::isspace((unsigned char) *p)) p++;
+			value.raw = std::string_view(start, p - start);
+
+			if(value.raw == "true" || value.raw == "false"){
+				value.type = Type::Bool;
+			}else if(!value.raw.empty() && (std::isdigit((unsigned char) value.raw[0]) || value.raw[0] == '-' || value.raw[0] == '.')){
+				value.type = Type::Number;
+			}else{
+				value.type = Type::Other;
+			}
+		}
+
+		const Field field = lookup(key);
+		if(field != COUNT){
+			values[field] = value;
+		}
+
+		skipSpace(p, end);
+		if(p == end) return false;
+		if(*p == ','){
+			p++;
+			continue;
+		}
+		return *p == '}';
+	}
+}
+
+bool GBJson::has(Field field) const{
+	return values[field].type != Type::None;
+}
+
+bool GBJson::string(Field field, std::string& out) const{
+	const auto& value = values[field];
+
+	if(value.type == Type::String){
+		out.assign(value.raw);
+	}else if(value.type == Type::Base64){
+		if(!decodeBase64(value.raw, out)) return false;
+	}else{
+		return false;
+	}
+
+	unescape(out);
+	return true;
+}
+
+std::string GBJson::string(Field field) const{
+	std::string out;
+	string(field, out);
+	return out;
+}
+
+std::string_view GBJson::raw(Field field) const{
+	const auto& value = values[field];
+	if(value.type != Type::String) return {};
+	return value.raw;
+}
+
+bool GBJson::number(Field field, double& out) const{
+	const auto& value = values[field];
+	if(value.type != Type::Number) return false;
+
+	const auto res = std::from_chars(value.raw.data(), value.raw.data() + value.raw.size(), out);
+	return res.ec == std::errc();
+}
+
+bool GBJson::boolean(Field field, bool& out) const{
+	const auto& value = values[field];
+	if(value.type != Type::Bool) return false;
+
+	out = value.raw == "true";
+	return true;
+}
+
+bool GBJson::decodeBase64(std::string_view in, std::string& out){
+	size_t outLen = 0;
+	auto ret = mbedtls_base64_decode(nullptr, 0, &outLen, (const unsigned char*) in.data(), in.size());
+	if(ret != MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL || outLen <= 0){
+		ESP_LOGW(TAG, "(1) Failed decoding base64: %.*s | Return status: %d", (int) in.size(), in.data(), ret);
+		return false;
+	}
+
+	// Decoded straight into the destination, sized once
+	out.resize(outLen);
+	ret = mbedtls_base64_decode((unsigned char*) out.data(), out.size(), &outLen, (const unsigned char*) in.data(), in.size());
+	if(ret != 0 || outLen <= 0){
+		ESP_LOGW(TAG, "(2) Failed decoding base64: %.*s | Return status: %d", (int) in.size(), in.data(), ret);
+		out.clear();
+		return false;
+	}
+	out.resize(outLen);
+
+	return true;
+}
+
+void GBJson::unescape(std::string& s){
+	size_t out = 0;
+	for(size_t i = 0; i < s.size(); i++){
+		char c = s[i];
+
+		if(c == '\\' && i + 1 < s.size()){
+			const char e = s[++i];
+			if(e == 'u'){
+				// Unicode escapes don't have a glyph in our fonts
+				size_t digits = 0;
+				while(digits < 4 && i + 1 < s.size() && std::isalnum((unsigned char) s[i + 1])){
+					i++;
+					digits++;
+				}
+				if(digits < 3){
+					// Not an escape after all, keep it verbatim
+					s[out++] = '\\';
+					i -= digits + 1;
+					continue;
+				}
+				c = '?';
+			}else if(e == 'n') c = '\n';
+			else if(e == 'r') continue;
+			else if(e == 't') c = ' ';
+			else if(e == '\\') c = '\\';
+			else{
+				s[out++] = '\\';
+				c = e;
+			}
+		}else if(c == '\r'){
+			continue;
+		}else if(c == '\t'){
+			c = ' ';
+		}
+
+		s[out++] = c;
+	}
+	s.resize(out);
+}
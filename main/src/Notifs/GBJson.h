@@ -0,0 +1,58 @@
+#ifndef CLOCKSTAR_FIRMWARE_GBJSON_H
+#define CLOCKSTAR_FIRMWARE_GBJSON_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * Single pass field extractor for Gadgetbridge's JSON-ish command objects, e.g.
+ * {t:"notify",id:1234,src:"WhatsApp",title:atob("..."),body:"..."}
+ *
+ * parse() walks the top level object once and records where each of the fields below starts and ends, nested values
+ * are skipped over. Nothing is copied or decoded until a field is asked for, and then only that field.
+ * Keys may be quoted or bare, strings may be double or single quoted or wrapped in atob() for base64.
+ * The views point into the parsed buffer, which has to outlive the GBJson.
+ */
+class GBJson {
+public:
+	enum Field : uint8_t {
+		T, Id, N, Src, Title, Body, Sender, Name, Number, Cmd, COUNT
+	};
+
+	/** @return False if json isn't an object, fields found before the error are still set */
+	bool parse(std::string_view json);
+
+	bool has(Field field) const;
+
+	/** Unescaped or base64 decoded string value, written straight into out. False if missing or not a string. */
+	bool string(Field field, std::string& out) const;
+	std::string string(Field field) const;
+
+	/** Raw string value, without decoding. Only meaningful for plain strings without escapes, like the command. */
+	std::string_view raw(Field field) const;
+
+	bool number(Field field, double& out) const;
+	bool boolean(Field field, bool& out) const;
+
+private:
+	enum class Type : uint8_t {
+		None, String, Base64, Number, Bool, Other
+	};
+
+	struct Value {
+		std::string_view raw; // String contents without the quotes, or the literal
+		Type type = Type::None;
+	};
+	Value values[COUNT];
+
+	static Field lookup(std::string_view key);
+
+	/** In place, the output never gets longer than the input */
+	static void unescape(std::string& s);
+	static bool decodeBase64(std::string_view in, std::string& out);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_GBJSON_H
@@ -1,41 +1,74 @@
 #include "Notif.h"
-#include <unordered_map>
-
-static const std::unordered_map<std::string, const char*> appMap = {
-		{ "Messenger", "S:/icon/app_mess.bin" },
-		{ "WhatsApp",  "S:/icon/app_wapp.bin" },
-		{ "Messages",  "S:/icon/app_sms.bin" },
-		{ "Instagram", "S:/icon/app_inst.bin" },
-		{ "Snapchat",  "S:/icon/app_snap.bin" },
-		{ "TikTok",    "S:/icon/app_tiktok.bin" }
+#include <string_view>
+#include <iterator>
+
+static constexpr const char* IconPaths[(size_t) NotifIcon::COUNT] = {
+		"S:/icon/app_mess.bin",
+		"S:/icon/app_wapp.bin",
+		"S:/icon/app_sms.bin",
+		"S:/icon/app_inst.bin",
+		"S:/icon/app_snap.bin",
+		"S:/icon/app_tiktok.bin",
+		"S:/icon/cat_other.bin",
+		"S:/icon/call_in.bin",
+		"S:/icon/call_miss.bin",
+		"S:/icon/call_out.bin",
+		"S:/icon/cat_soc.bin",
+		"S:/icon/cat_sched.bin",
+		"S:/icon/cat_email.bin",
+		"S:/icon/cat_news.bin",
+		"S:/icon/cat_health.bin",
+		"S:/icon/cat_fin.bin",
+		"S:/icon/cat_loc.bin",
+		"S:/icon/cat_entert.bin"
+};
+
+struct AppIcon {
+	std::string_view appID;
+	NotifIcon icon;
 };
 
-static const std::unordered_map<Notif::Category, const char*> catMap = {
-		{ Notif::Category::Other,              "S:/icon/cat_other.bin" },
-		{ Notif::Category::IncomingCall,       "S:/icon/call_in.bin" },
-		{ Notif::Category::MissedCall,         "S:/icon/call_miss.bin" },
-		{ Notif::Category::Voicemail,          "S:/icon/cat_other.bin" },
-		{ Notif::Category::Social,             "S:/icon/cat_soc.bin" },
-		{ Notif::Category::Schedule,           "S:/icon/cat_sched.bin" },
-		{ Notif::Category::Email,              "S:/icon/cat_email.bin" },
-		{ Notif::Category::News,               "S:/icon/cat_news.bin" },
-		{ Notif::Category::HealthAndFitness,   "S:/icon/cat_health.bin" },
-		{ Notif::Category::BusinessAndFinance, "S:/icon/cat_fin.bin" },
-		{ Notif::Category::Location,           "S:/icon/cat_loc.bin" },
-		{ Notif::Category::Entertainment,      "S:/icon/cat_entert.bin" },
-		{ Notif::Category::OutgoingCall,       "S:/icon/call_out.bin" }
+static constexpr AppIcon AppIcons[] = {
+		{ "Messenger", NotifIcon::Messenger },
+		{ "WhatsApp",  NotifIcon::WhatsApp },
+		{ "Messages",  NotifIcon::Messages },
+		{ "Instagram", NotifIcon::Instagram },
+		{ "Snapchat",  NotifIcon::Snapchat },
+		{ "TikTok",    NotifIcon::TikTok }
 };
 
-const char* iconPath(const Notif& notif){
-	auto itApp = appMap.find(notif.appID);
-	if(itApp != appMap.end()){
-		return itApp->second;
+// Indexed by Notif::Category
+static constexpr NotifIcon CategoryIcons[] = {
+		NotifIcon::Other, // Other
+		NotifIcon::CallIn, // IncomingCall
+		NotifIcon::CallMissed, // MissedCall
+		NotifIcon::Other, // Voicemail
+		NotifIcon::Social, // Social
+		NotifIcon::Schedule, // Schedule
+		NotifIcon::Email, // Email
+		NotifIcon::News, // News
+		NotifIcon::Health, // HealthAndFitness
+		NotifIcon::Finance, // BusinessAndFinance
+		NotifIcon::Location, // Location
+		NotifIcon::Entertainment, // Entertainment
+		NotifIcon::CallOut // OutgoingCall
+};
+static_assert(std::size(CategoryIcons) == (size_t) Notif::Category::OutgoingCall + 1, "Every category needs an icon");
+
+NotifIcon notifIcon(const Notif& notif){
+	for(const auto& app : AppIcons){
+		if(app.appID == notif.appID) return app.icon;
 	}
 
-	auto itCat = catMap.find(notif.category);
-	if(itCat != catMap.end()){
-		return itCat->second;
+	const auto cat = (size_t) notif.category;
+	if(cat < std::size(CategoryIcons)){
+		return CategoryIcons[cat];
 	}
 
-	return "S:/icon/cat_other.bin";
+	return NotifIcon::Other;
+}
+
+const char* iconPath(NotifIcon icon){
+	if(icon >= NotifIcon::COUNT) return IconPaths[(size_t) NotifIcon::Other];
+	return IconPaths[(size_t) icon];
 }
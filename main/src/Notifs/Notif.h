@@ -2,7 +2,9 @@
 #define CLOCKSTAR_FIRMWARE_NOTIF_H
 
 #include <string>
+#include <string_view>
 #include <ctime>
+#include <cstdint>
 
 struct Notif {
 	uint32_t uid;
@@ -34,8 +36,38 @@ struct Notif {
 		Entertainment,
 		OutgoingCall
 	} category;
+
+	uint32_t stamp = 0; // Source's version of the content, e.g. a hash of the ANCS date, 0 if it has none
+};
+
+/**
+ * A Notif whose strings point into a buffer it doesn't own, e.g. the frame it was parsed from, so it reaches the
+ * NotifStore without a copy in between. Only valid while that buffer is.
+ */
+struct NotifView {
+	uint32_t uid;
+	std::string_view title;
+	std::string_view message;
+	std::string_view appID;
+	Notif::Category category;
+	uint32_t stamp;
+
+	NotifView(uint32_t uid, std::string_view title, std::string_view message, std::string_view appID,
+			  Notif::Category category, uint32_t stamp = 0) : uid(uid), title(title), message(message), appID(appID),
+															  category(category), stamp(stamp){}
+
+	NotifView(const Notif& notif) : NotifView(notif.uid, notif.title, notif.message, notif.appID, notif.category,
+											  notif.stamp){}
+};
+
+/** Distinct icons a notification can show, each app or category icon has exactly one */
+enum class NotifIcon : uint8_t {
+	Messenger, WhatsApp, Messages, Instagram, Snapchat, TikTok,
+	Other, CallIn, CallMissed, CallOut, Social, Schedule, Email, News, Health, Finance, Location, Entertainment,
+	COUNT
 };
 
-const char* iconPath(const Notif& notif);
+NotifIcon notifIcon(const Notif& notif);
+const char* iconPath(NotifIcon icon);
 
 #endif //CLOCKSTAR_FIRMWARE_NOTIF_H
@@ -0,0 +1,106 @@
+#include "NotifCache.h"
+#include <nvs_flash.h>
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+static const char* TAG = "NotifCache";
+
+NotifCache::NotifCache(){
+	auto err = nvs_open(NVSNamespace, NVS_READWRITE, &handle);
+	ESP_ERROR_CHECK(err);
+}
+
+uint8_t NotifCache::load(NotifStore& store){
+	size_t size = 0;
+	auto err = nvs_get_blob(handle, BlobName, nullptr, &size);
+	if(err != ESP_OK || size < sizeof(Header)){
+		ESP_LOGI(TAG, "No cached notifications");
+		return 0;
+	}
+
+	std::vector<uint8_t> blob(size);
+	err = nvs_get_blob(handle, BlobName, blob.data(), &size);
+	if(err != ESP_OK) return 0;
+
+	Header header;
+	memcpy(&header, blob.data(), sizeof(Header));
+	if(header.version != Version){
+		ESP_LOGI(TAG, "Cache version %d, expected %d. Ignoring", header.version, Version);
+		return 0;
+	}
+
+	size_t pos = sizeof(Header);
+	std::vector<uint32_t> evicted;
+	Notif notif;
+	for(uint8_t i = 0; i < header.count; i++){
+		if(pos + sizeof(Entry) > size) break;
+
+		Entry entry;
+		memcpy(&entry, blob.data() + pos, sizeof(Entry));
+		pos += sizeof(Entry);
+
+		if(pos + entry.appLen + entry.titleLen + entry.messageLen > size) break;
+
+		auto text = (const char*) blob.data() + pos;
+		notif.uid = entry.uid;
+		notif.category = (Notif::Category) entry.category;
+		notif.stamp = entry.stamp;
+		notif.appID.assign(text, entry.appLen);
+		notif.title.assign(text + entry.appLen, entry.titleLen);
+		notif.message.assign(text + entry.appLen + entry.titleLen, entry.messageLen);
+		pos += entry.appLen + entry.titleLen + entry.messageLen;
+
+		store.put(notif, evicted);
+	}
+
+	ESP_LOGI(TAG, "Loaded %d cached notifications", (int) store.size());
+	return store.size() > 0 ? header.source : 0;
+}
+
+void NotifCache::save(const NotifStore& store, uint8_t source){
+	// forEach goes oldest first, keep the newest MaxCount
+	const size_t skip = store.size() > MaxCount ? store.size() - MaxCount : 0;
+
+	std::vector<uint8_t> blob(sizeof(Header));
+	size_t i = 0;
+	uint8_t count = 0;
+	store.forEach([&](const Notif& notif){
+		if(i++ < skip) return;
+
+		Entry entry = {
+				.uid = notif.uid,
+				.stamp = notif.stamp,
+				.category = (uint8_t) notif.category,
+				.appLen = (uint8_t) std::min(notif.appID.size(), (size_t) UINT8_MAX),
+				.titleLen = (uint8_t) std::min(notif.title.size(), std::min(MaxText, (size_t) UINT8_MAX)),
+				.messageLen = 0
+		};
+		entry.messageLen = (uint8_t) std::min(notif.message.size(), MaxText - entry.titleLen);
+
+		const size_t pos = blob.size();
+		blob.resize(pos + sizeof(Entry) + entry.appLen + entry.titleLen + entry.messageLen);
+		auto out = blob.data() + pos;
+		memcpy(out, &entry, sizeof(Entry));
+		out += sizeof(Entry);
+		memcpy(out, notif.appID.data(), entry.appLen);
+		memcpy(out + entry.appLen, notif.title.data(), entry.titleLen);
+		memcpy(out + entry.appLen + entry.titleLen, notif.message.data(), entry.messageLen);
+		count++;
+	});
+
+	const Header header = { .version = Version, .source = source, .count = count };
+	memcpy(blob.data(), &header, sizeof(Header));
+
+	esp_err_t err = nvs_set_blob(handle, BlobName, blob.data(), blob.size());
+	if(err != ESP_OK){
+		ESP_LOGW(TAG, "NVS notification cache store error: %d", err);
+		return;
+	}
+
+	err = nvs_commit(handle);
+	if(err != ESP_OK){
+		ESP_LOGW(TAG, "NVS notification cache commit error: %d", err);
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef CLOCKSTAR_FIRMWARE_NOTIFCACHE_H
+#define CLOCKSTAR_FIRMWARE_NOTIFCACHE_H
+
+#include <nvs.h>
+#include <cstdint>
+#include "NotifStore.h"
+
+/**
+ * The newest notifications of a NotifStore persisted in NVS, in the same namespace as Settings, so they survive
+ * reboots and can be shown before the phone has reconnected. Tagged with the source they came from, since uids are only
+ * meaningful to the source that assigned them.
+ *
+ * Flash is small and wears, so only MaxCount notifications with up to MaxText of title and message each are kept.
+ * Any longer text is fetched again when the notif is opened.
+ */
+class NotifCache {
+public:
+	NotifCache();
+
+	static constexpr size_t MaxCount = 16;
+	static constexpr size_t MaxText = 192; // [B] title and message together
+
+	/**
+	 * Fills store with the cached notifications, oldest first.
+	 * @return Source tag they were saved with, 0 if there's nothing cached
+	 */
+	uint8_t load(NotifStore& store);
+
+	void save(const NotifStore& store, uint8_t source);
+
+private:
+	nvs_handle_t handle{};
+
+	static constexpr const char* NVSNamespace = "Clockstar";
+	static constexpr const char* BlobName = "Notifs";
+	static constexpr uint8_t Version = 2;
+
+	/** Blob layout: Header, then per notif an Entry followed by its app ID, title and message. */
+	struct __attribute__((packed)) Header {
+		uint8_t version;
+		uint8_t source;
+		uint8_t count;
+	};
+	struct __attribute__((packed)) Entry {
+		uint32_t uid;
+		uint32_t stamp;
+		uint8_t category;
+		uint8_t appLen;
+		uint8_t titleLen;
+		uint8_t messageLen;
+	};
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_NOTIFCACHE_H
@@ -1,6 +1,14 @@
 #include "NotifSource.h"
+#include "Util/stdafx.h"
+#include <algorithm>
 
 void NotifSource::connect(){
+	{
+		std::lock_guard lock(metricsMut);
+		connectTime = millis();
+		awaitingFirst = true;
+	}
+
 	if(onConnect) onConnect();
 }
 
@@ -8,11 +16,13 @@ void NotifSource::disconnect(){
 	if(onDisconnect) onDisconnect();
 }
 
-void NotifSource::notifNew(Notif notif){
+void NotifSource::notifNew(const NotifView& notif){
+	countNotif();
 	if(onNotifAdd) onNotifAdd(notif);
 }
 
-void NotifSource::notifModify(Notif notif){
+void NotifSource::notifModify(const NotifView& notif){
+	countNotif();
 	if(onNotifModify) onNotifModify(notif);
 }
 
@@ -20,6 +30,18 @@ void NotifSource::notifRemove(uint32_t uid){
 	if(onNotifRemove) onNotifRemove(uid);
 }
 
+bool NotifSource::notifKnown(uint32_t uid, Notif::Category category, uint32_t stamp){
+	return onNotifKnown && onNotifKnown(uid, category, stamp);
+}
+
+bool NotifSource::tracksKnown() const{
+	return (bool) onNotifKnown;
+}
+
+void NotifSource::setNotifKnown(NotifSource::NotifKnownCB notifKnown){
+	NotifSource::onNotifKnown = std::move(notifKnown);
+}
+
 void NotifSource::setOnConnect(NotifSource::ConnectCB onConnect){
 	NotifSource::onConnect = std::move(onConnect);
 }
@@ -39,3 +61,53 @@ void NotifSource::setOnNotifModify(NotifSource::NotifModifyCB onNotifModify){
 void NotifSource::setOnNotifRemove(NotifSource::NotifRemoveCB onNotifRemove){
 	NotifSource::onNotifRemove = std::move(onNotifRemove);
 }
+
+NotifSource::Metrics NotifSource::getMetrics() const{
+	std::lock_guard lock(metricsMut);
+	return metrics;
+}
+
+void NotifSource::resetMetrics(){
+	std::lock_guard lock(metricsMut);
+	const auto depth = metrics.queueDepth;
+	metrics = {};
+	metrics.queueDepth = metrics.maxQueueDepth = depth;
+}
+
+void NotifSource::countNotif(){
+	std::lock_guard lock(metricsMut);
+	metrics.notifs++;
+
+	if(awaitingFirst){
+		awaitingFirst = false;
+		metrics.firstNotif = std::max((uint32_t) (millis() - connectTime), (uint32_t) 1);
+	}
+}
+
+void NotifSource::countBytes(size_t bytes){
+	std::lock_guard lock(metricsMut);
+	metrics.bytes += bytes;
+}
+
+void NotifSource::countParse(uint32_t time){
+	std::lock_guard lock(metricsMut);
+	metrics.parseTime += time;
+	metrics.maxParse = std::max(metrics.maxParse, time);
+}
+
+void NotifSource::countLatency(uint32_t time){
+	std::lock_guard lock(metricsMut);
+	metrics.latency += time;
+	metrics.maxLatency = std::max(metrics.maxLatency, time);
+}
+
+void NotifSource::countDrop(){
+	std::lock_guard lock(metricsMut);
+	metrics.drops++;
+}
+
+void NotifSource::setQueueDepth(size_t depth){
+	std::lock_guard lock(metricsMut);
+	metrics.queueDepth = depth;
+	metrics.maxQueueDepth = std::max(metrics.maxQueueDepth, metrics.queueDepth);
+}
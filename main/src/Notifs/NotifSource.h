@@ -3,6 +3,8 @@
 
 #include "Notif.h"
 #include <functional>
+#include <mutex>
+#include <cstdint>
 
 class NotifSource {
 public:
@@ -10,9 +12,11 @@ public:
 	using ConnectCB = std::function<void()>;
 	using DisconnectCB = std::function<void()>;
 
-	using NotifAddCB = std::function<void(Notif notif)>;
-	using NotifModifyCB = std::function<void(Notif notif)>;
+	/** The view is only valid for the duration of the call */
+	using NotifAddCB = std::function<void(const NotifView& notif)>;
+	using NotifModifyCB = std::function<void(const NotifView& notif)>;
 	using NotifRemoveCB = std::function<void(uint32_t uid)>;
+	using NotifKnownCB = std::function<bool(uint32_t uid, Notif::Category category, uint32_t stamp)>;
 
 	void setOnConnect(ConnectCB onConnect);
 	void setOnDisconnect(ConnectCB onDisconnect);
@@ -20,19 +24,67 @@ public:
 	void setOnNotifAdd(NotifAddCB onNotifAdd);
 	void setOnNotifModify(NotifModifyCB onNotifModify);
 	void setOnNotifRemove(NotifRemoveCB onNotifRemove);
+	void setNotifKnown(NotifKnownCB notifKnown);
 
 	virtual void actionPos(uint32_t uid) = 0;
 	virtual void actionNeg(uint32_t uid) = 0;
 
+	/**
+	 * Called when a notif is opened. Sources that only sent a preview of it fetch the rest, which arrives through the
+	 * modify callback.
+	 */
+	virtual void fetchFull(const Notif& notif){}
+
+	/** Whether the source announces every notif it still has on each connect, so stale cached ones can be dropped. */
+	virtual bool replaysOnConnect() const{ return false; }
+
+	/**
+	 * Another source connected, so this one won't hear from the phone until that one disconnects. Sources stop their
+	 * tasks and free their buffers until unpark(). Called from the connecting source's callback.
+	 */
+	virtual void park(){}
+	virtual void unpark(){}
+
+	/** Pipeline counters since boot or the last resetMetrics(), for comparing sources and finding the slow stage. */
+	struct Metrics {
+		uint32_t bytes = 0; // [B] received from the phone
+		uint32_t notifs = 0; // Delivered, new and modified
+		uint32_t drops = 0; // Malformed, timed out or otherwise lost
+		uint64_t parseTime = 0; // [us] spent parsing, in total
+		uint32_t maxParse = 0; // [us] longest single parse
+		uint64_t latency = 0; // [ms] from the phone announcing a notif to delivering it, in total
+		uint32_t maxLatency = 0; // [ms]
+		uint16_t queueDepth = 0; // Notifs announced but not fetched yet
+		uint16_t maxQueueDepth = 0;
+		uint32_t firstNotif = 0; // [ms] from the last connect to the first notif delivered after it, 0 until then
+	};
+	Metrics getMetrics() const;
+	void resetMetrics();
+
 protected:
 
 	void connect();
 	void disconnect();
 
-	void notifNew(Notif notif);
-	void notifModify(Notif notif);
+	void notifNew(const NotifView& notif);
+	void notifModify(const NotifView& notif);
 	void notifRemove(uint32_t uid);
 
+	/**
+	 * The notif is already held from an earlier connection and its content hasn't changed since, going by the stamp,
+	 * so the source can skip fetching it again.
+	 */
+	bool notifKnown(uint32_t uid, Notif::Category category, uint32_t stamp);
+
+	/** Whether anything keeps notifs across connections, otherwise checking notifKnown isn't worth a request */
+	bool tracksKnown() const;
+
+	void countBytes(size_t bytes);
+	void countParse(uint32_t time); // [us]
+	void countLatency(uint32_t time); // [ms]
+	void countDrop();
+	void setQueueDepth(size_t depth);
+
 private:
 
 	ConnectCB onConnect;
@@ -41,6 +93,13 @@ private:
 	NotifAddCB onNotifAdd;
 	NotifModifyCB onNotifModify;
 	NotifRemoveCB onNotifRemove;
+	NotifKnownCB onNotifKnown;
+
+	Metrics metrics;
+	mutable std::mutex metricsMut;
+	uint64_t connectTime = 0; // [ms]
+	bool awaitingFirst = false;
+	void countNotif();
 
 };
 
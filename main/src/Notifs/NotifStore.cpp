@@ -0,0 +1,251 @@
+#include "NotifStore.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+/** Length of str cut to at most max bytes, backed up so a multibyte UTF-8 character isn't split */
+static size_t utf8Cut(std::string_view str, size_t max){
+	if(str.size() <= max) return str.size();
+
+	size_t len = max;
+	while(len > 0 && ((uint8_t) str[len] & 0xC0) == 0x80){
+		len--;
+	}
+	return len;
+}
+
+NotifStore::NotifStore() : text(new char[TextBudget]){
+	index.reserve(Capacity);
+}
+
+bool NotifStore::put(const NotifView& notif, std::vector<uint32_t>& evicted){
+	std::unique_lock lock(mut);
+
+	Slot* slot = nullptr;
+	if(auto it = index.find(notif.uid); it != index.end()){
+		slot = &slots[it->second];
+		freeText(*slot);
+		release(slot->app);
+		slot->app = NoApp;
+	}
+	const bool added = slot == nullptr;
+
+	const size_t titleLen = utf8Cut(notif.title, MaxText);
+	const size_t messageLen = utf8Cut(notif.message, MaxText - titleLen);
+
+	// Oldest first until there's a free slot and enough text space, never the one being replaced
+	while(textUsed + titleLen + messageLen > TextBudget || (added && index.size() == Capacity)){
+		auto old = oldest(slot);
+		evicted.push_back(old->uid);
+		drop(*old);
+	}
+
+	if(added){
+		slot = &*std::find_if(slots.begin(), slots.end(), [](const Slot& slot){ return !slot.used; });
+		slot->used = true;
+		slot->seq = ++seq;
+		slot->uid = notif.uid;
+		index[notif.uid] = slot - slots.begin();
+	}
+
+	slot->titleLen = titleLen;
+	slot->messageLen = messageLen;
+	slot->offset = allocText(titleLen + messageLen);
+	memcpy(text.get() + slot->offset, notif.title.data(), titleLen);
+	memcpy(text.get() + slot->offset + titleLen, notif.message.data(), messageLen);
+
+	slot->app = intern(notif.appID);
+	slot->category = notif.category;
+	slot->stamp = notif.stamp;
+	slot->gen = ++gen;
+
+	return added;
+}
+
+bool NotifStore::remove(uint32_t uid){
+	std::unique_lock lock(mut);
+
+	auto it = index.find(uid);
+	if(it == index.end()) return false;
+
+	drop(slots[it->second]);
+	++gen;
+
+	return true;
+}
+
+bool NotifStore::clear(){
+	std::unique_lock lock(mut);
+	if(index.empty()) return false;
+
+	for(auto& slot : slots){
+		slot = {};
+	}
+	for(auto& app : apps){
+		app = {};
+	}
+	index.clear();
+	textEnd = textUsed = 0;
+	++gen;
+
+	return true;
+}
+
+bool NotifStore::get(uint32_t uid, Notif& out) const{
+	std::shared_lock lock(mut);
+
+	auto it = index.find(uid);
+	if(it == index.end()) return false;
+
+	fill(slots[it->second], out);
+	return true;
+}
+
+bool NotifStore::contains(uint32_t uid) const{
+	std::shared_lock lock(mut);
+	return index.count(uid) != 0;
+}
+
+size_t NotifStore::size() const{
+	std::shared_lock lock(mut);
+	return index.size();
+}
+
+uint32_t NotifStore::generation() const{
+	return gen;
+}
+
+std::vector<uint32_t> NotifStore::changedSince(uint32_t since, uint32_t& current) const{
+	std::shared_lock lock(mut);
+	current = gen;
+
+	std::vector<uint32_t> uids;
+	for(uint8_t i : ordered()){
+		if(slots[i].gen > since){
+			uids.push_back(slots[i].uid);
+		}
+	}
+
+	return uids;
+}
+
+void NotifStore::forEach(const std::function<void(const Notif& notif)>& fn) const{
+	std::shared_lock lock(mut);
+
+	Notif notif = {};
+	for(uint8_t i : ordered()){
+		fill(slots[i], notif);
+		fn(notif);
+	}
+}
+
+void NotifStore::fill(const Slot& slot, Notif& out) const{
+	out.uid = slot.uid;
+	out.title.assign(text.get() + slot.offset, slot.titleLen);
+	out.message.assign(text.get() + slot.offset + slot.titleLen, slot.messageLen);
+	if(slot.app == NoApp){
+		out.appID.clear();
+	}else{
+		out.appID = apps[slot.app].id;
+	}
+	out.category = slot.category;
+	out.stamp = slot.stamp;
+}
+
+void NotifStore::drop(Slot& slot){
+	freeText(slot);
+	release(slot.app);
+	index.erase(slot.uid);
+	slot = {};
+}
+
+NotifStore::Slot* NotifStore::oldest(const Slot* except){
+	Slot* old = nullptr;
+	for(auto& slot : slots){
+		if(!slot.used || &slot == except) continue;
+		if(old == nullptr || slot.seq < old->seq){
+			old = &slot;
+		}
+	}
+	return old;
+}
+
+uint16_t NotifStore::allocText(size_t size){
+	if(textEnd + size > TextBudget){
+		compact();
+	}
+
+	const uint16_t offset = textEnd;
+	textEnd += size;
+	textUsed += size;
+	return offset;
+}
+
+void NotifStore::freeText(Slot& slot){
+	const size_t size = slot.textSize();
+	textUsed -= size;
+
+	// Freeing the last blob gives its space straight back, holes elsewhere wait for compact()
+	if(slot.offset + size == textEnd){
+		textEnd = slot.offset;
+	}
+
+	slot.titleLen = slot.messageLen = 0;
+}
+
+void NotifStore::compact(){
+	std::vector<Slot*> used;
+	used.reserve(index.size());
+	for(auto& slot : slots){
+		if(slot.used && slot.textSize() > 0){
+			used.push_back(&slot);
+		}
+	}
+	std::sort(used.begin(), used.end(), [](const Slot* a, const Slot* b){ return a->offset < b->offset; });
+
+	size_t end = 0;
+	for(auto slot : used){
+		if(slot->offset != end){
+			memmove(text.get() + end, text.get() + slot->offset, slot->textSize());
+			slot->offset = end;
+		}
+		end += slot->textSize();
+	}
+	textEnd = end;
+}
+
+uint8_t NotifStore::intern(std::string_view id){
+	if(id.empty()) return NoApp;
+
+	uint8_t free = NoApp;
+	for(uint8_t i = 0; i < apps.size(); i++){
+		if(apps[i].refs > 0 && apps[i].id == id){
+			apps[i].refs++;
+			return i;
+		}
+		if(apps[i].refs == 0 && free == NoApp){
+			free = i;
+		}
+	}
+
+	// Keeps the entry's string capacity when it's reused
+	apps[free].id = id;
+	apps[free].refs = 1;
+	return free;
+}
+
+void NotifStore::release(uint8_t app){
+	if(app == NoApp || apps[app].refs == 0) return;
+	apps[app].refs--;
+}
+
+std::vector<uint8_t> NotifStore::ordered() const{
+	std::vector<uint8_t> used;
+	used.reserve(index.size());
+	for(const auto& pair : index){
+		used.push_back(pair.second);
+	}
+
+	std::sort(used.begin(), used.end(), [this](uint8_t a, uint8_t b){ return slots[a].seq < slots[b].seq; });
+	return used;
+}
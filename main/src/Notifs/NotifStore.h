@@ -0,0 +1,110 @@
+#ifndef CLOCKSTAR_FIRMWARE_NOTIFSTORE_H
+#define CLOCKSTAR_FIRMWARE_NOTIFSTORE_H
+
+#include "Notif.h"
+#include <array>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <shared_mutex>
+#include <unordered_map>
+
+/**
+ * Phone notifications in a fixed slot array with a uid index. Readers share the lock, so the UI reading and the BLE
+ * sources writing only wait on each other for the length of a copy.
+ * Every change bumps the generation and tags the slot with it, so readers that remember the generation they last saw
+ * can fetch only what changed since, instead of copying everything.
+ *
+ * Memory is fixed: title and message of each notification are one contiguous blob in a TextBudget arena, and app IDs,
+ * of which the same few repeat constantly, are interned once. When slots or text space run out, the oldest
+ * notifications are dropped to make room, so a notification storm can't grow the heap.
+ */
+class NotifStore {
+public:
+	static constexpr size_t Capacity = 32;
+	static constexpr size_t TextBudget = 8 * 1024; // [B]
+	static constexpr size_t MaxText = 1024; // [B] per notification, title and message together, longer is truncated
+
+	NotifStore();
+
+	/**
+	 * Adds notif, or replaces the stored one with the same uid. Its text is copied into the arena straight from the view.
+	 * @param evicted Uids of the oldest notifications dropped to make room are appended here
+	 * @return True if notif is new
+	 */
+	bool put(const NotifView& notif, std::vector<uint32_t>& evicted);
+	bool remove(uint32_t uid);
+	/** @return True if there was anything to clear */
+	bool clear();
+
+	bool get(uint32_t uid, Notif& out) const;
+	bool contains(uint32_t uid) const;
+	size_t size() const;
+
+	uint32_t generation() const;
+
+	/**
+	 * Uids of notifications added or changed after generation since, oldest first.
+	 * Removed ones aren't listed, check the ones held against contains().
+	 * @param current Generation the list is complete up to, pass it as since next time
+	 */
+	std::vector<uint32_t> changedSince(uint32_t since, uint32_t& current) const;
+
+	/**
+	 * Visits every notification, oldest first, under the shared lock. Don't call back into the store from fn.
+	 * The Notif passed is reused between calls, copy what needs to outlive the call.
+	 */
+	void forEach(const std::function<void(const Notif& notif)>& fn) const;
+
+private:
+	static constexpr uint8_t NoApp = 0xff;
+
+	struct Slot {
+		bool used = false;
+		uint32_t seq = 0; // Order of arrival
+		uint32_t gen = 0; // Generation of the last change
+
+		uint32_t uid = 0;
+		Notif::Category category = Notif::Category::Other;
+		uint32_t stamp = 0;
+		uint8_t app = NoApp;
+		uint16_t offset = 0; // [B] into text
+		uint16_t titleLen = 0; // [B]
+		uint16_t messageLen = 0; // [B]
+
+		size_t textSize() const{ return titleLen + messageLen; }
+	};
+	std::array<Slot, Capacity> slots;
+	std::unordered_map<uint32_t, uint8_t> index; // uid -> slot
+
+	std::unique_ptr<char[]> text;
+	size_t textEnd = 0; // [B] high water mark, compacted when an allocation doesn't fit behind it
+	size_t textUsed = 0; // [B]
+	uint16_t allocText(size_t size);
+	void freeText(Slot& slot);
+	void compact();
+
+	// Every slot references at most one app, so there's always room for a new one
+	struct App {
+		std::string id;
+		uint16_t refs = 0;
+	};
+	std::array<App, Capacity> apps;
+	uint8_t intern(std::string_view id);
+	void release(uint8_t app);
+
+	void drop(Slot& slot);
+	Slot* oldest(const Slot* except);
+	void fill(const Slot& slot, Notif& out) const;
+
+	uint32_t seq = 0;
+	std::atomic_uint32_t gen = 0;
+	mutable std::shared_mutex mut;
+
+	std::vector<uint8_t> ordered() const; // Used slots, oldest first
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_NOTIFSTORE_H
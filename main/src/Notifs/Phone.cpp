@@ -1,19 +1,43 @@
 #include "Phone.h"
 #include "Util/Events.h"
+#include "Util/stdafx.h"
+#include "Services/RTCTelemetry.h"
+#include "Util/Services.h"
+#include "Services/Console.h"
+#include <algorithm>
 
-Phone::Phone(BLE::Server* server, BLE::Client* client) : ancs(client), cTime(client), bangle(server){
-	notifs.reserve(20);
-
+Phone::Phone(BLE::Server* server, BLE::Client* client) : ancs(client), cTime(client), bangle(server),
+		batchDebounce([](void* arg){ static_cast<Phone*>(arg)->flushBatch(); }, this){
 	auto reg = [this](NotifSource* src){
 		src->setOnConnect([this, src](){ onConnect(src); });
 		src->setOnDisconnect([this, src](){ onDisconnect(src); });
-		src->setOnNotifAdd([this](Notif notif){ onAdd(std::move(notif)); });
-		src->setOnNotifModify([this](Notif notif){ onModify(std::move(notif)); });
+		src->setOnNotifAdd([this](const NotifView& notif){ onAdd(notif); });
+		src->setOnNotifModify([this](const NotifView& notif){ onModify(notif); });
 		src->setOnNotifRemove([this](uint32_t id){ onRemove(id); });
+#ifdef CONFIG_CM_NOTIF_CACHE
+		src->setNotifKnown([this](uint32_t uid, Notif::Category category, uint32_t stamp){ return known(uid, category, stamp); });
+#endif
 	};
 
 	reg(&ancs);
 	reg(&bangle);
+#ifdef CONFIG_CM_REPLAY
+	reg(&replay);
+#endif
+
+#ifdef CONFIG_CM_NOTIF_CACHE
+	syncTimer = xTimerCreate("PhoneSync", SyncTimeout, pdFALSE, this, [](TimerHandle_t timer){
+		static_cast<Phone*>(pvTimerGetTimerID(timer))->endSync();
+	});
+
+	// Shown on the lock screen before anything has connected
+	cachedType = (PhoneType) cache.load(notifs);
+	rehash(cachedType);
+#endif
+
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ printReport(print); }, [this](){ resetMetrics(); });
+	}
 }
 
 bool Phone::isConnected(){
@@ -23,20 +47,19 @@ bool Phone::isConnected(){
 Phone::PhoneType Phone::getPhoneType(){
 	if(current == &ancs) return PhoneType::IPhone;
 	else if(current == &bangle) return PhoneType::Android;
+#ifdef CONFIG_CM_REPLAY
+	else if(current == &replay) return PhoneType::IPhone;
+#endif
 	else return PhoneType::None;
 }
 
-auto Phone::findNotif(uint32_t id){
-	return std::find_if(notifs.begin(), notifs.end(), [id](const auto& notif){ return notif.uid == id; });
-}
-
 Notif Phone::getNotif(uint32_t uid){
-	auto notif = findNotif(uid);
-	if(notif == notifs.end()) return {};
-	return *notif;
+	Notif notif = {};
+	notifs.get(uid, notif);
+	return notif;
 }
 
-std::vector<Notif> Phone::getNotifs(){
+const NotifStore& Phone::getNotifs() const{
 	return notifs;
 }
 
@@ -45,23 +68,73 @@ uint32_t Phone::getNotifsCount() const{
 }
 
 void Phone::doPos(uint32_t id){
-	if(current == nullptr || findNotif(id) == notifs.end()) return;
-	current->actionPos(id);
+	if(current == nullptr || !notifs.contains(id)) return;
+	current->actionPos(toSource(id));
 }
 
 void Phone::doNeg(uint32_t id){
-	if(current == nullptr || findNotif(id) == notifs.end()) return;
-	current->actionNeg(id);
+	if(current == nullptr){
+		// Dismissing a cached notif while disconnected only drops it here, the phone will resend it if it still has it
+		onRemove(id);
+		return;
+	}
+
+	if(!notifs.contains(id)) return;
+	current->actionNeg(toSource(id));
+}
+
+void Phone::openNotif(uint32_t id){
+	Notif notif;
+	if(current == nullptr || !notifs.get(id, notif)) return;
+	notif.uid = toSource(id);
+	current->fetchFull(notif);
+}
+
+#ifdef CONFIG_CM_REPLAY
+Phone::ReplaySource& Phone::getReplaySource(){
+	return replay;
+}
+
+Bangle& Phone::getBangle(){
+	return bangle;
+}
+#endif
+
+void Phone::forEachSource(const std::function<void(NotifSource* src)>& fn){
+	fn(&ancs);
+	fn(&bangle);
+#ifdef CONFIG_CM_REPLAY
+	fn(&replay);
+#endif
 }
 
 void Phone::onConnect(NotifSource* src){
 	current = src;
+
+	// The phone type is known now, the other sources have nothing to do until it disconnects
+	forEachSource([src](NotifSource* other){
+		if(other != src){
+			other->park();
+		}
+	});
+
+	RTCTelemetry::phoneConnected();
 	Events::post(Facility::Phone, Event { .action = Event::Connected, .data = { .phoneType = getPhoneType() } });
 
-	if(!notifs.empty()){
-		notifs.clear();
-		Events::post(Facility::Phone, Event { .action = Event::Cleared, .data = { .phoneType = getPhoneType() } });
+#ifdef CONFIG_CM_NOTIF_CACHE
+	if(cachedType == getPhoneType() && notifs.size() > 0){
+		if(src->replaysOnConnect()){
+			std::lock_guard lock(syncMut);
+			stale.clear();
+			notifs.forEach([this](const Notif& notif){ stale.insert(notif.uid); });
+			xTimerChangePeriod(syncTimer, SyncTimeout, 0);
+		}
+		return;
 	}
+	cachedType = getPhoneType();
+#endif
+
+	clearNotifs();
 }
 
 void Phone::onDisconnect(NotifSource* src){
@@ -69,45 +142,314 @@ void Phone::onDisconnect(NotifSource* src){
 	Events::post(Facility::Phone, Event { .action = Event::Disconnected, .data = { .phoneType = getPhoneType() } });
 	current = nullptr;
 
-	if(!notifs.empty()){
-		notifs.clear();
+	forEachSource([src](NotifSource* other){
+		if(other != src){
+			other->unpark();
+		}
+	});
+
+#ifdef CONFIG_CM_NOTIF_CACHE
+	// An interrupted sync proves nothing, keep everything for the next connection
+	xTimerStop(syncTimer, 0);
+	{
+		std::lock_guard lock(syncMut);
+		stale.clear();
+	}
+
+	TaskPool::get().cancel(this);
+	saveScheduled = false;
+	save();
+	return;
+#endif
+
+	clearNotifs();
+}
+
+void Phone::clearNotifs(){
+	dropBatch();
+	forgetAll();
+	if(notifs.clear()){
 		Events::post(Facility::Phone, Event { .action = Event::Cleared, .data = { .phoneType = getPhoneType() } });
 	}
 }
 
-void Phone::onAdd(Notif notif){
+void Phone::onAdd(NotifView notif){
 	if(notif.title.empty() && notif.message.empty()) return;
 
-	if(findNotif(notif.uid) != notifs.end()){
-		onModify(std::move(notif));
+	if(dedup(notif, true)){
+#ifdef CONFIG_CM_NOTIF_CACHE
+		seen(notif.uid);
+#endif
 		return;
 	}
 
-	if(notifs.size() + 1 == notifs.capacity()){
-		notifs.reserve(notifs.capacity() * 2);
+	store(notif);
+}
+
+void Phone::onModify(NotifView notif){
+	if(dedup(notif, false)){
+#ifdef CONFIG_CM_NOTIF_CACHE
+		seen(notif.uid);
+#endif
+		return;
 	}
 
-	notifs.push_back(notif); // TODO: send whole notification, otherwise (by using a mutex) all newly unlocked tasks will rush after getNotif, and promptly get locked again by the mutex
-	Events::post(Facility::Phone, Event { .action = Event::Added, .data = { .addChgRem = { .id = notif.uid } } });
+	store(notif);
 }
 
-void Phone::onModify(Notif notif){
-	auto saved = findNotif(notif.uid);
-	if(saved == notifs.end()){
-		onAdd(std::move(notif));
-		return;
+void Phone::store(const NotifView& notif){
+#ifdef CONFIG_CM_NOTIF_CACHE
+	seen(notif.uid);
+#endif
+
+	std::vector<uint32_t> evicted;
+	const bool added = notifs.put(notif, evicted);
+
+	if(!evicted.empty()){
+		for(uint32_t uid : evicted){
+			forget(uid);
+		}
+		batchChange(Change::Removed, evicted.size());
 	}
+	batchChange(added ? Change::Added : Change::Changed);
 
-	*saved = notif;
-	Events::post(Facility::Phone, Event { .action = Event::Changed, .data = { .addChgRem = { .id = notif.uid } } });
+	// A ringing phone can't wait for the batch to go quiet, the pool posts it right away
+	if(notif.category == Notif::Category::IncomingCall){
+		batchDebounce.flush();
+	}
 }
 
 void Phone::onRemove(uint32_t id){
-	auto notif = findNotif(id);
-	if(notif == notifs.end()) return;
+	id = toStored(id);
+
+#ifdef CONFIG_CM_NOTIF_CACHE
+	seen(id);
+#endif
+
+	forget(id);
+	if(!notifs.remove(id)) return;
+	batchChange(Change::Removed);
+}
+
+uint32_t Phone::contentHash(PhoneType source, const NotifView& notif){
+	// FNV-1a, fields separated by a byte that can't appear in UTF-8 so "ab"+"c" and "a"+"bc" differ
+	uint32_t hash = 2166136261u;
+	auto add = [&hash](const uint8_t* data, size_t size){
+		for(size_t i = 0; i < size; i++){
+			hash = (hash ^ data[i]) * 16777619u;
+		}
+	};
+	auto field = [&add](std::string_view str){
+		static constexpr uint8_t Separator = 0xff;
+		add((const uint8_t*) str.data(), str.size());
+		add(&Separator, 1);
+	};
+
+	const auto type = (uint8_t) source;
+	add(&type, 1);
+	field(notif.appID);
+	field(notif.title);
+	field(notif.message);
+	add((const uint8_t*) &notif.stamp, sizeof(notif.stamp));
+	return hash;
+}
+
+bool Phone::dedup(NotifView& notif, bool add){
+	const uint32_t hash = contentHash(getPhoneType(), notif);
+	const uint32_t sourceUid = notif.uid;
+
+	std::lock_guard lock(dedupMut);
+
+	if(auto it = remapped.find(sourceUid); it != remapped.end()){
+		notif.uid = it->second;
+	}
+
+	if(auto it = contents.find(hash); it != contents.end() && notifs.contains(it->second)){
+		const uint32_t stored = it->second;
+		if(stored == notif.uid){
+			return true;
+		}
+
+		if(add){
+			// The source renumbered it, most likely a replay after reconnecting
+			if(auto old = sourceUids.find(stored); old != sourceUids.end()){
+				remapped.erase(old->second);
+			}
+			remapped[sourceUid] = stored;
+			sourceUids[stored] = sourceUid;
+			notif.uid = stored;
+			return true;
+		}
+	}
+
+	// New content under this uid, the previous content no longer points at it
+	if(auto old = hashes.find(notif.uid); old != hashes.end()){
+		auto prev = contents.find(old->second);
+		if(prev != contents.end() && prev->second == notif.uid){
+			contents.erase(prev);
+		}
+	}
+	hashes[notif.uid] = hash;
+	contents[hash] = notif.uid;
+	return false;
+}
+
+uint32_t Phone::toStored(uint32_t sourceUid){
+	std::lock_guard lock(dedupMut);
+	auto it = remapped.find(sourceUid);
+	return it == remapped.end() ? sourceUid : it->second;
+}
+
+uint32_t Phone::toSource(uint32_t uid){
+	std::lock_guard lock(dedupMut);
+	auto it = sourceUids.find(uid);
+	return it == sourceUids.end() ? uid : it->second;
+}
+
+void Phone::forget(uint32_t uid){
+	std::lock_guard lock(dedupMut);
+
+	if(auto it = hashes.find(uid); it != hashes.end()){
+		auto content = contents.find(it->second);
+		if(content != contents.end() && content->second == uid){
+			contents.erase(content);
+		}
+		hashes.erase(it);
+	}
+
+	if(auto it = sourceUids.find(uid); it != sourceUids.end()){
+		remapped.erase(it->second);
+		sourceUids.erase(it);
+	}
+}
+
+void Phone::forgetAll(){
+	std::lock_guard lock(dedupMut);
+	contents.clear();
+	hashes.clear();
+	remapped.clear();
+	sourceUids.clear();
+}
+
+void Phone::rehash(PhoneType source){
+	std::lock_guard lock(dedupMut);
+	notifs.forEach([this, source](const Notif& notif){
+		const uint32_t hash = contentHash(source, notif);
+		hashes[notif.uid] = hash;
+		contents[hash] = notif.uid;
+	});
+}
+
+void Phone::batchChange(Change change, uint16_t count){
+	std::lock_guard lock(batchMut);
+
+	if(change == Change::Added) batch.added += count;
+	else if(change == Change::Changed) batch.changed += count;
+	else batch.removed += count;
+
+	batchDebounce.trigger();
+}
+
+void Phone::flushBatch(){
+	std::unique_lock lock(batchMut);
+	const auto changes = batch;
+	batch = {};
+	lock.unlock();
+
+	if(changes.added == 0 && changes.changed == 0 && changes.removed == 0) return;
+
+	Events::post(Facility::Phone, Event { .action = Event::Notifs, .data = { .batch = changes } });
+
+#ifdef CONFIG_CM_NOTIF_CACHE
+	// Not pushed back by later changes, so a steady stream still gets saved every SaveDelay
+	if(!saveScheduled.exchange(true)){
+		TaskPool::get().schedule(this, pdMS_TO_TICKS(SaveDelay));
+	}
+#endif
+}
+
+#ifdef CONFIG_CM_NOTIF_CACHE
+bool Phone::known(uint32_t uid, Notif::Category category, uint32_t stamp){
+	uid = toStored(uid);
+
+	// Uids can get reused after the phone reboots, the category catches the obvious mismatches and the stamp a notif
+	// that was updated while disconnected
+	Notif notif;
+	if(!notifs.get(uid, notif) || notif.category != category || notif.stamp != stamp) return false;
+
+	seen(uid);
+	return true;
+}
+
+void Phone::seen(uint32_t uid){
+	std::lock_guard lock(syncMut);
+	if(stale.erase(uid) == 0) return;
+
+	// Replay is still going, give it another SyncTimeout
+	if(!stale.empty()){
+		xTimerChangePeriod(syncTimer, SyncTimeout, 0);
+	}else{
+		xTimerStop(syncTimer, 0);
+	}
+}
+
+void Phone::endSync(){
+	std::unique_lock lock(syncMut);
+	auto gone = std::move(stale);
+	stale.clear();
+	lock.unlock();
+
+	for(uint32_t uid : gone){
+		forget(uid);
+		if(notifs.remove(uid)){
+			batchChange(Change::Removed);
+		}
+	}
+}
+
+void Phone::save(){
+	cache.save(notifs, (uint8_t) cachedType);
+}
+#endif
+
+void Phone::run(){
+#ifdef CONFIG_CM_NOTIF_CACHE
+	saveScheduled = false;
+	save();
+#endif
+}
+
+void Phone::dropBatch(){
+	// Superseded by the Cleared that follows. Cancelled before locking, a flush that's running waits on the lock
+	batchDebounce.cancel();
+	std::lock_guard lock(batchMut);
+	batch = {};
+}
+
+NotifSource::Metrics Phone::getMetrics(PhoneType type) const{
+	if(type == PhoneType::IPhone) return ancs.getMetrics();
+	if(type == PhoneType::Android) return bangle.getMetrics();
+	return {};
+}
+
+void Phone::resetMetrics(){
+	ancs.resetMetrics();
+	bangle.resetMetrics();
+}
+
+void Phone::printReport(const std::function<void(const char* line)>& print) const{
+	char line[160];
+
+	auto report = [&line, &print](const char* name, const NotifSource::Metrics& m){
+		const uint32_t avgParse = m.notifs ? (uint32_t) (m.parseTime / m.notifs) : 0;
+		const uint32_t avgLatency = m.notifs ? (uint32_t) (m.latency / m.notifs) : 0;
+		snprintf(line, sizeof(line), "%-7s %6lu B  %4lu notifs  %3lu drops  parse %5lu / %5lu us  latency %4lu / %4lu ms  queue %2u / %2u  first %5lu ms\n",
+				 name, m.bytes, m.notifs, m.drops, avgParse, m.maxParse, avgLatency, m.maxLatency, m.queueDepth, m.maxQueueDepth, m.firstNotif);
+		print(line);
+	};
 
-	notifs.erase(notif);
-	Events::post(Facility::Phone, Event { .action = Event::Removed, .data = { .addChgRem = { .id = id } } });
+	report("ANCS", ancs.getMetrics());
+	report("Bangle", bangle.getMetrics());
 }
 
 void Phone::findPhoneStart(){
@@ -3,22 +3,43 @@
 
 
 #include <cstdint>
+#include <mutex>
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
 #include "Bangle.h"
 #include "ANCS/Client.h"
 #include "CurrentTime.h"
 #include "NotifSource.h"
-
-class Phone {
+#include "NotifStore.h"
+#include "NotifCache.h"
+#include "Util/TaskPool.h"
+#include "Util/Temporal.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <functional>
+
+class Phone : private TaskPool::Job {
 public:
 
 	enum class PhoneType {
 		None, Android, IPhone
 	};
 
+	/**
+	 * Adds, changes and removes aren't posted one by one. They're collected into a single Notifs event once the source
+	 * goes quiet for BatchWindow, or at most BatchMax after the first one, so a replay of 30 notifs after a reconnect is
+	 * one redraw and one chirp. Incoming calls skip the wait and are posted right away. Listeners diff the store against
+	 * their last generation to see what changed.
+	 */
 	struct Event {
-		enum { Connected, Disconnected, Added, Changed, Removed, Cleared } action;
+		enum { Connected, Disconnected, Notifs, Cleared } action;
 		union {
-			struct { uint32_t id; } addChgRem;
+			struct {
+				uint16_t added;
+				uint16_t changed;
+				uint16_t removed; // Including ones evicted from the store
+			} batch;
 			PhoneType phoneType;
 		} data;
 	};
@@ -29,32 +50,130 @@ public:
 	PhoneType getPhoneType();
 
 	Notif getNotif(uint32_t uid);
-	std::vector<Notif> getNotifs();
+	/** Thread safe, iterate with forEach() or diff with changedSince() instead of copying it. */
+	const NotifStore& getNotifs() const;
 	uint32_t getNotifsCount() const;
 
 	void doPos(uint32_t id);
 	void doNeg(uint32_t id);
 
+	/** The notif is on screen, fetch its full text if the source only sent a preview. */
+	void openNotif(uint32_t id);
+
 	void findPhoneStart();
 	void findPhoneStop();
 
+	/** Pipeline metrics of the source behind type, IPhone for ANCS and Android for Gadgetbridge. */
+	NotifSource::Metrics getMetrics(PhoneType type) const;
+	void resetMetrics();
+	/** One line per source, side by side for comparing the iOS and Android pipelines. */
+	void printReport(const std::function<void(const char* line)>& print) const;
+
+#ifdef CONFIG_CM_REPLAY
+	/**
+	 * Scripted stand-in for ANCS, for the replay harness. The ANCS parser only runs against requests in flight over a
+	 * live link, so notifs go straight into the pipeline: the same batching, store and events as a real source's, and
+	 * while connected the phone reports as an iPhone. Android floods go through the real parser, see getBangle().
+	 */
+	class ReplaySource : public NotifSource {
+	public:
+		void actionPos(uint32_t uid) override{}
+		void actionNeg(uint32_t uid) override{ notifRemove(uid); }
+
+		using NotifSource::connect;
+		using NotifSource::disconnect;
+		using NotifSource::notifNew;
+		using NotifSource::notifModify;
+		using NotifSource::notifRemove;
+	};
+	ReplaySource& getReplaySource();
+	Bangle& getBangle();
+#endif
+
 private:
 	ANCS::Client ancs;
 	CurrentTime cTime;
 	Bangle bangle;
+#ifdef CONFIG_CM_REPLAY
+	ReplaySource replay;
+#endif
 
 	NotifSource* current = nullptr;
 
+	void forEachSource(const std::function<void(NotifSource* src)>& fn);
+
 	void onConnect(NotifSource* src);
 	void onDisconnect(NotifSource* src);
 
-	void onAdd(Notif notif);
-	void onModify(Notif notif);
+	void onAdd(NotifView notif);
+	void onModify(NotifView notif);
 	void onRemove(uint32_t id);
-
-	std::vector<Notif> notifs; // TODO: mutex
-
-	auto findNotif(uint32_t id);
+	void store(const NotifView& notif);
+
+	NotifStore notifs;
+
+	/**
+	 * Sources resend what's already shown, ANCS after every reconnect under fresh uids. Notifs are hashed over source,
+	 * app, title and message, and one that matches a stored notif is dropped before it reaches the store, so it doesn't
+	 * count as a change and nothing redraws or chirps. If it came under another uid, that uid is remapped onto the
+	 * stored one, and actions on the stored one go to the source under the uid it uses now.
+	 */
+	std::mutex dedupMut;
+	std::unordered_map<uint32_t, uint32_t> contents; // Content hash -> stored uid
+	std::unordered_map<uint32_t, uint32_t> hashes; // Stored uid -> content hash
+	std::unordered_map<uint32_t, uint32_t> remapped; // Source uid -> stored uid, for repeats under a new uid
+	std::unordered_map<uint32_t, uint32_t> sourceUids; // Stored uid -> source uid, where it differs
+
+	static uint32_t contentHash(PhoneType source, const NotifView& notif);
+
+	/**
+	 * Translates notif's uid to the stored one and records its content.
+	 * @param add Repeats under a new uid are only looked for in adds, a modify is the source's word on its own uid
+	 * @return True if notif is a repeat of a stored one, in which case notif.uid is the stored uid
+	 */
+	bool dedup(NotifView& notif, bool add);
+	uint32_t toStored(uint32_t sourceUid);
+	uint32_t toSource(uint32_t uid);
+	void forget(uint32_t uid);
+	void forgetAll();
+	void rehash(PhoneType source); // After loading the cache
+	void clearNotifs();
+
+	static constexpr uint32_t BatchWindow = 150; // [ms]
+	static constexpr uint32_t BatchMax = 1000; // [ms]
+	Temporal::Debounce<BatchWindow, BatchMax> batchDebounce;
+	std::mutex batchMut;
+	decltype(Event::data.batch) batch = {};
+
+	enum class Change { Added, Changed, Removed };
+	void batchChange(Change change, uint16_t count = 1);
+	void flushBatch();
+	void dropBatch();
+
+#ifdef CONFIG_CM_NOTIF_CACHE
+	/**
+	 * Notifs are kept over disconnects and reboots. When the same kind of source reconnects they stay, sources skip
+	 * fetching the ones they're told are known, and for sources that replay everything they have on connect, cached
+	 * notifs that weren't replayed within SyncTimeout of the last replayed one were dismissed meanwhile and get dropped.
+	 */
+	NotifCache cache;
+	PhoneType cachedType = PhoneType::None;
+
+	static constexpr uint32_t SaveDelay = 5000; // [ms] from the first unsaved change, bounds flash writes
+	static constexpr uint32_t SyncTimeout = 4000; // [ms]
+	std::atomic_bool saveScheduled = false;
+	TimerHandle_t syncTimer;
+
+	std::mutex syncMut;
+	std::unordered_set<uint32_t> stale; // Cached, not yet replayed by the source
+
+	bool known(uint32_t uid, Notif::Category category, uint32_t stamp);
+	void seen(uint32_t uid);
+	void endSync();
+	void save();
+#endif
+
+	void run() override; // Saves the cache on a TaskPool worker, timer task stack is too small for NVS
 
 };
 
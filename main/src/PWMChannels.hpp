@@ -0,0 +1,92 @@
+#ifndef CLOCKSTAR_FIRMWARE_PWMCHANNELS_HPP
+#define CLOCKSTAR_FIRMWARE_PWMCHANNELS_HPP
+
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include "Periph/PWM.h"
+
+enum class PWMUser : uint8_t {
+	Buzzer,
+	Backlight,
+	RgbR,
+	RgbG,
+	RgbB,
+	COUNT
+};
+
+/**
+ * LEDC channel and timer allocation, done at compile time from what every PWMUser needs.
+ * Every user gets its own channel. Users that change their frequency get a timer of their own, the rest share a timer
+ * with the others running at the same frequency. Running out of channels or timers fails the build.
+ */
+class PWMChannels {
+public:
+	static constexpr LEDCAlloc get(PWMUser user){
+		return allocate()[(size_t) user];
+	}
+
+	static constexpr size_t timersUsed(){
+		size_t timers = 0;
+		for(const auto& alloc : allocate()){
+			timers = std::max(timers, (size_t) alloc.timer + 1);
+		}
+		return timers;
+	}
+
+private:
+	struct Need {
+		uint32_t freq; //[Hz]
+		bool variableFreq;
+	};
+
+	// In PWMUser order
+	static constexpr Need Needs[] = {
+			{ 5000, true }, // Buzzer, the frequency is the tone
+			{ 5000, false }, // Backlight
+			{ 5000, false }, // RgbR
+			{ 5000, false }, // RgbG
+			{ 5000, false } // RgbB
+	};
+
+	static constexpr std::array<LEDCAlloc, (size_t) PWMUser::COUNT> allocate(){
+		std::array<LEDCAlloc, (size_t) PWMUser::COUNT> allocs{};
+		uint32_t timerFreq[LEDC_TIMER_MAX] = {};
+		bool timerShared[LEDC_TIMER_MAX] = {};
+		size_t timers = 0;
+
+		for(size_t i = 0; i < allocs.size(); i++){
+			const Need& need = Needs[i];
+
+			size_t timer = timers;
+			if(!need.variableFreq){
+				for(size_t t = 0; t < timers; t++){
+					if(timerShared[t] && timerFreq[t] == need.freq){
+						timer = t;
+						break;
+					}
+				}
+			}
+
+			if(timer == timers){
+				timers++;
+				if(timer < LEDC_TIMER_MAX){
+					timerFreq[timer] = need.freq;
+					timerShared[timer] = !need.variableFreq;
+				}
+			}
+
+			allocs[i] = { (ledc_channel_t) i, (ledc_timer_t) timer, need.freq };
+		}
+
+		return allocs;
+	}
+
+	static_assert(sizeof(Needs) / sizeof(Needs[0]) == (size_t) PWMUser::COUNT, "Every PWMUser needs an entry in Needs");
+	static_assert((size_t) PWMUser::COUNT <= LEDC_CHANNEL_MAX, "Out of LEDC channels");
+};
+
+static_assert(PWMChannels::timersUsed() <= LEDC_TIMER_MAX, "Out of LEDC timers");
+
+
+#endif //CLOCKSTAR_FIRMWARE_PWMCHANNELS_HPP
@@ -0,0 +1,131 @@
+#include "ADCBurst.h"
+#include <esp_log.h>
+#include <algorithm>
+
+static const char* TAG = "ADCBurst";
+
+ADCBurst::ADCBurst(adc_unit_t unit, size_t samples) : unit(unit), samples(std::clamp(samples, (size_t) 1, MaxSamples)){
+	init();
+}
+
+ADCBurst::~ADCBurst(){
+	deinit();
+}
+
+adc_unit_t ADCBurst::getUnit() const{
+	return unit;
+}
+
+void ADCBurst::init(){
+	const adc_continuous_handle_cfg_t config = {
+			.max_store_buf_size = buf.size(),
+			.conv_frame_size = FrameSize
+	};
+	ESP_ERROR_CHECK(adc_continuous_new_handle(&config, &hndl));
+
+	if(channels > 0){
+		applyConfig();
+	}
+}
+
+void ADCBurst::deinit(){
+	if(hndl == nullptr) return;
+	ESP_ERROR_CHECK(adc_continuous_deinit(hndl));
+	hndl = nullptr;
+}
+
+void ADCBurst::reinit(){
+	std::lock_guard lock(mut);
+	deinit();
+	init();
+}
+
+void ADCBurst::config(adc_channel_t chan, adc_atten_t atten){
+	std::lock_guard lock(mut);
+
+	auto pattern = std::find_if(patterns.begin(), patterns.begin() + channels, [chan](const adc_digi_pattern_config_t& p){ return p.channel == chan; });
+	if(pattern == patterns.begin() + channels){
+		if(channels == patterns.size()){
+			ESP_LOGE(TAG, "Can't add channel %d, pattern is full", chan);
+			return;
+		}
+		channels++;
+	}
+
+	*pattern = {
+			.atten = (uint8_t) atten,
+			.channel = (uint8_t) chan,
+			.unit = (uint8_t) unit,
+			.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH
+	};
+
+	applyConfig();
+}
+
+void ADCBurst::applyConfig(){
+	adc_continuous_config_t config = {
+			.pattern_num = (uint32_t) channels,
+			.adc_pattern = patterns.data(),
+			.sample_freq_hz = SampleFreq,
+			.conv_mode = unit == ADC_UNIT_1 ? ADC_CONV_SINGLE_UNIT_1 : ADC_CONV_SINGLE_UNIT_2,
+			.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2
+	};
+	ESP_ERROR_CHECK(adc_continuous_config(hndl, &config));
+}
+
+esp_err_t ADCBurst::read(adc_channel_t chan, int& valueOut, adc_cali_handle_t cali, size_t samples){
+	std::lock_guard lock(mut);
+	if(hndl == nullptr || channels == 0) return ESP_ERR_INVALID_STATE;
+
+	if(samples == 0){
+		samples = this->samples;
+	}
+	const size_t frames = std::clamp((samples * channels + FrameSamples - 1) / FrameSamples, (size_t) 1, MaxSamples / FrameSamples);
+	const size_t size = frames * FrameSize;
+
+	esp_err_t err = adc_continuous_start(hndl);
+	if(err != ESP_OK) return err;
+
+	drain();
+
+	size_t got = 0;
+	while(got < size){
+		uint32_t read = 0;
+		err = adc_continuous_read(hndl, buf.data() + got, size - got, &read, ReadTimeout);
+		if(err != ESP_OK) break;
+		got += read;
+	}
+
+	adc_continuous_stop(hndl);
+
+	if(err != ESP_OK){
+		ESP_LOGW(TAG, "Burst failed after %zu of %zu bytes: %s", got, size, esp_err_to_name(err));
+		return err;
+	}
+
+	uint32_t sum = 0;
+	uint32_t count = 0;
+	for(size_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= got; i += SOC_ADC_DIGI_RESULT_BYTES){
+		const auto result = reinterpret_cast<const adc_digi_output_data_t*>(&buf[i]);
+		if(result->type2.unit != unit || result->type2.channel != chan) continue;
+
+		sum += result->type2.data;
+		count++;
+	}
+
+	if(count == 0) return ESP_ERR_NOT_FOUND;
+
+	const int raw = (int) ((sum + count / 2) / count);
+	if(cali != nullptr){
+		return adc_cali_raw_to_voltage(cali, raw, &valueOut);
+	}
+
+	valueOut = raw;
+	return ESP_OK;
+}
+
+void ADCBurst::drain(){
+	// Right after start nothing new has been converted yet, whatever is in the pool is left from the previous burst
+	uint32_t read = 0;
+	while(adc_continuous_read(hndl, buf.data(), buf.size(), &read, 0) == ESP_OK && read > 0);
+}
@@ -0,0 +1,65 @@
+#ifndef CLOCKSTAR_FIRMWARE_ADCBURST_H
+#define CLOCKSTAR_FIRMWARE_ADCBURST_H
+
+#include <esp_adc/adc_continuous.h>
+#include <esp_adc/adc_cali.h>
+#include <array>
+#include <mutex>
+
+/**
+ * ADC unit in continuous mode. The DMA only runs during a read: one burst converts every configured channel,
+ * the results are averaged per channel. The unit sleeps between bursts, nothing is converted in the background.
+ * Can't be used together with an ADC (oneshot) of the same unit.
+ */
+class ADCBurst {
+public:
+	/**
+	 * @param unit ADC unit
+	 * @param samples Default number of conversions per channel in a burst
+	 */
+	explicit ADCBurst(adc_unit_t unit, size_t samples = DefaultSamples);
+	virtual ~ADCBurst();
+
+	adc_unit_t getUnit() const;
+
+	/** Adds the channel to the bursts, or changes its attenuation if it is already in them. */
+	void config(adc_channel_t chan, adc_atten_t atten);
+
+	/**
+	 * Runs a burst and returns the channel's average raw value, or its voltage [mV] if calibration is given.
+	 * @param samples Conversions per channel, 0 for the default. Rounded up to whole DMA frames.
+	 */
+	esp_err_t read(adc_channel_t chan, int& valueOut, adc_cali_handle_t cali = nullptr, size_t samples = 0);
+
+	/** Deletes and recreates the driver, keeping the configured channels. */
+	void reinit();
+
+	static constexpr size_t DefaultSamples = 64;
+	static constexpr size_t MaxSamples = 256; // Per burst, over all channels
+
+private:
+	const adc_unit_t unit;
+	const size_t samples;
+	adc_continuous_handle_t hndl = nullptr;
+
+	std::array<adc_digi_pattern_config_t, SOC_ADC_PATT_LEN_MAX> patterns;
+	size_t channels = 0;
+
+	static constexpr uint32_t SampleFreq = 20000; //[Hz], a default burst takes ~3ms
+	static constexpr size_t FrameSamples = 64;
+	static constexpr size_t FrameSize = FrameSamples * SOC_ADC_DIGI_RESULT_BYTES; //[B]
+	static constexpr uint32_t ReadTimeout = 50; //[ms]
+
+	std::array<uint8_t, MaxSamples * SOC_ADC_DIGI_RESULT_BYTES> buf;
+	std::mutex mut;
+
+	void init();
+	void deinit();
+	void applyConfig();
+
+	/** Throws away conversions the DMA finished after the burst was complete */
+	void drain();
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_ADCBURST_H
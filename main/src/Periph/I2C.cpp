@@ -1,25 +1,302 @@
 #include "I2C.h"
-#include <driver/i2c.h>
+#include "Util/Services.h"
+#include "Services/Console.h"
+#include <driver/i2c_master.h>
+#include <esp_log.h>
+#include <esp_timer.h>
 #include <vector>
 #include <cstring>
+#include <algorithm>
 
-I2C::I2C(i2c_port_t port, gpio_num_t sda, gpio_num_t scl) : port(port){
-	i2c_config_t cfg = {
-		.mode = I2C_MODE_MASTER,
+static const char* TAG = "I2C";
+
+I2C::I2C(i2c_port_t port, gpio_num_t sda, gpio_num_t scl) : Threaded("I2C", 3 * 1024, PlannedTask::I2C), port(port){
+	const i2c_master_bus_config_t cfg = {
+		.i2c_port = port,
 		.sda_io_num = sda,
 		.scl_io_num = scl,
-		.sda_pullup_en = false,
-		.scl_pullup_en = false
+		.clk_source = I2C_CLK_SRC_DEFAULT,
+		.glitch_ignore_cnt = 7,
+		.flags = {
+			.enable_internal_pullup = false
+		}
 	};
-	cfg.master.clk_speed = 400000;
+	ESP_ERROR_CHECK(i2c_new_master_bus(&cfg, &bus));
+
+	pending = xSemaphoreCreateCounting(QueueSize, 0);
+	space = xSemaphoreCreateCounting(QueueSize, QueueSize);
 
-	ESP_ERROR_CHECK(i2c_driver_install(port, I2C_MODE_MASTER, 0, 0, 0));
-	ESP_ERROR_CHECK(i2c_param_config(port, &cfg));
+	freeWaits = xQueueCreate(WaitSlots, sizeof(SemaphoreHandle_t));
+	for(auto& sem : waitSems){
+		sem = xSemaphoreCreateBinary();
+		xQueueSend(freeWaits, &sem, 0);
+	}
+
+	stats.start = esp_timer_get_time();
 
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ printReport(print); }, [this](){ resetStats(); });
+	}
+
+	start();
 }
 
 I2C::~I2C(){
-	ESP_ERROR_CHECK(i2c_driver_delete(port));
+	Threaded::stop();
+
+	for(size_t i = 0; i < deviceCount; i++){
+		i2c_master_bus_rm_device(devices[i].handle);
+	}
+	ESP_ERROR_CHECK(i2c_del_master_bus(bus));
+
+	for(auto sem : waitSems){
+		vSemaphoreDelete(sem);
+	}
+	vQueueDelete(freeWaits);
+	vSemaphoreDelete(pending);
+	vSemaphoreDelete(space);
+}
+
+void I2C::submit(Transaction transaction){
+	enqueue(std::move(transaction), nullptr, nullptr);
+}
+
+void I2C::enqueue(Transaction&& transaction, SemaphoreHandle_t done, esp_err_t* result){
+	xSemaphoreTake(space, portMAX_DELAY);
+
+	{
+		std::lock_guard lock(mut);
+
+		size_t i = 0;
+		while(used[i]) i++;
+
+		Job& job = jobs[i];
+		job.transaction = std::move(transaction);
+		if(job.transaction.wbuf != nullptr && job.transaction.wsize <= InlineWrite){
+			memcpy(job.data, job.transaction.wbuf, job.transaction.wsize);
+			job.transaction.wbuf = job.data;
+		}
+		job.seq = seq++;
+		job.queued = esp_timer_get_time();
+		job.done = done;
+		job.result = result;
+		used[i] = true;
+	}
+
+	xSemaphoreGive(pending);
+}
+
+esp_err_t I2C::run(Transaction transaction){
+	// From a completion callback, waiting for the queue would wait for itself
+	if(xTaskGetCurrentTaskHandle() == workerTask){
+		return execute(transaction);
+	}
+
+	SemaphoreHandle_t done;
+	xQueueReceive(freeWaits, &done, portMAX_DELAY);
+
+	esp_err_t result = ESP_FAIL;
+	enqueue(std::move(transaction), done, &result);
+	xSemaphoreTake(done, portMAX_DELAY);
+
+	xQueueSend(freeWaits, &done, portMAX_DELAY);
+	return result;
+}
+
+void I2C::afterStopSignal(){
+	xSemaphoreGive(pending);
+}
+
+void I2C::loop(){
+	if(xSemaphoreTake(pending, portMAX_DELAY) != pdTRUE) return;
+	workerTask = xTaskGetCurrentTaskHandle();
+
+	static constexpr size_t MaxParts = 4;
+	Job parts[MaxParts];
+	size_t count = 0;
+	size_t burst = 0;
+
+	const auto take = [this](size_t i, Job& out){
+		out = std::move(jobs[i]);
+		if(out.transaction.wbuf == jobs[i].data){
+			out.transaction.wbuf = out.data;
+		}
+		jobs[i].transaction.callback = nullptr;
+		used[i] = false;
+	};
+
+	{
+		std::lock_guard lock(mut);
+
+		size_t next = QueueSize;
+		for(size_t i = 0; i < QueueSize; i++){
+			if(!used[i]) continue;
+			if(next == QueueSize || jobs[i].transaction.priority < jobs[next].transaction.priority ||
+			   (jobs[i].transaction.priority == jobs[next].transaction.priority && (int32_t) (jobs[i].seq - jobs[next].seq) < 0)){
+				next = i;
+			}
+		}
+		if(next == QueueSize) return; // Woken to stop
+
+		take(next, parts[count++]);
+		const Transaction& first = parts[0].transaction;
+
+		// Reads continuing exactly at the end of the burst join it, skipping any queue order between them
+		if(first.coalesce && first.wsize == 1 && first.rsize > 0){
+			burst = first.rsize;
+
+			bool joined = true;
+			while(joined && count < MaxParts){
+				joined = false;
+				for(size_t i = 0; i < QueueSize; i++){
+					if(!used[i]) continue;
+
+					const auto& t = jobs[i].transaction;
+					if(!t.coalesce || t.addr != first.addr || t.wsize != 1 || t.rsize == 0) continue;
+					if(t.wbuf[0] != first.wbuf[0] + burst || burst + t.rsize > MaxBurst) continue;
+
+					burst += t.rsize;
+					take(i, parts[count++]);
+					xSemaphoreTake(pending, 0);
+					joined = true;
+					break;
+				}
+			}
+		}
+	}
+
+	for(size_t i = 0; i < count; i++){
+		xSemaphoreGive(space);
+	}
+
+	const uint64_t start = esp_timer_get_time();
+	esp_err_t err;
+	if(count == 1){
+		err = execute(parts[0].transaction);
+	}else{
+		uint8_t buf[MaxBurst];
+		Transaction merged = parts[0].transaction;
+		merged.rbuf = buf;
+		merged.rsize = burst;
+		err = execute(merged);
+
+		if(err == ESP_OK){
+			size_t offset = 0;
+			for(size_t i = 0; i < count; i++){
+				memcpy(parts[i].transaction.rbuf, buf + offset, parts[i].transaction.rsize);
+				offset += parts[i].transaction.rsize;
+			}
+		}
+	}
+	const uint64_t end = esp_timer_get_time();
+
+	portENTER_CRITICAL(&statsLock);
+	stats.transactions++;
+	stats.coalesced += count - 1;
+	stats.bytes += parts[0].transaction.wsize + (count == 1 ? parts[0].transaction.rsize : burst);
+	stats.busy += end - start;
+	portEXIT_CRITICAL(&statsLock);
+
+	for(size_t i = 0; i < count; i++){
+		complete(parts[i], err, end);
+	}
+}
+
+void I2C::complete(Job& job, esp_err_t err, uint64_t now){
+	const auto wait = (uint32_t) std::min(now - job.queued, (uint64_t) UINT32_MAX);
+	const auto prio = (size_t) job.transaction.priority;
+
+	portENTER_CRITICAL(&statsLock);
+	stats.maxWait[prio] = std::max(stats.maxWait[prio], wait);
+	latencies[latencyHead] = wait;
+	latencyHead = (latencyHead + 1) % LatencyCount;
+	latencyCount = std::min(latencyCount + 1, LatencyCount);
+	portEXIT_CRITICAL(&statsLock);
+
+	if(job.transaction.callback){
+		job.transaction.callback(err);
+		job.transaction.callback = nullptr;
+	}
+
+	if(job.done){
+		*job.result = err;
+		xSemaphoreGive(job.done);
+	}
+}
+
+i2c_master_dev_handle_t I2C::device(uint8_t addr){
+	for(size_t i = 0; i < deviceCount; i++){
+		if(devices[i].addr == addr) return devices[i].handle;
+	}
+
+	if(deviceCount == MaxDevices){
+		ESP_LOGE(TAG, "No device slot left for 0x%02x", addr);
+		return nullptr;
+	}
+
+	const i2c_device_config_t cfg = {
+		.dev_addr_length = I2C_ADDR_BIT_LEN_7,
+		.device_address = addr,
+		.scl_speed_hz = Speed
+	};
+	i2c_master_dev_handle_t handle;
+	if(i2c_master_bus_add_device(bus, &cfg, &handle) != ESP_OK) return nullptr;
+
+	devices[deviceCount++] = { addr, handle };
+	return handle;
+}
+
+esp_err_t I2C::execute(const Transaction& t){
+	const int timeout = t.wait == portMAX_DELAY ? -1 : (int) pdTICKS_TO_MS(t.wait);
+
+	// Address only, to probe for a device. Needs no device handle, so a scan doesn't fill the device slots
+	if(t.wsize == 0 && t.rsize == 0){
+		return i2c_master_probe(bus, t.addr, timeout);
+	}
+
+	auto dev = device(t.addr);
+	if(dev == nullptr) return ESP_ERR_NO_MEM;
+
+	if(t.wsize > 0 && t.rsize > 0){
+		return i2c_master_transmit_receive(dev, t.wbuf, t.wsize, t.rbuf, t.rsize, timeout);
+	}else if(t.wsize > 0){
+		return i2c_master_transmit(dev, t.wbuf, t.wsize, timeout);
+	}else{
+		return i2c_master_receive(dev, t.rbuf, t.rsize, timeout);
+	}
+}
+
+void I2C::printReport(const std::function<void(const char* line)>& print){
+	char line[160];
+
+	portENTER_CRITICAL(&statsLock);
+	const Stats copy = stats;
+	uint32_t sorted[LatencyCount];
+	std::copy_n(latencies, latencyCount, sorted);
+	const size_t count = latencyCount;
+	portEXIT_CRITICAL(&statsLock);
+
+	const uint64_t elapsed = esp_timer_get_time() - copy.start;
+	const auto permille = (unsigned) (elapsed ? copy.busy * 1000 / elapsed : 0);
+	snprintf(line, sizeof(line), "I2C     %6lu xfers  %4lu coalesced  %8llu B  bus %u.%u %%\n",
+			 copy.transactions, copy.coalesced, copy.bytes, permille / 10, permille % 10);
+	print(line);
+
+	if(count == 0) return;
+
+	std::sort(sorted, sorted + count);
+	const auto pct = [&sorted, count](size_t p){ return sorted[(count - 1) * p / 100]; };
+	snprintf(line, sizeof(line), "I2C wait, last %zu: p50 %lu us, p99 %lu us, max %lu us  (max high %lu, normal %lu, low %lu)\n",
+			 count, pct(50), pct(99), sorted[count - 1], copy.maxWait[0], copy.maxWait[1], copy.maxWait[2]);
+	print(line);
+}
+
+void I2C::resetStats(){
+	portENTER_CRITICAL(&statsLock);
+	stats = {};
+	stats.start = esp_timer_get_time();
+	latencyHead = latencyCount = 0;
+	portEXIT_CRITICAL(&statsLock);
 }
 
 void I2C::scan(TickType_t timeout){
@@ -33,20 +310,11 @@ void I2C::scan(TickType_t timeout){
 }
 
 esp_err_t I2C::probe(uint8_t addr, TickType_t timeout){
-	std::lock_guard lock(mut);
-
-	auto cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
-	i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-	i2c_master_stop(cmd);
-	auto status = i2c_master_cmd_begin(port, cmd, timeout);
-	i2c_cmd_link_delete(cmd);
-	return status;
+	return run({ .addr = addr, .wait = timeout });
 }
 
 esp_err_t I2C::write(uint8_t addr, const uint8_t* data, size_t size, TickType_t wait){
-	std::lock_guard lock(mut);
-	return i2c_master_write_to_device(port, addr, data, size, wait);
+	return run({ .addr = addr, .wbuf = data, .wsize = size, .wait = wait });
 }
 
 esp_err_t I2C::write(uint8_t addr, uint8_t data, TickType_t wait){
@@ -59,8 +327,7 @@ esp_err_t I2C::write(uint8_t addr, std::initializer_list<uint8_t> data, TickType
 }
 
 esp_err_t I2C::read(uint8_t addr, uint8_t* data, size_t size, TickType_t wait){
-	std::lock_guard lock(mut);
-	return i2c_master_read_from_device(port, addr, data, size, wait);
+	return run({ .addr = addr, .rbuf = data, .rsize = size, .wait = wait });
 }
 
 esp_err_t I2C::read(uint8_t addr, uint8_t& data, TickType_t wait){
@@ -68,8 +335,7 @@ esp_err_t I2C::read(uint8_t addr, uint8_t& data, TickType_t wait){
 }
 
 esp_err_t I2C::write_read(uint8_t addr, const uint8_t* wbuf, size_t wsize, uint8_t* rbuf, size_t rsize, TickType_t wait){
-	std::lock_guard lock(mut);
-	return i2c_master_write_read_device(port, addr, wbuf, wsize, rbuf, rsize, wait);
+	return run({ .addr = addr, .wbuf = wbuf, .wsize = wsize, .rbuf = rbuf, .rsize = rsize, .wait = wait });
 }
 
 esp_err_t I2C::write_read(uint8_t addr, uint8_t wdata, uint8_t* rbuf, size_t rsize, TickType_t wait){
@@ -107,3 +373,7 @@ esp_err_t I2C::readReg(uint8_t addr, uint8_t reg, uint8_t* data, size_t size, Ti
 esp_err_t I2C::readReg(uint8_t addr, uint8_t reg, uint8_t& data, TickType_t wait){
 	return readReg(addr, reg, &data, 1, wait);
 }
+
+esp_err_t I2C::readReg(uint8_t addr, uint8_t reg, uint8_t* data, size_t size, Priority priority, bool coalesce, TickType_t wait){
+	return run({ .addr = addr, .wbuf = &reg, .wsize = 1, .rbuf = data, .rsize = size, .priority = priority, .coalesce = coalesce, .wait = wait });
+}
@@ -2,16 +2,47 @@
 #define CLOCKSTAR_FIRMWARE_I2C_H
 
 #include <hal/i2c_types.h>
+#include <driver/i2c_types.h>
 #include <hal/gpio_types.h>
 #include <esp_err.h>
-#include <freertos/portmacro.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <initializer_list>
+#include <functional>
 #include <mutex>
+#include <array>
+#include "Util/Threaded.h"
 
-class I2C {
+/**
+ * Shared I2C bus. Transactions are queued and run one by one on the I2C task, highest priority first and in order
+ * within a priority. Blocking calls queue a transaction and wait for it, submit() returns immediately and reports
+ * through a callback. Queued register reads that continue exactly where another read of the same device ends are
+ * run as one burst, if both allow it.
+ * Runs on the i2c_master driver, with a device handle per address created on its first transaction. The transfers are
+ * interrupt driven, the I2C task sleeps on their completion while the callers are already free with submit().
+ */
+class I2C : private Threaded {
 public:
 	I2C(i2c_port_t port, gpio_num_t sda, gpio_num_t scl);
-	virtual ~I2C();
+	~I2C() override;
+
+	enum class Priority : uint8_t { High, Normal, Low };
+	static constexpr size_t PriorityCount = 3;
+
+	struct Transaction {
+		uint8_t addr;
+		const uint8_t* wbuf = nullptr; // Copied when queued if it fits InlineWrite, has to outlive the transaction otherwise
+		size_t wsize = 0;
+		uint8_t* rbuf = nullptr; // Has to outlive the transaction
+		size_t rsize = 0;
+		Priority priority = Priority::Normal;
+		bool coalesce = false; // A register read whose device auto-increments, may be joined with adjacent reads
+		TickType_t wait = portMAX_DELAY;
+		std::function<void(esp_err_t)> callback; // Runs on the I2C task, must not block on the bus
+	};
+
+	/** Queues a transaction, waits only while the queue is full. */
+	void submit(Transaction transaction);
 
 	void scan(TickType_t timeout = 5);
 	esp_err_t probe(uint8_t addr, TickType_t timeout = 5);
@@ -34,10 +65,74 @@ public:
 
 	esp_err_t readReg(uint8_t addr, uint8_t reg, uint8_t* data, size_t size, TickType_t wait = portMAX_DELAY);
 	esp_err_t readReg(uint8_t addr, uint8_t reg, uint8_t& data, TickType_t wait = portMAX_DELAY);
+	esp_err_t readReg(uint8_t addr, uint8_t reg, uint8_t* data, size_t size, Priority priority, bool coalesce, TickType_t wait = portMAX_DELAY);
+
+	void printReport(const std::function<void(const char* line)>& print);
+	void resetStats();
 
 private:
 	const i2c_port_t port;
+	i2c_master_bus_handle_t bus = nullptr;
+	static constexpr uint32_t Speed = 400000; // [Hz]
+
+	// Only touched by the I2C task
+	struct Device {
+		uint8_t addr;
+		i2c_master_dev_handle_t handle;
+	};
+	static constexpr size_t MaxDevices = 8;
+	std::array<Device, MaxDevices> devices{};
+	size_t deviceCount = 0;
+	i2c_master_dev_handle_t device(uint8_t addr);
+
+	static constexpr size_t QueueSize = 16;
+	static constexpr size_t InlineWrite = 16; // [B]
+	static constexpr size_t MaxBurst = 64; // [B] of a coalesced read
+
+	struct Job {
+		Transaction transaction;
+		uint8_t data[InlineWrite];
+		uint32_t seq;
+		uint64_t queued; // [us]
+		SemaphoreHandle_t done; // Blocking callers, nullptr for submit()
+		esp_err_t* result;
+	};
+	std::array<Job, QueueSize> jobs;
+	std::array<bool, QueueSize> used{};
+	uint32_t seq = 0;
 	std::mutex mut;
+	SemaphoreHandle_t pending; // Counts queued jobs
+	SemaphoreHandle_t space; // Counts free job slots
+
+	// Blocking callers wait on one of these, taken from a queue so no semaphore is created per transaction
+	static constexpr size_t WaitSlots = 8;
+	std::array<SemaphoreHandle_t, WaitSlots> waitSems;
+	QueueHandle_t freeWaits;
+
+	TaskHandle_t workerTask = nullptr;
+
+	void enqueue(Transaction&& transaction, SemaphoreHandle_t done, esp_err_t* result);
+	esp_err_t run(Transaction transaction);
+
+	void loop() override;
+	void afterStopSignal() override;
+
+	esp_err_t execute(const Transaction& transaction);
+	void complete(Job& job, esp_err_t err, uint64_t now);
+
+	struct Stats {
+		uint32_t transactions;
+		uint32_t coalesced; // Reads run as part of another one's burst
+		uint64_t bytes;
+		uint64_t busy; // [us] the bus was in use
+		uint64_t start; // [us] of the last reset
+		uint32_t maxWait[PriorityCount]; // [us] from queueing to completion
+	} stats{};
+	static constexpr size_t LatencyCount = 64;
+	uint32_t latencies[LatencyCount]; // [us] from queueing to completion
+	size_t latencyHead = 0;
+	size_t latencyCount = 0;
+	portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
 
 };
 
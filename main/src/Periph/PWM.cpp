@@ -1,17 +1,20 @@
 #include <esp_clk_tree.h>
 #include <esp_log.h>
+#include <hal/ledc_ll.h>
 #include "PWM.h"
 
 static const char* TAG = "PMW";
 
-PWM::PWM(uint8_t pin, ledc_channel_t channel, bool invertDuty) : pin(pin), channel(channel), invertDuty(invertDuty){
+bool PWM::fadeInstalled = false;
+
+PWM::PWM(uint8_t pin, LEDCAlloc alloc, bool invertDuty) : pin(pin), channel(alloc.channel), timer(alloc.timer), invertDuty(invertDuty){
 
 	ledc_timer_config_t ledc_timer = {
 			.speed_mode       = getSpeedMode(channel),
 			.duty_resolution  = DutyResDefault,
-			.timer_num        = getTimer(channel),
-			.freq_hz          = DefaultFreq,
-			.clk_cfg          = LEDC_AUTO_CLK,
+			.timer_num        = timer,
+			.freq_hz          = alloc.freq,
+			.clk_cfg          = ClockSource,
 			.deconfigure      = false
 	};
 	if(ledc_timer_config(&ledc_timer) != ESP_OK){
@@ -36,7 +39,6 @@ void PWM::setFreq(uint16_t freq){
 	}
 
 	auto group = getSpeedMode(channel);
-	auto timer = getTimer(channel);
 
 	ledc_set_freq(group, timer, freq);
 	ledc_update_duty(group, channel);
@@ -50,11 +52,89 @@ void PWM::setDuty(uint8_t perc){
 	ledc_update_duty(group, channel);
 }
 
+void PWM::fade(uint8_t perc, uint32_t time, SemaphoreHandle_t done){
+	if(pin == (uint8_t) -1) return;
+	attach();
+
+	if(!fadeInstalled){
+		ESP_ERROR_CHECK(ledc_fade_func_install(0));
+		fadeInstalled = true;
+	}
+
+	auto group = getSpeedMode(channel);
+
+	// A fade still running is cut short, the new one starts from wherever it got to
+	ledc_fade_stop(group, channel);
+
+	ledc_cbs_t cbs = { .fade_cb = fadeEnd };
+	ledc_cb_register(group, channel, &cbs, done);
+
+	const uint32_t duty = (FullDuty * perc) / 100;
+	ledc_set_fade_with_time(group, channel, duty, time);
+	ledc_fade_start(group, channel, LEDC_FADE_NO_WAIT);
+}
+
+bool IRAM_ATTR PWM::fadeEnd(const ledc_cb_param_t* param, void* arg){
+	if(param->event != LEDC_FADE_END_EVT || arg == nullptr) return false;
+
+	BaseType_t woken = pdFALSE;
+	xSemaphoreGiveFromISR((SemaphoreHandle_t) arg, &woken);
+	return woken == pdTRUE;
+}
+
 void PWM::stop(){
 	if(pin == (uint8_t) -1) return;
 	ledc_stop(getSpeedMode(channel), channel, invertDuty);
 }
 
+bool IRAM_ATTR PWM::setFreqFromISR(uint16_t freq){
+	return setDividerFromISR(divider(freq));
+}
+
+bool IRAM_ATTR PWM::setDividerFromISR(uint32_t divider){
+	if(pin == (uint8_t) -1 || divider == 0) return false;
+
+	auto hw = LEDC_LL_GET_HW();
+	auto group = getSpeedMode(channel);
+
+	ledc_ll_set_clock_divider(hw, group, timer, divider);
+	ledc_ll_ls_timer_update(hw, group, timer);
+
+	ledc_ll_set_sig_out_en(hw, group, channel, true);
+	ledc_ll_set_duty_start(hw, group, channel, true);
+	ledc_ll_ls_channel_update(hw, group, channel);
+
+	return true;
+}
+
+void IRAM_ATTR PWM::muteFromISR(){
+	if(pin == (uint8_t) -1) return;
+
+	auto hw = LEDC_LL_GET_HW();
+	auto group = getSpeedMode(channel);
+
+	ledc_ll_set_idle_level(hw, group, channel, invertDuty);
+	ledc_ll_set_sig_out_en(hw, group, channel, false);
+	ledc_ll_ls_channel_update(hw, group, channel);
+}
+
+void IRAM_ATTR PWM::setDutyFromISR(uint32_t duty){
+	if(pin == (uint8_t) -1 || !attached) return;
+
+	auto hw = LEDC_LL_GET_HW();
+	auto group = getSpeedMode(channel);
+
+	// What ledc_set_duty and ledc_update_duty write for a plain duty change, without their locks
+	ledc_ll_set_duty_int_part(hw, group, channel, duty);
+	ledc_ll_set_duty_direction(hw, group, channel, LEDC_DUTY_DIR_INCREASE);
+	ledc_ll_set_duty_num(hw, group, channel, 1);
+	ledc_ll_set_duty_cycle(hw, group, channel, 1);
+	ledc_ll_set_duty_scale(hw, group, channel, 0);
+	ledc_ll_set_sig_out_en(hw, group, channel, true);
+	ledc_ll_set_duty_start(hw, group, channel, true);
+	ledc_ll_ls_channel_update(hw, group, channel);
+}
+
 void PWM::attach(){
 	if(pin == (uint8_t) -1) return;
 	if(attached) return;
@@ -64,7 +144,7 @@ void PWM::attach(){
 			.speed_mode     = getSpeedMode(channel),
 			.channel        = channel,
 			.intr_type      = LEDC_INTR_DISABLE,
-			.timer_sel      = getTimer(channel),
+			.timer_sel      = timer,
 			.duty           = 0,
 			.hpoint         = 0,
 			.flags = { .output_invert = invertDuty }
@@ -88,7 +168,3 @@ void PWM::detach(){
 constexpr ledc_mode_t PWM::getSpeedMode(ledc_channel_t channel){
 	return static_cast<ledc_mode_t>((channel / 8));
 }
-
-constexpr ledc_timer_t PWM::getTimer(ledc_channel_t channel){
-	return static_cast<ledc_timer_t>(((channel / 2) % 4));
-}
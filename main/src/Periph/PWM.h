@@ -4,68 +4,101 @@
 #include <driver/gptimer.h>
 #include <driver/ledc.h>
 #include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <soc/clk_tree_defs.h>
+#include <sdkconfig.h>
 
 /**
  * Duty resolution defaults to 10-bit (usually enough for most uses such as a piezo buzzer or LED dimming).
  *
+ * Channels share LEDC timers, and with them the frequency. Which channel runs on which timer is decided by the
+ * allocation, see PWMChannels.hpp.
  *
- * LEDC Chan to Group/Channel/Timer Mapping (used to prevent conflicts between channels/timers/groups)
-** ledc: 0  => Group: 0, Channel: 0, Timer: 0
-** ledc: 1  => Group: 0, Channel: 1, Timer: 0
-** ledc: 2  => Group: 0, Channel: 2, Timer: 1
-** ledc: 3  => Group: 0, Channel: 3, Timer: 1
-** ledc: 4  => Group: 0, Channel: 4, Timer: 2
-** ledc: 5  => Group: 0, Channel: 5, Timer: 2
-** ledc: 6  => Group: 0, Channel: 6, Timer: 3
-** ledc: 7  => Group: 0, Channel: 7, Timer: 3
-** ledc: 8  => Group: 1, Channel: 0, Timer: 0
-** ledc: 9  => Group: 1, Channel: 1, Timer: 0
-** ledc: 10 => Group: 1, Channel: 2, Timer: 1
-** ledc: 11 => Group: 1, Channel: 3, Timer: 1
-** ledc: 12 => Group: 1, Channel: 4, Timer: 2
-** ledc: 13 => Group: 1, Channel: 5, Timer: 2
-** ledc: 14 => Group: 1, Channel: 6, Timer: 3
-** ledc: 15 => Group: 1, Channel: 7, Timer: 3
+ * All timers run from the same clock. With CM_AMBIENT_SLEEP that's RC_FAST, which keeps the outputs going in light sleep.
  */
 
+/**
+ * A LEDC channel and the timer it runs on
+ */
+struct LEDCAlloc {
+	ledc_channel_t channel;
+	ledc_timer_t timer;
+	uint32_t freq; //[Hz] the timer starts with
+};
+
 class PWM {
 public:
-	PWM(uint8_t pin, ledc_channel_t channel, bool invertDuty = false);
+	PWM(uint8_t pin, LEDCAlloc alloc, bool invertDuty = false);
 	virtual ~PWM();
 
 	void setFreq(uint16_t freq);
 	void setDuty(uint8_t perc); //duty in percentage (0 - 100%)
+
+	/**
+	 * Fades the duty to perc in hardware over time [ms] and returns right away.
+	 * @param done Given from the fade end ISR, optional
+	 */
+	void fade(uint8_t perc, uint32_t time, SemaphoreHandle_t done = nullptr);
 	void stop();
 
 	void attach();
 	void detach();
 
-	static constexpr bool IRAM_ATTR checkFrequency(uint16_t freq){
-		uint64_t divParam = 0;
-		uint32_t precision = FullDuty;
+	/**
+	 * ISR safe, writes the timer divider for freq straight into the LEDC registers and enables the output.
+	 * @return False if the divider can't reach freq, output is left as it was
+	 */
+	bool IRAM_ATTR setFreqFromISR(uint16_t freq);
+
+	/** Same as setFreqFromISR with a divider from divider(), for tones whose divider was worked out ahead of time */
+	bool IRAM_ATTR setDividerFromISR(uint32_t divider);
+
+	/** ISR safe, disables the output until the next setFreqFromISR/setFreq */
+	void IRAM_ATTR muteFromISR();
 
-		divParam = (((uint64_t) src_clk_freq << 8) + ((freq * precision) / 2)) / (freq * precision);
+	/** ISR safe, duty in [0, FullDuty] */
+	void IRAM_ATTR setDutyFromISR(uint32_t duty);
 
-		if(!(divParam > 256 && divParam < (0x3FFFF))){
-			return false;
-		}
-		return true;
+	static constexpr ledc_timer_bit_t DRAM_ATTR DutyResDefault = LEDC_TIMER_10_BIT;
+	static constexpr uint32_t DRAM_ATTR FullDuty = 1 << DutyResDefault;
+
+	/**
+	 * LEDC timer divider for freq, with 8 fractional bits, or 0 if the divider can't reach it. The same rounding as
+	 * ledc_set_freq, in 32 bits. Folds to a constant for a constant freq, e.g. the NOTE_* ones.
+	 */
+	static constexpr uint32_t IRAM_ATTR divider(uint16_t freq){
+		if(freq == 0) return 0;
+
+		const uint32_t div = (DividerBase + freq / 2) / freq;
+		return div > 256 && div < 0x3FFFF ? div : 0;
+	}
+
+	static constexpr bool IRAM_ATTR checkFrequency(uint16_t freq){
+		return divider(freq) != 0;
 	}
 
 private:
 	uint8_t pin = -1;
 	ledc_channel_t channel = LEDC_CHANNEL_0;
+	ledc_timer_t timer = LEDC_TIMER_0;
 	bool invertDuty = false;
 	bool attached = false;
 
-	static constexpr uint32_t DefaultFreq = 5000;    //placeholder, usually changed before attaching to a channel or pin
-
-	static constexpr ledc_timer_bit_t DRAM_ATTR DutyResDefault = LEDC_TIMER_10_BIT;
-	static constexpr uint32_t DRAM_ATTR FullDuty = 1 << DutyResDefault;
+	static bool fadeInstalled;
+	static bool fadeEnd(const ledc_cb_param_t* param, void* arg);
 
 	static constexpr ledc_mode_t getSpeedMode(ledc_channel_t channel);
-	static constexpr ledc_timer_t getTimer(ledc_channel_t channel);
+#ifdef CONFIG_CM_AMBIENT_SLEEP
+	static constexpr ledc_clk_cfg_t ClockSource = LEDC_USE_RC_FAST_CLK;
+	static constexpr uint32_t DRAM_ATTR src_clk_freq = SOC_CLK_RC_FAST_FREQ_APPROX; //17.5 MHz
+#else
+	static constexpr ledc_clk_cfg_t ClockSource = LEDC_USE_APB_CLK;
 	static constexpr uint32_t DRAM_ATTR src_clk_freq = 80000000; //80 MHz
+#endif
+
+	// Timer divider (with 8 fractional bits) is DividerBase / freq
+	static constexpr uint32_t DRAM_ATTR DividerBase = ((uint64_t) src_clk_freq << 8) / FullDuty;
 };
 
 #endif //CIRCUITOS_PIEZO_H
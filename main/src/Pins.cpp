@@ -1,101 +1,95 @@
 #include "Pins.hpp"
 #include "Util/EfuseMeta.h"
 #include "Util/stdafx.h"
+#include <esp_log.h>
 
 static const char* TAG = "Pins";
 
-int Pins::get(Pin pin){
-	if(instance == nullptr){
-		instance = new Pins();
-		uint8_t revision = 0;
-		EfuseMeta::readRev(revision);
-
-		if(revision == 0){
-			instance->currentMap = &instance->Revision1;
-		}else if(revision == 1){
-			instance->currentMap = &instance->Revision2;
-		}else{
-			while(true){
-				ESP_LOGE("Pins", "No pin map found for revision %d!", revision);
-				delayMillis(1000);
-			}
-		}
+/** Builds a table from { pin, number } pairs in any order, pins left out are -1 */
+template<size_t N>
+static constexpr std::array<int8_t, (size_t) Pin::COUNT> makeMap(const std::pair<Pin, int8_t> (& pins)[N]){
+	std::array<int8_t, (size_t) Pin::COUNT> map = {};
+	for(auto& num : map){
+		num = -1;
 	}
+	for(const auto& [pin, num] : pins){
+		map[(size_t) pin] = num;
+	}
+	return map;
+}
 
-	assert(instance != nullptr);
+//For original Bit, Bit 2
+static constexpr std::pair<Pin, int8_t> Revision1Pins[] = {
+		{ Pin::BtnDown,   14 },
+		{ Pin::BtnUp,     15 },
+		{ Pin::BtnSelect, 27 },
+		{ Pin::BtnAlt,    39 },
+		{ Pin::LedBl,     4 },
+		{ Pin::Buzz,      2 },
+		{ Pin::BattRead,  36 },
+		{ Pin::BattVref,  -1 },
+		{ Pin::Usb,       19 },
+		{ Pin::I2cSda,    26 },
+		{ Pin::I2cScl,    25 },
+		{ Pin::TftSck,    16 },
+		{ Pin::TftMosi,   17 },
+		{ Pin::TftDc,     5 },
+		{ Pin::TftRst,    18 },
+		{ Pin::Rgb_r,     21 },
+		{ Pin::Rgb_g,     22 },
+		{ Pin::Rgb_b,     23 },
+		{ Pin::Imu_int1,  35 },
+		{ Pin::Imu_int2,  34 },
+};
 
-	PinMap* pinMap = instance->currentMap;
+//For Bit v3
+static constexpr std::pair<Pin, int8_t> Revision2Pins[] = {
+		{ Pin::BtnDown,   38 },
+		{ Pin::BtnUp,     40 },
+		{ Pin::BtnSelect, 39 },
+		{ Pin::BtnAlt,    37 },
+		{ Pin::LedBl,     9 },
+		{ Pin::Buzz,      11 },
+		{ Pin::BattRead,  10 },
+		{ Pin::BattVref,  35 },
+		{ Pin::Usb,       36 },
+		{ Pin::I2cSda,    4 },
+		{ Pin::I2cScl,    5 },
+		{ Pin::TftSck,    48 },
+		{ Pin::TftMosi,   34 },
+		{ Pin::TftDc,     33 },
+		{ Pin::TftRst,    47 },
+		{ Pin::Rgb_r,     8 },
+		{ Pin::Rgb_g,     7 },
+		{ Pin::Rgb_b,     6 },
+		{ Pin::Imu_int1,  41 },
+		{ Pin::Imu_int2,  42 },
+};
 
-	if(pinMap == nullptr){
-		ESP_LOGE(TAG, "Pin map is invalid.!\n");
-		return -1;
-	}
+// Indexed by the eFuse revision
+static constexpr std::array<int8_t, (size_t) Pin::COUNT> PinMaps[] = { makeMap(Revision1Pins), makeMap(Revision2Pins) };
+static constexpr size_t PinMapCount = sizeof(PinMaps) / sizeof(PinMaps[0]);
 
-	if(!pinMap->count(pin)){
-		ESP_LOGE(TAG, "Pin %d not mapped!\n", (int) pin);
-		return -1;
-	}
+DRAM_ATTR Pins::PinMap Pins::current = {};
+DRAM_ATTR bool Pins::resolved = false;
 
-	return pinMap->at(pin);
-}
-
-void Pins::setLatest(){
-	if(instance == nullptr){
-		instance = new Pins();
+void Pins::init(){
+	const uint8_t revision = EfuseMeta::getRevision();
+	if(revision >= PinMapCount){
+		while(true){
+			ESP_LOGE(TAG, "No pin map found for revision %d!", revision);
+			delayMillis(1000);
+		}
 	}
 
-	instance->currentMap = instance->pinMaps.back();
+	use(PinMaps[revision]);
 }
 
-Pins::Pins(){
-	initPinMaps();
+void Pins::setLatest(){
+	use(PinMaps[PinMapCount - 1]);
 }
 
-void Pins::initPinMaps(){
-	Revision1 = {
-			{ Pin::BtnDown,   14 },
-			{ Pin::BtnUp,     15 },
-			{ Pin::BtnSelect, 27 },
-			{ Pin::BtnAlt,    39 },
-			{ Pin::LedBl,     4 },
-			{ Pin::Buzz,      2 },
-			{ Pin::BattRead,  36 },
-			{ Pin::BattVref,  -1 },
-			{ Pin::Usb,       19 },
-			{ Pin::I2cSda,    26 },
-			{ Pin::I2cScl,    25 },
-			{ Pin::TftSck,    16 },
-			{ Pin::TftMosi,   17 },
-			{ Pin::TftDc,     5 },
-			{ Pin::TftRst,    18 },
-			{ Pin::Rgb_r,     21 },
-			{ Pin::Rgb_g,     22 },
-			{ Pin::Rgb_b,     23 },
-			{ Pin::Imu_int1,  35 },
-			{ Pin::Imu_int2,  34 },
-	};
-
-	Revision2 = {
-			{ Pin::BtnDown,   38 },
-			{ Pin::BtnUp,     40 },
-			{ Pin::BtnSelect, 39 },
-			{ Pin::BtnAlt,    37 },
-			{ Pin::LedBl,     9 },
-			{ Pin::Buzz,      11 },
-			{ Pin::BattRead,  10 },
-			{ Pin::BattVref,  35 },
-			{ Pin::Usb,       36 },
-			{ Pin::I2cSda,    4 },
-			{ Pin::I2cScl,    5 },
-			{ Pin::TftSck,    48 },
-			{ Pin::TftMosi,   34 },
-			{ Pin::TftDc,     33 },
-			{ Pin::TftRst,    47 },
-			{ Pin::Rgb_r,     8 },
-			{ Pin::Rgb_g,     7 },
-			{ Pin::Rgb_b,     6 },
-			{ Pin::Imu_int1,  41 },
-			{ Pin::Imu_int2,  42 },
-	};
+void Pins::use(const PinMap& map){
+	current = map;
+	resolved = true;
 }
-
@@ -1,11 +1,9 @@
 #ifndef CLOCKSTAR_LIBRARY_PINS_HPP
 #define CLOCKSTAR_LIBRARY_PINS_HPP
 
-#include <unordered_map>
+#include <array>
 #include <cstdint>
-#include <cstdio>
-#include <esp_debug_helpers.h>
-#include <vector>
+#include <esp_attr.h>
 
 enum class Pin : uint8_t {
 	BtnDown,
@@ -28,34 +26,40 @@ enum class Pin : uint8_t {
 	Rgb_b,
 	Imu_int1,
 	Imu_int2,
+	COUNT
 };
 
 /**
+ * Pin numbers of the board revision in eFuse. The tables are constant, init() copies the one matching the revision
+ * into a flat array in DRAM at boot, so get() is an index into RAM: safe in IRAM ISRs, with the flash cache off too.
+ * get() before init() resolves the table itself, only ISRs need init() to have run, which it does before any
+ * interrupt is installed. Unused pins are -1.
+ *
  * Note: This class does not affect pins used in the bootloader hook!
  */
 class Pins {
-	typedef std::unordered_map<Pin, int> PinMap;
 public:
-	static int get(Pin pin);
+	static inline int IRAM_ATTR get(Pin pin){
+		if(!resolved){
+			init();
+		}
+		return current[(size_t) pin];
+	}
 
+	/** Resolves the table for the revision in eFuse. Halts on a revision without one. */
+	static void init();
+
+	/** Uses the newest revision's table regardless of eFuse, for the test jig */
 	static void setLatest();
 
 private:
-	Pins();
-
-	PinMap* currentMap = nullptr;
-
-	inline static Pins* instance = nullptr;
-
-	void initPinMaps();
+	using PinMap = std::array<int8_t, (size_t) Pin::COUNT>;
 
-	//For original Bit, Bit 2
-	PinMap Revision1;
+	static DRAM_ATTR PinMap current;
+	static DRAM_ATTR bool resolved;
 
-	//For Bit v3
-	PinMap Revision2;
+	static void use(const PinMap& map);
 
-	std::vector<PinMap*> pinMaps = { &Revision1, &Revision2 };
 };
 
 #endif //CLOCKSTAR_LIBRARY_PINS_HPP
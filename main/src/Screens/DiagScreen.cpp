@@ -0,0 +1,153 @@
+#include "DiagScreen.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <esp_heap_caps.h>
+#include "Theme/theme.h"
+#include "Theme/styles.h"
+#include "Util/Services.h"
+#include "Util/stdafx.h"
+#include "Devices/Input.h"
+#include "Devices/Battery.h"
+#include "BLE/ConMan.h"
+#include "Services/TaskMonitor.h"
+#include "Screens/MainMenu/MainMenu.h"
+#include "Screens/OrientationView.h"
+
+static constexpr const char* Titles[] = { "FPS", "Flush", "CPU", "Heap", "Block", "BLE", "Drops", "Batt" };
+
+DiagScreen::DiagScreen() : queue(4, "DiagScreen"){
+	auto bg = lv_obj_create(*this);
+	lv_obj_add_flag(bg, LV_OBJ_FLAG_FLOATING);
+	lv_obj_set_size(bg, 128, 128);
+	lv_obj_set_pos(bg, 0, 0);
+	lv_obj_set_style_bg_color(bg, lv_color_black(), 0);
+	lv_obj_set_style_bg_opa(bg, LV_OPA_COVER, 0);
+
+	lv_obj_set_size(*this, 128, 128);
+	lv_obj_set_flex_flow(*this, LV_FLEX_FLOW_COLUMN);
+	lv_obj_set_style_pad_all(*this, 4, 0);
+	lv_obj_set_style_pad_row(*this, 2, 0);
+
+	for(uint8_t i = 0; i < RowCount; i++){
+		auto row = lv_obj_create(*this);
+		lv_obj_set_size(row, lv_pct(100), LV_SIZE_CONTENT);
+
+		auto title = lv_label_create(row);
+		lv_obj_set_style_text_font(title, &devin, 0);
+		lv_obj_set_style_text_color(title, Styles::TextColor, 0);
+		lv_label_set_text_static(title, Titles[i]);
+
+		rows[i] = lv_label_create(row);
+		lv_obj_set_style_text_font(rows[i], &devin, 0);
+		lv_obj_set_style_text_color(rows[i], lv_color_white(), 0);
+		lv_obj_align(rows[i], LV_ALIGN_TOP_RIGHT, 0, 0);
+		lv_label_set_text_static(rows[i], "-");
+	}
+}
+
+DiagScreen::~DiagScreen(){
+	Events::unlisten(&queue);
+}
+
+void DiagScreen::onStarting(){
+	queue.reset();
+	Events::listen(Facility::Input, &queue);
+
+	lastFrames = LVGL::getFrameCounters();
+	lastDrops = totalDrops();
+	lastUpdate = millis();
+}
+
+void DiagScreen::onStop(){
+	Events::unlisten(&queue);
+}
+
+void DiagScreen::loop(){
+	Event evt;
+	if(queue.get(evt, 0)){
+		auto data = (Input::Data*) evt.data;
+		if(data->btn == Input::Alt && data->action == Input::Data::Press){
+			transition<MainMenu>();
+			return;
+		}
+		if(data->btn == Input::Select && data->action == Input::Data::Press){
+			transition<OrientationView>();
+			return;
+		}
+	}
+
+	if(millis() - lastUpdate < UpdateInterval) return;
+	update();
+}
+
+void DiagScreen::update(){
+	const auto now = millis();
+	const auto elapsed = (uint32_t) std::max<uint64_t>(now - lastUpdate, 1); // [ms]
+	lastUpdate = now;
+
+	// This screen's own redraws are counted too, they're a few labels at most
+	const auto frames = LVGL::getFrameCounters();
+	const uint32_t frameCount = frames.frames - lastFrames.frames;
+	const uint64_t flushTime = frames.flushTime - lastFrames.flushTime; // [us]
+	lastFrames = frames;
+
+	setRow(Fps, "%lu.%lu", frameCount * 1000 / elapsed, (frameCount * 10000 / elapsed) % 10);
+	if(frameCount > 0){
+		const auto perFrame = (uint32_t) (flushTime / frameCount); // [us]
+		setRow(Flush, "%lu.%02lu ms", perFrame / 1000, (perFrame % 1000) / 10);
+	}else{
+		setRow(Flush, "-");
+	}
+
+	if(auto monitor = Services.get<Service::TaskMonitor>()){
+		setRow(Cpu, "%u%% %u%%", monitor->getCoreLoad(0), monitor->getCoreLoad(1));
+	}else{
+		setRow(Cpu, "- -");
+	}
+
+	setRow(Heap, "%zu B", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+	setRow(Block, "%zu B", heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+
+	const auto link = ConMan.getLink();
+	if(link.interval != 0){
+		// Interval is in 1.25 ms units
+		setRow(Ble, "%u.%02u ms %u B", link.interval * 5 / 4, (link.interval * 125) % 100, link.mtu);
+	}else{
+		setRow(Ble, "-");
+	}
+
+	auto drops = totalDrops();
+	if(drops < lastDrops){
+		lastDrops = 0; // Stats were reset from the console
+	}
+	setRow(Drops, "%lu +%lu", drops, drops - lastDrops);
+	lastDrops = drops;
+
+	if(auto battery = Services.get<Service::Battery>()){
+		setRow(Batt, "%u mV", battery->getVoltage());
+	}
+}
+
+void DiagScreen::setRow(Row row, const char* fmt, ...){
+	char text[sizeof(texts[0])];
+
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+
+	// Setting the same text would still invalidate and redraw the label
+	if(strcmp(text, texts[row]) == 0) return;
+	strcpy(texts[row], text);
+	lv_label_set_text_static(rows[row], texts[row]);
+}
+
+uint32_t DiagScreen::totalDrops(){
+	uint32_t drops = 0;
+	for(size_t i = 0; i < Events::FacilityCount; i++){
+		drops += Events::getStats((Facility) i).dropped;
+	}
+	return drops;
+}
@@ -0,0 +1,45 @@
+#ifndef CLOCKSTAR_FIRMWARE_DIAGSCREEN_H
+#define CLOCKSTAR_FIRMWARE_DIAGSCREEN_H
+
+#include "LV_Interface/LVScreen.h"
+#include "LV_Interface/LVGL.h"
+#include "Util/Events.h"
+
+/**
+ * Hidden live performance readout for testers, opened with the Up + Down chord in the main menu and left with Alt.
+ * Select opens OrientationView.
+ * Rows are refreshed every UpdateInterval from counters the services keep anyway, and a label is only touched when
+ * its text changed, so the screen itself costs a few small redraws a second.
+ * Core load needs the TaskMonitor service (CONFIG_CM_TASK_MONITOR) and shows dashes without it.
+ */
+class DiagScreen : public LVScreen {
+public:
+	DiagScreen();
+	~DiagScreen() override;
+
+private:
+	static constexpr uint32_t UpdateInterval = 500; // [ms]
+
+	enum Row { Fps, Flush, Cpu, Heap, Block, Ble, Drops, Batt, RowCount };
+	lv_obj_t* rows[RowCount];
+	char texts[RowCount][24] = {};
+
+	EventQueue queue;
+
+	uint64_t lastUpdate = 0; // [ms]
+	LVGL::FrameCounters lastFrames = {};
+	uint32_t lastDrops = 0;
+
+	void onStarting() override;
+	void onStop() override;
+	void loop() override;
+
+	void update();
+	void setRow(Row row, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+	static uint32_t totalDrops();
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_DIAGSCREEN_H
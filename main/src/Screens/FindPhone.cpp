@@ -0,0 +1,169 @@
+#include "FindPhone.h"
+#include <cstdio>
+#include <cmath>
+#include "Theme/theme.h"
+#include "Util/Services.h"
+#include "Util/stdafx.h"
+#include "Devices/Input.h"
+#include "BLE/ConMan.h"
+#include "Screens/MainMenu/MainMenu.h"
+
+static constexpr const char* LevelTexts[] = { "Cold", "Cool", "Warm", "Hot", "Very hot" };
+static constexpr lv_color_t LevelColors[] = {
+		LV_COLOR_MAKE(60, 110, 255),
+		LV_COLOR_MAKE(90, 200, 230),
+		LV_COLOR_MAKE(240, 200, 60),
+		LV_COLOR_MAKE(255, 120, 30),
+		LV_COLOR_MAKE(255, 40, 20)
+};
+
+FindPhone::FindPhone() : phone(*(Services.get<Service::Phone>())), queue(4, "FindPhone"){
+	lv_obj_set_size(*this, 128, 128);
+
+	title = lv_label_create(*this);
+	lv_label_set_text_static(title, "Find phone");
+	lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 6);
+
+	levelLabel = lv_label_create(*this);
+	lv_obj_set_style_text_font(levelLabel, &devin2, 0);
+	lv_label_set_text_static(levelLabel, "...");
+	lv_obj_align(levelLabel, LV_ALIGN_CENTER, 0, -14);
+
+	bar = lv_bar_create(*this);
+	lv_obj_set_size(bar, 100, 8);
+	lv_obj_align(bar, LV_ALIGN_CENTER, 0, 8);
+	lv_bar_set_range(bar, 0, Levels);
+	lv_bar_set_value(bar, 0, LV_ANIM_OFF);
+
+	rssiLabel = lv_label_create(*this);
+	lv_obj_set_style_text_font(rssiLabel, &devin, 0);
+	lv_label_set_text_static(rssiLabel, "- dBm");
+	lv_obj_align(rssiLabel, LV_ALIGN_CENTER, 0, 24);
+
+	hint = lv_label_create(*this);
+	lv_obj_set_style_text_font(hint, &devin, 0);
+	lv_label_set_text_static(hint, "");
+	lv_obj_align(hint, LV_ALIGN_BOTTOM_MID, 0, -6);
+}
+
+FindPhone::~FindPhone(){
+	Events::unlisten(&queue);
+}
+
+void FindPhone::onStarting(){
+	queue.reset();
+	Events::listen(Facility::Input, &queue);
+
+	primed = false;
+	lastRead = 0;
+	levelChanged = millis();
+	lastReads = ConMan.getLink().rssiReads;
+
+	const bool canRing = phone.getPhoneType() == Phone::PhoneType::Android;
+	lv_label_set_text_static(hint, canRing ? "Select: ring" : "");
+
+	auto sleep = Services.get<Service::Sleep>();
+	sleep->enAutoSleep(false);
+}
+
+void FindPhone::onStop(){
+	Events::unlisten(&queue);
+	setRing(false);
+
+	auto sleep = Services.get<Service::Sleep>();
+	sleep->enAutoSleep(true);
+}
+
+void FindPhone::loop(){
+	Event evt;
+	if(queue.get(evt, 0)){
+		auto data = (Input::Data*) evt.data;
+		if(data->btn == Input::Alt && data->action == Input::Data::Press){
+			transition<MainMenu>();
+			return;
+		}else if(data->btn == Input::Select && data->action == Input::Data::Press && phone.getPhoneType() == Phone::PhoneType::Android){
+			setRing(!ringing);
+		}
+	}
+
+	handleRing();
+	sample();
+}
+
+void FindPhone::setRing(bool ring){
+	if(ring == ringing) return;
+	ringing = ring;
+
+	if(ringing){
+		phone.findPhoneStart();
+		ringTime = millis();
+		ringState = true;
+		lv_label_set_text_static(hint, "Ringing...");
+	}else{
+		phone.findPhoneStop();
+		lv_label_set_text_static(hint, phone.getPhoneType() == Phone::PhoneType::Android ? "Select: ring" : "");
+	}
+}
+
+void FindPhone::handleRing(){
+	if(!ringing) return;
+
+	if(millis() - ringTime >= RingPeriod){
+		ringTime = millis();
+		ringState = !ringState;
+		ringState ? phone.findPhoneStart() : phone.findPhoneStop();
+	}
+}
+
+void FindPhone::sample(){
+	const uint64_t now = millis();
+
+	const auto link = ConMan.getLink();
+	if(link.rssiReads != lastReads){
+		lastReads = link.rssiReads;
+		show(link.rssi);
+	}
+
+	if(phone.getPhoneType() == Phone::PhoneType::None){
+		if(primed){
+			primed = false;
+			lv_label_set_text_static(levelLabel, "Not connected");
+			lv_label_set_text_static(rssiLabel, "- dBm");
+			lv_bar_set_value(bar, 0, LV_ANIM_OFF);
+		}
+		return;
+	}
+
+	const uint32_t interval = now - levelChanged < FastHold ? FastInterval : SlowInterval;
+	if(now - lastRead < interval) return;
+	lastRead = now;
+	ConMan.readRSSI();
+}
+
+void FindPhone::show(float rssi){
+	if(!primed){
+		primed = true;
+		median.reset(rssi);
+		smooth.reset(rssi);
+		showLevel(level.reset(rssi));
+	}
+
+	const float value = smooth.update(median.update(rssi));
+
+	snprintf(rssiText, sizeof(rssiText), "%d dBm", (int) std::lround(value));
+	lv_label_set_text_static(rssiLabel, rssiText);
+
+	const auto prev = level.get();
+	if(level.update(value) != prev){
+		showLevel(level.get());
+	}
+}
+
+void FindPhone::showLevel(size_t index){
+	levelChanged = millis();
+
+	lv_label_set_text_static(levelLabel, LevelTexts[index]);
+	lv_obj_set_style_text_color(levelLabel, LevelColors[index], 0);
+	lv_obj_set_style_bg_color(bar, LevelColors[index], LV_PART_INDICATOR);
+	lv_bar_set_value(bar, index + 1, LV_ANIM_ON);
+}
@@ -0,0 +1,65 @@
+#ifndef CLOCKSTAR_FIRMWARE_FINDPHONE_H
+#define CLOCKSTAR_FIRMWARE_FINDPHONE_H
+
+#include "LV_Interface/LVScreen.h"
+#include "Notifs/Phone.h"
+#include "Util/Events.h"
+#include "Util/DSP.h"
+
+/**
+ * Hot/cold finder for the connected phone, opened from the main menu and left with Alt. The connection's RSSI is read
+ * every SlowInterval while it holds steady, and every FastInterval for FastHold after the shown level changed, when
+ * the wearer is likely walking around. A median drops the single-packet fades, an EMA smooths what's left and the
+ * hysteresis keeps the level from flickering at its edges.
+ *
+ * Android phones can be rung as well, Select toggles it. The ring is resent every RingPeriod, on and off again.
+ */
+class FindPhone : public LVScreen {
+public:
+	FindPhone();
+	~FindPhone() override;
+
+private:
+	Phone& phone;
+	EventQueue queue;
+
+	lv_obj_t* title;
+	lv_obj_t* levelLabel;
+	lv_obj_t* bar;
+	lv_obj_t* rssiLabel;
+	lv_obj_t* hint;
+	char rssiText[12] = {};
+
+	static constexpr uint32_t SlowInterval = 1000; // [ms]
+	static constexpr uint32_t FastInterval = 250; // [ms]
+	static constexpr uint32_t FastHold = 4000; // [ms]
+
+	DSP::Median<float, 5> median;
+	DSP::EMA<float> smooth{ 0.35f };
+	static constexpr size_t Levels = 5;
+	DSP::Hysteresis<float, Levels> level{ { -100, -88, -78, -69, -60, -20 }, 2 }; // [dBm]
+	bool primed = false;
+
+	uint64_t lastRead = 0; // [ms]
+	uint64_t levelChanged = 0; // [ms]
+	uint32_t lastReads = 0; // ConMan's count of finished reads at the last sample
+
+	bool ringing = false;
+	bool ringState = false;
+	uint64_t ringTime = 0; // [ms]
+	static constexpr uint32_t RingPeriod = 1000; // [ms]
+	void setRing(bool ring);
+	void handleRing();
+
+	void sample();
+	void show(float rssi);
+	void showLevel(size_t index);
+
+	void onStarting() override;
+	void onStop() override;
+	void loop() override;
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_FINDPHONE_H
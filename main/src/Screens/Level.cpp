@@ -1,22 +1,30 @@
 #include "Level.h"
 #include <algorithm>
-#include <vec2.hpp>
 #include <geometric.hpp>
+#include <common.hpp>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include "../Util/Services.h"
 #include "Devices/Input.h"
 #include "Screens/MainMenu/MainMenu.h"
-#include "LV_Interface/FSLVGL.h"
 #include "Services/SleepMan.h"
 
-Level::Level() : imu((IMU*) Services.get(Service::IMU)), reader([this](){ readerFunc(); }, "reader", 2048, 5, 1), data(QueueSize),
-				 pitchFilter(filterStrength), rollFilter(filterStrength), queue(4){
-	FSLVGL::addToCache("/level/bg.bin");
-
+static constexpr const char* AssetPaths[] = {
+		"S:/level/bg.bin",
+		"S:/level/bubbleCenter.bin",
+		"S:/level/bubbleHorizontal.bin",
+		"S:/level/bubbleVertical.bin",
+		"S:/level/markingsCenter.bin",
+		"S:/level/markingsHorizontal.bin",
+		"S:/level/markingsVertical.bin"
+};
+const LVScreen::AssetList Level::Assets = { AssetPaths, sizeof(AssetPaths) / sizeof(AssetPaths[0]) };
+
+Level::Level() : queue(4, "Level"){
 	bg = lv_obj_create(*this);
 	lv_obj_set_pos(bg, 0, 0);
 	lv_obj_set_size(bg, 128, 128);
-	lv_obj_set_style_bg_img_src(bg, "S:/level/bg.bin", LV_STATE_DEFAULT);
+	setStaticBackground(bg, "S:/level/bg.bin");
 
 	bubbleCenter = lv_img_create(bg);
 	lv_img_set_src(bubbleCenter, "S:/level/bubbleCenter.bin");
@@ -40,7 +48,6 @@ Level::Level() : imu((IMU*) Services.get(Service::IMU)), reader([this](){ reader
 }
 
 Level::~Level(){
-	FSLVGL::removeFromCache("/level/bg.bin");
 }
 
 void Level::setOrientation(double pitch, double roll){
@@ -56,11 +63,23 @@ void Level::setOrientation(double pitch, double roll){
 	if(glm::length(centerVec) > CenterConstr){
 		centerVec *= (CenterConstr / glm::length(centerVec));
 	}
-
-	lv_obj_set_pos(bubbleCenter, (int16_t) (CenterPos + centerVec.x), (int16_t) (CenterPos + centerVec.y));
-	lv_obj_set_x(bubbleHorizontal, horizontalX);
-	lv_obj_set_y(bubbleVertical, verticalY);
-
+	const auto centerX = (int16_t) (CenterPos + centerVec.x);
+	const auto centerY = (int16_t) (CenterPos + centerVec.y);
+
+	// Setting a position restyles and invalidates the object even if it didn't move
+	if(centerX != shown.centerX || centerY != shown.centerY){
+		lv_obj_set_pos(bubbleCenter, centerX, centerY);
+		shown.centerX = centerX;
+		shown.centerY = centerY;
+	}
+	if(horizontalX != shown.horizontalX){
+		lv_obj_set_x(bubbleHorizontal, horizontalX);
+		shown.horizontalX = horizontalX;
+	}
+	if(verticalY != shown.verticalY){
+		lv_obj_set_y(bubbleVertical, verticalY);
+		shown.verticalY = verticalY;
+	}
 }
 
 void Level::loop(){
@@ -69,54 +88,92 @@ void Level::loop(){
 		if(evt.facility == Facility::Input){
 			auto eventData = (Input::Data*) evt.data;
 			if(eventData->btn == Input::Alt && eventData->action == Input::Data::Press){
-				free(evt.data);
-				transition([](){ return std::make_unique<MainMenu>(); });
+				transition<MainMenu>();
 				return;
 			}
 		}
-		free(evt.data);
 	}
 
-	PitchRoll sample{};
-	if(!data.get(sample, 0)){
+	if(!orientation) return;
+
+	const auto state = orientation->get();
+	if(state.time == 0) return; // Bubbles stay centered until the first fused batch
+
+	const uint64_t now = esp_timer_get_time();
+	updateMotion(state, now);
+	setOrientation(motion.pos.y, motion.pos.x);
+
+	// Polled slowly while the device is held still, a change in tilt still shows within 1 / StillFps
+	const bool settled = glm::length(motion.pos - motion.target) < StillDistance && glm::length(motion.rate) < StillRate;
+	if(!settled){
+		stillSince = 0;
+		setFrameRate(MovingFps);
+	}else if(stillSince == 0){
+		stillSince = now;
+	}else if(now - stillSince >= StillTime){
+		setFrameRate(StillFps);
+	}
+}
+
+void Level::updateMotion(const Orientation::State& state, uint64_t now){
+	const glm::vec2 measured = {
+			std::clamp(-state.gravity.x, (float) -AngleConstraint, (float) AngleConstraint),
+			std::clamp(-state.gravity.y, (float) -AngleConstraint, (float) AngleConstraint)
+	};
+
+	if(lastUpdate == 0){
+		motion = { measured, {}, measured, {} };
+		lastUpdate = state.time;
+		lastLoop = now;
 		return;
 	}
 
-	setOrientation(sample.pitch, sample.roll);
+	if(state.time != lastUpdate){
+		const float interval = (float) (state.time - lastUpdate) / 1000000.0f;
+		motion.rate = (measured - motion.target) / interval;
+		motion.target = measured;
+		lastUpdate = state.time;
+	}
+
+	const float dt = std::min((float) (now - lastLoop) / 1000000.0f, MaxStep);
+	lastLoop = now;
+
+	const float age = now > state.time ? std::min((float) (now - state.time) / 1000000.0f, MaxPredict) : 0.0f;
+	auto predicted = motion.target + motion.rate * age;
+	predicted = glm::clamp(predicted, glm::vec2((float) -AngleConstraint), glm::vec2((float) AngleConstraint));
+
+	// Critically damped, reaches the target as fast as possible without overshooting
+	motion.vel += (SpringOmega * SpringOmega * (predicted - motion.pos) - 2.0f * SpringOmega * motion.vel) * dt;
+	motion.pos += motion.vel * dt;
 }
 
 void Level::onStart(){
-	auto sleep = (SleepMan*) Services.get(Service::Sleep);
+	auto sleep = Services.get<Service::Sleep>();
 	sleep->enAutoSleep(false);
 
-	if(imu == nullptr){
-		ESP_LOGE("Level", "IMU service error\n");
+	if(!orientation){
+		ESP_LOGE("Level", "Orientation service error\n");
 		return;
 	}
-	reader.start();
 	Events::listen(Facility::Input, &queue);
 }
 
 void Level::onStarting(){
-	const IMU::Sample reading = imu->getSample();
-	const PitchRoll pitchRoll = { -reading.accelY, -reading.accelX };
-	pitchFilter.reset(pitchRoll.pitch);
-	rollFilter.reset(pitchRoll.roll);
-	setOrientation(pitchRoll.pitch, pitchRoll.roll);
-}
+	if(!orientation) return;
 
-void Level::readerFunc(){
-	const IMU::Sample reading = imu->getSample();
-	PitchRoll pitchRoll = { pitchFilter.update(-reading.accelY), rollFilter.update(-reading.accelX) };
-	data.post(pitchRoll);
-
-	vTaskDelay(ReaderDelay);
+	// Bubbles stay centered until the first fused batch arrives, ~40 ms after acquiring
+	orientation->acquire();
+	lastUpdate = 0;
+	stillSince = 0;
+	setFrameRate(MovingFps);
 }
 
 void Level::onStop(){
-	reader.stop();
+	if(orientation){
+		orientation->release();
+	}
 	Events::unlisten(&queue);
 
-	auto sleep = (SleepMan*) Services.get(Service::Sleep);
+	auto sleep = Services.get<Service::Sleep>();
 	sleep->enAutoSleep(true);
 }
@@ -3,9 +3,11 @@
 
 #include "../LV_Interface/LVScreen.h"
 #include "../LV_Interface/LVStyle.h"
-#include "../Util/EMA.h"
-#include "../Devices/IMU.h"
+#include "../Services/Orientation.h"
 #include "Util/Events.h"
+#include "Util/Services.h"
+#include <vec2.hpp>
+#include <climits>
 
 class Level : public LVScreen {
 public:
@@ -14,6 +16,8 @@ public:
 
 	void setOrientation(double pitch, double roll);
 
+	static const AssetList Assets;
+
 private:
 	lv_obj_t* bg;
 	lv_obj_t* markingsHorizontal, * markingsCenter, * markingsVertical;
@@ -24,28 +28,36 @@ private:
 		uint8_t max;
 	};
 
-	IMU* imu;
+	ServiceHold<Service::Orientation> orientation;
+	uint64_t lastUpdate = 0; // [us], time of the last fused orientation taken in
+	uint64_t lastLoop = 0; // [us]
+
+	/**
+	 * Bubbles follow the measured tilt through a critically damped spring, aimed at where the tilt is predicted to be
+	 * now from its last rate of change, which hides the fusion latency without overshooting on noise.
+	 * Tilt is in [-AngleConstraint, AngleConstraint], x is roll and y is pitch.
+	 */
+	struct Motion {
+		glm::vec2 target; // Last measured tilt
+		glm::vec2 rate; // [1/s] of the measured tilt
+		glm::vec2 pos; // Shown tilt
+		glm::vec2 vel; // [1/s] of the shown tilt
+	} motion{};
+	void updateMotion(const Orientation::State& state, uint64_t now);
+
+	// Pixel positions currently set, bubbles are only moved when they change
+	struct {
+		int16_t centerX, centerY;
+		int16_t horizontalX;
+		int16_t verticalY;
+	} shown{ INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN };
+
+	uint64_t stillSince = 0; // [us], 0 while the bubbles are moving
 	void loop() override;
 	void onStart() override;
 	void onStop() override;
 	void onStarting() override;
 
-	ThreadedClosure reader;
-	void readerFunc();
-
-	static constexpr TickType_t ReaderDelay = 40 / portTICK_PERIOD_MS;
-
-	struct PitchRoll {
-		double pitch;
-		double roll;
-	};
-	Queue<PitchRoll> data;
-	static constexpr int QueueSize = 10;
-
-	EMA pitchFilter;
-	EMA rollFilter;
-	static constexpr float filterStrength = 0.2;
-
 	EventQueue queue;
 
 	static constexpr Constraint VerticalConstr = { 10, 73 };
@@ -54,6 +66,15 @@ private:
 	static constexpr int8_t CenterPos = 40;
 	static constexpr double AngleConstraint = 0.5f;
 
+	static constexpr float SpringOmega = 18.0f; // [rad/s], stiffness of the bubble spring
+	static constexpr float MaxPredict = 0.06f; // [s] of extrapolation past the last fused sample
+	static constexpr float MaxStep = 0.05f; // [s] of simulated motion per loop, after a stall the bubble doesn't jump
+	static constexpr float StillDistance = 0.004f; // Tilt from the target under which the bubbles count as settled, well under a pixel
+	static constexpr float StillRate = 0.02f; // [1/s]
+	static constexpr uint32_t StillTime = 500000; // [us] settled until dropping to StillFps
+	static constexpr uint8_t MovingFps = 50;
+	static constexpr uint8_t StillFps = 10;
+
 };
 
 #endif //CLOCKSTAR_FIRMWARE_LEVEL_H
@@ -1,14 +1,11 @@
 #include "CtrlItem.h"
+#include "Theme/styles.h"
 
 CtrlItem::CtrlItem(lv_obj_t* parent, const char* desel, const char* sel) : LVObject(parent), desel(desel), sel(sel){
 	lv_obj_set_flex_align(*this, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
 	lv_obj_set_size(*this, lv_pct(50), LV_SIZE_CONTENT);
-	lv_obj_set_style_radius(*this, 3, 0);
-	lv_obj_set_style_pad_ver(*this, 4, 0);
-
-	lv_obj_set_style_bg_color(*this, lv_color_white(), 0);
-	lv_obj_set_style_bg_opa(*this, LV_OPA_0, 0);
-	lv_obj_set_style_bg_opa(*this, LV_OPA_20, LV_STATE_FOCUSED);
+	lv_obj_add_style(*this, Styles::get(Styles::CtrlItem), 0);
+	lv_obj_add_style(*this, Styles::get(Styles::CtrlItemFocused), LV_STATE_FOCUSED);
 
 	icon = lv_img_create(*this);
 	lv_obj_set_size(icon, 10, 10);
@@ -1,20 +1,15 @@
 #include "Item.h"
-#include <regex>
+#include "Theme/styles.h"
 
-LVStyle Item::standard;
-LVStyle Item::focused;
-bool Item::styleInited = false;
-
-Item::Item(lv_obj_t* parent, std::function<void()> dismiss) : LVSelectable(parent), onDismiss(dismiss){
-	initStyle();
 
+Item::Item(lv_obj_t* parent, std::function<void(uint32_t uid)> dismiss, std::function<void(uint32_t uid)> open) : LVSelectable(parent), onDismiss(dismiss), onOpen(open){
 	lv_obj_set_size(*this, lv_pct(100), LV_SIZE_CONTENT);
 	lv_obj_set_flex_flow(*this, LV_FLEX_FLOW_COLUMN);
 
 	lv_obj_add_flag(*this, LV_OBJ_FLAG_CLICKABLE);
 
-	lv_obj_add_style(*this, standard, LV_STATE_DEFAULT);
-	lv_obj_add_style(*this, focused, LV_STATE_FOCUSED);
+	lv_obj_add_style(*this, Styles::get(Styles::NotifItem), LV_STATE_DEFAULT);
+	lv_obj_add_style(*this, Styles::get(Styles::NotifItemFocused), LV_STATE_FOCUSED);
 
 	top = lv_obj_create(*this);
 	lv_obj_set_size(top, lv_pct(100), 11);
@@ -30,17 +25,15 @@ Item::Item(lv_obj_t* parent, std::function<void()> dismiss) : LVSelectable(paren
 	label = lv_label_create(top);
 	lv_obj_set_flex_grow(label, 1);
 	lv_obj_set_size(label, lv_pct(100), LabelHeight);
-	lv_obj_set_style_pad_left(label, 4, 0);
+	lv_obj_add_style(label, Styles::get(Styles::NotifTitle), 0);
 	lv_label_set_long_mode(label, LV_LABEL_LONG_SCROLL);
-	lv_obj_set_style_text_color(label, lv_color_make(244, 126, 27), 0);
 
 	bot = lv_obj_create(*this);
 	lv_obj_set_size(bot, lv_pct(100), LV_SIZE_CONTENT);
 
 	body = lv_label_create(bot);
 	lv_obj_set_size(body, lv_pct(100), LabelHeight);
-	lv_obj_set_style_max_height(body, 34, 0);
-	lv_obj_set_style_pad_hor(body, 2, 0);
+	lv_obj_add_style(body, Styles::get(Styles::NotifBody), 0);
 	lv_label_set_long_mode(body, LV_LABEL_LONG_DOT);
 
 	lv_obj_add_event_cb(*this, [](lv_event_t* evt){
@@ -63,6 +56,10 @@ Item::Item(lv_obj_t* parent, std::function<void()> dismiss) : LVSelectable(paren
 		auto item = static_cast<Item*>(evt->user_data);
 		lv_label_set_long_mode(item->label, LV_LABEL_LONG_SCROLL);
 		lv_label_set_long_mode(item->body, LV_LABEL_LONG_SCROLL);
+
+		if(item->onOpen){
+			item->onOpen(item->uid);
+		}
 	}, LV_EVENT_FOCUSED, this);
 
 	lv_obj_add_event_cb(*this, [](lv_event_t* evt){
@@ -77,19 +74,33 @@ Item::Item(lv_obj_t* parent, std::function<void()> dismiss) : LVSelectable(paren
 }
 
 void Item::update(const Notif& notif){
-	iPath = ::iconPath(notif);
-	lv_img_set_src(icon, iPath);
+	uid = notif.uid;
+
+	const auto id = notifIcon(notif);
+	if(id != iconId){
+		iconId = id;
+		lv_img_set_src(icon, ::iconPath(id));
+	}
 
 	lv_label_set_text(label, notif.title.c_str());
 
-	auto copy = notif.message;
-	copy = std::regex_replace(copy, std::regex("\\n"), "  ");
+	// Newlines become two spaces, the preview is a single line
+	std::string copy;
+	copy.reserve(notif.message.size() + 8);
+	for(const char c : notif.message){
+		if(c == '\n') copy += "  ";
+		else copy += c;
+	}
 
 	lv_label_set_text(body, copy.c_str());
 }
 
-const char* Item::iconPath(){
-	return iPath;
+uint32_t Item::getUid() const{
+	return uid;
+}
+
+NotifIcon Item::getIcon() const{
+	return iconId;
 }
 
 void Item::createControls(){
@@ -116,7 +127,7 @@ void Item::createControls(){
 		item->deselect();
 
 		auto dismiss = item->onDismiss;
-		dismiss();
+		dismiss(item->uid);
 	}, LV_EVENT_CLICKED, this);
 
 	lv_group_add_obj(inputGroup, *del);
@@ -134,31 +145,3 @@ void Item::delControls(){
 	del = canc = nullptr;
 }
 
-void Item::initStyle(){
-	if(styleInited) return;
-	styleInited = true;
-
-	lv_style_set_radius(standard, 3);
-	lv_style_set_pad_top(standard, 2);
-	lv_style_set_pad_bottom(standard, 3);
-	lv_style_set_pad_hor(standard, 3);
-	lv_style_set_pad_gap(standard, 4);
-
-	lv_style_set_border_width(standard, 1);
-	lv_style_set_border_color(standard, lv_color_white());
-	lv_style_set_border_opa(standard, 40);
-
-	lv_style_set_bg_color(focused, lv_color_white());
-	lv_style_set_bg_opa(focused, 40);
-	lv_style_set_border_opa(focused, LV_OPA_0);
-
-	lv_style_set_radius(focused, 3);
-	lv_style_set_pad_top(focused, 2);
-	lv_style_set_pad_bottom(focused, 3);
-	lv_style_set_pad_hor(focused, 3);
-	lv_style_set_pad_gap(focused, 4);
-
-	lv_style_set_border_width(focused, 1);
-	lv_style_set_border_color(focused, lv_color_white());
-	lv_style_set_border_opa(focused, 40);
-}
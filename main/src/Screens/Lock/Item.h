@@ -3,26 +3,22 @@
 
 
 #include <functional>
-#include "LV_Interface/LVStyle.h"
 #include "LV_Interface/LVSelectable.h"
 #include "Notifs/Notif.h"
 #include "CtrlItem.h"
 
 class Item : public LVSelectable {
 public:
-	Item(lv_obj_t* parent, std::function<void()> dismiss);
+	Item(lv_obj_t* parent, std::function<void(uint32_t uid)> dismiss, std::function<void(uint32_t uid)> open = {});
 
+	/** Binds the item to notif, items are recycled for other notifs as the list scrolls */
 	void update(const Notif& notif);
-	const char* iconPath();
+	uint32_t getUid() const;
+	NotifIcon getIcon() const;
 
 private:
-	static LVStyle standard;
-	static LVStyle focused;
-
-	static bool styleInited;
-	static void initStyle();
-
-	const char* iPath = nullptr;
+	uint32_t uid = 0;
+	NotifIcon iconId = NotifIcon::COUNT;
 
 	lv_obj_t* top;
 	lv_obj_t* icon;
@@ -38,7 +34,8 @@ private:
 	void createControls();
 	void delControls();
 
-	const std::function<void()> onDismiss;
+	const std::function<void(uint32_t uid)> onDismiss;
+	const std::function<void(uint32_t uid)> onOpen;
 
 	static constexpr uint8_t LabelHeight = 8;
 };
@@ -1,19 +1,25 @@
 #include "LockScreen.h"
 #include "Util/Services.h"
 #include "Theme/theme.h"
+#include "Theme/styles.h"
 #include "Services/Time.h"
 #include "Util/stdafx.h"
 #include "Screens/MainMenu/MainMenu.h"
 #include "Services/SleepMan.h"
 #include "LV_Interface/FSLVGL.h"
 #include "LV_Interface/InputLVGL.h"
+#include <algorithm>
+
+LockScreen::LockScreen() : ts(*(Services.get<Service::Time>())), phone(*(Services.get<Service::Phone>())), queue(24, "LockScreen"){
+	queue.coalesce<Time::Event>(Facility::Time, Time::Event::Updated);
 
-LockScreen::LockScreen() : ts(*((Time*) Services.get(Service::Time))), phone(*((Phone*) Services.get(Service::Phone))), queue(24){
 	notifs.reserve(MaxNotifs);
-	notifIcons.reserve(MaxIconsCount);
 
 	buildUI();
 
+	// Kept over sleep and while apps run, resuming only brings the time and notifs up to date
+	setPersistent(true);
+
 	lv_obj_add_event_cb(main, [](lv_event_t* evt){
 		auto scr = static_cast<LockScreen*>(evt->user_data);
 		scr->setSleep(true);
@@ -44,7 +50,7 @@ void LockScreen::onStop(){
 }
 
 void LockScreen::setSleep(bool en){
-	auto sleep = (SleepMan*) Services.get(Service::Sleep);
+	auto sleep = Services.get<Service::Sleep>();
 	if(!sleep) return;
 	sleep->enAltLock(en);
 }
@@ -55,28 +61,23 @@ void LockScreen::prepare(){
 	lv_group_focus_obj(main);
 
 	locker->hide();
-	status->loop();
-	clock->loop();
+	face->loop();
 	updateTime(ts.getTime());
 	queue.reset();
 	updateNotifs();
+	rewind();
+	syncIcons();
 }
 
 void LockScreen::loop(){
 	locker->loop();
 	if(locker->t() >= 1){
 		locker->loop();
-		transition([](){ return std::make_unique<MainMenu>(); });
+		transition<MainMenu>();
 		return;
 	}
 
-	status->loop();
-
-	clock->loop();
-
-	if(millis() - lastTimeUpdate > TimeUpdateInterval){
-		updateTime(ts.getTime());
-	}
+	face->loop();
 
 	Event evt;
 	while(queue.get(evt, 0)){
@@ -92,8 +93,13 @@ void LockScreen::loop(){
 			auto data = (Input::Data*) evt.data;
 			processInput(*data);
 		}
-		free(evt.data);
 	}
+
+	syncWindow();
+	syncIcons();
+
+	// The slider moves from here while it's sliding, otherwise only events and its hide timeout are left
+	setLoopPeriod(locker->started() ? 0 : IdleLoopPeriod);
 }
 
 void LockScreen::processInput(const Input::Data& evt){
@@ -116,198 +122,296 @@ void LockScreen::processInput(const Input::Data& evt){
 }
 
 void LockScreen::processEvt(const Phone::Event& evt){
-	if(evt.action == Phone::Event::Added || evt.action == Phone::Event::Changed){
-		auto notif = phone.getNotif(evt.data.addChgRem.id);
-		notifAdd(notif);
-	}else if(evt.action == Phone::Event::Removed){
-		notifRem(evt.data.addChgRem.id);
+	if(evt.action == Phone::Event::Notifs){
+		updateNotifs();
 	}else if(evt.action == Phone::Event::Cleared){
 		notifsClear();
 	}
 }
 
 void LockScreen::updateNotifs(){
-	const auto set = phone.getNotifs();
-	auto find = [&set](uint32_t uid) -> const Notif*{
-		for(auto& notif : set){
-			if(notif.uid == uid) return &notif;
-		}
-		return nullptr;
-	};
+	const auto& store = phone.getNotifs();
+	if(store.generation() == notifsGen) return;
 
-	std::unordered_set<uint32_t> forRem;
+	// Gone while the screen wasn't listening, or dropped from the store to make room
+	std::vector<uint32_t> forRem;
 	for(const auto& pair : notifs){
-		auto exists = find(pair.first);
-		if(!exists){
-			forRem.insert(pair.first);
+		if(!store.contains(pair.first)){
+			forRem.push_back(pair.first);
 		}
 	}
 	for(uint32_t uid : forRem){
 		notifRem(uid);
 	}
 
-	for(const auto& notif : set){
-		if(notifs.count(notif.uid) == 0){
+	for(uint32_t uid : store.changedSince(notifsGen, notifsGen)){
+		Notif notif;
+		if(store.get(uid, notif)){
 			notifAdd(notif);
 		}
 	}
 }
 
 void LockScreen::notifAdd(const Notif& notif){
-	bool isModify = true;
-
-	if(notifs.count(notif.uid) == 0){
-		if(notifs.size() >= MaxNotifs) return;
-
-		isModify = false;
-
-		auto uid = notif.uid;
-		auto item = new Item(rest, [this, uid](){
-			notifRem(uid);
-			phone.doNeg(uid);
-		});
-
-		bool itemActive = false;
-		if(InputLVGL::getInstance()->getIndev()->group != inputGroup){
-			itemActive = true;
+	const auto icon = notifIcon(notif);
+
+	auto it = notifs.find(notif.uid);
+	if(it != notifs.end()){
+		if(icon != it->second){
+			removeNotifIcon(it->second);
+			addNotifIcon(icon);
+			it->second = icon;
 		}
 
-		auto focused = lv_group_get_focused(inputGroup);
-		lv_obj_move_to_index(*item, 0);
-		lv_group_remove_all_objs(inputGroup);
-		lv_group_add_obj(inputGroup, main);
-		for(int j = 0; j < lv_obj_get_child_cnt(rest); ++j){
-			lv_group_add_obj(inputGroup, lv_obj_get_child(rest, j));
+		if(auto item = findItem(notif.uid)){
+			item->update(notif);
 		}
+		return;
+	}
 
-		lv_group_focus_obj(focused);
-		if(itemActive){
-			lv_event_send(focused, LV_EVENT_CLICKED, nullptr);
-		}
+	if(notifs.size() >= MaxNotifs) return;
 
-		lv_obj_add_flag(*item, LV_OBJ_FLAG_SCROLL_ON_FOCUS);
-		lv_obj_add_flag(*item, LV_OBJ_FLAG_SCROLL_CHAIN_VER);
+	notifs.insert({ notif.uid, icon });
+	addNotifIcon(icon);
+	order.insert(order.begin(), notif.uid);
 
-		notifs.insert(std::make_pair(notif.uid, item));
+	// Newest go on top, so it's only bound while the window is there. The focused item isn't taken from under the user.
+	if(first > 0 || (poolUsed == PoolSize && lv_group_get_focused(inputGroup) == *pool[PoolSize - 1])){
+		first++;
+		return;
+	}
 
-		addNotifIcon(iconPath(notif));
+	if(poolUsed < PoolSize){
+		pool[poolUsed++] = createItem();
 	}
 
-	auto el = notifs[notif.uid];
+	auto item = pool[poolUsed - 1];
+	std::rotate(pool.begin(), pool.begin() + poolUsed - 1, pool.begin() + poolUsed);
+	item->update(notif);
+	lv_obj_move_to_index(*item, 0);
 
-	if(isModify){
-		removeNotifIcon(el->iconPath());
-		addNotifIcon(iconPath(notif));
-	}
-	el->update(notif);
+	regroup();
 }
 
 void LockScreen::notifRem(uint32_t id){
 	auto it = notifs.find(id);
 	if(it == notifs.end()) return;
-	auto& el = it->second;
-
-	removeNotifIcon(el->iconPath());
-	lv_group_focus_next(inputGroup);
 
-	lv_obj_del(*el);
+	removeNotifIcon(it->second);
 	notifs.erase(it);
+
+	const auto pos = std::find(order.begin(), order.end(), id);
+	if(pos == order.end()) return;
+	const size_t index = pos - order.begin();
+	order.erase(pos);
+
+	if(index < first){
+		first--;
+		return;
+	}
+	if(index >= first + poolUsed) return;
+
+	const size_t row = index - first;
+	auto item = pool[row];
+	if(lv_group_get_focused(inputGroup) == *item){
+		lv_group_focus_next(inputGroup);
+	}
+
+	// The freed item takes the next unbound notif below, or above, and is deleted only once all of them are bound
+	if(first + poolUsed - 1 < order.size()){
+		std::rotate(pool.begin() + row, pool.begin() + row + 1, pool.begin() + poolUsed);
+		bind(item, order[first + poolUsed - 1]);
+		lv_obj_move_to_index(*item, -1);
+	}else if(first > 0){
+		std::rotate(pool.begin(), pool.begin() + row, pool.begin() + row + 1);
+		first--;
+		bind(item, order[first]);
+		lv_obj_move_to_index(*item, 0);
+	}else{
+		std::rotate(pool.begin() + row, pool.begin() + row + 1, pool.begin() + poolUsed);
+		pool[--poolUsed] = nullptr;
+		lv_obj_del(*item);
+		return;
+	}
+
+	regroup();
 }
 
 void LockScreen::notifsClear(){
-	notifs.clear(); // This has to precede rest clearing
+	notifs.clear();
+	order.clear();
+	pool = {};
+	poolUsed = 0;
+	first = 0;
 	lv_obj_clean(rest);
 
-	notifIcons.clear();
-	lv_obj_clean(icons);
+	for(auto& slot : iconSlots){
+		slot.count = 0;
+	}
+	iconsDirty = true;
 }
 
+Item* LockScreen::createItem(){
+	auto item = new Item(rest, [this](uint32_t uid){
+		notifRem(uid);
+		phone.doNeg(uid);
+	}, [this](uint32_t uid){
+		phone.openNotif(uid);
+	});
 
-void LockScreen::addNotifIcon(const char* path){
-	if(path == nullptr) return;
+	lv_obj_add_flag(*item, LV_OBJ_FLAG_SCROLL_ON_FOCUS);
+	lv_obj_add_flag(*item, LV_OBJ_FLAG_SCROLL_CHAIN_VER);
 
-	if(notifIcons.count(path)){
-		notifIcons[path].count++;
-		return;
+	return item;
+}
+
+Item* LockScreen::findItem(uint32_t uid) const{
+	for(size_t i = 0; i < poolUsed; i++){
+		if(pool[i]->getUid() == uid) return pool[i];
 	}
+	return nullptr;
+}
 
-	if(notifIcons.size() >= MaxIconsCount) return;
+void LockScreen::bind(Item* item, uint32_t uid){
+	Notif notif;
+	if(!phone.getNotifs().get(uid, notif)) return; // Already gone from the store, the next updateNotifs() removes it
+	item->update(notif);
+}
 
+void LockScreen::regroup(){
+	bool itemActive = false;
+	if(InputLVGL::getInstance()->getIndev()->group != inputGroup){
+		itemActive = true;
+	}
 
-	lv_obj_t* icon = lv_img_create(icons);
-	lv_img_set_src(icon, path);
+	auto focused = lv_group_get_focused(inputGroup);
+	lv_group_remove_all_objs(inputGroup);
+	lv_group_add_obj(inputGroup, main);
+	for(int j = 0; j < lv_obj_get_child_cnt(rest); ++j){
+		lv_group_add_obj(inputGroup, lv_obj_get_child(rest, j));
+	}
 
-	NotifIcon notifIcon = { 1, icon };
-	notifIcons.insert({ path, notifIcon });
+	lv_group_focus_obj(focused);
+	if(itemActive){
+		lv_event_send(focused, LV_EVENT_CLICKED, nullptr);
+	}
 }
 
-void LockScreen::removeNotifIcon(const char* path){
-	if(path == nullptr) return;
+void LockScreen::rewind(){
+	if(first == 0) return;
 
-	auto pair = notifIcons.find(path);
-	if(pair == notifIcons.end()) return;
+	first = 0;
+	for(size_t i = 0; i < poolUsed; i++){
+		bind(pool[i], order[i]);
+	}
+}
 
-	pair->second.count -= 1;
-	if(pair->second.count > 0) return;
+void LockScreen::syncWindow(){
+	if(poolUsed == 0) return;
 
-	lv_obj_del(pair->second.icon);
-	notifIcons.erase(pair);
+	const auto focused = lv_group_get_focused(inputGroup);
+	if(focused == *pool[poolUsed - 1] && first + poolUsed < order.size()){
+		slide(true);
+	}else if(focused == *pool[0] && first > 0){
+		slide(false);
+	}
 }
 
-void LockScreen::updateTime(const tm& time){
-	lastTimeUpdate = millis();
+void LockScreen::slide(bool down){
+	const auto focused = lv_group_get_focused(inputGroup);
+	const lv_coord_t gap = lv_obj_get_style_pad_row(rest, LV_PART_MAIN);
+	const lv_coord_t scroll = lv_obj_get_scroll_y(rest);
+
+	auto item = down ? pool[0] : pool[poolUsed - 1];
+	const lv_coord_t leaving = lv_obj_get_height(*item) + gap;
+
+	if(down){
+		std::rotate(pool.begin(), pool.begin() + 1, pool.begin() + poolUsed);
+		bind(item, order[first + poolUsed]);
+		first++;
+		lv_obj_move_to_index(*item, -1);
+	}else{
+		std::rotate(pool.begin(), pool.begin() + poolUsed - 1, pool.begin() + poolUsed);
+		first--;
+		bind(item, order[first]);
+		lv_obj_move_to_index(*item, 0);
+	}
 
-	char dateText[128];
+	regroup();
 
-	static const char* Months[] = { "January", "February", "March", "April", "May", "June", "July", "August", "September", "October", "November", "December" };
-	const int dayLd = time.tm_mday - (time.tm_mday / 10) * 10;
-	const char* daySuff;
-	if(time.tm_mday == 11 || time.tm_mday == 12) daySuff = "th";
-	else if(dayLd == 1) daySuff = "st";
-	else if(dayLd == 2) daySuff = "nd";
-	else if(dayLd == 3) daySuff = "rd";
-	else daySuff = "th";
+	// Scroll by what moved above the focused item so nothing on screen jumps, then carry on towards the focused one
+	lv_obj_update_layout(rest);
+	const lv_coord_t arriving = lv_obj_get_height(*item) + gap;
+	lv_obj_scroll_to_y(rest, down ? scroll - leaving : scroll + arriving, LV_ANIM_OFF);
+	lv_obj_scroll_to_view(focused, LV_ANIM_ON);
+}
 
-	snprintf(dateText, sizeof(dateText), "%s %d%s, %d", Months[time.tm_mon % 12], time.tm_mday, daySuff, 1900 + time.tm_year);
+void LockScreen::addNotifIcon(NotifIcon icon){
+	if(icon >= NotifIcon::COUNT) return;
 
-	lv_label_set_text(date, dateText);
+	iconSlots[(size_t) icon].count++;
+	iconsDirty = true;
+}
+
+void LockScreen::removeNotifIcon(NotifIcon icon){
+	if(icon >= NotifIcon::COUNT) return;
+
+	auto& slot = iconSlots[(size_t) icon];
+	if(slot.count == 0) return;
+
+	slot.count--;
+	iconsDirty = true;
+}
+
+void LockScreen::syncIcons(){
+	if(!iconsDirty) return;
+	iconsDirty = false;
+	if(icons == nullptr) return;
+
+	// Only slots that appeared or emptied since the last sync touch LVGL, the row is laid out once on the next refresh
+	for(size_t i = 0; i < iconSlots.size(); i++){
+		auto& slot = iconSlots[i];
+		const bool show = slot.count > 0;
+		if(show == slot.shown) continue;
+		slot.shown = show;
+
+		if(!show){
+			lv_obj_add_flag(slot.icon, LV_OBJ_FLAG_HIDDEN);
+			continue;
+		}
+
+		if(slot.icon == nullptr){
+			slot.icon = lv_img_create(icons);
+			lv_img_set_src(slot.icon, iconPath((NotifIcon) i));
+		}else{
+			lv_obj_clear_flag(slot.icon, LV_OBJ_FLAG_HIDDEN);
+			lv_obj_move_to_index(slot.icon, -1); // Newly shown icons go last, as when they were created anew
+		}
+	}
+}
+
+void LockScreen::updateTime(const tm& time){
+	face->update(time);
 }
 
 void LockScreen::buildUI(){
 	lv_obj_add_flag(*this, LV_OBJ_FLAG_SCROLLABLE);
-	lv_obj_set_flex_flow(*this, LV_FLEX_FLOW_COLUMN);
 
+	// The two pages and the main page's top, middle and bottom are fixed, only their contents use flex layouts
 	main = lv_obj_create(*this);
 	lv_obj_set_size(main, 128, 128);
-	lv_obj_set_flex_flow(main, LV_FLEX_FLOW_COLUMN);
-	lv_obj_set_flex_align(main, LV_FLEX_ALIGN_SPACE_BETWEEN, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
-
-	status = new StatusBar(main, false);
+	lv_obj_set_pos(main, 0, 0);
 
-	mainMid = lv_obj_create(main);
-	lv_obj_set_size(mainMid, 128, LV_SIZE_CONTENT);
-	lv_obj_set_flex_flow(mainMid, LV_FLEX_FLOW_COLUMN);
-	lv_obj_set_flex_align(mainMid, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
-	lv_obj_set_style_pad_gap(mainMid, 2, 0);
+	// Placed by the face, the locker goes over it
+	face = std::make_unique<WatchFace>(main, FacePath);
+	icons = face->getNotifRow();
 
 	locker = new Slider(main);
-
-	clock = new ClockLabelBig(mainMid);
-
-	date = lv_label_create(mainMid);
-	lv_obj_set_size(date, 128, 10);
-	lv_obj_set_style_text_align(date, LV_TEXT_ALIGN_CENTER, 0);
-	lv_obj_set_style_pad_top(date, 2, 0);
-
-	icons = lv_obj_create(mainMid);
-	lv_obj_set_size(icons, 128, 11);
-	lv_obj_set_style_min_height(icons, 1, 0);
-	lv_obj_set_flex_flow(icons, LV_FLEX_FLOW_ROW);
-	lv_obj_set_flex_align(icons, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
-	lv_obj_set_style_pad_gap(icons, 2, 0);
+	lv_obj_align(*locker, LV_ALIGN_BOTTOM_MID, 0, 0);
 
 	rest = lv_obj_create(*this);
 	lv_obj_set_size(rest, 128, 128);
+	lv_obj_set_pos(rest, 0, 128);
 	lv_obj_set_flex_flow(rest, LV_FLEX_FLOW_COLUMN);
 	lv_obj_set_flex_align(rest, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
 	lv_obj_set_style_pad_hor(rest, 4, 0);
@@ -318,11 +422,13 @@ void LockScreen::buildUI(){
 
 	lv_obj_set_style_bg_color(main, lv_color_black(), 0);
 	lv_obj_set_style_bg_opa(main, LV_OPA_COVER, 0);
-	lv_obj_set_style_bg_img_src(main, "S:/bg.bin", 0);
+	if(auto bg = face->getBackground()){
+		setStaticBackground(main, bg);
+	}
 
 	lv_obj_set_style_bg_color(rest, lv_color_black(), 0);
 	lv_obj_set_style_bg_opa(rest, LV_OPA_COVER, 0);
-	lv_obj_set_style_bg_img_src(rest, "S:/bg_bot.bin", 0);
+	setStaticBackground(rest, "S:/bg_bot.bin");
 
 	// Scrolling
 
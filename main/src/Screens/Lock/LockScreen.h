@@ -6,10 +6,13 @@
 #include "Util/Events.h"
 #include "Notifs/Phone.h"
 #include "Services/Time.h"
-#include "UIElements/StatusBar.h"
 #include "Slider.h"
+#include "WatchFace.h"
 #include "Devices/Input.h"
-#include "UIElements/ClockLabelBig.h"
+#include <array>
+#include <vector>
+#include <unordered_map>
+#include <memory>
 
 class LockScreen : public LVScreen {
 public:
@@ -20,12 +23,8 @@ private:
 	/** Layout:
 	 *
 	 * - main
-	 * |-- mainTop
-	 * |-- mainMid
-	 * | |- clock
-	 * | |- date
-	 * | `- icons
-	 * `-- mainBot
+	 * |-- face layers, see WatchFace
+	 * `-- locker
 	 *
 	 * - rest
 	 * |-- item
@@ -35,12 +34,9 @@ private:
 
 	lv_obj_t* main;
 
-	lv_obj_t* mainTop;
-
-	lv_obj_t* mainMid;
-	ClockLabelBig* clock;
-	lv_obj_t* date;
-	lv_obj_t* icons;
+	static constexpr const char* FacePath = "S:/faces/default.wf";
+	std::unique_ptr<WatchFace> face;
+	lv_obj_t* icons; // The face's notification row, nullptr if it has none
 
 	Slider* locker;
 	lv_obj_t* playing;
@@ -48,21 +44,35 @@ private:
 
 	lv_obj_t* rest;
 
-	StatusBar* status;
-
 	Time& ts;
 	Phone& phone;
-	EventQueue queue;
-
-	static constexpr uint8_t MaxNotifs = 20;
-	std::unordered_map<uint32_t, Item*> notifs;
+	CoalescingEventQueue queue;
 
-	struct NotifIcon {
-		uint32_t count;
-		lv_obj_t* icon;
+	/**
+	 * Notifications are a recycled list. order holds every uid shown, newest first, but only up to PoolSize items
+	 * exist, bound to order[first] onwards. When focus reaches the first or last bound item, the window slides by one:
+	 * the item at the other end moves over and is rebound, so the LVGL cost doesn't grow with the backlog.
+	 */
+	static constexpr uint8_t MaxNotifs = NotifStore::Capacity;
+	static constexpr uint8_t PoolSize = 6; // Rows fitting in rest, plus one above and one below
+	std::unordered_map<uint32_t, NotifIcon> notifs; // Icon each shown notif counts towards
+	std::vector<uint32_t> order;
+	std::array<Item*, PoolSize> pool{}; // In the order of rest's children
+	size_t poolUsed = 0;
+	size_t first = 0; // Index in order of pool[0]
+	uint32_t notifsGen = 0; // Store generation the items were last synced to
+
+	/**
+	 * One slot per NotifIcon, counting the notifications showing it. Changes only touch the counts, syncIcons() applies
+	 * them to the row once per loop. Emptied icons are hidden rather than deleted, so they aren't decoded again.
+	 */
+	struct IconSlot {
+		uint8_t count;
+		bool shown;
+		lv_obj_t* icon; // Created when first shown
 	};
-	std::unordered_map<const char*, NotifIcon> notifIcons;
-	static constexpr uint8_t MaxIconsCount = MaxNotifs;
+	std::array<IconSlot, (size_t) NotifIcon::COUNT> iconSlots{};
+	bool iconsDirty = false;
 	static constexpr const char* EtcIconPath = "S:/icon/etc.bin";
 
 	void onStarting() override;
@@ -75,16 +85,23 @@ private:
 	void notifRem(uint32_t id);
 	void notifsClear();
 
-	void addNotifIcon(const char* path);
-	void removeNotifIcon(const char* path);
+	Item* createItem();
+	Item* findItem(uint32_t uid) const;
+	void bind(Item* item, uint32_t uid);
+	void regroup();
+	void rewind();
+	void syncWindow();
+	void slide(bool down);
+
+	void addNotifIcon(NotifIcon icon);
+	void removeNotifIcon(NotifIcon icon);
+	void syncIcons();
 
 	void loop() override;
 	void processEvt(const Phone::Event& evt);
 	void processInput(const Input::Data& evt);
 
 	void updateTime(const tm& time);
-	static constexpr uint32_t TimeUpdateInterval = 200;
-	uint64_t lastTimeUpdate = 0;
 
 	void buildUI();
 
@@ -0,0 +1,346 @@
+#include "WatchFace.h"
+#include "Theme/theme.h"
+#include "Theme/styles.h"
+#include "UIElements/StatusBar.h"
+#include "UIElements/ClockLabelBig.h"
+#include "LV_Interface/LVText.h"
+#include "LV_Interface/LVGL.h"
+#include "LV_Interface/FSLVGL.h"
+#include "Devices/Battery.h"
+#include "Notifs/Phone.h"
+#include "Services/Time.h"
+#include "Util/Services.h"
+#include "Util/RamFile.h"
+#include "Util/PSRAM.h"
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <cstring>
+#include <memory>
+
+static const char* TAG = "WatchFace";
+
+static constexpr uint32_t Magic = 0x46575343; // "CSWF"
+static constexpr uint8_t Version = 1;
+
+struct __attribute__((packed)) FileHeader {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t count; // Layers following the header, bottom first
+	uint16_t reserved;
+};
+static_assert(sizeof(FileHeader) == 8);
+
+struct __attribute__((packed)) WatchFace::Desc {
+	uint8_t kind;
+	uint8_t bind;
+	uint8_t align; // lv_align_t, within the parent
+	uint8_t pathLen; // [B] of the path following the layer, without a terminator
+	int16_t x, y; // [px]
+	uint8_t w, h; // [px], 0 sizes to content
+	uint16_t period; // [s] between refreshes, 0 on every Time update
+	uint8_t r, g, b;
+	uint8_t reserved;
+};
+
+// Used when the description is missing or broken, the same as faces/default.wf
+static constexpr struct {
+	uint8_t kind, bind, align;
+	int16_t x, y;
+	uint8_t w, h;
+	uint16_t period;
+	uint8_t r, g, b;
+	const char* path;
+} DefaultFace[] = {
+		{ (uint8_t) WatchFace::Kind::Image, 0, LV_ALIGN_TOP_LEFT, 0, 0, 0, 0, 0, 0, 0, 0, "S:/bg.bin" },
+		{ (uint8_t) WatchFace::Kind::Status, 0, LV_ALIGN_TOP_MID, 0, 0, 0, 0, 0, 0, 0, 0, "" },
+		{ (uint8_t) WatchFace::Kind::Clock, 0, LV_ALIGN_TOP_MID, 0, 41, 0, 0, 1, 0, 0, 0, "" },
+		{ (uint8_t) WatchFace::Kind::Text, (uint8_t) WatchFace::Bind::Date, LV_ALIGN_TOP_MID, 0, 65, 128, 0, 60, 207, 198, 184, "" },
+		{ (uint8_t) WatchFace::Kind::Notifs, 0, LV_ALIGN_TOP_MID, 0, 75, 128, 11, 0, 0, 0, 0, "" }
+};
+
+WatchFace::WatchFace(lv_obj_t* parent, const char* path) : parent(parent){
+	if(!load(path)){
+		ESP_LOGW(TAG, "Couldn't load %s, using the default face", path);
+		layers.clear();
+		loadDefault();
+	}
+	build();
+}
+
+WatchFace::~WatchFace(){
+	free(surface);
+}
+
+const char* WatchFace::getBackground() const{
+	return background;
+}
+
+lv_obj_t* WatchFace::getNotifRow() const{
+	return notifRow;
+}
+
+void WatchFace::loop(){
+	if(status){
+		status->loop();
+	}
+	if(clock){
+		clock->loop();
+	}
+}
+
+void WatchFace::update(const tm& time){
+	auto ts = Services.get<Service::Time>();
+	const time_t now = ts ? ts->now() : 0;
+
+	for(auto& layer : layers){
+		if(layer.kind != Kind::Text) continue;
+		if(layer.period != 0 && now < layer.due) continue;
+
+		// Due on the period's boundary, like the minute ticks it's refreshed from
+		if(layer.period != 0){
+			layer.due = now - now % layer.period + layer.period;
+		}
+		setText(layer, time);
+	}
+}
+
+bool WatchFace::load(const char* path){
+	static_assert(sizeof(Desc) == 16, "Desc is the stored layout, see tools/face_gen.py");
+
+	std::string spath("/spiffs");
+	spath.append(strchr(path, ':') ? path + 2 : path);
+
+	// Only read while the face is built, a bundled description isn't copied
+	std::unique_ptr<RamFile> file;
+	const auto asset = FSLVGL::getAsset(path);
+	if(asset.compressed()){
+		file = std::make_unique<RamFile>(spath.c_str(), asset.data, asset.size, asset.rawSize);
+	}else if(asset.data){
+		file = std::make_unique<RamFile>(spath.c_str(), asset.data, asset.size);
+	}else{
+		file = std::make_unique<RamFile>(spath.c_str());
+	}
+
+	const uint8_t* data = file->buffer();
+	const size_t size = file->size();
+	if(data == nullptr || size < sizeof(FileHeader)) return false;
+
+	FileHeader header;
+	memcpy(&header, data, sizeof(header));
+	if(header.magic != Magic || header.version != Version || header.count > MaxLayers){
+		ESP_LOGW(TAG, "%s isn't a face description of version %d", path, Version);
+		return false;
+	}
+
+	size_t offset = sizeof(FileHeader);
+	for(uint8_t i = 0; i < header.count; i++){
+		if(offset + sizeof(Desc) > size) return false;
+		Desc desc;
+		memcpy(&desc, data + offset, sizeof(desc));
+		offset += sizeof(Desc);
+
+		if(offset + desc.pathLen > size) return false;
+		if(desc.kind >= (uint8_t) Kind::COUNT || desc.bind >= (uint8_t) Bind::COUNT || desc.align > LV_ALIGN_CENTER) return false;
+		if(desc.kind == (uint8_t) Kind::Image && desc.pathLen == 0) return false;
+
+		add(desc, std::string((const char*) data + offset, desc.pathLen));
+		offset += desc.pathLen;
+	}
+
+	return true;
+}
+
+void WatchFace::loadDefault(){
+	for(const auto& def : DefaultFace){
+		const Desc desc = { def.kind, def.bind, def.align, (uint8_t) strlen(def.path), def.x, def.y, def.w, def.h, def.period,
+							def.r, def.g, def.b, 0 };
+		add(desc, def.path);
+	}
+}
+
+void WatchFace::add(const Desc& desc, std::string path){
+	layers.push_back({
+			(Kind) desc.kind,
+			(Bind) desc.bind,
+			(lv_align_t) desc.align,
+			desc.x, desc.y,
+			desc.w ? (lv_coord_t) desc.w : (lv_coord_t) LV_SIZE_CONTENT,
+			desc.h ? (lv_coord_t) desc.h : (lv_coord_t) LV_SIZE_CONTENT,
+			desc.period,
+			lv_color_make(desc.r, desc.g, desc.b),
+			std::move(path)
+	});
+}
+
+void WatchFace::build(){
+	size_t images = 0;
+	const Layer* first = nullptr;
+	for(const auto& layer : layers){
+		if(layer.kind != Kind::Image) continue;
+		if(images++ == 0){
+			first = &layer;
+		}
+	}
+
+	// A plain background needs no surface of its own, the screen keeps it in RAM anyway
+	lv_img_header_t header{};
+	const bool plain = images == 1 && first->x == 0 && first->y == 0 &&
+			(first->align == LV_ALIGN_DEFAULT || first->align == LV_ALIGN_TOP_LEFT) &&
+			lv_img_decoder_get_info(first->path.c_str(), &header) == LV_RES_OK && header.w == Size && header.h == Size;
+	if(plain){
+		background = first->path.c_str();
+	}else if(images > 0){
+		composite();
+	}
+
+	for(auto& layer : layers){
+		switch(layer.kind){
+			case Kind::Image:
+				continue;
+
+			case Kind::Text: {
+				lv_text_align_t textAlign = LV_TEXT_ALIGN_CENTER;
+				if(layer.align == LV_ALIGN_TOP_LEFT || layer.align == LV_ALIGN_LEFT_MID || layer.align == LV_ALIGN_BOTTOM_LEFT){
+					textAlign = LV_TEXT_ALIGN_LEFT;
+				}else if(layer.align == LV_ALIGN_TOP_RIGHT || layer.align == LV_ALIGN_RIGHT_MID || layer.align == LV_ALIGN_BOTTOM_RIGHT){
+					textAlign = LV_TEXT_ALIGN_RIGHT;
+				}
+
+				layer.text = new LVText(parent, "", &devin, layer.color, textAlign, Styles::TextLineSpace);
+				layer.obj = *layer.text;
+				if(layer.w != LV_SIZE_CONTENT){
+					lv_obj_set_width(layer.obj, layer.w);
+				}
+				if(layer.h != LV_SIZE_CONTENT){
+					lv_obj_set_height(layer.obj, layer.h);
+				}
+				break;
+			}
+
+			case Kind::Clock:
+				if(clock){
+					ESP_LOGW(TAG, "Only one clock per face, skipping");
+					continue;
+				}
+
+				// Under a minute the colon blinks, which takes a Time update every second
+				clock = new ClockLabelBig(parent, layer.period < 60);
+				layer.obj = *clock;
+				break;
+
+			case Kind::Status:
+				if(status){
+					ESP_LOGW(TAG, "Only one status bar per face, skipping");
+					continue;
+				}
+				status = new StatusBar(parent, false);
+				layer.obj = *status;
+				break;
+
+			case Kind::Notifs:
+				if(notifRow){
+					ESP_LOGW(TAG, "Only one notification row per face, skipping");
+					continue;
+				}
+				notifRow = lv_obj_create(parent);
+				lv_obj_set_size(notifRow, layer.w, layer.h);
+				lv_obj_set_style_min_height(notifRow, 1, 0);
+				lv_obj_set_flex_flow(notifRow, LV_FLEX_FLOW_ROW);
+				lv_obj_set_flex_align(notifRow, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
+				lv_obj_set_style_pad_gap(notifRow, 2, 0);
+				layer.obj = notifRow;
+				break;
+
+			default:
+				continue;
+		}
+
+		lv_obj_align(layer.obj, layer.align, layer.x, layer.y);
+	}
+}
+
+void WatchFace::composite(){
+	// The image layers are laid out as objects once, drawn into the surface and deleted again
+	auto stack = lv_obj_create(parent);
+	lv_obj_remove_style_all(stack);
+	lv_obj_set_size(stack, Size, Size);
+	lv_obj_set_pos(stack, 0, 0);
+
+	for(auto& layer : layers){
+		if(layer.kind != Kind::Image) continue;
+		layer.obj = lv_img_create(stack);
+		lv_img_set_src(layer.obj, layer.path.c_str());
+		lv_obj_align(layer.obj, layer.align, layer.x, layer.y);
+	}
+	lv_obj_update_layout(stack);
+
+	constexpr size_t bytes = Size * Size * sizeof(lv_color_t);
+	surface = (lv_color_t*) heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if(surface == nullptr && PSRAM::available()){
+		surface = (lv_color_t*) heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+	}
+	if(surface == nullptr){
+		ESP_LOGW(TAG, "Couldn't allocate the face surface, drawing its images from files");
+		lv_obj_move_background(stack);
+		return;
+	}
+
+	// Black like the parent's background, the images are blended over it
+	memset(surface, 0, bytes);
+	lv_area_t area;
+	lv_obj_get_coords(stack, &area);
+	LVGL::render(stack, area, surface);
+
+	lv_obj_del(stack);
+	for(auto& layer : layers){
+		if(layer.kind != Kind::Image) continue;
+		layer.obj = nullptr;
+		lv_img_cache_invalidate_src(layer.path.c_str());
+	}
+
+	surfaceDsc.header.cf = LV_IMG_CF_TRUE_COLOR;
+	surfaceDsc.header.w = Size;
+	surfaceDsc.header.h = Size;
+	surfaceDsc.data_size = bytes;
+	surfaceDsc.data = (const uint8_t*) surface;
+	lv_obj_set_style_bg_img_src(parent, &surfaceDsc, 0);
+}
+
+void WatchFace::setText(Layer& layer, const tm& time){
+	char text[48] = "";
+
+	switch(layer.bind){
+		case Bind::Date: {
+			static const char* Months[] = { "January", "February", "March", "April", "May", "June", "July", "August", "September", "October", "November", "December" };
+			const int dayLd = time.tm_mday - (time.tm_mday / 10) * 10;
+			const char* daySuff;
+			if(time.tm_mday == 11 || time.tm_mday == 12) daySuff = "th";
+			else if(dayLd == 1) daySuff = "st";
+			else if(dayLd == 2) daySuff = "nd";
+			else if(dayLd == 3) daySuff = "rd";
+			else daySuff = "th";
+
+			snprintf(text, sizeof(text), "%s %d%s, %d", Months[time.tm_mon % 12], time.tm_mday, daySuff, 1900 + time.tm_year);
+			break;
+		}
+
+		case Bind::Battery:
+			if(auto battery = Services.get<Service::Battery>()){
+				snprintf(text, sizeof(text), "%d%%", battery->getPerc());
+			}
+			break;
+
+		case Bind::NotifCount:
+			// Empty instead of a zero, like the status bar's notification icon
+			if(auto phone = Services.get<Service::Phone>(); phone && phone->getNotifsCount() > 0){
+				snprintf(text, sizeof(text), "%lu", (unsigned long) phone->getNotifsCount());
+			}
+			break;
+
+		default:
+			return;
+	}
+
+	// Only rendered if it changed
+	layer.text->setText(text);
+}
@@ -0,0 +1,92 @@
+#ifndef CLOCKSTAR_FIRMWARE_WATCHFACE_H
+#define CLOCKSTAR_FIRMWARE_WATCHFACE_H
+
+#include <lvgl.h>
+#include <ctime>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class StatusBar;
+class ClockLabelBig;
+class LVText;
+
+/**
+ * Lock screen face built from a description in the asset bundle, see tools/face_gen.py for the format.
+ * A face is a list of layers, each placed by an LVGL alignment and an offset in the parent:
+ * - Image layers are static. A lone full-screen image is left to the screen as a static background, several are
+ *   composited once into a surface in RAM, which is then drawn as a plain copy on every redraw.
+ * - Text layers are bound to the date, battery percentage or notification count.
+ * - Clock, Status and Notifs layers are the big digit clock, the status bar and the notification icon row.
+ *
+ * Bound layers aren't polled. They're refreshed from the Time updates the screen already gets, at most once per the
+ * period they declare, and only redrawn when their text changed. The clock ticks seconds only if its period is
+ * under a minute, so a face without seconds doesn't wake the device every second.
+ * If the description can't be read, the built-in default face is used.
+ */
+class WatchFace {
+public:
+	/**
+	 * @param parent 128x128 object the layers are created in
+	 * @param path LVGL path of the description (e.g. S:/faces/default.wf)
+	 */
+	WatchFace(lv_obj_t* parent, const char* path);
+	~WatchFace();
+
+	enum class Kind : uint8_t { Image, Text, Clock, Status, Notifs, COUNT };
+	enum class Bind : uint8_t { None, Date, Battery, NotifCount, COUNT };
+
+	/** Path of the face's only image layer if it covers the whole parent, for LVScreen::setStaticBackground. */
+	const char* getBackground() const;
+
+	/** Row for the notification icons, nullptr if the face has none */
+	lv_obj_t* getNotifRow() const;
+
+	/** Call from the screen's loop, runs the widgets that follow their own events */
+	void loop();
+
+	/** Refreshes the bound layers that are due, call with every Time update */
+	void update(const tm& time);
+
+private:
+	lv_obj_t* const parent;
+
+	struct Layer {
+		Kind kind;
+		Bind bind;
+		lv_align_t align;
+		lv_coord_t x, y; // [px]
+		lv_coord_t w, h; // [px], LV_SIZE_CONTENT if 0 in the description
+		uint16_t period; // [s]
+		lv_color_t color;
+		std::string path;
+
+		lv_obj_t* obj = nullptr;
+		LVText* text = nullptr;
+		time_t due = 0; // Unix time of the next refresh
+	};
+	std::vector<Layer> layers;
+
+	static constexpr size_t MaxLayers = 16;
+	static constexpr lv_coord_t Size = 128; // [px]
+
+	StatusBar* status = nullptr;
+	ClockLabelBig* clock = nullptr;
+	lv_obj_t* notifRow = nullptr;
+	const char* background = nullptr;
+
+	lv_color_t* surface = nullptr; // Composited image layers, if there's more than the background
+	lv_img_dsc_t surfaceDsc{};
+
+	struct Desc; // Layer as stored in the description
+	bool load(const char* path);
+	void loadDefault();
+	void add(const Desc& desc, std::string path);
+	void build();
+	void composite();
+	void setText(Layer& layer, const tm& time);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_WATCHFACE_H
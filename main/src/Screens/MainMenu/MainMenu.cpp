@@ -6,26 +6,41 @@
 #include "Screens/Theremin/Theremin.h"
 #include "Screens/PongGame.h"
 #include "Screens/Settings/SettingsScreen.h"
+#include "Screens/DiagScreen.h"
+#include "Screens/FindPhone.h"
 #include "Util/stdafx.h"
 #include "LV_Interface/InputLVGL.h"
+#include "LV_Interface/AssetPrefetch.h"
+#include "LV_Interface/LVBuild.h"
+#include "Services/Gestures.h"
 
 uint8_t  MainMenu::lastIndex = UINT8_MAX;
 
-MainMenu::MainMenu() : phone(*((Phone*) Services.get(Service::Phone))), queue(4){
-	lv_img_cache_set_size(8);
+static const LVScreen::AssetList* const ItemAssets[] = {
+		nullptr,
+		&Level::Assets,
+		&Theremin::Assets,
+		nullptr,
+		nullptr,
+		nullptr
+};
 
-	lv_obj_set_size(*this, 128, LV_SIZE_CONTENT);
-	lv_obj_add_flag(*this, LV_OBJ_FLAG_SCROLLABLE);
-	lv_obj_set_flex_flow(*this, LV_FLEX_FLOW_COLUMN);
-	lv_obj_set_flex_align(*this, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
+MainMenu::MainMenu() : phone(*(Services.get<Service::Phone>())), queue(4, "MainMenu"), pager(*this){
+	// Stays resident while apps and the lock screen run, so going back doesn't rebuild the menu and its GIFs
+	setPersistent(true);
 
-	bg = lv_obj_create(*this);
-	lv_obj_add_flag(bg, LV_OBJ_FLAG_FLOATING);
-	lv_obj_set_size(bg, 128, 128);
-	lv_obj_set_pos(bg, 0, 0);
-	lv_obj_set_style_bg_color(bg, lv_color_black(), 0);
-	lv_obj_set_style_bg_opa(bg, LV_OPA_COVER, 0);
-	lv_obj_set_style_bg_img_src(bg, "S:/bg.bin", 0);
+	// Labels and the focused GIF's frames, the cache grows from there if the hit rate asks for it
+	setImageCache(2, 8);
+
+	LVBuild::build(*this,
+		LVBuild::Size{ 128, LV_SIZE_CONTENT },
+		LVBuild::Flags{ .add = LV_OBJ_FLAG_SCROLLABLE | LV_OBJ_FLAG_SCROLL_ONE });
+
+	bg = LVBuild::obj(*this,
+		LVBuild::Style{ Styles::Backdrop },
+		LVBuild::Flags{ .add = LV_OBJ_FLAG_FLOATING },
+		LVBuild::Size{ 128, 128 },
+		LVBuild::Pos{ 0, 0 });
 
 	for(int i = 0; i < ItemCount; i++){
 		const auto& info = ItemInfos[i];
@@ -44,47 +59,56 @@ MainMenu::MainMenu() : phone(*((Phone*) Services.get(Service::Phone))), queue(4)
 			menu->onClick();
 		}, LV_EVENT_CLICKED, this);
 
+		lv_obj_add_event_cb(*item, [](lv_event_t* evt){
+			auto menu = static_cast<MainMenu*>(evt->user_data);
+			menu->onFocus(lv_event_get_target(evt));
+		}, LV_EVENT_FOCUSED, this);
+
+		if(ItemAssets[i]){
+			lv_obj_add_event_cb(*item, [](lv_event_t* evt){
+				auto prefetch = AssetPrefetch::getInstance();
+				if(prefetch == nullptr) return;
+				prefetch->request(*static_cast<const LVScreen::AssetList*>(evt->user_data));
+			}, LV_EVENT_FOCUSED, (void*) ItemAssets[i]);
+		}
+
 		lv_group_add_obj(inputGroup, *item);
-		lv_obj_add_flag(*item, LV_OBJ_FLAG_SCROLL_ON_FOCUS);
-		lv_obj_add_flag(*item, LV_OBJ_FLAG_SNAPPABLE);
-		lv_obj_clear_flag(*item, LV_OBJ_FLAG_CLICK_FOCUSABLE);
+		LVBuild::build(*item, LVBuild::Flags{
+			.add = LV_OBJ_FLAG_SNAPPABLE,
+			.clear = LV_OBJ_FLAG_CLICK_FOCUSABLE
+		});
 
 		items[i] = item;
 	}
 
-	//find my phone
-	lv_obj_add_event_cb(*items[0], [](lv_event_t* evt){
-		auto menu = static_cast<MainMenu*>(evt->user_data);
-		if(menu->findPhoneRinging){
-			menu->stopPhoneRing();
-		}else{
-			menu->startPhoneRing();
-		}
-	}, LV_EVENT_CLICKED, this);
-
-	lv_obj_add_event_cb(*items[0], [](lv_event_t* evt){
-		auto menu = static_cast<MainMenu*>(evt->user_data);
-		if(menu->findPhoneRinging){
-			menu->stopPhoneRing();
-		}
-	}, LV_EVENT_DEFOCUSED, this);
-
 	statusBar = new StatusBar(*this);
-	lv_obj_add_flag(*statusBar, LV_OBJ_FLAG_FLOATING);
-	lv_obj_set_pos(*statusBar, 0, 0);
+	LVBuild::build(*statusBar, LVBuild::Flags{ .add = LV_OBJ_FLAG_FLOATING }, LVBuild::Pos{ 0, 0 });
+
+	placeItems();
 
 	// Scrolling
-	lv_obj_add_flag(*this, LV_OBJ_FLAG_SCROLL_ONE);
 	lv_obj_set_scroll_snap_y(*this, LV_SCROLL_SNAP_START);
 	lv_group_set_wrap(inputGroup, false);
+}
 
-	Events::listen(Facility::Input, &queue);
-	Events::listen(Facility::Phone, &queue);
+void MainMenu::placeItems(){
+	// Items are a fixed column of full screen pages, stacked without a flex layout. Hidden ones take no page.
+	lv_coord_t y = 0;
+	for(auto item : items){
+		if(lv_obj_has_flag(*item, LV_OBJ_FLAG_HIDDEN)) continue;
+		lv_obj_set_pos(*item, 0, y);
+		y += MenuItem::Height;
+	}
 }
 
 MainMenu::~MainMenu(){
 	Events::unlisten(&queue);
-	lv_img_cache_set_size(LV_IMG_CACHE_DEF_SIZE);
+}
+
+void MainMenu::onFocus(lv_obj_t* item){
+	// Focus changes while the menu starts or re-places its items scroll at once, others slide to the new page
+	if(isRunning() && pager.slide(item)) return;
+	lv_obj_scroll_to_view(item, isRunning() ? LV_ANIM_ON : LV_ANIM_OFF);
 }
 
 void MainMenu::resetMenuIndex(){
@@ -96,38 +120,64 @@ void MainMenu::onStart(){
 }
 
 void MainMenu::onStarting(){
-	// TODO: place all ring phone stuff into setRingAlts
+	queue.reset();
+	Events::listen(Facility::Input, &queue);
+	Events::listen(Facility::Phone, &queue);
+
+	pager.enable();
 
 	if(lastIndex == UINT8_MAX){
 		lastIndex = 0;
 	}
 
-	if(phone.getPhoneType() != Phone::PhoneType::Android){
-		lv_obj_add_flag(*items[0], LV_OBJ_FLAG_HIDDEN);
-
-		if(lastIndex == 0){
-			lastIndex = 1;
+	const bool connected = phone.getPhoneType() != Phone::PhoneType::None;
+	if(connected == lv_obj_has_flag(*items[0], LV_OBJ_FLAG_HIDDEN)){
+		if(connected){
+			lv_obj_clear_flag(*items[0], LV_OBJ_FLAG_HIDDEN);
+		}else{
+			lv_obj_add_flag(*items[0], LV_OBJ_FLAG_HIDDEN);
 		}
+		placeItems();
+	}
+
+	if(!connected && lastIndex == 0){
+		lastIndex = 1;
 	}
 
 	lv_group_focus_obj(*items[lastIndex]);
 	lv_obj_scroll_to_view(*items[lastIndex], LV_ANIM_OFF);
+	items[lastIndex]->resume(); // Focusing the item that was already focused sends no event
 
 	lastIndex = UINT8_MAX;
 
 	setConnAlts();
+
+	// Flicks scroll the menu and a shake opens the focused item
+	if(gestures){
+		gestures->acquire();
+	}
 }
 
 void MainMenu::onStop(){
-	findPhoneRinging = false;
-	phone.findPhoneStop();
+	Events::unlisten(&queue);
+	pager.disable();
+
+	if(auto focused = lv_group_get_focused(inputGroup)){
+		const auto index = lv_obj_get_index(focused) - 1; // StatusBar is first
+		if(index < ItemCount){
+			items[index]->pause();
+		}
+	}
+
+	if(gestures){
+		gestures->release();
+	}
 }
 
 void MainMenu::loop(){
+	pager.loop();
 	statusBar->loop();
 
-	handleRing();
-
 	Event evt;
 	if(queue.get(evt, 0)){
 		if(evt.facility == Facility::Input){
@@ -137,8 +187,10 @@ void MainMenu::loop(){
 			auto data = (Phone::Event*) evt.data;
 			handlePhoneChange(*data);
 		}
-		free(evt.data);
 	}
+
+	// The pager steps its slide from here
+	setLoopPeriod(pager.isSliding() ? 0 : IdleLoopPeriod);
 }
 
 void MainMenu::onClick(){
@@ -148,31 +200,33 @@ void MainMenu::onClick(){
 
 	lastIndex = index;
 
-	std::function<void()> launcher[] = {
-			[](){ },
-			[this](){ transition([](){ return std::make_unique<Level>(); }); },
-			[this](){ transition([](){ return std::make_unique<Theremin>(); }); },
-			[this](){ transition([](){ return std::make_unique<PongGame>(); }); },
-			[](){ },
-			[this](){ transition([](){ return std::make_unique<SettingsScreen>(); }); }
-	};
-
-	launcher[index]();
+	switch(index){
+		case 0: transition<FindPhone>(); break;
+		case 1: transition<Level>(); break;
+		case 2: transition<Theremin>(); break;
+		case 3: transition<PongGame>(); break;
+		case 5: transition<SettingsScreen>(); break;
+		default: break;
+	}
 }
 
 void MainMenu::handlePhoneChange(Phone::Event& event){
+	if(event.action != Phone::Event::Connected && event.action != Phone::Event::Disconnected) return;
+
 	auto focused = lv_group_get_focused(inputGroup);
 	auto index = lv_obj_get_index(focused) - 1;
 	auto& findPhone = *items[0];
 	bool hiddenBefore = lv_obj_has_flag(findPhone, LV_OBJ_FLAG_HIDDEN);
 
-	if(event.action == Phone::Event::Connected && event.data.phoneType == Phone::PhoneType::Android){
+	if(event.action == Phone::Event::Connected){
 		lv_obj_clear_flag(findPhone, LV_OBJ_FLAG_HIDDEN);
 	}else{
 		lv_obj_add_flag(findPhone, LV_OBJ_FLAG_HIDDEN);
 	}
 
 	if(hiddenBefore != lv_obj_has_flag(findPhone, LV_OBJ_FLAG_HIDDEN)){
+		placeItems();
+
 		if(!hiddenBefore && index == 0){
 			lv_obj_scroll_to_view(*items[1], LV_ANIM_OFF);
 			lv_group_focus_obj(*items[1]);
@@ -187,7 +241,9 @@ void MainMenu::handlePhoneChange(Phone::Event& event){
 
 void MainMenu::handleInput(Input::Data& event){
 	if(event.btn == Input::Alt && event.action == Input::Data::Press){
-		transition([](){ return std::make_unique<LockScreen>(); });
+		transition<LockScreen>();
+	}else if(event.action == Input::Data::Chord && event.chord == DiagChord){
+		transition<DiagScreen>();
 	}
 }
 
@@ -198,29 +254,3 @@ void MainMenu::setConnAlts(){
 						 ? ItemInfos[ConnectionItemIndex].iconAltPath : ItemInfos[ConnectionItemIndex].iconPath;
 	connEl->setAltParams(connAlt, ConnDesc[(int) phone.getPhoneType()]);
 }
-
-void MainMenu::startPhoneRing(){
-	if(findPhoneRinging) return;
-
-	findPhoneRinging = true;
-	phone.findPhoneStart();
-	findPhoneCounter = millis();
-	findPhoneState = true;
-}
-
-void MainMenu::stopPhoneRing(){
-	if(!findPhoneRinging) return;
-
-	findPhoneRinging = false;
-	phone.findPhoneStop();
-}
-
-void MainMenu::handleRing(){
-	if(!findPhoneRinging) return;
-
-	if(millis() - findPhoneCounter >= FindPhonePeriod){
-		findPhoneCounter = millis();
-		findPhoneState = !findPhoneState;
-		findPhoneState ? phone.findPhoneStart() : phone.findPhoneStop();
-	}
-}
@@ -6,9 +6,11 @@
 #include "LV_Interface/LVScreen.h"
 #include "UIElements/StatusBar.h"
 #include "MenuItem.h"
+#include "LV_Interface/LVPager.h"
 #include "Notifs/Phone.h"
 #include "Devices/Input.h"
 #include "MenuItemAlt.h"
+#include "Util/Services.h"
 
 class MainMenu : public LVScreen {
 public:
@@ -41,16 +43,11 @@ private:
 	static constexpr uint8_t ItemCount = sizeof(ItemInfos) / sizeof(ItemInfos[0]);
 	static constexpr uint8_t ConnectionItemIndex = 4;
 
-	void setConnAlts();
-
-	bool findPhoneRinging = false;
-	void startPhoneRing();
-	void stopPhoneRing();
-	void handleRing();
+	/** Opens the hidden DiagScreen */
+	static constexpr uint8_t DiagChord = (1 << Input::Up) | (1 << Input::Down);
 
-	bool findPhoneState = false;
-	uint32_t findPhoneCounter = 0;
-	static constexpr uint32_t FindPhonePeriod = 1000; //1 second
+	void setConnAlts();
+	void placeItems();
 
 	static uint8_t lastIndex;
 
@@ -68,7 +65,14 @@ private:
 	void loop() override;
 	EventQueue queue;
 
+	// Constructed with the menu and torn down with it, so Gestures and Orientation only exist while it's up
+	ServiceHold<Service::Gestures> gestures;
+
+	/** Pages are slid to with pre-rendered surfaces, LVGL's scroll animation is the fallback without them */
+	LVPager pager;
+
 	void onClick();
+	void onFocus(lv_obj_t* item);
 
 	void handlePhoneChange(Phone::Event& event);
 	void handleInput(Input::Data& event);
@@ -2,20 +2,13 @@
 #include "UIElements/StatusBar.h"
 
 MenuItem::MenuItem(lv_obj_t* parent, const char* gifPath, const char* labelPath) : LVObject(parent){
-	lv_obj_set_flex_flow(*this, LV_FLEX_FLOW_COLUMN);
-	lv_obj_set_flex_align(*this, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
-
-	lv_obj_set_size(*this, 128, 128);
-	lv_obj_set_style_pad_gap(*this, 4, 0);
-	lv_obj_set_style_pad_top(*this, 16, 0);
+	lv_obj_set_size(*this, Width, Height);
 
 	labelContainer = lv_obj_create(*this);
-	lv_obj_set_size(labelContainer, lv_pct(100), 26);
-	lv_obj_set_flex_flow(labelContainer, LV_FLEX_FLOW_COLUMN);
-	lv_obj_set_flex_align(labelContainer, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
-	lv_obj_set_style_pad_gap(labelContainer, 2, 0);
+	lv_obj_set_size(labelContainer, Width, LabelHeight);
 
 	label = lv_img_create(labelContainer);
+	lv_obj_center(label);
 
 	constructVis(gifPath, labelPath);
 
@@ -37,12 +30,22 @@ void MenuItem::constructVis(const char* gifPath, const char* labelPath){
 		lv_obj_del(*gif);
 	}
 
-	gif = new LVGIF(*this, gifPath);
+	gif = new LVGIF(*this, gifPath, 4);
 	gif->setLooping(LVGIF::LoopType::On);
-	gif->reset();
-	gif->stop();
+	gif->release();
 
 	lv_obj_move_to_index(*gif, 0);
+
+	place();
+}
+
+void MenuItem::place(){
+	// The icon and label are centered as one column below PadTop, icons differ in height
+	const lv_coord_t gifHeight = lv_obj_get_style_height(*gif, LV_PART_MAIN);
+	const lv_coord_t top = PadTop + (Height - PadTop - (gifHeight + Gap + LabelHeight)) / 2;
+
+	lv_obj_align(*gif, LV_ALIGN_TOP_MID, 0, top);
+	lv_obj_set_pos(labelContainer, 0, top + gifHeight + Gap);
 }
 
 void MenuItem::onFocus(){
@@ -51,5 +54,15 @@ void MenuItem::onFocus(){
 }
 
 void MenuItem::onDefocus(){
-	gif->stop();
+	// Off screen items keep only their first frame, so the frame RAM doesn't grow with the item count
+	gif->release();
+}
+
+void MenuItem::pause(){
+	gif->release();
+}
+
+void MenuItem::resume(){
+	gif->reset();
+	gif->start();
 }
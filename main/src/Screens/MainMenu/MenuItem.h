@@ -8,12 +8,25 @@ class MenuItem : public LVObject {
 public:
 	MenuItem(lv_obj_t* parent, const char* gifPath, const char* labelPath);
 
+	/** Only the focused item animates. These pause and resume it while the menu isn't running. */
+	void pause();
+	void resume();
+
+	static constexpr lv_coord_t Width = 128;
+	static constexpr lv_coord_t Height = 128;
+
 protected:
+	// Fixed placement instead of a flex column, only the icon's height varies
+	static constexpr lv_coord_t PadTop = 16;
+	static constexpr lv_coord_t Gap = 4;
+	static constexpr lv_coord_t LabelHeight = 26;
+
 	LVGIF* gif = nullptr;
 	lv_obj_t* labelContainer;
 	lv_obj_t* label = nullptr;
 
 	void constructVis(const char* gifPath, const char* labelPath);
+	void place();
 
 	virtual void onFocus();
 	virtual void onDefocus();
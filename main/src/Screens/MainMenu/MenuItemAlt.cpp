@@ -13,6 +13,7 @@ MenuItemAlt::MenuItemAlt(lv_obj_t* parent, const char* gifPath, const char* labe
 	lv_label_set_long_mode(textLabel, LV_LABEL_LONG_WRAP);
 	lv_obj_set_width(textLabel, lv_pct(100));
 	lv_obj_set_style_text_align(textLabel, LV_TEXT_ALIGN_CENTER, 0);
+	lv_obj_center(textLabel);
 }
 
 void MenuItemAlt::setAltParams(const char* gifPathAlt, const char* labelPathAlt){
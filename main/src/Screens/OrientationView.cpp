@@ -0,0 +1,253 @@
+#include "OrientationView.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "Theme/theme.h"
+#include "Theme/styles.h"
+#include "Util/stdafx.h"
+#include "Devices/Input.h"
+#include "Services/SleepMan.h"
+#include "Screens/DiagScreen.h"
+
+static const char* TAG = "OrientationView";
+
+static constexpr int16_t Size = 128; // [px]
+static constexpr int32_t Center = Size / 2; // [px]
+static constexpr int32_t Focal = 200; // [px]
+static constexpr int32_t Distance = 160 * 16; // [px / 16] from the viewer to the model's center
+static constexpr int16_t StatsY = Size - 9; // [px]
+
+/** RGB565 with its bytes swapped, the way the canvas holds it for the panel */
+static constexpr uint16_t swap565(uint8_t r, uint8_t g, uint8_t b){
+	const uint16_t c = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+	return (uint16_t) ((c >> 8) | (c << 8));
+}
+
+enum : uint8_t { Body, Face, Strap };
+
+// Front and back shade of each edge color, edges facing away from the viewer are dimmed
+static constexpr uint16_t Colors[][2] = {
+		{ swap565(255, 255, 255), swap565(96, 96, 96) },
+		{ swap565(207, 198, 184), swap565(83, 79, 74) }, // Styles::TextColor
+		{ swap565(128, 128, 128), swap565(48, 48, 48) }
+};
+
+// Case, screen face with an arrow at 12 o'clock (-Y) and the strap stubs
+const OrientationView::Vertex OrientationView::Model[VertexCount] = {
+		{ -24, -24, 6 }, { 24, -24, 6 }, { 24, 24, 6 }, { -24, 24, 6 },
+		{ -24, -24, -6 }, { 24, -24, -6 }, { 24, 24, -6 }, { -24, 24, -6 },
+		{ -18, -18, 6 }, { 18, -18, 6 }, { 18, 18, 6 }, { -18, 18, 6 },
+		{ -5, -10, 6 }, { 5, -10, 6 }, { 0, -16, 6 },
+		{ -12, -24, -3 }, { 12, -24, -3 }, { -12, -38, -3 }, { 12, -38, -3 },
+		{ -12, 24, -3 }, { 12, 24, -3 }, { -12, 38, -3 }, { 12, 38, -3 }
+};
+
+const OrientationView::Edge OrientationView::Edges[EdgeCount] = {
+		{ 0, 1, Body }, { 1, 2, Body }, { 2, 3, Body }, { 3, 0, Body },
+		{ 4, 5, Body }, { 5, 6, Body }, { 6, 7, Body }, { 7, 4, Body },
+		{ 0, 4, Body }, { 1, 5, Body }, { 2, 6, Body }, { 3, 7, Body },
+		{ 8, 9, Face }, { 9, 10, Face }, { 10, 11, Face }, { 11, 8, Face },
+		{ 12, 13, Face }, { 13, 14, Face }, { 14, 12, Face },
+		{ 15, 17, Strap }, { 17, 18, Strap }, { 18, 16, Strap },
+		{ 19, 21, Strap }, { 21, 22, Strap }, { 22, 20, Strap }
+};
+
+OrientationView::OrientationView() : LVDirectScreen(Fps), queue(4, "OrientationView"){
+	// Only shown if the direct canvas couldn't be allocated
+	auto bg = lv_obj_create(*this);
+	lv_obj_set_size(bg, Size, Size);
+	lv_obj_set_pos(bg, 0, 0);
+	lv_obj_set_style_bg_color(bg, lv_color_black(), 0);
+	lv_obj_set_style_bg_opa(bg, LV_OPA_COVER, 0);
+
+	auto label = lv_label_create(bg);
+	lv_obj_set_style_text_font(label, &devin, 0);
+	lv_obj_set_style_text_color(label, Styles::TextColor, 0);
+	lv_label_set_text_static(label, "No canvas");
+	lv_obj_center(label);
+}
+
+OrientationView::~OrientationView(){
+	Events::unlisten(&queue);
+}
+
+void OrientationView::onStarting(){
+	// A fresh canvas starts out black
+	minX = minY = 0;
+	maxX = maxY = -1;
+	lastTime = 0;
+
+	statsStart = millis();
+	statsFrames = 0;
+	statsRender = 0;
+	snprintf(stats, sizeof(stats), "  - fps    - us");
+
+	if(!orientation) return;
+
+	// Every sample is fused as it arrives, the model follows the wrist within a frame
+	orientation->acquire(true);
+	powerLock.acquire();
+}
+
+void OrientationView::onStart(){
+	auto sleep = Services.get<Service::Sleep>();
+	sleep->enAutoSleep(false);
+
+	if(!orientation){
+		ESP_LOGE(TAG, "Orientation service error");
+	}
+	Events::listen(Facility::Input, &queue);
+}
+
+void OrientationView::onStop(){
+	if(orientation){
+		orientation->release(true);
+		powerLock.release();
+	}
+	Events::unlisten(&queue);
+
+	auto sleep = Services.get<Service::Sleep>();
+	sleep->enAutoSleep(true);
+}
+
+void OrientationView::loop(){
+	Event evt{};
+	if(queue.get(evt, 0)){
+		auto data = (Input::Data*) evt.data;
+		if(data->btn == Input::Alt && data->action == Input::Data::Press){
+			transition<DiagScreen>();
+			return;
+		}
+	}
+
+	if(millis() - statsStart < UpdateInterval) return;
+	updateStats();
+}
+
+bool OrientationView::draw(LGFX_Sprite& canvas){
+	if(!orientation) return false;
+
+	// Nothing to draw until the first fused sample, and nothing new until the next one
+	const auto state = orientation->get();
+	if(state.time == 0 || state.time == lastTime) return false;
+	lastTime = state.time;
+
+	auto buf = (uint16_t*) canvas.getBuffer();
+	const auto start = esp_timer_get_time();
+
+	Point points[VertexCount];
+	transform(state.quat, points);
+	clear(buf);
+	raster(buf, points);
+
+	statsRender += esp_timer_get_time() - start;
+	statsFrames++;
+
+	// Drawn over the model every frame, clearing may have cut into it
+	canvas.setTextColor(lgfx::color565(207, 198, 184), TFT_BLACK);
+	canvas.drawString(stats, 2, StatsY);
+	return true;
+}
+
+void OrientationView::transform(const Fusion::Quat<float>& quat, Point* out){
+	// Rotation matrix from the quaternion in Q14, products of two Q14 terms are shifted back by 13 to double them
+	const int32_t w = std::lround(quat.q1 * 16384.0f);
+	const int32_t x = std::lround(quat.q2 * 16384.0f);
+	const int32_t y = std::lround(quat.q3 * 16384.0f);
+	const int32_t z = std::lround(quat.q4 * 16384.0f);
+
+	const int32_t r[3][3] = {
+			{ 16384 - ((y * y + z * z) >> 13), (x * y - w * z) >> 13, (x * z + w * y) >> 13 },
+			{ (x * y + w * z) >> 13, 16384 - ((x * x + z * z) >> 13), (y * z - w * x) >> 13 },
+			{ (x * z - w * y) >> 13, (y * z + w * x) >> 13, 16384 - ((x * x + y * y) >> 13) }
+	};
+
+	// Earth X is right and Y is down on the canvas, Z points at the viewer looking down on the watch
+	for(size_t i = 0; i < VertexCount; i++){
+		const int32_t vx = Model[i].x * 16, vy = Model[i].y * 16, vz = Model[i].z * 16; // [px / 16]
+		const int32_t ex = (r[0][0] * vx + r[0][1] * vy + r[0][2] * vz) >> 14;
+		const int32_t ey = (r[1][0] * vx + r[1][1] * vy + r[1][2] * vz) >> 14;
+		const int32_t ez = (r[2][0] * vx + r[2][1] * vy + r[2][2] * vz) >> 14;
+
+		const int32_t depth = Distance - ez;
+		out[i] = {
+				(int16_t) (Center + ex * Focal / depth),
+				(int16_t) (Center + ey * Focal / depth),
+				(int16_t) ez
+		};
+	}
+}
+
+void OrientationView::raster(uint16_t* buf, const Point* points){
+	minX = minY = Size;
+	maxX = maxY = -1;
+
+	for(const auto& edge : Edges){
+		const auto& a = points[edge.a];
+		const auto& b = points[edge.b];
+		const bool front = a.z + b.z >= 0;
+		line(buf, a, b, Colors[edge.color][front ? 0 : 1]);
+	}
+
+	for(size_t i = 0; i < VertexCount; i++){
+		minX = std::min(minX, points[i].x);
+		minY = std::min(minY, points[i].y);
+		maxX = std::max(maxX, points[i].x);
+		maxY = std::max(maxY, points[i].y);
+	}
+	minX = std::max<int16_t>(minX, 0);
+	minY = std::max<int16_t>(minY, 0);
+	maxX = std::min<int16_t>(maxX, Size - 1);
+	maxY = std::min<int16_t>(maxY, Size - 1);
+}
+
+void OrientationView::clear(uint16_t* buf){
+	if(minX > maxX || minY > maxY) return;
+
+	const size_t bytes = (maxX - minX + 1) * sizeof(uint16_t);
+	for(int16_t y = minY; y <= maxY; y++){
+		memset(buf + y * Size + minX, 0, bytes);
+	}
+}
+
+void OrientationView::line(uint16_t* buf, Point a, Point b, uint16_t color){
+	// Bresenham, pixels off the canvas are skipped instead of clipping the line first
+	const int16_t dx = std::abs(b.x - a.x);
+	const int16_t dy = -std::abs(b.y - a.y);
+	const int16_t sx = a.x < b.x ? 1 : -1;
+	const int16_t sy = a.y < b.y ? 1 : -1;
+	int16_t err = dx + dy;
+
+	for(;;){
+		if(a.x >= 0 && a.x < Size && a.y >= 0 && a.y < Size){
+			buf[a.y * Size + a.x] = color;
+		}
+		if(a.x == b.x && a.y == b.y) return;
+
+		const int16_t e2 = 2 * err;
+		if(e2 >= dy){
+			err += dy;
+			a.x += sx;
+		}
+		if(e2 <= dx){
+			err += dx;
+			a.y += sy;
+		}
+	}
+}
+
+void OrientationView::updateStats(){
+	const auto now = millis();
+	const auto elapsed = (uint32_t) std::max<uint64_t>(now - statsStart, 1); // [ms]
+	statsStart = now;
+
+	const uint32_t fps = (statsFrames * 1000 + elapsed / 2) / elapsed;
+	const uint32_t render = statsFrames ? (uint32_t) (statsRender / statsFrames) : 0; // [us]
+	snprintf(stats, sizeof(stats), "%3lu fps %4lu us", (unsigned long) fps, (unsigned long) render);
+
+	statsFrames = 0;
+	statsRender = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef CLOCKSTAR_FIRMWARE_ORIENTATIONVIEW_H
+#define CLOCKSTAR_FIRMWARE_ORIENTATIONVIEW_H
+
+#include "../LV_Interface/LVDirectScreen.h"
+#include "../Services/Orientation.h"
+#include "Util/Events.h"
+#include "Util/Services.h"
+#include "Util/PowerLock.h"
+#include <cstdint>
+
+/**
+ * Hidden live wireframe of the watch drawn from the fused quaternion, for checking fusion against the real thing.
+ * Opened with Select on DiagScreen and left with Alt. The model is rotated and projected in fixed point and its edges
+ * are rasterized straight into the direct canvas, only the area the last frame drew is cleared. The bottom row shows
+ * the frame rate and the transform and rasterize time, so the screen doubles as a benchmark of the IMU, fusion and
+ * display pipeline under continuous load.
+ */
+class OrientationView : public LVDirectScreen {
+public:
+	OrientationView();
+	~OrientationView() override;
+
+private:
+	static constexpr uint8_t Fps = 60;
+	static constexpr uint32_t UpdateInterval = 500; // [ms] of the stats row
+
+	struct Vertex {
+		int8_t x, y, z; // [px] in IMU::Sample axes
+	};
+	struct Edge {
+		uint8_t a, b;
+		uint8_t color; // Into Colors
+	};
+	struct Point {
+		int16_t x, y; // [px]
+		int16_t z; // [px / 16] towards the viewer
+	};
+
+	static constexpr size_t VertexCount = 23;
+	static constexpr size_t EdgeCount = 25;
+	static const Vertex Model[VertexCount];
+	static const Edge Edges[EdgeCount];
+
+	ServiceHold<Service::Orientation> orientation;
+	EventQueue queue;
+	PowerLock powerLock{ PowerProfile::Performance, "Orientation" };
+
+	uint64_t lastTime = 0; // [us] of the fused state last drawn
+
+	// Canvas area drawn by the last frame, inclusive, empty if minX > maxX
+	int16_t minX = 0, minY = 0, maxX = -1, maxY = -1;
+
+	uint64_t statsStart = 0; // [ms]
+	uint32_t statsFrames = 0;
+	uint64_t statsRender = 0; // [us] spent in transform and rasterize
+	char stats[24] = {};
+
+	void onStarting() override;
+	void onStart() override;
+	void onStop() override;
+	void loop() override;
+	bool draw(LGFX_Sprite& canvas) override;
+
+	/** Rotates the model by quat, with the rotation in Q14, and projects it onto the canvas */
+	static void transform(const Fusion::Quat<float>& quat, Point* out);
+	void raster(uint16_t* buf, const Point* points);
+	void clear(uint16_t* buf);
+	void updateStats();
+
+	static void line(uint16_t* buf, Point a, Point b, uint16_t color);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_ORIENTATIONVIEW_H
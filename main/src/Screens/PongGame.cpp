@@ -5,216 +5,205 @@
 #include "Util/Notes.h"
 #include "Services/SleepMan.h"
 #include "Util/stdafx.h"
+#include "LV_Interface/LVGL.h"
+#include "LV_Interface/LVBuild.h"
 #include <cmath>
 #include <algorithm>
 #include <esp_random.h>
 
-PongGame::PongGame() 
-	: paddleY(0.5f),
-	  score(0),
-	  gameOver(false),
-	  gameThread([this](){ gameLoop(); }, "Pong", 4096, 5, 1),
-	  pitchFilter(filterStrength),
-	  queue(4)
+PongGame::PongGame()
+	: LVGame("Pong", StepRate),
+	  queue(4, "PongGame")
 {
 	// Get services
-	imu = (IMU*) Services.get(Service::IMU);
-	audio = (ChirpSystem*) Services.get(Service::Audio);
+	imu = Services.get<Service::IMUStream>();
+	audio = Services.get<Service::Audio>();
 
 	// Create background
-	bg = lv_obj_create(*this);
-	lv_obj_set_size(bg, SCREEN_WIDTH, SCREEN_HEIGHT);
-	lv_obj_set_style_bg_color(bg, lv_color_black(), 0);
-	lv_obj_set_style_border_width(bg, 1, 0);
-	lv_obj_set_style_border_color(bg, lv_color_white(), 0);
+	bg = LVBuild::obj(*this,
+		LVBuild::Style{ Styles::PongField },
+		LVBuild::Size{ SCREEN_WIDTH, SCREEN_HEIGHT },
+		LVBuild::Flags{ .clear = LV_OBJ_FLAG_SCROLLABLE });
 
 	// Create score label
-	scoreLabel = lv_label_create(bg);
+	scoreLabel = LVBuild::label(bg,
+		LVBuild::Style{ Styles::TextWhite },
+		LVBuild::Pos{ 5, 5 });
 	lv_label_set_text(scoreLabel, "Score: 0");
-	lv_obj_set_style_text_color(scoreLabel, lv_color_white(), 0);
-	lv_obj_set_pos(scoreLabel, 5, 5);
-
-	// Create ball
-	ball = lv_obj_create(bg);
-	lv_obj_set_size(ball, BALL_SIZE, BALL_SIZE);
-	lv_obj_set_style_bg_color(ball, lv_color_white(), 0);
-	lv_obj_set_style_bg_opa(ball, LV_OPA_COVER, 0);
-	lv_obj_set_style_border_width(ball, 0, 0);
-	lv_obj_set_style_radius(ball, BALL_SIZE / 2, 0);
-
-	// Create paddle
-	paddle = lv_obj_create(bg);
-	lv_obj_set_size(paddle, PADDLE_WIDTH, PADDLE_HEIGHT);
-	lv_obj_set_style_bg_color(paddle, lv_color_white(), 0);
-	lv_obj_set_style_bg_opa(paddle, LV_OPA_COVER, 0);
-	lv_obj_set_style_border_width(paddle, 0, 0);
+
+	// Ball and paddle move every frame, they're drawn as sprites instead of objects
+	sprites = new LVSprites(bg, SpriteCount);
+	lv_obj_set_size(*sprites, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+	sprites->set(SpriteBall, { .w = BALL_SIZE, .h = BALL_SIZE, .radius = BALL_SIZE / 2 });
+	sprites->set(SpritePaddle, { .w = PADDLE_WIDTH, .h = PADDLE_HEIGHT });
 
 	// Initialize game state
-	resetBall();
+	state.paddleY = 0.5f;
+	resetBall(state);
 }
 
 PongGame::~PongGame() {
 	Events::unlisten(&queue);
 }
 
-void PongGame::onStart() {
+void PongGame::onGameStart() {
 	// Disable auto-sleep during game
-	auto sleep = (SleepMan*) Services.get(Service::Sleep);
+	auto sleep = Services.get<Service::Sleep>();
 	sleep->enAutoSleep(false);
 
+	// 60 Hz physics and rendering run at full speed
+	powerLock.acquire();
+
 	// Listen for input events
 	Events::listen(Facility::Input, &queue);
 
-	// Initialize IMU filter
-	IMU::Sample sample = imu->getSample();
-	pitchFilter.reset(sample.accelY);
-
-	// Start game thread
-	running = true;
-	gameThread.start();
+	// Initialize IMU filter and subscribe to the stream
+	pitchFilter.reset(imu->read().data.accelY);
+	imu->subscribe(&imuSub);
 }
 
-void PongGame::onStop() {
-	// Stop game thread
-	running = false;
-	gameThread.stop(0);
-
+void PongGame::onGameStop() {
 	// Cleanup
+	imu->unsubscribe(&imuSub);
 	Events::unlisten(&queue);
 
+	powerLock.release();
+
 	// Re-enable auto-sleep
-	auto sleep = (SleepMan*) Services.get(Service::Sleep);
+	auto sleep = Services.get<Service::Sleep>();
 	sleep->enAutoSleep(true);
 }
 
-void PongGame::loop() {
-	// Handle button input in main UI thread
-	handleInput();
-}
+void PongGame::resetBall(PongState& state) {
+	state.ball.x = SCREEN_WIDTH / 2;
+	state.ball.y = SCREEN_HEIGHT / 2;
+	state.round++;
 
-void PongGame::resetBall() {
-	ballState.x = SCREEN_WIDTH / 2;
-	ballState.y = SCREEN_HEIGHT / 2;
-	
 	// Random angle between -45 and 45 degrees
 	float angle = (esp_random() % 90 - 45) * M_PI / 180.0f;
-	ballState.vx = BALL_SPEED * std::cos(angle);
-	ballState.vy = BALL_SPEED * std::sin(angle);
+	state.ball.vx = BALL_SPEED * std::cos(angle);
+	state.ball.vy = BALL_SPEED * std::sin(angle);
 }
 
-void PongGame::updateGame() {
-	if(gameOver) return;
+void PongGame::step(PongState& state) {
+	if(restart.exchange(false) && state.gameOver) {
+		state.score = 0;
+		state.gameOver = false;
+		resetBall(state);
+	}
+
+	updatePaddle(state);
+
+	if(state.gameOver) return;
 
 	// Update ball position
-	ballState.x += ballState.vx;
-	ballState.y += ballState.vy;
+	state.ball.x += state.ball.vx;
+	state.ball.y += state.ball.vy;
 
 	// Check collisions
-	checkCollisions();
+	checkCollisions(state);
+}
+
+void PongGame::updatePaddle(PongState& state) {
+	// Several low-latency samples arrive per game step
+	IMUStream::Sample sample{};
+	bool updated = false;
+	while(imuSub.get(sample)){
+		pitchFilter.update(sample.data.accelY);
+		updated = true;
+	}
+	if(updated){
+		LVGL::markInput(sample.time);
+	}
+	float pitch = pitchFilter.get();
 
-	// Update paddle from IMU
-	IMU::Sample sample = imu->getSample();
-	float pitch = pitchFilter.update(sample.accelY);
-	
 	// Map pitch to paddle position (-0.3g to 0.3g → 0 to 1)
 	float targetY = std::clamp((pitch + 0.3f) / 0.6f, 0.0f, 1.0f);
-	
+
 	// Smooth paddle movement
-	paddleY += (targetY - paddleY) * PADDLE_SPEED;
-	paddleY = std::clamp(paddleY, 0.0f, 1.0f);
+	state.paddleY += (targetY - state.paddleY) * PADDLE_SPEED;
+	state.paddleY = std::clamp(state.paddleY, 0.0f, 1.0f);
 }
 
-void PongGame::checkCollisions() {
+void PongGame::checkCollisions(PongState& state) {
+	auto& ball = state.ball;
+
 	// Top/bottom walls
-	if(ballState.y <= 0 || ballState.y >= SCREEN_HEIGHT - BALL_SIZE) {
-		ballState.vy = -ballState.vy;
+	if(ball.y <= 0 || ball.y >= SCREEN_HEIGHT - BALL_SIZE) {
+		ball.vy = -ball.vy;
 		playHitSound();
 	}
 
 	// Left wall - paddle side
-	if(ballState.x <= PADDLE_WIDTH) {
-		float paddleTop = paddleY * (SCREEN_HEIGHT - PADDLE_HEIGHT);
+	if(ball.x <= PADDLE_WIDTH) {
+		float paddleTop = state.paddleY * (SCREEN_HEIGHT - PADDLE_HEIGHT);
 		float paddleBottom = paddleTop + PADDLE_HEIGHT;
-		
-		if(ballState.y >= paddleTop && ballState.y <= paddleBottom) {
+
+		if(ball.y >= paddleTop && ball.y <= paddleBottom) {
 			// Hit paddle
-			ballState.vx = -ballState.vx;
-			ballState.x = PADDLE_WIDTH;
-			
+			ball.vx = -ball.vx;
+			ball.x = PADDLE_WIDTH;
+
 			// Add spin based on hit position
-			float hitPos = (ballState.y - paddleTop) / PADDLE_HEIGHT;
-			ballState.vy += (hitPos - 0.5f) * 0.5f;
-			
-			score++;
+			float hitPos = (ball.y - paddleTop) / PADDLE_HEIGHT;
+			ball.vy += (hitPos - 0.5f) * 0.5f;
+
+			state.score++;
 			playHitSound();
-		} else if(ballState.x <= 0) {
+		} else if(ball.x <= 0) {
 			// Miss - game over
-			gameOver = true;
+			state.gameOver = true;
 			playMissSound();
 		}
 	}
 
 	// Right wall
-	if(ballState.x >= SCREEN_WIDTH - BALL_SIZE) {
-		ballState.vx = -ballState.vx;
-		ballState.x = SCREEN_WIDTH - BALL_SIZE;
+	if(ball.x >= SCREEN_WIDTH - BALL_SIZE) {
+		ball.vx = -ball.vx;
+		ball.x = SCREEN_WIDTH - BALL_SIZE;
 		playHitSound();
 	}
 }
 
-void PongGame::updateUI() {
-	// Update ball position
-	lv_obj_set_pos(ball, (int)ballState.x, (int)ballState.y);
+void PongGame::render(const PongState& prev, const PongState& curr, float alpha) {
+	// A reset ball jumps to the center instead of sliding there
+	const bool sameRound = prev.round == curr.round;
+	const float ballX = sameRound ? lerp(prev.ball.x, curr.ball.x, alpha) : curr.ball.x;
+	const float ballY = sameRound ? lerp(prev.ball.y, curr.ball.y, alpha) : curr.ball.y;
+	sprites->move(SpriteBall, (lv_coord_t) ballX, (lv_coord_t) ballY);
 
-	// Update paddle position
-	int paddlePixelY = paddleY * (SCREEN_HEIGHT - PADDLE_HEIGHT);
-	lv_obj_set_pos(paddle, 0, paddlePixelY);
+	const float paddleY = lerp(prev.paddleY, curr.paddleY, alpha);
+	sprites->move(SpritePaddle, 0, (lv_coord_t) (paddleY * (SCREEN_HEIGHT - PADDLE_HEIGHT)));
+
+	// The label is only relaid out when the score changes
+	if(curr.score == shownScore && curr.gameOver == shownGameOver) return;
+	shownScore = curr.score;
+	shownGameOver = curr.gameOver;
 
-	// Update score
 	char buf[32];
-	if(gameOver) {
-		snprintf(buf, sizeof(buf), "Score: %d\nGame Over!", score);
+	if(curr.gameOver) {
+		snprintf(buf, sizeof(buf), "Score: %d\nGame Over!", curr.score);
 	} else {
-		snprintf(buf, sizeof(buf), "Score: %d", score);
+		snprintf(buf, sizeof(buf), "Score: %d", curr.score);
 	}
 	lv_label_set_text(scoreLabel, buf);
 }
 
-void PongGame::gameLoop() {
-	const TickType_t frameTime = pdMS_TO_TICKS(16);  // ~60 FPS
-	
-	while(running) {
-		TickType_t startTick = xTaskGetTickCount();
-		
-		// Update game state
-		updateGame();
-		
-		// Update UI
-		updateUI();
-		
-		// Maintain frame rate
-		TickType_t elapsed = xTaskGetTickCount() - startTick;
-		if(elapsed < frameTime) {
-			vTaskDelay(frameTime - elapsed);
-		}
-	}
-}
-
-void PongGame::handleInput() {
+void PongGame::onLoop() {
+	// Handle button input in main UI thread
 	Event event;
 	if(queue.get(event, 0)) {
 		if(event.facility == Facility::Input) {
 			auto data = (Input::Data*) event.data;
-			
+
 			if(data->action == Input::Data::Press) {
 				if(data->btn == Input::Button::Alt) {
 					// Exit game
-					transition([](){ return std::make_unique<MainMenu>(); });
-				} else if(data->btn == Input::Button::Select && gameOver) {
-					// Restart game
-					score = 0;
-					gameOver = false;
-					resetBall();
+					transition<MainMenu>();
+				} else if(data->btn == Input::Button::Select) {
+					// Restart game, picked up by the next step if it's over
+					restart = true;
 				}
 			}
 		}
@@ -1,41 +1,52 @@
 #ifndef CLOCKSTAR_FIRMWARE_PONGGAME_H
 #define CLOCKSTAR_FIRMWARE_PONGGAME_H
 
-#include "../LV_Interface/LVScreen.h"
-#include "../Devices/IMU.h"
+#include "../LV_Interface/LVGame.h"
+#include "../LV_Interface/LVSprites.h"
+#include "../Services/IMUStream.h"
 #include "../Services/ChirpSystem.h"
 #include "../Util/Events.h"
-#include "../Util/EMA.h"
-#include "../Util/Threaded.h"
+#include "../Util/DSP.h"
+#include "../Util/PowerLock.h"
 #include <atomic>
 
-class PongGame : public LVScreen {
+struct PongState {
+	struct {
+		float x, y;           // Ball position
+		float vx, vy;         // Ball velocity, per step
+	} ball;
+
+	float paddleY;            // Paddle position (0-1)
+	int score;
+	bool gameOver;
+	uint8_t round;            // Counts ball resets, the ball isn't interpolated across one
+};
+
+class PongGame : public LVGame<PongState> {
 public:
 	PongGame();
 	~PongGame() override;
 
 private:
-	void onStart() override;
-	void onStop() override;
-	void loop() override;
+	void onGameStart() override;
+	void onGameStop() override;
+	void onLoop() override;
+
+	void step(PongState& state) override;
+	void render(const PongState& prev, const PongState& curr, float alpha) override;
 
 	// UI Objects
 	lv_obj_t* bg;
 	lv_obj_t* scoreLabel;
-	lv_obj_t* ball;
-	lv_obj_t* paddle;
-
-	// Game State
-	struct {
-		float x, y;           // Ball position
-		float vx, vy;         // Ball velocity
-	} ballState;
+	LVSprites* sprites;
+	enum : uint8_t { SpriteBall, SpritePaddle, SpriteCount };
 
-	float paddleY;            // Paddle position (0-1)
-	int score;
-	bool gameOver;
+	// Shown by scoreLabel, it's only set when these change
+	int shownScore = -1;
+	bool shownGameOver = false;
 
 	// Game Constants
+	static constexpr uint8_t StepRate = 60; // [Hz]
 	static constexpr int SCREEN_WIDTH = 128;
 	static constexpr int SCREEN_HEIGHT = 128;
 	static constexpr int BALL_SIZE = 4;
@@ -44,30 +55,29 @@ private:
 	static constexpr float BALL_SPEED = 1.5f;
 	static constexpr float PADDLE_SPEED = 0.02f;
 
-	// Game Thread
-	ThreadedClosure gameThread;
-	std::atomic_bool running{false};
-	void gameLoop();
+	// Set on the LVGL thread, picked up by the next step
+	std::atomic_bool restart{false};
 
 	// IMU
-	IMU* imu;
-	EMA pitchFilter;
-	static constexpr float filterStrength = 0.15f;
+	IMUStream* imu;
+	IMUStream::Subscriber imuSub{ 1, true }; // Low latency, the paddle tracks the wrist closely
+	/**
+	 * Bias and offset are calibrated out in IMU, this only takes out jitter. Still at 5 Hz, tilting at 1 g/s opens it
+	 * up to 25 Hz, about where the plain EMA used to sit, so the paddle keeps up with quick flicks.
+	 */
+	DSP::OneEuro<float> pitchFilter{ IMUStream::LowLatencyRate, 5.0, 20.0 };
 
 	// Services
 	ChirpSystem* audio;
 	EventQueue queue;
+	PowerLock powerLock{ PowerProfile::Performance, "Pong" };
 
 	// Game Logic
-	void updateGame();
-	void checkCollisions();
-	void resetBall();
-	void updateUI();
+	void updatePaddle(PongState& state);
+	void checkCollisions(PongState& state);
+	static void resetBall(PongState& state);
 	void playHitSound();
 	void playMissSound();
-
-	// Input
-	void handleInput();
 };
 
 #endif // CLOCKSTAR_FIRMWARE_PONGGAME_H
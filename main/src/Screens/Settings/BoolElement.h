@@ -4,7 +4,7 @@
 
 #include <functional>
 #include "LV_Interface/LVObject.h"
-#include "LV_Interface/LVStyle.h"
+#include "LV_Interface/LVText.h"
 
 class BoolElement : public LVObject {
 public:
@@ -14,25 +14,8 @@ public:
 	[[nodiscard]] bool getValue() const;
 
 private:
-	lv_obj_t* label;
+	LVText* label;
 	lv_obj_t* switchElement;
-	LVStyle defaultStyle;
-	LVStyle focusedStyle;
-	LVStyle labelStyle;
-	LVStyle switchStyle;
-	LVStyle switchCheckedStyle;
-	LVStyle switchKnobStyle;
-
-	static lv_style_transition_dsc_t Transition;
-	constexpr static const lv_style_prop_t TransProps[] = {
-			LV_STYLE_BG_OPA, LV_STYLE_BG_COLOR,
-			LV_STYLE_TRANSFORM_WIDTH, LV_STYLE_TRANSFORM_HEIGHT,
-			LV_STYLE_TRANSLATE_Y, LV_STYLE_TRANSLATE_X,
-			LV_STYLE_TRANSFORM_ZOOM, LV_STYLE_TRANSFORM_ANGLE,
-			LV_STYLE_COLOR_FILTER_OPA, LV_STYLE_COLOR_FILTER_DSC,
-			LV_STYLE_PROP_INV
-	};
-
 	bool value;
 	std::function<void(bool)> cb;
 
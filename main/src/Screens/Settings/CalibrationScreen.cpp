@@ -0,0 +1,127 @@
+#include "CalibrationScreen.h"
+#include "SettingsScreen.h"
+#include <cstdarg>
+#include <cstdio>
+#include "Theme/theme.h"
+#include "Theme/styles.h"
+#include "Devices/Input.h"
+#include "Util/Services.h"
+#include "Util/LoopGuard.h"
+#include "Util/stdafx.h"
+
+static constexpr uint8_t AllFaces = 0x3f;
+
+CalibrationScreen::CalibrationScreen() : calibrator(*Services.get<Service::IMUCalibrator>()), queue(4, "Calibration"){
+	lv_obj_set_size(*this, 128, 128);
+
+	auto bg = lv_obj_create(*this);
+	lv_obj_add_flag(bg, LV_OBJ_FLAG_FLOATING);
+	lv_obj_set_size(bg, 128, 128);
+	lv_obj_set_pos(bg, 0, 0);
+	lv_obj_set_style_bg_color(bg, lv_color_black(), 0);
+	lv_obj_set_style_bg_opa(bg, LV_OPA_COVER, 0);
+	lv_obj_set_style_bg_img_src(bg, "S:/bg.bin", 0);
+
+	statusBar = new StatusBar(*this);
+	lv_obj_add_flag(*statusBar, LV_OBJ_FLAG_FLOATING);
+	lv_obj_set_pos(*statusBar, 0, 0);
+
+	title = lv_label_create(*this);
+	lv_obj_set_style_text_font(title, &devin, 0);
+	lv_obj_set_style_text_color(title, lv_color_white(), 0);
+	lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 24);
+
+	hint = lv_label_create(*this);
+	lv_obj_set_width(hint, 120);
+	lv_label_set_long_mode(hint, LV_LABEL_LONG_WRAP);
+	lv_obj_set_style_text_align(hint, LV_TEXT_ALIGN_CENTER, 0);
+	lv_obj_set_style_text_font(hint, &devin, 0);
+	lv_obj_set_style_text_color(hint, Styles::TextColor, 0);
+	lv_obj_align(hint, LV_ALIGN_TOP_MID, 0, 48);
+}
+
+CalibrationScreen::~CalibrationScreen(){
+	Events::unlisten(&queue);
+}
+
+void CalibrationScreen::onStarting(){
+	step = Step::Gyro;
+	captureTime = 0;
+	show("Gyro", "Lay the watch down and press Select");
+
+	queue.reset();
+	Events::listen(Facility::Input, &queue);
+}
+
+void CalibrationScreen::onStop(){
+	Events::unlisten(&queue);
+}
+
+void CalibrationScreen::loop(){
+	Event evt{};
+	if(queue.get(evt, 0)){
+		auto data = (Input::Data*) evt.data;
+		if(data->btn == Input::Alt && data->action == Input::Data::Press){
+			transition<SettingsScreen>();
+			return;
+		}
+
+		if(data->btn == Input::Select && data->action == Input::Data::Press && captureTime == 0){
+			if(step == Step::Done){
+				transition<SettingsScreen>();
+				return;
+			}
+
+			captureTime = millis() + SettleTime;
+			show(step == Step::Gyro ? "Gyro" : "Accelerometer", "Hold still...");
+		}
+	}
+
+	if(captureTime != 0 && millis() >= captureTime){
+		captureTime = 0;
+		capture();
+	}
+
+	statusBar->loop();
+}
+
+void CalibrationScreen::capture(){
+	// Blocks for the whole capture on purpose, the prompt went out with the last frame
+	LoopGuard::Exempt exempt;
+
+	if(step == Step::Gyro){
+		if(!calibrator.calibrateGyro()){
+			show("Gyro", "It moved, lay it down and press Select again");
+			return;
+		}
+
+		step = Step::Faces;
+		show("Accelerometer", "Rest it on any side and press Select, 0 of 6");
+		return;
+	}
+
+	if(!calibrator.captureAccelFace()){
+		show("Accelerometer", "Keep it still with one side flat down, then press Select");
+		return;
+	}
+
+	const uint8_t faces = calibrator.getCapturedFaces();
+	if(faces != AllFaces){
+		show("Accelerometer", "Turn it onto another side and press Select, %d of 6", __builtin_popcount(faces));
+		return;
+	}
+
+	calibrator.finishAccel();
+	step = Step::Done;
+	show("Done", "Calibration saved, press Select");
+}
+
+void CalibrationScreen::show(const char* titleText, const char* fmt, ...){
+	lv_label_set_text_static(title, titleText);
+
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(hintText, sizeof(hintText), fmt, args);
+	va_end(args);
+	lv_label_set_text_static(hint, hintText);
+}
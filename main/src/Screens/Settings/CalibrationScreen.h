@@ -0,0 +1,47 @@
+#ifndef CLOCKSTAR_FIRMWARE_CALIBRATIONSCREEN_H
+#define CLOCKSTAR_FIRMWARE_CALIBRATIONSCREEN_H
+
+#include "LV_Interface/LVScreen.h"
+#include "Util/Events.h"
+#include "UIElements/StatusBar.h"
+#include "Services/IMUCalibrator.h"
+
+/**
+ * Guided IMU calibration, opened from the settings. Select captures the gyro at rest, then the accelerometer with each
+ * of the six faces down, and the result is stored once all are in. Alt goes back at any point, the captures so far
+ * are kept by the calibrator.
+ * A capture starts SettleTime after the press so the press itself isn't in it, and blocks the UI thread for the
+ * calibrator's ~2 s, exempt from the loop guard. The prompt is on screen before that.
+ */
+class CalibrationScreen : public LVScreen {
+public:
+	CalibrationScreen();
+	~CalibrationScreen() override;
+
+private:
+	static constexpr uint32_t SettleTime = 1000; // [ms]
+
+	IMUCalibrator& calibrator;
+
+	enum class Step : uint8_t { Gyro, Faces, Done };
+	Step step = Step::Gyro;
+	uint64_t captureTime = 0; // [ms] when the pending capture starts, 0 if none
+
+	lv_obj_t* title;
+	lv_obj_t* hint;
+	char hintText[64] = {};
+	StatusBar* statusBar;
+
+	EventQueue queue;
+
+	void onStarting() override;
+	void onStop() override;
+	void loop() override;
+
+	void capture();
+	void show(const char* titleText, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_CALIBRATIONSCREEN_H
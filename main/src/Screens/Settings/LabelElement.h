@@ -3,18 +3,15 @@
 
 #include <functional>
 #include "LV_Interface/LVObject.h"
-#include "LV_Interface/LVStyle.h"
+#include "LV_Interface/LVText.h"
 
 class LabelElement : public LVObject {
 public:
 	explicit LabelElement(lv_obj_t* parent, const char* name, std::function<void()> cb);
 
 private:
-	lv_obj_t* label;
+	LVText* label;
 
-	LVStyle defaultStyle;
-	LVStyle focusedStyle;
-	LVStyle labelStyle;
 	static constexpr lv_style_selector_t SelDefault = LV_PART_MAIN | LV_STATE_DEFAULT;
 	static constexpr lv_style_selector_t SelFocus = LV_PART_MAIN | LV_STATE_FOCUSED;
 
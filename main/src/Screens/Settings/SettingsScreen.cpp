@@ -6,10 +6,11 @@
 #include "SliderElement.h"
 #include "LabelElement.h"
 #include "DiscreteSliderElement.h"
+#include "CalibrationScreen.h"
 #include "Services/StatusCenter.h"
 
-SettingsScreen::SettingsScreen() : settings(*(Settings*) Services.get(Service::Settings)), backlight(*(BacklightBrightness*) Services.get(Service::Backlight)),
-								   audio(*(ChirpSystem*) Services.get(Service::Audio)), imu(*(IMU*) Services.get(Service::IMU)), queue(4){
+SettingsScreen::SettingsScreen() : settings(*Services.get<Service::Settings>()), edit(settings), backlight(*Services.get<Service::Backlight>()),
+								   audio(*Services.get<Service::Audio>()), imu(*Services.get<Service::IMU>()), queue(4, "Settings"){
 	lv_obj_set_size(*this, 128, 128);
 
 	bg = lv_obj_create(*this);
@@ -32,52 +33,57 @@ SettingsScreen::SettingsScreen() : settings(*(Settings*) Services.get(Service::S
 	lv_obj_add_flag(*statusBar, LV_OBJ_FLAG_FLOATING);
 	lv_obj_set_pos(*statusBar, 0, 0);
 
-	auto startingSettings = settings.get();
+	// Only events and the status bar are handled in loop(), the rows are run by LVGL
+	setLoopPeriod(IdleLoopPeriod);
+
+	// Changes are previewed as they're made and committed once on exit, see Settings::Edit
+	const auto& starting = edit.base();
 
 	audioSwitch = new BoolElement(container, "Sound", [this](bool value){
+		edit.draft().notificationSounds = value;
 		if(value){
-			auto status = (StatusCenter*) Services.get(Service::Status);
+			auto status = Services.get<Service::Status>();
 			status->beep();
 		}
-	}, startingSettings.notificationSounds);
+	}, starting.notificationSounds);
 	lv_group_add_obj(inputGroup, *audioSwitch);
 
 	brightnessSlider = new SliderElement(container, "Brightness", [this](uint8_t value){
+		edit.draft().screenBrightness = value;
 		backlight.setBrightness(value);
-	}, startingSettings.screenBrightness);
+	}, starting.screenBrightness);
 	lv_group_add_obj(inputGroup, *brightnessSlider);
 
 	ledSwitch = new BoolElement(container, "LED enable", [this](bool value){
-		auto s = settings.get();
-		s.ledEnable = value;
-		settings.set(s);
+		edit.draft().ledEnable = value;
 
-		auto status = (StatusCenter*) Services.get(Service::Status);
-		status->updateLED();
+		auto status = Services.get<Service::Status>();
+		status->previewLED(value);
 
 		if(value){
 			status->blink();
 		}
-	}, startingSettings.notificationSounds);
+	}, starting.ledEnable);
 	lv_group_add_obj(inputGroup, *ledSwitch);
 
 	sleepSlider = new DiscreteSliderElement(container, "Sleep time", [this](uint8_t value){
 		if(value >= Settings::SleepSteps) return;
-		auto s = settings.get();
-		s.sleepTime = value;
-		settings.set(s);
-	}, std::vector<const char*>(Settings::SleepText, Settings::SleepText + Settings::SleepSteps), startingSettings.sleepTime);
+		edit.draft().sleepTime = value;
+	}, std::vector<const char*>(Settings::SleepText, Settings::SleepText + Settings::SleepSteps), starting.sleepTime);
 	lv_group_add_obj(inputGroup, *sleepSlider);
 
 	motionSwitch = new BoolElement(container, "Tilt to wake", [this](bool value){
-		auto s = settings.get();
-		s.motionDetection = value;
-		settings.set(s);
-	}, startingSettings.notificationSounds);
+		edit.draft().motionDetection = value;
+	}, starting.motionDetection);
 	lv_group_add_obj(inputGroup, *motionSwitch);
 
+	calibrate = new LabelElement(container, "Calibrate motion", [this](){
+		transition<CalibrationScreen>();
+	});
+	lv_group_add_obj(inputGroup, *calibrate);
+
 	saveAndExit = new LabelElement(container, "Save and Exit", [this](){
-		transition([](){ return std::make_unique<MainMenu>(); });
+		transition<MainMenu>();
 	});
 	lv_group_add_obj(inputGroup, *saveAndExit);
 
@@ -92,49 +98,46 @@ void SettingsScreen::loop(){
 		if(evt.facility == Facility::Input){
 			auto eventData = (Input::Data*) evt.data;
 			if(eventData->btn == Input::Alt && eventData->action == Input::Data::Press){
-				free(evt.data);
-				transition([](){ return std::make_unique<MainMenu>(); });
+				transition<MainMenu>();
 				return;
 			}
 		}
-		free(evt.data);
 	}
 
 	statusBar->loop();
 }
 
 void SettingsScreen::onStop(){
-	auto savedSettings = settings.get();
-	savedSettings.notificationSounds = audioSwitch->getValue();
-	savedSettings.screenBrightness = brightnessSlider->getValue();
-	savedSettings.sleepTime = sleepSlider->getValue();
-	savedSettings.ledEnable = ledSwitch->getValue();
-	savedSettings.motionDetection = motionSwitch->getValue();
-	settings.set(savedSettings);
-	settings.store();
-
-	backlight.setBrightness(brightnessSlider->getValue());
-	imu.enableTiltDetection(motionSwitch->getValue());
-	//TODO - apply sleep time
+	const bool tiltChanged = edit.draft().motionDetection != edit.base().motionDetection;
 
-	Events::unlisten(&queue);
+	// One set() for the whole session, listeners such as StatusCenter's LED pick it up from its Changed event
+	auto status = Services.get<Service::Status>();
+	if(!edit.commit()){
+		status->updateLED();
+	}
 
-	auto status = (StatusCenter*) Services.get(Service::Status);
+	if(tiltChanged){
+		imu.enableTiltDetection(edit.base().motionDetection);
+	}
+
+	Events::unlisten(&queue);
 	status->blockAudio(false);
-	status->updateLED();
 }
 
 void SettingsScreen::onStarting(){
-	brightnessSlider->setValue(settings.get().screenBrightness);
-	audioSwitch->setValue(settings.get().notificationSounds);
-	ledSwitch->setValue(settings.get().ledEnable);
-	sleepSlider->setValue(settings.get().sleepTime);
-	motionSwitch->setValue(settings.get().motionDetection);
+	edit.begin();
+
+	const auto& current = edit.base();
+	brightnessSlider->setValue(current.screenBrightness);
+	audioSwitch->setValue(current.notificationSounds);
+	ledSwitch->setValue(current.ledEnable);
+	sleepSlider->setValue(current.sleepTime);
+	motionSwitch->setValue(current.motionDetection);
 }
 
 void SettingsScreen::onStart(){
 	Events::listen(Facility::Input, &queue);
 
-	auto status = (StatusCenter*) Services.get(Service::Status);
+	auto status = Services.get<Service::Status>();
 	status->blockAudio(true);
 }
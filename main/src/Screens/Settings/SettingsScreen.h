@@ -28,6 +28,7 @@ private:
 	void loop() override;
 
 	Settings& settings;
+	Settings::Edit edit;
 	BacklightBrightness& backlight;
 	ChirpSystem& audio;
 	IMU& imu;
@@ -41,6 +42,7 @@ private:
 	DiscreteSliderElement* sleepSlider;
 	LabelElement* saveAndExit;
 	BoolElement* motionSwitch;
+	LabelElement* calibrate;
 
 	static constexpr uint8_t TopPadding = 18;
 
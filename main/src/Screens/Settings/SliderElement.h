@@ -4,7 +4,7 @@
 
 #include <functional>
 #include "LV_Interface/LVSelectable.h"
-#include "LV_Interface/LVStyle.h"
+#include "LV_Interface/LVText.h"
 
 class SliderElement : public LVSelectable {
 public:
@@ -14,16 +14,11 @@ public:
 	[[nodiscard]] uint8_t getValue() const; //0-100
 
 private:
-	lv_obj_t* label;
+	LVText* label;
 	lv_obj_t* slider;
 
 	static constexpr lv_style_selector_t sel = LV_PART_MAIN | LV_STATE_DEFAULT;
 	static constexpr lv_style_selector_t selFocus = LV_PART_MAIN | LV_STATE_FOCUSED;
-	LVStyle defaultStyle;
-	LVStyle focusedStyle;
-	LVStyle labelStyle;
-	LVStyle sliderMainStyle;
-	LVStyle sliderKnobStyle;
 
 	uint8_t value; //0-100
 	std::function<void(uint8_t)> cb;
@@ -1,4 +1,5 @@
 #include "ShutdownScreen.h"
+#include "Theme/styles.h"
 #include "Theme/theme.h"
 #include "Util/stdafx.h"
 
@@ -15,12 +16,8 @@ ShutdownScreen::ShutdownScreen(){
 	lv_obj_set_size(*this, 128, 128);
 	lv_obj_set_style_pad_bottom(*this, 16, 0);
 
-	label = lv_label_create(*this);
-	lv_obj_align(label, LV_ALIGN_BOTTOM_MID, 0, 0);
-	lv_label_set_text(label, "Low battery!\nShutting down.");
-	lv_obj_set_style_text_align(label, LV_TEXT_ALIGN_CENTER, 0);
-	lv_obj_set_style_text_font(label, &devin, 0);
-	lv_obj_set_style_text_color(label, lv_color_white(), 0);
+	label = new LVText(*this, "Low battery!\nShutting down.", &devin, lv_color_white(), LV_TEXT_ALIGN_CENTER, Styles::TextLineSpace);
+	lv_obj_align(*label, LV_ALIGN_BOTTOM_MID, 0, 0);
 
 	img = lv_img_create(*this);
 	lv_img_set_src(img, "S:/icons/bigLowBattery.bin");
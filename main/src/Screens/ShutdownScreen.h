@@ -3,6 +3,7 @@
 
 
 #include "LV_Interface/LVScreen.h"
+#include "LV_Interface/LVText.h"
 
 class ShutdownScreen : public LVScreen {
 public:
@@ -14,7 +15,7 @@ private:
 
 	void shutdown();
 
-	lv_obj_t* label;
+	LVText* label;
 	lv_obj_t* img;
 	lv_obj_t* bg;
 
@@ -1,7 +1,16 @@
 #include "ArpeggioSequence.h"
+#include "Periph/PWM.h"
 #include <algorithm>
 #include <esp_random.h>
 
+static constexpr bool notesReachable(){
+	for(const auto note : ArpeggioSequence::NotesArray){
+		if(PWM::divider(note) == 0) return false;
+	}
+	return true;
+}
+static_assert(notesReachable(), "Every arpeggio note needs a divider the LEDC timer can reach");
+
 void ArpeggioSequence::setBaseNote(Note note){
 	const auto it = std::find(std::begin(NotesArray), std::end(NotesArray), note);
 	if(it == std::end(NotesArray)) return;
@@ -13,60 +22,42 @@ void ArpeggioSequence::setBaseNote(Note note){
 
 void ArpeggioSequence::setBaseNoteIndex(uint16_t index){
 	if(index > MaxBaseNoteIndex) return;
-
-	const auto diff = index - baseNoteIndex;
-	if(diff == 0) return;
-
-	for(auto& note : sequence){
-		const auto i = std::find(std::begin(NotesArray), std::end(NotesArray), note);
-		const auto noteIndex = std::distance(NotesArray, i);
-		note = NotesArray[noteIndex + diff];
-	}
 	baseNoteIndex = index;
 }
 
 void ArpeggioSequence::setSize(uint8_t size){
 	if(size < 1 || size > MaxSequenceSize) return;
+	if(size == sequenceSize) return;
 
-	const auto diff = int(size) - int(sequenceSize);
-	const auto absDiff = abs(diff);
-	if(diff == 0) return;
-
+	const auto oldSize = sequenceSize;
 	sequenceSize = size;
-	if(diff < 0){
-		for(auto i = 0; i < absDiff; i++){
-			sequence.pop_back();
-		}
-	}else{
-		addRandomNotes(absDiff);
+	if(size > oldSize){
+		randomizeFrom(oldSize);
 	}
 }
 
-void ArpeggioSequence::addRandomNotes(uint8_t num){
-	if(num == 0 || num > MaxSequenceSize) return;
-
-	std::vector<Note> possibleNotes = { NotesArray + baseNoteIndex, NotesArray + baseNoteIndex + sequenceSize };
-
-	for(auto& note : sequence){
-		const auto it = std::find(std::begin(possibleNotes), std::end(possibleNotes), note);
-		if(it != std::end(possibleNotes)){
-			possibleNotes.erase(it);
-		}
+void ArpeggioSequence::randomizeFrom(uint8_t first){
+	// New notes are picked from the ones not yet in the sequence
+	std::array<uint8_t, MaxSequenceSize> possible{};
+	uint8_t possibleCount = 0;
+	for(uint8_t offset = 0; offset < sequenceSize; offset++){
+		if(std::find(offsets.begin(), offsets.begin() + first, offset) != offsets.begin() + first) continue;
+		possible[possibleCount++] = offset;
 	}
+	if(possibleCount == 0) return;
 
-	for(auto i = 0; i < num; i++){
-		sequence.push_back(possibleNotes[esp_random() % possibleNotes.size()]);
+	for(uint8_t i = first; i < sequenceSize; i++){
+		offsets[i] = possible[esp_random() % possibleCount];
 	}
 }
 
 void ArpeggioSequence::refresh(){
-	sequence.clear();
-	sequence.push_back(NotesArray[baseNoteIndex]);
-	addRandomNotes(sequenceSize - 1);
+	offsets[0] = 0;
+	randomizeFrom(1);
 }
 
-const std::vector<ArpeggioSequence::Note>& ArpeggioSequence::getTones() const{
-	return sequence;
+ArpeggioSequence::Note ArpeggioSequence::getTone(uint8_t index) const{
+	return NotesArray[baseNoteIndex + offsets[std::min(index, (uint8_t) (sequenceSize - 1))]];
 }
 
 uint16_t ArpeggioSequence::getBaseNoteIndex() const{
@@ -2,8 +2,13 @@
 #define CLOCKSTAR_FIRMWARE_ARPEGGIOSEQUENCE_H
 
 #include "Util/Notes.h"
-#include <random>
+#include <array>
+#include <cstdint>
 
+/**
+ * Random arpeggio over the sequence's size worth of notes from the base note up, always starting on the base note.
+ * Notes are stored as offsets from the base note in a fixed size array, nothing is allocated.
+ */
 class ArpeggioSequence {
 	typedef uint16_t Note;
 public:
@@ -15,7 +20,7 @@ public:
 	[[nodiscard]] uint16_t getBaseNoteIndex() const;
 	[[nodiscard]] uint16_t getBaseNote() const;
 	[[nodiscard]] uint8_t getSize() const;
-	[[nodiscard]] const std::vector<Note>& getTones() const;
+	[[nodiscard]] Note getTone(uint8_t index) const;
 
 
 	static constexpr Note NotesArray[] = {
@@ -35,8 +40,8 @@ private:
 
 	uint16_t baseNoteIndex = 7; //defaults to NOTE_E3, ranges from 0 to (NumNotes - MaxSequenceSize)
 	uint8_t sequenceSize = 1; // ranges from 1 to MaxSequenceSize
-	std::vector<Note> sequence{};
-	void addRandomNotes(uint8_t num);
+	std::array<uint8_t, MaxSequenceSize> offsets{}; // From baseNoteIndex, the first sequenceSize are used
+	void randomizeFrom(uint8_t first);
 };
 
 
@@ -0,0 +1,44 @@
+#ifndef CLOCKSTAR_FIRMWARE_HINTLAYOUT_H
+#define CLOCKSTAR_FIRMWARE_HINTLAYOUT_H
+
+#include <lvgl.h>
+
+// Generated by tools/layout_gen.py, don't edit
+
+/**
+ * Placement of Theremin's hint rows within their containers. Each piece is either text in devin or an image,
+ * images with a gap get the ThereminArrow style.
+ */
+namespace HintLayout {
+
+	struct Piece {
+		const char* text;
+		const char* img;
+		lv_coord_t x;
+		lv_coord_t y;
+		bool gap;
+	};
+
+	constexpr lv_coord_t VerticalWidth = 60;
+	constexpr Piece Vertical[] = {
+			{ "Tilt", nullptr, 0, 0, false },
+			{ nullptr, "S:/theremin/up.bin", 25, 0, true },
+			{ nullptr, "S:/theremin/down.bin", 38, 0, false },
+			{ "to change", nullptr, 0, 9, false },
+			{ "the number", nullptr, 0, 16, false },
+			{ "of tones", nullptr, 0, 23, false },
+	};
+
+	constexpr lv_coord_t HorizontalWidth = 80;
+	constexpr Piece Horizontal[] = {
+			{ "Tilt", nullptr, 0, 0, false },
+			{ nullptr, "S:/theremin/left.bin", 25, 0, true },
+			{ nullptr, "S:/theremin/right.bin", 38, 0, false },
+			{ "to change", nullptr, 0, 9, false },
+			{ "base frequency", nullptr, 0, 16, false },
+	};
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_HINTLAYOUT_H
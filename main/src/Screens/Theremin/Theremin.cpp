@@ -1,25 +1,49 @@
 #include "Theremin.h"
 #include <algorithm>
+#include <esp_log.h>
 #include "Util/Services.h"
 #include "Util/stdafx.h"
 #include "Devices/Input.h"
 #include "Screens/MainMenu/MainMenu.h"
 #include "Services/StatusCenter.h"
 #include "Services/SleepMan.h"
-
-
-Theremin::Theremin() : audio(*(ChirpSystem*) Services.get(Service::Audio)), sem(xSemaphoreCreateBinary()),
-					   timer(getToneDuration(sequence.getSize()), timerCB, sem),
-					   audioThread([this](){ audioThreadFunc(); }, "Theremin audio", 2048, 5, 1), imu((IMU*) Services.get(Service::IMU)),
-					   pitchFilter(filterStrength), rollFilter(filterStrength), queue(4){
+#include "LV_Interface/LVGL.h"
+#include "LV_Interface/LVText.h"
+#include "LV_Interface/LVBuild.h"
+#include "Theme/theme.h"
+
+static const char* TAG = "Theremin";
+
+static constexpr const char* AssetPaths[] = {
+		"S:/theremin/horizontalBar.bin",
+		"S:/theremin/verticalBar.bin",
+		"S:/theremin/dot.bin",
+		"S:/theremin/up.bin",
+		"S:/theremin/down.bin",
+		"S:/theremin/left.bin",
+		"S:/theremin/right.bin"
+};
+const LVScreen::AssetList Theremin::Assets = { AssetPaths, sizeof(AssetPaths) / sizeof(AssetPaths[0]) };
+
+Theremin::Theremin() : audio(*Services.get<Service::Audio>()),
+					   baseNoteIndex(sequence.getBaseNoteIndex()), sequenceSize(sequence.getSize()), sem(xSemaphoreCreateBinary()),
+					   audioThread([this](){ audioThreadFunc(); }, "Theremin audio", 2048, PlannedTask::ThereminAudio),
+					   queue(4, "Theremin"){
 	buildUI();
-	sequence.refresh();
 
-	xSemaphoreGive(sem);
+	const esp_timer_create_args_t args = {
+			.callback = timerCB,
+			.arg = sem,
+			.dispatch_method = ESP_TIMER_ISR,
+			.name = "Theremin",
+			.skip_unhandled_events = true
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&args, &timer));
 }
 
 
 Theremin::~Theremin(){
+	esp_timer_delete(timer);
 	vSemaphoreDelete(sem);
 }
 
@@ -38,41 +62,35 @@ void Theremin::setOrientation(float pitch, float roll){
 	const auto mappedNote = (uint16_t) map(roll, -AngleConstraint, AngleConstraint, 0, ArpeggioSequence::MaxBaseNoteIndex);
 	const auto mappedSize = (uint8_t) map(pitch, -AngleConstraint, AngleConstraint, 1, ArpeggioSequence::MaxSequenceSize);
 
-	if(mappedNote != sequence.getBaseNoteIndex()){
-		sequence.setBaseNoteIndex(mappedNote);
-	}
-
-	if(mappedSize != sequence.getSize()){
-		sequence.setSize(mappedSize);
-		timer.stop();
-		timer.setPeriod(getToneDuration(sequence.getSize()));
-		timer.start();
-	}
+	baseNoteIndex = mappedNote;
+	sequenceSize = mappedSize;
 }
 
 void Theremin::onStart(){
-	auto sleep = (SleepMan*) Services.get(Service::Sleep);
+	auto sleep = Services.get<Service::Sleep>();
 	sleep->enAutoSleep(false);
 
-	auto status = (StatusCenter*) Services.get(Service::Status);
+	auto status = Services.get<Service::Status>();
 	status->blockAudio(true);
 
 	audio.setPersistentAttach(true);
 
-	const IMU::Sample reading = imu->getSample();
-	const PitchRoll pitchRoll = { -(float) reading.accelY, -(float) reading.accelX };
-	pitchFilter.reset(pitchRoll.pitch);
-	rollFilter.reset(pitchRoll.roll);
-	setOrientation(pitchRoll.pitch, pitchRoll.roll);
+	if(orientation){
+		orientation->acquire(true);
+	}else{
+		ESP_LOGE(TAG, "Orientation service error");
+	}
+	lastUpdate = 0;
 
 	abortFlag = false;
 	audioThread.start();
-	timer.start();
+	esp_timer_start_periodic(timer, SequenceDuration * 1000);
+	xSemaphoreGive(sem);
 	Events::listen(Facility::Input, &queue);
 }
 
 void Theremin::onStop(){
-	timer.stop();
+	esp_timer_stop(timer);
 	audio.stop();
 	audio.setPersistentAttach(false);
 
@@ -83,12 +101,15 @@ void Theremin::onStop(){
 		vTaskDelay(1);
 	}
 
+	if(orientation){
+		orientation->release(true);
+	}
 	Events::unlisten(&queue);
 
-	auto status = (StatusCenter*) Services.get(Service::Status);
+	auto status = Services.get<Service::Status>();
 	status->blockAudio(false);
 
-	auto sleep = (SleepMan*) Services.get(Service::Sleep);
+	auto sleep = Services.get<Service::Sleep>();
 	sleep->enAutoSleep(true);
 }
 
@@ -99,48 +120,47 @@ void Theremin::loop(){
 		if(evt.facility == Facility::Input){
 			auto eventData = (Input::Data*) evt.data;
 			if(eventData->btn == Input::Alt && eventData->action == Input::Data::Press){
-				free(evt.data);
-				transition([](){ return std::make_unique<MainMenu>(); });
+				transition<MainMenu>();
 				return;
 			}
 		}
-		free(evt.data);
 	}
 
-	const IMU::Sample reading = imu->getSample();
-	const PitchRoll pitchRoll = { (float) pitchFilter.update(-reading.accelY), (float) rollFilter.update(-reading.accelX) };
-	setOrientation(pitchRoll.pitch, pitchRoll.roll);
+	if(!orientation) return;
+
+	const auto state = orientation->get();
+	if(state.time == lastUpdate) return;
+	lastUpdate = state.time;
+
+	setOrientation(-state.gravity.y, -state.gravity.x);
+	LVGL::markInput(state.time);
 }
 
 void IRAM_ATTR Theremin::timerCB(void* arg){
-	BaseType_t priority = pdFALSE;
-	xSemaphoreGiveFromISR(arg, &priority);
+	BaseType_t woken = pdFALSE;
+	xSemaphoreGiveFromISR(arg, &woken);
+	if(woken){
+		esp_timer_isr_dispatch_need_yield();
+	}
 }
 
 void Theremin::audioThreadFunc(){
 	while(!xSemaphoreTake(sem, portMAX_DELAY));
-	timer.stop();
-
 	if(abortFlag) return;
 
-	if(sequenceIndex >= sequence.getSize()){
-		sequenceIndex = 0;
-	}
+	sequence.setBaseNoteIndex(baseNoteIndex);
+	sequence.setSize(sequenceSize);
+	sequence.refresh();
 
-	if(sequenceIndex == 0){
-		sequence.refresh();
-		timer.setPeriod(getToneDuration(sequence.getSize()));
+	const uint8_t size = sequence.getSize();
+	const uint16_t toneDuration = getToneDuration(size) / 2;
+	for(uint8_t i = 0; i < size; i++){
+		const auto freq = sequence.getTone(i);
+		chirps[i * 2] = { freq, freq, toneDuration };
+		chirps[i * 2 + 1] = { 0, 0, toneDuration };
 	}
 
-	const auto freq = sequence.getTones()[sequenceIndex];
-	const uint16_t toneDuration = getToneDuration(sequence.getSize()) / 2;
-	const Sound sound = { { freq, freq, toneDuration },
-						  { 0,    0,    toneDuration } };
-
-	audio.play(sound);
-	timer.start();
-
-	sequenceIndex++;
+	audio.play(chirps.data(), size * 2);
 }
 
 constexpr uint32_t Theremin::getToneDuration(uint8_t sequenceSize){
@@ -148,79 +168,50 @@ constexpr uint32_t Theremin::getToneDuration(uint8_t sequenceSize){
 }
 
 void Theremin::buildUI(){
-	lv_style_set_text_color(textStyle, lv_color_white());
-
-
-	bg = lv_obj_create(*this);
-	lv_obj_set_pos(bg, 0, 0);
-	lv_obj_set_size(bg, 128, 128);
-	lv_obj_set_style_bg_img_src(bg, "S:/bg.bin", 0);
-	lv_obj_set_style_bg_img_tiled(bg, true, 0);
-
-
-	sliderHorizontal = lv_slider_create(bg);
-	lv_obj_set_pos(sliderHorizontal, HorizontalBarX, HorizontalBarY);
-	lv_obj_set_size(sliderHorizontal, SliderLength, SliderWidth);
-	lv_obj_set_style_bg_img_src(sliderHorizontal, "S:/theremin/horizontalBar.bin", 0);
-	lv_obj_set_style_bg_img_src(sliderHorizontal, "S:/theremin/dot.bin", LV_PART_KNOB);
-	lv_obj_set_style_pad_hor(sliderHorizontal, 5, LV_PART_MAIN);
-	lv_slider_set_range(sliderHorizontal, 0, SliderRange);
-
-
-	sliderVertical = lv_slider_create(bg);
-	lv_obj_set_pos(sliderVertical, VerticalBarX, VerticalBarY);
-	lv_obj_set_size(sliderVertical, SliderWidth, SliderLength);
-	lv_obj_set_style_bg_img_src(sliderVertical, "S:/theremin/verticalBar.bin", 0);
-	lv_obj_set_style_bg_img_src(sliderVertical, "S:/theremin/dot.bin", LV_PART_KNOB);
-	lv_obj_set_style_pad_bottom(sliderVertical, 5, LV_PART_MAIN);
-	lv_slider_set_range(sliderHorizontal, 0, SliderRange);
-
-
-	textVertical = lv_obj_create(bg);
-	lv_obj_set_layout(textVertical, LV_LAYOUT_FLEX);
-	lv_obj_set_flex_flow(textVertical, LV_FLEX_FLOW_ROW_WRAP);
-	lv_obj_set_flex_align(textVertical, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START);
-	lv_obj_set_size(textVertical, 60, 40);
-	lv_obj_set_pos(textVertical, VerticalTextX, VerticalTextY);
-	lv_obj_set_style_pad_column(textVertical, 3, 0);
-	auto label = lv_label_create(textVertical);
-	lv_label_set_text(label, "Tilt");
-	lv_obj_add_style(label, textStyle, 0);
-	auto arrow = lv_img_create(textVertical);
-	lv_img_set_src(arrow, "S:/theremin/up.bin");
-	lv_obj_set_style_pad_left(arrow, 1, 0);
-	arrow = lv_img_create(textVertical);
-	lv_img_set_src(arrow, "S:/theremin/down.bin");
-	label = lv_label_create(textVertical);
-	lv_label_set_text(label, "to change");
-	lv_obj_add_style(label, textStyle, 0);
-	label = lv_label_create(textVertical);
-	lv_label_set_text(label, "the number");
-	lv_obj_add_style(label, textStyle, 0);
-	label = lv_label_create(textVertical);
-	lv_label_set_text(label, "of tones");
-	lv_obj_add_style(label, textStyle, 0);
-
-
-	textHorizontal = lv_obj_create(bg);
-	lv_obj_set_layout(textHorizontal, LV_LAYOUT_FLEX);
-	lv_obj_set_flex_flow(textHorizontal, LV_FLEX_FLOW_ROW_WRAP);
-	lv_obj_set_flex_align(textHorizontal, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START);
-	lv_obj_set_size(textHorizontal, 80, 40);
-	lv_obj_set_pos(textHorizontal, HorizontalTextX, HorizontalTextY);
-	lv_obj_set_style_pad_column(textHorizontal, 3, 0);
-	label = lv_label_create(textHorizontal);
-	lv_label_set_text(label, "Tilt");
-	lv_obj_add_style(label, textStyle, 0);
-	arrow = lv_img_create(textHorizontal);
-	lv_img_set_src(arrow, "S:/theremin/left.bin");
-	lv_obj_set_style_pad_left(arrow, 1, 0);
-	arrow = lv_img_create(textHorizontal);
-	lv_img_set_src(arrow, "S:/theremin/right.bin");
-	label = lv_label_create(textHorizontal);
-	lv_label_set_text(label, "to change");
-	lv_obj_add_style(label, textStyle, 0);
-	label = lv_label_create(textHorizontal);
-	lv_label_set_text(label, "base frequency");
-	lv_obj_add_style(label, textStyle, 0);
+	bg = LVBuild::obj(*this,
+		LVBuild::Style{ Styles::Backdrop },
+		LVBuild::Pos{ 0, 0 },
+		LVBuild::Size{ 128, 128 });
+
+
+	sliderHorizontal = LVBuild::slider(bg,
+		LVBuild::Style{ Styles::ThereminBarH },
+		LVBuild::Style{ Styles::ThereminKnob, LV_PART_KNOB },
+		LVBuild::Pos{ HorizontalBarX, HorizontalBarY },
+		LVBuild::Size{ SliderLength, SliderWidth },
+		LVBuild::Range{ 0, SliderRange });
+
+
+	sliderVertical = LVBuild::slider(bg,
+		LVBuild::Style{ Styles::ThereminBarV },
+		LVBuild::Style{ Styles::ThereminKnob, LV_PART_KNOB },
+		LVBuild::Pos{ VerticalBarX, VerticalBarY },
+		LVBuild::Size{ SliderWidth, SliderLength },
+		LVBuild::Range{ 0, SliderRange });
+
+
+	textVertical = LVBuild::obj(bg,
+		LVBuild::Size{ HintLayout::VerticalWidth, 40 },
+		LVBuild::Pos{ VerticalTextX, VerticalTextY });
+	buildHint(textVertical, HintLayout::Vertical);
+
+
+	textHorizontal = LVBuild::obj(bg,
+		LVBuild::Size{ HintLayout::HorizontalWidth, 40 },
+		LVBuild::Pos{ HorizontalTextX, HorizontalTextY });
+	buildHint(textHorizontal, HintLayout::Horizontal);
+}
+
+template<size_t N>
+void Theremin::buildHint(lv_obj_t* parent, const HintLayout::Piece (& pieces)[N]){
+	for(const auto& piece : pieces){
+		if(piece.text){
+			auto text = new LVText(parent, piece.text, &devin, lv_color_white());
+			lv_obj_set_pos(*text, piece.x, piece.y);
+		}else if(piece.gap){
+			LVBuild::img(parent, LVBuild::Style{ Styles::ThereminArrow }, LVBuild::Src{ piece.img }, LVBuild::Pos{ piece.x, piece.y });
+		}else{
+			LVBuild::img(parent, LVBuild::Src{ piece.img }, LVBuild::Pos{ piece.x, piece.y });
+		}
+	}
 }
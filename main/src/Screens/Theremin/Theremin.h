@@ -2,14 +2,16 @@
 #define CLOCKSTAR_FIRMWARE_THEREMIN_H
 
 #include <atomic>
+#include <array>
+#include <esp_timer.h>
 #include "LV_Interface/LVScreen.h"
-#include "LV_Interface/LVStyle.h"
 #include "ArpeggioSequence.h"
 #include "Services/ChirpSystem.h"
 #include "Util/Queue.h"
-#include "Util/EMA.h"
-#include "Devices/IMU.h"
+#include "Services/Orientation.h"
 #include "Util/Events.h"
+#include "Util/Services.h"
+#include "HintLayout.h"
 
 class Theremin : public LVScreen {
 public:
@@ -18,6 +20,8 @@ public:
 
 	void setOrientation(float pitch, float roll);
 
+	static const AssetList Assets;
+
 private:
 	void onStart() override;
 	void onStop() override;
@@ -42,37 +46,39 @@ private:
 	static constexpr uint8_t HorizontalBarY = 110;
 	static constexpr uint8_t HorizontalTextX = 23;
 	static constexpr uint8_t HorizontalTextY = 75;
-	LVStyle textStyle;
 
 	ChirpSystem& audio;
-	ArpeggioSequence sequence;
 
+	// Owned by the audio thread. setOrientation only leaves the settings for the next sequence to pick up.
+	ArpeggioSequence sequence;
+	std::atomic_uint16_t baseNoteIndex;
+	std::atomic_uint8_t sequenceSize;
 
 	static constexpr uint32_t DRAM_ATTR SequenceDuration = 800; //ms
 	static constexpr uint32_t getToneDuration(uint8_t sequenceSize);
 
+	// A whole sequence is compiled into one sound, the sweep engine times its notes
+	std::array<Chirp, ArpeggioSequence::MaxSequenceSize * 2> chirps;
+
 	SemaphoreHandle_t sem;
-	Timer timer;
+	esp_timer_handle_t timer; // Periodic, one sequence per period
 	static void timerCB(void* arg);
 
 	ThreadedClosure audioThread;
 	void audioThreadFunc();
-	volatile uint8_t sequenceIndex = 0;
 
 
-	IMU* imu;
-	struct PitchRoll {
-		float pitch;
-		float roll;
-	};
-	EMA pitchFilter;
-	EMA rollFilter;
-	static constexpr float filterStrength = 0.12;
+	ServiceHold<Service::Orientation> orientation;
+	uint64_t lastUpdate = 0; // [us], time of the last applied orientation
 
 	EventQueue queue;
 	std::atomic_bool abortFlag = false;
 
 	void buildUI();
+
+	/** Places a hint row at the coordinates from tools/layout_gen.py, they're fixed so the rows need no flex layout */
+	template<size_t N>
+	void buildHint(lv_obj_t* parent, const HintLayout::Piece (& pieces)[N]);
 };
 
 
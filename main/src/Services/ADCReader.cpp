@@ -2,27 +2,34 @@
 #include <algorithm>
 
 ADCReader::ADCReader(ADC& adc, adc_channel_t chan, adc_cali_handle_t cali, float offset, float factor, float emaA, float min, float max)
-		: adc(adc), chan(chan), cali(cali), offset(offset), factor(factor), emaA(emaA), min(min), max(max){
+		: adc(&adc), chan(chan), cali(cali), offset(offset), factor(factor), ema(emaA), min(min), max(max){
+
+}
+
+ADCReader::ADCReader(ADCBurst& burst, adc_channel_t chan, adc_cali_handle_t cali, float offset, float factor, float emaA, float min, float max)
+		: burst(&burst), chan(chan), cali(cali), offset(offset), factor(factor), ema(emaA), min(min), max(max){
 
 }
 
 float ADCReader::sample(){
 	int raw = 0;
-	if(adc.read(chan, raw, cali) != ESP_OK){
+	const esp_err_t err = burst ? burst->read(chan, raw, cali) : adc->read(chan, raw, cali);
+	if(err != ESP_OK){
 		return getValue();
 	}
 
-	if(value == -1 || emaA == 1){
-		value = raw;
+	if(!primed){
+		ema.reset(raw);
+		primed = true;
 	}else{
-		value = value * (1.0f - emaA) + emaA * (float) raw;
+		ema.update(raw);
 	}
 
 	return getValue();
 }
 
 float ADCReader::getValue() const{
-	const float adjusted = value * factor + offset + moreOffset;
+	const float adjusted = ema.get() * factor + offset + moreOffset;
 
 	if(max == 0 && min == 0){
 		return adjusted;
@@ -47,7 +54,7 @@ float ADCReader::getValue() const{
 }
 
 void ADCReader::resetEma(){
-	value = -1;
+	primed = false;
 	sample();
 }
 
@@ -56,6 +63,6 @@ void ADCReader::setMoreOffset(float offset){
 }
 
 void ADCReader::setEMAFactor(float factor){
-	emaA = factor;
+	ema = DSP::EMA<float>(factor);
 	resetEma();
 }
@@ -4,6 +4,8 @@
 #include <esp_adc/adc_cali.h>
 #include <hal/adc_types.h>
 #include "Periph/ADC.h"
+#include "Periph/ADCBurst.h"
+#include "Util/DSP.h"
 
 class ADCReader {
 public:
@@ -23,6 +25,11 @@ public:
 	 */
 	ADCReader(ADC& adc, adc_channel_t chan, adc_cali_handle_t cali = nullptr, float offset = 0, float factor = 1, float emaA = 1, float min = 0, float max = 0);
 
+	/**
+	 * Same as above, but every sample is the average of a burst of conversions, see ADCBurst.
+	 */
+	ADCReader(ADCBurst& burst, adc_channel_t chan, adc_cali_handle_t cali = nullptr, float offset = 0, float factor = 1, float emaA = 1, float min = 0, float max = 0);
+
 	/** Sample and return new value. */
 	float sample();
 
@@ -42,18 +49,18 @@ public:
 	void setEMAFactor(float factor);
 
 private:
-	ADC& adc;
+	ADC* adc = nullptr;
+	ADCBurst* burst = nullptr;
 	const adc_channel_t chan;
 	const adc_cali_handle_t cali;
 
 	const float offset;
 	const float factor;
-	float emaA;
+	DSP::EMA<float> ema;
+	bool primed = false; // The next sample resets the EMA
 	const float min;
 	const float max;
 
-	float value = -1.0f;
-
 	float moreOffset = 0;
 
 };
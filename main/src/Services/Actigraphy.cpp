@@ -0,0 +1,124 @@
+#include "Actigraphy.h"
+#include "Time.h"
+#include "DataLog.h"
+#include "Util/Services.h"
+#include <algorithm>
+#include <cmath>
+
+Actigraphy::Actigraphy(IMU& imu) : imu(imu){
+
+}
+
+Actigraphy::~Actigraphy(){
+	setSleep(false);
+}
+
+void Actigraphy::setSleep(bool sleep){
+	if(sleep){
+		std::lock_guard lock(mut);
+		if(tracking || imu.isFIFOEnabled()) return;
+
+		current = {};
+		hasPrev = false;
+		tracking = true;
+
+		imu.setFIFOLowRate(true);
+		imu.setFIFOWatermark(Watermark);
+		imu.setFIFOListener(this);
+		imu.enableFIFO(true);
+		return;
+	}
+
+	imu.setFIFOListener(nullptr);
+	TaskPool::get().cancel(this);
+
+	std::lock_guard lock(mut);
+	if(!tracking) return;
+
+	// Batches already in the ring still complete epochs, the open one is missing what's left in the sensor
+	process();
+	tracking = false;
+
+	imu.enableFIFO(false);
+	imu.setFIFOWatermark();
+	imu.setFIFOLowRate(false);
+}
+
+size_t Actigraphy::take(Epoch* out, size_t max){
+	std::lock_guard lock(mut);
+
+	const size_t n = std::min(max, count);
+	size_t tail = (head + Capacity - count) % Capacity;
+	for(size_t i = 0; i < n; i++){
+		out[i] = ring[tail];
+		tail = (tail + 1) % Capacity;
+	}
+	count -= n;
+	return n;
+}
+
+void Actigraphy::run(){
+	{
+		std::lock_guard lock(mut);
+		if(!tracking) return;
+		process();
+	}
+
+	// DataLog is paused through sleep, so the epochs are handed over with every batch before the ring fills up
+	auto log = Services.get<Service::DataLog>();
+	if(log){
+		log->takeEpochs();
+	}
+}
+
+void Actigraphy::process(){
+	size_t closed = 0;
+	uint32_t read = 0;
+
+	size_t n;
+	while((n = imu.readFIFO(batch, ReadSize)) > 0){
+		for(size_t i = 0; i < n; i++){
+			closed += feed(batch[i], read + i);
+		}
+		read += n;
+	}
+	if(closed == 0) return;
+
+	// The batch was read right after its watermark interrupt, so its last sample is taken as now
+	auto time = Services.get<Service::Time>();
+	const auto now = time ? (uint32_t) time->now() : 0;
+
+	// Epochs closed in this pass are the newest ones in the ring
+	closed = std::min(closed, count);
+	for(size_t i = 0; i < closed; i++){
+		Epoch& epoch = ring[(head + Capacity - 1 - i) % Capacity];
+		const auto since = (uint32_t) std::lround((read - 1 - epoch.time) / IMU::LowFIFORate);
+		epoch.time = now > since ? now - since : 0;
+	}
+}
+
+bool Actigraphy::feed(const IMU::Sample& sample, uint32_t index){
+	if(hasPrev){
+		// Vector difference instead of the magnitude, turning over at rest changes the direction of gravity only
+		const float dx = sample.accelX - prev.accelX;
+		const float dy = sample.accelY - prev.accelY;
+		const float dz = sample.accelZ - prev.accelZ;
+		const float change = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+		current.pim += (uint32_t) std::lround(change * 1000.0f);
+		if(change > ActiveThresh){
+			current.active++;
+		}
+	}
+	prev = sample;
+	hasPrev = true;
+
+	if(++current.samples < EpochSamples) return false;
+
+	current.time = index;
+	ring[head] = current;
+	head = (head + 1) % Capacity;
+	count = std::min(count + 1, Capacity);
+	current = {};
+	return true;
+}
@@ -0,0 +1,72 @@
+#ifndef CLOCKSTAR_FIRMWARE_ACTIGRAPHY_H
+#define CLOCKSTAR_FIRMWARE_ACTIGRAPHY_H
+
+#include "Devices/IMU.h"
+#include "Util/TaskPool.h"
+#include <mutex>
+
+/**
+ * Movement per minute while the watch sleeps, for telling sleep from rest on the phone. Going to sleep switches the
+ * IMU FIFO to its low rate, accelerometer only, with the largest watermark, so the chip is woken once per batch of
+ * 160 s instead of for every sample, ~23 times an hour. Each batch is reduced to its epochs in one pass on the
+ * TaskPool, the samples themselves aren't kept. DataLog takes the closed epochs into the log.
+ *
+ * The FIFO is only taken if nothing else holds it when the watch goes to sleep. Samples still in the sensor when the
+ * watch wakes are dropped with the epoch they belong to.
+ */
+class Actigraphy : private TaskPool::Job {
+public:
+	Actigraphy(IMU& imu);
+	~Actigraphy() override;
+
+	/** Called by Sleep on the way into sleep and out of it */
+	void setSleep(bool sleep);
+
+	struct Epoch {
+		uint32_t time; // [s] Unix time the epoch ended
+		uint32_t pim; // [mg] Proportional integration of the sample to sample acceleration change
+		uint8_t samples; // Shorter than EpochSamples if the watch woke up, at 3.125 Hz
+		uint8_t active; // Samples with a change over ActiveThresh
+	};
+
+	static constexpr size_t EpochSamples = 188; // ~60 s at IMU::LowFIFORate
+
+	/**
+	 * Moves up to max closed epochs into out, oldest first.
+	 * @return Number of epochs written
+	 */
+	size_t take(Epoch* out, size_t max);
+
+private:
+	IMU& imu;
+
+	static constexpr uint16_t Watermark = IMU::MaxLowRateWatermark; // [samples], 160 s at 3.125 Hz
+	static constexpr float ActiveThresh = 0.05f; // [g]
+	static constexpr size_t ReadSize = 32; // [samples]
+	static constexpr size_t Capacity = 16; // [epochs] kept until DataLog takes them
+
+	std::mutex mut; // Guards the epoch ring and tracking
+	Epoch ring[Capacity];
+	size_t head = 0; // Next write position
+	size_t count = 0;
+
+	bool tracking = false;
+	Epoch current = {};
+	IMU::Sample prev = {};
+	bool hasPrev = false;
+	IMU::Sample batch[ReadSize];
+
+	/** Reads the batches in the ring and closes the epochs they fill up. Call under mut. */
+	void process();
+	void run() override;
+
+	/**
+	 * @param index Of the sample within the processed batches, kept as the epoch's time until the time is known
+	 * @return True if the sample closed an epoch
+	 */
+	bool feed(const IMU::Sample& sample, uint32_t index);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_ACTIGRAPHY_H
@@ -0,0 +1,78 @@
+#include "Activity.h"
+#include "Time.h"
+#include "Util/Services.h"
+#include "Util/stdafx.h"
+
+Activity::Activity(IMU& imu) : SleepyThreaded(UpdateInterval, "Activity"), imu(imu), events(32){
+	Events::listen(Facility::Motion, &events);
+
+	imu.enablePedometer(true);
+	imu.enableMotionDetection(true);
+	lastCount = imu.getStepCount();
+
+	start();
+}
+
+Activity::~Activity(){
+	stop();
+	Events::unlisten(&events);
+
+	imu.enableMotionDetection(false);
+	imu.enablePedometer(false);
+}
+
+uint32_t Activity::getSteps(){
+	std::lock_guard lock(mut);
+	updateSteps();
+	return steps;
+}
+
+Activity::State Activity::getState() const{
+	return state;
+}
+
+void Activity::sleepyLoop(){
+	Event evt;
+	while(events.get(evt, 0)){
+		auto param = (IMU::Event*) evt.data;
+		if(param->action == IMU::Event::SignMotion){
+			moved();
+		}
+	}
+
+	{
+		std::lock_guard lock(mut);
+		updateSteps();
+	}
+
+	if(state == State::Moving && millis() - lastMotion >= StillTimeout){
+		state = State::Still;
+	}
+}
+
+void Activity::updateSteps(){
+	const uint16_t count = imu.getStepCount();
+	// Unsigned 16-bit difference stays right across one counter wrap
+	const uint16_t delta = count - lastCount;
+	lastCount = count;
+
+	if(auto time = Services.get<Service::Time>()){
+		const int today = time->getTime().tm_yday;
+		if(day != today){
+			// Steps since the last update are counted into the new day. The first known day keeps the steps since boot
+			if(day != -1){
+				steps = 0;
+			}
+			day = today;
+		}
+	}
+
+	if(delta == 0) return;
+	steps += delta;
+	moved();
+}
+
+void Activity::moved(){
+	lastMotion = millis();
+	state = State::Moving;
+}
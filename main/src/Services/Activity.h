@@ -0,0 +1,50 @@
+#ifndef CLOCKSTAR_FIRMWARE_ACTIVITY_H
+#define CLOCKSTAR_FIRMWARE_ACTIVITY_H
+
+#include "Devices/IMU.h"
+#include "Util/Events.h"
+#include "Util/Threaded.h"
+#include <atomic>
+#include <mutex>
+
+/**
+ * Daily step count and a coarse activity state, offloaded to the IMU's pedometer and significant motion engines.
+ * The service only reads the hardware step counter and reacts to motion interrupts, it never touches sensor samples.
+ * Paused during sleep while the IMU keeps counting, the steps taken meanwhile are picked up on resume.
+ */
+class Activity : public SleepyThreaded {
+public:
+	Activity(IMU& imu);
+	~Activity() override;
+
+	enum class State {
+		Still, Moving
+	};
+
+	/** Steps counted since midnight, or since boot if the time hasn't been set. */
+	uint32_t getSteps();
+	State getState() const;
+
+private:
+	IMU& imu;
+	EventQueue events;
+
+	static constexpr uint32_t UpdateInterval = 1000; // [ms]
+	static constexpr uint32_t StillTimeout = 60000; // [ms] without steps or significant motion
+
+	std::mutex mut;
+	uint16_t lastCount = 0; // Hardware counter at the last update
+	uint32_t steps = 0;
+	int day = -1; // tm_yday the steps belong to
+
+	std::atomic<State> state = State::Still;
+	std::atomic_uint32_t lastMotion = 0; // [ms]
+
+	void sleepyLoop() override;
+	void updateSteps();
+	void moved();
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_ACTIVITY_H
@@ -3,15 +3,19 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <cmath>
+#include <esp_log.h>
 #include "Util/Services.h"
 #include "Util/stdafx.h"
 
-BacklightBrightness::BacklightBrightness(PWM* pwm) : pwm(*pwm){
+static const char* TAG = "Backlight";
+
+BacklightBrightness::BacklightBrightness(PWM* pwm) : pwm(*pwm), fadeSem(xSemaphoreCreateBinary()){
 
 }
 
 void BacklightBrightness::setBrightness(uint8_t level){
-	pwm.setDuty(mapDuty(level));
+	duty = mapDuty(level);
+	pwm.setDuty(duty);
 }
 
 constexpr uint8_t BacklightBrightness::mapDuty(uint8_t level){
@@ -30,30 +34,40 @@ void BacklightBrightness::fadeIn(){
 	if(state) return;
 	state = true;
 
-	pwm.attach();
-	Settings& settings = *(Settings*) Services.get(Service::Settings);
+	Settings& settings = *Services.get<Service::Settings>();
 
-	for(uint8_t i = 0; i < 100; i++){
-		uint8_t val = map(i, 0, 100, 0, mapDuty(settings.get().screenBrightness));
-		pwm.setDuty(val);
-		vTaskDelay(FadeDelay / portTICK_PERIOD_MS);
-	}
+	xSemaphoreTake(fadeSem, 0);
+	fading = true;
+	duty = mapDuty(settings.get().screenBrightness);
+	pwm.fade(duty, FadeTime, fadeSem);
 }
 
 void BacklightBrightness::fadeOut(){
 	if(!state) return;
 	state = false;
 
-	Settings& settings = *(Settings*) Services.get(Service::Settings);
+	xSemaphoreTake(fadeSem, 0);
+	fading = true;
+	pwm.fade(0, FadeTime, fadeSem);
+}
+
+void BacklightBrightness::await(){
+	if(!fading) return;
 
-	for(uint8_t i = 100; i > 0; i--){
-		uint8_t val = map(i, 0, 100, 0, mapDuty(settings.get().screenBrightness));
-		pwm.setDuty(val);
-		vTaskDelay(FadeDelay / portTICK_PERIOD_MS);
+	if(!xSemaphoreTake(fadeSem, FadeTime * 2)){
+		ESP_LOGW(TAG, "Fade didn't finish in time");
+	}
+	fading = false;
+
+	if(!state){
+		pwm.detach();
 	}
-	pwm.detach();
 }
 
 bool BacklightBrightness::isOn(){
 	return state;
 }
+
+uint8_t BacklightBrightness::getDuty() const{
+	return state ? duty : 0;
+}
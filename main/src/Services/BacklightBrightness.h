@@ -1,6 +1,8 @@
 #ifndef CLOCKSTAR_FIRMWARE_BACKLIGHTBRIGHTNESS_H
 #define CLOCKSTAR_FIRMWARE_BACKLIGHTBRIGHTNESS_H
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "Periph/PWM.h"
 #include "Settings/Settings.h"
 
@@ -9,18 +11,29 @@ public:
 	explicit BacklightBrightness(PWM* pwm);
 	void setBrightness(uint8_t level); //0 - 100%
 
+	/**
+	 * Fades run in the LEDC hardware and return right away. await() blocks until the last one is done,
+	 * and detaches the PWM after a fade out.
+	 */
 	void fadeIn();
 	void fadeOut();
+	void await();
 
 	bool isOn();
 
+	/** Duty the backlight is driven at, 0 while it's off [%] */
+	uint8_t getDuty() const;
+
 private:
 	PWM& pwm;
 	static constexpr uint8_t mapDuty(uint8_t level);
-	static constexpr uint8_t FadeDelay = 2;
+	static constexpr uint32_t FadeTime = 200; //[ms]
 	static constexpr uint8_t MinDuty = 10;
 
 	bool state = false;
+	uint8_t duty = 0; //[%]
+	bool fading = false;
+	SemaphoreHandle_t fadeSem;
 };
 
 
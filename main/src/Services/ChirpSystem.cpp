@@ -1,133 +1,139 @@
 #include <esp_log.h>
 #include "ChirpSystem.h"
+#include "PCMAudio.h"
 #include "Util/stdafx.h"
+#include "Util/Hot.h"
+#include "Util/Services.h"
+#include "Services/Console.h"
+#include <cstdio>
+#include <esp_memory_utils.h>
 
 static const char* TAG = "ChirpSystem";
 
-ChirpSystem::ChirpSystem(PWM& pwm) : Threaded("ChirpSystem", 2048, UINT8_MAX, 0), pwm(pwm), queue(xQueueCreate(QueueLength, sizeof(QueueItem))),
-timerSem(xSemaphoreCreateBinary()), timer(MinimumLength * 1000, isr, timerSem), sleepLock(ESP_PM_APB_FREQ_MAX){
+ChirpSystem::ChirpSystem(PWM& pwm) : Threaded("ChirpSystem", 2048, PlannedTask::ChirpSystem), pwm(&pwm),
+sem(xSemaphoreCreateBinary()), sleepLock(ESP_PM_APB_FREQ_MAX, "ChirpSystem"){
+
+	const esp_timer_create_args_t args = {
+			.callback = isr,
+			.arg = this,
+			.dispatch_method = ESP_TIMER_ISR,
+			.name = "Chirp",
+			.skip_unhandled_events = true
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&args, &timer));
 
 	pwm.detach();
-	xSemaphoreGive(timerSem);
+
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ printReport(print); }, [this](){ resetMetrics(); });
+	}
+
 	start();
 }
 
+ChirpSystem::ChirpSystem(PCMAudio& pcm) : Threaded("ChirpSystem", 2048, PlannedTask::ChirpSystem), pcm(&pcm), sem(nullptr), timer(nullptr),
+sleepLock(ESP_PM_APB_FREQ_MAX, "ChirpSystem"){
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ printReport(print); }, [this](){ resetMetrics(); });
+	}
+}
+
 ChirpSystem::~ChirpSystem(){
 	stop();
+	if(pcm) return;
+
 	Threaded::stop();
-	vSemaphoreDelete(timerSem);
-	vQueueDelete(queue);
+	esp_timer_stop(timer);
+	esp_timer_delete(timer);
+	vSemaphoreDelete(sem);
 	detach();
 }
 
-void ChirpSystem::play(std::initializer_list<Chirp> sound){
-	play((Sound) sound);
-}
-
-void ChirpSystem::play(const Sound& sound){
+void ChirpSystem::play(const SoundProgram& program, Voice voice){
 	if(mute) return;
 
+	if(pcm){
+		pcm->play(program, PCMAudio::Wave::Square, (uint8_t) voice);
+		return;
+	}
+
 	if(!pwmPersistence){
 		attach();
 	}
 
-	uint32_t totalLength = 0;
-	for(const Chirp& chirp : sound){
-		totalLength += chirp.duration;
-	}
-	if(totalLength > MaxLength){
-		ESP_LOGE(TAG, "Sound is too long! Max length is %lums, sound is %lums", MaxLength, totalLength);
-		return;
+	auto& slot = slots[(size_t) voice];
+	const uint8_t i = slot.next.fetch_add(1, std::memory_order_relaxed) % SlotDepth;
+	slot.programs[i] = program;
+	slot.submitted[i] = esp_timer_get_time();
+	if(slot.pending.exchange(i + 1, std::memory_order_release) != 0){
+		replaced++;
 	}
 
-	xQueueReset(queue);
+	xSemaphoreGive(sem);
+}
 
-	for(const Chirp& chirp : sound){
-		if(chirp.endFreq == chirp.startFreq){
-			QueueItem item = { QueueItem::Type::Tone, { .tone = { chirp.startFreq, chirp.duration } } };
-			xQueueSend(queue, &item, portMAX_DELAY);
-			continue;
-		}
-		//TODO - group tones with a low  frequency delta, this would reduce the number of discrete tones
-		for(uint32_t durationSum = 0; durationSum < chirp.duration;){
-			uint16_t freq = freqMap((long) durationSum, 0, chirp.duration, chirp.startFreq, chirp.endFreq);
-			uint16_t tonePeriod = std::max(MinimumLength, (uint32_t) (1000.0 / (double) freq));
-			uint16_t constrainedTonePeriod = std::min(tonePeriod, (uint16_t) (chirp.duration - durationSum));
-
-			if(!PWM::checkFrequency(freq)){
-				freq = 0;
-			}
-			QueueItem item = { QueueItem::Type::Tone, { .tone = { freq, constrainedTonePeriod } } };
-			xQueueSend(queue, &item, portMAX_DELAY);
+void ChirpSystem::play(std::initializer_list<Chirp> sound, Voice voice){
+	compileAndPlay(sound.begin(), sound.size(), voice);
+}
 
-			durationSum += constrainedTonePeriod;
-		}
-	}
-	const QueueItem endItem = { QueueItem::Type::Tone, { .tone = { 0, 0 } } };
-	xQueueSend(queue, &endItem, portMAX_DELAY);
+void ChirpSystem::play(const Sound& sound, Voice voice){
+	compileAndPlay(sound.data(), sound.size(), voice);
 }
 
-/*void IRAM_ATTR ChirpSystem::playFromISR(std::initializer_list<Chirp> sound){
-	playFromISR((Sound) sound);
+void ChirpSystem::play(const Chirp* chirps, size_t count, Voice voice){
+	compileAndPlay(chirps, count, voice);
 }
 
-void IRAM_ATTR ChirpSystem::playFromISR(const Sound& sound){
+void ChirpSystem::compileAndPlay(const Chirp* chirps, size_t count, Voice voice){
 	if(mute) return;
 
 	uint32_t totalLength = 0;
-	for(const Chirp& chirp : sound){
-		totalLength += chirp.duration;
+	for(size_t i = 0; i < count; i++){
+		totalLength += chirps[i].duration;
 	}
 	if(totalLength > MaxLength){
+		ESP_LOGE(TAG, "Sound is too long! Max length is %lums, sound is %lums", MaxLength, totalLength);
 		return;
 	}
 
-	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	std::lock_guard lock(compileLock);
 
-	if(!xQueueIsQueueEmptyFromISR(queue)){
-		QueueItem item = { QueueItem::Type::ClearTones, { .numToClear = (uint16_t) uxQueueMessagesWaitingFromISR(queue) } };
-		xQueueSendToFrontFromISR(queue, &item, &xHigherPriorityTaskWoken);
+	// The task only ever moves on to the last submitted buffer, so the third one is safe to overwrite
+	auto& set = buffers[(size_t) voice];
+	auto& last = lastBuf[(size_t) voice];
+	const auto playing = playingBuf.load();
+	uint8_t i = 0;
+	while(i == last || set[i].data() == playing){
+		i++;
 	}
+	last = i;
 
-	for(const Chirp& chirp : sound){
-		if(chirp.endFreq == chirp.startFreq){
-			QueueItem item = { QueueItem::Type::Tone, { .tone = { chirp.startFreq, chirp.duration } } };
-			xQueueSendFromISR(queue, &item, &xHigherPriorityTaskWoken);
-			continue;
-		}
-		//TODO - group tones with a low  frequency delta, this would reduce the number of discrete tones
-		for(uint32_t durationSum = 0; durationSum < chirp.duration;){
-			uint16_t freq = freqMap((long) durationSum, 0, chirp.duration, chirp.startFreq, chirp.endFreq);
-			uint16_t tonePeriod = std::max(MinimumLength, (uint32_t) (1000.0 / (double) freq));
-			uint16_t constrainedTonePeriod = std::min(tonePeriod, (uint16_t) (chirp.duration - durationSum));
-
-			if(!PWM::checkFrequency(freq)){
-				freq = 0;
-			}
-			QueueItem item = { QueueItem::Type::Tone, { .tone = { freq, constrainedTonePeriod } } };
-			xQueueSendFromISR(queue, &item, &xHigherPriorityTaskWoken);
-
-			durationSum += constrainedTonePeriod;
-		}
+	auto& buf = set[i];
+	const auto segments = compileSegments(chirps, count, buf.data(), buf.size());
+	if(segments > buf.size()){
+		ESP_LOGW(TAG, "Sound has %zu chirps, only the first %zu are played", segments, buf.size());
 	}
 
-	const QueueItem endItem = { QueueItem::Type::Tone, { .tone = { 0, 0 } } };
-	xQueueSendFromISR(queue, &endItem, &xHigherPriorityTaskWoken);
-}*/
+	play(SoundProgram{ buf.data(), (uint16_t) std::min(segments, buf.size()) }, voice);
+}
 
 void IRAM_ATTR ChirpSystem::stopFromISR(){
-	BaseType_t priority = pdFALSE;
+	if(pcm) return;
 
-	if(!xQueueIsQueueEmptyFromISR(queue)){
-		QueueItem item = { QueueItem::Type::ClearTones, { .numToClear = (uint16_t) uxQueueMessagesWaitingFromISR(queue) } };
-		xQueueSendToFrontFromISR(queue, &item, &priority);
-	}
+	stopRequest = true;
+
+	BaseType_t priority = pdFALSE;
+	xSemaphoreGiveFromISR(sem, &priority);
 }
 
 void ChirpSystem::stop(){
-	xQueueReset(queue);
-	pwm.stop();
-	detach();
+	if(pcm){
+		pcm->stop();
+		return;
+	}
+
+	stopRequest = true;
+	xSemaphoreGive(sem);
 }
 
 void ChirpSystem::setMute(bool mute){
@@ -141,83 +147,193 @@ bool ChirpSystem::isMuted() const{
 	return mute;
 }
 
+ChirpSystem::Metrics ChirpSystem::getMetrics() const{
+	Metrics m = metrics;
+	m.replaced = replaced;
+	return m;
+}
+
+void ChirpSystem::resetMetrics(){
+	metrics = {};
+	replaced = 0;
+}
+
+void ChirpSystem::printReport(const std::function<void(const char* line)>& print) const{
+	char line[160];
+	const auto m = getMetrics();
+
+	const uint32_t avgLatency = m.sounds ? (uint32_t) (m.latency / m.sounds) : 0;
+	const uint32_t avgError = m.tones ? (uint32_t) (m.toneError / m.tones) : 0;
+	snprintf(line, sizeof(line), "Audio   %5lu sounds  latency %5lu / %5lu us  %6lu tones  error %5lu / %5lu us\n",
+			 m.sounds, avgLatency, m.maxLatency, m.tones, avgError, m.maxToneError);
+	print(line);
+	snprintf(line, sizeof(line), "Audio   %5lu replaced  %5lu dropped  %5lu interrupted  %5lu stopped\n",
+			 m.replaced, m.dropped, m.interrupted, m.stopped);
+	print(line);
+}
+
 void ChirpSystem::setPersistentAttach(bool persistent){
 	this->pwmPersistence = persistent;
 	if(persistent){
 		attach();
-	}else if(uxQueueMessagesWaiting(queue) <= 0){
+	}else if(!playing){
 		detach();
 	}
 }
 
 void ChirpSystem::attach(){
-	if(attached) return;
+	if(attached || !pwm) return;
 	attached = true;
-	pwm.attach();
-	pwm.setDuty(50);
-	sleepLock.acquire();
+	pwm->attach();
+	pwm->setDuty(50);
 }
 
 void ChirpSystem::detach(){
-	if(!attached) return;
+	if(!attached || !pwm) return;
 	attached = false;
-	pwm.detach();
-	sleepLock.release();
+	pwm->detach();
 }
 
 void IRAM_ATTR ChirpSystem::isr(void* arg){
-	BaseType_t priority = pdFALSE;
-	xSemaphoreGiveFromISR(arg, &priority);
-}
-
-void ChirpSystem::loop(){
-	while(!xSemaphoreTake(timerSem, portMAX_DELAY));
-	timer.stop();
-
-	QueueItem item{};
-	if(xQueueReceive(queue, &item, portMAX_DELAY)){
-
-		while(item.type == QueueItem::Type::ClearTones || (item.type == QueueItem::Type::Tone && item.data.tone.length == 0)){
-			if(item.type == QueueItem::Type::ClearTones){
-				processClearTone(item.data.numToClear);
-			}else if(item.type == QueueItem::Type::Tone){
-				if(item.data.tone.freq == 0){
-					pwm.stop();
-					if(!pwmPersistence){
-						detach();
-					}
-				}
-			}
-			xQueueReceive(queue, &item, portMAX_DELAY);
+	static_cast<ChirpSystem*>(arg)->advance();
+}
+
+void IRAM_ATTR ChirpSystem::advance(){
+	while(segment < current.count && step >= current.segments[segment].steps){
+		const uint64_t now = esp_timer_get_time();
+		const int64_t error = (int64_t) (now - segmentStart) - (int64_t) current.segments[segment].stepLength * current.segments[segment].steps;
+		const uint32_t absError = error < 0 ? -error : error;
+		metrics.tones++;
+		metrics.toneError += absError;
+		metrics.maxToneError = std::max(metrics.maxToneError, absError);
+		segmentStart = now;
+
+		segment++;
+		step = 0;
+		if(segment < current.count){
+			freq = current.segments[segment].freq;
 		}
+	}
 
-		auto tone = item.data.tone;
+	if(segment >= current.count){
+		pwm->muteFromISR();
+		done = true;
 
-		if(tone.freq == 0){
-			pwm.stop();
-		}else{
-			pwm.setFreq(tone.freq);
+		BaseType_t woken = pdFALSE;
+		xSemaphoreGiveFromISR(sem, &woken);
+		if(woken){
+			esp_timer_isr_dispatch_need_yield();
 		}
+		return;
+	}
+
+	const Segment& seg = current.segments[segment];
+
+	// Armed before touching the PWM, so the step's own work doesn't stretch it
+	esp_timer_start_once(timer, seg.stepLength);
 
-		timer.setPeriod(tone.length);
-		timer.start();
+	// The lock is only held while a tone is on, long silent steps can be slept through
+	if((freq >> 16) != 0){
+		sleepLock.acquire();
+	}else if(seg.stepLength >= MinimumSleepGap){
+		sleepLock.release();
 	}
+
+	// Tones have their divider compiled in, only sweep steps divide
+	const bool on = seg.divider != 0 ? pwm->setDividerFromISR(seg.divider) : pwm->setFreqFromISR(freq >> 16);
+	if(!on){
+		pwm->muteFromISR();
+	}
+
+	freq += seg.increment;
+	step++;
 }
 
-void ChirpSystem::processClearTone(uint16_t numToClear){
-	const auto available = uxQueueMessagesWaiting(queue);
-	if(available < numToClear){
-		ESP_LOGE(TAG, "Failed to clear %d items from queue! Only available: %d items.", available, numToClear);
+void CM_HOT ChirpSystem::loop(){
+	while(!xSemaphoreTake(sem, portMAX_DELAY));
+
+	if(stopRequest.exchange(false)){
+		esp_timer_stop(timer);
+		for(auto& slot : slots){
+			if(slot.pending.exchange(0) != 0){
+				metrics.dropped++;
+			}
+		}
+		if(playing){
+			if(!done){
+				metrics.stopped++;
+			}
+			finish();
+		}
+		return;
 	}
-	QueueItem item{};
-	for(uint16_t i = 0; i < numToClear; i++){
-		if(!xQueueReceive(queue, &item, 0)){
-			ESP_LOGE(TAG, "Failed to clear %d items from queue! Only cleared: %d items.", available, i);
-			return;
+
+	// Newest submission of the highest voice wins, everything below it is dropped
+	bool started = false;
+	for(int v = (int) Voice::COUNT - 1; v >= 0; v--){
+		auto& slot = slots[v];
+		const uint8_t pending = slot.pending.exchange(0, std::memory_order_acquire);
+		if(pending == 0) continue;
+
+		if(started || (playing && !done && v < (int) currentVoice)){
+			metrics.dropped++;
+			continue;
+		}
+
+		if(playing && !done){
+			metrics.interrupted++;
 		}
+
+		begin(slot.programs[pending - 1], (Voice) v);
+		started = true;
+
+		const uint32_t latency = esp_timer_get_time() - slot.submitted[pending - 1];
+		metrics.sounds++;
+		metrics.latency += latency;
+		metrics.maxLatency = std::max(metrics.maxLatency, latency);
+	}
+
+	if(!started && done && playing){
+		finish();
 	}
 }
 
-constexpr long ChirpSystem::freqMap(long val, long fromLow, long fromHigh, long toLow, long toHigh){
-	return (val - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
+void CM_HOT ChirpSystem::begin(const SoundProgram& program, Voice voice){
+	esp_timer_stop(timer);
+
+	current = program;
+	if(current.segments != nullptr && !esp_ptr_internal(current.segments)){
+		current.count = std::min<uint16_t>(current.count, flashCopy.size());
+		std::copy_n(current.segments, current.count, flashCopy.data());
+		current.segments = flashCopy.data();
+	}
+
+	currentVoice = voice;
+	playingBuf = program.segments;
+	segment = 0;
+	step = 0;
+	freq = current.count > 0 ? current.segments[0].freq : 0;
+	segmentStart = esp_timer_get_time();
+	done = false;
+	playing = true;
+
+	// First step from here, the ISR takes it from there
+	if(current.count > 0){
+		advance();
+	}else{
+		finish();
+	}
+}
+
+void CM_HOT ChirpSystem::finish(){
+	pwm->stop();
+	sleepLock.release();
+	if(!pwmPersistence){
+		detach();
+	}
+
+	playingBuf = nullptr;
+	current = {};
+	playing = false;
+	done = false;
 }
@@ -1,12 +1,16 @@
 #ifndef CIRCUITMESS_AUDIO_AUDIOSYSTEM_H
 #define CIRCUITMESS_AUDIO_AUDIOSYSTEM_H
 
-#include <mutex>
+#include <esp_timer.h>
 #include "Periph/PWM.h"
-#include "Periph/Timer.h"
 #include "Util/Threaded.h"
 #include "Util/SleepLock.h"
 #include <array>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <mutex>
 
 /**
  * A chirp is a waveform that “sweeps” from a starting frequency to an ending frequency, during the specified duration of time.
@@ -20,21 +24,87 @@ struct Chirp {
 
 typedef std::vector<Chirp> Sound;
 
+class PCMAudio;
+
+/**
+ * A compiled Chirp: steps of equal length, the frequency changing by increment from one step to the next.
+ * A constant frequency is a single step.
+ */
+struct Segment {
+	uint32_t freq; //[Hz/65536] of the first step, 0 for silence
+	int32_t increment; //[Hz/65536] per step
+	uint32_t stepLength; //[us]
+	uint16_t steps;
+	uint32_t divider; // PWM::divider of freq if the segment doesn't sweep, 0 otherwise
+};
+
+/**
+ * A sound compiled into the segments the sweep engine plays. ChirpSystem only gets the pointer, so the segments have
+ * to stay alive while the sound is playing. Sounds known at compile time should be compiled with ChirpSystem::compile.
+ * Segments outside internal RAM (constexpr programs end up in flash) are copied before the ISR plays them.
+ */
+struct SoundProgram {
+	const Segment* segments = nullptr;
+	uint16_t count = 0;
+};
+
+template<size_t N>
+struct CompiledSound {
+	std::array<Segment, N> segments{};
+
+	constexpr operator SoundProgram() const{ return { segments.data(), (uint16_t) N }; }
+};
+
 /**
  * Simple Audio system designed for short SFX played on a simple piezo buzzer.
+ *
+ * Sounds are played by the sweep engine: an esp_timer ISR that steps through the segments, writing every step's
+ * frequency straight into the LEDC timer. The audio task only wakes up to start and to finish a sound.
+ * Constructed with a PCMAudio instead, sounds are handed over to its voices and can overlap.
  */
 class ChirpSystem : private Threaded {
 public:
 	explicit ChirpSystem(PWM& pwm);
+	explicit ChirpSystem(PCMAudio& pcm);
 	~ChirpSystem() override;
+
 	/**
-	 * Plays the specified sound, interrupts the currently playing sound.
+	 * Compiles chirps into a program at compile time, e.g.
+	 * static constexpr Chirp Chirps[] = { ... };
+	 * static constexpr auto Sound = ChirpSystem::compile<ChirpSystem::segmentCount(Chirps)>(Chirps);
 	 */
-/*	void playFromISR(std::initializer_list<Chirp> sound);
-	void playFromISR(const Sound& sound);*/
+	template<size_t Count, size_t N>
+	static constexpr CompiledSound<Count> compile(const Chirp (&chirps)[N]){
+		CompiledSound<Count> sound;
+		compileSegments(chirps, N, sound.segments.data(), Count);
+		return sound;
+	}
 
-	void play(std::initializer_list<Chirp> sound);
-	void play(const Sound& sound);
+	template<size_t N>
+	static constexpr size_t segmentCount(const Chirp (&chirps)[N]){
+		return compileSegments(chirps, N, nullptr, 0);
+	}
+
+	/**
+	 * Sources of sounds, in rising priority. A sound interrupts the one playing if its voice has at least the same
+	 * priority, sounds for lower voices are dropped while a higher one plays.
+	 */
+	enum class Voice : uint8_t {
+		App, Click, Notification, COUNT
+	};
+
+	/**
+	 * Plays the specified sound on a voice. Doesn't block and doesn't lock, can be called from any task.
+	 * The program is only passed on by pointer and has to outlive the playback.
+	 */
+	void play(const SoundProgram& program, Voice voice = Voice::App);
+
+	/**
+	 * Compiles the sound into an internal buffer of the voice first, for sounds only known at runtime.
+	 */
+	void play(std::initializer_list<Chirp> sound, Voice voice = Voice::App);
+	void play(const Sound& sound, Voice voice = Voice::App);
+	void play(const Chirp* chirps, size_t count, Voice voice = Voice::App);
 
 	void stopFromISR();
 	void stop();
@@ -44,50 +114,145 @@ public:
 	 * Useful when there is heavy usage of the system since detaching and reattaching has a performance penalty
 	 *
 	 * False - default, attaches and detaches the PWM for every chirp.
+	 *
+	 * Either way the sleep lock is only held while a tone plays, not between sounds.
 	 */
 	void setPersistentAttach(bool persistent);
 
 	void setMute(bool mute);
 	[[nodiscard]] bool isMuted() const;
 
+	/**
+	 * Timing of the sweep engine, not collected when playing through PCMAudio.
+	 */
+	struct Metrics {
+		uint32_t sounds = 0; // Started
+		uint64_t latency = 0; // [us] from play() to the first tone on the pin, in total
+		uint32_t maxLatency = 0; // [us]
+		uint32_t tones = 0; // Segments played to their end
+		uint64_t toneError = 0; // [us] difference between the played and the requested segment length, in total
+		uint32_t maxToneError = 0; // [us]
+		uint32_t replaced = 0; // Submissions overwritten by a newer one of the same voice before they started
+		uint32_t dropped = 0; // Submissions given up for a higher voice
+		uint32_t interrupted = 0; // Sounds cut off by a newer one
+		uint32_t stopped = 0; // Sounds cut off by stop()
+	};
+	[[nodiscard]] Metrics getMetrics() const;
+	void resetMetrics();
+	void printReport(const std::function<void(const char* line)>& print) const;
+
 
 private:
-	PWM& pwm;
+	PWM* pwm = nullptr;
+	PCMAudio* pcm = nullptr;
 	bool mute = false;
 
 	void loop() override;
-	void processClearTone(uint16_t numToClear);
-	QueueHandle_t queue;
-	SemaphoreHandle_t timerSem;
+	void compileAndPlay(const Chirp* chirps, size_t count, Voice voice);
+	void begin(const SoundProgram& program, Voice voice);
+	void finish();
+
+	SemaphoreHandle_t sem; // Given by play and by the ISR once a sound is done
+
+	static constexpr uint8_t SlotDepth = 4;
+
+	/**
+	 * Submissions of a voice. Producers claim an entry with next, fill it and publish it in pending, the audio task
+	 * takes the newest one by swapping pending out. An entry is only reused SlotDepth submissions later.
+	 */
+	struct Slot {
+		SoundProgram programs[SlotDepth];
+		uint64_t submitted[SlotDepth]; //[us]
+		std::atomic_uint8_t next = 0;
+		std::atomic_uint8_t pending = 0; // Index + 1 of the newest entry, 0 if none
+	};
+	Slot slots[(size_t) Voice::COUNT];
+	std::atomic_bool stopRequest = false;
+
+	// Sweep engine. Set up by the audio task while the timer is stopped, owned by the ISR while it runs.
+	// The ISR and the task are both on core 0, so they never run at the same time.
+	esp_timer_handle_t timer;
+	SoundProgram current;
+	Voice currentVoice = Voice::App;
+	uint16_t segment = 0;
+	uint16_t step = 0;
+	uint32_t freq = 0; //[Hz/65536]
+	uint64_t segmentStart = 0; //[us]
+	std::atomic_bool done = false;
+	std::atomic_bool playing = false;
 
-	Timer timer;
 	static void isr(void* arg);
+	void advance();
+
+	// Written by the audio task and the ISR, except replaced which producers count
+	Metrics metrics;
+	std::atomic_uint32_t replaced = 0;
 
 	bool pwmPersistence = false;
-	SleepLock sleepLock;
+	SleepLock sleepLock; // Held by the sweep engine while a tone is on
 	bool attached = false;
 
 	void attach();
 	void detach();
 
-	static constexpr long freqMap(long val, long fromLow, long fromHigh, long toLow, long toHigh);
+	// Runtime compiled sounds, three per voice. play() compiles into the one that's neither playing nor the last
+	// submitted, as the task may start that one at any moment. Producers take turns on compileLock.
+	std::atomic<const Segment*> playingBuf = nullptr;
+	static constexpr size_t CompileBuffers = 3;
+	uint8_t lastBuf[(size_t) Voice::COUNT] = {};
+	std::mutex compileLock;
+
 	static constexpr uint32_t DRAM_ATTR MaxLength = 2000; //2s
-	static constexpr uint32_t DRAM_ATTR MinimumLength = 5; //5ms
-	static constexpr uint32_t DRAM_ATTR QueueLength = MaxLength / MinimumLength;
+	static constexpr uint32_t DRAM_ATTR MinimumStep = 1000; //[us]
+	static constexpr uint32_t DRAM_ATTR MinimumDelta = 3; //[Hz] sweep steps closer than this are merged
+	static constexpr uint32_t DRAM_ATTR MinimumSleepGap = 20000; //[us] shorter silences keep the sleep lock
+	static constexpr size_t MaxChirps = 32;
 
-	struct Tone {
-		uint16_t freq; //Hz
-		uint16_t length; //ms
-	};
-	struct QueueItem {
-		enum class Type : uint8_t {
-			Tone, ClearTones
-		} type;
-		union Data {
-			Tone tone;
-			uint16_t numToClear;
-		} data;
-	};
+	std::array<Segment, MaxChirps> buffers[(size_t) Voice::COUNT][CompileBuffers];
+
+	// The ISR runs with the flash cache off during flash writes, programs from rodata are played from a copy in here
+	std::array<Segment, MaxChirps> flashCopy;
+
+	/**
+	 * Writes at most max segments into out, returns how many the chirps compile into.
+	 */
+	static constexpr size_t compileSegments(const Chirp* chirps, size_t count, Segment* out, size_t max){
+		size_t n = 0;
+		for(size_t i = 0; i < count; i++){
+			if(chirps[i].duration == 0) continue;
+
+			if(out != nullptr && n < max){
+				out[n] = compileChirp(chirps[i]);
+			}
+			n++;
+		}
+		return n;
+	}
+
+	static constexpr Segment compileChirp(const Chirp& chirp){
+		const uint32_t length = (uint32_t) chirp.duration * 1000;
+		if(chirp.startFreq == chirp.endFreq){
+			return { (uint32_t) chirp.startFreq << 16, 0, length, 1, PWM::divider(chirp.startFreq) };
+		}
+
+		const int32_t span = (int32_t) chirp.endFreq - (int32_t) chirp.startFreq;
+		const uint32_t delta = span < 0 ? -span : span;
+
+		// A step lasts at least one period of the lowest frequency in the sweep, so every tone can be heard
+		const uint32_t lowest = std::min(chirp.startFreq, chirp.endFreq) != 0 ? std::min(chirp.startFreq, chirp.endFreq) : std::max(chirp.startFreq, chirp.endFreq);
+		const uint32_t minStep = std::max(MinimumStep, 1000000 / lowest);
+
+		// Steps with a low frequency delta are grouped into one, short sweeps don't need a step every millisecond
+		const uint32_t steps = std::max((uint32_t) 1, std::min(length / minStep, delta / MinimumDelta));
+
+		return {
+				(uint32_t) chirp.startFreq << 16,
+				(int32_t) ((int64_t) span * 65536 / (int64_t) steps),
+				length / steps,
+				(uint16_t) steps,
+				0
+		};
+	}
 };
 
 #endif //CIRCUITMESS_AUDIO_AUDIOSYSTEM_H
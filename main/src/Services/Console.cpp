@@ -0,0 +1,94 @@
+#include "Console.h"
+#include "Util/Events.h"
+#include "Util/SleepLock.h"
+#include "Util/TaskPlan.h"
+#include "Util/Trace.h"
+#include <cstdio>
+
+Console::Console() : Threaded("Console", 4 * 1024, PlannedTask::Console){
+	// Firmware-wide counters, the subsystems add theirs as they come up
+	addReport([](const Print& print){
+		char line[64];
+		snprintf(line, sizeof(line), "Events: %lu payloads fell back to the heap\n", Events::getPoolFallbacks());
+		print(line);
+		Events::printStats(print);
+	}, [](){ Events::resetStats(); });
+	addReport([](const Print& print){ SleepLock::printReport(print); }, [](){ SleepLock::resetStats(); });
+	addReport([](const Print& print){ TaskPlan::printReport(print); });
+
+	addCommand('t', "dump the trace", [](const Print& print){
+#ifdef CONFIG_CM_TRACE
+		Trace::dump();
+#else
+		print("Tracing is off, enable CONFIG_CM_TRACE\n");
+#endif
+	});
+#ifdef CONFIG_CM_TRACE
+	addReport({}, [](){ Trace::clear(); });
+#endif
+}
+
+Console::~Console(){
+	stop();
+}
+
+void Console::addReport(std::function<void(const Print& print)> report, std::function<void()> reset){
+	std::lock_guard lock(mut);
+	reports.push_back({ std::move(report), std::move(reset) });
+}
+
+void Console::addCommand(char key, const char* help, std::function<void(const Print& print)> fn){
+	std::lock_guard lock(mut);
+
+	for(auto& cmd : commands){
+		if(cmd.key != key) continue;
+		cmd = { key, help, std::move(fn) };
+		return;
+	}
+
+	commands.push_back({ key, help, std::move(fn) });
+}
+
+void Console::loop(){
+	int c;
+	while((c = getchar()) != EOF){
+		handle((char) c);
+	}
+
+	vTaskDelay(pdMS_TO_TICKS(PollInterval));
+}
+
+void Console::handle(char key){
+	const Print print = [](const char* line){ printf("%s", line); };
+
+	// Handlers run outside the lock, a slow one mustn't hold up subsystems registering theirs
+	std::vector<Report> reps;
+	std::vector<Command> cmds;
+	{
+		std::lock_guard lock(mut);
+		reps = reports;
+		cmds = commands;
+	}
+
+	if(key == 'p'){
+		for(const auto& rep : reps){
+			if(rep.print) rep.print(print);
+		}
+	}else if(key == 'r'){
+		for(const auto& rep : reps){
+			if(rep.reset) rep.reset();
+		}
+		printf("Counters reset\n");
+	}else if(key == 'h'){
+		printf("p: print reports\nr: reset counters\n");
+		for(const auto& cmd : cmds){
+			printf("%c: %s\n", cmd.key, cmd.help);
+		}
+	}else{
+		for(const auto& cmd : cmds){
+			if(cmd.key != key) continue;
+			cmd.fn(print);
+			break;
+		}
+	}
+}
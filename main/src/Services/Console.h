@@ -0,0 +1,55 @@
+#ifndef CLOCKSTAR_FIRMWARE_CONSOLE_H
+#define CLOCKSTAR_FIRMWARE_CONSOLE_H
+
+#include "Util/Threaded.h"
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/**
+ * Single-key diagnostics over the serial console, on a low-priority task of its own. Subsystems register a report
+ * with its reset: 'p' prints every report in the order they were added, 'r' resets them all. Other keys run the
+ * commands registered for them, 'h' lists those.
+ * Handlers run on the console task and may block it, reports of state owned by another task hand the work over to it.
+ * They stay registered for good, so only subsystems that live until shutdown add any.
+ */
+class Console : private Threaded {
+public:
+	using Print = std::function<void(const char* line)>;
+
+	Console();
+	~Console() override;
+
+	/** @param reset Called on 'r', either may be empty */
+	void addReport(std::function<void(const Print& print)> report, std::function<void()> reset = {});
+
+	/** Binds a key, replacing any command bound to it before. 'p', 'r' and 'h' are the console's own. */
+	void addCommand(char key, const char* help, std::function<void(const Print& print)> fn);
+
+	using Threaded::start;
+
+private:
+	static constexpr uint32_t PollInterval = 500; // [ms]
+
+	struct Report {
+		std::function<void(const Print& print)> print;
+		std::function<void()> reset;
+	};
+
+	struct Command {
+		char key;
+		const char* help;
+		std::function<void(const Print& print)> fn;
+	};
+
+	std::mutex mut;
+	std::vector<Report> reports;
+	std::vector<Command> commands;
+
+	void loop() override;
+	void handle(char key);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_CONSOLE_H
@@ -0,0 +1,302 @@
+#include "DataLog.h"
+#include "Activity.h"
+#include "Actigraphy.h"
+#include "Time.h"
+#include "Devices/Battery.h"
+#include "LV_Interface/FSLVGL.h"
+#include "Util/Services.h"
+#include <esp_log.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+static const char* TAG = "DataLog";
+
+static uint8_t* putVarint(uint8_t* p, uint32_t val){
+	while(val >= 0x80){
+		*p++ = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	*p++ = val;
+	return p;
+}
+
+static uint8_t* putZigzag(uint8_t* p, int32_t val){
+	return putVarint(p, ((uint32_t) val << 1) ^ (uint32_t) (val >> 31));
+}
+
+DataLog::DataLog() : SleepyThreaded(LoopInterval, "DataLog")
+#ifdef CONFIG_CM_DATALOG_IMU
+		, sub(std::min<uint32_t>(IMUStream::Rate, UINT8_MAX))
+#endif
+{
+	mount();
+
+#ifdef CONFIG_CM_DATALOG_IMU
+	stream = Services.get<Service::IMUStream>();
+	if(stream){
+		stream->subscribe(&sub);
+	}
+#endif
+
+	start();
+}
+
+DataLog::~DataLog(){
+	stop();
+
+#ifdef CONFIG_CM_DATALOG_IMU
+	if(stream){
+		stream->unsubscribe(&sub);
+	}
+#endif
+
+	std::lock_guard lock(mut);
+	if(open.used > persisted){
+		store(open);
+	}
+	if(file){
+		fclose(file);
+	}
+}
+
+DataLog::Range DataLog::range(){
+	std::lock_guard lock(mut);
+	return { first, open.seq };
+}
+
+bool DataLog::read(uint32_t seq, Block& block){
+	std::lock_guard lock(mut);
+	if(seq == open.seq){
+		block = open;
+		return true;
+	}
+
+	if(seq < first || seq > open.seq) return false;
+	return load(seq, block) && block.seq == seq;
+}
+
+void DataLog::takeEpochs(){
+	auto time = Services.get<Service::Time>();
+	if(time == nullptr) return;
+
+	const auto now = (uint32_t) time->now();
+	if(now < MinTime) return;
+
+	logActigraphy(now);
+}
+
+void DataLog::sleepyLoop(){
+	auto time = Services.get<Service::Time>();
+	if(time == nullptr) return;
+
+	const auto now = (uint32_t) time->now();
+	if(now < MinTime) return;
+
+	if(now >= nextSteps){
+		nextSteps = now + StepsInterval;
+		logSteps(now);
+	}
+
+	if(now >= nextBattery){
+		nextBattery = now + BatteryInterval;
+		logBattery(now);
+	}
+
+#ifdef CONFIG_CM_DATALOG_IMU
+	logAccel(now);
+#endif
+
+	logActigraphy(now);
+
+	if(now >= nextPersist){
+		nextPersist = now + PersistInterval;
+
+		std::lock_guard lock(mut);
+		if(open.used > persisted && store(open)){
+			persisted = open.used;
+		}
+	}
+}
+
+void DataLog::logSteps(uint32_t time){
+	auto activity = Services.get<Service::Activity>();
+	if(activity == nullptr) return;
+
+	const auto steps = activity->getSteps();
+	if(steps == lastSteps) return;
+	lastSteps = steps;
+
+	std::lock_guard lock(mut);
+	auto p = beginRecord(Record::Steps, time);
+	p = putVarint(p, steps);
+	endRecord(p);
+}
+
+void DataLog::logBattery(uint32_t time){
+	auto battery = Services.get<Service::Battery>();
+	if(battery == nullptr) return;
+
+	const auto voltage = battery->getVoltage();
+	if(voltage == 0) return;
+
+	std::lock_guard lock(mut);
+	auto p = beginRecord(Record::Battery, time);
+	p = putZigzag(p, (int32_t) voltage - lastVoltage);
+	*p++ = battery->getPerc();
+	*p++ = (uint8_t) battery->getChargingState();
+	endRecord(p);
+	lastVoltage = voltage;
+}
+
+void DataLog::logAccel(uint32_t time){
+#ifdef CONFIG_CM_DATALOG_IMU
+	IMUStream::Sample sample;
+	while(sub.get(sample)){
+		const float accel[3] = { sample.data.accelX, sample.data.accelY, sample.data.accelZ };
+
+		std::lock_guard lock(mut);
+		auto p = beginRecord(Record::Accel, time);
+		for(int i = 0; i < 3; i++){
+			const auto mg = (int16_t) std::clamp(std::lround(accel[i] * 1000.0f), (long) INT16_MIN, (long) INT16_MAX);
+			p = putZigzag(p, (int32_t) mg - lastAccel[i]);
+			lastAccel[i] = mg;
+		}
+		endRecord(p);
+	}
+#endif
+}
+
+void DataLog::logActigraphy(uint32_t time){
+	auto actigraphy = Services.get<Service::Actigraphy>();
+	if(actigraphy == nullptr) return;
+
+	Actigraphy::Epoch epochs[4];
+	size_t n;
+	while((n = actigraphy->take(epochs, sizeof(epochs) / sizeof(epochs[0]))) > 0){
+		std::lock_guard lock(mut);
+		for(size_t i = 0; i < n; i++){
+			if(epochs[i].time < MinTime) continue;
+
+			// Epochs come in with each FIFO batch, after records of later times, so they carry their own age
+			auto p = beginRecord(Record::Actigraphy, time);
+			p = putVarint(p, time > epochs[i].time ? time - epochs[i].time : 0);
+			p = putVarint(p, epochs[i].pim);
+			*p++ = epochs[i].samples;
+			*p++ = epochs[i].active;
+			endRecord(p);
+		}
+	}
+}
+
+uint8_t* DataLog::beginRecord(Record type, uint32_t time){
+	if(open.used + MaxRecord > sizeof(open.data)){
+		close();
+	}
+
+	if(open.used == 0){
+		open.start = lastTime = time;
+		lastVoltage = 0;
+		memset(lastAccel, 0, sizeof(lastAccel));
+	}
+
+	auto p = open.data + open.used;
+	*p++ = (uint8_t) type;
+	p = putVarint(p, time >= lastTime ? time - lastTime : 0);
+	lastTime = std::max(lastTime, time);
+	return p;
+}
+
+void DataLog::endRecord(const uint8_t* end){
+	open.used = end - open.data;
+}
+
+void DataLog::close(){
+	if(!store(open)){
+		ESP_LOGW(TAG, "Couldn't store block %lu", open.seq);
+	}
+
+	const auto seq = open.seq + 1;
+	open = {};
+	open.seq = seq;
+	persisted = 0;
+
+	// The open block's slot held the oldest one
+	if(seq >= first + capacity){
+		first = seq - capacity + 1;
+	}
+}
+
+void DataLog::mount(){
+	if(FSLVGL::isMounted()){
+		file = fopen(Path, "r+");
+		if(file == nullptr){
+			file = fopen(Path, "w+");
+			if(file){
+				const Block empty = {};
+				for(uint32_t i = 0; i < CONFIG_CM_DATALOG_BLOCKS; i++){
+					if(fwrite(&empty, sizeof(empty), 1, file) == 1) continue;
+
+					ESP_LOGW(TAG, "No room for %d blocks in SPIFFS", CONFIG_CM_DATALOG_BLOCKS);
+					fclose(file);
+					file = nullptr;
+					unlink(Path);
+					break;
+				}
+			}
+		}
+	}
+
+	if(file){
+		// Block sized writes, stdio's own buffer would only copy them
+		setvbuf(file, nullptr, _IONBF, 0);
+		capacity = CONFIG_CM_DATALOG_BLOCKS;
+	}else{
+		ram.reset(new(std::nothrow) Block[RamCapacity]());
+		capacity = ram ? RamCapacity : 0;
+	}
+
+	// Slots of older laps keep their seq until overwritten, the newest lap is the one within capacity of the last
+	uint32_t last = 0;
+	uint32_t oldest = UINT32_MAX;
+	Block header;
+	for(uint32_t slot = 0; file && slot < capacity; slot++){
+		if(fseek(file, slot * sizeof(Block), SEEK_SET) != 0 || fread(&header, HeaderSize, 1, file) != 1) break;
+		if(header.seq == 0 || header.seq % capacity != slot) continue;
+
+		last = std::max(last, header.seq);
+		oldest = std::min(oldest, header.seq);
+	}
+	if(last > 0){
+		first = std::max(oldest, last >= capacity ? last - capacity + 2 : 1);
+	}
+
+	open.seq = last + 1;
+	ESP_LOGI(TAG, "%lu blocks in %s, up to %lu", open.seq - first, file ? "SPIFFS" : "RAM", last);
+}
+
+bool DataLog::store(const Block& block){
+	if(capacity == 0) return false;
+
+	const uint32_t slot = block.seq % capacity;
+	if(!file){
+		ram[slot] = block;
+		return true;
+	}
+
+	return fseek(file, slot * sizeof(Block), SEEK_SET) == 0 && fwrite(&block, sizeof(Block), 1, file) == 1;
+}
+
+bool DataLog::load(uint32_t seq, Block& block){
+	if(capacity == 0) return false;
+
+	const uint32_t slot = seq % capacity;
+	if(!file){
+		block = ram[slot];
+		return true;
+	}
+
+	return fseek(file, slot * sizeof(Block), SEEK_SET) == 0 && fread(&block, sizeof(Block), 1, file) == 1;
+}
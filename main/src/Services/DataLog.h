@@ -0,0 +1,119 @@
+#ifndef CLOCKSTAR_FIRMWARE_DATALOG_H
+#define CLOCKSTAR_FIRMWARE_DATALOG_H
+
+#include "Util/Threaded.h"
+#include "Services/IMUStream.h"
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+/**
+ * Compact binary log of step counts, battery samples, movement per minute of sleep with CONFIG_CM_ACTIGRAPHY and, with
+ * CONFIG_CM_DATALOG_IMU, a 1 Hz accelerometer trace, for BLE::Export to sync to the phone.
+ *
+ * Records are packed into Blocks that each decode on their own, so the phone can pick up at any block. A record is
+ * [u8 Record][varint dt][payload], dt in seconds since the previous record or the block's start. Values that change
+ * slowly are stored as zigzag varint deltas from the previous record of their type in the same block:
+ * 	Steps	[varint steps since midnight]
+ * 	Battery	[zigzag mV delta][u8 percent][u8 Battery::ChargingState]
+ * 	Accel	[zigzag mg delta] x, y, z
+ * 	Actigraphy	[varint s the epoch ended before the record][varint pim mg][u8 samples][u8 active samples], see Actigraphy
+ *
+ * Closed blocks go into a ring file of CONFIG_CM_DATALOG_BLOCKS slots in SPIFFS, slot seq % capacity, and the open one
+ * is written into its slot every PersistInterval, so a reboot loses little. Without SPIFFS the ring is kept in RAM.
+ */
+class DataLog : private SleepyThreaded {
+public:
+	DataLog();
+	~DataLog() override;
+
+	static constexpr size_t BlockSize = 512; // [B]
+
+	struct Block {
+		uint32_t seq; // 0 in unused slots
+		uint32_t start; // [s] Unix time the first record's dt counts from
+		uint16_t used; // [B] of data
+		uint8_t data[BlockSize - 10];
+	} __attribute__((packed));
+	static_assert(sizeof(Block) == BlockSize);
+
+	static constexpr size_t HeaderSize = offsetof(Block, data); // [B]
+
+	enum class Record : uint8_t {
+		Steps = 1, Battery = 2, Accel = 3, Actigraphy = 4
+	};
+
+	/** Block seqs in the log, last is the open one and still grows */
+	struct Range {
+		uint32_t first;
+		uint32_t last;
+	};
+	Range range();
+
+	/** Copies block seq, the open one as filled so far. @return False if it's dropped from the ring or not open yet */
+	bool read(uint32_t seq, Block& block);
+
+	/** Pauses the loop through sleep, where it would wake the chip every second */
+	using SleepyThreaded::pause;
+	using SleepyThreaded::resume;
+
+	/** Logs the epochs Actigraphy has closed. Actigraphy calls this after each batch, as the loop is paused meanwhile. */
+	void takeEpochs();
+
+private:
+	static constexpr uint32_t LoopInterval = 1000; // [ms]
+	static constexpr uint32_t StepsInterval = 300; // [s] between step records, only if the count changed
+	static constexpr uint32_t BatteryInterval = 600; // [s]
+	static constexpr uint32_t PersistInterval = 900; // [s] between writes of the open block
+	static constexpr uint32_t MinTime = 1577836800; // [s] 2020-01-01, anything earlier means the time isn't set
+
+	static constexpr size_t MaxRecord = 1 + 5 + 3 * 5; // [B] accel record with the widest varints
+	static constexpr size_t RamCapacity = 16; // [blocks] without SPIFFS
+	static constexpr const char* Path = "/spiffs/.datalog";
+
+	std::mutex mut;
+
+	FILE* file = nullptr;
+	std::unique_ptr<Block[]> ram;
+	uint32_t capacity = 0; // [blocks]
+	uint32_t first = 1; // Oldest seq in the ring
+
+	Block open = {};
+	uint32_t lastTime = 0; // [s] of the last record in the open block
+	uint16_t lastVoltage = 0; // [mV] Deltas of the open block
+	int16_t lastAccel[3] = {};
+	uint16_t persisted = 0; // [B] of the open block in its slot
+
+	// Logger state, only touched by sleepyLoop
+	uint32_t lastSteps = UINT32_MAX;
+	uint32_t nextSteps = 0; // [s]
+	uint32_t nextBattery = 0; // [s]
+	uint32_t nextPersist = 0; // [s]
+
+#ifdef CONFIG_CM_DATALOG_IMU
+	IMUStream* stream = nullptr;
+	IMUStream::Subscriber sub;
+#endif
+
+	void sleepyLoop() override;
+
+	void logSteps(uint32_t time);
+	void logBattery(uint32_t time);
+	void logAccel(uint32_t time);
+	void logActigraphy(uint32_t time);
+
+	/** Starts a record at the end of the open block, closing it first if the record might not fit. Call under mut. */
+	uint8_t* beginRecord(Record type, uint32_t time);
+	void endRecord(const uint8_t* end);
+
+	void close();
+
+	void mount();
+	bool store(const Block& block);
+	bool load(uint32_t seq, Block& block);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_DATALOG_H
@@ -0,0 +1,113 @@
+#include "Gestures.h"
+#include "Util/Events.h"
+#include <geometric.hpp>
+#include <cmath>
+
+Gestures::Gestures(Orientation& orientation) : orientation(orientation){
+
+}
+
+Gestures::~Gestures(){
+	std::lock_guard lock(mut);
+	if(users == 0) return;
+
+	orientation.setBatchHandler({});
+	orientation.release();
+}
+
+void Gestures::acquire(){
+	std::lock_guard lock(mut);
+	if(users++ > 0) return;
+
+	reset();
+	orientation.setBatchHandler([this](const IMU::Sample* samples, size_t count){ process(samples, count); });
+	orientation.acquire();
+}
+
+void Gestures::release(){
+	std::lock_guard lock(mut);
+	if(users == 0 || --users > 0) return;
+
+	orientation.setBatchHandler({});
+	orientation.release();
+}
+
+void Gestures::reset(){
+	tick = quietUntil = 0;
+	seeded = false;
+	flickSign = 0;
+	jolts = 0;
+	face = 0;
+}
+
+void Gestures::process(const IMU::Sample* samples, size_t count){
+	for(size_t i = 0; i < count; i++){
+		processSample(samples[i]);
+	}
+}
+
+void Gestures::processSample(const IMU::Sample& sample){
+	tick++;
+
+	const glm::vec3 accel = { sample.accelX, sample.accelY, sample.accelZ };
+	if(!seeded){
+		gravity = accel;
+		seeded = true;
+	}
+	gravity += (accel - gravity) * GravityAlpha;
+
+	if(tick < quietUntil) return;
+
+	// Turn-over
+	const int8_t newFace = gravity.z > FaceThreshold ? 1 : (gravity.z < -FaceThreshold ? -1 : 0);
+	if(newFace != 0){
+		if(face != 0 && newFace != face && tick - faceTick <= TurnWindow){
+			face = newFace;
+			faceTick = tick;
+			post({ .action = IMU::Event::TurnOver });
+			return;
+		}
+		face = newFace;
+		faceTick = tick;
+	}
+
+	// Shake
+	const glm::vec3 linear = accel - gravity;
+	if(glm::dot(linear, linear) > JoltThreshold * JoltThreshold && tick - lastJolt >= JoltSpacing){
+		if(jolts == 0 || tick - firstJolt > ShakeWindow){
+			jolts = 0;
+			firstJolt = tick;
+		}
+		jolts++;
+		lastJolt = tick;
+
+		if(jolts >= ShakeJolts){
+			post({ .action = IMU::Event::Shake });
+			return;
+		}
+	}
+
+	// Flick, ignored while a shake is building up since shaking spins the gyro as well
+	const bool shaking = jolts >= 2 && tick - firstJolt <= ShakeWindow;
+	const float rate = sample.gyroX;
+	if(flickSign == 0){
+		if(!shaking && std::abs(rate) > FlickRate){
+			flickSign = rate > 0 ? 1 : -1;
+			flickStart = tick;
+		}
+	}else if(tick - flickStart > FlickWindow || shaking){
+		// No rebound, a slow turn rather than a flick
+		flickSign = 0;
+	}else if(rate * -flickSign > FlickRebound){
+		const auto dir = flickSign > 0 ? IMU::FlickDirection::Down : IMU::FlickDirection::Up;
+		post({ .action = IMU::Event::Flick, .flickDir = dir });
+	}
+}
+
+void Gestures::post(const IMU::Event& evt){
+	Events::post(Facility::Motion, evt);
+
+	quietUntil = tick + Refractory;
+	flickSign = 0;
+	jolts = 0;
+}
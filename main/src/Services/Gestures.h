@@ -0,0 +1,69 @@
+#ifndef CLOCKSTAR_FIRMWARE_GESTURES_H
+#define CLOCKSTAR_FIRMWARE_GESTURES_H
+
+#include "Devices/IMU.h"
+#include "Orientation.h"
+#include <mutex>
+#include <vec3.hpp>
+
+/**
+ * Recognizes wrist flicks, shakes and turning the watch over from the FIFO samples Orientation fuses, and posts them
+ * as IMU::Event Flick, Shake and TurnOver on Facility::Motion.
+ * Each gesture is a small state machine over per-sample features, so batches are processed incrementally in constant
+ * memory on the Orientation task. Reference counted like Orientation, which it keeps acquired while in use.
+ */
+class Gestures {
+public:
+	Gestures(Orientation& orientation);
+	virtual ~Gestures();
+
+	void acquire();
+	void release();
+
+private:
+	Orientation& orientation;
+
+	std::mutex mut;
+	uint32_t users = 0;
+
+	void process(const IMU::Sample* samples, size_t count);
+	void processSample(const IMU::Sample& sample);
+	void reset();
+	void post(const IMU::Event& evt);
+
+	// Time is counted in samples at the 104 Hz FIFO rate
+	uint32_t tick = 0; // [samples]
+	uint32_t quietUntil = 0; // [samples] no detection after a gesture, so its tail doesn't trigger another one
+	static constexpr uint32_t Refractory = 52; // [samples]
+
+	// Gravity is a low-pass of the accelerometer, the rest is linear acceleration
+	static constexpr float GravityAlpha = 0.05f;
+	glm::vec3 gravity = {};
+	bool seeded = false;
+
+	// Flick: fast rotation around the forearm (X) followed by a rebound the other way
+	static constexpr float FlickRate = 6.0f; // [rad/s]
+	static constexpr float FlickRebound = 3.0f; // [rad/s]
+	static constexpr uint32_t FlickWindow = 31; // [samples]
+	int8_t flickSign = 0; // Sign of the pending flick's first peak, 0 if none
+	uint32_t flickStart = 0; // [samples]
+
+	// Shake: several linear acceleration jolts in a short window
+	static constexpr float JoltThreshold = 1.0f; // [g]
+	static constexpr uint32_t JoltSpacing = 8; // [samples] minimum between counted jolts
+	static constexpr uint8_t ShakeJolts = 4;
+	static constexpr uint32_t ShakeWindow = 104; // [samples]
+	uint8_t jolts = 0;
+	uint32_t firstJolt = 0; // [samples]
+	uint32_t lastJolt = 0; // [samples]
+
+	// Turn-over: gravity settles on the opposite Z face shortly after leaving the other
+	static constexpr float FaceThreshold = 0.75f; // [g] Z component of gravity for a settled face
+	static constexpr uint32_t TurnWindow = 156; // [samples]
+	int8_t face = 0; // +1 or -1 for the last settled Z face, 0 if none yet
+	uint32_t faceTick = 0; // [samples] last time gravity sat on that face
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_GESTURES_H
@@ -0,0 +1,206 @@
+#include "HeapMonitor.h"
+#include "Util/Services.h"
+#include "Services/Console.h"
+#include <esp_log.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef CONFIG_CM_HEAP_MONITOR_TRACE
+#include <esp_heap_trace.h>
+
+static heap_trace_record_t traceRecords[HeapMonitor::TraceRecords];
+#endif
+
+static const char* TAG = "HeapMonitor";
+
+std::atomic_uint32_t HeapMonitor::failures = 0;
+std::atomic_uint32_t HeapMonitor::lastFailSize = 0;
+std::atomic_uint32_t HeapMonitor::lastFailCaps = 0;
+
+HeapMonitor::HeapMonitor() : PooledThreaded("HeapMonitor"), regions{
+		{ .name = "internal", .caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+		{ .name = "dma", .caps = MALLOC_CAP_DMA },
+		{ .name = "spiram", .caps = MALLOC_CAP_SPIRAM }
+}{
+	for(auto& region : regions){
+		region.total = heap_caps_get_total_size(region.caps);
+	}
+
+	heap_caps_register_failed_alloc_callback(onAllocFailed);
+
+#ifdef CONFIG_CM_HEAP_MONITOR_TRACE
+	ESP_ERROR_CHECK(heap_trace_init_standalone(traceRecords, TraceRecords));
+	ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_LEAKS));
+#endif
+
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ printReport(print); }, [this](){ resetStats(); });
+	}
+
+	start();
+}
+
+HeapMonitor::~HeapMonitor(){
+	stop();
+
+#ifdef CONFIG_CM_HEAP_MONITOR_TRACE
+	heap_trace_stop();
+#endif
+}
+
+void HeapMonitor::onAllocFailed(size_t size, uint32_t caps, const char* function){
+	failures++;
+	lastFailSize = size;
+	lastFailCaps = caps;
+}
+
+void HeapMonitor::loop(){
+	sample();
+	delayNext(SampleInterval);
+}
+
+void HeapMonitor::sample(){
+	std::lock_guard lock(mut);
+
+	historyHead = (historyHead + 1) % HistoryLength;
+	historyCount = std::min(historyCount + 1, HistoryLength);
+	const size_t oldest = (historyHead + HistoryLength - (historyCount - 1)) % HistoryLength;
+
+	for(size_t i = 0; i < RegionCount; i++){
+		auto& region = regions[i];
+		if(region.total == 0) continue;
+
+		multi_heap_info_t info;
+		heap_caps_get_info(&info, region.caps);
+
+		region.free = info.total_free_bytes;
+		region.largest = info.largest_free_block;
+		region.minFree = info.minimum_free_bytes;
+		region.blocks = info.allocated_blocks;
+		region.fragmentation = region.free ? 100 - std::min<size_t>(100, region.largest * 100 / region.free) : 0;
+
+		history[i][historyHead] = region.largest;
+		const uint32_t window = (historyCount - 1) * SampleInterval; // [ms]
+		region.trend = window ? (int32_t) (((int64_t) region.largest - (int64_t) history[i][oldest]) * 60000 / window) : 0;
+
+		if(!region.alerted && region.fragmentation >= AlertThreshold){
+			region.alerted = true;
+			alerts++;
+			alert(region);
+		}else if(region.alerted && region.fragmentation + AlertHysteresis < AlertThreshold){
+			region.alerted = false;
+		}
+	}
+}
+
+void HeapMonitor::alert(const Region& region){
+	ESP_LOGW(TAG, "%s heap %u %% fragmented: %zu B free, largest block %zu B, %zu blocks, largest block %+ld B/min",
+			 region.name, region.fragmentation, region.free, region.largest, region.blocks, region.trend);
+
+#ifdef CONFIG_CM_HEAP_MONITOR_TRACE
+	printSites([](const char* line){ ESP_LOGW(TAG, "%s", line); });
+#endif
+}
+
+void HeapMonitor::forEachRegion(const std::function<void(const Region& region)>& fn){
+	std::lock_guard lock(mut);
+	for(const auto& region : regions){
+		fn(region);
+	}
+}
+
+void HeapMonitor::printReport(const std::function<void(const char* line)>& print){
+	char line[128];
+
+	forEachRegion([&line, &print](const Region& region){
+		if(region.total == 0){
+			snprintf(line, sizeof(line), "Heap %-8s not present\n", region.name);
+			print(line);
+			return;
+		}
+
+		snprintf(line, sizeof(line), "Heap %-8s free %6zu B  largest %6zu B  min free %6zu B  %4zu blocks  frag %3u %%  largest %+6ld B/min\n",
+				 region.name, region.free, region.largest, region.minFree, region.blocks, region.fragmentation, region.trend);
+		print(line);
+	});
+
+	snprintf(line, sizeof(line), "Heap alerts: %lu over %u %%, %lu failed allocations, last %lu B with caps 0x%lx\n",
+			 alerts, AlertThreshold, failures.load(), lastFailSize.load(), lastFailCaps.load());
+	print(line);
+
+#ifdef CONFIG_CM_HEAP_MONITOR_TRACE
+	std::lock_guard lock(mut);
+	printSites(print);
+#endif
+}
+
+void HeapMonitor::resetStats(){
+	std::lock_guard lock(mut);
+
+	alerts = 0;
+	failures = 0;
+	lastFailSize = 0;
+	lastFailCaps = 0;
+	historyCount = 0;
+}
+
+#ifdef CONFIG_CM_HEAP_MONITOR_TRACE
+
+size_t HeapMonitor::collectSites(Site* sites, size_t max){
+	static constexpr size_t MaxSites = 32;
+	static Site found[MaxSites];
+	size_t count = 0;
+
+	// Stopped while reading, so records don't shift under the loop
+	heap_trace_stop();
+	const size_t records = heap_trace_get_count();
+	for(size_t i = 0; i < records; i++){
+		heap_trace_record_t record;
+		if(heap_trace_get(i, &record) != ESP_OK) continue;
+
+		auto site = std::find_if(found, found + count, [&record](const Site& site){
+			return memcmp(site.callers, record.alloced_by, sizeof(site.callers)) == 0;
+		});
+		if(site == found + count){
+			if(count == MaxSites) continue;
+
+			site = &found[count++];
+			memcpy(site->callers, record.alloced_by, sizeof(site->callers));
+			site->count = 0;
+			site->bytes = 0;
+		}
+		site->count++;
+		site->bytes += record.size;
+	}
+	heap_trace_resume();
+
+	const size_t top = std::min(count, max);
+	std::partial_sort_copy(found, found + count, sites, sites + top, [](const Site& a, const Site& b){ return a.count > b.count; });
+	return top;
+}
+
+void HeapMonitor::printSites(const std::function<void(const char* line)>& print){
+	static Site sites[TopSites];
+	const size_t count = collectSites(sites, TopSites);
+
+	heap_trace_summary_t summary;
+	heap_trace_summary(&summary);
+
+	char line[128];
+	snprintf(line, sizeof(line), "Live allocations traced: %zu of %zu records%s, by call site:\n",
+			 summary.count, summary.capacity, summary.has_overflowed ? ", overflowed" : "");
+	print(line);
+
+	for(size_t i = 0; i < count; i++){
+		int pos = snprintf(line, sizeof(line), "%5lu blocks %7zu B ", sites[i].count, sites[i].bytes);
+		for(const auto caller : sites[i].callers){
+			if(caller == nullptr || pos >= (int) sizeof(line) - 12) break;
+			pos += snprintf(line + pos, sizeof(line) - pos, " %p", caller);
+		}
+		snprintf(line + pos, sizeof(line) - pos, "\n");
+		print(line);
+	}
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef CLOCKSTAR_FIRMWARE_HEAPMONITOR_H
+#define CLOCKSTAR_FIRMWARE_HEAPMONITOR_H
+
+#include "Util/TaskPool.h"
+#include <esp_heap_caps.h>
+#include <functional>
+#include <mutex>
+#include <atomic>
+
+/**
+ * Samples the heaps periodically, per capability: internal RAM, its DMA capable part and SPIRAM, each with its own
+ * fragmentation, as a sum over both would hide one behind the other. Tracked are free memory, the largest free block
+ * and the all-time low, with a rolling window of the largest block to show whether fragmentation is creeping up over
+ * hours of uptime.
+ * Logs an alert when a heap's fragmentation (the share of free memory outside its largest block) crosses
+ * CONFIG_CM_HEAP_MONITOR_FRAG_ALERT, and counts allocations that failed.
+ * With CONFIG_CM_HEAP_MONITOR_TRACE, live allocations are traced and grouped by call site, the alert and the report
+ * list the sites holding the most blocks. Their addresses resolve with addr2line against the ELF.
+ */
+class HeapMonitor : private PooledThreaded {
+public:
+	HeapMonitor();
+	~HeapMonitor() override;
+
+	static constexpr uint32_t SampleInterval = 5000; // [ms]
+	static constexpr size_t HistoryLength = 72; // Samples in the rolling window, 6 min
+
+	struct Region {
+		const char* name;
+		uint32_t caps;
+		size_t total; // [B], 0 if the board has no memory with caps
+		size_t free; // [B]
+		size_t largest; // [B] largest free block
+		size_t minFree; // [B] lowest free since boot
+		size_t blocks; // Allocated blocks
+		uint8_t fragmentation; // [%]
+		int32_t trend; // [B/min] change of the largest free block over the window
+		bool alerted;
+	};
+
+	/** Calls fn with each monitored heap, under the monitor's lock. */
+	void forEachRegion(const std::function<void(const Region& region)>& fn);
+
+	void printReport(const std::function<void(const char* line)>& print);
+	void resetStats();
+
+private:
+	std::mutex mut;
+
+	static constexpr size_t RegionCount = 3;
+	Region regions[RegionCount];
+	size_t history[RegionCount][HistoryLength] = {}; // [B] largest free block
+	size_t historyHead = 0;
+	size_t historyCount = 0;
+
+#ifdef CONFIG_CM_HEAP_MONITOR_FRAG_ALERT
+	static constexpr uint8_t AlertThreshold = CONFIG_CM_HEAP_MONITOR_FRAG_ALERT; // [%]
+#else
+	static constexpr uint8_t AlertThreshold = 50; // [%]
+#endif
+	static constexpr uint8_t AlertHysteresis = 10; // [%] below the threshold before an alert fires again
+	uint32_t alerts = 0;
+
+	// Set from the allocator's failure callback, which can run in any task
+	static std::atomic_uint32_t failures;
+	static std::atomic_uint32_t lastFailSize; // [B]
+	static std::atomic_uint32_t lastFailCaps;
+	static void onAllocFailed(size_t size, uint32_t caps, const char* function);
+
+	void loop() override;
+	void sample();
+	void alert(const Region& region);
+
+#ifdef CONFIG_CM_HEAP_MONITOR_TRACE
+	static constexpr size_t TraceRecords = 400;
+	static constexpr size_t TopSites = 8;
+
+	struct Site {
+		void* callers[CONFIG_HEAP_TRACING_STACK_DEPTH];
+		uint32_t count;
+		size_t bytes; // [B]
+	};
+
+	/** Live allocations grouped by call site, the ones holding the most blocks first. */
+	size_t collectSites(Site* sites, size_t max);
+	void printSites(const std::function<void(const char* line)>& print);
+#endif
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_HEAPMONITOR_H
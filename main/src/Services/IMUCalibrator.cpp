@@ -0,0 +1,156 @@
+#include "IMUCalibrator.h"
+#include "Util/stdafx.h"
+#include "Util/Services.h"
+#include "Services/Console.h"
+#include <esp_log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static const char* TAG = "IMUCalibrator";
+
+IMUCalibrator::IMUCalibrator(IMU& imu, IMUCalibration& storage) : imu(imu), storage(storage){
+
+}
+
+void IMUCalibrator::addCommands(Console& console){
+	console.addCommand('g', "calibrate the gyro, lying still", [](const Console::Print& print){
+		auto calibrator = Services.get<Service::IMUCalibrator>();
+		if(calibrator == nullptr) return;
+
+		print(calibrator->calibrateGyro() ? "Gyro calibration done\n" : "Gyro calibration failed, keep the watch still\n");
+	});
+
+	console.addCommand('a', "capture the accelerometer face lying down", [](const Console::Print& print){
+		auto calibrator = Services.get<Service::IMUCalibrator>();
+		if(calibrator == nullptr) return;
+
+		Face face;
+		if(!calibrator->captureAccelFace(&face)){
+			print("Capture failed, keep the watch still with one face down\n");
+			return;
+		}
+
+		char line[48];
+		snprintf(line, sizeof(line), "Captured face %d, faces 0x%02x\n", (int) face, calibrator->getCapturedFaces());
+		print(line);
+	});
+
+	console.addCommand('f', "finish the accelerometer calibration", [](const Console::Print& print){
+		auto calibrator = Services.get<Service::IMUCalibrator>();
+		if(calibrator == nullptr) return;
+
+		print(calibrator->finishAccel() ? "Accelerometer calibration done\n" : "Accelerometer calibration needs all six faces\n");
+	});
+}
+
+bool IMUCalibrator::capture(Capture& mean){
+	double sum[6] = {};
+	double sumSq[6] = {};
+
+	for(size_t i = 0; i < CaptureSamples; i++){
+		const auto sample = imu.getSample();
+		const float values[6] = { sample.gyroX, sample.gyroY, sample.gyroZ, sample.accelX, sample.accelY, sample.accelZ };
+		for(size_t j = 0; j < 6; j++){
+			sum[j] += values[j];
+			sumSq[j] += values[j] * values[j];
+		}
+
+		delayMillis(SampleInterval);
+	}
+
+	bool still = true;
+	for(size_t j = 0; j < 6; j++){
+		const double avg = sum[j] / CaptureSamples;
+		const double dev = std::sqrt(std::max(0.0, sumSq[j] / CaptureSamples - avg * avg));
+		if(dev > (j < 3 ? StillGyro : StillAccel)){
+			still = false;
+		}
+
+		if(j < 3){
+			mean.gyro[j] = (float) avg;
+		}else{
+			mean.accel[j - 3] = (float) avg;
+		}
+	}
+
+	return still;
+}
+
+void IMUCalibrator::apply(const IMUCalibrationData& cal){
+	imu.setCalibration(cal);
+	storage.set(cal);
+	storage.store();
+}
+
+bool IMUCalibrator::calibrateGyro(){
+	Capture mean{};
+	if(!capture(mean)){
+		ESP_LOGW(TAG, "Moved during gyro calibration");
+		return false;
+	}
+
+	// Samples already have the old bias removed, what's left is the correction
+	auto cal = imu.getCalibration();
+	for(size_t i = 0; i < 3; i++){
+		cal.gyroBias[i] += mean.gyro[i];
+	}
+	apply(cal);
+
+	ESP_LOGI(TAG, "Gyro bias %.4f %.4f %.4f rad/s", cal.gyroBias[0], cal.gyroBias[1], cal.gyroBias[2]);
+	return true;
+}
+
+bool IMUCalibrator::captureAccelFace(Face* face){
+	Capture mean{};
+	if(!capture(mean)){
+		ESP_LOGW(TAG, "Moved during accelerometer capture");
+		return false;
+	}
+
+	size_t axis = 0;
+	for(size_t i = 1; i < 3; i++){
+		if(std::fabs(mean.accel[i]) > std::fabs(mean.accel[axis])){
+			axis = i;
+		}
+	}
+	if(std::fabs(mean.accel[axis]) < VerticalAccel){
+		ESP_LOGW(TAG, "No axis is vertical");
+		return false;
+	}
+
+	const auto index = (uint8_t) (axis * 2 + (mean.accel[axis] < 0 ? 1 : 0));
+	faceReadings[index] = mean.accel[axis];
+	faces |= 1 << index;
+
+	if(face){
+		*face = (Face) index;
+	}
+	return true;
+}
+
+uint8_t IMUCalibrator::getCapturedFaces() const{
+	return faces;
+}
+
+bool IMUCalibrator::finishAccel(){
+	if(faces != 0b111111) return false;
+
+	auto cal = imu.getCalibration();
+	for(size_t i = 0; i < 3; i++){
+		const float pos = faceReadings[i * 2];
+		const float neg = faceReadings[i * 2 + 1];
+
+		// Correction in the current calibrated domain, folded into the stored offset and scale
+		const float offset = (pos + neg) / 2.0f;
+		const float scale = 2.0f / (pos - neg);
+		cal.accelOffset[i] += offset / cal.accelScale[i];
+		cal.accelScale[i] *= scale;
+	}
+	apply(cal);
+	faces = 0;
+
+	ESP_LOGI(TAG, "Accel offset %.4f %.4f %.4f g, scale %.4f %.4f %.4f", cal.accelOffset[0], cal.accelOffset[1], cal.accelOffset[2],
+			 cal.accelScale[0], cal.accelScale[1], cal.accelScale[2]);
+	return true;
+}
@@ -0,0 +1,77 @@
+#ifndef CLOCKSTAR_FIRMWARE_IMUCALIBRATOR_H
+#define CLOCKSTAR_FIRMWARE_IMUCALIBRATOR_H
+
+#include "Devices/IMU.h"
+#include "Settings/IMUCalibration.h"
+
+class Console;
+
+/**
+ * Estimates IMU calibration from readings taken at rest, applies it to the IMU and persists it.
+ * Captures read the already calibrated samples and refine the current calibration, so they can be repeated.
+ * Every capture blocks for CaptureTime, call it from a task that can afford that.
+ */
+class IMUCalibrator {
+public:
+	IMUCalibrator(IMU& imu, IMUCalibration& storage);
+
+	/**
+	 * Averages the gyro over CaptureTime as its zero-rate bias. The watch must lie still in any position.
+	 * @return False if it moved during the capture
+	 */
+	bool calibrateGyro();
+
+	enum class Face : uint8_t {
+		XPos, XNeg, YPos, YNeg, ZPos, ZNeg
+	};
+
+	/**
+	 * Captures the accelerometer reading of the axis currently aligned with gravity. Six-position calibration:
+	 * capture with each of the six faces down, then call finishAccel().
+	 * @param face Set to the captured face
+	 * @return False if the watch moved, or no axis was close enough to vertical
+	 */
+	bool captureAccelFace(Face* face = nullptr);
+
+	/** Bitmask of captured faces, bit n set for Face n. */
+	uint8_t getCapturedFaces() const;
+
+	/**
+	 * Derives per-axis offset and scale from the six captures and stores them.
+	 * @return False if some faces weren't captured yet
+	 */
+	bool finishAccel();
+
+	/**
+	 * Binds the calibration to the console: 'g' gyro at rest, 'a' the face lying down, 'f' finishes the accelerometer
+	 * once all six faces are in. Looks the calibrator up on every key, so a provided one is only built when used.
+	 */
+	static void addCommands(Console& console);
+
+private:
+	IMU& imu;
+	IMUCalibration& storage;
+
+	static constexpr size_t CaptureSamples = 200;
+	static constexpr uint32_t SampleInterval = 10; // [ms], ~2 s per capture
+	static constexpr uint32_t CaptureTime = CaptureSamples * SampleInterval; // [ms]
+	static constexpr float StillGyro = 0.01f; // Max standard deviation at rest [rad/s]
+	static constexpr float StillAccel = 0.01f; // Max standard deviation at rest [g]
+	static constexpr float VerticalAccel = 0.8f; // Min reading of the axis facing down [g]
+
+	float faceReadings[6] = {};
+	uint8_t faces = 0;
+
+	struct Capture {
+		float gyro[3];
+		float accel[3];
+	};
+
+	/** Averages CaptureSamples readings, false if any axis varied more than the rest thresholds. */
+	bool capture(Capture& mean);
+	void apply(const IMUCalibrationData& cal);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_IMUCALIBRATOR_H
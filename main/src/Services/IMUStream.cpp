@@ -0,0 +1,137 @@
+#include "IMUStream.h"
+#include "Util/stdafx.h"
+#include <algorithm>
+
+static_assert(IMUStream::Rate > 0 && IMUStream::Rate <= 104, "IMU stream rate must be within the sensor ODR");
+
+IMUStream::Subscriber::Subscriber(uint8_t decimation, bool lowLatency) : decimation(std::max((uint8_t) 1, decimation)), lowLatency(lowLatency){
+
+}
+
+void IMUStream::Subscriber::push(const Sample& sample){
+	if(++phase < decimation) return;
+	phase = 0;
+
+	const auto h = head.load(std::memory_order_relaxed);
+	if(h - tail.load(std::memory_order_acquire) == Capacity){
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	ring[h % Capacity] = sample;
+	head.store(h + 1, std::memory_order_release);
+}
+
+bool IMUStream::Subscriber::get(Sample& sample){
+	const auto t = tail.load(std::memory_order_relaxed);
+	if(t == head.load(std::memory_order_acquire)) return false;
+
+	sample = ring[t % Capacity];
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+bool IMUStream::Subscriber::latest(Sample& sample){
+	const auto h = head.load(std::memory_order_acquire);
+	if(tail.load(std::memory_order_relaxed) == h) return false;
+
+	// The slot behind head can't be rewritten until tail moves past it
+	sample = ring[(h - 1) % Capacity];
+	tail.store(h, std::memory_order_release);
+	return true;
+}
+
+size_t IMUStream::Subscriber::available() const{
+	return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+}
+
+uint32_t IMUStream::Subscriber::getDropped() const{
+	return dropped.load(std::memory_order_relaxed);
+}
+
+IMUStream::IMUStream(IMU& imu) : PooledThreaded("IMUStream"), imu(imu){
+
+}
+
+IMUStream::~IMUStream(){
+	stop();
+}
+
+void IMUStream::subscribe(Subscriber* sub){
+	if(sub == nullptr) return;
+
+	std::lock_guard run(runMut);
+	{
+		std::lock_guard lock(mut);
+		if(std::find(subscribers.begin(), subscribers.end(), sub) != subscribers.end()) return;
+
+		// Not in the list yet, so the stream isn't writing to it
+		sub->phase = 0;
+		sub->tail.store(sub->head.load());
+		subscribers.push_back(sub);
+	}
+
+	if(sub->lowLatency && lowLatencyCount++ == 0){
+		imu.acquireHighRate();
+		period = LowLatencyPeriod;
+	}
+
+	if(!running()){
+		start();
+	}
+}
+
+void IMUStream::unsubscribe(Subscriber* sub){
+	std::lock_guard run(runMut);
+
+	bool empty;
+	{
+		std::lock_guard lock(mut);
+		auto it = std::find(subscribers.begin(), subscribers.end(), sub);
+		if(it == subscribers.end()) return;
+		subscribers.erase(it);
+		empty = subscribers.empty();
+	}
+
+	if(sub->lowLatency && --lowLatencyCount == 0){
+		period = Period;
+		imu.releaseHighRate();
+	}
+
+	// Outside mut, stop() waits for a running loop() which takes it
+	if(empty && running()){
+		stop();
+	}
+}
+
+IMUStream::Sample IMUStream::read(){
+	if(running()){
+		std::lock_guard lock(lastMut);
+		if(micros() - last.time <= period * 1000){
+			return last;
+		}
+	}
+
+	return sample();
+}
+
+IMUStream::Sample IMUStream::sample(){
+	const Sample s = { imu.getSample(), micros() };
+
+	std::lock_guard lock(lastMut);
+	last = s;
+	return s;
+}
+
+void IMUStream::loop(){
+	const auto s = sample();
+
+	{
+		std::lock_guard lock(mut);
+		for(auto sub : subscribers){
+			sub->push(s);
+		}
+	}
+
+	alignNext(period);
+}
@@ -0,0 +1,96 @@
+#ifndef CLOCKSTAR_FIRMWARE_IMUSTREAM_H
+#define CLOCKSTAR_FIRMWARE_IMUSTREAM_H
+
+#include "Devices/IMU.h"
+#include "Util/TaskPool.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/**
+ * Single IMU sampling stream shared by all apps. While anyone is subscribed, one pool job reads the IMU at Rate
+ * and hands every subscriber a timestamped copy through its own lock-free ring, so screens don't issue their own
+ * register reads on the shared I2C bus. The job stops when the last subscriber leaves.
+ * While a low-latency subscriber is subscribed, the IMU runs at its high rate and the stream polls every
+ * LowLatencyPeriod instead.
+ */
+class IMUStream : private PooledThreaded {
+public:
+	IMUStream(IMU& imu);
+	~IMUStream() override;
+
+	static constexpr uint32_t Rate = CONFIG_CM_IMU_STREAM_RATE; // [Hz]
+	static constexpr uint32_t Period = 1000 / Rate; // [ms]
+	static constexpr uint32_t LowLatencyPeriod = 3; // [ms], just above the 2.4 ms sample interval at 416 Hz
+	static constexpr uint32_t LowLatencyRate = 1000 / LowLatencyPeriod; // [Hz] of the samples low-latency subscribers get
+
+	struct Sample {
+		IMU::Sample data;
+		uint64_t time; // [us]
+	};
+
+	/**
+	 * Receiving end of the stream. Single producer (the stream job), single consumer (the owner), no locks.
+	 * Samples that arrive while the ring is full are dropped.
+	 */
+	class Subscriber {
+	public:
+		/**
+		 * @param decimation Receive every decimation-th streamed sample
+		 * @param lowLatency Keep the stream in its low-latency mode while subscribed, for games and other closed loops
+		 */
+		explicit Subscriber(uint8_t decimation = 1, bool lowLatency = false);
+
+		bool get(Sample& sample);
+
+		/** Drops everything but the newest sample and returns it. */
+		bool latest(Sample& sample);
+
+		size_t available() const;
+		uint32_t getDropped() const;
+
+	private:
+		friend IMUStream;
+
+		static constexpr size_t Capacity = 16; // Power of two, fits a 60 Hz frame of low-latency samples
+
+		Sample ring[Capacity];
+		std::atomic_size_t head = 0; // Written by the stream
+		std::atomic_size_t tail = 0; // Written by the owner
+		std::atomic_uint32_t dropped = 0;
+
+		const uint8_t decimation;
+		const bool lowLatency;
+		uint8_t phase = 0;
+
+		void push(const Sample& sample);
+	};
+
+	void subscribe(Subscriber* sub);
+	void unsubscribe(Subscriber* sub);
+
+	/**
+	 * Newest streamed sample if it's no older than one period, a fresh read otherwise. For seeding filters before
+	 * the first subscribed sample arrives.
+	 */
+	Sample read();
+
+private:
+	IMU& imu;
+
+	std::mutex mut; // Guards subscribers
+	std::mutex runMut; // Serializes starting and stopping the job
+	std::vector<Subscriber*> subscribers;
+	uint32_t lowLatencyCount = 0; // Guarded by runMut
+	std::atomic_uint32_t period = Period; // [ms]
+
+	Sample last = {};
+	std::mutex lastMut;
+
+	void loop() override;
+	Sample sample();
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_IMUSTREAM_H
@@ -0,0 +1,96 @@
+#include "Orientation.h"
+#include "Fusion/Madgwick.h"
+#include "Fusion/Mahony.h"
+#include "Util/stdafx.h"
+
+Orientation::Orientation(IMU& imu) : Threaded("Orientation", 3 * 1024, PlannedTask::Orientation), imu(imu){
+#ifdef CONFIG_CM_ORIENTATION_MAHONY
+	filter = std::make_unique<Fusion::MahonyT<float>>();
+#else
+	filter = std::make_unique<Fusion::MadgwickT<float>>();
+#endif
+}
+
+Orientation::~Orientation(){
+	stop();
+	imu.enableFIFO(false);
+}
+
+void Orientation::acquire(bool lowLatency){
+	std::lock_guard lock(mut);
+	if(lowLatency) lowLatencyUsers++;
+	imu.setFIFOWatermark(lowLatencyUsers > 0 ? LowLatencyWatermark : Watermark);
+	if(users++ > 0) return;
+
+	// Readers see time 0 until the first batch is fused instead of a stale state from the last session
+	seeded = false;
+	publish({});
+
+	imu.enableFIFO(true);
+	start();
+}
+
+void Orientation::release(bool lowLatency){
+	std::lock_guard lock(mut);
+	if(lowLatency && lowLatencyUsers > 0) lowLatencyUsers--;
+	if(users == 0) return;
+	if(--users > 0){
+		imu.setFIFOWatermark(lowLatencyUsers > 0 ? LowLatencyWatermark : Watermark);
+		return;
+	}
+
+	stop();
+	imu.enableFIFO(false);
+	imu.setFIFOWatermark();
+}
+
+void Orientation::setBatchHandler(BatchHandler handler){
+	std::lock_guard lock(handlerMut);
+	batchHandler = std::move(handler);
+}
+
+Orientation::State Orientation::get() const{
+	for(;;){
+		const uint32_t s1 = seq.load(std::memory_order_acquire);
+		if((s1 & 1) == 0){
+			State copy = state;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(seq.load(std::memory_order_relaxed) == s1) return copy;
+		}
+
+		// The writer got preempted mid-update, let it finish
+		vTaskDelay(1);
+	}
+}
+
+void Orientation::publish(const State& s){
+	const uint32_t n = seq.load(std::memory_order_relaxed);
+	seq.store(n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	state = s;
+
+	seq.store(n + 2, std::memory_order_release);
+}
+
+void Orientation::loop(){
+	const size_t count = imu.readFIFO(batch, BatchSize, ReadTimeout);
+	if(count == 0) return;
+
+	size_t i = 0;
+	if(!seeded){
+		// Start from the accelerometer attitude instead of converging from identity over several seconds
+		filter->reset(batch[0]);
+		seeded = true;
+		i = 1;
+	}
+
+	const auto orient = filter->update(batch + i, count - i);
+
+	publish({ filter->getQuat(), orient, filter->getGravity(), micros() });
+
+	std::lock_guard lock(handlerMut);
+	if(batchHandler){
+		batchHandler(batch, count);
+	}
+}
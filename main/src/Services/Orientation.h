@@ -0,0 +1,73 @@
+#ifndef CLOCKSTAR_FIRMWARE_ORIENTATION_H
+#define CLOCKSTAR_FIRMWARE_ORIENTATION_H
+
+#include "Devices/IMU.h"
+#include "Fusion/Filter.h"
+#include "Util/Threaded.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/**
+ * Runs the orientation filter selected in CM_ORIENTATION_FILTER on every IMU FIFO sample, on its own task on core 0.
+ * The latest state is published through a seqlock, so readers never block the filter or touch I2C.
+ * Reference counted: the FIFO and the task only run between acquire() and the matching release().
+ */
+class Orientation : private Threaded {
+public:
+	Orientation(IMU& imu);
+	~Orientation() override;
+
+	struct State {
+		Fusion::Quat<float> quat;
+		Fusion::Orient orient;
+		glm::vec3 gravity; // Unit vector in IMU::Sample axes
+		uint64_t time; // [us], of the last fused sample
+	};
+
+	/** Latest fused state. Lock-free, retries while the filter is writing. */
+	State get() const;
+
+	/**
+	 * @param lowLatency Interrupt on every FIFO sample instead of every Watermark samples while this user holds it,
+	 * at the cost of more wakeups. Pass the same value to release().
+	 */
+	void acquire(bool lowLatency = false);
+	void release(bool lowLatency = false);
+
+	/**
+	 * Called on the filter task with every batch of raw samples, after its state is published. Must not block.
+	 * There's one handler, an empty function removes it.
+	 */
+	using BatchHandler = std::function<void(const IMU::Sample* samples, size_t count)>;
+	void setBatchHandler(BatchHandler handler);
+
+private:
+	IMU& imu;
+	std::unique_ptr<Fusion::FilterT<float>> filter;
+
+	static constexpr uint16_t Watermark = 4; // [samples], ~40 ms of latency at 104 Hz
+	static constexpr uint16_t LowLatencyWatermark = 1; // [samples]
+	static constexpr size_t BatchSize = 16; // [samples]
+	static constexpr TickType_t ReadTimeout = 100; // [ms]
+	IMU::Sample batch[BatchSize];
+	bool seeded = false;
+
+	std::atomic_uint32_t seq = 0; // Odd while state is being written
+	State state = {};
+
+	std::mutex mut;
+	uint32_t users = 0;
+	uint32_t lowLatencyUsers = 0;
+
+	BatchHandler batchHandler;
+	std::mutex handlerMut;
+
+	void loop() override;
+	void publish(const State& s);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_ORIENTATION_H
@@ -0,0 +1,179 @@
+#include "PCMAudio.h"
+#include <esp_log.h>
+#include <cmath>
+#include <algorithm>
+
+static const char* TAG = "PCMAudio";
+
+PCMAudio::PCMAudio(gpio_num_t pin) : Threaded("PCMAudio", 3072, PlannedTask::PCMAudio), sleepLock(ESP_PM_APB_FREQ_MAX, "PCMAudio"), sem(xSemaphoreCreateBinary()){
+	for(size_t i = 0; i < TableSize; i++){
+		const float t = (float) i / (float) TableSize;
+		tables[(size_t) Wave::Square][i] = i < TableSize / 2 ? Amplitude : -Amplitude;
+		tables[(size_t) Wave::Triangle][i] = (int16_t) (Amplitude * (t < 0.5f ? 4.0f * t - 1.0f : 3.0f - 4.0f * t));
+		tables[(size_t) Wave::Sine][i] = (int16_t) (Amplitude * sinf(2.0f * (float) M_PI * t));
+	}
+
+	i2s_chan_config_t chanCfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+	chanCfg.dma_desc_num = 4;
+	chanCfg.dma_frame_num = BlockSize;
+	chanCfg.auto_clear = true; // Silence instead of repeating the last block on underrun
+	if(i2s_new_channel(&chanCfg, &tx, nullptr) != ESP_OK){
+		ESP_LOGE(TAG, "I2S channel alloc failed");
+		return;
+	}
+
+	i2s_pdm_tx_config_t pdmCfg = {
+			.clk_cfg = I2S_PDM_TX_CLK_DEFAULT_CONFIG(SampleRate),
+			.slot_cfg = I2S_PDM_TX_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
+			.gpio_cfg = {
+					.clk = GPIO_NUM_NC, // The buzzer only needs the bitstream
+					.dout = pin,
+					.invert_flags = { .clk_inv = false }
+			}
+	};
+	if(i2s_channel_init_pdm_tx_mode(tx, &pdmCfg) != ESP_OK){
+		ESP_LOGE(TAG, "I2S PDM init failed");
+		i2s_del_channel(tx);
+		tx = nullptr;
+		return;
+	}
+
+	start();
+}
+
+PCMAudio::~PCMAudio(){
+	Threaded::stop();
+	if(tx){
+		if(enabled){
+			i2s_channel_disable(tx);
+		}
+		i2s_del_channel(tx);
+	}
+	vSemaphoreDelete(sem);
+}
+
+void PCMAudio::afterStopSignal(){
+	xSemaphoreGive(sem);
+}
+
+void PCMAudio::play(const SoundProgram& program, Wave wave, uint8_t priority){
+	if(program.count == 0) return;
+
+	if(program.count > MaxSegments){
+		ESP_LOGW(TAG, "Sound has %d segments, only the first %zu are played", program.count, MaxSegments);
+	}
+
+	{
+		std::lock_guard lock(voiceMut);
+
+		auto voice = std::find_if(voices.begin(), voices.end(), [](const Voice& v){ return !v.active; });
+		if(voice == voices.end()){
+			voice = std::min_element(voices.begin(), voices.end(), [](const Voice& a, const Voice& b){
+				return a.priority != b.priority ? a.priority < b.priority : a.started < b.started;
+			});
+			if(voice->priority > priority) return;
+		}
+
+		voice->count = std::min((size_t) program.count, MaxSegments);
+		std::copy_n(program.segments, voice->count, voice->segments.begin());
+		voice->segment = 0;
+		voice->step = 0;
+		voice->stepLeft = 0;
+		voice->freq = voice->segments[0].freq;
+		voice->phase = 0;
+		voice->wave = wave;
+		voice->started = playCount++;
+		voice->priority = priority;
+		voice->active = true;
+
+		nextStep(*voice);
+	}
+
+	xSemaphoreGive(sem);
+}
+
+void PCMAudio::stop(){
+	std::lock_guard lock(voiceMut);
+	for(auto& voice : voices){
+		voice.active = false;
+	}
+}
+
+void PCMAudio::nextStep(Voice& voice){
+	while(voice.segment < voice.count && voice.step >= voice.segments[voice.segment].steps){
+		voice.segment++;
+		voice.step = 0;
+		if(voice.segment < voice.count){
+			voice.freq = voice.segments[voice.segment].freq;
+		}
+	}
+
+	if(voice.segment >= voice.count){
+		voice.active = false;
+		return;
+	}
+
+	const Segment& seg = voice.segments[voice.segment];
+	voice.stepLeft = std::max((uint32_t) 1, (uint32_t) ((uint64_t) seg.stepLength * SampleRate / 1000000));
+	voice.phaseInc = (uint32_t) ((uint64_t) voice.freq * 65536 / SampleRate);
+
+	voice.freq += seg.increment;
+	voice.step++;
+}
+
+void PCMAudio::render(int16_t* out, size_t count){
+	std::array<int32_t, BlockSize> mix{};
+
+	std::lock_guard lock(voiceMut);
+
+	for(auto& voice : voices){
+		if(!voice.active) continue;
+
+		const auto& table = tables[(size_t) voice.wave];
+		for(size_t i = 0; i < count && voice.active; i++){
+			// Silent steps keep their place in the sound, they just don't add anything
+			if(voice.phaseInc != 0){
+				mix[i] += table[voice.phase >> (32 - TableBits)];
+				voice.phase += voice.phaseInc;
+			}
+
+			if(--voice.stepLeft == 0){
+				nextStep(voice);
+			}
+		}
+	}
+
+	for(size_t i = 0; i < count; i++){
+		out[i] = (int16_t) std::clamp(mix[i], (int32_t) INT16_MIN, (int32_t) INT16_MAX);
+	}
+}
+
+void PCMAudio::loop(){
+	bool active;
+	{
+		std::lock_guard lock(voiceMut);
+		active = std::any_of(voices.begin(), voices.end(), [](const Voice& v){ return v.active; });
+	}
+
+	if(!active){
+		if(enabled){
+			i2s_channel_disable(tx);
+			enabled = false;
+			sleepLock.release();
+		}
+
+		while(!xSemaphoreTake(sem, portMAX_DELAY));
+		return;
+	}
+
+	if(!enabled){
+		sleepLock.acquire();
+		i2s_channel_enable(tx);
+		enabled = true;
+	}
+
+	render(block.data(), block.size());
+
+	size_t written = 0;
+	i2s_channel_write(tx, block.data(), block.size() * sizeof(int16_t), &written, portMAX_DELAY);
+}
@@ -0,0 +1,80 @@
+#ifndef CLOCKSTAR_FIRMWARE_PCMAUDIO_H
+#define CLOCKSTAR_FIRMWARE_PCMAUDIO_H
+
+#include <mutex>
+#include <array>
+#include <driver/gpio.h>
+#include <driver/i2s_pdm.h>
+#include "Util/Threaded.h"
+#include "Util/SleepLock.h"
+#include "ChirpSystem.h"
+
+/**
+ * Sample based buzzer output. Voices play compiled sounds (see ChirpSystem::compile) from a wavetable, get mixed
+ * into 16-bit PCM and streamed to the pin by the I2S peripheral in PDM mode, through its DMA buffers.
+ * Sounds on different voices overlap instead of cutting each other off. The task sleeps while nothing plays.
+ */
+class PCMAudio : private Threaded {
+public:
+	enum class Wave : uint8_t {
+		Square, Triangle, Sine, COUNT
+	};
+
+	explicit PCMAudio(gpio_num_t pin);
+	~PCMAudio() override;
+
+	/**
+	 * Starts the sound on a free voice. If all are busy, it takes over the lowest priority one that has been playing
+	 * the longest, unless they all have a higher priority than the new sound.
+	 * The segments are copied, the program doesn't have to outlive the call.
+	 */
+	void play(const SoundProgram& program, Wave wave = Wave::Square, uint8_t priority = 0);
+	void stop();
+
+	static constexpr uint32_t SampleRate = 16000; //[Hz]
+	static constexpr size_t Voices = 4;
+	static constexpr size_t MaxSegments = 32;
+
+private:
+	i2s_chan_handle_t tx = nullptr;
+	bool enabled = false;
+	SleepLock sleepLock;
+
+	SemaphoreHandle_t sem; // Given when a voice starts
+	void loop() override;
+	void afterStopSignal() override;
+
+	struct Voice {
+		std::array<Segment, MaxSegments> segments;
+		uint16_t count = 0;
+		uint16_t segment = 0;
+		uint16_t step = 0;
+		uint32_t stepLeft = 0; //[samples]
+		uint32_t freq = 0; //[Hz/65536]
+		uint32_t phase = 0;
+		uint32_t phaseInc = 0;
+		uint32_t started = 0;
+		uint8_t priority = 0;
+		Wave wave = Wave::Square;
+		bool active = false;
+	};
+	std::array<Voice, Voices> voices;
+	uint32_t playCount = 0;
+	std::mutex voiceMut;
+
+	/** Moves the voice to its next step, deactivates it when the sound is over */
+	static void nextStep(Voice& voice);
+
+	void render(int16_t* out, size_t count);
+
+	static constexpr size_t BlockSize = 128; //[samples]
+	std::array<int16_t, BlockSize> block;
+
+	static constexpr size_t TableBits = 8;
+	static constexpr size_t TableSize = 1 << TableBits;
+	static constexpr int16_t Amplitude = INT16_MAX / 2; // Two voices at full swing before the mix clips
+	std::array<int16_t, TableSize> tables[(size_t) Wave::COUNT];
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_PCMAUDIO_H
@@ -0,0 +1,214 @@
+#include "PowerTelemetry.h"
+#include "Util/Services.h"
+#include "Services/Console.h"
+#include <esp_pm.h>
+#include <sdkconfig.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <soc/gpio_reg.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+static const char* TAG = "PowerTelemetry";
+
+PowerTelemetry::PowerTelemetry(){
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+	esp_pm_sleep_cbs_register_config_t cbs = {
+			.enter_cb = sleepEnter,
+			.exit_cb = sleepExit,
+			.enter_cb_user_arg = this,
+			.exit_cb_user_arg = this,
+			.enter_cb_prior = 0,
+			.exit_cb_prior = 0
+	};
+	if(esp_pm_light_sleep_register_cbs(&cbs) != ESP_OK){
+		ESP_LOGE(TAG, "Light sleep callbacks register failed, wakes won't be recorded");
+	}
+#else
+	ESP_LOGW(TAG, "CONFIG_PM_LIGHT_SLEEP_CALLBACKS is off, only sleep sessions are recorded");
+#endif
+
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ printReport(print); }, [this](){ resetStats(); });
+	}
+}
+
+PowerTelemetry::~PowerTelemetry(){
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+	esp_pm_sleep_cbs_register_config_t cbs = {
+			.enter_cb = sleepEnter,
+			.exit_cb = sleepExit,
+			.enter_cb_user_arg = this,
+			.exit_cb_user_arg = this,
+			.enter_cb_prior = 0,
+			.exit_cb_prior = 0
+	};
+	esp_pm_light_sleep_unregister_cbs(&cbs);
+#endif
+}
+
+void PowerTelemetry::setWakePins(uint64_t mask){
+	wakePins = mask;
+}
+
+esp_err_t IRAM_ATTR PowerTelemetry::sleepEnter(int64_t expected, void* arg){
+	auto t = static_cast<PowerTelemetry*>(arg);
+	const int64_t now = esp_timer_get_time();
+
+	portENTER_CRITICAL_SAFE(&t->mux);
+	if(t->lastExit != 0 && t->historyCount > 0){
+		auto& wake = t->history[(t->historyHead + HistoryLength - 1) % HistoryLength];
+		wake.awake = now - t->lastExit;
+		t->causes[std::min((size_t) wake.cause, CauseCount - 1)].awake += wake.awake;
+	}
+	t->lastExit = 0;
+	portEXIT_CRITICAL_SAFE(&t->mux);
+
+	return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR PowerTelemetry::sleepExit(int64_t slept, void* arg){
+	auto t = static_cast<PowerTelemetry*>(arg);
+	const auto cause = esp_sleep_get_wakeup_cause();
+	const uint64_t levels = REG_READ(GPIO_IN_REG) | ((uint64_t) REG_READ(GPIO_IN1_REG) << 32);
+
+	portENTER_CRITICAL_SAFE(&t->mux);
+	t->history[t->historyHead] = { cause, levels & t->wakePins, (uint32_t) slept, 0 };
+	t->historyHead = (t->historyHead + 1) % HistoryLength;
+	t->historyCount = std::min(t->historyCount + 1, HistoryLength);
+	t->causes[std::min((size_t) cause, CauseCount - 1)].wakes++;
+	t->slept += slept;
+	t->lastExit = esp_timer_get_time();
+	portEXIT_CRITICAL_SAFE(&t->mux);
+
+	return ESP_OK;
+}
+
+void PowerTelemetry::sessionStart(){
+	sessionStartTime = esp_timer_get_time();
+	portENTER_CRITICAL(&mux);
+	sessionStartSlept = slept;
+	portEXIT_CRITICAL(&mux);
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+	auto status = std::make_unique<TaskStatus_t[]>(MaxTasks);
+	sessionTaskCount = uxTaskGetSystemState(status.get(), MaxTasks, nullptr);
+	for(size_t i = 0; i < sessionTaskCount; i++){
+		sessionTasks[i] = { status[i].xHandle, status[i].ulRunTimeCounter };
+	}
+#endif
+}
+
+void PowerTelemetry::sessionEnd(){
+	const uint64_t duration = esp_timer_get_time() - sessionStartTime;
+	portENTER_CRITICAL(&mux);
+	const uint64_t sessionSlept = slept - sessionStartSlept;
+	portEXIT_CRITICAL(&mux);
+
+	sessions.count++;
+	sessions.duration += duration;
+	sessions.slept += sessionSlept;
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+	auto status = std::make_unique<TaskStatus_t[]>(MaxTasks);
+	const size_t count = uxTaskGetSystemState(status.get(), MaxTasks, nullptr);
+
+	// Tasks created during the session count from 0
+	for(size_t i = 0; i < count; i++){
+		for(size_t j = 0; j < sessionTaskCount; j++){
+			if(sessionTasks[j].handle != status[i].xHandle) continue;
+			status[i].ulRunTimeCounter -= sessionTasks[j].runtime;
+			break;
+		}
+	}
+	std::sort(status.get(), status.get() + count, [](const TaskStatus_t& a, const TaskStatus_t& b){
+		return a.ulRunTimeCounter > b.ulRunTimeCounter;
+	});
+
+	topTaskCount = 0;
+	for(size_t i = 0; i < count && topTaskCount < TopTasks; i++){
+		if(status[i].ulRunTimeCounter == 0) break;
+		auto& top = topTasks[topTaskCount++];
+		strncpy(top.name, status[i].pcTaskName, sizeof(top.name) - 1);
+		top.name[sizeof(top.name) - 1] = 0;
+		top.runtime = status[i].ulRunTimeCounter;
+	}
+#endif
+}
+
+void PowerTelemetry::printReport(const std::function<void(const char* line)>& print){
+	char line[128];
+
+	portENTER_CRITICAL(&mux);
+	CauseStats causeCopy[CauseCount];
+	std::copy(std::begin(causes), std::end(causes), causeCopy);
+	Wake historyCopy[HistoryLength];
+	std::copy(std::begin(history), std::end(history), historyCopy);
+	const size_t head = historyHead;
+	const size_t count = historyCount;
+	portEXIT_CRITICAL(&mux);
+
+	// Without the sleep callbacks nothing is known about the wakes, sessions are counted as slept through
+#ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+	const uint64_t sessionSlept = sessions.slept;
+#else
+	const uint64_t sessionSlept = sessions.duration;
+#endif
+	const uint64_t sessionAwake = sessions.duration - std::min(sessionSlept, sessions.duration);
+	const uint64_t charge = (sessionSlept * SleepCurrent + sessionAwake * AwakeCurrent) / 3600000000ull; //[uAh]
+
+	snprintf(line, sizeof(line), "Sleep   %4lu sessions  %6llu s  asleep %3u %%  ~%llu.%03llu mAh\n",
+			 sessions.count, sessions.duration / 1000000, sessions.duration ? (unsigned) (sessionSlept * 100 / sessions.duration) : 0,
+			 charge / 1000, charge % 1000);
+	print(line);
+
+	for(size_t i = 0; i < CauseCount; i++){
+		if(causeCopy[i].wakes == 0) continue;
+		snprintf(line, sizeof(line), "Wake    %-10s %6lu wakes  awake %6llu ms  avg %5llu us\n", causeName((esp_sleep_source_t) i),
+				 causeCopy[i].wakes, causeCopy[i].awake / 1000, causeCopy[i].awake / causeCopy[i].wakes);
+		print(line);
+	}
+
+	for(size_t i = 0; i < count; i++){
+		const auto& wake = historyCopy[(head + HistoryLength - count + i) % HistoryLength];
+		snprintf(line, sizeof(line), "Wake    %-10s pins %012llx  slept %8lu us  awake %6lu us\n", causeName(wake.cause),
+				 wake.pins, wake.slept, wake.awake);
+		print(line);
+	}
+
+	for(size_t i = 0; i < topTaskCount; i++){
+		snprintf(line, sizeof(line), "Session %-16s ran %8lu\n", topTasks[i].name, topTasks[i].runtime);
+		print(line);
+	}
+}
+
+void PowerTelemetry::resetStats(){
+	portENTER_CRITICAL(&mux);
+	std::fill(std::begin(causes), std::end(causes), CauseStats{});
+	historyHead = historyCount = 0;
+	slept = 0;
+	sessionStartSlept = 0;
+	portEXIT_CRITICAL(&mux);
+
+	sessions = {};
+	topTaskCount = 0;
+}
+
+const char* PowerTelemetry::causeName(esp_sleep_source_t cause){
+	switch(cause){
+		case ESP_SLEEP_WAKEUP_UNDEFINED: return "undefined";
+		case ESP_SLEEP_WAKEUP_EXT0: return "ext0";
+		case ESP_SLEEP_WAKEUP_EXT1: return "ext1";
+		case ESP_SLEEP_WAKEUP_TIMER: return "timer";
+		case ESP_SLEEP_WAKEUP_TOUCHPAD: return "touchpad";
+		case ESP_SLEEP_WAKEUP_ULP: return "ulp";
+		case ESP_SLEEP_WAKEUP_GPIO: return "gpio";
+		case ESP_SLEEP_WAKEUP_UART: return "uart";
+		case ESP_SLEEP_WAKEUP_WIFI: return "wifi";
+		case ESP_SLEEP_WAKEUP_BT: return "bt";
+		default: return "other";
+	}
+}
@@ -0,0 +1,91 @@
+#ifndef CLOCKSTAR_FIRMWARE_POWERTELEMETRY_H
+#define CLOCKSTAR_FIRMWARE_POWERTELEMETRY_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_sleep.h>
+#include <functional>
+
+/**
+ * Wake and charge accounting for finding what drains the battery while asleep.
+ * Every light sleep exit is recorded with its cause, the wake pins that were high, how long the chip slept and how
+ * long it stayed awake before sleeping again. This needs CONFIG_PM_LIGHT_SLEEP_CALLBACKS.
+ * Sleep sessions (one Sleep::sleep each) are always recorded, together with the tasks that ran the longest during the
+ * last one if FreeRTOS run-time stats are on. Charge is estimated from the time spent asleep and awake.
+ */
+class PowerTelemetry {
+public:
+	PowerTelemetry();
+	~PowerTelemetry();
+
+	/** GPIOs set up as wake sources, the ones that were high are recorded with every wake */
+	void setWakePins(uint64_t mask);
+
+	void sessionStart();
+	void sessionEnd();
+
+	struct Wake {
+		esp_sleep_source_t cause;
+		uint64_t pins; // Wake pins that were high
+		uint32_t slept; //[us]
+		uint32_t awake; //[us] until the next sleep, 0 while still awake
+	};
+
+	struct CauseStats {
+		uint32_t wakes = 0;
+		uint64_t awake = 0; //[us]
+	};
+
+	void printReport(const std::function<void(const char* line)>& print);
+	void resetStats();
+
+	static constexpr uint32_t SleepCurrent = 250; //[uA] in light sleep, backlight off
+	static constexpr uint32_t AwakeCurrent = 30000; //[uA] at the Idle power profile
+	static constexpr size_t HistoryLength = 16;
+	static constexpr size_t CauseCount = 16;
+	static constexpr size_t MaxTasks = 32;
+	static constexpr size_t TopTasks = 5;
+
+private:
+	portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+	uint64_t wakePins = 0;
+
+	// Written by the light sleep callbacks
+	Wake history[HistoryLength] = {};
+	size_t historyHead = 0;
+	size_t historyCount = 0;
+	CauseStats causes[CauseCount];
+	uint64_t slept = 0; //[us] in total
+	int64_t lastExit = 0; //[us]
+
+	static esp_err_t sleepEnter(int64_t expected, void* arg);
+	static esp_err_t sleepExit(int64_t slept, void* arg);
+
+	struct TaskSample {
+		TaskHandle_t handle;
+		uint32_t runtime;
+	};
+	TaskSample sessionTasks[MaxTasks];
+	size_t sessionTaskCount = 0;
+
+	struct Session {
+		uint32_t count = 0;
+		uint64_t duration = 0; //[us] in total
+		uint64_t slept = 0; //[us] in total
+	} sessions;
+	int64_t sessionStartTime = 0; //[us]
+	uint64_t sessionStartSlept = 0; //[us]
+
+	struct TopTask {
+		char name[configMAX_TASK_NAME_LEN];
+		uint32_t runtime; // Run-time stats ticks during the last session
+	};
+	TopTask topTasks[TopTasks] = {};
+	size_t topTaskCount = 0;
+
+	static const char* causeName(esp_sleep_source_t cause);
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_POWERTELEMETRY_H
@@ -0,0 +1,158 @@
+#include "RTCTelemetry.h"
+#include "Util/Services.h"
+#include "Services/Console.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_attr.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "Util/stdafx.h"
+
+static const char* TAG = "RTCTelemetry";
+
+RTC_NOINIT_ATTR RTCTelemetry::Block RTCTelemetry::block;
+DRAM_ATTR portMUX_TYPE RTCTelemetry::lock = portMUX_INITIALIZER_UNLOCKED;
+bool RTCTelemetry::phoneSeen = false;
+
+RTCTelemetry::RTCTelemetry() : PooledThreaded("RTCTelemetry"){
+	const auto reason = esp_reset_reason();
+
+	// RTC memory is random after power-on, and may hold a stale block if power was only briefly lost
+	if(reason == ESP_RST_POWERON || block.magic != Magic || block.check != ~Magic){
+		memset(&block, 0, sizeof(block));
+		block.magic = Magic;
+		block.check = ~Magic;
+	}else{
+		block.last = block.current;
+		block.lastReason = reason;
+		block.lastValid = true;
+		block.reported = false;
+	}
+
+	block.boots++;
+	if(reason < ReasonCount){
+		block.resets[reason]++;
+	}
+
+	block.current = {};
+	block.current.minFreeHeap = UINT32_MAX;
+
+	if(block.lastValid){
+		char line[128];
+		format(block.last, line, sizeof(line));
+		if(isCrash(reason)){
+			ESP_LOGW(TAG, "Boot %lu after a %s, last boot: %s", block.boots, reasonName(reason), line);
+		}else{
+			ESP_LOGI(TAG, "Boot %lu after %s, last boot: %s", block.boots, reasonName(reason), line);
+		}
+	}
+
+	sample();
+
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ printReport(print); }, [this](){ resetStats(); });
+	}
+
+	start();
+}
+
+RTCTelemetry::~RTCTelemetry(){
+	stop();
+}
+
+void RTCTelemetry::phoneConnected(){
+	if(phoneSeen){
+		portENTER_CRITICAL(&lock);
+		block.current.reconnects++;
+		portEXIT_CRITICAL(&lock);
+	}
+	phoneSeen = true;
+}
+
+void RTCTelemetry::loop(){
+	sample();
+	delayNext(SampleInterval);
+}
+
+void RTCTelemetry::sample(){
+	const uint32_t minFree = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+	const uint32_t uptime = millis() / 1000;
+	portENTER_CRITICAL(&lock);
+	block.current.minFreeHeap = std::min<uint32_t>(block.current.minFreeHeap, minFree);
+	block.current.uptime = uptime;
+	portEXIT_CRITICAL(&lock);
+}
+
+bool RTCTelemetry::takeCrashReport(char* buf, size_t size){
+	if(!block.lastValid || block.reported || !isCrash((esp_reset_reason_t) block.lastReason)) return false;
+	block.reported = true;
+
+	const int len = snprintf(buf, size, "Clockstar reset by %s, last boot ", reasonName((esp_reset_reason_t) block.lastReason));
+	if(len < 0 || (size_t) len >= size) return true;
+	format(block.last, buf + len, size - len);
+	return true;
+}
+
+void RTCTelemetry::printReport(const std::function<void(const char* line)>& print){
+	char counters[128];
+	char line[192];
+
+	portENTER_CRITICAL(&lock);
+	const Counters current = block.current;
+	portEXIT_CRITICAL(&lock);
+
+	format(current, counters, sizeof(counters));
+	snprintf(line, sizeof(line), "Telemetry boot %lu: %s\n", block.boots, counters);
+	print(line);
+
+	if(block.lastValid){
+		format(block.last, counters, sizeof(counters));
+		snprintf(line, sizeof(line), "Telemetry last boot, ended by %s: %s\n", reasonName((esp_reset_reason_t) block.lastReason), counters);
+		print(line);
+	}
+
+	int pos = snprintf(line, sizeof(line), "Telemetry resets:");
+	for(size_t i = 0; i < ReasonCount && pos < (int) sizeof(line) - 24; i++){
+		if(block.resets[i] == 0) continue;
+		pos += snprintf(line + pos, sizeof(line) - pos, " %s %u", reasonName((esp_reset_reason_t) i), block.resets[i]);
+	}
+	snprintf(line + pos, sizeof(line) - pos, "\n");
+	print(line);
+}
+
+void RTCTelemetry::resetStats(){
+	portENTER_CRITICAL(&lock);
+	block.current = {};
+	block.current.minFreeHeap = UINT32_MAX;
+	portEXIT_CRITICAL(&lock);
+	sample();
+}
+
+bool RTCTelemetry::isCrash(esp_reset_reason_t reason){
+	return reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+}
+
+const char* RTCTelemetry::reasonName(esp_reset_reason_t reason){
+	switch(reason){
+		case ESP_RST_POWERON: return "power-on";
+		case ESP_RST_EXT: return "external reset";
+		case ESP_RST_SW: return "restart";
+		case ESP_RST_PANIC: return "panic";
+		case ESP_RST_INT_WDT: return "interrupt watchdog";
+		case ESP_RST_TASK_WDT: return "task watchdog";
+		case ESP_RST_WDT: return "watchdog";
+		case ESP_RST_DEEPSLEEP: return "deep sleep";
+		case ESP_RST_BROWNOUT: return "brownout";
+		case ESP_RST_SDIO: return "SDIO";
+		case ESP_RST_USB: return "USB";
+		case ESP_RST_JTAG: return "JTAG";
+		default: return "unknown";
+	}
+}
+
+void RTCTelemetry::format(const Counters& counters, char* buf, size_t size){
+	snprintf(buf, size, "up %lu s, max frame %lu ms, %lu event drops, %lu reconnects, min free heap %lu B, %lu watchdog near-misses",
+			 counters.uptime, counters.maxFrame, counters.eventDrops, counters.reconnects,
+			 counters.minFreeHeap == UINT32_MAX ? 0 : counters.minFreeHeap, counters.nearMisses);
+}
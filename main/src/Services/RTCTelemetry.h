@@ -0,0 +1,107 @@
+#ifndef CLOCKSTAR_FIRMWARE_RTCTELEMETRY_H
+#define CLOCKSTAR_FIRMWARE_RTCTELEMETRY_H
+
+#include "Util/TaskPool.h"
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <functional>
+
+/**
+ * Performance and crash counters kept in RTC slow memory, which survives panics, watchdog and software resets, as
+ * well as light and deep sleep. At boot the counters of the boot that just ended become the last boot's record,
+ * together with why it ended, and counting starts over. Resets are also counted by reason until power is lost.
+ * The last boot is logged at startup and in the console report, and sent to Gadgetbridge once if it ended in a crash.
+ *
+ * Hot paths bump the counters through the static functions, which are safe from any task and from ISRs. They update
+ * the block under a spinlock rather than with atomics, as RTC memory doesn't support the atomic instructions.
+ * The instance must be created before anything counts, it validates the block and samples the heap and uptime.
+ */
+class RTCTelemetry : private PooledThreaded {
+public:
+	RTCTelemetry();
+	~RTCTelemetry() override;
+
+	static constexpr uint32_t SampleInterval = 10000; // [ms]
+
+#ifdef CONFIG_ESP_TASK_WDT_TIMEOUT_S
+	/** LVGL loops busy for longer than half the task watchdog timeout count as watchdog near-misses */
+	static constexpr uint32_t NearMissTime = CONFIG_ESP_TASK_WDT_TIMEOUT_S * 500; // [ms]
+#else
+	static constexpr uint32_t NearMissTime = 2500; // [ms]
+#endif
+
+	struct Counters {
+		uint32_t maxFrame; // [ms] longest LVGL frame, render start to the last flush
+		uint32_t eventDrops; // Events that found a subscriber queue full
+		uint32_t reconnects; // Phone connections after the first one
+		uint32_t minFreeHeap; // [B] lowest free internal heap
+		uint32_t nearMisses;
+		uint32_t uptime; // [s] at the last sample
+	};
+
+	static void frameTime(uint32_t time){
+		portENTER_CRITICAL_SAFE(&lock);
+		if(time > block.current.maxFrame){
+			block.current.maxFrame = time;
+		}
+		portEXIT_CRITICAL_SAFE(&lock);
+	}
+
+	/** Always inlined, it's counted from IRAM code that may run with the flash cache disabled */
+	__attribute__((always_inline)) static void eventDropped(){
+		portENTER_CRITICAL_SAFE(&lock);
+		block.current.eventDrops++;
+		portEXIT_CRITICAL_SAFE(&lock);
+	}
+
+	static void loopTime(uint32_t time){
+		if(time < NearMissTime) return;
+		portENTER_CRITICAL_SAFE(&lock);
+		block.current.nearMisses++;
+		portEXIT_CRITICAL_SAFE(&lock);
+	}
+
+	static void phoneConnected();
+
+	/**
+	 * Formats a one line summary of the last boot if it ended in a crash and it hasn't been taken yet.
+	 * @return False if there's nothing to report
+	 */
+	static bool takeCrashReport(char* buf, size_t size);
+
+	void printReport(const std::function<void(const char* line)>& print);
+
+	/** Restarts the current boot's counters. The last boot's record and the reset counts are kept. */
+	void resetStats();
+
+private:
+	static constexpr uint32_t Magic = 0x436c6b54;
+	static constexpr size_t ReasonCount = 20;
+
+	struct Block {
+		uint32_t magic;
+		uint32_t boots; // Since power was lost
+		uint16_t resets[ReasonCount]; // By esp_reset_reason_t
+		Counters current;
+		Counters last;
+		uint8_t lastReason; // esp_reset_reason_t that ended the last boot
+		bool lastValid;
+		bool reported;
+		uint32_t check; // ~magic
+	};
+	static Block block;
+	static portMUX_TYPE lock; // Guards block.current
+
+	static bool phoneSeen;
+
+	void loop() override;
+	void sample();
+
+	static bool isCrash(esp_reset_reason_t reason);
+	static const char* reasonName(esp_reset_reason_t reason);
+	static void format(const Counters& counters, char* buf, size_t size);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_RTCTELEMETRY_H
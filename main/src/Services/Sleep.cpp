@@ -3,15 +3,23 @@
 #include "BLE/ConMan.h"
 #include "Util/Events.h"
 #include "Util/Services.h"
+#include "Activity.h"
+#include "Actigraphy.h"
+#include "DataLog.h"
+#include "Util/PowerLock.h"
+#include "PowerTelemetry.h"
+#include "Util/Trace.h"
 #include <esp_sleep.h>
 #include <esp_pm.h>
 #include <driver/gpio.h>
 #include <esp_timer.h>
 #include <esp_log.h>
+#include <cstdio>
 
 static const char* TAG = "Sleep";
 
 gpio_num_t Sleep::WakePin;
+volatile int64_t Sleep::intrTime = 0;
 
 Sleep::Sleep(){
 	WakePin = (gpio_num_t) Pins::get(Pin::BtnAlt);
@@ -19,38 +27,139 @@ Sleep::Sleep(){
 	wakeSem = xSemaphoreCreateBinary();
 }
 
-void Sleep::sleep(std::function<void()> preWake){
+void Sleep::sleep(std::function<void()> preSleep, std::function<void()> preWake){
+	TRACE_SCOPE("sleep");
 	ESP_LOGI(TAG, "Goint to sleep\n");
 
-	auto input = (Input*) Services.get(Service::Input);
-	auto time = (Input*) Services.get(Service::Time);
-	auto battery = (Battery*) Services.get(Service::Battery);
-	auto bl = (BacklightBrightness*) Services.get(Service::Backlight);
+	auto input = Services.get<Service::Input>();
+	auto time = Services.get<Service::Time>();
+	auto battery = Services.get<Service::Battery>();
+	auto bl = Services.get<Service::Backlight>();
+	auto activity = Services.get<Service::Activity>();
+	auto actigraphy = Services.get<Service::Actigraphy>();
+	auto dataLog = Services.get<Service::DataLog>();
+
+	// Sleep entry. The fade runs in the LEDC hardware and the BLE parameter request completes in the controller,
+	// so both are started first and everything else is done while they run. Pausing the pooled services only
+	// cancels their jobs, the battery task applies its change on its own.
+	traceStart = esp_timer_get_time();
+	traceCount = 0;
+
+	bl->fadeOut();
+	ConMan.goLowPow();
+	mark("start");
 
 	input->pause();
 	time->pause();
+	activity->pause();
+	if(dataLog){
+		dataLog->pause();
+	}
 	battery->setSleep(true);
+	mark("services");
 
 	Events::post(Facility::Sleep, Event { .action = Event::SleepOn });
 
-	bl->fadeOut();
-	ConMan.goLowPow();
+	bl->await(); // LEDC stops in light sleep, the backlight has to be off by then
+	mark("backlight");
+
+	if(preSleep){
+		preSleep();
+	}
+	mark("frame");
+
+	// Only once the lock screen is up, the screen it replaced may have held the FIFO until then
+	if(actigraphy){
+		actigraphy->setSleep(true);
+	}
+
+	auto telemetry = Services.get<Service::PowerTelemetry>();
+	if(telemetry){
+		telemetry->sessionStart();
+	}
 
 	int64_t sleepStartTime = esp_timer_get_time();
+	entryTime = sleepStartTime - traceStart;
+	logTrace("Sleep path [us]:");
+
 	sleepStart();
 	auto sleepTime = esp_timer_get_time() - sleepStartTime;
 
-	ConMan.goHiPow();
-	input->resume();
-	time->resume();
-	battery->setSleep(false);
+	if(telemetry){
+		telemetry->sessionEnd();
+	}
+	mark("pm");
+
+	if(FastResume){
+		input->resume();
+		bl->fadeIn();
+		mark("backlight");
+
+		// The first frame may start a screen that takes the FIFO
+		if(actigraphy){
+			actigraphy->setSleep(false);
+		}
+
+		if(preWake){
+			preWake();
+		}
+		mark("frame");
+
+		ConMan.goHiPow();
+		time->resume();
+		activity->resume();
+		if(dataLog){
+			dataLog->resume();
+		}
+		battery->setSleep(false);
+		mark("services");
+
+		Events::post(Facility::Sleep, Event { .action = Event::SleepOff });
+	}else{
+		ConMan.goHiPow();
+		input->resume();
+		time->resume();
+		activity->resume();
+		if(dataLog){
+			dataLog->resume();
+		}
+		battery->setSleep(false);
+		if(actigraphy){
+			actigraphy->setSleep(false);
+		}
+		mark("services");
 
-	Events::post(Facility::Sleep, Event { .action = Event::SleepOff });
+		Events::post(Facility::Sleep, Event { .action = Event::SleepOff });
 
-	preWake();
-	bl->fadeIn();
+		if(preWake){
+			preWake();
+		}
+		mark("frame");
+
+		bl->fadeIn();
+		mark("backlight");
+	}
 
 	ESP_LOGI(TAG, "Slept for %lld us\n", sleepTime);
+	logTrace("Wake path [us]:");
+}
+
+uint32_t Sleep::getEntryTime() const{
+	return entryTime;
+}
+
+void Sleep::mark(const char* step){
+	if(traceCount >= MaxTraceMarks) return;
+	trace[traceCount++] = { step, (uint32_t) (esp_timer_get_time() - traceStart) };
+}
+
+void Sleep::logTrace(const char* title){
+	char line[128];
+	int len = snprintf(line, sizeof(line), "%s", title);
+	for(size_t i = 0; i < traceCount && len > 0 && len < (int) sizeof(line); i++){
+		len += snprintf(line + len, sizeof(line) - len, " %s %lu", trace[i].step, trace[i].time);
+	}
+	ESP_LOGI(TAG, "%s", line);
 }
 
 void IRAM_ATTR Sleep::sleepStart(){
@@ -64,8 +173,14 @@ void IRAM_ATTR Sleep::sleepStart(){
 	gpio_config(&io_conf);
 	gpio_isr_handler_add(WakePin, intr, &wakeSem);
 
+	intrTime = 0;
 	confPM(true);
 	xSemaphoreTake(wakeSem, portMAX_DELAY);
+
+	traceStart = intrTime ? intrTime : esp_timer_get_time();
+	traceCount = 0;
+	mark("task");
+
 	gpio_isr_handler_remove(WakePin);
 	confPM(false);
 
@@ -73,28 +188,41 @@ void IRAM_ATTR Sleep::sleepStart(){
 }
 
 void IRAM_ATTR Sleep::intr(void* arg){
+	if(intrTime == 0){
+		intrTime = esp_timer_get_time();
+	}
 	gpio_set_intr_type(WakePin, GPIO_INTR_POSEDGE);
 	auto sem = (SemaphoreHandle_t*) arg;
-	xSemaphoreGive(*sem);
+	BaseType_t wake = pdFALSE;
+	xSemaphoreGiveFromISR(*sem, &wake);
+	portYIELD_FROM_ISR(wake);
 }
 
 void Sleep::confPM(bool sleep, bool firstTime){
 	if(sleep){
+		// FIFO batches taken through sleep wake the chip over INT1. Other INT1 sources are rare enough to wake with them
+		auto imu = Services.get<Service::IMU>();
+		const bool fifoWake = imu && imu->isFIFOEnabled();
+
+		if(auto telemetry = Services.get<Service::PowerTelemetry>()){
+			telemetry->setWakePins((1ULL << WakePin) | (1ULL << Pins::get(Pin::Imu_int2)) | (fifoWake ? 1ULL << Pins::get(Pin::Imu_int1) : 0));
+		}
+
 		gpio_wakeup_enable(WakePin, GPIO_INTR_HIGH_LEVEL);
 		gpio_wakeup_enable((gpio_num_t) Pins::get(Pin::Imu_int2), GPIO_INTR_HIGH_LEVEL);
+		if(fifoWake){
+			gpio_wakeup_enable((gpio_num_t) Pins::get(Pin::Imu_int1), GPIO_INTR_HIGH_LEVEL);
+		}
 		esp_sleep_enable_gpio_wakeup();
 	}else{
 		gpio_wakeup_disable(WakePin);
 		gpio_wakeup_disable((gpio_num_t) Pins::get(Pin::Imu_int2));
+		gpio_wakeup_disable((gpio_num_t) Pins::get(Pin::Imu_int1));
 		if(!firstTime){
 			esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
 		}
 	}
 
-	esp_pm_config_t pm_config = {
-			.max_freq_mhz = 240, // e.g. 80, 160, 240
-			.min_freq_mhz = 240, // e.g. 40
-			.light_sleep_enable = sleep // enable light sleep
-	};
-	ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+	// Frequencies follow the PowerLocks held, see PowerProfile
+	PowerLock::setLightSleep(sleep);
 }
@@ -6,6 +6,7 @@
 #include "Services/Time.h"
 #include "BacklightBrightness.h"
 #include "Pins.hpp"
+#include <sdkconfig.h>
 
 class SleepMan;
 
@@ -13,7 +14,21 @@ class Sleep {
 public:
 	Sleep();
 
-	void sleep(std::function<void()> preWake = {});
+	/**
+	 * Light sleeps until woken. preSleep runs once the backlight is off, preWake should render the first frame.
+	 * With FastResume the backlight starts fading in before preWake, and the services the first frame doesn't need
+	 * are only resumed after it. Every sleep logs a trace of the way into sleep and of the wake path.
+	 */
+	void sleep(std::function<void()> preSleep = {}, std::function<void()> preWake = {});
+
+	/** Time from the last sleep() call until light sleep was enabled [us] */
+	uint32_t getEntryTime() const;
+
+#ifdef CONFIG_CM_SLEEP_FAST_RESUME
+	static constexpr bool FastResume = true;
+#else
+	static constexpr bool FastResume = false;
+#endif
 
 	struct Event {
 		enum { SleepOn, SleepOff } action;
@@ -25,6 +40,20 @@ friend SleepMan;
 
 	SemaphoreHandle_t wakeSem;
 	static void intr(void* arg);
+	static volatile int64_t intrTime; //[us] of the wake button or motion interrupt, 0 if woken otherwise
+
+	/** Sleep path timestamps from the sleep call, wake path ones from the wake interrupt or the wake call */
+	struct TraceMark {
+		const char* step;
+		uint32_t time; //[us]
+	};
+	static constexpr size_t MaxTraceMarks = 8;
+	TraceMark trace[MaxTraceMarks];
+	size_t traceCount = 0;
+	int64_t traceStart = 0; //[us]
+	void mark(const char* step);
+	void logTrace(const char* title);
+	uint32_t entryTime = 0; //[us]
 
 	void sleepStart();
 
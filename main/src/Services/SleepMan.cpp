@@ -1,61 +1,102 @@
 #include "SleepMan.h"
 #include "Screens/Lock/LockScreen.h"
 #include "Util/Services.h"
+#include "Util/LoopGuard.h"
 #include "Screens/ShutdownScreen.h"
 #include <esp_sleep.h>
 #include <driver/rtc_io.h>
 #include "Screens/MainMenu/MainMenu.h"
+#include <algorithm>
 
-SleepMan::SleepMan(LVGL& lvgl) : events(12), lvgl(lvgl),
-								 imu(*((IMU*) Services.get(Service::IMU))),
-								 bl(*((BacklightBrightness*) Services.get(Service::Backlight))),
-								 settings(*((Settings*) Services.get(Service::Settings))){
+SleepMan::SleepMan(LVGL& lvgl) : events(12, "SleepMan"), lvgl(lvgl),
+								 imu(*(Services.get<Service::IMU>())),
+								 bl(*(Services.get<Service::Backlight>())),
+								 settings(*(Services.get<Service::Settings>())), uiLock(PowerProfile::Normal, "UI"){
 	Events::listen(Facility::Input, &events);
 	Events::listen(Facility::Motion, &events);
 	Events::listen(Facility::Battery, &events);
+	Events::listen(Facility::Phone, &events);
 
 	imu.enableTiltDetection(settings.get().motionDetection);
 	imu.setTiltDirection(IMU::TiltDirection::Lowered);
 
 	actTime = millis();
+	predictor.woke(actTime);
+	uiLock.acquire();
 }
 
-void SleepMan::goSleep(){
-	auto battery = (Battery*) Services.get(Service::Battery);
+void SleepMan::goSleep(bool automatic){
+	auto battery = Services.get<Service::Battery>();
 	if(!battery || battery->isShutdown()) return;
 
 	MainMenu::resetMenuIndex();
 
+	undim(false);
+	uiLock.release();
+
 	lvgl.stopScreen();
 	imu.setTiltDirection(IMU::TiltDirection::Lifted);
 
 	inSleep = true;
+	predictor.slept(millis(), automatic);
+
+	// Blocks the LVGL thread until woken, which isn't a stall
+	LoopGuard::Exempt exempt;
 	sleep.sleep([this](){
-		if(!nsBlocked){
-			lvgl.startScreen([](){ return std::make_unique<LockScreen>(); });
+		// Pending settings are written while the backlight is already off
+		settings.flush();
+
+		if(!Sleep::FastResume) return;
+
+		// Brought up and drawn while the backlight is off, waking only has to bring it up to date.
+		// The lock screen is only built if it isn't resident already.
+		lvgl.startScreen<LockScreen>();
+		lv_refr_now(lvgl.disp());
+		lvgl.stopScreen();
+	}, [this](){
+		uiLock.acquire();
+		if(nsBlocked){
+			lv_timer_handler();
+		}else if(Sleep::FastResume){
+			lvgl.resumeSuspended();
+			lv_refr_now(lvgl.disp());
+		}else{
+			lvgl.startScreen<LockScreen>();
+			lv_timer_handler();
 		}
-		lv_timer_handler();
 	});
 	nsBlocked = inSleep = false;
 
 	imu.setTiltDirection(IMU::TiltDirection::Lowered);
 
 	wakeTime = actTime = millis();
+	predictor.woke(wakeTime);
 	events.reset();
 }
 
-void SleepMan::wake(bool blockLock){
+void SleepMan::wake(bool blockLock, int64_t intrTime){
 	if(!inSleep) return;
 	nsBlocked = blockLock;
+	if(intrTime != 0 && Sleep::intrTime == 0){
+		Sleep::intrTime = intrTime;
+	}
 	xSemaphoreGive(sleep.wakeSem);
 }
 
 void SleepMan::shutdown(){
-	Display* display = (Display*) Services.get(Service::Display);
+	Display* display = Services.get<Service::Display>();
+
+	settings.flush();
+
+	// Every shutdown ends here, the critical battery one included, so the history is written once on the way out
+	if(auto battery = Services.get<Service::Battery>()){
+		battery->getHistory().store();
+	}
 
 	bl.fadeOut();
 	imu.shutdown();
 	display->getLGFX().sleep();
+	bl.await();
 
 	gpio_sleep_set_pull_mode((gpio_num_t)Pins::get(Pin::BattVref), GPIO_PULLDOWN_ONLY);
 	gpio_sleep_sel_en((gpio_num_t)Pins::get(Pin::BattVref));
@@ -94,35 +135,109 @@ void SleepMan::checkEvents(){
 		}else if(evt.facility == Facility::Motion){
 			auto param = (IMU::Event*) evt.data;
 			handleMotion(*param);
+		}else if(evt.facility == Facility::Phone){
+			auto param = (Phone::Event*) evt.data;
+			handlePhone(*param);
+		}else if(evt.facility == Facility::Battery){
+			auto param = (Battery::Event*) evt.data;
+			handleBattery(*param);
 		}
-
-		free(evt.data);
 	}
 }
 
+const SettingsStruct& SleepMan::getSettings(){
+	settings.refresh(cachedSettings, settingsVersion);
+	return cachedSettings;
+}
+
 void SleepMan::checkAutoSleep(){
 	if(!autoSleep) return;
 
-	auto sti = settings.get().sleepTime;
+	auto sti = getSettings().sleepTime;
 	if(sti >= Settings::SleepSteps) return;
 
-	auto sleepSeconds = Settings::SleepSeconds[settings.get().sleepTime];
+	auto sleepSeconds = sti == Settings::SleepAdaptive ? predictor.getTimeout() : Settings::SleepSeconds[sti];
+	const auto inactive = (millis() - actTime) / 1000;
+
+	if(!dimmed && inactive >= DimSeconds && (sleepSeconds == 0 || sleepSeconds > DimSeconds)){
+		dim();
+	}
+
 	if(sleepSeconds == 0) return;
 
-	if((millis() - actTime) / 1000 < sleepSeconds) return;
+	if(inactive < sleepSeconds) return;
+
+	goSleep(true);
+}
+
+void SleepMan::dim(){
+	if(dimmed) return;
+	dimmed = true;
+
+	bl.setBrightness(std::min(getSettings().screenBrightness, DimBrightness));
+
+	auto display = Services.get<Service::Display>();
+	display->setIdle(true);
+	lvgl.setIdleRefresh(DimRefreshPeriod);
+	uiLock.release();
+	setAmbient(true);
+}
+
+void SleepMan::undim(bool restoreBacklight){
+	if(!dimmed) return;
+	dimmed = false;
+	setAmbient(false);
+	uiLock.acquire();
+
+	lvgl.setIdleRefresh(0);
+	auto display = Services.get<Service::Display>();
+	display->setIdle(false);
 
-	goSleep();
+	if(restoreBacklight){
+		bl.setBrightness(getSettings().screenBrightness);
+	}
+}
+
+void SleepMan::setAmbient(bool ambient){
+#ifdef CONFIG_CM_AMBIENT_SLEEP
+	// LEDC keeps running from RC_FAST as long as it stays powered and the pin keeps its function in sleep
+	// Both are undone on the way out, so the light sleep outside ambient powers RC_FAST down and lets the pin go
+	esp_sleep_pd_config(ESP_PD_DOMAIN_RC_FAST, ambient ? ESP_PD_OPTION_ON : ESP_PD_OPTION_AUTO);
+	if(ambient){
+		gpio_sleep_sel_dis((gpio_num_t) Pins::get(Pin::LedBl));
+	}else{
+		gpio_sleep_sel_en((gpio_num_t) Pins::get(Pin::LedBl));
+	}
+
+	// Buttons wake the chip through GPIO wakeup, time and LVGL with their timers, BLE stays connected through modem sleep
+	if(auto input = Services.get<Service::Input>()){
+		input->setWakeup(ambient);
+	}
+	PowerLock::setLightSleep(ambient);
+#endif
 }
 
 void SleepMan::handleInput(const Input::Data& evt){
 	actTime = millis();
+	undim();
+
+	if(evt.action == Input::Data::Press){
+		predictor.pressed(actTime);
+	}
+
+	if(evt.action == Input::Data::Chord && (evt.chord & (1 << Input::Alt))){
+		altClick = false;
+	}
 
 	if(evt.btn != Input::Alt || !altLock) return;
 
+	// A short click locks, holding Alt or using it in a chord is left to the screens
 	if(evt.action == Input::Data::Press){
-		if(millis() - wakeTime < WakeCooldown) return;
-		altPress = millis();
-	}else if(millis() - altPress < AltHoldTime){
+		altClick = millis() - wakeTime >= WakeCooldown;
+	}else if(evt.action == Input::Data::Hold){
+		altClick = false;
+	}else if(evt.action == Input::Data::Release && altClick){
+		altClick = false;
 		goSleep();
 	}
 }
@@ -130,17 +245,36 @@ void SleepMan::handleInput(const Input::Data& evt){
 void SleepMan::handleMotion(const IMU::Event& evt){
 	if(!autoSleep) return;
 
-	const bool wristSleep = settings.get().motionDetection;
+	const bool wristSleep = getSettings().motionDetection;
 
-	if((evt.action == IMU::Event::WristTilt && evt.wristTiltDir == IMU::TiltDirection::Lowered && wristSleep) || evt.action == IMU::Event::DoubleTap){
+	if((evt.action == IMU::Event::WristTilt && evt.wristTiltDir == IMU::TiltDirection::Lowered && wristSleep) || evt.action == IMU::Event::DoubleTap || evt.action == IMU::Event::TurnOver){
 		goSleep();
 	}
 }
 
+void SleepMan::handlePhone(const Phone::Event& evt){
+	if(evt.action != Phone::Event::Notifs || (evt.data.batch.added == 0 && evt.data.batch.changed == 0)) return;
+
+	// A new notification is shown in full, and gets the whole timeout before the UI dims again
+	actTime = millis();
+	undim();
+}
+
+void SleepMan::handleBattery(const Battery::Event& evt){
+	if(evt.action != Battery::Event::Plugged) return;
+
+	// Plugging in counts as activity, the charging state shows up on a lit screen
+	actTime = millis();
+	undim();
+}
+
 void SleepMan::enAltLock(bool altLock){
 	SleepMan::altLock = altLock;
 }
 
 void SleepMan::enAutoSleep(bool autoSleep){
 	SleepMan::autoSleep = autoSleep;
+	if(!autoSleep){
+		undim();
+	}
 }
@@ -6,6 +6,10 @@
 #include "Devices/IMU.h"
 #include "Util/Events.h"
 #include "LV_Interface/LVGL.h"
+#include "Util/PowerLock.h"
+#include "SleepPredictor.h"
+#include "Notifs/Phone.h"
+#include "Devices/Battery.h"
 #include <memory>
 
 class SleepMan {
@@ -18,7 +22,8 @@ public:
 
 	static constexpr uint32_t ShutdownTime = 3000; //3s
 
-	void wake(bool blockLockScreen = false);
+	/** @param intrTime [us] of the interrupt that led to the wake, the wake trace starts there instead of at this call */
+	void wake(bool blockLockScreen = false, int64_t intrTime = 0);
 	void shutdown();
 
 private:
@@ -30,28 +35,53 @@ private:
 	IMU& imu;
 	BacklightBrightness& bl;
 	Settings& settings;
+	SettingsStruct cachedSettings;
+	uint32_t settingsVersion = UINT32_MAX;
 
-	void goSleep();
+	/** Settings copy refreshed only when they changed, the loop reads them every iteration */
+	const SettingsStruct& getSettings();
+
+	/** @param automatic Timed out, not requested by a button or a gesture */
+	void goSleep(bool automatic = false);
 
 	bool inSleep = false;
 
 	uint32_t actTime = 0;
 	bool autoSleep = true;
+	SleepPredictor predictor;
 	void checkAutoSleep();
 
 	void checkEvents();
 	void handleInput(const Input::Data& evt);
 	void handleMotion(const IMU::Event& evt);
+	void handlePhone(const Phone::Event& evt);
+	void handleBattery(const Battery::Event& evt);
 
 	static constexpr uint32_t WakeCooldown = 100;
 	uint32_t wakeTime = 0;
 
 	bool altLock = false;
-	static constexpr uint32_t AltHoldTime = 300;
-	uint32_t altPress;
+	bool altClick = false;
 
 	bool nsBlocked = false;
 
+	/** Normal profile while the UI is awake, released when dimmed or asleep */
+	PowerLock uiLock;
+
+	/**
+	 * Dim state between active and sleep: lowered backlight, UI refreshed once per DimRefreshPeriod, and the panel in
+	 * its 8 color idle mode until the next redraw leaves it. Input and new or changed notifications undim.
+	 */
+	bool dimmed = false;
+	static constexpr uint32_t DimSeconds = 15;
+	static constexpr uint8_t DimBrightness = 20; // [%]
+	static constexpr uint32_t DimRefreshPeriod = 1000; // [ms]
+	void dim();
+	void undim(bool restoreBacklight = true);
+
+	/** Ambient: automatic light sleep between refreshes while dimmed, the backlight stays on, see CM_AMBIENT_SLEEP */
+	void setAmbient(bool ambient);
+
 };
 
 
@@ -0,0 +1,58 @@
+#include "SleepPredictor.h"
+#include <algorithm>
+#include <esp_log.h>
+
+static const char* TAG = "SleepPredictor";
+
+void SleepPredictor::woke(uint64_t now){
+	if(autoSlept && now - sleepTime < RewakeWindow){
+		margin = std::min(margin + MarginUp, MarginMax);
+		ESP_LOGI(TAG, "Woken right after auto sleep, margin now %.2f", margin);
+	}
+
+	wakeTime = now;
+	lastPress = 0;
+	autoSlept = false;
+}
+
+void SleepPredictor::pressed(uint64_t now){
+	if(lastPress == 0){
+		const float delay = (float) (now - wakeTime);
+		firstPress = firstPress * (1.0f - FirstPressA) + FirstPressA * delay;
+	}else{
+		// Only pauses the user carried on after, anything longer ended in sleep and is never seen here
+		const uint64_t gap = std::min((now - lastPress) / 100, (uint64_t) UINT16_MAX);
+		gaps[gapHead] = (uint16_t) gap;
+		gapHead = (gapHead + 1) % MaxGaps;
+		gapCount = std::min(gapCount + 1, MaxGaps);
+	}
+
+	lastPress = now;
+}
+
+void SleepPredictor::slept(uint64_t now, bool automatic){
+	if(automatic){
+		margin = std::max(margin - MarginDown, MarginMin);
+	}
+
+	sleepTime = now;
+	autoSlept = automatic;
+}
+
+uint32_t SleepPredictor::getTimeout() const{
+	if(lastPress == 0){
+		const auto timeout = (uint32_t) (firstPress * margin / 1000.0f);
+		return std::clamp(timeout, GlanceMin, GlanceMax);
+	}
+
+	if(gapCount < MinGaps){
+		return ActiveDefault;
+	}
+
+	std::array<uint16_t, MaxGaps> sorted = gaps;
+	const size_t index = (gapCount - 1) * GapPercentile / 100;
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.begin() + gapCount);
+
+	const auto timeout = (uint32_t) ((float) sorted[index] * margin / 10.0f);
+	return std::clamp(timeout, ActiveMin, ActiveMax);
+}
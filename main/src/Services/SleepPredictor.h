@@ -0,0 +1,56 @@
+#ifndef CLOCKSTAR_FIRMWARE_SLEEPPREDICTOR_H
+#define CLOCKSTAR_FIRMWARE_SLEEPPREDICTOR_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Adaptive auto sleep timeout, learned from recent screen-on sessions.
+ * Until the first button press of a session the watch counts as glanced at, and times out soon after the delay the
+ * first press usually comes with. Once the user is pressing buttons, the timeout follows the longest pauses they
+ * recently made between presses and still carried on, so reading a notification or scrolling keeps the screen on.
+ * Every wake that comes right after an auto sleep means the timeout was too short and widens the margin, the margin
+ * shrinks back a little with every auto sleep that wasn't undone. Kept in RAM only, it starts over after a reboot.
+ */
+class SleepPredictor {
+public:
+	void woke(uint64_t now); //[ms]
+	void pressed(uint64_t now); //[ms]
+	void slept(uint64_t now, bool automatic); //[ms]
+
+	/** Timeout from the last activity [s] */
+	uint32_t getTimeout() const;
+
+	static constexpr uint32_t GlanceMin = 5; //[s]
+	static constexpr uint32_t GlanceMax = 15; //[s]
+	static constexpr uint32_t ActiveMin = 10; //[s]
+	static constexpr uint32_t ActiveMax = 120; //[s]
+
+private:
+	static constexpr uint32_t ActiveDefault = 30; //[s] until enough pauses are known
+	static constexpr uint32_t RewakeWindow = 5000; //[ms]
+	static constexpr float MarginMin = 1.5f;
+	static constexpr float MarginMax = 4.0f;
+	static constexpr float MarginUp = 0.5f;
+	static constexpr float MarginDown = 0.05f;
+	static constexpr float FirstPressA = 0.2f; // EMA factor
+
+	static constexpr size_t MaxGaps = 32;
+	static constexpr size_t MinGaps = 4;
+	static constexpr size_t GapPercentile = 90; //[%]
+	std::array<uint16_t, MaxGaps> gaps{}; //[100ms]
+	size_t gapCount = 0;
+	size_t gapHead = 0;
+
+	float firstPress = 4000; //[ms] EMA of the delay from wake to the first press
+	float margin = 2.0f;
+
+	uint64_t wakeTime = 0; //[ms]
+	uint64_t lastPress = 0; //[ms], 0 while the session is a glance
+	uint64_t sleepTime = 0; //[ms]
+	bool autoSlept = false;
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_SLEEPPREDICTOR_H
@@ -2,17 +2,25 @@
 #include "Util/Services.h"
 #include "SleepMan.h"
 #include "Pins.hpp"
+#include "PWMChannels.hpp"
+#include "Util/stdafx.h"
+#include <algorithm>
 
-StatusCenter::StatusCenter() : Threaded("Status", 2048), events(12),
-chirp(*((ChirpSystem*) Services.get(Service::Audio))),
-settings(*((Settings*) Services.get(Service::Settings)))
+StatusCenter::StatusCenter() : Threaded("Status", 2048, PlannedTask::Status), events(12, "StatusCenter"),
+chirp(*(Services.get<Service::Audio>())),
+settings(*(Services.get<Service::Settings>()))
 {
+	events.coalesce<Battery::Event>(Facility::Battery, Battery::Event::LevelChange);
+	events.coalesce<Battery::Event>(Facility::Battery, Battery::Event::Charging);
 	Events::listen(Facility::Phone, &events);
 	Events::listen(Facility::Battery, &events);
+	events.coalesce<Settings::Event>(Facility::Settings, Settings::Event::Changed);
+	Events::listen(Facility::Settings, &events);
+	Events::listen(Facility::Sleep, &events);
 
-	auto pwmR = new PWM(Pins::get(Pin::Rgb_r), LEDC_CHANNEL_2, true);
-	auto pwmG = new PWM(Pins::get(Pin::Rgb_g), LEDC_CHANNEL_3, true);
-	auto pwmB = new PWM(Pins::get(Pin::Rgb_b), LEDC_CHANNEL_4, true);
+	auto pwmR = new PWM(Pins::get(Pin::Rgb_r), PWMChannels::get(PWMUser::RgbR), true);
+	auto pwmG = new PWM(Pins::get(Pin::Rgb_g), PWMChannels::get(PWMUser::RgbG), true);
+	auto pwmB = new PWM(Pins::get(Pin::Rgb_b), PWMChannels::get(PWMUser::RgbB), true);
 
 	led = new RGBLEDController(*pwmR, *pwmG, *pwmB);
 	led->begin();
@@ -22,8 +30,19 @@ settings(*((Settings*) Services.get(Service::Settings)))
 }
 
 void StatusCenter::loop(){
+	TickType_t wait = portMAX_DELAY;
+	if(flushTime != 0){
+		const uint64_t now = millis();
+		wait = flushTime > now ? pdMS_TO_TICKS(flushTime - now) : 0;
+	}
+
 	Event evt;
-	if(!events.get(evt, portMAX_DELAY)) return;
+	if(!events.get(evt, wait)){
+		if(flushTime != 0 && millis() >= flushTime){
+			flush();
+		}
+		return;
+	}
 
 	if(evt.facility == Facility::Phone){
 		auto data = (Phone::Event*) evt.data;
@@ -31,32 +50,70 @@ void StatusCenter::loop(){
 	}else if(evt.facility == Facility::Battery){
 		auto data = (Battery::Event*) evt.data;
 		processBatt(*data);
+	}else if(evt.facility == Facility::Settings){
+		// The LED follows its setting as soon as it changes
+		updateLED();
+	}else if(evt.facility == Facility::Sleep){
+		auto data = (Sleep::Event*) evt.data;
+		asleep = data->action == Sleep::Event::SleepOn;
+
+		// Woken up, whatever waited for the sleep window goes out with the wake
+		if(!asleep && flushTime != 0){
+			flushTime = std::max(millis(), lastAlert + AlertInterval);
+		}
 	}
-
-	free(evt.data);
 }
 
 void StatusCenter::processPhone(const Phone::Event& evt){
-	auto phone = (Phone*) Services.get(Service::Phone);
-	hasNotifs = !phone->getNotifs().empty();
+	if(auto phone = Services.get<Service::Phone>()){
+		hasNotifs = phone->getNotifsCount() > 0;
+	}
 
-	if((evt.action == Phone::Event::Added || evt.action == Phone::Event::Changed)){
-		if(settings.get().notificationSounds && !audioBlocked){
-			beep();
-		}
+	// One chirp and blink for the whole batch, and for any batches following it within the window
+	if(evt.action == Phone::Event::Notifs && (evt.data.batch.added > 0 || evt.data.batch.changed > 0)){
+		pending.beep = pending.blink = true;
+		schedule();
+	}
+}
 
-		if(settings.get().ledEnable){
-			blink();
-		}
+void StatusCenter::schedule(){
+	if(flushTime != 0) return;
+
+	const uint64_t now = millis();
+	if(asleep){
+		flushTime = (now / SleepWindow + 1) * SleepWindow;
+	}else{
+		flushTime = std::max(now, lastAlert + AlertInterval);
+	}
+
+	if(flushTime <= now){
+		flush();
+	}
+}
+
+void StatusCenter::flush(){
+	flushTime = 0;
+	lastAlert = millis();
+
+	if(pending.beep && settings.get().notificationSounds && !audioBlocked){
+		beep();
+	}
+
+	if(pending.blink && settings.get().ledEnable){
+		blink();
 	}
+
+	pending = {};
 }
 
 void StatusCenter::processBatt(const Battery::Event& evt){
+	const auto prevState = battState;
+
 	if(evt.action == Battery::Event::Charging){
 		if(evt.chargeStatus != Battery::ChargingState::Unplugged){
 			battState = Charging;
 		}
-	}else{
+	}else if(evt.action == Battery::Event::LevelChange){
 		auto level = evt.level;
 
 		if(level == Battery::Critical){
@@ -70,11 +127,21 @@ void StatusCenter::processBatt(const Battery::Event& evt){
 		}
 	}
 
+	// Level changes come in all the time, the LED pattern only restarts when the state it shows changed
+	if(battState == prevState) return;
 	updateLED();
 }
 
 void StatusCenter::updateLED(){
-	if(settings.get().ledEnable == false){
+	showLED(settings.get().ledEnable);
+}
+
+void StatusCenter::previewLED(bool enable){
+	showLED(enable);
+}
+
+void StatusCenter::showLED(bool enable){
+	if(!enable){
 		led->clear();
 		return;
 	}
@@ -96,12 +163,15 @@ void StatusCenter::blink(){
 	led->blinkTwice({ 0, 0, 255 });
 }
 
+static constexpr Chirp BeepChirps[] = {
+	Chirp{ .startFreq = 400, .endFreq = 600, .duration = 50 },
+	Chirp{ .startFreq = 0, .endFreq = 0, .duration = 100 },
+	Chirp{ .startFreq = 600, .endFreq = 400, .duration = 50 }
+};
+static constexpr auto Beep = ChirpSystem::compile<ChirpSystem::segmentCount(BeepChirps)>(BeepChirps);
+
 void StatusCenter::beep(){
-	chirp.play({
-		Chirp{ .startFreq = 400, .endFreq = 600, .duration = 50 },
-		Chirp{ .startFreq = 0, .endFreq = 0, .duration = 100 },
-		Chirp{ .startFreq = 600, .endFreq = 400, .duration = 50 }
-	});
+	chirp.play(Beep, ChirpSystem::Voice::Notification);
 }
 
 void StatusCenter::shutdown(){
@@ -9,6 +9,7 @@
 #include "ChirpSystem.h"
 #include "Settings/Settings.h"
 #include "Devices/LEDController.h"
+#include <atomic>
 
 class StatusCenter : public Threaded {
 public:
@@ -17,21 +18,44 @@ public:
 	void blockAudio(bool block);
 
 	void updateLED();
+
+	/** Shows the LED as it would be with ledEnable set to enable, without changing the setting */
+	void previewLED(bool enable);
 	void blink();
 	void beep();
 	void shutdown();
 
 private:
-	EventQueue events;
+	CoalescingEventQueue events;
 
 	ChirpSystem& chirp;
 	Settings& settings;
 	RGBLEDController* led;
 
-	bool audioBlocked = false;
+	std::atomic_bool audioBlocked = false;
 	bool hasNotifs = false;
 	enum { Ok, Empty, Charging } battState = Ok;
 
+	/**
+	 * Notification feedback is merged rather than played per event: a beep and blink go out at most once per
+	 * AlertInterval, and whatever comes in meanwhile joins the next one. Asleep, alerts wait for the next SleepWindow
+	 * boundary, so a burst spread over a few seconds wakes the LED and buzzer once. Settings and audioBlocked are
+	 * checked when the alert plays, not when it's queued.
+	 */
+	struct {
+		bool beep = false;
+		bool blink = false;
+	} pending;
+	uint64_t flushTime = 0; // [ms] 0 when nothing is pending
+	uint64_t lastAlert = 0; // [ms]
+	bool asleep = false;
+	static constexpr uint32_t AlertInterval = 2000; // [ms]
+	static constexpr uint32_t SleepWindow = 3000; // [ms]
+
+	void schedule();
+	void showLED(bool enable);
+	void flush();
+
 	void loop() override;
 
 	void processPhone(const Phone::Event& evt);
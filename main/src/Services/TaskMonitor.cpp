@@ -0,0 +1,133 @@
+#include "TaskMonitor.h"
+#include "Util/Services.h"
+#include "Services/Console.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+TaskMonitor::TaskMonitor() : PooledThreaded("TaskMonitor"){
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ printReport(print); });
+	}
+
+	start();
+}
+
+TaskMonitor::~TaskMonitor(){
+	stop();
+}
+
+void TaskMonitor::loop(){
+	sample();
+	delayNext(SampleInterval);
+}
+
+TaskMonitor::TaskInfo* TaskMonitor::findTask(TaskHandle_t handle){
+	for(size_t i = 0; i < taskCount; i++){
+		if(tasks[i].handle == handle) return &tasks[i];
+	}
+	return nullptr;
+}
+
+void TaskMonitor::sample(){
+	uint32_t total = 0;
+	const auto count = uxTaskGetSystemState(status, MaxTasks, &total);
+
+	std::lock_guard lock(mut);
+
+	const uint32_t elapsed = total - prevTotal;
+	prevTotal = total;
+
+	uint32_t idle[portNUM_PROCESSORS] = {};
+
+	// Forget tasks that were deleted since the last sample
+	for(size_t i = 0; i < taskCount; i++){
+		tasks[i].seen = false;
+	}
+	for(size_t i = 0; i < count; i++){
+		if(auto task = findTask(status[i].xHandle)){
+			task->seen = true;
+		}
+	}
+	for(size_t i = 0; i < taskCount;){
+		if(tasks[i].seen){
+			i++;
+		}else{
+			tasks[i] = tasks[--taskCount];
+		}
+	}
+
+	for(size_t i = 0; i < count; i++){
+		const auto& stat = status[i];
+
+		auto task = findTask(stat.xHandle);
+		if(task == nullptr){
+			if(taskCount == MaxTasks) continue;
+
+			task = &tasks[taskCount++];
+			*task = {
+					.name = {},
+					.handle = stat.xHandle,
+					.core = stat.xCoreID,
+					.stackFree = UINT32_MAX,
+					.cpu = 0,
+					.prevRuntime = stat.ulRunTimeCounter,
+					.seen = true
+			};
+			strncpy(task->name, stat.pcTaskName, sizeof(task->name) - 1);
+		}
+
+		task->stackFree = std::min(task->stackFree, (uint32_t) stat.usStackHighWaterMark * sizeof(StackType_t));
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+		const uint32_t runtime = stat.ulRunTimeCounter - task->prevRuntime;
+		task->prevRuntime = stat.ulRunTimeCounter;
+		task->cpu = elapsed ? std::min<uint32_t>(100, (uint64_t) runtime * 100 / elapsed) : 0;
+
+		for(uint8_t core = 0; core < portNUM_PROCESSORS; core++){
+			if(stat.xHandle == xTaskGetIdleTaskHandleForCPU(core)){
+				idle[core] = stat.ulRunTimeCounter;
+			}
+		}
+#endif
+	}
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+	historyHead = (historyHead + 1) % HistoryLength;
+	historyCount = std::min(historyCount + 1, HistoryLength);
+	for(uint8_t core = 0; core < portNUM_PROCESSORS; core++){
+		const uint32_t idleTime = idle[core] - prevIdle[core];
+		prevIdle[core] = idle[core];
+		history[core][historyHead] = elapsed ? 100 - std::min<uint32_t>(100, (uint64_t) idleTime * 100 / elapsed) : 0;
+	}
+#endif
+}
+
+void TaskMonitor::forEachTask(const std::function<void(const TaskInfo& task)>& fn){
+	std::lock_guard lock(mut);
+	for(size_t i = 0; i < taskCount; i++){
+		fn(tasks[i]);
+	}
+}
+
+uint8_t TaskMonitor::getCoreLoad(uint8_t core, size_t age){
+	std::lock_guard lock(mut);
+	if(core >= portNUM_PROCESSORS || age >= historyCount) return 0;
+	return history[core][(historyHead + HistoryLength - age) % HistoryLength];
+}
+
+void TaskMonitor::printReport(const std::function<void(const char* line)>& print){
+	char line[96];
+
+	for(uint8_t core = 0; core < portNUM_PROCESSORS; core++){
+		snprintf(line, sizeof(line), "Core %d load: %3d %% now, %3d %% %u s ago\n", core, getCoreLoad(core),
+				 getCoreLoad(core, HistoryLength - 1), (unsigned) ((HistoryLength - 1) * SampleInterval / 1000));
+		print(line);
+	}
+
+	forEachTask([&line, &print](const TaskInfo& task){
+		snprintf(line, sizeof(line), "%-16s core %2d  stack free %5lu B  cpu %3d %%\n", task.name,
+				 task.core == tskNO_AFFINITY ? -1 : (int) task.core, task.stackFree, task.cpu);
+		print(line);
+	});
+}
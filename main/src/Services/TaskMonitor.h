@@ -0,0 +1,63 @@
+#ifndef CLOCKSTAR_FIRMWARE_TASKMONITOR_H
+#define CLOCKSTAR_FIRMWARE_TASKMONITOR_H
+
+#include "Util/TaskPool.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <functional>
+#include <mutex>
+
+/**
+ * Samples FreeRTOS task state periodically. Tracks the lowest stack high-water mark and the CPU share of every task,
+ * and the load of each core over a rolling window, for sizing Threaded stacks and finding CPU hogs.
+ * CPU figures need CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS, which CM_TASK_MONITOR selects.
+ */
+class TaskMonitor : private PooledThreaded {
+public:
+	TaskMonitor();
+	~TaskMonitor() override;
+
+	static constexpr size_t MaxTasks = 32;
+	static constexpr size_t HistoryLength = 30; // Samples per core in the rolling window
+	static constexpr uint32_t SampleInterval = 2000; // [ms]
+
+	struct TaskInfo {
+		char name[configMAX_TASK_NAME_LEN];
+		TaskHandle_t handle;
+		BaseType_t core; // tskNO_AFFINITY if unpinned
+		uint32_t stackFree; // Lowest free stack seen [B]
+		uint8_t cpu; // Share of one core during the last sample [%]
+		uint32_t prevRuntime;
+		bool seen;
+	};
+
+	/** Calls fn with the tracked tasks, under the monitor's lock. */
+	void forEachTask(const std::function<void(const TaskInfo& task)>& fn);
+
+	/** Core load [%] of the sample that is age samples old, 0 being the latest. */
+	uint8_t getCoreLoad(uint8_t core, size_t age = 0);
+
+	void printReport(const std::function<void(const char* line)>& print);
+
+private:
+	std::mutex mut;
+
+	TaskStatus_t status[MaxTasks];
+	TaskInfo tasks[MaxTasks];
+	size_t taskCount = 0;
+
+	uint8_t history[portNUM_PROCESSORS][HistoryLength] = {};
+	size_t historyHead = 0;
+	size_t historyCount = 0;
+
+	uint32_t prevTotal = 0;
+	uint32_t prevIdle[portNUM_PROCESSORS] = {};
+
+	void loop() override;
+	void sample();
+	TaskInfo* findTask(TaskHandle_t handle);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_TASKMONITOR_H
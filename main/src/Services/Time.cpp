@@ -2,33 +2,74 @@
 #include "Time.h"
 #include "Util/stdafx.h"
 #include "Util/Events.h"
+#include <cstdlib>
 
 static const char* TAG = "Time";
 
-Time::Time(RTC& rtc) : SleepyThreaded(UpdateInterval, "Time", 2 * 1024, 6, 0), rtc(rtc){
-	updateFromRTC();
-	start();
+Time::Time(RTC& rtc) : rtc(rtc){
+	const esp_timer_create_args_t tickArgs = {
+			.callback = onTick,
+			.arg = this,
+			.dispatch_method = ESP_TIMER_TASK,
+			.name = "Time",
+			.skip_unhandled_events = true
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&tickArgs, &tickTimer));
+
+	resume();
 }
 
 Time::~Time(){
-	stop();
+	pause();
+	esp_timer_delete(tickTimer);
+}
+
+time_t Time::now() const{
+	return (time_t) (nowMillis() / 1000);
+}
+
+uint64_t Time::nowMillis() const{
+	return (uint64_t) ((int64_t) millis() + offset);
+}
+
+Time::Clock Time::getClock() const{
+	const auto time = getTime();
+	return { (uint8_t) time.tm_hour, (uint8_t) time.tm_min, (uint8_t) time.tm_sec, (uint8_t) time.tm_wday };
 }
 
 std::tm Time::getTime() const{
-	time_t currentTime = time + (millis() - updateTime) / 1000;
-	tm ret = {};
-	gmtime_r(&currentTime, &ret);
+	const time_t current = now();
+
+	tm ret;
+	portENTER_CRITICAL(&cacheLock);
+	const bool valid = cacheTime == current;
+	if(valid){
+		ret = cache;
+	}
+	portEXIT_CRITICAL(&cacheLock);
+	if(valid) return ret;
+
+	ret = {};
+	gmtime_r(&current, &ret);
+
+	portENTER_CRITICAL(&cacheLock);
+	cache = ret;
+	cacheTime = current;
+	portEXIT_CRITICAL(&cacheLock);
+
 	return ret;
 }
 
+void Time::set(time_t time){
+	offset = (int64_t) time * 1000 - (int64_t) millis();
+}
+
 void Time::setTime(tm time_tm){
 	ESP_LOGI(TAG, "Updating time by tm");
 
-	resetTime();
-	updateTime = millis();
-
 	rtc.setTime(time_tm);
-	Time::time = mktime(&time_tm);
+	set(mktime(&time_tm));
+	schedule();
 
 	Events::post(Facility::Time, Time::Event { .action = Event::Updated, .updated = { .time = time_tm } });
 }
@@ -36,29 +77,88 @@ void Time::setTime(tm time_tm){
 void Time::setTime(time_t time){
 	ESP_LOGI(TAG, "Updating time by time_t");
 
-	resetTime();
-	updateTime = millis();
-
 	tm time_tm = {};
 	gmtime_r(&time, &time_tm);
 
 	rtc.setTime(time_tm);
-	Time::time = time;
+	set(time);
+	schedule();
 
 	Events::post(Facility::Time, Time::Event { .action = Event::Updated, .updated = { .time = time_tm } });
 }
 
-tm Time::updateFromRTC(){
-	resetTime();
-	updateTime = millis();
+bool Time::sync(time_t time){
+	const int64_t drift = (int64_t) time * 1000 - (int64_t) nowMillis();
+	if(std::abs(drift) < SyncThreshold){
+		ESP_LOGD(TAG, "Pushed time within %lld ms, not updating", drift);
+		return false;
+	}
+
+	ESP_LOGI(TAG, "Off by %lld ms, syncing", drift);
+	setTime(time);
+	return true;
+}
+
+void Time::pause(){
+	if(paused) return;
+	paused = true;
+
+	esp_timer_stop(tickTimer);
+}
+
+void Time::resume(){
+	if(!paused) return;
+	paused = false;
+
+	syncFromRTC();
+	schedule();
+	post();
+}
+
+void Time::holdSeconds(){
+	if(secondHolds++ == 0){
+		schedule();
+	}
+}
+
+void Time::releaseSeconds(){
+	if(--secondHolds == 0){
+		schedule();
+	}
+}
+
+void Time::syncFromRTC(){
+	syncTime = millis();
 
 	tm time_tm = rtc.getTime();
-	time = mktime(&time_tm);
-	return time_tm;
+	set(mktime(&time_tm));
 }
 
-void Time::sleepyLoop(){
-	ESP_LOGI(TAG, "Scheduled RTC sync");
-	auto time_tm = updateFromRTC();
-	Events::post(Facility::Time, Time::Event { .action = Event::Updated, .updated = { .time = time_tm } });
+void Time::schedule(){
+	esp_timer_stop(tickTimer);
+	if(paused) return;
+
+	const bool seconds = secondHolds > 0;
+	const uint64_t period = seconds ? 1000 : 60000;
+	const uint64_t wait = period - nowMillis() % period + TickMargin;
+	esp_timer_start_once(tickTimer, wait * 1000);
+}
+
+void Time::post(){
+	Events::post(Facility::Time, Time::Event { .action = Event::Updated, .updated = { .time = getTime() } });
+}
+
+void Time::onTick(void* arg){
+	static_cast<Time*>(arg)->tick();
+}
+
+void Time::tick(){
+	if(paused) return;
+
+	if(millis() - syncTime >= ResyncInterval * 1000){
+		syncFromRTC();
+	}
+
+	post();
+	schedule();
 }
@@ -1,13 +1,23 @@
 #ifndef CLOCKSTAR_FIRMWARE_TIME_H
 #define CLOCKSTAR_FIRMWARE_TIME_H
 
-#include "Util/Threaded.h"
 #include "Devices/RTC.h"
+#include <atomic>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
 
-class Time : public SleepyThreaded {
+/**
+ * Wall clock, read from the RTC on start and on every resume and extrapolated from esp_timer in between.
+ * Updated events come once per minute boundary, or once per second while a screen holds seconds.
+ * Minute boundaries come from an esp_timer aimed at the extrapolated boundary, and the RTC is read every ResyncInterval.
+ * The RTC's INT line isn't wired to the ESP on either revision, so its alarm can't drive the ticks.
+ * The clock itself is a single atomic offset from esp_timer, the broken-down time is converted at most once per second
+ * and shared by all readers.
+ */
+class Time {
 public:
 	Time(RTC& rtc);
-	~Time();
+	virtual ~Time();
 
 	struct Event {
 		enum { Updated } action;
@@ -18,24 +28,67 @@ public:
 		};
 	};
 
+	/** Epoch time, without any conversion */
+	time_t now() const; //[s]
+	uint64_t nowMillis() const; //[ms]
+
+	struct Clock {
+		uint8_t hour;
+		uint8_t minute;
+		uint8_t second;
+		uint8_t weekday; // 0 is Sunday
+	};
+
+	/** Fields of the current second, for hot UI paths */
+	Clock getClock() const;
+
 	tm getTime() const;
 	void setTime(tm time_tm);
 	void setTime(time_t time);
 
+	/**
+	 * Sets the time only if it's off by SyncThreshold or more, for sources that push it on every connection.
+	 * Skips the RTC write and the Updated event otherwise. @return True if the time was set
+	 */
+	bool sync(time_t time);
+
+	/** Stops the ticks, the clock keeps running from esp_timer */
+	void pause();
+
+	/** Syncs from the RTC, posts the time and restarts the ticks */
+	void resume();
+
+	/** Ticks every second until the matching releaseSeconds(), for screens showing seconds. Calls nest. */
+	void holdSeconds();
+	void releaseSeconds();
+
 private:
 	RTC& rtc;
 
-	static constexpr uint32_t UpdateInterval = 5000; // [ms]
-	uint64_t updateTime = 0;
+	std::atomic<int64_t> offset = 0; // [ms] epoch time minus millis()
+	uint64_t syncTime = 0; // [ms] of the last RTC read
+
+	mutable tm cache{};
+	mutable time_t cacheTime = -1; // Second the cache holds
+	mutable portMUX_TYPE cacheLock = portMUX_INITIALIZER_UNLOCKED;
+
+	void set(time_t time);
+
+	bool paused = true;
+	std::atomic_int secondHolds = 0;
+
+	esp_timer_handle_t tickTimer = nullptr;
 
-	time_t time;
+	static constexpr uint32_t ResyncInterval = 600; // [s]
+	static constexpr uint32_t SyncThreshold = 2000; // [ms] of drift, pushed times only have second resolution
+	static constexpr uint32_t TickMargin = 2; // [ms] past the boundary, so the extrapolated time is already over it
 
-	void sleepyLoop() override;
-	tm updateFromRTC();
+	void syncFromRTC();
+	void schedule();
+	void post();
 
-	// Hide public functions
-	using Threaded::start;
-	using Threaded::stop;
+	static void onTick(void* arg);
+	void tick();
 
 };
 
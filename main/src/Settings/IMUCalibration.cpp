@@ -0,0 +1,73 @@
+#include "IMUCalibration.h"
+#include "NVSSchema.h"
+#include <nvs_flash.h>
+#include <esp_log.h>
+#include <cstring>
+
+static const char* TAG = "IMUCalibration";
+
+static constexpr auto Schema = nvsSchema(1,
+		nvsKey("gyroBias", &IMUCalibrationData::gyroBias),
+		nvsKey("accelOffset", &IMUCalibrationData::accelOffset),
+		nvsKey("accelScale", &IMUCalibrationData::accelScale)
+);
+
+IMUCalibration::IMUCalibration(){
+	auto err = nvs_open(NVSNamespace, NVS_READWRITE, &handle);
+	ESP_ERROR_CHECK(err);
+	load();
+}
+
+IMUCalibrationData IMUCalibration::get(){
+	return data;
+}
+
+void IMUCalibration::set(const IMUCalibrationData& data){
+	this->data = data;
+	calibrated = true;
+}
+
+bool IMUCalibration::isCalibrated() const{
+	return calibrated;
+}
+
+void IMUCalibration::store(){
+	if(Schema.store(handle, data, stored) < 0){
+		ESP_LOGW(TAG, "NVS calibration store error");
+		return;
+	}
+
+	auto err = Schema.storeVersion(handle);
+	if(err == ESP_OK){
+		err = nvs_commit(handle);
+	}
+	if(err != ESP_OK){
+		ESP_LOGW(TAG, "NVS calibration commit error: %d", err);
+		return;
+	}
+
+	stored = data;
+}
+
+void IMUCalibration::load(){
+	// Unlike Settings, nothing is written until a calibration is run, so isCalibrated() stays meaningful
+	if(Schema.getStoredVersion(handle) != 0){
+		Schema.load(handle, data);
+		stored = data;
+		calibrated = true;
+		return;
+	}
+
+	IMUCalibrationData legacy;
+	if(!nvsReadLegacyBlob(LegacyNamespace, LegacyBlob, &legacy, sizeof(IMUCalibrationData))){
+		ESP_LOGI(TAG, "IMU calibration not found, using defaults");
+		return;
+	}
+
+	ESP_LOGI(TAG, "Migrating calibration blob to per-key storage");
+	set(legacy);
+	store();
+	if(memcmp(&stored, &legacy, sizeof(IMUCalibrationData)) == 0){
+		nvsEraseLegacyBlob(LegacyNamespace, LegacyBlob);
+	}
+}
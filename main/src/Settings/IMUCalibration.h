@@ -0,0 +1,48 @@
+#ifndef CLOCKSTAR_FIRMWARE_IMUCALIBRATION_H
+#define CLOCKSTAR_FIRMWARE_IMUCALIBRATION_H
+
+#include <nvs.h>
+
+/**
+ * Applied to every converted IMU sample, after the board revision axis flip:
+ * 		gyro = gyro - gyroBias
+ * 		accel = (accel - accelOffset) * accelScale
+ */
+struct IMUCalibrationData {
+	float gyroBias[3] = { 0, 0, 0 }; // [rad/s]
+	float accelOffset[3] = { 0, 0, 0 }; // [g]
+	float accelScale[3] = { 1, 1, 1 };
+};
+
+/**
+ * IMU calibration persisted in NVS, a key per vector in its own namespace.
+ */
+class IMUCalibration {
+public:
+	IMUCalibration();
+
+	IMUCalibrationData get();
+	void set(const IMUCalibrationData& data);
+	void store();
+
+	/** True if calibration data was found in NVS or has been set since boot. */
+	bool isCalibrated() const;
+
+private:
+	nvs_handle_t handle{};
+	IMUCalibrationData data;
+	bool calibrated = false;
+
+	static constexpr const char* NVSNamespace = "IMUCal";
+
+	// Before per-key storage, the calibration was one blob next to the settings
+	static constexpr const char* LegacyNamespace = "Clockstar";
+	static constexpr const char* LegacyBlob = "IMUCal";
+
+	IMUCalibrationData stored; // As in flash
+
+	void load();
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_IMUCALIBRATION_H
@@ -0,0 +1,172 @@
+#ifndef CLOCKSTAR_FIRMWARE_NVSSCHEMA_H
+#define CLOCKSTAR_FIRMWARE_NVSSCHEMA_H
+
+#include <nvs.h>
+#include <tuple>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * Persisted struct field: the NVS key it's stored under, at most 15 characters, and the member it maps to.
+ * A key missing from NVS leaves the member at its default, the struct's member initializer.
+ */
+template<typename S, typename T>
+struct NVSKey {
+	const char* name;
+	T S::* member;
+};
+
+template<typename S, typename T>
+constexpr NVSKey<S, T> nvsKey(const char* name, T S::* member){
+	return { name, member };
+}
+
+namespace NVSValue {
+
+	template<typename T>
+	esp_err_t read(nvs_handle_t handle, const char* key, T& value){
+		if constexpr(std::is_same_v<T, bool>){
+			uint8_t raw;
+			const auto err = nvs_get_u8(handle, key, &raw);
+			if(err == ESP_OK){
+				value = raw != 0;
+			}
+			return err;
+		}else if constexpr(std::is_same_v<T, uint8_t>){
+			return nvs_get_u8(handle, key, &value);
+		}else if constexpr(std::is_same_v<T, uint16_t>){
+			return nvs_get_u16(handle, key, &value);
+		}else if constexpr(std::is_same_v<T, uint32_t>){
+			return nvs_get_u32(handle, key, &value);
+		}else{
+			static_assert(std::is_trivially_copyable_v<T>);
+
+			// Anything else is a blob of exactly the member's size, a changed type reads as missing
+			T raw;
+			size_t size = sizeof(T);
+			const auto err = nvs_get_blob(handle, key, &raw, &size);
+			if(err != ESP_OK) return err;
+			if(size != sizeof(T)) return ESP_ERR_NVS_INVALID_LENGTH;
+			memcpy(&value, &raw, sizeof(T));
+			return ESP_OK;
+		}
+	}
+
+	template<typename T>
+	esp_err_t write(nvs_handle_t handle, const char* key, const T& value){
+		if constexpr(std::is_same_v<T, bool>){
+			return nvs_set_u8(handle, key, value ? 1 : 0);
+		}else if constexpr(std::is_same_v<T, uint8_t>){
+			return nvs_set_u8(handle, key, value);
+		}else if constexpr(std::is_same_v<T, uint16_t>){
+			return nvs_set_u16(handle, key, value);
+		}else if constexpr(std::is_same_v<T, uint32_t>){
+			return nvs_set_u32(handle, key, value);
+		}else{
+			static_assert(std::is_trivially_copyable_v<T>);
+			return nvs_set_blob(handle, key, &value, sizeof(T));
+		}
+	}
+
+}
+
+/**
+ * Compile-time list of the keys a struct is persisted with, one NVS entry per key. Every user of a schema keeps its
+ * own namespace, so a store only touches its own keys and a change rewrites only the keys that changed.
+ * The version is stored under VersionKey and bumped when a key is renamed or changes meaning, so load can migrate.
+ */
+template<typename S, typename... T>
+class NVSSchema {
+public:
+	constexpr NVSSchema(uint16_t version, NVSKey<S, T>... keys) : version(version), keys(keys...){}
+
+	const uint16_t version;
+	static constexpr const char* VersionKey = "_ver";
+
+	/**
+	 * Reads every key present in NVS into out, the others keep their values.
+	 * @return Keys found
+	 */
+	size_t load(nvs_handle_t handle, S& out) const{
+		size_t found = 0;
+		std::apply([&](const auto&... key){
+			((found += NVSValue::read(handle, key.name, out.*key.member) == ESP_OK ? 1 : 0), ...);
+		}, keys);
+		return found;
+	}
+
+	/**
+	 * Writes the keys whose value differs from before, without committing.
+	 * @return Keys written, or -1 if a write failed
+	 */
+	int store(nvs_handle_t handle, const S& value, const S& before) const{
+		int written = 0;
+		std::apply([&](const auto&... key){
+			((written = storeKey(handle, key, value, before, written)), ...);
+		}, keys);
+		return written;
+	}
+
+	/** Stored schema version, 0 if nothing was stored with a schema yet */
+	static uint16_t getStoredVersion(nvs_handle_t handle){
+		uint16_t stored = 0;
+		nvs_get_u16(handle, VersionKey, &stored);
+		return stored;
+	}
+
+	esp_err_t storeVersion(nvs_handle_t handle) const{
+		return nvs_set_u16(handle, VersionKey, version);
+	}
+
+private:
+	const std::tuple<NVSKey<S, T>...> keys;
+
+	template<typename K>
+	static int storeKey(nvs_handle_t handle, const K& key, const S& value, const S& before, int written){
+		if(written < 0) return written;
+
+		// Compared byte-wise, so array members work as well
+		const auto& current = value.*key.member;
+		if(memcmp(&current, &(before.*key.member), sizeof(current)) == 0) return written;
+
+		if(NVSValue::write(handle, key.name, current) != ESP_OK) return -1;
+		return written + 1;
+	}
+
+};
+
+template<typename S, typename... T>
+constexpr NVSSchema<S, T...> nvsSchema(uint16_t version, NVSKey<S, T>... keys){
+	return NVSSchema<S, T...>(version, keys...);
+}
+
+/**
+ * Reads a struct stored as one blob before per-key storage, only if it still has the struct's exact size.
+ * @return True if out was filled
+ */
+inline bool nvsReadLegacyBlob(const char* ns, const char* name, void* out, size_t size){
+	nvs_handle_t handle;
+	if(nvs_open(ns, NVS_READONLY, &handle) != ESP_OK) return false;
+
+	size_t stored = 0;
+	bool ok = nvs_get_blob(handle, name, nullptr, &stored) == ESP_OK && stored == size &&
+			  nvs_get_blob(handle, name, out, &stored) == ESP_OK;
+
+	nvs_close(handle);
+	return ok;
+}
+
+/** Removes a migrated blob, once its values are committed under their own keys. */
+inline void nvsEraseLegacyBlob(const char* ns, const char* name){
+	nvs_handle_t handle;
+	if(nvs_open(ns, NVS_READWRITE, &handle) != ESP_OK) return;
+
+	if(nvs_erase_key(handle, name) == ESP_OK){
+		nvs_commit(handle);
+	}
+	nvs_close(handle);
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_NVSSCHEMA_H
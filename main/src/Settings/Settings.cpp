@@ -1,46 +1,218 @@
 #include "Settings.h"
+#include "NVSSchema.h"
+#include "Util/Events.h"
+#include "Util/Services.h"
+#include "Services/Console.h"
 #include <nvs_flash.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <cstring>
+#include <algorithm>
 
 static const char* TAG = "Settings";
 
+// Bump the version when a key is renamed or changes meaning, and handle the old one in Settings::migrate
+static constexpr auto Schema = nvsSchema(1,
+		nvsKey("sounds", &SettingsStruct::notificationSounds),
+		nvsKey("brightness", &SettingsStruct::screenBrightness),
+		nvsKey("sleepTime", &SettingsStruct::sleepTime),
+		nvsKey("led", &SettingsStruct::ledEnable),
+		nvsKey("motion", &SettingsStruct::motionDetection)
+);
+
 Settings::Settings(){
 	auto err = nvs_open(NVSNamespace, NVS_READWRITE, &handle);
 	ESP_ERROR_CHECK(err);
 	load();
+
+	if(auto console = Services.get<Service::Console>()){
+		console->addReport([this](const Console::Print& print){ printReport(print); }, [this](){ resetStats(); });
+	}
+}
+
+Settings::~Settings(){
+	TaskPool::get().cancel(this);
+	flush();
 }
 
-SettingsStruct Settings::get(){
-	return settingsStruct;
+SettingsStruct Settings::get() const{
+	for(;;){
+		const uint32_t before = seq.load(std::memory_order_acquire);
+		if((before & 1) == 0){
+			SettingsStruct copy;
+			memcpy(&copy, (const void*) &settingsStruct, sizeof(SettingsStruct));
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(seq.load(std::memory_order_relaxed) == before) return copy;
+		}
+
+		// A writer is mid-copy, possibly preempted on this core, let it finish instead of spinning
+		taskYIELD();
+	}
 }
 
 void Settings::set(SettingsStruct& settings){
-	settingsStruct = settings;
+	uint32_t version;
+	{
+		std::lock_guard lock(writeMut);
+
+		seq.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy((void*) &settingsStruct, &settings, sizeof(SettingsStruct));
+		version = (seq.fetch_add(1, std::memory_order_release) + 1) / 2;
+	}
+
+	{
+		std::lock_guard lock(mut);
+		stats.sets++;
+	}
+
+	Events::post(Facility::Settings, Event { .action = Event::Changed, .version = version });
+	store();
+}
+
+Settings::Edit::Edit(Settings& settings) : settings(settings), start(settings.get()), edited(start){}
+
+void Settings::Edit::begin(){
+	start = edited = settings.get();
+}
+
+SettingsStruct& Settings::Edit::draft(){
+	return edited;
+}
+
+const SettingsStruct& Settings::Edit::base() const{
+	return start;
+}
+
+bool Settings::Edit::isDirty() const{
+	return memcmp(&start, &edited, sizeof(SettingsStruct)) != 0;
+}
+
+bool Settings::Edit::commit(){
+	if(!isDirty()) return false;
+
+	settings.set(edited);
+	start = edited;
+	return true;
+}
+
+uint32_t Settings::getVersion() const{
+	return seq.load(std::memory_order_acquire) / 2;
+}
+
+bool Settings::refresh(SettingsStruct& cache, uint32_t& version) const{
+	const uint32_t current = getVersion();
+	if(current == version) return false;
+
+	// A set() between the two reads only means the next call refreshes again
+	cache = get();
+	version = current;
+	return true;
 }
 
 void Settings::store(){
-	esp_err_t err = nvs_set_blob(handle, BlobName, &settingsStruct, sizeof(SettingsStruct));
+	TaskPool::get().schedule(this, pdMS_TO_TICKS(CommitDelay));
+}
 
-	if(err != ESP_OK){
-		ESP_LOGW(TAG, "NVS settings store error: %d", err);
+void Settings::run(){
+	flush();
+}
+
+void Settings::flush(){
+	const auto current = get();
+	std::lock_guard lock(mut);
+
+	// All fields are bytes, there's no padding to compare
+	if(memcmp(&current, &stored, sizeof(SettingsStruct)) == 0){
+		stats.skipped++;
 		return;
 	}
 
-	err = nvs_commit(handle);
+	const uint64_t start = esp_timer_get_time();
+	const int keys = write(current, stored);
+	if(keys < 0) return;
+	const auto duration = (uint32_t) (esp_timer_get_time() - start);
+
+	stored = current;
+	stats.writes++;
+	stats.keys += keys;
+	stats.lastCommit = duration;
+	stats.maxCommit = std::max(stats.maxCommit, duration);
+}
+
+int Settings::write(const SettingsStruct& settings, const SettingsStruct& before){
+	const int keys = Schema.store(handle, settings, before);
+
+	if(keys < 0){
+		ESP_LOGW(TAG, "NVS settings store error");
+		return -1;
+	}
+
+	const auto err = nvs_commit(handle);
 	if(err != ESP_OK){
 		ESP_LOGW(TAG, "NVS settings commit error: %d", err);
+		return -1;
 	}
+
+	return keys;
+}
+
+void Settings::printReport(const std::function<void(const char* line)>& print){
+	std::unique_lock lock(mut);
+	const auto copy = stats;
+	lock.unlock();
+
+	char line[128];
+	snprintf(line, sizeof(line), "Settings %4lu changes  %3lu flash writes (%lu keys)  %3lu skipped  commit last %lu us, max %lu us\n",
+			 copy.sets, copy.writes, copy.keys, copy.skipped, copy.lastCommit, copy.maxCommit);
+	print(line);
+}
+
+void Settings::resetStats(){
+	std::lock_guard lock(mut);
+	stats = {};
 }
 
 void Settings::load(){
-	size_t out_size = sizeof(SettingsStruct);
-	auto err = nvs_get_blob(handle, BlobName, &settingsStruct, &out_size);
-	if(err != ESP_OK){
-		ESP_LOGI(TAG, "Settings not found, writing defaults");
-		store();
-		err = nvs_get_blob(handle, BlobName, &settingsStruct, &out_size);
-		if(err != ESP_OK){
-			ESP_LOGE(TAG, "Couldn't access NVS settings: %d", err);
+	const uint16_t version = Schema.getStoredVersion(handle);
+
+	// Keys missing from NVS keep their defaults, so only values that were changed at some point take up flash
+	Schema.load(handle, settingsStruct);
+	stored = settingsStruct;
+
+	if(version == Schema.version) return;
+	if(!migrate(version)) return; // Retried on the next boot
+
+	const auto err = Schema.storeVersion(handle);
+	if(err != ESP_OK || nvs_commit(handle) != ESP_OK){
+		ESP_LOGW(TAG, "NVS settings version store error: %d", err);
+		return;
+	}
+
+	if(version == 0){
+		nvsEraseLegacyBlob(LegacyNamespace, LegacyBlob);
+	}
+}
+
+bool Settings::migrate(uint16_t from){
+	if(from == 0){
+		// Nothing under the schema yet, take over the single blob of older firmware if there is one
+		SettingsStruct legacy;
+		if(!nvsReadLegacyBlob(LegacyNamespace, LegacyBlob, &legacy, sizeof(SettingsStruct))) return true;
+
+		ESP_LOGI(TAG, "Migrating settings blob to per-key storage");
+		if(Schema.store(handle, legacy, stored) < 0){
+			ESP_LOGW(TAG, "NVS settings migration error");
+			return false;
 		}
+
+		settingsStruct = stored = legacy;
+		return true;
 	}
+
+	ESP_LOGI(TAG, "Settings schema %d -> %d", from, Schema.version);
+	return true;
 }
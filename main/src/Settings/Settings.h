@@ -2,6 +2,10 @@
 #define CLOCKSTAR_FIRMWARE_SETTINGS_H
 
 #include <nvs.h>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "Util/TaskPool.h"
 
 struct SettingsStruct {
 	bool notificationSounds = true;
@@ -11,26 +15,108 @@ struct SettingsStruct {
 	bool motionDetection = false;
 };
 
-class Settings {
+/**
+ * Settings are stored one NVS key per field, as listed in the schema in Settings.cpp, in their own namespace.
+ * Settings are kept in RAM and written behind. Every set() moves a commit CommitDelay into the future, so a burst of
+ * changes ends in one flash write of only the changed keys, and a commit is skipped if nothing differs from flash.
+ * Readers copy the RAM settings under a seqlock and never take a lock, they yield if they catch a write.
+ * Every set() bumps the version and posts a Changed event on Facility::Settings.
+ */
+class Settings : private TaskPool::Job {
 public:
 	Settings();
+	~Settings() override;
 
-	SettingsStruct get();
+	struct Event {
+		enum { Changed } action;
+		uint32_t version;
+	};
+
+	SettingsStruct get() const;
 	void set(SettingsStruct& settings);
+
+	/** Increments with every set() */
+	uint32_t getVersion() const;
+
+	/**
+	 * For hot paths keeping a copy. Refreshes cache only if the settings changed since version.
+	 * @return True if cache was refreshed
+	 */
+	bool refresh(SettingsStruct& cache, uint32_t& version) const;
+
+	/**
+	 * Edit session, for screens changing several settings at once. Changes go into a draft that only the editor sees
+	 * and previews through its own fast paths, such as setting the backlight's duty. commit() applies the whole draft
+	 * with a single set(), so listeners get one Changed event and the flash is written once.
+	 */
+	class Edit {
+	public:
+		explicit Edit(Settings& settings);
+
+		/** Starts over from the current settings, dropping uncommitted changes */
+		void begin();
+
+		SettingsStruct& draft();
+		const SettingsStruct& base() const;
+		bool isDirty() const;
+
+		/** @return False if the draft didn't differ from the settings it started from, nothing is set then */
+		bool commit();
+
+	private:
+		Settings& settings;
+		SettingsStruct start;
+		SettingsStruct edited;
+	};
+
+	/** Schedules a commit of the current settings. */
 	void store();
 
-	static constexpr uint8_t SleepSteps = 5;
-	static constexpr const uint32_t SleepSeconds[SleepSteps] = { 0, 30, 60, 2 * 60, 5 * 60 };
-	static constexpr const char* SleepText[SleepSteps] = { "OFF", "30 sec", "1 min", "2 min", "5 min" };
+	/** Commits now if anything changed, for sleep and shutdown. */
+	void flush();
+
+	void printReport(const std::function<void(const char* line)>& print);
+	void resetStats();
+
+	static constexpr uint8_t SleepSteps = 6;
+	static constexpr uint8_t SleepAdaptive = 5; // Timeout learned from use, see SleepPredictor. SleepSeconds holds its upper bound.
+	static constexpr const uint32_t SleepSeconds[SleepSteps] = { 0, 30, 60, 2 * 60, 5 * 60, 2 * 60 };
+	static constexpr const char* SleepText[SleepSteps] = { "OFF", "30 sec", "1 min", "2 min", "5 min", "Auto" };
 
 private:
 	nvs_handle_t handle{};
 	SettingsStruct settingsStruct;
+	std::atomic_uint32_t seq = 0; // Odd while settingsStruct is being written
+	std::mutex writeMut;
+
+	SettingsStruct stored; // As in flash
+	std::mutex mut; // Flash and stats
+
+	static constexpr uint32_t CommitDelay = 3000; // [ms]
 
-	static constexpr const char* NVSNamespace = "Clockstar";
-	static constexpr const char* BlobName = "Settings";
+	struct {
+		uint32_t sets; // Changes made in RAM
+		uint32_t writes; // Flash commits
+		uint32_t keys; // Keys written by those commits
+		uint32_t skipped; // Commits that found nothing changed
+		uint32_t lastCommit; // [us]
+		uint32_t maxCommit; // [us]
+	} stats{};
+
+	static constexpr const char* NVSNamespace = "Settings";
+
+	// Before per-key storage, the whole struct was one blob
+	static constexpr const char* LegacyNamespace = "Clockstar";
+	static constexpr const char* LegacyBlob = "Settings";
 
 	void load();
+	bool migrate(uint16_t from);
+
+	/** @return Keys written, or -1 on error */
+	int write(const SettingsStruct& settings, const SettingsStruct& before);
+
+	// Runs on the TaskPool, committing a few keys blocks it for a few ms
+	void run() override;
 };
 
 
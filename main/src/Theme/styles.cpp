@@ -0,0 +1,266 @@
+#include "styles.h"
+#include "theme.h"
+
+static constexpr lv_style_const_prop_t num(lv_style_prop_t prop, int32_t value){
+	return { .prop = prop, .value = { .num = value } };
+}
+
+static constexpr lv_style_const_prop_t color(lv_style_prop_t prop, lv_color_t value){
+	return { .prop = prop, .value = { .color = value } };
+}
+
+static constexpr lv_style_const_prop_t ptr(lv_style_prop_t prop, const void* value){
+	return { .prop = prop, .value = { .ptr = value } };
+}
+
+static constexpr lv_style_const_prop_t End = { .prop = LV_STYLE_PROP_INV, .value = { .num = 0 } };
+
+static constexpr lv_color_t Black = LV_COLOR_MAKE(0, 0, 0);
+static constexpr lv_color_t White = LV_COLOR_MAKE(0xff, 0xff, 0xff);
+static constexpr lv_color_t Beige = Styles::TextColor;
+static constexpr lv_color_t Orange = LV_COLOR_MAKE(244, 126, 27);
+static constexpr lv_color_t Purple = LV_COLOR_MAKE(0x81, 0x3d, 0xf5);
+static constexpr lv_color_t Gray = LV_COLOR_MAKE(0xbb, 0xbb, 0xbb);
+
+static constexpr lv_style_prop_t SwitchTransitionProps[] = {
+		LV_STYLE_BG_OPA, LV_STYLE_BG_COLOR,
+		LV_STYLE_TRANSFORM_WIDTH, LV_STYLE_TRANSFORM_HEIGHT,
+		LV_STYLE_TRANSLATE_Y, LV_STYLE_TRANSLATE_X,
+		LV_STYLE_TRANSFORM_ZOOM, LV_STYLE_TRANSFORM_ANGLE,
+		LV_STYLE_COLOR_FILTER_OPA, LV_STYLE_COLOR_FILTER_DSC,
+		LV_STYLE_PROP_INV
+};
+
+static const lv_style_transition_dsc_t SwitchTransition = {
+		.props = SwitchTransitionProps,
+		.user_data = nullptr,
+		.path_xcb = lv_anim_path_linear,
+		.time = 150,
+		.delay = 0
+};
+
+static const lv_style_const_prop_t ScreenProps[] = {
+		color(LV_STYLE_BG_COLOR, Black),
+		num(LV_STYLE_BG_OPA, LV_OPA_COVER),
+		End
+};
+
+static const lv_style_const_prop_t LabelProps[] = {
+		ptr(LV_STYLE_TEXT_FONT, &devin),
+		color(LV_STYLE_TEXT_COLOR, Beige),
+		num(LV_STYLE_TEXT_LINE_SPACE, Styles::TextLineSpace),
+		End
+};
+
+static const lv_style_const_prop_t TextWhiteProps[] = {
+		ptr(LV_STYLE_TEXT_FONT, &devin),
+		color(LV_STYLE_TEXT_COLOR, White),
+		End
+};
+
+static const lv_style_const_prop_t RowProps[] = {
+		num(LV_STYLE_BORDER_WIDTH, 1),
+		num(LV_STYLE_BORDER_OPA, LV_OPA_TRANSP),
+		num(LV_STYLE_PAD_TOP, 3),
+		num(LV_STYLE_PAD_BOTTOM, 3),
+		num(LV_STYLE_PAD_LEFT, 3),
+		num(LV_STYLE_PAD_RIGHT, 3),
+		num(LV_STYLE_BG_OPA, LV_OPA_TRANSP),
+		End
+};
+
+static const lv_style_const_prop_t RowFocusedProps[] = {
+		num(LV_STYLE_BORDER_WIDTH, 1),
+		color(LV_STYLE_BORDER_COLOR, White),
+		num(LV_STYLE_BORDER_OPA, LV_OPA_COVER),
+		End
+};
+
+static const lv_style_const_prop_t SliderMainProps[] = {
+		num(LV_STYLE_BG_OPA, LV_OPA_COVER),
+		color(LV_STYLE_BG_COLOR, Gray),
+		num(LV_STYLE_RADIUS, LV_RADIUS_CIRCLE),
+		num(LV_STYLE_PAD_LEFT, 5),
+		num(LV_STYLE_PAD_RIGHT, 5),
+		End
+};
+
+static const lv_style_const_prop_t SliderKnobProps[] = {
+		num(LV_STYLE_BG_OPA, LV_OPA_COVER),
+		num(LV_STYLE_RADIUS, LV_RADIUS_CIRCLE),
+		num(LV_STYLE_HEIGHT, 10),
+		num(LV_STYLE_WIDTH, 10),
+		End
+};
+
+static const lv_style_const_prop_t SliderKnobEditedProps[] = {
+		color(LV_STYLE_BG_COLOR, Purple),
+		End
+};
+
+static const lv_style_const_prop_t SliderValueProps[] = {
+		num(LV_STYLE_ALIGN, LV_ALIGN_CENTER),
+		ptr(LV_STYLE_TEXT_FONT, &devin),
+		num(LV_STYLE_PAD_TOP, 1),
+		color(LV_STYLE_TEXT_COLOR, Black),
+		End
+};
+
+static const lv_style_const_prop_t SwitchProps[] = {
+		num(LV_STYLE_BORDER_WIDTH, 1),
+		color(LV_STYLE_BORDER_COLOR, White),
+		num(LV_STYLE_BG_OPA, LV_OPA_TRANSP),
+		num(LV_STYLE_RADIUS, LV_RADIUS_CIRCLE),
+		num(LV_STYLE_ANIM_TIME, 120),
+		End
+};
+
+static const lv_style_const_prop_t SwitchIndicatorProps[] = {
+		num(LV_STYLE_RADIUS, LV_RADIUS_CIRCLE),
+		ptr(LV_STYLE_TRANSITION, &SwitchTransition),
+		End
+};
+
+static const lv_style_const_prop_t SwitchCheckedProps[] = {
+		num(LV_STYLE_BORDER_WIDTH, 1),
+		color(LV_STYLE_BORDER_COLOR, White),
+		color(LV_STYLE_BG_COLOR, Purple),
+		num(LV_STYLE_BG_OPA, LV_OPA_COVER),
+		color(LV_STYLE_TEXT_COLOR, White),
+		ptr(LV_STYLE_TRANSITION, &SwitchTransition),
+		End
+};
+
+static const lv_style_const_prop_t SwitchKnobProps[] = {
+		color(LV_STYLE_BG_COLOR, White),
+		num(LV_STYLE_BG_OPA, LV_OPA_COVER),
+		num(LV_STYLE_RADIUS, LV_RADIUS_CIRCLE),
+		num(LV_STYLE_PAD_TOP, -3),
+		num(LV_STYLE_PAD_BOTTOM, -3),
+		num(LV_STYLE_PAD_LEFT, -3),
+		num(LV_STYLE_PAD_RIGHT, -3),
+		End
+};
+
+static const lv_style_const_prop_t NotifItemProps[] = {
+		num(LV_STYLE_RADIUS, 3),
+		num(LV_STYLE_PAD_TOP, 2),
+		num(LV_STYLE_PAD_BOTTOM, 3),
+		num(LV_STYLE_PAD_LEFT, 3),
+		num(LV_STYLE_PAD_RIGHT, 3),
+		num(LV_STYLE_PAD_ROW, 4),
+		num(LV_STYLE_PAD_COLUMN, 4),
+		num(LV_STYLE_BORDER_WIDTH, 1),
+		color(LV_STYLE_BORDER_COLOR, White),
+		num(LV_STYLE_BORDER_OPA, 40),
+		End
+};
+
+static const lv_style_const_prop_t NotifItemFocusedProps[] = {
+		color(LV_STYLE_BG_COLOR, White),
+		num(LV_STYLE_BG_OPA, 40),
+		num(LV_STYLE_BORDER_OPA, LV_OPA_TRANSP), // The highlight replaces the outline
+		End
+};
+
+static const lv_style_const_prop_t NotifTitleProps[] = {
+		num(LV_STYLE_PAD_LEFT, 4),
+		color(LV_STYLE_TEXT_COLOR, Orange),
+		End
+};
+
+static const lv_style_const_prop_t NotifBodyProps[] = {
+		num(LV_STYLE_MAX_HEIGHT, 34),
+		num(LV_STYLE_PAD_LEFT, 2),
+		num(LV_STYLE_PAD_RIGHT, 2),
+		End
+};
+
+static const lv_style_const_prop_t CtrlItemProps[] = {
+		num(LV_STYLE_RADIUS, 3),
+		num(LV_STYLE_PAD_TOP, 4),
+		num(LV_STYLE_PAD_BOTTOM, 4),
+		color(LV_STYLE_BG_COLOR, White),
+		num(LV_STYLE_BG_OPA, LV_OPA_TRANSP),
+		End
+};
+
+static const lv_style_const_prop_t CtrlItemFocusedProps[] = {
+		num(LV_STYLE_BG_OPA, LV_OPA_20),
+		End
+};
+
+static const lv_style_const_prop_t BackdropProps[] = {
+		color(LV_STYLE_BG_COLOR, Black),
+		num(LV_STYLE_BG_OPA, LV_OPA_COVER),
+		ptr(LV_STYLE_BG_IMG_SRC, "S:/bg.bin"),
+		num(LV_STYLE_BG_IMG_TILED, 1),
+		End
+};
+
+static const lv_style_const_prop_t PongFieldProps[] = {
+		color(LV_STYLE_BG_COLOR, Black),
+		num(LV_STYLE_BORDER_WIDTH, 1),
+		color(LV_STYLE_BORDER_COLOR, White),
+		num(LV_STYLE_PAD_TOP, 0),
+		num(LV_STYLE_PAD_BOTTOM, 0),
+		num(LV_STYLE_PAD_LEFT, 0),
+		num(LV_STYLE_PAD_RIGHT, 0),
+		End
+};
+
+static const lv_style_const_prop_t ThereminBarHProps[] = {
+		ptr(LV_STYLE_BG_IMG_SRC, "S:/theremin/horizontalBar.bin"),
+		num(LV_STYLE_PAD_LEFT, 5),
+		num(LV_STYLE_PAD_RIGHT, 5),
+		End
+};
+
+static const lv_style_const_prop_t ThereminBarVProps[] = {
+		ptr(LV_STYLE_BG_IMG_SRC, "S:/theremin/verticalBar.bin"),
+		num(LV_STYLE_PAD_BOTTOM, 5),
+		End
+};
+
+static const lv_style_const_prop_t ThereminKnobProps[] = {
+		ptr(LV_STYLE_BG_IMG_SRC, "S:/theremin/dot.bin"),
+		End
+};
+
+static const lv_style_const_prop_t ThereminArrowProps[] = {
+		num(LV_STYLE_PAD_LEFT, 1),
+		End
+};
+
+namespace Styles {
+
+	LV_STYLE_CONST_INIT(Screen, ScreenProps);
+	LV_STYLE_CONST_INIT(Label, LabelProps);
+	LV_STYLE_CONST_INIT(TextWhite, TextWhiteProps);
+
+	LV_STYLE_CONST_INIT(Row, RowProps);
+	LV_STYLE_CONST_INIT(RowFocused, RowFocusedProps);
+	LV_STYLE_CONST_INIT(SliderMain, SliderMainProps);
+	LV_STYLE_CONST_INIT(SliderKnob, SliderKnobProps);
+	LV_STYLE_CONST_INIT(SliderKnobEdited, SliderKnobEditedProps);
+	LV_STYLE_CONST_INIT(SliderValue, SliderValueProps);
+	LV_STYLE_CONST_INIT(Switch, SwitchProps);
+	LV_STYLE_CONST_INIT(SwitchIndicator, SwitchIndicatorProps);
+	LV_STYLE_CONST_INIT(SwitchChecked, SwitchCheckedProps);
+	LV_STYLE_CONST_INIT(SwitchKnob, SwitchKnobProps);
+
+	LV_STYLE_CONST_INIT(NotifItem, NotifItemProps);
+	LV_STYLE_CONST_INIT(NotifItemFocused, NotifItemFocusedProps);
+	LV_STYLE_CONST_INIT(NotifTitle, NotifTitleProps);
+	LV_STYLE_CONST_INIT(NotifBody, NotifBodyProps);
+	LV_STYLE_CONST_INIT(CtrlItem, CtrlItemProps);
+	LV_STYLE_CONST_INIT(CtrlItemFocused, CtrlItemFocusedProps);
+
+	LV_STYLE_CONST_INIT(Backdrop, BackdropProps);
+	LV_STYLE_CONST_INIT(PongField, PongFieldProps);
+	LV_STYLE_CONST_INIT(ThereminBarH, ThereminBarHProps);
+	LV_STYLE_CONST_INIT(ThereminBarV, ThereminBarVProps);
+	LV_STYLE_CONST_INIT(ThereminKnob, ThereminKnobProps);
+	LV_STYLE_CONST_INIT(ThereminArrow, ThereminArrowProps);
+
+}
@@ -0,0 +1,58 @@
+#ifndef CLOCKSTAR_FIRMWARE_STYLES_H
+#define CLOCKSTAR_FIRMWARE_STYLES_H
+
+#include <lvgl.h>
+
+/**
+ * Shared styles, built at compile time from constant property lists and kept in flash. Objects reference them
+ * instead of setting local style properties, so they don't allocate a local style each and LVGL resolves the
+ * properties from one shared list. Add them with lv_obj_add_style(obj, Styles::get(Styles::X), selector).
+ */
+namespace Styles {
+
+	extern const lv_style_t Screen; // Black, opaque background of screens
+	extern const lv_style_t Label; // Default font and text color of labels, applied by the theme
+
+	extern const lv_style_t TextWhite; // Default font in white
+
+	// Label's text color and line space, for text drawn without a label
+	constexpr lv_color_t TextColor = LV_COLOR_MAKE(207, 198, 184);
+	constexpr lv_coord_t TextLineSpace = 2;
+
+	// Settings rows
+	extern const lv_style_t Row; // Main part, default state
+	extern const lv_style_t RowFocused; // Main part, focused state
+	extern const lv_style_t SliderMain;
+	extern const lv_style_t SliderKnob;
+	extern const lv_style_t SliderKnobEdited; // Knob part, edited state
+	extern const lv_style_t SliderValue; // Value label on a discrete slider's knob
+	extern const lv_style_t Switch;
+	extern const lv_style_t SwitchIndicator;
+	extern const lv_style_t SwitchChecked; // Indicator part, checked state
+	extern const lv_style_t SwitchKnob;
+
+	// Lock screen notifications
+	extern const lv_style_t NotifItem;
+	extern const lv_style_t NotifItemFocused; // Focused state, over NotifItem
+	extern const lv_style_t NotifTitle;
+	extern const lv_style_t NotifBody;
+	extern const lv_style_t CtrlItem;
+	extern const lv_style_t CtrlItemFocused; // Focused state, over CtrlItem
+
+	// App screens
+	extern const lv_style_t Backdrop; // Black, with the tiled background image
+	extern const lv_style_t PongField;
+	extern const lv_style_t ThereminBarH; // Main part of the horizontal slider
+	extern const lv_style_t ThereminBarV; // Main part of the vertical slider
+	extern const lv_style_t ThereminKnob;
+	extern const lv_style_t ThereminArrow;
+
+	/** LVGL takes styles as mutable, but never writes to a constant one */
+	inline lv_style_t* get(const lv_style_t& style){
+		return const_cast<lv_style_t*>(&style);
+	}
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_STYLES_H
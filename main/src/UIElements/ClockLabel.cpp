@@ -3,21 +3,27 @@
 #include "Util/stdafx.h"
 #include "Theme/theme.h"
 
-ClockLabel::ClockLabel(lv_obj_t* parent) : LVObject(parent), ts(*((Time*) Services.get(Service::Time))), queue(2){
+ClockLabel::ClockLabel(lv_obj_t* parent, bool seconds) : LVObject(parent), ts(*(Services.get<Service::Time>())), queue(2, "ClockLabel"),
+		seconds(seconds){
 	lv_obj_set_size(obj, LV_SIZE_CONTENT, LV_SIZE_CONTENT);
 
+	queue.coalesce<Time::Event>(Facility::Time, Time::Event::Updated);
 	Events::listen(Facility::Time, &queue);
+
+	// The colon blinks with the seconds
+	if(seconds){
+		ts.holdSeconds();
+	}
 }
 
 ClockLabel::~ClockLabel(){
+	if(seconds){
+		ts.releaseSeconds();
+	}
 	Events::unlisten(&queue);
 }
 
 void ClockLabel::loop(){
-	if(millis() - lastTimeUpdate > TimeUpdateInterval){
-		updateTime(ts.getTime());
-	}
-
 	Event evt;
 	if(queue.get(evt, 0)){
 		if(evt.facility == Facility::Time){
@@ -26,17 +32,19 @@ void ClockLabel::loop(){
 				updateTime(data->updated.time);
 			}
 		}
-		free(evt.data);
 	}
 }
 
 void ClockLabel::updateTime(const tm& time){
-	lastTimeUpdate = millis();
+	const bool colon = !seconds || time.tm_sec % 2;
+	if(time.tm_hour == shownHour && time.tm_min == shownMinute && colon == shownColon) return;
+	shownHour = time.tm_hour;
+	shownMinute = time.tm_min;
+	shownColon = colon;
 
 	char clockText[128];
-	snprintf(clockText, sizeof(clockText), "%02d%c%02d", time.tm_hour, time.tm_sec % 2 ? ':' : ' ', time.tm_min);
+	snprintf(clockText, sizeof(clockText), "%02d%c%02d", time.tm_hour, colon ? ':' : ' ', time.tm_min);
 
+	// Subclasses invalidate only what they changed
 	updateUI(clockText);
-	lv_obj_refr_size(*this);
-	lv_obj_invalidate(*this);
 }
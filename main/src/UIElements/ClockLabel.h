@@ -7,7 +7,8 @@
 
 class ClockLabel : public LVObject {
 public:
-	explicit ClockLabel(lv_obj_t* parent);
+	/** @param seconds Tick every second with a blinking colon, otherwise the colon stays and updates come per minute */
+	explicit ClockLabel(lv_obj_t* parent, bool seconds = true);
 	~ClockLabel() override;
 
 	void loop();
@@ -20,10 +21,13 @@ protected:
 private:
 	virtual void updateUI(const char* clockText) = 0;
 
-	EventQueue queue;
+	CoalescingEventQueue queue;
+	const bool seconds;
 
-	static constexpr uint32_t TimeUpdateInterval = 200;
-	uint64_t lastTimeUpdate = 0;
+	// Shown digits and colon, the label is only redrawn when one of them changes
+	int shownHour = -1;
+	int shownMinute = -1;
+	bool shownColon = false;
 };
 
 
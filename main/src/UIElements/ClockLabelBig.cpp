@@ -1,32 +1,171 @@
 #include "ClockLabelBig.h"
 #include "LV_Interface/FSLVGL.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
 
-ClockLabelBig::ClockLabelBig(lv_obj_t* parent) : ClockLabel(parent){
-	lv_obj_set_size(obj, LV_SIZE_CONTENT, LV_SIZE_CONTENT);
-	lv_obj_set_flex_flow(obj, LV_FLEX_FLOW_ROW);
-	lv_obj_set_flex_align(obj, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_START);
-	lv_obj_set_style_pad_gap(obj, 3, 0);
+static const char* TAG = "ClockLabelBig";
 
-	for(auto& icon : icons){
-		icon = lv_img_create(obj);
+uint8_t* ClockLabelBig::atlas = nullptr;
+lv_img_dsc_t ClockLabelBig::glyphs[GlyphCount]{};
+
+ClockLabelBig::ClockLabelBig(lv_obj_t* parent, bool seconds) : ClockLabel(parent, seconds){
+	loadAtlas();
+
+	for(auto& cell : cells){
+		cell = GlyphSpace;
 	}
 
+	lv_obj_set_size(obj, layout(cellX), glyphs[0].header.h);
+	lv_obj_add_event_cb(obj, onDraw, LV_EVENT_DRAW_MAIN, this);
+
 	updateTime(ts.getTime());
 }
 
 void ClockLabelBig::updateUI(const char* clockText){
-	for(uint8_t i = 0; i < NumIcons; i++){
-		lv_img_set_src(icons[i], getPath(clockText[i]));
+	bool changed[NumCells] = {};
+	for(uint8_t i = 0; i < NumCells; i++){
+		const auto glyph = getGlyph(clockText[i]);
+		changed[i] = glyph != cells[i];
+		cells[i] = glyph;
+	}
+
+	// A glyph of another width (the 1 is narrower) shifts every cell after it, resizing redraws the whole widget
+	lv_coord_t x[NumCells];
+	const lv_coord_t width = layout(x);
+	if(memcmp(x, cellX, sizeof(x)) != 0 || width != lv_obj_get_width(obj)){
+		memcpy(cellX, x, sizeof(x));
+		lv_obj_set_width(obj, width);
+		lv_obj_invalidate(obj);
+		return;
+	}
+
+	for(uint8_t i = 0; i < NumCells; i++){
+		if(changed[i]){
+			invalidateCell(i);
+		}
+	}
+}
+
+lv_coord_t ClockLabelBig::layout(lv_coord_t* x) const{
+	lv_coord_t pos = 0;
+	for(uint8_t i = 0; i < NumCells; i++){
+		if(i > 0){
+			pos += Gap;
+		}
+		x[i] = pos;
+		pos += glyphs[cells[i]].header.w;
+	}
+	return pos;
+}
+
+void ClockLabelBig::invalidateCell(uint8_t i){
+	lv_area_t area;
+	lv_obj_get_coords(obj, &area);
+	area.x1 += cellX[i];
+	area.x2 = area.x1 + glyphs[cells[i]].header.w - 1;
+	lv_obj_invalidate_area(obj, &area);
+}
+
+void ClockLabelBig::onDraw(lv_event_t* evt){
+	auto label = static_cast<ClockLabelBig*>(evt->user_data);
+	auto ctx = lv_event_get_draw_ctx(evt);
+
+	lv_area_t coords;
+	lv_obj_get_coords(label->obj, &coords);
+
+	lv_draw_img_dsc_t dsc;
+	lv_draw_img_dsc_init(&dsc);
+
+	for(uint8_t i = 0; i < NumCells; i++){
+		const auto& glyph = glyphs[label->cells[i]];
+		if(glyph.data == nullptr) continue;
+
+		lv_area_t cell = {
+				.x1 = (lv_coord_t) (coords.x1 + label->cellX[i]),
+				.y1 = coords.y1,
+				.x2 = (lv_coord_t) (coords.x1 + label->cellX[i] + glyph.header.w - 1),
+				.y2 = (lv_coord_t) (coords.y1 + glyph.header.h - 1)
+		};
+
+		lv_area_t clipped;
+		if(!_lv_area_intersect(&clipped, &cell, ctx->clip_area)) continue;
+
+		lv_draw_img(ctx, &dsc, &cell, &glyph);
+	}
+}
+
+void ClockLabelBig::loadAtlas(){
+	if(atlas) return;
+
+	lv_img_header_t headers[GlyphCount];
+	size_t total = 0;
+	for(uint8_t i = 0; i < GlyphCount; i++){
+		if(lv_img_decoder_get_info(IconPaths[i], &headers[i]) != LV_RES_OK){
+			ESP_LOGW(TAG, "Couldn't read %s", IconPaths[i]);
+			headers[i] = {};
+		}
+		total += headers[i].w * headers[i].h * LV_IMG_PX_SIZE_ALPHA_BYTE;
+	}
+
+	atlas = (uint8_t*) heap_caps_malloc(total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if(atlas == nullptr){
+		ESP_LOGE(TAG, "Couldn't allocate %zu B digit atlas", total);
+		return;
+	}
+
+	size_t offset = 0;
+	for(uint8_t i = 0; i < GlyphCount; i++){
+		const auto& header = headers[i];
+		const size_t size = header.w * header.h * LV_IMG_PX_SIZE_ALPHA_BYTE;
+
+		auto& glyph = glyphs[i];
+		glyph.header.cf = LV_IMG_CF_TRUE_COLOR_ALPHA;
+		glyph.header.w = header.w;
+		glyph.header.h = header.h;
+		glyph.data_size = size;
+		glyph.data = size ? atlas + offset : nullptr;
+
+		if(size){
+			decodeGlyph(IconPaths[i], header, atlas + offset);
+		}
+		offset += size;
+	}
+}
+
+void ClockLabelBig::decodeGlyph(const char* path, const lv_img_header_t& header, uint8_t* out){
+	const size_t stride = header.w * LV_IMG_PX_SIZE_ALPHA_BYTE;
+
+	lv_img_decoder_dsc_t dsc;
+	if(lv_img_decoder_open(&dsc, path, lv_color_white(), 0) != LV_RES_OK){
+		ESP_LOGW(TAG, "Couldn't decode %s", path);
+		memset(out, 0, stride * header.h);
+		return;
 	}
+
+	// Indexed and alpha images decode line by line into color + alpha pixels, the same layout as the atlas
+	if(dsc.img_data == nullptr || header.cf == LV_IMG_CF_TRUE_COLOR_ALPHA){
+		for(lv_coord_t y = 0; y < header.h; y++){
+			if(dsc.img_data){
+				memcpy(out + y * stride, dsc.img_data + y * stride, stride);
+			}else if(lv_img_decoder_read_line(&dsc, 0, y, header.w, out + y * stride) != LV_RES_OK){
+				memset(out + y * stride, 0, stride);
+			}
+		}
+	}else{
+		ESP_LOGW(TAG, "Unsupported color format %d in %s", header.cf, path);
+		memset(out, 0, stride * header.h);
+	}
+
+	lv_img_decoder_close(&dsc);
 }
 
-constexpr const char* ClockLabelBig::getPath(char c){
+constexpr uint8_t ClockLabelBig::getGlyph(char c){
 	if(c >= '0' && c <= '9'){
-		return IconPaths[c - '0'];
+		return c - '0';
 	}else if(c == ':'){
-		return IconPaths[10];
+		return GlyphColon;
 	}else{
-		return IconPaths[11];
+		return GlyphSpace;
 	}
 }
-
@@ -3,23 +3,44 @@
 
 #include "ClockLabel.h"
 
+/**
+ * Clock drawn from a digit atlas: the glyph images are decoded once into a true color + alpha sprite sheet in RAM,
+ * which the widget blits from directly in its draw event. Only cells whose glyph changed are invalidated, unless a
+ * glyph of a different width moves the others.
+ */
 class ClockLabelBig : public ClockLabel {
 public:
-	explicit ClockLabelBig(lv_obj_t* parent);
+	explicit ClockLabelBig(lv_obj_t* parent, bool seconds = true);
 	~ClockLabelBig() override = default;
 private:
 	void updateUI(const char* clockText) override;
 
+	static constexpr uint8_t NumCells = 5;
+	static constexpr lv_coord_t Gap = 3; // [px] between cells
 
-	static constexpr const char* getPath(char c);
+	uint8_t cells[NumCells]; // Glyph index shown by each cell
+	lv_coord_t cellX[NumCells]{}; // [px] from the widget's left edge
 
-	static constexpr uint8_t NumIcons = 5;
-	lv_obj_t* icons[NumIcons]{};
+	static constexpr uint8_t GlyphCount = 12;
+	static constexpr uint8_t GlyphColon = 10;
+	static constexpr uint8_t GlyphSpace = 11;
 
-	static constexpr const char* IconPaths[12] = {
+	static constexpr const char* IconPaths[GlyphCount] = {
 			"S:/clockIcons/0.bin", "S:/clockIcons/1.bin", "S:/clockIcons/2.bin", "S:/clockIcons/3.bin", "S:/clockIcons/4.bin", "S:/clockIcons/5.bin",
 			"S:/clockIcons/6.bin", "S:/clockIcons/7.bin", "S:/clockIcons/8.bin", "S:/clockIcons/9.bin", "S:/clockIcons/colon.bin", "S:/clockIcons/space.bin"
 	};
+
+	// Shared by all instances and kept for the lifetime of the firmware, like the LVGL styles
+	static uint8_t* atlas;
+	static lv_img_dsc_t glyphs[GlyphCount];
+	static void loadAtlas();
+	static void decodeGlyph(const char* path, const lv_img_header_t& header, uint8_t* out);
+
+	static constexpr uint8_t getGlyph(char c);
+	lv_coord_t layout(lv_coord_t* x) const;
+	void invalidateCell(uint8_t i);
+
+	static void onDraw(lv_event_t* evt);
 };
 
 
@@ -2,6 +2,7 @@
 #define CLOCKSTAR_FIRMWARE_CLOCKLABELSMALL_H
 
 #include "ClockLabel.h"
+#include "LV_Interface/LVText.h"
 
 class ClockLabelSmall : public ClockLabel {
 public:
@@ -9,7 +10,7 @@ public:
 	~ClockLabelSmall() override = default;
 private:
 	void updateUI(const char* clockText) override;
-	lv_obj_t* clock;
+	LVText* clock;
 };
 
 
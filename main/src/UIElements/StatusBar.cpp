@@ -1,8 +1,8 @@
 #include "StatusBar.h"
 #include "Util/Services.h"
 
-StatusBar::StatusBar(lv_obj_t* parent, bool showExtra) : LVObject(parent), phone(*((Phone*) Services.get(Service::Phone))),
-														 battery(*((Battery*) Services.get(Service::Battery))), queue(12), showExtra(showExtra){
+StatusBar::StatusBar(lv_obj_t* parent, bool showExtra) : LVObject(parent), phone(*(Services.get<Service::Phone>())),
+														 battery(*(Services.get<Service::Battery>())), queue(12, "StatusBar"), showExtra(showExtra){
 	lv_obj_set_size(*this, 128, 15);
 	lv_obj_set_style_pad_ver(*this, 2, 0);
 	lv_obj_set_style_pad_hor(*this, 3, 0);
@@ -31,6 +31,8 @@ StatusBar::StatusBar(lv_obj_t* parent, bool showExtra) : LVObject(parent), phone
 	batDevice = new BatteryElement(*this);
 
 	// Events::listen(Facility::Phone, &queue); TODO: uncomment once evnet processing is actually hapening
+	queue.coalesce<Battery::Event>(Facility::Battery, Battery::Event::LevelChange);
+	queue.coalesce<Battery::Event>(Facility::Battery, Battery::Event::Charging);
 	Events::listen(Facility::Battery, &queue);
 
 	setPhoneConnected();
@@ -59,7 +61,6 @@ void StatusBar::loop(){
 		if(event.facility == Facility::Battery){
 			setDeviceBattery();
 		}
-		free(event.data);
 	}
 
 	batDevice->loop();
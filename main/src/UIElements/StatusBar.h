@@ -22,7 +22,7 @@ private:
 	Phone& phone;
 	Battery& battery;
 
-	EventQueue queue;
+	CoalescingEventQueue queue;
 
 	bool connected = false;
 	bool showExtra = false;
@@ -0,0 +1,76 @@
+#include "AssetBundle.h"
+#include <cstring>
+#include <algorithm>
+#include <esp_log.h>
+
+static const char* TAG = "AssetBundle";
+
+AssetBundle::AssetBundle(const char* partitionLabel){
+	auto part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+	if(part == nullptr){
+		ESP_LOGE(TAG, "Couldn't find partition %s", partitionLabel);
+		return;
+	}
+
+	Header header;
+	if(esp_partition_read(part, 0, &header, sizeof(Header)) != ESP_OK){
+		ESP_LOGE(TAG, "Couldn't read bundle header");
+		return;
+	}
+
+	if(header.magic != Magic || header.version != Version || header.size > part->size || header.size < sizeof(Header) + header.count * sizeof(Entry)){
+		ESP_LOGE(TAG, "Invalid bundle in partition %s", partitionLabel);
+		return;
+	}
+
+	const void* ptr;
+	auto ret = esp_partition_mmap(part, 0, header.size, ESP_PARTITION_MMAP_DATA, &ptr, &handle);
+	if(ret != ESP_OK){
+		ESP_LOGE(TAG, "Couldn't map bundle: %s", esp_err_to_name(ret));
+		return;
+	}
+
+	base = (const uint8_t*) ptr;
+	index = (const Entry*) (base + sizeof(Header));
+	count = header.count;
+
+	ESP_LOGI(TAG, "Mapped %lu assets, %lu B", count, header.size);
+}
+
+AssetBundle::~AssetBundle(){
+	if(base == nullptr) return;
+	esp_partition_munmap(handle);
+}
+
+AssetBundle::Asset AssetBundle::find(const char* path) const{
+	if(base == nullptr) return { nullptr, 0, 0 };
+
+	const auto hash = hashPath(path);
+	const auto end = index + count;
+	auto entry = std::lower_bound(index, end, hash, [](const Entry& e, uint32_t h){ return e.hash < h; });
+
+	for(; entry != end && entry->hash == hash; entry++){
+		if(strcmp((const char*) (base + entry->pathOffset), path) == 0){
+			return { base + entry->offset, entry->size, entry->rawSize };
+		}
+	}
+
+	return { nullptr, 0, 0 };
+}
+
+bool AssetBundle::isMapped() const{
+	return base != nullptr;
+}
+
+size_t AssetBundle::getCount() const{
+	return count;
+}
+
+uint32_t AssetBundle::hashPath(const char* path){
+	uint32_t hash = 2166136261u;
+	for(; *path; path++){
+		hash ^= (uint8_t) *path;
+		hash *= 16777619u;
+	}
+	return hash;
+}
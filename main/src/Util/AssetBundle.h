@@ -0,0 +1,68 @@
+#ifndef CLOCKSTAR_FIRMWARE_ASSETBUNDLE_H
+#define CLOCKSTAR_FIRMWARE_ASSETBUNDLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <esp_partition.h>
+
+/**
+ * Read-only asset container memory-mapped from its own flash partition.
+ * Built from spiffs_image by tools/pack_assets.py. Layout (little endian):
+ * 	Header, Entry[count] sorted by path hash, NUL-terminated relative paths, 4-byte aligned file blobs.
+ * Blobs are stored as raw LZ4 blocks when the bundle is packed with --compress and the file shrinks enough.
+ * Offsets are relative to the start of the bundle.
+ */
+class AssetBundle {
+public:
+	AssetBundle(const char* partitionLabel = "assets");
+	virtual ~AssetBundle();
+
+	struct Asset {
+		const uint8_t* data;
+		size_t size; // [B] stored size
+		size_t rawSize; // [B] size after decompression
+
+		bool compressed() const{ return data && size != rawSize; }
+	};
+
+	/**
+	 * @param path Relative to the image root (e.g. /bg.bin)
+	 * @return Asset pointing into mapped flash, data is nullptr if not found
+	 */
+	Asset find(const char* path) const;
+
+	bool isMapped() const;
+	size_t getCount() const;
+
+	/** FNV-1a, same as used by the packer. */
+	static uint32_t hashPath(const char* path);
+
+	static constexpr uint32_t Magic = 0x42415343; // "CSAB"
+	static constexpr uint16_t Version = 2;
+
+private:
+	struct Header {
+		uint32_t magic;
+		uint16_t version;
+		uint16_t reserved;
+		uint32_t count;
+		uint32_t size; // [B] total bundle size
+	};
+
+	struct Entry {
+		uint32_t hash;
+		uint32_t pathOffset;
+		uint32_t offset;
+		uint32_t size;
+		uint32_t rawSize;
+	};
+
+	const uint8_t* base = nullptr;
+	const Entry* index = nullptr;
+	uint32_t count = 0;
+	esp_partition_mmap_handle_t handle;
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_ASSETBUNDLE_H
@@ -0,0 +1,49 @@
+#include "AsyncCopy.h"
+#include <esp_async_memcpy.h>
+#include <esp_memory_utils.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
+
+static const char* TAG = "AsyncCopy";
+
+static std::mutex installMut;
+static async_memcpy_t driver = nullptr;
+static bool installFailed = false;
+
+static bool IRAM_ATTR onDone(async_memcpy_t mcp, async_memcpy_event_t* event, void* arg){
+	BaseType_t woken = pdFALSE;
+	xSemaphoreGiveFromISR((SemaphoreHandle_t) arg, &woken);
+	return woken == pdTRUE;
+}
+
+bool AsyncCopy::install(){
+	std::lock_guard lock(installMut);
+	if(driver) return true;
+	if(installFailed) return false;
+
+	async_memcpy_config_t config = ASYNC_MEMCPY_DEFAULT_CONFIG();
+	config.backlog = Backlog;
+	if(esp_async_memcpy_install(&config, &driver) != ESP_OK){
+		ESP_LOGW(TAG, "Couldn't install the async memcpy driver, copying with the CPU");
+		driver = nullptr;
+		installFailed = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool AsyncCopy::copy(void* dest, const void* src, size_t len, SemaphoreHandle_t done){
+	// The GDMA moves words between internal RAM, anything else is copied here
+	const bool dma = len >= MinLen && (((uintptr_t) dest | (uintptr_t) src | len) & 3) == 0 && esp_ptr_dma_capable(dest) && esp_ptr_dma_capable(src);
+	if(dma && install() && esp_async_memcpy(driver, dest, (void*) src, len, onDone, done) == ESP_OK){
+		return true;
+	}
+
+	memcpy(dest, src, len);
+	xSemaphoreGive(done);
+	return false;
+}
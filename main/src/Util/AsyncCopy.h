@@ -0,0 +1,31 @@
+#ifndef CLOCKSTAR_FIRMWARE_ASYNCCOPY_H
+#define CLOCKSTAR_FIRMWARE_ASYNCCOPY_H
+
+#include <cstddef>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/**
+ * Large memory copies on the GDMA through esp_async_memcpy, so the caller can do other work while a buffer is copied
+ * and take the done semaphore once it needs the data. Copies the DMA can't do (small, unaligned, or from mapped flash
+ * or PSRAM) are done with memcpy on the spot and signal done before returning.
+ * The driver is installed with the first copy that uses it. Safe to call from any task.
+ */
+class AsyncCopy {
+public:
+	/**
+	 * Copies len bytes from src to dest, both must stay valid until done is given.
+	 * @param done Binary semaphore, given once dest is filled
+	 * @return True if the copy is running on the DMA, false if it was done already
+	 */
+	static bool copy(void* dest, const void* src, size_t len, SemaphoreHandle_t done);
+
+private:
+	static constexpr size_t MinLen = 2048; // [B] Shorter copies are quicker with memcpy than setting up the DMA
+	static constexpr uint32_t Backlog = 8; // Copies the DMA queues at once
+
+	static bool install();
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_ASYNCCOPY_H
@@ -0,0 +1,110 @@
+#include "BootGraph.h"
+#include <esp_log.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <freertos/task.h>
+#include "Util/stdafx.h"
+#include "Util/Trace.h"
+
+static const char* TAG = "boot";
+
+BootGraph::BootGraph() : done(xEventGroupCreate()){
+
+}
+
+BootGraph::~BootGraph(){
+	waitBits(added);
+	vEventGroupDelete(done);
+}
+
+BootGraph::Stage BootGraph::run(const char* name, std::initializer_list<Stage> deps, std::function<void()> fn){
+	auto& node = add(name, deps, std::move(fn), false);
+	execute(node);
+	return node.index;
+}
+
+BootGraph::Stage BootGraph::async(const char* name, std::initializer_list<Stage> deps, std::function<void()> fn, int8_t core, size_t stackSize){
+	auto& node = add(name, deps, std::move(fn), true);
+	xTaskCreatePinnedToCore(asyncFunc, name, stackSize, &node, AsyncPriority, nullptr, core < 0 ? tskNO_AFFINITY : core);
+	return node.index;
+}
+
+void BootGraph::wait(std::initializer_list<Stage> stages){
+	EventBits_t bits = 0;
+	for(const auto stage : stages){
+		bits |= 1 << stage;
+	}
+	waitBits(bits);
+}
+
+BootGraph::Node& BootGraph::add(const char* name, std::initializer_list<Stage> deps, std::function<void()> fn, bool async){
+	assert(count < MaxStages);
+
+	auto& node = nodes[count];
+	node = { .name = name, .deps = 0, .fn = std::move(fn), .start = 0, .end = 0, .core = -1, .async = async, .index = (Stage) count, .graph = this };
+	for(const auto dep : deps){
+		assert(dep < count);
+		node.deps |= 1 << dep;
+	}
+
+	added |= 1 << count;
+	count++;
+	return node;
+}
+
+void BootGraph::execute(Node& node){
+	waitBits(node.deps);
+
+	node.start = millis();
+	node.core = xPortGetCoreID();
+	TRACE_BEGIN(node.name);
+	node.fn();
+	TRACE_END(node.name);
+	node.fn = nullptr;
+	node.end = millis();
+
+	ESP_LOGI(TAG, "%5llu ms  %s", node.end, node.name);
+	xEventGroupSetBits(done, 1 << node.index);
+}
+
+void BootGraph::waitBits(EventBits_t bits){
+	if(bits == 0) return;
+	xEventGroupWaitBits(done, bits, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+void BootGraph::asyncFunc(void* arg){
+	auto& node = *static_cast<Node*>(arg);
+	node.graph->execute(node);
+	vTaskDelete(nullptr);
+}
+
+void BootGraph::printTimeline(){
+	static constexpr size_t BarWidth = 32;
+
+	waitBits(added);
+	if(count == 0) return;
+
+	uint64_t first = nodes[0].start, last = 0;
+	for(size_t i = 0; i < count; i++){
+		first = std::min(first, nodes[i].start);
+		last = std::max(last, nodes[i].end);
+	}
+	const uint64_t span = std::max<uint64_t>(last - first, 1);
+
+	ESP_LOGI(TAG, "Boot timeline, %llu ms from the first stage to the last:", span);
+	for(size_t i = 0; i < count; i++){
+		const auto& node = nodes[i];
+
+		char bar[BarWidth + 1];
+		const size_t from = (node.start - first) * BarWidth / span;
+		const size_t to = std::max(from + 1, (size_t) ((node.end - first) * BarWidth / span));
+		for(size_t j = 0; j < BarWidth; j++){
+			bar[j] = (j >= from && j < to) ? '#' : '.';
+		}
+		bar[BarWidth] = 0;
+
+		ESP_LOGI(TAG, "%-12s %5llu - %5llu ms %5llu ms  core %d %-5s |%s|", node.name, node.start, node.end, node.end - node.start,
+				 node.core, node.async ? "async" : "", bar);
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef CLOCKSTAR_FIRMWARE_BOOTGRAPH_H
+#define CLOCKSTAR_FIRMWARE_BOOTGRAPH_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <functional>
+#include <initializer_list>
+
+/**
+ * Startup dependency graph. Each stage is a named init step listing the stages it needs. run() does a stage in the
+ * calling task once its dependencies are done, async() gives it a task of its own so init that doesn't depend on it
+ * carries on meanwhile. Stages are timestamped, printTimeline() logs when each ran, where and for how long.
+ *
+ * Stages may only depend on stages added before them, which keeps the graph acyclic. The destructor waits for every
+ * stage, so async stages can safely write to locals declared before the graph.
+ */
+class BootGraph {
+public:
+	using Stage = uint8_t;
+
+	BootGraph();
+	~BootGraph();
+
+	Stage run(const char* name, std::initializer_list<Stage> deps, std::function<void()> fn);
+	Stage async(const char* name, std::initializer_list<Stage> deps, std::function<void()> fn, int8_t core = -1, size_t stackSize = AsyncStack);
+
+	/** Blocks until the stages are done. */
+	void wait(std::initializer_list<Stage> stages);
+
+	/** Waits for all stages and logs the timeline. */
+	void printTimeline();
+
+private:
+	static constexpr size_t MaxStages = 24; // Bits in an event group
+	static constexpr size_t AsyncStack = 6 * 1024; // [B]
+	static constexpr uint8_t AsyncPriority = 5;
+
+	struct Node {
+		const char* name;
+		EventBits_t deps;
+		std::function<void()> fn;
+		uint64_t start; // [ms] since boot
+		uint64_t end; // [ms] since boot
+		int8_t core;
+		bool async;
+		Stage index;
+		BootGraph* graph;
+	};
+	Node nodes[MaxStages];
+	size_t count = 0;
+	EventBits_t added = 0;
+
+	EventGroupHandle_t done;
+
+	Node& add(const char* name, std::initializer_list<Stage> deps, std::function<void()> fn, bool async);
+	void execute(Node& node);
+	void waitBits(EventBits_t bits);
+	static void asyncFunc(void* arg);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_BOOTGRAPH_H
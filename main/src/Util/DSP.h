@@ -0,0 +1,315 @@
+#ifndef CLOCKSTAR_FIRMWARE_DSP_H
+#define CLOCKSTAR_FIRMWARE_DSP_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "Fusion/Fixed.h"
+
+/**
+ * Filters for sensor and ADC readings, for float or Fusion::Fixed samples. Coefficients are computed from rates and
+ * cutoffs in constant expressions, so a filter declared constexpr or static costs no math at runtime beyond its
+ * update. Every filter has update(), which returns the new output, get() and reset().
+ */
+namespace DSP {
+
+namespace detail {
+
+/** tan by Lambert's continued fraction, exact to double precision for |x| < pi/4, i.e. cutoffs below rate/4 */
+constexpr double tan(double x){
+	const double x2 = x * x;
+	double frac = 0;
+	for(int i = 12; i > 0; i--){
+		frac = x2 / ((2 * i + 1) - frac);
+	}
+	return x / (1 - frac);
+}
+
+template<typename T>
+constexpr T abs(T x){
+	return x < T() ? -x : x;
+}
+
+/** Smoothing factor of a first order low-pass at cutoff [Hz] sampled at rate [Hz] */
+constexpr double alpha(double rate, double cutoff){
+	const double r = 2 * M_PI * cutoff / rate;
+	return r / (r + 1);
+}
+
+}
+
+/** Exponential moving average, val += a * (x - val). */
+template<typename T>
+class EMA {
+public:
+	constexpr explicit EMA(T a, T initial = T()) : a(a), val(initial){}
+
+	/** Same response as a first order low-pass, see detail::alpha. [Hz] */
+	static constexpr EMA fromCutoff(double rate, double cutoff){
+		return EMA((T) detail::alpha(rate, cutoff));
+	}
+
+	T update(T x){
+		val += a * (x - val);
+		return val;
+	}
+
+	T get() const{
+		return val;
+	}
+
+	void reset(T to = T()){
+		val = to;
+	}
+
+private:
+	T a;
+	T val;
+
+};
+
+/**
+ * One-euro filter: a low-pass whose cutoff rises with the speed of the signal, so it's smooth at rest and lags little
+ * while moving. Samples are expected at a fixed rate.
+ */
+template<typename T>
+class OneEuro {
+public:
+	/**
+	 * @param rate Sample rate [Hz]
+	 * @param minCutoff Cutoff at rest [Hz], lower is smoother
+	 * @param beta Cutoff added per unit/s of speed [Hz], higher lags less while moving
+	 * @param speedCutoff Cutoff of the speed estimate [Hz]
+	 */
+	constexpr OneEuro(double rate, double minCutoff, double beta, double speedCutoff = 1.0)
+			: rate((T) rate), k((T) (2 * M_PI / rate)), minCutoff((T) minCutoff), beta((T) beta),
+			  speedA((T) detail::alpha(rate, speedCutoff)){}
+
+	T update(T x){
+		if(!primed){
+			reset(x);
+			return val;
+		}
+
+		speed += speedA * ((x - val) * rate - speed);
+
+		const T r = k * (minCutoff + beta * detail::abs(speed));
+		val += r / (r + T(1)) * (x - val);
+		return val;
+	}
+
+	T get() const{
+		return val;
+	}
+
+	void reset(T to = T()){
+		val = to;
+		speed = T();
+		primed = true;
+	}
+
+private:
+	T rate;
+	T k;
+	T minCutoff;
+	T beta;
+	T speedA;
+
+	T val = T();
+	T speed = T(); // [unit/s]
+	bool primed = false;
+
+};
+
+/** Median of the last N samples, for dropping single-sample spikes. N is small and odd. */
+template<typename T, size_t N>
+class Median {
+	static_assert(N % 2 == 1 && N <= 15);
+
+public:
+	T update(T x){
+		window[next] = x;
+		next = (next + 1) % N;
+		if(count < N){
+			count++;
+		}
+
+		// Insertion sort of a copy, quicker than anything smarter at these sizes
+		std::array<T, N> sorted;
+		for(size_t i = 0; i < count; i++){
+			size_t j = i;
+			for(; j > 0 && window[i] < sorted[j - 1]; j--){
+				sorted[j] = sorted[j - 1];
+			}
+			sorted[j] = window[i];
+		}
+
+		val = sorted[count / 2];
+		return val;
+	}
+
+	T get() const{
+		return val;
+	}
+
+	void reset(T to = T()){
+		window.fill(to);
+		count = N;
+		next = 0;
+		val = to;
+	}
+
+private:
+	std::array<T, N> window = {};
+	size_t count = 0;
+	size_t next = 0;
+	T val = T();
+
+};
+
+template<typename T>
+struct BiquadCoeffs {
+	T b0, b1, b2;
+	T a1, a2; // a0 is normalized to 1
+};
+
+/** Second order low-pass by bilinear transform. The default q is Butterworth, flat with no overshoot. [Hz] */
+template<typename T>
+constexpr BiquadCoeffs<T> lowPass(double rate, double cutoff, double q = M_SQRT1_2){
+	const double k = detail::tan(M_PI * cutoff / rate);
+	const double norm = 1 / (1 + k / q + k * k);
+	const double b0 = k * k * norm;
+	return { (T) b0, (T) (2 * b0), (T) b0, (T) (2 * (k * k - 1) * norm), (T) ((1 - k / q + k * k) * norm) };
+}
+
+/** Biquad in transposed direct form II, which keeps float rounding low. */
+template<typename T>
+class Biquad {
+public:
+	constexpr explicit Biquad(const BiquadCoeffs<T>& c) : c(c){}
+
+	T update(T x){
+		const T y = c.b0 * x + s1;
+		s1 = c.b1 * x - c.a1 * y + s2;
+		s2 = c.b2 * x - c.a2 * y;
+		val = y;
+		return val;
+	}
+
+	T get() const{
+		return val;
+	}
+
+	/** Settles the filter as if it had seen to forever. Assumes unity gain at DC, like lowPass. */
+	void reset(T to = T()){
+		val = to;
+		s1 = to - c.b0 * to;
+		s2 = c.b2 * to - c.a2 * to;
+	}
+
+private:
+	BiquadCoeffs<T> c;
+	T s1 = T();
+	T s2 = T();
+	T val = T();
+
+};
+
+/**
+ * Fixed point biquad in direct form I. The five products are summed in int64_t at full precision and rounded once,
+ * instead of after every multiply, which would leave the small coefficients of a low cutoff with few bits.
+ */
+template<int Frac>
+class Biquad<Fusion::Fixed<Frac>> {
+	using T = Fusion::Fixed<Frac>;
+
+public:
+	constexpr explicit Biquad(const BiquadCoeffs<T>& c) : c(c){}
+
+	T update(T x){
+		const int64_t acc = (int64_t) c.b0.raw * x.raw + (int64_t) c.b1.raw * x1.raw + (int64_t) c.b2.raw * x2.raw
+							- (int64_t) c.a1.raw * y1.raw - (int64_t) c.a2.raw * y2.raw;
+		x2 = x1;
+		x1 = x;
+		y2 = y1;
+		y1 = T::fromRaw((int32_t) ((acc + (1 << (Frac - 1))) >> Frac));
+		return y1;
+	}
+
+	T get() const{
+		return y1;
+	}
+
+	void reset(T to = T()){
+		x1 = x2 = y1 = y2 = to;
+	}
+
+private:
+	BiquadCoeffs<T> c;
+	T x1 = T();
+	T x2 = T();
+	T y1 = T();
+	T y2 = T();
+
+};
+
+/**
+ * Quantizes a reading into Levels levels that don't flicker at the boundaries: the level only changes once the
+ * reading is margin past the current level's range.
+ */
+template<typename T, size_t Levels>
+class Hysteresis {
+public:
+	/**
+	 * @param thresholds Ordered low to high, including the min and max. Level i is [thresholds[i], thresholds[i + 1]].
+	 * @param margin A few percent of a level's range, wider ones can make neighbouring levels overlap
+	 */
+	constexpr Hysteresis(const std::array<T, Levels + 1>& thresholds, T margin) : thresholds(thresholds), margin(margin){}
+
+	size_t update(T x){
+		T low = thresholds[level];
+		if(level > 0){
+			low -= margin;
+		}
+
+		T high = thresholds[level + 1];
+		if(level < Levels - 1){
+			high += margin;
+		}
+
+		if(x < low || x > high){
+			level = find(x);
+		}
+
+		return level;
+	}
+
+	size_t get() const{
+		return level;
+	}
+
+	size_t reset(T x = T()){
+		level = find(x);
+		return level;
+	}
+
+private:
+	std::array<T, Levels + 1> thresholds;
+	T margin;
+	size_t level = 0;
+
+	/** Readings out of range count as the first or last level */
+	size_t find(T x) const{
+		for(size_t i = 0; i < Levels - 1; i++){
+			if(x <= thresholds[i + 1]) return i;
+		}
+		return Levels - 1;
+	}
+
+};
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_DSP_H
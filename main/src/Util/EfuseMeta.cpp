@@ -1,8 +1,36 @@
 #include "EfuseMeta.h"
+#include <esp_log.h>
+
+bool EfuseMeta::load(){
+	bool ok = readPID(CachedPID);
+	ok &= readRev(CachedRevision);
+	ok &= esp_efuse_read_field_blob((const esp_efuse_desc_t**) PIDAddition_Blob, &CachedPIDAddition, 8) == ESP_OK;
+	Loaded = true;
+	return ok;
+}
+
+void EfuseMeta::ensureLoaded(){
+	if(Loaded) return;
+	load();
+}
+
+uint16_t EfuseMeta::getPID(){
+	ensureLoaded();
+	return CachedPID;
+}
+
+uint8_t EfuseMeta::getRevision(){
+	ensureLoaded();
+	return CachedRevision;
+}
+
+uint8_t EfuseMeta::getPIDAddition(){
+	ensureLoaded();
+	return CachedPIDAddition;
+}
 
 bool EfuseMeta::check(){
-	readPID(CachedPID);
-	readRev(CachedRevision);
+	ensureLoaded();
 
 	//Make an exception for this product a having blank PID!
 	if(CachedPID == PID){
@@ -35,9 +63,18 @@ bool EfuseMeta::write(){
 		return false;
 	}
 
+	// The snapshot is stale now, the next getter reads the burnt fields back
+	Loaded = false;
 	return true;
 }
 
+esp_err_t EfuseMeta::writePIDAddition(uint8_t addition){
+	const esp_err_t err = esp_efuse_write_field_blob((const esp_efuse_desc_t**) PIDAddition_Blob, &addition, 8);
+	CachedPIDAddition = 0;
+	Loaded = false;
+	return err;
+}
+
 void EfuseMeta::log(){
 	ESP_LOGE("Hardware check", "PID (0x%04x), rev(0x%02x) does not match software (0x%04x).", CachedPID, CachedRevision, PID);
 }
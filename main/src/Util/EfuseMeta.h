@@ -7,11 +7,24 @@
 /**
  * Used for reading/writing product IDs, revision numbers from efuse.
  * (previously called HWVersion)
+ *
+ * The fields don't change while running, load() reads them once at boot and the getters return that snapshot.
+ * readPID() and readRev() go to the eFuse every time, for the jig that burns them.
  */
 class EfuseMeta {
 public:
+	/** Reads every field into the snapshot. False if any read failed, the getters then return 0 for it. */
+	static bool load();
+
+	static uint16_t getPID();
+	static uint8_t getRevision();
+	static uint8_t getPIDAddition(); // EFUSE_BLK4, tells Clockstar v2 from Bit v3, see resolvePIDConflicts in main
+
 	static bool check();
+
+	/** Burn the fields, the snapshot is reloaded on the next getter. */
 	static bool write();
+	static esp_err_t writePIDAddition(uint8_t addition);
 	static void log();
 
 	static bool readPID(uint16_t& pid);
@@ -27,10 +40,16 @@ private:
 	static inline constexpr const uint8_t HWRevision = 1;
 	static inline uint8_t CachedRevision = 0;
 
+	static inline uint8_t CachedPIDAddition = 0;
+	static inline bool Loaded = false;
+	static void ensureLoaded();
+
 	static constexpr esp_efuse_desc_t PIDBlock = { EFUSE_BLK3, 16, 16 };
 	static constexpr const esp_efuse_desc_t* PID_Blob[] = { &PIDBlock, nullptr };
 	static constexpr esp_efuse_desc_t RevBlock = { EFUSE_BLK3, 32, 8 };
 	static constexpr const esp_efuse_desc_t* Rev_Blob[] = { &RevBlock, nullptr };
+	static constexpr esp_efuse_desc_t PIDAdditionBlock = { EFUSE_BLK4, 0, 8 };
+	static constexpr const esp_efuse_desc_t* PIDAddition_Blob[] = { &PIDAdditionBlock, nullptr };
 };
 
 #endif //ARTEMIS_FIRMWARE_HWVERSION_H
\ No newline at end of file
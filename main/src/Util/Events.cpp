@@ -1,69 +1,541 @@
 #include "Events.h"
 #include <cstring>
+#include <algorithm>
+#include <esp_heap_caps.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <cstdio>
+#include "Services/RTCTelemetry.h"
+#include "Trace.h"
+#include "Hot.h"
 
-std::unordered_map<Facility, std::unordered_set<EventQueue*>> Events::queues;
+std::atomic<const Events::Subscribers*> Events::subscribers[Events::FacilityCount] = {};
+std::atomic_uint32_t Events::readers[Events::FacilityCount] = {};
 std::mutex Events::mut;
+Events::Slab Events::slabs[Events::FacilityCount];
+portMUX_TYPE Events::slabLock = portMUX_INITIALIZER_UNLOCKED;
+uint32_t Events::fallbacks = 0;
+EventQueue* Events::allQueues = nullptr;
+EventStats Events::facilityStats[Events::FacilityCount];
+portMUX_TYPE Events::statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* const FacilityNames[] = { "Input", "Motion", "Phone", "Time", "Battery", "Sleep", "Settings" };
+
+Event::~Event(){
+	release();
+}
+
+Event::Event(Event&& other) noexcept : facility(other.facility), data(other.data){
+	other.data = nullptr;
+}
+
+Event& Event::operator=(Event&& other) noexcept{
+	if(this == &other) return *this;
+	release();
+	facility = other.facility;
+	data = other.data;
+	other.data = nullptr;
+	return *this;
+}
+
+void Event::release(){
+	Events::release(data);
+	data = nullptr;
+}
 
 void Events::listen(Facility facility, EventQueue* queue){
 	std::lock_guard lock(mut);
 
-	queues[facility].insert(queue);
+	auto current = subscribers[(size_t) facility].load();
+	auto list = new Subscribers();
+	if(current){
+		*list = *current;
+	}
+
+	if(std::find(list->queues, list->queues + list->count, queue) != list->queues + list->count){
+		delete list;
+		return;
+	}
+	if(list->count >= MaxSubscribers) abort();
+	queue->addLane(facility);
+	list->queues[list->count++] = queue;
+
+	publish((size_t) facility, list);
 }
 
 void Events::unlisten(EventQueue* queue){
 	std::lock_guard lock(mut);
 
-	for(auto& pair : queues){
-		pair.second.erase(queue);
+	for(size_t i = 0; i < FacilityCount; i++){
+		auto current = subscribers[i].load();
+		if(current == nullptr) continue;
+
+		auto end = current->queues + current->count;
+		if(std::find(current->queues, end, queue) == end) continue;
+
+		auto list = new Subscribers();
+		list->count = std::remove_copy(current->queues, end, list->queues, queue) - list->queues;
+		publish(i, list);
+	}
+}
+
+void Events::publish(size_t facility, const Subscribers* list){
+	auto old = subscribers[facility].exchange(list);
+	if(old == nullptr) return;
+
+	// Posts that loaded the old list are done with it once the reader count drops to zero
+	while(readers[facility].load() != 0){
+		vTaskDelay(1);
+	}
+	delete old;
+}
+
+void CM_HOT Events::post(Facility facility, const void* data, size_t size){
+	TRACE_SCOPE("events_post");
+	EventQueue* subs[MaxSubscribers];
+	size_t subCount = 0;
+
+	readers[(size_t) facility]++;
+	if(auto list = subscribers[(size_t) facility].load()){
+		subCount = list->count;
+		std::copy(list->queues, list->queues + subCount, subs);
+	}
+	readers[(size_t) facility]--;
+
+	if(subCount == 0) return;
+
+	if(size != 0 && slabs[(size_t) facility].memory == nullptr){
+		std::lock_guard lock(mut);
+		if(slabs[(size_t) facility].memory == nullptr){
+			initSlab(facility, size);
+		}
+	}
+
+	const void* payload = nullptr;
+	if(size != 0){
+		auto block = alloc(facility, size);
+		if(block == nullptr){
+			// Out of both slab and heap, counted the same as a full queue for every subscriber
+			for(size_t i = 0; i < subCount; i++){
+				subs[i]->countPost(facility, false, 0);
+			}
+			return;
+		}
+
+		block->refs = subCount;
+		payload = block + 1;
+		memcpy(block + 1, data, size);
+	}
+
+	for(size_t i = 0; i < subCount; i++){
+		if(!subs[i]->post(facility, payload)){
+			release(payload);
+		}
 	}
 }
 
-void Events::post(Facility facility, const void* data, size_t size){
-	std::unique_lock lock(mut);
+bool IRAM_ATTR Events::postFromISR(Facility facility, const void* data, size_t size, BaseType_t* woken){
+	EventQueue* subs[MaxSubscribers];
+	size_t subCount = 0;
+
+	readers[(size_t) facility]++;
+	if(auto list = subscribers[(size_t) facility].load()){
+		subCount = list->count;
+		for(size_t i = 0; i < subCount; i++){
+			subs[i] = list->queues[i];
+		}
+	}
+	readers[(size_t) facility]--;
+
+	if(subCount == 0) return true;
 
-	auto pair = queues.find(facility);
-	if(pair == queues.end()) return;
+	const void* payload = nullptr;
+	if(size != 0){
+		auto block = allocFromISR(facility, size);
+		if(block == nullptr) return false;
 
-	const std::unordered_set<EventQueue*> subs = pair->second;
-	lock.unlock();
+		block->refs = subCount;
+		payload = block + 1;
+		auto src = (const uint8_t*) data;
+		auto dst = (uint8_t*) (block + 1);
+		for(size_t i = 0; i < size; i++){
+			dst[i] = src[i];
+		}
+	}
 
-	for(auto queue : subs){
-		void* qData = nullptr;
-		if(size != 0){
-			qData = malloc(size);
-			memcpy(qData, data, size);
+	bool delivered = true;
+	for(size_t i = 0; i < subCount; i++){
+		if(!subs[i]->postFromISR(facility, payload, woken)){
+			release(payload);
+			delivered = false;
 		}
-		queue->post(facility, qData);
 	}
+
+	return delivered;
+}
+
+void Events::reserve(Facility facility, size_t size){
+	std::lock_guard lock(mut);
+	if(slabs[(size_t) facility].memory != nullptr) return;
+	initSlab(facility, size);
+}
+
+uint32_t Events::getPoolFallbacks(){
+	return fallbacks;
+}
+
+EventStats Events::getStats(Facility facility){
+	portENTER_CRITICAL(&statsLock);
+	auto stats = facilityStats[(size_t) facility];
+	portEXIT_CRITICAL(&statsLock);
+	return stats;
+}
+
+static void printStatsLine(const std::function<void(const char* line)>& print, const char* name, const EventStats& stats){
+	char line[128];
+	snprintf(line, sizeof(line), "%-12s %6lu posted, %6lu delivered, %4lu dropped, depth %2lu, latency avg %5lu us, max %6lu us\n",
+			 name, stats.posted, stats.delivered, stats.dropped, stats.maxDepth,
+			 stats.delivered ? (uint32_t) (stats.latencyTotal / stats.delivered) : 0, stats.latencyMax);
+	print(line);
+}
+
+void Events::printStats(const std::function<void(const char* line)>& print){
+	for(size_t i = 0; i < FacilityCount; i++){
+		printStatsLine(print, FacilityNames[i], getStats((Facility) i));
+	}
+
+	std::lock_guard lock(mut);
+	for(auto queue = allQueues; queue; queue = queue->nextQueue){
+		printStatsLine(print, queue->name, queue->getStats());
+	}
+}
+
+void Events::resetStats(){
+	std::lock_guard lock(mut);
+
+	portENTER_CRITICAL(&statsLock);
+	for(auto& stats : facilityStats){
+		stats = {};
+	}
+	for(auto queue = allQueues; queue; queue = queue->nextQueue){
+		queue->stats = {};
+	}
+	portEXIT_CRITICAL(&statsLock);
+}
+
+void Events::initSlab(Facility facility, size_t size){
+	auto& slab = slabs[(size_t) facility];
+	const size_t blockSize = (sizeof(Header) + size + alignof(Header) - 1) & ~(alignof(Header) - 1);
+	const size_t count = SlabBlocks[(size_t) facility];
+
+	auto memory = (uint8_t*) heap_caps_malloc(blockSize * count, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if(memory == nullptr) return;
+
+	for(size_t i = 0; i < count; i++){
+		auto block = (Header*) (memory + i * blockSize);
+		block->next = (i + 1 < count) ? (Header*) (memory + (i + 1) * blockSize) : nullptr;
+	}
+
+	portENTER_CRITICAL(&slabLock);
+	slab.blockSize = blockSize;
+	slab.count = count;
+	slab.freeList = (Header*) memory;
+	slab.memory = memory;
+	portEXIT_CRITICAL(&slabLock);
+}
+
+Events::Header* CM_HOT Events::alloc(Facility facility, size_t size){
+	auto& slab = slabs[(size_t) facility];
+
+	Header* block = nullptr;
+	portENTER_CRITICAL(&slabLock);
+	if(sizeof(Header) + size <= slab.blockSize && slab.freeList != nullptr){
+		block = slab.freeList;
+		slab.freeList = block->next;
+	}else{
+		fallbacks++;
+	}
+	portEXIT_CRITICAL(&slabLock);
+
+	if(block == nullptr){
+		block = (Header*) malloc(sizeof(Header) + size);
+	}
+
+	return block;
+}
+
+Events::Header* IRAM_ATTR Events::allocFromISR(Facility facility, size_t size){
+	auto& slab = slabs[(size_t) facility];
+
+	Header* block = nullptr;
+	portENTER_CRITICAL_ISR(&slabLock);
+	if(sizeof(Header) + size <= slab.blockSize && slab.freeList != nullptr){
+		block = slab.freeList;
+		slab.freeList = block->next;
+	}
+	portEXIT_CRITICAL_ISR(&slabLock);
+
+	return block;
+}
+
+void IRAM_ATTR Events::release(const void* data){
+	if(data == nullptr) return;
+
+	auto block = (Header*) data - 1;
+	if(--block->refs != 0) return;
+
+	for(auto& slab : slabs){
+		if(slab.memory == nullptr) continue;
+		if((uint8_t*) block < slab.memory || (uint8_t*) block >= slab.memory + slab.blockSize * slab.count) continue;
+
+		portENTER_CRITICAL_SAFE(&slabLock);
+		block->next = slab.freeList;
+		slab.freeList = block;
+		portEXIT_CRITICAL_SAFE(&slabLock);
+		return;
+	}
+
+	// Heap fallback blocks are never posted from interrupts, so this only runs in task context
+	free(block);
 }
 
 
-EventQueue::EventQueue(size_t count){
-	queue = xQueueCreate(count, sizeof(Event));
+EventQueue::EventQueue(size_t count, const char* name) : count(count), pending(xSemaphoreCreateCounting(count * (size_t) Lane::COUNT, 0)), name(name){
+
+	std::lock_guard lock(Events::mut);
+	nextQueue = Events::allQueues;
+	Events::allQueues = this;
 }
 
 EventQueue::~EventQueue(){
+	{
+		std::lock_guard lock(Events::mut);
+		for(auto link = &Events::allQueues; *link; link = &(*link)->nextQueue){
+			if(*link != this) continue;
+			*link = nextQueue;
+			break;
+		}
+	}
+
 	reset();
-	vQueueDelete(queue);
+	for(auto lane : lanes){
+		if(lane){
+			vQueueDelete(lane);
+		}
+	}
+	vSemaphoreDelete(pending);
+}
+
+void EventQueue::addLane(Facility facility){
+	auto& lane = lanes[(size_t) laneOf(facility)];
+	if(lane == nullptr){
+		lane = xQueueCreate(count, sizeof(Item));
+	}
+}
+
+bool CM_HOT EventQueue::receive(Item& item, TickType_t timeout){
+	if(xSemaphoreTake(pending, timeout) != pdTRUE) return false;
+
+	// Items are queued before pending is given, so one of the lanes has it unless this was a wake()
+	for(auto lane : lanes){
+		if(lane && xQueueReceive(lane, &item, 0) == pdTRUE) return true;
+	}
+	return false;
+}
+
+void EventQueue::wake(){
+	xSemaphoreGive(pending);
+}
+
+UBaseType_t EventQueue::depth() const{
+	return uxSemaphoreGetCount(pending);
+}
+
+bool CM_HOT EventQueue::get(Event& event, TickType_t timeout){
+	Item item;
+	if(!receive(item, timeout)) return false;
+	received(item);
+
+	event.release();
+	event.facility = item.facility;
+	event.data = item.data;
+	return true;
+}
+
+EventStats EventQueue::getStats() const{
+	portENTER_CRITICAL(&Events::statsLock);
+	auto copy = stats;
+	portEXIT_CRITICAL(&Events::statsLock);
+	return copy;
 }
 
-bool EventQueue::get(Event& event, TickType_t timeout){
-	return xQueueReceive(queue, &event, timeout) == pdTRUE;
+bool CM_HOT EventQueue::post(Facility facility, const void* data){
+	Item item = {
+			.facility = facility,
+			.data = data,
+			.postTime = (uint32_t) esp_timer_get_time()
+	};
+
+	return send(item);
+}
+
+bool CM_HOT EventQueue::send(const Item& item){
+	auto lane = lanes[(size_t) laneOf(item.facility)];
+	const bool sent = lane && xQueueSend(lane, &item, 0) == pdTRUE;
+	if(sent){
+		xSemaphoreGive(pending);
+	}
+	countPost(item.facility, sent, depth());
+	return sent;
 }
 
-bool EventQueue::post(Facility facility, void* data){
-	Event event = {
+bool IRAM_ATTR EventQueue::postFromISR(Facility facility, const void* data, BaseType_t* woken){
+	Item item = {
 			.facility = facility,
-			.data = data
+			.data = data,
+			.postTime = (uint32_t) esp_timer_get_time()
 	};
 
-	return xQueueSend(queue, &event, 0) == pdTRUE;
+	auto lane = lanes[(size_t) laneOf(facility)];
+	const bool sent = lane && xQueueSendFromISR(lane, &item, woken) == pdTRUE;
+	if(sent){
+		xSemaphoreGiveFromISR(pending, woken);
+	}
+	countPost(facility, sent, uxQueueMessagesWaitingFromISR(pending));
+	return sent;
+}
+
+void IRAM_ATTR EventQueue::countPost(Facility facility, bool sent, UBaseType_t depth){
+	auto& fac = Events::facilityStats[(size_t) facility];
+
+	portENTER_CRITICAL_SAFE(&Events::statsLock);
+	stats.posted++;
+	fac.posted++;
+	if(!sent){
+		stats.dropped++;
+		fac.dropped++;
+		RTCTelemetry::eventDropped();
+	}
+	stats.maxDepth = std::max(stats.maxDepth, (uint32_t) depth);
+	fac.maxDepth = std::max(fac.maxDepth, (uint32_t) depth);
+	portEXIT_CRITICAL_SAFE(&Events::statsLock);
+}
+
+void CM_HOT EventQueue::received(const Item& item){
+	const uint32_t latency = (uint32_t) esp_timer_get_time() - item.postTime;
+	auto& fac = Events::facilityStats[(size_t) item.facility];
+
+	portENTER_CRITICAL(&Events::statsLock);
+	stats.delivered++;
+	stats.latencyTotal += latency;
+	stats.latencyMax = std::max(stats.latencyMax, latency);
+	fac.delivered++;
+	fac.latencyTotal += latency;
+	fac.latencyMax = std::max(fac.latencyMax, latency);
+	portEXIT_CRITICAL(&Events::statsLock);
 }
 
 void EventQueue::reset(){
-	while(uxQueueMessagesWaiting(queue) > 0){
-		Event evt = {};
-		get(evt, 0);
-		free(evt.data);
+	// A wake() holds a count without an item, so this goes until the count is out rather than the first miss
+	Item item;
+	while(depth() > 0){
+		if(receive(item, 0)){
+			Events::release(item.data);
+		}
+	}
+}
+
+
+CoalescingEventQueue::CoalescingEventQueue(size_t count, const char* name) : EventQueue(count, name){
+
+}
+
+CoalescingEventQueue::~CoalescingEventQueue(){
+	// Drain slot markers here, the base destructor would release them as payloads
+	CoalescingEventQueue::reset();
+}
+
+void CoalescingEventQueue::addSlot(Facility facility, int action){
+	if(slotCount >= MaxSlots) abort();
+	slots[slotCount++] = { .facility = facility, .action = action, .data = nullptr, .queued = false };
+}
+
+CoalescingEventQueue::Slot* CM_HOT CoalescingEventQueue::findSlot(Facility facility, const void* data){
+	if(data == nullptr) return nullptr;
+
+	for(size_t i = 0; i < slotCount; i++){
+		if(slots[i].facility == facility && slots[i].action == *(const int*) data) return &slots[i];
 	}
+	return nullptr;
+}
+
+bool CM_HOT CoalescingEventQueue::get(Event& event, TickType_t timeout){
+	Item item;
+	if(!receive(item, timeout)) return false;
+	received(item);
+
+	if(item.data >= slots && item.data < slots + slotCount){
+		auto slot = (Slot*) item.data;
+
+		portENTER_CRITICAL(&slotLock);
+		item.data = slot->data;
+		slot->data = nullptr;
+		slot->queued = false;
+		portEXIT_CRITICAL(&slotLock);
+	}
+
+	event.release();
+	event.facility = item.facility;
+	event.data = item.data;
+	return true;
+}
+
+void CoalescingEventQueue::reset(){
+	Item item;
+	while(depth() > 0){
+		if(!receive(item, 0)) continue;
+		if(item.data >= slots && item.data < slots + slotCount) continue;
+		Events::release(item.data);
+	}
+	clearSlots();
+}
+
+void CoalescingEventQueue::clearSlots(){
+	for(size_t i = 0; i < slotCount; i++){
+		portENTER_CRITICAL(&slotLock);
+		auto data = slots[i].data;
+		slots[i].data = nullptr;
+		slots[i].queued = false;
+		portEXIT_CRITICAL(&slotLock);
+
+		Events::release(data);
+	}
+}
+
+bool CM_HOT CoalescingEventQueue::post(Facility facility, const void* data){
+	auto slot = findSlot(facility, data);
+	if(slot == nullptr) return EventQueue::post(facility, data);
+
+	portENTER_CRITICAL(&slotLock);
+	auto old = slot->data;
+	slot->data = data;
+	const bool enqueue = !slot->queued;
+	slot->queued = true;
+	portEXIT_CRITICAL(&slotLock);
+
+	Events::release(old);
+
+	if(!enqueue){
+		countPost(facility, true, depth());
+		return true;
+	}
+
+	// If the marker doesn't fit, the update stays pending and the next post retries
+	if(!EventQueue::post(facility, slot)){
+		portENTER_CRITICAL(&slotLock);
+		slot->queued = false;
+		portEXIT_CRITICAL(&slotLock);
+	}
+
+	return true;
 }
@@ -2,17 +2,48 @@
 #define CLOCKSTAR_FIRMWARE_EVENTS_H
 
 #include <freertos/FreeRTOS.h>
+#include <esp_attr.h>
 #include <freertos/portmacro.h>
 #include <freertos/queue.h>
-#include <unordered_map>
-#include <unordered_set>
+#include <freertos/semphr.h>
 #include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <functional>
 
-enum class Facility { Input, Motion, Phone, Time, Battery, Sleep };
+enum class Facility { Input, Motion, Phone, Time, Battery, Sleep, Settings };
 
+/**
+ * Received event. Holds a reference to its payload and drops it when destroyed or reused by EventQueue::get,
+ * so receivers don't free data themselves. The payload is shared between all subscribers and must not be modified.
+ */
 struct Event {
-	Facility facility;
-	void* data;
+	Facility facility = Facility::Input;
+	const void* data = nullptr;
+
+	Event() = default;
+	~Event();
+
+	Event(const Event&) = delete;
+	Event& operator=(const Event&) = delete;
+	Event(Event&& other) noexcept;
+	Event& operator=(Event&& other) noexcept;
+
+	/** Returns the payload to the pool before the event goes out of scope. */
+	void release();
+};
+
+/**
+ * Event bus counters, kept per facility and per queue. Latencies are measured from posting to EventQueue::get.
+ * Coalesced updates count as posted but are delivered once.
+ */
+struct EventStats {
+	uint32_t posted = 0;
+	uint32_t delivered = 0;
+	uint32_t dropped = 0; // Subscriber queue was full or the payload couldn't be allocated
+	uint32_t maxDepth = 0; // Highest number of events waiting in a queue
+	uint32_t latencyMax = 0; // [us]
+	uint64_t latencyTotal = 0; // [us]
 };
 
 class EventQueue;
@@ -33,26 +64,199 @@ public:
 		post(facility, data, sizeof(T));
 	}
 
+	/**
+	 * Posts an event from an interrupt handler. The payload is taken from the facility's slab only, so the slab has to exist,
+	 * either from an earlier post or from reserve(). Events that find the slab empty or a subscriber queue full are dropped.
+	 * @param woken Set to pdTRUE if a subscriber with a higher priority than the interrupted task was woken
+	 * @return False if the event was dropped for at least one subscriber
+	 */
+	static bool postFromISR(Facility facility, const void* data, size_t size, BaseType_t* woken);
+
+	template <typename T>
+	static bool postFromISR(Facility facility, const T& data, BaseType_t* woken){
+		return postFromISR(facility, &data, sizeof(T), woken);
+	}
+
+	/** Sets up the payload slab of a facility ahead of time, for facilities posted to from interrupts. */
+	static void reserve(Facility facility, size_t size);
+
+	/** Number of payloads that didn't fit their facility's slab and went to the heap instead. */
+	static uint32_t getPoolFallbacks();
+
+	static constexpr size_t FacilityCount = (size_t) Facility::Settings + 1;
+	static EventStats getStats(Facility facility);
+
+	/** Prints the facility and queue counters line by line, the serial console prints them on 'p'. */
+	static void printStats(const std::function<void(const char* line)>& print);
+	static void resetStats();
+
 private:
-	static std::unordered_map<Facility, std::unordered_set<EventQueue*>> queues;
-	static std::mutex mut;
+	static constexpr size_t MaxSubscribers = 16;
+
+	/**
+	 * Immutable subscriber list of one facility. Posting reads the current list without locking; listen and unlisten
+	 * publish a modified copy and free the old one once no post is still reading it.
+	 */
+	struct Subscribers {
+		size_t count = 0;
+		EventQueue* queues[MaxSubscribers];
+	};
+	static std::atomic<const Subscribers*> subscribers[FacilityCount];
+	static std::atomic_uint32_t readers[FacilityCount];
+	static std::mutex mut; // Serializes listen/unlisten and slab setup
+
+	static void publish(size_t facility, const Subscribers* list);
+
+	static EventQueue* allQueues; // Every live EventQueue, linked through EventQueue::nextQueue, guarded by mut
+	static EventStats facilityStats[FacilityCount];
+	static portMUX_TYPE statsLock;
+
+	/**
+	 * Payloads are posted once and shared by all subscribers. Each payload block starts with a Header holding the number
+	 * of queued events still referencing it, and the free list link while the block is unused.
+	 */
+	struct alignas(8) Header {
+		std::atomic_uint32_t refs;
+		Header* next;
+	};
+
+	/** Fixed-size payload blocks per facility, allocated on the facility's first post and sized to its payload. */
+	struct Slab {
+		uint8_t* memory = nullptr;
+		size_t blockSize = 0;
+		size_t count = 0;
+		Header* freeList = nullptr;
+	};
+
+	static constexpr size_t SlabBlocks[FacilityCount] = { 32, 24, 16, 16, 8, 4, 4 }; // Input, Motion, Phone, Time, Battery, Sleep, Settings
+	static Slab slabs[FacilityCount];
+	static portMUX_TYPE slabLock;
+	static uint32_t fallbacks;
+
+	static void initSlab(Facility facility, size_t size);
+	/** Takes a block from the facility's slab, or from the heap if the slab is full. Nullptr if both are out. */
+	static Header* alloc(Facility facility, size_t size);
+	static Header* allocFromISR(Facility facility, size_t size);
+	static void release(const void* data);
+
+	friend Event;
+	friend EventQueue;
 
 };
 
+/**
+ * Events are queued in priority lanes by facility, and get() takes them from the most urgent lane that has any, so a
+ * button press doesn't wait behind a burst of notifications. Order is kept within a lane. Each lane holds count events
+ * and is only created once the queue listens to one of its facilities.
+ */
 class EventQueue {
 public:
-	EventQueue(size_t count);
+	EventQueue(size_t count, const char* name = "");
 	virtual ~EventQueue();
 
-	bool get(Event& item, TickType_t timeout);
-	void reset();
+	virtual bool get(Event& item, TickType_t timeout);
+	virtual void reset();
 
-private:
-	QueueHandle_t queue;
+	/** Ends a get() waiting on this queue, or the next one, without an event. It returns false as if it timed out. */
+	void wake();
+
+	EventStats getStats() const;
 
-	bool post(Facility facility, void* data);
+	enum class Lane : uint8_t {
+		High, Normal, Low, COUNT
+	};
+
+	static constexpr Lane laneOf(Facility facility){
+		switch(facility){
+			case Facility::Input:
+			case Facility::Sleep:
+				return Lane::High;
+			case Facility::Phone:
+			case Facility::Motion:
+				return Lane::Normal;
+			default:
+				return Lane::Low;
+		}
+	}
+
+protected:
+	struct Item {
+		Facility facility;
+		const void* data;
+		uint32_t postTime; // [us]
+	};
+
+	/** Takes the next item from the most urgent lane, without counting it as received */
+	bool receive(Item& item, TickType_t timeout);
+
+	/** Events waiting in all lanes */
+	UBaseType_t depth() const;
+
+	bool send(const Item& item);
+	void countPost(Facility facility, bool sent, UBaseType_t depth);
+	void received(const Item& item);
+
+	virtual bool post(Facility facility, const void* data);
+	virtual bool postFromISR(Facility facility, const void* data, BaseType_t* woken);
 	friend Events;
 
+private:
+	const size_t count;
+	QueueHandle_t lanes[(size_t) Lane::COUNT] = {};
+	SemaphoreHandle_t pending; // Counts the items in all lanes, given after each one is queued
+
+	/** Creates the lane of facility if it doesn't exist yet, called by Events::listen before it publishes the queue */
+	void addLane(Facility facility);
+
+	const char* name;
+	EventQueue* nextQueue = nullptr;
+	EventStats stats;
+
+};
+
+/**
+ * EventQueue that keeps only the latest event of state-like kinds, such as battery level or time updates.
+ * A coalesced event replaces the pending one of the same facility and action instead of taking another queue slot,
+ * so bursts of updates can't fill the queue and crowd out other events. It's received at the position of the first
+ * pending update in its lane, carrying the latest payload. Events posted from interrupts are queued normally.
+ */
+class CoalescingEventQueue : public EventQueue {
+public:
+	CoalescingEventQueue(size_t count, const char* name = "");
+	~CoalescingEventQueue() override;
+
+	/**
+	 * Coalesce events of facility whose payload T has the given action.
+	 * T must start with its action enum, as all event payloads do.
+	 */
+	template<typename T>
+	void coalesce(Facility facility, decltype(T::action) action){
+		static_assert(offsetof(T, action) == 0 && sizeof(T::action) == sizeof(int), "Event payload must start with its action");
+		addSlot(facility, (int) action);
+	}
+
+	bool get(Event& item, TickType_t timeout) override;
+	void reset() override;
+
+private:
+	static constexpr size_t MaxSlots = 4;
+
+	struct Slot {
+		Facility facility;
+		int action;
+		const void* data; // Latest payload, nullptr if nothing is pending
+		bool queued; // Slot marker is in the queue
+	};
+	Slot slots[MaxSlots];
+	size_t slotCount = 0;
+	portMUX_TYPE slotLock = portMUX_INITIALIZER_UNLOCKED;
+
+	void addSlot(Facility facility, int action);
+	Slot* findSlot(Facility facility, const void* data);
+	void clearSlots();
+
+	bool post(Facility facility, const void* data) override;
+
 };
 
 
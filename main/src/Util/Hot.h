@@ -0,0 +1,14 @@
+#ifndef CLOCKSTAR_FIRMWARE_HOT_H
+#define CLOCKSTAR_FIRMWARE_HOT_H
+
+#define CM_HOT_STR2(x) #x
+#define CM_HOT_STR(x) CM_HOT_STR2(x)
+
+/**
+ * Marks a function for the hot set, placed like IRAM_ATTR. With CONFIG_CM_IRAM_HOT_PATHS main/linker.lf maps these
+ * sections into IRAM, otherwise they stay in flash like any other code. Every function gets its own section, so unused
+ * ones are still garbage collected. Not for inline functions or templates, they can be emitted in several objects.
+ */
+#define CM_HOT __attribute__((section(".cm_hot." CM_HOT_STR(__COUNTER__))))
+
+#endif //CLOCKSTAR_FIRMWARE_HOT_H
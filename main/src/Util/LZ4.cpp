@@ -0,0 +1,53 @@
+#include "LZ4.h"
+#include <cstring>
+
+size_t LZ4::decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize){
+	const uint8_t* ip = src;
+	const uint8_t* const ipEnd = src + srcSize;
+	uint8_t* op = dst;
+	uint8_t* const opEnd = dst + dstSize;
+
+	auto readLength = [&ip, ipEnd](size_t len) -> size_t {
+		if(len != 15) return len;
+		uint8_t b;
+		do {
+			if(ip >= ipEnd) return SIZE_MAX;
+			b = *ip++;
+			len += b;
+		} while(b == 255);
+		return len;
+	};
+
+	while(ip < ipEnd){
+		const uint8_t token = *ip++;
+
+		const size_t literals = readLength(token >> 4);
+		if(literals > (size_t) (ipEnd - ip) || literals > (size_t) (opEnd - op)) return 0;
+		memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		if(ip >= ipEnd) break; // Last sequence only has literals
+
+		if(ipEnd - ip < 2) return 0;
+		const size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > (size_t) (op - dst)) return 0;
+
+		const size_t match = readLength(token & 0x0F);
+		if(match == SIZE_MAX || match + 4 > (size_t) (opEnd - op)) return 0;
+
+		const uint8_t* ref = op - offset;
+		if(offset >= match + 4){
+			memcpy(op, ref, match + 4);
+			op += match + 4;
+		}else{
+			// Overlapping copy repeats the last offset bytes
+			for(size_t i = 0; i < match + 4; i++){
+				*op++ = *ref++;
+			}
+		}
+	}
+
+	return op - dst;
+}
@@ -0,0 +1,18 @@
+#ifndef CLOCKSTAR_FIRMWARE_LZ4_H
+#define CLOCKSTAR_FIRMWARE_LZ4_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace LZ4 {
+
+/**
+ * Decodes a raw LZ4 block (no frame header), as written by tools/pack_assets.py.
+ * @return Number of bytes written to dst, 0 if the block is malformed or doesn't fit.
+ */
+size_t decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_LZ4_H
@@ -0,0 +1,237 @@
+#include "LoopGuard.h"
+#include "stdafx.h"
+#include "Trace.h"
+#include <esp_log.h>
+#include <esp_task_wdt.h>
+#include <sdkconfig.h>
+#include <cstdio>
+
+static const char* TAG = "LoopGuard";
+
+std::atomic<LoopGuard*> LoopGuard::guards[MaxGuards] = {};
+
+LoopGuard::LoopGuard(const char* name, uint32_t budget, bool watchdog) : name(name), budget(budget), watchdog(watchdog){
+	if(budget == 0) return;
+
+	const esp_timer_create_args_t args = {
+			.callback = hangCheck,
+			.arg = this,
+			.dispatch_method = ESP_TIMER_TASK,
+			.name = "LoopGuard",
+			.skip_unhandled_events = true
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&args, &hangTimer));
+}
+
+LoopGuard::~LoopGuard(){
+	for(auto& slot : guards){
+		LoopGuard* self = this;
+		slot.compare_exchange_strong(self, nullptr);
+	}
+
+	if(hangTimer){
+		esp_timer_stop(hangTimer);
+		esp_timer_delete(hangTimer);
+	}
+}
+
+void LoopGuard::begin(const char* phase){
+	if(budget == 0) return;
+
+	if(task == nullptr){
+		task = xTaskGetCurrentTaskHandle();
+		bool registered = false;
+		for(auto& slot : guards){
+			LoopGuard* empty = nullptr;
+			if(slot.compare_exchange_strong(empty, this)){
+				registered = true;
+				break;
+			}
+		}
+		if(!registered){
+			ESP_LOGW(TAG, "No free slot for %s, its spans aren't marked", name);
+		}
+	}
+
+	if(!subscribed && watchdog){
+		subscribe(true);
+	}
+#ifdef CONFIG_ESP_TASK_WDT_EN
+	if(subscribed){
+		esp_task_wdt_reset();
+	}
+#endif
+
+	const uint32_t now = millis();
+	iterStart.store(now, std::memory_order_relaxed);
+	phaseName = phase;
+	phaseStart = now;
+	longestPhase = longestSpan = nullptr;
+	longestPhaseTime = longestSpanTime = 0;
+	where.store(phase, std::memory_order_relaxed);
+	active.store(true, std::memory_order_release);
+
+	esp_timer_start_once(hangTimer, (uint64_t) budget * HangFactor * 1000);
+}
+
+void LoopGuard::phase(const char* name){
+	if(!active.load(std::memory_order_relaxed)) return;
+
+	closePhase(millis());
+	phaseName = name;
+	where.store(name, std::memory_order_relaxed);
+}
+
+void LoopGuard::end(){
+	if(!active.load(std::memory_order_relaxed)) return;
+
+	active.store(false, std::memory_order_release);
+	esp_timer_stop(hangTimer);
+
+	const uint32_t now = millis();
+	closePhase(now);
+	where.store(nullptr, std::memory_order_relaxed);
+
+	const uint32_t elapsed = now - iterStart.load(std::memory_order_relaxed);
+	stats.iterations++;
+	if(elapsed <= budget) return;
+
+	stats.stalls++;
+	if(elapsed > stats.worst){
+		stats.worst = elapsed;
+		stats.worstPhase = longestPhase;
+		stats.worstSpan = longestSpan;
+	}
+
+	TRACE_INSTANT("loop_stall");
+	if(longestSpan){
+		ESP_LOGW(TAG, "%s stalled for %lu ms, %lu ms in %s, longest span %s %lu ms", name, elapsed, longestPhaseTime, longestPhase,
+				 longestSpan, longestSpanTime);
+	}else{
+		ESP_LOGW(TAG, "%s stalled for %lu ms, %lu ms in %s", name, elapsed, longestPhaseTime, longestPhase);
+	}
+}
+
+void LoopGuard::detach(){
+	end();
+	subscribe(false);
+}
+
+void LoopGuard::closePhase(uint32_t now){
+	const uint32_t time = now - phaseStart;
+	if(time >= longestPhaseTime){
+		longestPhase = phaseName;
+		longestPhaseTime = time;
+	}
+	phaseStart = now;
+}
+
+void LoopGuard::subscribe(bool on){
+#ifdef CONFIG_ESP_TASK_WDT_EN
+	if(on == subscribed) return;
+
+	if(on){
+		subscribed = esp_task_wdt_add(nullptr) == ESP_OK;
+	}else{
+		esp_task_wdt_delete(nullptr);
+		subscribed = false;
+	}
+#endif
+}
+
+void LoopGuard::hangCheck(void* arg){
+	auto guard = static_cast<LoopGuard*>(arg);
+	if(!guard->active.load(std::memory_order_acquire)) return;
+
+	const char* where = guard->where.load(std::memory_order_relaxed);
+	const uint32_t elapsed = millis() - guard->iterStart.load(std::memory_order_relaxed);
+	guard->hangs++;
+	ESP_LOGE(TAG, "%s stuck for %lu ms in %s", guard->name, elapsed, where ? where : "?");
+}
+
+LoopGuard* LoopGuard::forCurrentTask(){
+	const auto current = xTaskGetCurrentTaskHandle();
+	for(auto& slot : guards){
+		auto guard = slot.load(std::memory_order_acquire);
+		if(guard && guard->task == current) return guard;
+	}
+	return nullptr;
+}
+
+LoopGuard::Span::Span(const char* name) : guard(forCurrentTask()), name(name){
+	if(guard == nullptr || !guard->active.load(std::memory_order_relaxed)){
+		guard = nullptr;
+		return;
+	}
+
+	outer = guard->where.exchange(name, std::memory_order_relaxed);
+	start = millis();
+}
+
+LoopGuard::Span::~Span(){
+	if(guard == nullptr) return;
+
+	const uint32_t time = millis() - start;
+	if(time >= guard->longestSpanTime){
+		guard->longestSpan = name;
+		guard->longestSpanTime = time;
+	}
+	guard->where.store(outer, std::memory_order_relaxed);
+}
+
+LoopGuard::Exempt::Exempt() : guard(forCurrentTask()), wasActive(false){
+	if(guard == nullptr) return;
+
+	wasActive = guard->active.exchange(false, std::memory_order_acq_rel);
+	if(wasActive){
+		esp_timer_stop(guard->hangTimer);
+	}
+	guard->subscribe(false);
+}
+
+LoopGuard::Exempt::~Exempt(){
+	if(guard == nullptr) return;
+
+	if(guard->watchdog){
+		guard->subscribe(true);
+	}
+	if(!wasActive) return;
+
+	// The time spent exempt doesn't count, the iteration goes on as if it started now
+	const uint32_t now = millis();
+	guard->iterStart.store(now, std::memory_order_relaxed);
+	guard->phaseStart = now;
+	guard->active.store(true, std::memory_order_release);
+	esp_timer_start_once(guard->hangTimer, (uint64_t) guard->budget * HangFactor * 1000);
+}
+
+LoopGuard::Stats LoopGuard::getStats() const{
+	Stats s = stats;
+	s.hangs = hangs.load(std::memory_order_relaxed);
+	return s;
+}
+
+void LoopGuard::resetStats(){
+	stats = {};
+	hangs = 0;
+}
+
+void LoopGuard::printReport(const std::function<void(const char* line)>& print) const{
+	char line[160];
+	const auto s = getStats();
+
+	if(budget == 0){
+		snprintf(line, sizeof(line), "Stalls  %s: guard off\n", name);
+		print(line);
+		return;
+	}
+
+	snprintf(line, sizeof(line), "Stalls  %s: %lu of %lu iterations over %lu ms, %lu stuck over %lu ms\n", name, s.stalls, s.iterations, budget,
+			 s.hangs, budget * HangFactor);
+	print(line);
+
+	if(s.stalls == 0) return;
+	snprintf(line, sizeof(line), "Stalls  %s: worst %lu ms, in %s%s%s\n", name, s.worst, s.worstPhase ? s.worstPhase : "?",
+			 s.worstSpan ? ", span " : "", s.worstSpan ? s.worstSpan : "");
+	print(line);
+}
@@ -0,0 +1,113 @@
+#ifndef CLOCKSTAR_FIRMWARE_LOOPGUARD_H
+#define CLOCKSTAR_FIRMWARE_LOOPGUARD_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+/**
+ * Soft watchdog for a task's loop. Iterations are bracketed by begin() and end() and split into named phases, code
+ * the loop calls into can mark its own spans. An iteration over the budget counts as a stall and is logged with the
+ * phase and the span it spent the longest in. One still running at HangFactor times the budget is reported from an
+ * esp_timer right away, with the phase or span it's stuck in, before the task watchdog prints its backtrace.
+ *
+ * Names must be string literals, only the pointer is kept. Not copyable, the guard is found by its task.
+ */
+class LoopGuard {
+public:
+	/**
+	 * @param budget [ms] per iteration, 0 turns the guard off
+	 * @param watchdog Subscribe the guarded task to the task watchdog on the first begin()
+	 */
+	LoopGuard(const char* name, uint32_t budget, bool watchdog);
+	virtual ~LoopGuard();
+
+	LoopGuard(const LoopGuard&) = delete;
+	LoopGuard& operator=(const LoopGuard&) = delete;
+
+	/** Called by the guarded task at the start of every iteration, which enters the phase */
+	void begin(const char* phase);
+	void phase(const char* name);
+	void end();
+
+	/** Unsubscribes the guarded task from the task watchdog. Call on that task before it exits. */
+	void detach();
+
+	/** Marks a span on the current task's guard. No-op on tasks without one, so shared code can mark freely. */
+	class Span {
+	public:
+		explicit Span(const char* name);
+		~Span();
+
+	private:
+		LoopGuard* guard;
+		const char* name;
+		const char* outer;
+		uint32_t start; // [ms]
+	};
+
+	/** Pauses the current task's guard and its watchdog subscription while the task blocks on purpose, e.g. in sleep. */
+	class Exempt {
+	public:
+		Exempt();
+		~Exempt();
+
+	private:
+		LoopGuard* guard;
+		bool wasActive;
+	};
+
+	struct Stats {
+		uint32_t iterations;
+		uint32_t stalls; // Iterations over the budget
+		uint32_t hangs; // Iterations reported while still running
+		uint32_t worst; // [ms]
+		const char* worstPhase;
+		const char* worstSpan; // nullptr if no span ran in the worst iteration
+	};
+	[[nodiscard]] Stats getStats() const;
+	void resetStats();
+	void printReport(const std::function<void(const char* line)>& print) const;
+
+private:
+	const char* name;
+	const uint32_t budget; // [ms]
+	const bool watchdog;
+
+	static constexpr uint32_t HangFactor = 10;
+
+	TaskHandle_t task = nullptr;
+	bool subscribed = false;
+	esp_timer_handle_t hangTimer = nullptr;
+
+	// Written by the guarded task, read by the hang timer
+	std::atomic_bool active = false;
+	std::atomic_uint32_t iterStart = 0; // [ms]
+	std::atomic<const char*> where = nullptr; // Innermost phase or span
+
+	// Guarded task only
+	const char* phaseName = nullptr;
+	uint32_t phaseStart = 0; // [ms]
+	const char* longestPhase = nullptr;
+	uint32_t longestPhaseTime = 0; // [ms]
+	const char* longestSpan = nullptr;
+	uint32_t longestSpanTime = 0; // [ms]
+
+	Stats stats = {};
+	std::atomic_uint32_t hangs = 0; // Counted by the hang timer
+
+	void closePhase(uint32_t now);
+	void subscribe(bool on);
+	static void hangCheck(void* arg);
+
+	static constexpr size_t MaxGuards = 2;
+	static std::atomic<LoopGuard*> guards[MaxGuards];
+	static LoopGuard* forCurrentTask();
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_LOOPGUARD_H
@@ -0,0 +1,20 @@
+#include "PSRAM.h"
+#include <esp_heap_caps.h>
+#include <sdkconfig.h>
+
+#ifdef CONFIG_CM_PSRAM
+#include <esp_psram.h>
+#endif
+
+bool PSRAM::available(){
+#ifdef CONFIG_CM_PSRAM
+	return esp_psram_is_initialized();
+#else
+	return false;
+#endif
+}
+
+size_t PSRAM::getFree(){
+	if(!available()) return 0;
+	return heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
@@ -0,0 +1,22 @@
+#ifndef CLOCKSTAR_FIRMWARE_PSRAM_H
+#define CLOCKSTAR_FIRMWARE_PSRAM_H
+
+#include <cstddef>
+
+/**
+ * External PSRAM on board revisions that have it. Builds with CONFIG_CM_PSRAM probe for it at boot and carry on
+ * without it if it isn't fitted (CONFIG_SPIRAM_IGNORE_NOTFOUND), so the same firmware runs on every revision and
+ * users of PSRAM check available() and fall back to internal RAM.
+ */
+class PSRAM {
+public:
+	/** PSRAM was found and initialized at boot. Always false without CONFIG_CM_PSRAM. */
+	static bool available();
+
+	/** [B] */
+	static size_t getFree();
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_PSRAM_H
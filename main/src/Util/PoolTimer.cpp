@@ -0,0 +1,41 @@
+#include "PoolTimer.h"
+#include <esp_log.h>
+
+static const char* TAG = "PoolTimer";
+
+PoolTimer::PoolTimer(uint32_t period, TimerCallback callback, void* dataPtr) : period(period), callback(callback), dataPtr(dataPtr){}
+
+PoolTimer::~PoolTimer(){
+	stop();
+}
+
+void PoolTimer::start(){
+	if(running) return;
+	running = true;
+	TaskPool::get().scheduleAligned(this, pdMS_TO_TICKS(period));
+}
+
+void PoolTimer::stop(){
+	if(!running) return;
+	running = false;
+	TaskPool::get().cancel(this);
+}
+
+void PoolTimer::reset(){
+	if(!running) return;
+	TaskPool::get().scheduleAligned(this, pdMS_TO_TICKS(period));
+}
+
+void PoolTimer::setPeriod(uint32_t period){
+	if(running){
+		ESP_LOGE(TAG, "setPeriod called while timer is running");
+		return;
+	}
+
+	this->period = period;
+}
+
+void PoolTimer::run(){
+	if(!running.exchange(false)) return;
+	callback(dataPtr);
+}
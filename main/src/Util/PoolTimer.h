@@ -0,0 +1,40 @@
+#ifndef CLOCKSTAR_FIRMWARE_POOLTIMER_H
+#define CLOCKSTAR_FIRMWARE_POOLTIMER_H
+
+#include "TaskPool.h"
+#include <atomic>
+
+/**
+ * One-shot timer with the same interface as Timer, fired by the TaskPool on a tick aligned to its period instead of from
+ * an esp_timer interrupt. Lets sampling timers share wakeups with the other periodic services.
+ */
+class PoolTimer : private TaskPool::Job {
+	typedef void (*TimerCallback)(void* arg);
+
+public:
+	/**
+	 * @param period - Time until the callback is called [ms]
+	 * @param callback - Called from a TaskPool worker, must not block
+	 * @param dataPtr - data pointer passed to the callback, optional
+	 */
+	PoolTimer(uint32_t period, TimerCallback callback, void* dataPtr = nullptr);
+	virtual ~PoolTimer();
+
+	void start();
+	void stop();
+	void reset();
+	void setPeriod(uint32_t period);
+
+private:
+	uint32_t period;
+	const TimerCallback callback;
+	void* dataPtr;
+
+	std::atomic_bool running = false;
+
+	void run() override;
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_POOLTIMER_H
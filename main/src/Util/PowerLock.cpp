@@ -0,0 +1,79 @@
+#include "PowerLock.h"
+#include <esp_log.h>
+
+static const char* TAG = "PowerLock";
+
+std::mutex PowerLock::mut;
+uint8_t PowerLock::holders[(size_t) PowerProfile::COUNT] = {};
+bool PowerLock::lightSleep = false;
+PowerProfile PowerLock::applied = PowerProfile::COUNT;
+bool PowerLock::appliedSleep = false;
+
+PowerLock::PowerLock(PowerProfile profile, const char* name) : profile(profile), lock(ESP_PM_CPU_FREQ_MAX, name){
+
+}
+
+PowerLock::~PowerLock(){
+	release();
+}
+
+void PowerLock::acquire(){
+	std::lock_guard guard(mut);
+	if(locked) return;
+	locked = true;
+
+	// Raise the ceiling first, so the CPU lock doesn't briefly run at the old one
+	holders[(size_t) profile]++;
+	apply();
+
+	if(profile != PowerProfile::Idle){
+		lock.acquire();
+	}
+}
+
+void PowerLock::release(){
+	std::lock_guard guard(mut);
+	if(!locked) return;
+	locked = false;
+
+	lock.release();
+	holders[(size_t) profile]--;
+	apply();
+}
+
+bool PowerLock::isLocked() const{
+	return locked;
+}
+
+PowerProfile PowerLock::getProfile(){
+	std::lock_guard guard(mut);
+	return applied == PowerProfile::COUNT ? PowerProfile::Idle : applied;
+}
+
+void PowerLock::setLightSleep(bool enable){
+	std::lock_guard guard(mut);
+	lightSleep = enable;
+	apply();
+}
+
+void PowerLock::apply(){
+	auto top = PowerProfile::Idle;
+	for(size_t i = 0; i < (size_t) PowerProfile::COUNT; i++){
+		if(holders[i] > 0){
+			top = (PowerProfile) i;
+		}
+	}
+
+	if(top == applied && lightSleep == appliedSleep) return;
+	applied = top;
+	appliedSleep = lightSleep;
+
+	esp_pm_config_t config = {
+			.max_freq_mhz = Frequencies[(size_t) top],
+			.min_freq_mhz = Frequencies[(size_t) PowerProfile::Idle],
+			.light_sleep_enable = lightSleep
+	};
+	if(esp_pm_configure(&config) != ESP_OK){
+		ESP_LOGE(TAG, "esp_pm_configure failed for %d MHz", config.max_freq_mhz);
+	}
+}
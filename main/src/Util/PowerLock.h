@@ -0,0 +1,56 @@
+#ifndef CLOCKSTAR_FIRMWARE_POWERLOCK_H
+#define CLOCKSTAR_FIRMWARE_POWERLOCK_H
+
+
+#include <mutex>
+#include "SleepLock.h"
+
+/**
+ * CPU frequency presets. Idle is what the CPU drops to when nobody holds a PowerLock.
+ */
+enum class PowerProfile : uint8_t {
+	Idle, Normal, Performance, COUNT
+};
+
+/**
+ * Requests a power profile from esp_pm. The CPU runs at the highest profile held by any PowerLock and drops to Idle
+ * once none are held. APB is at 80 MHz in every profile, so peripheral clocks don't change between them.
+ * Every PowerLock is a SleepLock of its own, its held time shows up in SleepLock::printReport under its name.
+ * Unlike SleepLock, acquire and release take a mutex and can't be called from an ISR.
+ */
+class PowerLock {
+public:
+	PowerLock(PowerProfile profile, const char* name);
+	virtual ~PowerLock();
+
+	void acquire();
+	void release();
+
+	[[nodiscard]] bool isLocked() const;
+
+	/** Highest profile currently held, Idle if none */
+	static PowerProfile getProfile();
+
+	/** Enables automatic light sleep, for while nothing holds an APB or CPU lock. */
+	static void setLightSleep(bool enable);
+
+	static constexpr int Frequencies[(size_t) PowerProfile::COUNT] = { 80, 160, 240 }; //[MHz]
+
+private:
+	const PowerProfile profile;
+	SleepLock lock;
+	bool locked = false;
+
+	static std::mutex mut;
+	static uint8_t holders[(size_t) PowerProfile::COUNT];
+	static bool lightSleep;
+	static PowerProfile applied; // COUNT until the first apply
+	static bool appliedSleep;
+
+	/** Reconfigures esp_pm for the highest profile held, called with mut locked. */
+	static void apply();
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_POWERLOCK_H
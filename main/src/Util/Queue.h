@@ -6,6 +6,7 @@
 #include <freertos/portmacro.h>
 #include <freertos/queue.h>
 #include <memory>
+#include <functional>
 
 template<typename T>
 class Queue {
@@ -71,4 +72,82 @@ private:
 
 };
 
+/**
+ * PtrQueue over a fixed set of preallocated objects. Producers acquire() a free slot, fill it and post() it, and the
+ * returned Ptr hands the slot back to the pool when it's destroyed, so steady-state traffic makes no heap allocations.
+ */
+template<typename T>
+class PooledPtrQueue {
+public:
+	struct Deleter {
+		PooledPtrQueue* pool = nullptr;
+		void operator()(T* ptr) const{ pool->recycle(ptr); }
+	};
+	using Ptr = std::unique_ptr<T, Deleter>;
+
+	/**
+	 * @param count Number of slots, which is also the queue length
+	 * @param init Called once for each slot, e.g. to reserve buffer capacity
+	 */
+	PooledPtrQueue(size_t count, const std::function<void(T&)>& init = {}) : size(count), slots(new T[count]){
+		queue = xQueueCreate(count, sizeof(T*));
+		freeQueue = xQueueCreate(count, sizeof(T*));
+
+		for(size_t i = 0; i < count; i++){
+			if(init){
+				init(slots[i]);
+			}
+
+			T* ptr = &slots[i];
+			xQueueSend(freeQueue, &ptr, 0);
+		}
+	}
+
+	virtual ~PooledPtrQueue(){
+		vQueueDelete(queue);
+		vQueueDelete(freeQueue);
+	}
+
+	/** Takes a free slot. Returns nullptr if all slots are queued or held by receivers. */
+	Ptr acquire(TickType_t timeout = 0){
+		T* ptr;
+		if(xQueueReceive(freeQueue, &ptr, timeout) != pdTRUE) return Ptr(nullptr, Deleter{ this });
+		return Ptr(ptr, Deleter{ this });
+	}
+
+	Ptr get(TickType_t timeout = portMAX_DELAY){
+		T* ptr;
+		if(xQueueReceive(queue, &ptr, timeout) != pdTRUE) return Ptr(nullptr, Deleter{ this });
+		return Ptr(ptr, Deleter{ this });
+	}
+
+	Ptr post(Ptr item, TickType_t timeout = portMAX_DELAY){
+		T* ptr = item.release();
+		if(xQueueSend(queue, &ptr, timeout) == pdTRUE){
+			ptr = nullptr;
+		}
+		return Ptr(ptr, Deleter{ this });
+	}
+
+	void reset(){
+		T* ptr;
+		while(xQueueReceive(queue, &ptr, 0) == pdTRUE){
+			recycle(ptr);
+		}
+	}
+
+	const size_t size;
+
+private:
+	QueueHandle_t queue;
+	QueueHandle_t freeQueue;
+	std::unique_ptr<T[]> slots;
+
+	void recycle(T* ptr){
+		if(ptr == nullptr) return;
+		xQueueSend(freeQueue, &ptr, 0);
+	}
+
+};
+
 #endif //CLOCKSTAR_FIRMWARE_QUEUE_H
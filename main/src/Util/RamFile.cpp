@@ -2,10 +2,17 @@
 #include <string.h>
 #include <esp_log.h>
 #include <esp_heap_caps.h>
+#include "LZ4.h"
+#include "AsyncCopy.h"
 
 static const char* TAG = "RamFile";
 
-RamFile::RamFile(const char* path, bool use32bAligned) : filePath(path){
+uint32_t RamFile::allocCaps(bool use32bAligned, bool external){
+	if(use32bAligned) return MALLOC_CAP_INTERNAL | MALLOC_CAP_32BIT;
+	return (external ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) | MALLOC_CAP_8BIT;
+}
+
+RamFile::RamFile(const char* path, bool use32bAligned, bool external) : filePath(path){
 	auto file = fopen(path, "rb");
 	if(file == nullptr){
 		ESP_LOGE(TAG, "Couldn't open file: %s", path);
@@ -29,11 +36,11 @@ RamFile::RamFile(const char* path, bool use32bAligned) : filePath(path){
 		}
 	}
 
-	data = (uint8_t*) heap_caps_malloc(allocSize, MALLOC_CAP_INTERNAL | (use32bAligned ? MALLOC_CAP_32BIT : MALLOC_CAP_8BIT));
+	const auto caps = allocCaps(use32bAligned, external);
+	data = (uint8_t*) heap_caps_malloc(allocSize, caps);
 	if(data == nullptr){
 		fileSize = 0;
-		ESP_LOGE(TAG, "Couldn't allocate memory for %s. Need %zu B, largest block: %zu B", path, allocSize,
-				 heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | (use32bAligned ? MALLOC_CAP_32BIT : MALLOC_CAP_8BIT)));
+		ESP_LOGE(TAG, "Couldn't allocate memory for %s. Need %zu B, largest block: %zu B", path, allocSize, heap_caps_get_largest_free_block(caps));
 		fclose(file);
 		return;
 	}
@@ -42,7 +49,35 @@ RamFile::RamFile(const char* path, bool use32bAligned) : filePath(path){
 	fclose(file);
 }
 
+RamFile::RamFile(const char* path, const uint8_t* mapped, size_t size) : data((uint8_t*) mapped), filePath(path), fileSize(size), owned(false){
+
+}
+
+RamFile::RamFile(const char* path, const uint8_t* lz4, size_t lz4Size, size_t size, bool use32bAligned, bool external) : filePath(path){
+	size_t allocSize = size;
+	if(use32bAligned && size % 4 != 0){
+		allocSize += 4 - (size % 4);
+	}
+
+	const auto caps = allocCaps(use32bAligned, external);
+	data = (uint8_t*) heap_caps_malloc(allocSize, caps);
+	if(data == nullptr){
+		ESP_LOGE(TAG, "Couldn't allocate memory for %s. Need %zu B, largest block: %zu B", path, allocSize, heap_caps_get_largest_free_block(caps));
+		return;
+	}
+
+	if(LZ4::decompress(lz4, lz4Size, data, size) != size){
+		ESP_LOGE(TAG, "Corrupt compressed file: %s", path);
+		free(data);
+		data = nullptr;
+		return;
+	}
+
+	fileSize = size;
+}
+
 RamFile::~RamFile(){
+	if(!owned) return;
 	free(data);
 }
 
@@ -57,6 +92,19 @@ size_t IRAM_ATTR RamFile::read(void* dest, size_t len){
 	return len;
 }
 
+size_t RamFile::readAsync(void* dest, size_t len, SemaphoreHandle_t done){
+	len = cursor < fileSize ? std::min(len, fileSize - cursor) : 0;
+	if(len == 0){
+		xSemaphoreGive(done);
+		return 0;
+	}
+
+	AsyncCopy::copy(dest, data + cursor, len, done);
+	cursor += len;
+
+	return len;
+}
+
 void RamFile::seek(size_t pos, int whence){
 	if(whence == SEEK_SET){
 		cursor = pos;
@@ -75,6 +123,10 @@ size_t RamFile::size(){
 	return fileSize;
 }
 
-std::string RamFile::path(){
+const std::string& RamFile::path() const{
 	return filePath;
 }
+
+const uint8_t* RamFile::buffer() const{
+	return data;
+}
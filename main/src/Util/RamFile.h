@@ -5,24 +5,50 @@
 #include <vector>
 #include <cstddef>
 #include <string>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 class RamFile {
 public:
-	RamFile(const char* path, bool use32bAligned = false);
+	/**
+	 * Loads a file into RAM.
+	 * @param external Place it in PSRAM instead of internal RAM, see PSRAM. Ignored with use32bAligned.
+	 */
+	RamFile(const char* path, bool use32bAligned = false, bool external = false);
+
+	/** Wraps already mapped file contents (e.g. from an AssetBundle) without copying. The data isn't owned. */
+	RamFile(const char* path, const uint8_t* mapped, size_t size);
+
+	/** Decompresses an LZ4 block into RAM. */
+	RamFile(const char* path, const uint8_t* lz4, size_t lz4Size, size_t size, bool use32bAligned = false, bool external = false);
 	virtual ~RamFile();
 
 	size_t read(void* dest, size_t len);
+
+	/**
+	 * Like read(), but large reads from RAM are copied by the DMA with AsyncCopy. The cursor moves at once, dest and
+	 * the file must stay valid until done is given.
+	 * @param done Binary semaphore, given once dest is filled, right away if nothing is read
+	 * @return Bytes being read
+	 */
+	size_t readAsync(void* dest, size_t len, SemaphoreHandle_t done);
 	void seek(size_t pos, int whence = SEEK_SET);
 	size_t pos();
 
 	size_t size();
-	std::string path();
+	const std::string& path() const;
+
+	/** Direct access to the file contents, nullptr if loading failed. */
+	const uint8_t* buffer() const;
 
 private:
 	uint8_t* data = nullptr;
 	size_t cursor = 0;
 	std::string filePath;
 	size_t fileSize = 0;
+	bool owned = true;
+
+	static uint32_t allocCaps(bool use32bAligned, bool external);
 
 };
 
@@ -0,0 +1,121 @@
+#include "ReadAheadFile.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+#include <esp_heap_caps.h>
+
+ReadAheadFile::ReadAheadFile(FILE* file, size_t bufferSize) : file(file), bufferSize(bufferSize){
+	if(file == nullptr) return;
+
+	struct stat st;
+	if(fstat(fileno(file), &st) == 0){
+		fileSize = st.st_size;
+	}
+
+	if(bufferSize == 0) return;
+
+	// stdio's own buffer would only add a copy
+	setvbuf(file, nullptr, _IONBF, 0);
+	buffer = (uint8_t*) heap_caps_malloc(bufferSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+ReadAheadFile::~ReadAheadFile(){
+	free(buffer);
+	if(file) fclose(file);
+}
+
+bool ReadAheadFile::syncFilePos(size_t offset){
+	if(filePos == offset) return true;
+
+	syscalls++;
+	if(fseek(file, offset, SEEK_SET) != 0) return false;
+	filePos = offset;
+	return true;
+}
+
+size_t ReadAheadFile::read(void* dest, size_t len){
+	if(file == nullptr) return 0;
+	reads++;
+
+	auto out = (uint8_t*) dest;
+	size_t total = 0;
+
+	while(len > 0){
+		if(pos >= bufferStart && pos < bufferStart + bufferLen){
+			const size_t count = std::min(len, bufferStart + bufferLen - pos);
+			memcpy(out, buffer + (pos - bufferStart), count);
+			out += count;
+			pos += count;
+			total += count;
+			len -= count;
+			continue;
+		}
+
+		if(buffer == nullptr || len >= bufferSize){
+			if(!syncFilePos(pos)) break;
+
+			syscalls++;
+			const size_t count = fread(out, 1, len, file);
+			filePos += count;
+			pos += count;
+			total += count;
+			break;
+		}
+
+		const size_t start = pos - (pos % bufferSize);
+		if(!syncFilePos(start)) break;
+
+		syscalls++;
+		bufferStart = start;
+		bufferLen = fread(buffer, 1, bufferSize, file);
+		filePos += bufferLen;
+
+		if(pos >= bufferStart + bufferLen) break; // EOF
+	}
+
+	return total;
+}
+
+size_t ReadAheadFile::write(const void* src, size_t len){
+	if(file == nullptr || !syncFilePos(pos)) return 0;
+
+	syscalls++;
+	const size_t count = fwrite(src, 1, len, file);
+	filePos += count;
+	pos += count;
+	fileSize = std::max(fileSize, pos);
+	bufferLen = 0;
+
+	return count;
+}
+
+bool ReadAheadFile::seek(long offset, int whence){
+	long target;
+	if(whence == SEEK_CUR){
+		target = (long) pos + offset;
+	}else if(whence == SEEK_END){
+		target = (long) fileSize + offset;
+	}else{
+		target = offset;
+	}
+
+	if(target < 0) return false;
+	pos = target;
+	return true;
+}
+
+size_t ReadAheadFile::tell() const{
+	return pos;
+}
+
+bool ReadAheadFile::error() const{
+	return file == nullptr || ferror(file);
+}
+
+uint32_t ReadAheadFile::getReads() const{
+	return reads;
+}
+
+uint32_t ReadAheadFile::getSyscalls() const{
+	return syscalls;
+}
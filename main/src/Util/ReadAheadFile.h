@@ -0,0 +1,51 @@
+#ifndef CLOCKSTAR_FIRMWARE_READAHEADFILE_H
+#define CLOCKSTAR_FIRMWARE_READAHEADFILE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * stdio file with a read-ahead buffer. Buffer refills are aligned to the buffer size, so with a 4 kB buffer
+ * every refill reads exactly one flash sector. Reads at least as big as the buffer go straight to the file.
+ */
+class ReadAheadFile {
+public:
+	/**
+	 * Takes ownership of the file and closes it when destroyed.
+	 * @param bufferSize [B] 0 passes every call through to stdio
+	 */
+	ReadAheadFile(FILE* file, size_t bufferSize);
+	virtual ~ReadAheadFile();
+
+	size_t read(void* dest, size_t len);
+	size_t write(const void* src, size_t len);
+	bool seek(long offset, int whence);
+	size_t tell() const;
+
+	bool error() const;
+
+	/** Number of read() calls and of stdio calls they needed. */
+	uint32_t getReads() const;
+	uint32_t getSyscalls() const;
+
+private:
+	FILE* file;
+	uint8_t* buffer = nullptr;
+	const size_t bufferSize;
+
+	size_t bufferStart = 0; // file offset of buffer[0]
+	size_t bufferLen = 0;
+	size_t pos = 0;
+	size_t filePos = 0; // where the stdio cursor actually is
+	size_t fileSize = 0;
+
+	uint32_t reads = 0;
+	uint32_t syscalls = 0;
+
+	bool syncFilePos(size_t offset);
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_READAHEADFILE_H
@@ -1,12 +1,54 @@
 #include "Services.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char* TAG = "Services";
 
 ServiceLocator Services;
 
-void ServiceLocator::set(Service service, void* ptr){
-	services[service] = ptr;
+void* ServiceLocator::create(size_t index){
+	std::lock_guard lock(mut);
+
+	// Constructed by another task while this one waited for the lock
+	void* ptr = services[index].load(std::memory_order_acquire);
+	if(ptr != nullptr) return ptr;
+
+	auto& provider = providers[index];
+	if(!provider.create) return nullptr;
+
+	const auto start = esp_timer_get_time();
+	ptr = provider.create();
+	services[index].store(ptr, std::memory_order_release);
+	ESP_LOGI(TAG, "Service %zu constructed on first use in %lld us", index, esp_timer_get_time() - start);
+
+	return ptr;
 }
 
-void* ServiceLocator::get(Service service){
-	if(!services.count(service)) return nullptr;
-	return services[service];
+void* ServiceLocator::hold(size_t index){
+	std::lock_guard lock(mut);
+
+	void* ptr = services[index].load(std::memory_order_acquire);
+	if(ptr == nullptr){
+		ptr = create(index);
+	}
+
+	if(ptr != nullptr){
+		providers[index].holds++;
+	}
+
+	return ptr;
+}
+
+void ServiceLocator::drop(size_t index){
+	std::lock_guard lock(mut);
+
+	auto& provider = providers[index];
+	if(provider.holds == 0 || --provider.holds > 0) return;
+	if(!provider.destroy) return;
+
+	void* ptr = services[index].exchange(nullptr, std::memory_order_acq_rel);
+	if(ptr == nullptr) return;
+
+	provider.destroy(ptr);
+	ESP_LOGI(TAG, "Service %zu torn down, no holds left", index);
 }
@@ -1,21 +1,156 @@
 #ifndef CLOCKSTAR_FIRMWARE_SERVICES_H
 #define CLOCKSTAR_FIRMWARE_SERVICES_H
 
-#include <unordered_map>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
 
-enum class Service { IMU, Phone, Time, Audio, Settings, Sleep, Battery, Backlight, Status, Input, Display };
+enum class Service { IMU, Phone, Time, Audio, Settings, Sleep, Battery, Backlight, Status, Input, Display, TaskMonitor, IMUStream, Orientation, IMUCalibrator, Activity, Gestures, PowerTelemetry, I2C, HeapMonitor, RTCTelemetry, DataLog, Actigraphy, Console, COUNT };
 
+/** Type registered under each Service, see ServiceLocator::get */
+template<Service S>
+struct ServiceType;
+
+#define CM_SERVICE_TYPE(service, T) class T; template<> struct ServiceType<Service::service> { using type = T; };
+CM_SERVICE_TYPE(IMU, IMU)
+CM_SERVICE_TYPE(Phone, Phone)
+CM_SERVICE_TYPE(Time, Time)
+CM_SERVICE_TYPE(Audio, ChirpSystem)
+CM_SERVICE_TYPE(Settings, Settings)
+CM_SERVICE_TYPE(Sleep, SleepMan)
+CM_SERVICE_TYPE(Battery, Battery)
+CM_SERVICE_TYPE(Backlight, BacklightBrightness)
+CM_SERVICE_TYPE(Status, StatusCenter)
+CM_SERVICE_TYPE(Input, Input)
+CM_SERVICE_TYPE(Display, Display)
+CM_SERVICE_TYPE(TaskMonitor, TaskMonitor)
+CM_SERVICE_TYPE(IMUStream, IMUStream)
+CM_SERVICE_TYPE(Orientation, Orientation)
+CM_SERVICE_TYPE(IMUCalibrator, IMUCalibrator)
+CM_SERVICE_TYPE(Activity, Activity)
+CM_SERVICE_TYPE(Gestures, Gestures)
+CM_SERVICE_TYPE(PowerTelemetry, PowerTelemetry)
+CM_SERVICE_TYPE(I2C, I2C)
+CM_SERVICE_TYPE(HeapMonitor, HeapMonitor)
+CM_SERVICE_TYPE(RTCTelemetry, RTCTelemetry)
+CM_SERVICE_TYPE(DataLog, DataLog)
+CM_SERVICE_TYPE(Actigraphy, Actigraphy)
+CM_SERVICE_TYPE(Console, Console)
+#undef CM_SERVICE_TYPE
+
+/**
+ * Services are set during init, possibly while tasks started earlier already look others up, so slots are atomic.
+ * The slot index and the type are both fixed by the Service, so a lookup is a single load and a service can only be
+ * set to, and read as, the type in its ServiceType. Callers need the full class only to use the pointer.
+ *
+ * Services only some screens use can be provided as a factory instead, and are constructed by the first lookup.
+ * Given a destroy function too, they're torn down again once the last ServiceHold on them goes away.
+ */
 class ServiceLocator {
 public:
-	void set(Service service, void* ptr);
-	void* get(Service service);
+	template<Service S>
+	void set(typename ServiceType<S>::type* ptr){
+		static_assert(S != Service::COUNT);
+		services[(size_t) S].store(ptr, std::memory_order_release);
+	}
+
+	/**
+	 * Registers a factory in place of an instance. It runs on the task of the first get() or hold(), under the
+	 * locator's lock, and may look up other services itself.
+	 * @param destroy Called with the instance when the last hold is dropped, empty to keep it once constructed.
+	 * A service provided with one must only be used through ServiceHold, a bare get() pointer would dangle.
+	 */
+	template<Service S>
+	void provide(std::function<typename ServiceType<S>::type*()> create,
+				 std::function<void(typename ServiceType<S>::type*)> destroy = {}){
+		static_assert(S != Service::COUNT);
+		using T = typename ServiceType<S>::type;
+
+		std::lock_guard lock(mut);
+		auto& provider = providers[(size_t) S];
+		provider.create = [create = std::move(create)](){ return (void*) create(); };
+		if(destroy){
+			provider.destroy = [destroy = std::move(destroy)](void* ptr){ destroy(static_cast<T*>(ptr)); };
+		}else{
+			provider.destroy = {};
+		}
+	}
+
+	/** Constructs provided services on first use, nullptr until the service is set otherwise */
+	template<Service S>
+	[[nodiscard]] typename ServiceType<S>::type* get(){
+		static_assert(S != Service::COUNT);
+		void* ptr = services[(size_t) S].load(std::memory_order_acquire);
+		if(ptr == nullptr){
+			ptr = create((size_t) S);
+		}
+		return static_cast<typename ServiceType<S>::type*>(ptr);
+	}
+
+	/** Like get(), and keeps the service alive until the matching drop(). ServiceHold pairs the two. */
+	template<Service S>
+	[[nodiscard]] typename ServiceType<S>::type* hold(){
+		static_assert(S != Service::COUNT);
+		return static_cast<typename ServiceType<S>::type*>(hold((size_t) S));
+	}
+
+	template<Service S>
+	void drop(){
+		static_assert(S != Service::COUNT);
+		drop((size_t) S);
+	}
 
 private:
-	std::unordered_map<Service, void*> services;
+	std::atomic<void*> services[(size_t) Service::COUNT] = {};
+
+	struct Provider {
+		std::function<void*()> create;
+		std::function<void(void*)> destroy;
+		uint32_t holds = 0;
+	};
+	Provider providers[(size_t) Service::COUNT];
 
+	// Recursive since factories and destroy functions hold and drop the services they depend on
+	std::recursive_mutex mut;
+
+	void* create(size_t index);
+	void* hold(size_t index);
+	void drop(size_t index);
 
 };
 
 extern ServiceLocator Services;
 
+/**
+ * Declares a dependency on a service for the lifetime of the owner, typically a screen member. Constructs the
+ * service if it's provided lazily and lets it be torn down once no holds are left.
+ */
+template<Service S>
+class ServiceHold {
+public:
+	using T = typename ServiceType<S>::type;
+
+	ServiceHold() : ptr(Services.hold<S>()){}
+
+	~ServiceHold(){
+		if(ptr){
+			Services.drop<S>();
+		}
+	}
+
+	ServiceHold(const ServiceHold&) = delete;
+	ServiceHold& operator=(const ServiceHold&) = delete;
+
+	[[nodiscard]] T* get() const{ return ptr; }
+	T* operator->() const{ return ptr; }
+	T& operator*() const{ return *ptr; }
+	explicit operator bool() const{ return ptr != nullptr; }
+
+private:
+	T* const ptr;
+
+};
+
 #endif //CLOCKSTAR_FIRMWARE_SERVICES_H
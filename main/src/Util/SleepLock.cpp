@@ -1,24 +1,115 @@
 #include "SleepLock.h"
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <cstdio>
+#include <algorithm>
+#include <iterator>
 
-SleepLock::SleepLock(esp_pm_lock_type_t type){
-	ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "Lock", &lockHndl));
+SleepLock* SleepLock::locks[MaxLocks] = {};
+uint64_t SleepLock::statsStart = 0;
+
+static portMUX_TYPE registryMux = portMUX_INITIALIZER_UNLOCKED;
+
+SleepLock::SleepLock(esp_pm_lock_type_t type, const char* name) : name(name){
+	ESP_ERROR_CHECK(esp_pm_lock_create(type, 0, name, &lockHndl));
+
+	portENTER_CRITICAL(&registryMux);
+	for(auto& lock : locks){
+		if(lock != nullptr) continue;
+		lock = this;
+		break;
+	}
+	portEXIT_CRITICAL(&registryMux);
 }
 
 SleepLock::~SleepLock(){
+	portENTER_CRITICAL(&registryMux);
+	for(auto& lock : locks){
+		if(lock != this) continue;
+		lock = nullptr;
+		break;
+	}
+	portEXIT_CRITICAL(&registryMux);
+
 	if(locked){
 		esp_pm_lock_release(lockHndl);
 	}
 	esp_pm_lock_delete(lockHndl);
 }
 
-void SleepLock::acquire(){
-	if(locked) return;
-	locked = true;
-	esp_pm_lock_acquire(lockHndl);
+void IRAM_ATTR SleepLock::acquire(){
+	portENTER_CRITICAL_SAFE(&mux);
+	if(!locked){
+		locked = true;
+		lockTime = esp_timer_get_time();
+		acquisitions = acquisitions + 1;
+		esp_pm_lock_acquire(lockHndl);
+	}
+	portEXIT_CRITICAL_SAFE(&mux);
+}
+
+void IRAM_ATTR SleepLock::release(){
+	portENTER_CRITICAL_SAFE(&mux);
+	if(locked){
+		locked = false;
+		heldTime = heldTime + (esp_timer_get_time() - lockTime);
+		esp_pm_lock_release(lockHndl);
+	}
+	portEXIT_CRITICAL_SAFE(&mux);
+}
+
+bool SleepLock::isLocked() const{
+	return locked;
 }
 
-void SleepLock::release(){
-	if(!locked) return;
-	locked = false;
-	esp_pm_lock_release(lockHndl);
+uint64_t SleepLock::getHeldTime() const{
+	portENTER_CRITICAL(&mux);
+	uint64_t time = heldTime;
+	if(locked){
+		time += esp_timer_get_time() - lockTime;
+	}
+	portEXIT_CRITICAL(&mux);
+	return time;
+}
+
+void SleepLock::printReport(const std::function<void(const char* line)>& print){
+	char line[96];
+	const uint64_t elapsed = esp_timer_get_time() - statsStart;
+
+	snprintf(line, sizeof(line), "Sleep locks over the last %llu s:\n", elapsed / 1000000);
+	print(line);
+
+	SleepLock* copy[MaxLocks];
+	portENTER_CRITICAL(&registryMux);
+	std::copy(std::begin(locks), std::end(locks), copy);
+	portEXIT_CRITICAL(&registryMux);
+
+	for(auto lock : copy){
+		if(lock == nullptr) continue;
+
+		const uint64_t held = lock->getHeldTime();
+		snprintf(line, sizeof(line), "%-16s held %8llu ms  %3u %%  %6lu times%s\n", lock->name, held / 1000,
+				 elapsed ? (unsigned) (held * 100 / elapsed) : 0, lock->acquisitions, lock->locked ? "  [held]" : "");
+		print(line);
+	}
+}
+
+void SleepLock::resetStats(){
+	const uint64_t now = esp_timer_get_time();
+
+	portENTER_CRITICAL(&registryMux);
+	for(auto lock : locks){
+		if(lock == nullptr) continue;
+		portENTER_CRITICAL(&lock->mux);
+		lock->heldTime = 0;
+		lock->acquisitions = 0;
+		if(lock->locked){
+			lock->lockTime = now;
+		}
+		portEXIT_CRITICAL(&lock->mux);
+	}
+	portEXIT_CRITICAL(&registryMux);
+
+	statsStart = now;
 }
@@ -3,18 +3,47 @@
 
 
 #include <esp_pm.h>
-
+#include <freertos/FreeRTOS.h>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+/**
+ * Power management lock. Every lock keeps track of how long it was held, printReport lists them by name so it's
+ * visible which component keeps the chip from light sleeping.
+ * acquire and release are in IRAM and can be called from an ISR. Both take the lock's spinlock, so one lock can be shared
+ * by a task and an ISR, e.g. ChirpSystem's, which the sweep ISR takes and the audio task releases.
+ */
 class SleepLock {
 public:
-	SleepLock(esp_pm_lock_type_t type);
+	SleepLock(esp_pm_lock_type_t type, const char* name = "Lock");
 	virtual ~SleepLock();
 
 	void acquire();
 	void release();
 
+	[[nodiscard]] bool isLocked() const;
+
+	/** Time held since the last reset, including the ongoing hold [us] */
+	[[nodiscard]] uint64_t getHeldTime() const;
+
+	static void printReport(const std::function<void(const char* line)>& print);
+	static void resetStats();
+
+	static constexpr size_t MaxLocks = 16;
+
 private:
 	esp_pm_lock_handle_t lockHndl;
-	bool locked = false; // i.e. acquired
+	const char* name;
+	mutable portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED; // Guards the state and counters below
+	volatile bool locked = false; // i.e. acquired
+
+	volatile uint64_t heldTime = 0; //[us]
+	volatile uint64_t lockTime = 0; //[us] when it was last acquired
+	volatile uint32_t acquisitions = 0;
+
+	static SleepLock* locks[MaxLocks];
+	static uint64_t statsStart; //[us]
 
 };
 
@@ -0,0 +1,60 @@
+#ifndef CLOCKSTAR_FIRMWARE_STATEBUFFER_H
+#define CLOCKSTAR_FIRMWARE_STATEBUFFER_H
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+
+/**
+ * Hands the newest copy of a state from one producer task to one consumer task, without locks and without either side
+ * ever waiting. Besides the slot each side holds there's a third one with the latest published state, publish and
+ * read swap their slot with it. States the consumer didn't get to in time are dropped, it always reads the newest.
+ */
+template<typename T>
+class StateBuffer {
+public:
+	/** Producer side, copies state into the back slot and makes it the latest */
+	void publish(const T& state){
+		slots[back] = state;
+		back = latest.exchange(back | Fresh) & Index;
+	}
+
+	/**
+	 * Consumer side, the newest published state. Stays valid until the next read.
+	 * @param fresh Set if it was published since the previous read
+	 * @return nullptr if nothing was published yet
+	 */
+	const T* read(bool* fresh = nullptr){
+		const bool isFresh = latest.load() & Fresh;
+		if(isFresh){
+			front = latest.exchange(front) & Index;
+			valid = true;
+		}
+		if(fresh){
+			*fresh = isFresh;
+		}
+		return valid ? &slots[front] : nullptr;
+	}
+
+	/** Forgets published states, only while neither side is running */
+	void clear(){
+		latest = 1;
+		back = 0;
+		front = 2;
+		valid = false;
+	}
+
+private:
+	static constexpr uint8_t Index = 0x3;
+	static constexpr uint8_t Fresh = 0x4;
+
+	std::array<T, 3> slots{};
+	std::atomic<uint8_t> latest{ 1 };
+	uint8_t back = 0; // Producer only
+	uint8_t front = 2; // Consumer only
+	bool valid = false; // Consumer only
+
+};
+
+
+#endif //CLOCKSTAR_FIRMWARE_STATEBUFFER_H
@@ -0,0 +1,68 @@
+#include "TaskPlan.h"
+#include <mutex>
+#include <memory>
+#include <cstdio>
+
+static constexpr size_t MaxTracked = 24;
+
+struct Tracked {
+	TaskHandle_t handle;
+	PlannedTask task;
+};
+
+static Tracked tracked[MaxTracked];
+static size_t trackedCount = 0;
+static std::mutex trackedMut;
+
+void TaskPlan::track(TaskHandle_t handle, PlannedTask task){
+	std::lock_guard lock(trackedMut);
+	if(trackedCount == MaxTracked) return;
+	tracked[trackedCount++] = { handle, task };
+}
+
+void TaskPlan::untrack(TaskHandle_t handle){
+	std::lock_guard lock(trackedMut);
+	for(size_t i = 0; i < trackedCount; i++){
+		if(tracked[i].handle != handle) continue;
+		tracked[i] = tracked[--trackedCount];
+		return;
+	}
+}
+
+void TaskPlan::printReport(const std::function<void(const char* line)>& print){
+	static constexpr size_t MaxTasks = 40;
+	auto status = std::make_unique<TaskStatus_t[]>(MaxTasks);
+	const size_t count = uxTaskGetSystemState(status.get(), MaxTasks, nullptr);
+
+	char line[128];
+	size_t mismatches = 0;
+	for(size_t i = 0; i < count; i++){
+		const auto& stat = status[i];
+		const int core = stat.xCoreID == tskNO_AFFINITY ? AnyCore : (int) stat.xCoreID;
+
+		const Placement* plan = nullptr;
+		{
+			std::lock_guard lock(trackedMut);
+			for(size_t j = 0; j < trackedCount; j++){
+				if(tracked[j].handle == stat.xHandle){
+					plan = &get(tracked[j].task);
+					break;
+				}
+			}
+		}
+
+		if(plan == nullptr){
+			// Idle, IDF and ad hoc tasks, placed by sdkconfig or their creator
+			snprintf(line, sizeof(line), "Task %-16s core %2d  prio %2u  unplanned\n", stat.pcTaskName, core, (unsigned) stat.uxCurrentPriority);
+		}else{
+			const bool ok = plan->core == core && plan->priority == stat.uxBasePriority;
+			if(!ok) mismatches++;
+			snprintf(line, sizeof(line), "Task %-16s core %2d  prio %2u  %-10s planned core %2d prio %2u%s\n", stat.pcTaskName, core,
+					 (unsigned) stat.uxCurrentPriority, className(plan->cls), plan->core, plan->priority, ok ? "" : "  MISMATCH");
+		}
+		print(line);
+	}
+
+	snprintf(line, sizeof(line), "Task plan: %zu tasks, %zu off their placement\n", count, mismatches);
+	print(line);
+}
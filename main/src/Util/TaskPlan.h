@@ -0,0 +1,140 @@
+#ifndef CLOCKSTAR_FIRMWARE_TASKPLAN_H
+#define CLOCKSTAR_FIRMWARE_TASKPLAN_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <sdkconfig.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * What a task does, which decides where it may run. Render owns its core. Real-time audio, radio and sensor work share
+ * the other one, audio above the rest, so none of them can delay a frame and nothing unpinned can delay them.
+ */
+enum class TaskClass : uint8_t {
+	Render, Audio, Radio, Sensor, Background
+};
+
+/** Firmware tasks with a place in the TaskPlan, constructed with it through Threaded */
+enum class PlannedTask : uint8_t {
+	LVGL, AssetPrefetch,
+	ChirpSystem, PCMAudio, ThereminAudio, Game,
+	BLE, Bangle, ANCSNotif, ANCSData, DFU, AssetSync, Export,
+	IMU, I2C, Orientation,
+	Battery, LEDController, Status, Console, Pool0, Pool1,
+	COUNT
+};
+
+/**
+ * Core and priority of every PlannedTask, checked against the TaskClass rules at compile time, so moving a task onto
+ * the wrong core or above the render thread doesn't build. Tasks created by IDF components are placed by sdkconfig,
+ * the radio core is checked against Bluedroid's and the controller's there.
+ */
+class TaskPlan {
+public:
+	static constexpr int8_t AnyCore = -1;
+	static constexpr int8_t RenderCore = 1;
+	static constexpr int8_t RealtimeCore = 0;
+
+	struct Placement {
+		PlannedTask task;
+		TaskClass cls;
+		int8_t core; // AnyCore leaves it to the scheduler
+		uint8_t priority;
+	};
+
+	static constexpr Placement Plan[] = {
+			{ PlannedTask::LVGL, TaskClass::Render, RenderCore, 6 },
+			{ PlannedTask::AssetPrefetch, TaskClass::Background, RealtimeCore, 1 },
+
+			{ PlannedTask::ChirpSystem, TaskClass::Audio, RealtimeCore, configMAX_PRIORITIES - 1 },
+			{ PlannedTask::PCMAudio, TaskClass::Audio, RealtimeCore, 15 },
+			{ PlannedTask::ThereminAudio, TaskClass::Audio, RealtimeCore, 10 },
+			{ PlannedTask::Game, TaskClass::Background, RealtimeCore, 5 }, // Steps are timed, a late wakeup costs nothing
+
+			{ PlannedTask::BLE, TaskClass::Radio, RealtimeCore, 9 },
+			{ PlannedTask::Bangle, TaskClass::Radio, RealtimeCore, 5 },
+			{ PlannedTask::ANCSNotif, TaskClass::Radio, RealtimeCore, 5 },
+			{ PlannedTask::ANCSData, TaskClass::Radio, RealtimeCore, 5 },
+			{ PlannedTask::DFU, TaskClass::Radio, RealtimeCore, 4 }, // Flash writes, behind everything talking to the phone
+			{ PlannedTask::AssetSync, TaskClass::Radio, RealtimeCore, 4 },
+			{ PlannedTask::Export, TaskClass::Radio, RealtimeCore, 3 }, // Bulk notifications, UART and Bangle go first
+
+			{ PlannedTask::IMU, TaskClass::Sensor, RealtimeCore, 8 },
+			{ PlannedTask::I2C, TaskClass::Sensor, RealtimeCore, 9 },
+			{ PlannedTask::Orientation, TaskClass::Sensor, RealtimeCore, 7 },
+
+			{ PlannedTask::Battery, TaskClass::Background, RenderCore, 5 },
+			{ PlannedTask::LEDController, TaskClass::Background, RealtimeCore, 6 },
+			{ PlannedTask::Status, TaskClass::Background, AnyCore, 5 },
+			{ PlannedTask::Console, TaskClass::Background, AnyCore, 1 },
+			// TaskPool workers, one per core, under LVGL so a pooled job on the render core waits for the frame
+			{ PlannedTask::Pool0, TaskClass::Background, RealtimeCore, 5 },
+			{ PlannedTask::Pool1, TaskClass::Background, RenderCore, 5 },
+	};
+
+	static constexpr const Placement& get(PlannedTask task){
+		return Plan[(size_t) task];
+	}
+
+	static constexpr const char* className(TaskClass cls){
+		constexpr const char* Names[] = { "render", "audio", "radio", "sensor", "background" };
+		return Names[(size_t) cls];
+	}
+
+	/** Called by Threaded with every planned task it starts and on its way out, for the report */
+	static void track(TaskHandle_t handle, PlannedTask task);
+	static void untrack(TaskHandle_t handle);
+
+	/** Lists every task with its core and priority, the planned ones against their placement. */
+	static void printReport(const std::function<void(const char* line)>& print);
+
+	static constexpr uint8_t RenderPriority = Plan[(size_t) PlannedTask::LVGL].priority;
+
+	/** Whether the plan keeps the TaskClass rules, asserted below */
+	static constexpr bool valid(){
+		if(sizeof(Plan) / sizeof(Plan[0]) != (size_t) PlannedTask::COUNT) return false;
+
+		uint8_t lowestAudio = UINT8_MAX;
+		uint8_t highestOther = 0; // Of the rest sharing the real-time core
+		for(size_t i = 0; i < (size_t) PlannedTask::COUNT; i++){
+			const auto& p = Plan[i];
+			if((size_t) p.task != i) return false;
+			if(p.priority >= configMAX_PRIORITIES) return false;
+
+			if(p.cls == TaskClass::Render){
+				if(p.core != RenderCore) return false;
+				continue;
+			}
+
+			// Anything else that can run next to rendering has to yield to it
+			if((p.core == RenderCore || p.core == AnyCore) && p.priority >= RenderPriority) return false;
+
+			if(p.cls == TaskClass::Audio || p.cls == TaskClass::Radio || p.cls == TaskClass::Sensor){
+				if(p.core != RealtimeCore) return false;
+			}
+
+			if(p.cls == TaskClass::Audio){
+				lowestAudio = p.priority < lowestAudio ? p.priority : lowestAudio;
+			}else if(p.core == RealtimeCore){
+				highestOther = p.priority > highestOther ? p.priority : highestOther;
+			}
+		}
+
+		return lowestAudio > highestOther;
+	}
+
+};
+
+static_assert(TaskPlan::valid(), "TaskPlan breaks its placement rules, see TaskClass");
+static_assert(TaskPlan::RenderCore != TaskPlan::RealtimeCore);
+#ifdef CONFIG_BT_BLUEDROID_PINNED_TO_CORE
+static_assert(CONFIG_BT_BLUEDROID_PINNED_TO_CORE == TaskPlan::RealtimeCore, "Bluedroid has to run on the real-time core with the rest of the radio work");
+#endif
+#ifdef CONFIG_BT_CTRL_PINNED_TO_CORE
+static_assert(CONFIG_BT_CTRL_PINNED_TO_CORE == TaskPlan::RealtimeCore, "The BT controller has to run on the real-time core with the rest of the radio work");
+#endif
+
+
+#endif //CLOCKSTAR_FIRMWARE_TASKPLAN_H
@@ -0,0 +1,233 @@
+#include "TaskPool.h"
+#include "TaskPlan.h"
+#include <esp_log.h>
+#include <algorithm>
+
+static const char* TAG = "TaskPool";
+
+TaskPool& TaskPool::get(){
+	static TaskPool pool;
+	return pool;
+}
+
+TaskPool::TaskPool(){
+	static const char* const Names[] = { "Pool0", "Pool1" };
+	static constexpr PlannedTask Planned[] = { PlannedTask::Pool0, PlannedTask::Pool1 };
+	static_assert(TaskPlan::get(PlannedTask::Pool0).core == 0 && TaskPlan::get(PlannedTask::Pool1).core == 1);
+
+	for(size_t i = 0; i < WorkerCount; i++){
+		workers[i].wake = xSemaphoreCreateBinary();
+		xTaskCreatePinnedToCore(workerFunc, Names[i], WorkerStack, (void*) i, TaskPlan::get(Planned[i]).priority, &workers[i].task, i);
+		TaskPlan::track(workers[i].task, Planned[i]);
+	}
+}
+
+void TaskPool::schedule(Job* job, TickType_t delay, int8_t core){
+	scheduleAt(job, xTaskGetTickCount() + delay, core);
+}
+
+void TaskPool::scheduleAligned(Job* job, TickType_t period, int8_t core){
+	if(period == 0){
+		schedule(job, 0, core);
+		return;
+	}
+
+	const auto now = xTaskGetTickCount();
+	scheduleAt(job, (now / period + 1) * period, core);
+}
+
+TickType_t TaskPool::getNextDeadline(){
+	std::lock_guard lock(mut);
+
+	TickType_t wait = portMAX_DELAY;
+	const auto now = xTaskGetTickCount();
+	for(const auto& worker : workers){
+		for(const auto& entry : worker.jobs){
+			const auto remaining = (int32_t) (entry.job->due - now);
+			wait = std::min(wait, (TickType_t) std::max(remaining, (int32_t) 0));
+		}
+	}
+
+	return wait;
+}
+
+void TaskPool::scheduleAt(Job* job, TickType_t due, int8_t core){
+	size_t index;
+
+	{
+		std::lock_guard lock(mut);
+		remove(job);
+
+		if(core >= 0 && core < (int8_t) WorkerCount){
+			index = core;
+		}else{
+			index = 0;
+			for(size_t i = 1; i < WorkerCount; i++){
+				if(workers[i].jobs.size() < workers[index].jobs.size()){
+					index = i;
+				}
+			}
+		}
+
+		job->due = due;
+		workers[index].jobs.push_back({ job, core >= 0 });
+	}
+
+	xSemaphoreGive(workers[index].wake);
+}
+
+void TaskPool::cancel(Job* job){
+	for(;;){
+		{
+			std::lock_guard lock(mut);
+			remove(job);
+
+			bool busy = false;
+			for(const auto& worker : workers){
+				if(worker.current == job && worker.task != xTaskGetCurrentTaskHandle()){
+					busy = true;
+				}
+			}
+			if(!busy) return;
+		}
+
+		vTaskDelay(1);
+	}
+}
+
+bool TaskPool::remove(Job* job){
+	for(auto& worker : workers){
+		auto it = std::find_if(worker.jobs.begin(), worker.jobs.end(), [job](const Entry& entry){ return entry.job == job; });
+		if(it == worker.jobs.end()) continue;
+
+		worker.jobs.erase(it);
+		return true;
+	}
+
+	return false;
+}
+
+TaskPool::Job* TaskPool::take(Worker& worker, TickType_t now, TickType_t& wait, bool steal){
+	auto next = worker.jobs.end();
+	for(auto it = worker.jobs.begin(); it != worker.jobs.end(); ++it){
+		if(steal && it->pinned) continue;
+		if(next == worker.jobs.end() || (int32_t) (it->job->due - next->job->due) < 0){
+			next = it;
+		}
+	}
+	if(next == worker.jobs.end()) return nullptr;
+
+	const auto remaining = (int32_t) (next->job->due - now);
+	if(remaining > 0){
+		wait = std::min(wait, (TickType_t) remaining);
+		return nullptr;
+	}
+
+	auto job = next->job;
+	worker.jobs.erase(next);
+	return job;
+}
+
+void TaskPool::workerFunc(void* arg){
+	auto index = (size_t) arg;
+	auto& pool = get();
+
+	for(;;){
+		pool.work(index);
+	}
+}
+
+void TaskPool::work(size_t index){
+	auto& self = workers[index];
+
+	Job* job = nullptr;
+	TickType_t wait = portMAX_DELAY;
+
+	{
+		std::lock_guard lock(mut);
+		const auto now = xTaskGetTickCount();
+
+		job = take(self, now, wait, false);
+		for(size_t i = 0; job == nullptr && i < WorkerCount; i++){
+			if(i == index) continue;
+			job = take(workers[i], now, wait, true);
+			if(job){
+				ESP_LOGV(TAG, "Worker %d stole a job from worker %d", (int) index, (int) i);
+			}
+		}
+
+		self.current = job;
+	}
+
+	if(job == nullptr){
+		xSemaphoreTake(self.wake, wait);
+		return;
+	}
+
+	job->run();
+
+	std::lock_guard lock(mut);
+	self.current = nullptr;
+}
+
+
+PooledThreaded::PooledThreaded(const char* name, int8_t core) : name(name), core(core){}
+
+PooledThreaded::~PooledThreaded(){
+	if(state != Stopped){
+		ESP_LOGE(TAG, "PooledThreaded %s destructing while still running", name);
+		abort();
+	}
+}
+
+void PooledThreaded::start(){
+	if(state != Stopped) return;
+
+	if(!onStart()) return;
+
+	state = Running;
+	TaskPool::get().schedule(this, 0, core);
+}
+
+void PooledThreaded::stop(){
+	if(state != Running) return;
+
+	state = Stopping;
+	TaskPool::get().cancel(this);
+	onStop();
+	state = Stopped;
+}
+
+bool PooledThreaded::running() const{
+	return state != Stopped;
+}
+
+bool PooledThreaded::onStart(){
+	return true;
+}
+
+void PooledThreaded::onStop(){ }
+
+void PooledThreaded::delayNext(uint32_t millis){
+	nextDelay = pdMS_TO_TICKS(millis);
+	aligned = false;
+}
+
+void PooledThreaded::alignNext(uint32_t period){
+	nextDelay = pdMS_TO_TICKS(period);
+	aligned = true;
+}
+
+void PooledThreaded::run(){
+	nextDelay = 0;
+	aligned = false;
+	loop();
+
+	if(state != Running) return;
+
+	if(aligned){
+		TaskPool::get().scheduleAligned(this, nextDelay, core);
+	}else{
+		TaskPool::get().schedule(this, nextDelay, core);
+	}
+}
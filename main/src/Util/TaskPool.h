@@ -0,0 +1,120 @@
+#ifndef CLOCKSTAR_FIRMWARE_TASKPOOL_H
+#define CLOCKSTAR_FIRMWARE_TASKPOOL_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <vector>
+#include <mutex>
+
+/**
+ * Cooperative executor with one worker task per core. Jobs are short, non-blocking callbacks scheduled to run after
+ * a delay. Each worker runs its own due jobs first and steals due jobs that aren't pinned to a core from the other
+ * worker when it runs out. Mostly idle periodic services run here instead of keeping a parked task with its own stack.
+ *
+ * Periodic jobs are scheduled onto aligned ticks (multiples of their period since boot), so services with commensurate
+ * periods wake together. Idle workers block until the earliest deadline, which is what tickless idle and the PM layer
+ * see as the next wakeup, leaving light sleep one long window instead of several unaligned ones.
+ */
+class TaskPool {
+public:
+	class Job {
+	public:
+		virtual ~Job() = default;
+
+	protected:
+		virtual void run() = 0;
+
+	private:
+		TickType_t due = 0;
+		friend TaskPool;
+	};
+
+	static TaskPool& get();
+
+	/**
+	 * Schedules the job to run once after delay. Scheduling a job that's already waiting moves its deadline.
+	 * @param core Worker to run it on, -1 lets either worker run it
+	 */
+	void schedule(Job* job, TickType_t delay, int8_t core = -1);
+
+	/** Schedules the job on the next tick that is a multiple of period. */
+	void scheduleAligned(Job* job, TickType_t period, int8_t core = -1);
+
+	/** Ticks until the earliest scheduled job, portMAX_DELAY if there are none. */
+	TickType_t getNextDeadline();
+
+	/** Removes the job from the pool. If it's currently running on another worker, waits until it returns. */
+	void cancel(Job* job);
+
+private:
+	TaskPool();
+
+	static constexpr size_t WorkerStack = 3 * 1024; // [B]
+	static constexpr size_t WorkerCount = portNUM_PROCESSORS;
+
+	struct Entry {
+		Job* job;
+		bool pinned;
+	};
+
+	struct Worker {
+		std::vector<Entry> jobs;
+		Job* current = nullptr;
+		SemaphoreHandle_t wake;
+		TaskHandle_t task;
+	};
+	Worker workers[WorkerCount];
+	std::mutex mut;
+
+	static void workerFunc(void* arg);
+	void work(size_t index);
+
+	void scheduleAt(Job* job, TickType_t due, int8_t core);
+	Job* take(Worker& worker, TickType_t now, TickType_t& wait, bool steal);
+	bool remove(Job* job);
+
+};
+
+/**
+ * Threaded-compatible adapter that runs loop() as a TaskPool job instead of on its own task.
+ * loop() must not block. It calls delayNext() instead of vTaskDelay to set when the next loop runs.
+ */
+class PooledThreaded : private TaskPool::Job {
+public:
+	virtual ~PooledThreaded();
+
+	void start();
+	void stop();
+
+	bool running() const;
+
+protected:
+	PooledThreaded(const char* name, int8_t core = -1);
+
+	virtual bool onStart();
+	virtual void onStop();
+
+	virtual void loop() = 0;
+
+	void delayNext(uint32_t millis);
+
+	/** Runs the next loop on the next tick aligned to period, see TaskPool::scheduleAligned. */
+	void alignNext(uint32_t period);
+
+private:
+	const char* name;
+	const int8_t core;
+	bool aligned = false;
+
+	enum {
+		Stopped, Running, Stopping
+	} state = Stopped;
+
+	TickType_t nextDelay = 0;
+
+	void run() final;
+
+};
+
+#endif //CLOCKSTAR_FIRMWARE_TASKPOOL_H
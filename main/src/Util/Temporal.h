@@ -0,0 +1,140 @@
+#ifndef CLOCKSTAR_FIRMWARE_TEMPORAL_H
+#define CLOCKSTAR_FIRMWARE_TEMPORAL_H
+
+#include "TaskPool.h"
+#include "stdafx.h"
+#include <atomic>
+#include <algorithm>
+
+/**
+ * Filters over time, with their timing fixed at compile time and their deadlines kept in the TaskPool, so a filter
+ * that's waiting wakes its owner exactly when it's due instead of needing a periodic task or a timer of its own.
+ * Callbacks run on a TaskPool worker and must not block, waking the owner is what they're for.
+ * Value hysteresis, which doesn't depend on time, is DSP::Hysteresis.
+ */
+namespace Temporal {
+
+using Callback = void (*)(void* arg);
+
+/**
+ * Time hysteresis: a new value is only taken once update() was given it for HoldTime in a row. While a value is pending,
+ * onDue is called once it's been held long enough, so an owner updating on its own slow samples can update right then.
+ */
+template<typename T, uint32_t HoldTime>
+class Hold : private TaskPool::Job {
+public:
+	explicit Hold(T initial = T(), Callback onDue = nullptr, void* arg = nullptr) : val(initial), onDue(onDue), arg(arg){}
+
+	~Hold() override{
+		TaskPool::get().cancel(this);
+	}
+
+	T update(T value){
+		if(value == val){
+			pending = false;
+			return val;
+		}
+
+		const uint64_t now = millis();
+		if(!pending || value != pendingVal){
+			pending = true;
+			pendingVal = value;
+			pendingTime = now;
+
+			// A tick late, so the owner's update() is past HoldTime when it gets woken
+			if(onDue){
+				TaskPool::get().schedule(this, pdMS_TO_TICKS(HoldTime) + 1);
+			}
+			return val;
+		}
+
+		if(now - pendingTime >= HoldTime){
+			val = value;
+			pending = false;
+		}
+		return val;
+	}
+
+	void reset(T value){
+		val = value;
+		pending = false;
+	}
+
+	T get() const{
+		return val;
+	}
+
+	bool isPending() const{
+		return pending;
+	}
+
+private:
+	T val;
+	T pendingVal = T();
+	uint64_t pendingTime = 0; // [ms]
+	bool pending = false;
+
+	const Callback onDue;
+	void* const arg;
+
+	void run() override{
+		onDue(arg);
+	}
+
+};
+
+/**
+ * Calls fire once trigger() wasn't called for Quiet, or at the latest MaxWait after the first trigger() since the last
+ * call, so a steady trickle isn't held back forever. Safe to trigger from any task.
+ */
+template<uint32_t Quiet, uint32_t MaxWait = UINT32_MAX>
+class Debounce : private TaskPool::Job {
+	static_assert(Quiet <= MaxWait, "Quiet window can't be longer than the longest wait");
+
+public:
+	Debounce(Callback fire, void* arg = nullptr) : fire(fire), arg(arg){}
+
+	~Debounce() override{
+		TaskPool::get().cancel(this);
+	}
+
+	void trigger(){
+		const uint64_t now = millis();
+		uint64_t start = 0;
+		if(burstStart.compare_exchange_strong(start, now)){
+			start = now;
+		}
+
+		const uint64_t age = now - start;
+		const uint32_t delay = age >= MaxWait ? 0 : std::min<uint64_t>(Quiet, MaxWait - age);
+		TaskPool::get().schedule(this, pdMS_TO_TICKS(delay));
+	}
+
+	/** Calls fire on the pool right away instead of waiting out the window */
+	void flush(){
+		TaskPool::get().schedule(this, 0);
+	}
+
+	/** Drops a pending call, waits for it if it's running. Mustn't be called holding a lock the callback takes. */
+	void cancel(){
+		TaskPool::get().cancel(this);
+		burstStart = 0;
+	}
+
+private:
+	const Callback fire;
+	void* const arg;
+
+	std::atomic<uint64_t> burstStart = 0; // [ms] of the first trigger since the last call, 0 if none
+
+	void run() override{
+		burstStart = 0;
+		fire(arg);
+	}
+
+};
+
+}
+
+
+#endif //CLOCKSTAR_FIRMWARE_TEMPORAL_H
@@ -7,6 +7,12 @@ Threaded::Threaded(const char* name, size_t stackSize, uint8_t priority, int8_t
 	stopMut = xSemaphoreCreateMutex();
 }
 
+Threaded::Threaded(const char* name, size_t stackSize, PlannedTask planned) : name(name), stackSize(stackSize),
+		priority(TaskPlan::get(planned).priority), core(TaskPlan::get(planned).core), planned(planned){
+	stopSem = xSemaphoreCreateBinary();
+	stopMut = xSemaphoreCreateMutex();
+}
+
 Threaded::~Threaded(){
 	if(state != Stopped){
 		ESP_LOGE("Threaded", "Threaded %s destructing while still running", name);
@@ -29,6 +35,10 @@ void Threaded::start(){
 	}else{
 		xTaskCreatePinnedToCore(Threaded::threadFunc, name, stackSize, this, priority, &task, core);
 	}
+
+	if(planned != PlannedTask::COUNT){
+		TaskPlan::track(task, planned);
+	}
 }
 
 void Threaded::stop(TickType_t wait){
@@ -57,6 +67,10 @@ void Threaded::threadFunc(void* arg){
 
 	thr->onStop();
 
+	if(thr->planned != PlannedTask::COUNT){
+		TaskPlan::untrack(xTaskGetCurrentTaskHandle());
+	}
+
 	thr->state = Stopped;
 	xSemaphoreGive(thr->stopSem);
 
@@ -77,30 +91,28 @@ bool Threaded::running(){
 	return state == Running || state == Stopping;
 }
 
+ThreadedClosure::ThreadedClosure(Lambda loopFn, const char* name, size_t stackSize, PlannedTask planned, Lambda stopSignalFn) : Threaded(name, stackSize, planned),
+		fn(std::move(loopFn)), stopSignalFn(std::move(stopSignalFn)){}
+
 ThreadedClosure::ThreadedClosure(Lambda loopFn, const char* name, size_t stackSize, uint8_t priority, int8_t core) : Threaded(name, stackSize, priority, core), fn(std::move(loopFn)){}
 
 void ThreadedClosure::loop(){
 	fn();
 }
 
-SleepyThreaded::SleepyThreaded(TickType_t loopInterval, const char* name, size_t stackSize, uint8_t priority, int8_t core) : Threaded(name, stackSize, priority, core), SleepTime(loopInterval){
-	pauseSem = xSemaphoreCreateBinary();
+void ThreadedClosure::afterStopSignal(){
+	if(stopSignalFn){
+		stopSignalFn();
+	}
 }
 
-SleepyThreaded::~SleepyThreaded(){
-	vSemaphoreDelete(pauseSem);
-}
+SleepyThreaded::SleepyThreaded(TickType_t loopInterval, const char* name, int8_t core) : PooledThreaded(name, core), SleepTime(loopInterval){}
 
 void SleepyThreaded::pause(){
-	if(paused) return;
-	xSemaphoreGive(pauseSem);
-	while(!paused){
-		vTaskDelay(1);
-	}
+	stop();
 }
 
 void SleepyThreaded::resume(){
-	paused = false;
 	start();
 }
 
@@ -109,14 +121,12 @@ void SleepyThreaded::resetTime(){
 }
 
 void SleepyThreaded::loop(){
-	if(millis() - lastLoop < SleepTime){
-		if(xSemaphoreTake(pauseSem, millis() - lastLoop + 1) == pdTRUE){
-			stop(0);
-			paused = true;
-			return;
-		}
-		return;
-	}
+	// Loops run on ticks aligned to SleepTime so periodic services wake together. After a resetTime(), the next aligned
+	// tick is skipped if it comes less than half a period later.
+	alignNext(SleepTime);
+
+	const auto elapsed = millis() - lastLoop;
+	if(elapsed < SleepTime / 2) return;
 
 	resetTime();
 	sleepyLoop();
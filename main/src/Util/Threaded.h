@@ -6,6 +6,8 @@
 #include <freertos/task.h>
 #include <freertos/semphr.h>
 #include <functional>
+#include "TaskPool.h"
+#include "TaskPlan.h"
 
 class Threaded {
 public:
@@ -17,6 +19,8 @@ public:
 	bool running();
 
 protected:
+	/** Core and priority from the TaskPlan. Firmware tasks take this one, the ad hoc one is for examples and tests. */
+	Threaded(const char* name, size_t stackSize, PlannedTask planned);
 	Threaded(const char* name, size_t stackSize = 12000, uint8_t priority = 5, int8_t core = -1);
 
 	virtual bool onStart();
@@ -32,6 +36,7 @@ private:
 	size_t stackSize;
 	const uint8_t priority;
 	const int8_t core;
+	const PlannedTask planned = PlannedTask::COUNT; // COUNT if ad hoc
 
 	enum {
 		Stopped, Running, Stopping
@@ -48,23 +53,29 @@ class ThreadedClosure : public Threaded {
 public:
 	using Lambda = std::function<void()>;
 
+	/** @param stopSignalFn Wakes loopFn from whatever it blocks on, for tasks that are stopped before destruction */
+	ThreadedClosure(Lambda loopFn, const char* name, size_t stackSize, PlannedTask planned, Lambda stopSignalFn = {});
 	ThreadedClosure(Lambda loopFn, const char* name, size_t stackSize = 12000, uint8_t priority = 5, int8_t core = -1);
 
 protected:
 	void loop() override;
+	void afterStopSignal() override;
 	Lambda fn;
+	Lambda stopSignalFn;
 
 };
 
-class SleepyThreaded : public Threaded {
+/**
+ * Periodic service running sleepyLoop() every loopInterval milliseconds, on ticks aligned to the interval.
+ * Runs as a TaskPool job, so sleepyLoop() must not block.
+ */
+class SleepyThreaded : public PooledThreaded {
 public:
-	virtual ~SleepyThreaded();
-
 	void pause();
 	void resume();
 
 protected:
-	SleepyThreaded(TickType_t loopInterval, const char* name, size_t stackSize = 12000, uint8_t priority = 5, int8_t core = -1);
+	SleepyThreaded(TickType_t loopInterval, const char* name, int8_t core = -1);
 
 	void resetTime();
 	virtual void sleepyLoop() = 0;
@@ -73,9 +84,6 @@ private:
 	const TickType_t SleepTime;
 	TickType_t lastLoop = 0;
 
-	SemaphoreHandle_t pauseSem;
-	bool paused = false;
-
 	void loop() final;
 
 };
@@ -0,0 +1,83 @@
+#include "Trace.h"
+
+#ifdef CONFIG_CM_TRACE
+
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+static const char* TAG = "Trace";
+
+Trace::Record* Trace::rings[portNUM_PROCESSORS] = {};
+std::atomic_uint32_t Trace::heads[portNUM_PROCESSORS] = {};
+std::atomic_bool Trace::enabled = false;
+
+void Trace::init(){
+	for(auto& ring : rings){
+		ring = (Record*) heap_caps_malloc(RingSize * sizeof(Record), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+		if(ring == nullptr){
+			ESP_LOGE(TAG, "Couldn't allocate %zu B for a trace ring", RingSize * sizeof(Record));
+			return;
+		}
+	}
+
+	enabled = true;
+}
+
+void IRAM_ATTR Trace::record(Type type, const char* name){
+	if(!enabled.load(std::memory_order_relaxed)) return;
+
+	const auto core = xPortGetCoreID();
+	const uint32_t index = heads[core].fetch_add(1, std::memory_order_relaxed) % RingSize;
+
+	auto& rec = rings[core][index];
+	rec.time = esp_timer_get_time();
+	rec.name = name;
+	rec.task = xPortInIsrContext() ? nullptr : xTaskGetCurrentTaskHandle();
+	rec.type = type;
+}
+
+void Trace::dump(){
+	if(rings[0] == nullptr) return;
+
+	// Writers that already passed the check finish their record well within a tick
+	enabled = false;
+	vTaskDelay(2);
+
+	printf("TRACE:begin:%llu\n", esp_timer_get_time());
+
+	std::vector<TaskStatus_t> tasks(uxTaskGetNumberOfTasks() + 4);
+	tasks.resize(uxTaskGetSystemState(tasks.data(), tasks.size(), nullptr));
+	for(const auto& task : tasks){
+		printf("TRACE:task:%p:%s\n", task.xHandle, task.pcTaskName);
+	}
+
+	static constexpr char Types[] = { 'B', 'E', 'I' };
+	size_t total = 0;
+	for(size_t core = 0; core < portNUM_PROCESSORS; core++){
+		const uint32_t head = heads[core];
+		const uint32_t count = std::min<uint32_t>(head, RingSize);
+
+		for(uint32_t i = head - count; i != head; i++){
+			const auto& rec = rings[core][i % RingSize];
+			printf("TRACE:%zu:%p:%c:%llu:%s\n", core, rec.task, Types[(uint8_t) rec.type], rec.time, rec.name);
+		}
+		total += count;
+	}
+
+	printf("TRACE:end:%zu\n", total);
+
+	clear();
+	enabled = true;
+}
+
+void Trace::clear(){
+	for(auto& head : heads){
+		head = 0;
+	}
+}
+
+#endif
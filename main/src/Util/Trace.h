@@ -0,0 +1,76 @@
+#ifndef CLOCKSTAR_FIRMWARE_TRACE_H
+#define CLOCKSTAR_FIRMWARE_TRACE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Span and instant event recorder for seeing how tasks interleave across both cores. Each core records into its own
+ * ring, slots are claimed with an atomic increment so tasks and ISRs on the same core never wait on each other, and
+ * the oldest records are overwritten once a ring is full. Names must be string literals, only the pointer is kept.
+ *
+ * dump() prints the rings over the console as TRACE: lines, tools/trace_capture.py turns them into a Chrome trace
+ * JSON that Perfetto opens. Recording is paused while dumping. Without CONFIG_CM_TRACE the macros compile to nothing.
+ */
+class Trace {
+public:
+	enum class Type : uint8_t { Begin, End, Instant };
+
+	static void init();
+
+	static void IRAM_ATTR record(Type type, const char* name);
+
+	static void begin(const char* name){ record(Type::Begin, name); }
+	static void end(const char* name){ record(Type::End, name); }
+	static void instant(const char* name){ record(Type::Instant, name); }
+
+	class Scope {
+	public:
+		explicit Scope(const char* name) : name(name){ begin(name); }
+		~Scope(){ end(name); }
+
+	private:
+		const char* name;
+	};
+
+	static void dump();
+	static void clear();
+
+private:
+#ifdef CONFIG_CM_TRACE_EVENTS
+	static constexpr size_t RingSize = CONFIG_CM_TRACE_EVENTS; // Records per core
+#else
+	static constexpr size_t RingSize = 2048; // Records per core
+#endif
+
+	struct Record {
+		uint64_t time; // [us] since boot
+		const char* name;
+		TaskHandle_t task; // nullptr in ISRs
+		Type type;
+	};
+
+	static Record* rings[portNUM_PROCESSORS];
+	static std::atomic_uint32_t heads[portNUM_PROCESSORS];
+	static std::atomic_bool enabled;
+
+};
+
+#ifdef CONFIG_CM_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_BEGIN(name) Trace::begin(name)
+#define TRACE_END(name) Trace::end(name)
+#define TRACE_INSTANT(name) Trace::instant(name)
+#else
+#define TRACE_SCOPE(name) do{}while(0)
+#define TRACE_BEGIN(name) do{}while(0)
+#define TRACE_END(name) do{}while(0)
+#define TRACE_INSTANT(name) do{}while(0)
+#endif
+
+#endif //CLOCKSTAR_FIRMWARE_TRACE_H
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Compiles the lock screen faces below into the description format read by main/src/Screens/Lock/WatchFace.cpp.
+
+A description is a header followed by its layers, bottom first, all little endian:
+	header: u32 magic "CSWF", u8 version, u8 layer count, u16 reserved
+	layer:  u8 kind, u8 binding, u8 lv_align_t, u8 path length, i16 x, i16 y, u8 w, u8 h, u16 period [s],
+	        u8 r, u8 g, u8 b, u8 reserved, then the path without a terminator
+Sizes of 0 fit the content. Image layers are static and composited once, a text layer's period is the most often
+it's refreshed, and the clock ticks seconds only with a period under 60.
+Rerun it when a face changes, the output goes into the asset bundle with the rest of spiffs_image.
+
+Usage: face_gen.py [repo root]
+"""
+
+import os
+import struct
+import sys
+
+OUTPUT = "spiffs_image/faces"
+
+MAGIC = 0x46575343  # "CSWF"
+VERSION = 1
+MAX_LAYERS = 16
+
+HEADER = struct.Struct("<IBBH")
+LAYER = struct.Struct("<BBBBhhBBHBBBB")
+
+KINDS = { "image": 0, "text": 1, "clock": 2, "status": 3, "notifs": 4 }
+BINDS = { None: 0, "date": 1, "battery": 2, "notif_count": 3 }
+ALIGNS = {
+	"top_left": 1, "top_mid": 2, "top_right": 3, "bottom_left": 4, "bottom_mid": 5, "bottom_right": 6,
+	"left_mid": 7, "right_mid": 8, "center": 9
+}
+
+TEXT_COLOR = (207, 198, 184)  # Styles::TextColor
+
+
+def layer(kind, align = "top_left", x = 0, y = 0, w = 0, h = 0, period = 0, bind = None, color = (0, 0, 0), path = ""):
+	return (kind, align, x, y, w, h, period, bind, color, path)
+
+
+# Name: layers, bottom first. default.wf must match DefaultFace in WatchFace.cpp, it's the fallback.
+FACES = {
+	"default": [
+		layer("image", path = "S:/bg.bin"),
+		layer("status", "top_mid"),
+		layer("clock", "top_mid", y = 41, period = 1),
+		layer("text", "top_mid", y = 65, w = 128, period = 60, bind = "date", color = TEXT_COLOR),
+		layer("notifs", "top_mid", y = 75, w = 128, h = 11),
+	],
+}
+
+
+def pack(layers):
+	if len(layers) > MAX_LAYERS:
+		raise ValueError("{} layers, at most {} fit".format(len(layers), MAX_LAYERS))
+
+	out = bytearray(HEADER.pack(MAGIC, VERSION, len(layers), 0))
+	for kind, align, x, y, w, h, period, bind, color, path in layers:
+		if kind == "image" and not path:
+			raise ValueError("Image layers need a path")
+		encoded = path.encode()
+		out += LAYER.pack(KINDS[kind], BINDS[bind], ALIGNS[align], len(encoded), x, y, w, h, period, *color, 0)
+		out += encoded
+	return bytes(out)
+
+
+def main():
+	root = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+	out_dir = os.path.join(root, OUTPUT)
+	os.makedirs(out_dir, exist_ok = True)
+	for name, layers in FACES.items():
+		with open(os.path.join(out_dir, name + ".wf"), "wb") as f:
+			f.write(pack(layers))
+
+
+if __name__ == "__main__":
+	main()
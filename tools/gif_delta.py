@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Delta-encodes GIFs made by the LVGL GIF converter (desc.bin + N.bin frames) for LVGIF.
+
+Every frame after the first is cropped to the rectangle where it differs from frame 0, which LVGIF
+draws on top of frame 0. delta.bin holds a big-endian (x, y, w, h, flags) record per frame.
+Frames that can't be drawn as an opaque patch over frame 0 are kept whole and flagged FULL.
+
+Usage: gif_delta.py <gif dir> <output dir>
+"""
+
+import os
+import struct
+import sys
+
+FLAG_FULL = 1
+
+DELTA = struct.Struct(">HHHHB")
+
+CF_INDEXED = { 7: 1, 8: 2, 9: 4, 10: 8 }
+
+
+def parse(data):
+	"""Returns (bpp, w, h, palette bytes, rows of palette indices) or None for unsupported formats."""
+	header = struct.unpack("<I", data[:4])[0]
+	cf = header & 0x1F
+	w = (header >> 10) & 0x7FF
+	h = (header >> 21) & 0x7FF
+	if cf not in CF_INDEXED:
+		return None
+
+	bpp = CF_INDEXED[cf]
+	palette_size = 4 * (1 << bpp)
+	palette = data[4:4 + palette_size]
+	stride = (w * bpp + 7) // 8
+	pixels = data[4 + palette_size:]
+	if len(pixels) < stride * h:
+		return None
+
+	rows = []
+	per_byte = 8 // bpp
+	mask = (1 << bpp) - 1
+	for y in range(h):
+		row = pixels[y * stride:(y + 1) * stride]
+		indices = []
+		for x in range(w):
+			b = row[x // per_byte]
+			shift = 8 - bpp * (x % per_byte + 1)
+			indices.append((b >> shift) & mask)
+		rows.append(indices)
+
+	return cf, bpp, w, h, palette, rows
+
+
+def encode(cf, bpp, palette, rows):
+	h = len(rows)
+	w = len(rows[0]) if h else 0
+	out = bytearray(struct.pack("<I", cf | (w << 10) | (h << 21)))
+	out += palette
+	per_byte = 8 // bpp
+	for row in rows:
+		packed = bytearray((w * bpp + 7) // 8)
+		for x, index in enumerate(row):
+			packed[x // per_byte] |= index << (8 - bpp * (x % per_byte + 1))
+		out += packed
+	return bytes(out)
+
+
+def rgba(palette, index):
+	b, g, r, a = palette[index * 4:index * 4 + 4]
+	return (0, 0, 0, 0) if a == 0 else (r, g, b, a)
+
+
+def delta(base, frame):
+	"""Returns (x, y, w, h, flags) of frame against base."""
+	_, _, w, h, base_pal, base_rows = base
+	_, _, _, _, pal, rows = frame
+
+	xs, ys = [], []
+	for y in range(h):
+		for x in range(w):
+			if rgba(pal, rows[y][x]) != rgba(base_pal, base_rows[y][x]):
+				xs.append(x)
+				ys.append(y)
+
+	if not xs:
+		return 0, 0, 0, 0, 0
+
+	x0, x1, y0, y1 = min(xs), max(xs) + 1, min(ys), max(ys) + 1
+
+	# A patch pixel that isn't opaque would let frame 0 show through where the two differ
+	for y in range(y0, y1):
+		for x in range(x0, x1):
+			color = rgba(pal, rows[y][x])
+			if color[3] != 255 and color != rgba(base_pal, base_rows[y][x]):
+				return 0, 0, w, h, FLAG_FULL
+
+	return x0, y0, x1 - x0, y1 - y0, 0
+
+
+def convert(files):
+	"""Takes {name: bytes} of one GIF directory, returns the converted {name: bytes} or None if it can't be delta-encoded."""
+	if "desc.bin" not in files:
+		return None
+
+	desc = files["desc.bin"]
+	count = struct.unpack(">I", desc[4:8])[0]
+	names = ["%d.bin" % i for i in range(count)]
+	if any(n not in files for n in names) or count < 2:
+		return None
+
+	frames = [parse(files[n]) for n in names]
+	if any(f is None for f in frames):
+		return None
+	if any(f[2:4] != frames[0][2:4] for f in frames):
+		return None
+
+	out = dict(files)
+	records = bytearray()
+	for i, frame in enumerate(frames):
+		if i == 0:
+			records += DELTA.pack(0, 0, frame[2], frame[3], FLAG_FULL)
+			continue
+
+		x, y, w, h, flags = delta(frames[0], frame)
+		records += DELTA.pack(x, y, w, h, flags)
+		if w == 0:
+			del out[names[i]]
+		elif not flags:
+			cf, bpp, _, _, pal, rows = frame
+			out[names[i]] = encode(cf, bpp, pal, [row[x:x + w] for row in rows[y:y + h]])
+
+	out["delta.bin"] = bytes(records)
+	return out
+
+
+def main():
+	if len(sys.argv) != 3:
+		print(__doc__)
+		sys.exit(1)
+
+	src, dst = sys.argv[1], sys.argv[2]
+	files = {}
+	for name in os.listdir(src):
+		with open(os.path.join(src, name), "rb") as f:
+			files[name] = f.read()
+
+	out = convert(files)
+	if out is None:
+		print("Not a delta-encodable GIF: %s" % src)
+		sys.exit(1)
+
+	os.makedirs(dst, exist_ok=True)
+	for name, data in out.items():
+		with open(os.path.join(dst, name), "wb") as f:
+			f.write(data)
+
+	before = sum(len(d) for d in files.values())
+	after = sum(len(d) for d in out.values())
+	print("%s: %d -> %d B" % (src, before, after))
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Precomputes the placement of fixed screen layouts, so screens place their objects without a flex layout.
+
+Lays out the rows below like LVGL's flex ROW_WRAP with START alignment would, using glyph widths from the font
+source and image sizes from the image headers, and writes the coordinates into a header of constexpr tables.
+Rerun it when a laid out text, image or font changes.
+
+Usage: layout_gen.py [repo root]
+"""
+
+import os
+import re
+import struct
+import sys
+
+FONT = "main/src/Theme/devin.c"
+IMAGES = "spiffs_image"
+OUTPUT = "main/src/Screens/Theremin/HintLayout.h"
+
+GAP = 3  # [px], pad_column of the rows
+
+
+def text(value):
+	return ("text", value, 0)
+
+
+def img(path, pad_left = 0):
+	return ("img", path, pad_left)
+
+
+# Name: (row width, pieces)
+LAYOUTS = {
+	"Vertical": (60, [
+		text("Tilt"), img("theremin/up.bin", 1), img("theremin/down.bin"), text("to change"), text("the number"), text("of tones")
+	]),
+	"Horizontal": (80, [
+		text("Tilt"), img("theremin/left.bin", 1), img("theremin/right.bin"), text("to change"), text("base frequency")
+	]),
+}
+
+
+def load_font(path):
+	"""Returns (glyph widths by character, line height), for a single FORMAT0_TINY range like lv_font_conv emits."""
+	with open(path) as f:
+		src = f.read()
+
+	advances = [int(a) for a in re.findall(r"\.adv_w\s*=\s*(\d+)", src)]
+	start = int(re.search(r"\.range_start\s*=\s*(\d+)", src).group(1))
+	length = int(re.search(r"\.range_length\s*=\s*(\d+)", src).group(1))
+	first = int(re.search(r"\.glyph_id_start\s*=\s*(\d+)", src).group(1))
+	line_height = int(re.search(r"\.line_height\s*=\s*(\d+)", src).group(1))
+
+	# Advances are in 1/16 px and rounded per glyph, like lv_font_get_glyph_width
+	widths = { chr(start + i): (advances[first + i] + 8) >> 4 for i in range(length) }
+	return widths, line_height
+
+
+def image_size(path):
+	with open(path, "rb") as f:
+		header = struct.unpack("<I", f.read(4))[0]
+	return (header >> 10) & 0x7FF, (header >> 21) & 0x7FF
+
+
+def layout(root, font, width, pieces):
+	widths, line_height = font
+
+	sized = []
+	for kind, value, pad_left in pieces:
+		if kind == "text":
+			w, h = sum(widths[c] for c in value), line_height
+		else:
+			w, h = image_size(os.path.join(root, IMAGES, value))
+		sized.append((kind, value, pad_left, w + pad_left, h))
+
+	# Rows fill up until the next piece would overrun the width, each row is as tall as its tallest piece
+	placed = []
+	x = y = row_height = 0
+	for kind, value, pad_left, w, h in sized:
+		if x > 0 and x + w > width:
+			x = 0
+			y += row_height
+			row_height = 0
+		placed.append((kind, value, pad_left, x, y))
+		x += w + GAP
+		row_height = max(row_height, h)
+
+	return placed
+
+
+def emit(layouts):
+	out = [
+		"#ifndef CLOCKSTAR_FIRMWARE_HINTLAYOUT_H",
+		"#define CLOCKSTAR_FIRMWARE_HINTLAYOUT_H",
+		"",
+		"#include <lvgl.h>",
+		"",
+		"// Generated by tools/layout_gen.py, don't edit",
+		"",
+		"/**",
+		" * Placement of Theremin's hint rows within their containers. Each piece is either text in devin or an image,",
+		" * images with a gap get the ThereminArrow style.",
+		" */",
+		"namespace HintLayout {",
+		"",
+		"\tstruct Piece {",
+		"\t\tconst char* text;",
+		"\t\tconst char* img;",
+		"\t\tlv_coord_t x;",
+		"\t\tlv_coord_t y;",
+		"\t\tbool gap;",
+		"\t};",
+	]
+
+	for name, (width, placed) in layouts.items():
+		out.append("")
+		out.append("\tconstexpr lv_coord_t {}Width = {};".format(name, width))
+		out.append("\tconstexpr Piece {}[] = {{".format(name))
+		for kind, value, pad_left, x, y in placed:
+			if kind == "text":
+				piece = "\"{}\", nullptr".format(value)
+			else:
+				piece = "nullptr, \"S:/{}\"".format(value)
+			out.append("\t\t\t{{ {}, {}, {}, {} }},".format(piece, x, y, "true" if pad_left else "false"))
+		out.append("\t};")
+
+	out += [
+		"",
+		"}",
+		"",
+		"",
+		"#endif //CLOCKSTAR_FIRMWARE_HINTLAYOUT_H",
+		"",
+	]
+	return "\n".join(out)
+
+
+def main():
+	root = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+	font = load_font(os.path.join(root, FONT))
+	layouts = { name: (width, layout(root, font, width, pieces)) for name, (width, pieces) in LAYOUTS.items() }
+
+	with open(os.path.join(root, OUTPUT), "w") as f:
+		f.write(emit(layouts))
+
+
+if __name__ == "__main__":
+	main()
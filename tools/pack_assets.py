@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""Packs a directory tree into the AssetBundle format read by main/src/Util/AssetBundle.cpp.
+
+Usage: pack_assets.py [--compress] [--gif-delta] <input dir> <output file>
+
+With --compress, files that shrink by at least a quarter are stored as LZ4 blocks.
+With --gif-delta, GIF directories are delta-encoded with gif_delta.py where that makes them smaller.
+"""
+
+import os
+import struct
+import sys
+
+import gif_delta
+
+MAGIC = 0x42415343  # "CSAB"
+VERSION = 2
+ALIGN = 4
+
+COMPRESS_MIN_SIZE = 512  # [B]
+COMPRESS_MAX_RATIO = 0.75
+
+HEADER = struct.Struct("<IHHII")
+ENTRY = struct.Struct("<IIIII")
+
+
+def fnv1a(data):
+	h = 2166136261
+	for b in data:
+		h ^= b
+		h = (h * 16777619) & 0xFFFFFFFF
+	return h
+
+
+def lz4_compress(data):
+	"""Greedy LZ4 block compressor, output is decodable by any LZ4 block decoder."""
+	MIN_MATCH = 4
+	LAST_LITERALS = 5
+	MF_LIMIT = 12
+
+	out = bytearray()
+	table = {}
+	anchor = 0
+	pos = 0
+	end = len(data)
+
+	def emit(literals, match_len, offset):
+		lit_len = len(literals)
+		token = (min(lit_len, 15) << 4) | (min(match_len - MIN_MATCH, 15) if match_len else 0)
+		out.append(token)
+		if lit_len >= 15:
+			rest = lit_len - 15
+			while rest >= 255:
+				out.append(255)
+				rest -= 255
+			out.append(rest)
+		out.extend(literals)
+		if not match_len:
+			return
+		out.extend(struct.pack("<H", offset))
+		if match_len - MIN_MATCH >= 15:
+			rest = match_len - MIN_MATCH - 15
+			while rest >= 255:
+				out.append(255)
+				rest -= 255
+			out.append(rest)
+
+	while pos + MF_LIMIT < end:
+		key = data[pos:pos + MIN_MATCH]
+		candidate = table.get(key)
+		table[key] = pos
+		if candidate is None or pos - candidate > 0xFFFF:
+			pos += 1
+			continue
+
+		length = MIN_MATCH
+		limit = end - LAST_LITERALS
+		while pos + length < limit and data[candidate + length] == data[pos + length]:
+			length += 1
+
+		emit(data[anchor:pos], length, pos - candidate)
+		pos += length
+		anchor = pos
+
+	emit(data[anchor:], 0, 0)
+	return bytes(out)
+
+
+def align(value):
+	return (value + ALIGN - 1) & ~(ALIGN - 1)
+
+
+def collect(root, delta):
+	"""Returns [(relative path, contents)]."""
+	files = []
+	for dirpath, _, filenames in os.walk(root):
+		contents = {}
+		for name in filenames:
+			with open(os.path.join(dirpath, name), "rb") as f:
+				contents[name] = f.read()
+
+		if delta and "desc.bin" in contents:
+			converted = gif_delta.convert(contents)
+			if converted is not None and sum(map(len, converted.values())) < sum(map(len, contents.values())):
+				contents = converted
+
+		prefix = "/" + os.path.relpath(dirpath, root).replace(os.sep, "/")
+		prefix = "" if prefix == "/." else prefix
+		for name, data in contents.items():
+			files.append((prefix + "/" + name, data))
+	return files
+
+
+def main():
+	args = sys.argv[1:]
+	compress = "--compress" in args
+	delta = "--gif-delta" in args
+	args = [a for a in args if a not in ("--compress", "--gif-delta")]
+	if len(args) != 2:
+		print(__doc__)
+		sys.exit(1)
+
+	root, output = args
+	files = collect(root, delta)
+
+	entries = []
+	for rel, data in files:
+		path = rel.encode()
+		entries.append((fnv1a(path), path, data))
+	entries.sort(key=lambda e: (e[0], e[1]))
+
+	strings = bytearray()
+	path_offsets = []
+	strings_start = HEADER.size + ENTRY.size * len(entries)
+	for _, path, _ in entries:
+		path_offsets.append(strings_start + len(strings))
+		strings += path + b"\0"
+
+	compressed = 0
+	blobs = bytearray()
+	blobs_start = align(strings_start + len(strings))
+	index = bytearray()
+	for (h, _, data), path_offset in zip(entries, path_offsets):
+		raw_size = len(data)
+		stored = data
+		if compress and raw_size >= COMPRESS_MIN_SIZE:
+			packed = lz4_compress(data)
+			if len(packed) <= raw_size * COMPRESS_MAX_RATIO:
+				stored = packed
+				compressed += 1
+		offset = blobs_start + len(blobs)
+		index += ENTRY.pack(h, path_offset, offset, len(stored), raw_size)
+		blobs += stored
+		blobs += b"\0" * (align(len(blobs)) - len(blobs))
+
+	total = blobs_start + len(blobs)
+	out = bytearray(HEADER.pack(MAGIC, VERSION, 0, len(entries), total))
+	out += index
+	out += strings
+	out += b"\0" * (blobs_start - len(out))
+	out += blobs
+
+	os.makedirs(os.path.dirname(os.path.abspath(output)), exist_ok=True)
+	with open(output, "wb") as f:
+		f.write(out)
+
+	print("Packed %d assets (%d compressed), %d B" % (len(entries), compressed, total))
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Checks a replay run (firmware built with CONFIG_CM_REPLAY) against a stored baseline.
+
+The run is read from a log file, e.g. saved idf.py monitor output, or captured from a serial port, which needs
+pyserial. Capturing waits for the next complete run. The last complete run in the input is used.
+
+Every scenario has to pass its on-device budget, and with a baseline its frame time and latency percentiles may not
+grow by more than the tolerance over the baseline's, plus SLACK for the timer resolution. --record writes the run as
+the new baseline instead of comparing. Exits with 1 if any check fails, so it can gate a build.
+
+Usage: replay_check.py <log file | serial port> [--baseline file.json | --record file.json] [--tolerance 0.15] [--baud 115200]
+"""
+
+import argparse
+import json
+import os
+import sys
+
+FIELDS = [ "frames", "frame_p50", "frame_p95", "frame_p99", "frame_max", "inputs", "latency_p50", "latency_p95", "latency_max" ]
+
+# Percentiles held against the baseline, maxima are a single frame and too noisy to gate on
+CHECKED = [ "frame_p50", "frame_p95", "frame_p99", "latency_p50", "latency_p95" ]
+
+SLACK = 500  # [us]
+
+
+def capture(port, baud):
+	import serial
+
+	with serial.Serial(port, baud, timeout = 120) as ser:
+		ser.reset_input_buffer()
+
+		lines = []
+		started = False
+		while True:
+			line = ser.readline()
+			if not line:
+				raise RuntimeError("Timed out waiting for a replay run")
+			line = line.decode(errors = "replace").strip()
+			if line.startswith("REPLAY:begin:"):
+				started = True
+				lines = []
+			if started:
+				lines.append(line)
+			if started and line.startswith("REPLAY:end:"):
+				return lines
+
+
+def parse(lines):
+	"""Returns (build, { scenario: result }) of the last complete run in lines."""
+	run = None
+	start = None
+	for i, line in enumerate(lines):
+		if line.startswith("REPLAY:begin:"):
+			start = i
+		elif line.startswith("REPLAY:end:") and start is not None:
+			run = lines[start:i + 1]
+	if run is None:
+		raise RuntimeError("No complete replay run found")
+
+	build = run[0].split(":", 2)[2]
+	scenarios = {}
+	for line in run[1:-1]:
+		if not line.startswith("REPLAY:"):
+			continue
+		fields = line.split(":")
+		if len(fields) != len(FIELDS) + 3:
+			continue
+		result = dict(zip(FIELDS, map(int, fields[2:-1])))
+		result["pass"] = fields[-1] == "PASS"
+		scenarios[fields[1]] = result
+
+	return build, scenarios
+
+
+def compare(scenarios, baseline, tolerance):
+	"""Prints a line per check and returns whether all of them passed."""
+	ok = True
+	for name, result in scenarios.items():
+		if not result["pass"]:
+			print("FAIL %-12s over its on-device budget" % name)
+			ok = False
+
+		base = baseline.get(name)
+		if base is None:
+			print("NEW  %-12s not in the baseline" % name)
+			continue
+
+		for field in CHECKED:
+			limit = base[field] * (1 + tolerance) + SLACK
+			status = "ok  " if result[field] <= limit else "FAIL"
+			if status == "FAIL":
+				ok = False
+			print("%s %-12s %-12s %8d us  baseline %8d us  %+6.1f%%" % (status, name, field, result[field], base[field],
+					(result[field] - base[field]) * 100.0 / max(base[field], 1)))
+
+	for name in baseline:
+		if name not in scenarios:
+			print("FAIL %-12s missing from the run" % name)
+			ok = False
+
+	return ok
+
+
+def main():
+	parser = argparse.ArgumentParser(description = "Checks a replay run against a stored baseline.")
+	parser.add_argument("source", help = "log file or serial port")
+	group = parser.add_mutually_exclusive_group()
+	group.add_argument("--baseline", help = "baseline JSON to compare against")
+	group.add_argument("--record", help = "write the run as a baseline JSON")
+	parser.add_argument("--tolerance", type = float, default = 0.15, help = "allowed growth over the baseline")
+	parser.add_argument("--baud", type = int, default = 115200)
+	args = parser.parse_args()
+
+	if os.path.isfile(args.source):
+		with open(args.source, errors = "replace") as f:
+			lines = [line.strip() for line in f]
+	else:
+		lines = capture(args.source, args.baud)
+
+	build, scenarios = parse(lines)
+	print("Build %s, %d scenarios" % (build, len(scenarios)))
+
+	if args.record:
+		with open(args.record, "w") as f:
+			json.dump({ "build": build, "scenarios": scenarios }, f, indent = "\t")
+		print("Baseline written to %s" % args.record)
+		sys.exit(0 if all(result["pass"] for result in scenarios.values()) else 1)
+
+	baseline = {}
+	if args.baseline:
+		with open(args.baseline) as f:
+			stored = json.load(f)
+		print("Baseline build %s" % stored["build"])
+		baseline = stored["scenarios"]
+
+	ok = compare(scenarios, baseline, args.tolerance)
+	print("PASS" if ok else "FAIL")
+	sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+	main()
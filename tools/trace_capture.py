@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Converts a trace dump (firmware built with CONFIG_CM_TRACE, 't' on the serial console) into a Chrome trace JSON.
+
+Open the output in Perfetto (ui.perfetto.dev) or chrome://tracing. Every task gets a thread track, each event's core
+is in its args, spans recorded from ISRs show up on an ISR track per core.
+
+The dump is either read from a log file, e.g. saved idf.py monitor output, or captured from a serial port, which
+needs pyserial. Capturing sends 't' itself and stops at the end marker.
+
+Usage: trace_capture.py <log file | serial port> <output.json> [baud]
+"""
+
+import json
+import os
+import sys
+
+PHASES = { "B": "B", "E": "E", "I": "i" }
+
+
+def capture(port, baud):
+	import serial
+
+	with serial.Serial(port, baud, timeout = 10) as ser:
+		ser.reset_input_buffer()
+		ser.write(b"t")
+
+		lines = []
+		while True:
+			line = ser.readline()
+			if not line:
+				raise RuntimeError("Timed out waiting for the trace dump")
+			line = line.decode(errors = "replace").strip()
+			lines.append(line)
+			if line.startswith("TRACE:end:"):
+				return lines
+
+
+def convert(lines):
+	"""Returns the Chrome trace event list for the last complete dump in lines."""
+	start = None
+	for i, line in enumerate(lines):
+		if line.startswith("TRACE:begin:"):
+			start = i
+	if start is None:
+		raise RuntimeError("No trace dump found")
+
+	tasks = {}
+	records = []
+	for line in lines[start + 1:]:
+		if not line.startswith("TRACE:"):
+			continue
+		fields = line.split(":", 5)
+		if fields[1] == "end":
+			break
+		if fields[1] == "task":
+			tasks[fields[2]] = fields[3]
+			continue
+		if len(fields) != 6 or fields[3] not in PHASES:
+			continue
+		core, task, phase, time, name = fields[1:]
+		records.append((int(time), int(core), task, PHASES[phase], name))
+
+	if not records:
+		return []
+
+	records.sort()
+	base = records[0][0]
+
+	# Tasks without affinity migrate between cores, so threads are keyed by task alone and the core goes in args.
+	# ISRs get a thread per core, with their core number as the id, which no task handle can be.
+	events = []
+	threads = {}
+	for time, core, task, phase, name in records:
+		handle = int(task, 16) if task.startswith("0x") else 0
+		if handle == 0:
+			tid = core
+			threads[tid] = "ISR core %d" % core
+		else:
+			tid = handle
+			threads[tid] = tasks.get(task, "task " + task)
+		event = { "name": name, "ph": phase, "ts": time - base, "pid": 0, "tid": tid, "args": { "core": core } }
+		if phase == "i":
+			event["s"] = "t"
+		events.append(event)
+
+	events.append({ "name": "process_name", "ph": "M", "pid": 0, "args": { "name": "Clockstar" } })
+	for tid, name in threads.items():
+		events.append({ "name": "thread_name", "ph": "M", "pid": 0, "tid": tid, "args": { "name": name } })
+
+	return events
+
+
+def main():
+	if len(sys.argv) < 3:
+		print(__doc__)
+		sys.exit(1)
+
+	source, output = sys.argv[1], sys.argv[2]
+	baud = int(sys.argv[3]) if len(sys.argv) > 3 else 115200
+
+	if os.path.isfile(source):
+		with open(source, errors = "replace") as f:
+			lines = [line.strip() for line in f]
+	else:
+		lines = capture(source, baud)
+
+	events = convert(lines)
+	with open(output, "w") as f:
+		json.dump({ "traceEvents": events, "displayTimeUnit": "ms" }, f)
+
+	print("%d events written to %s" % (len(events), output))
+
+
+if __name__ == "__main__":
+	main()